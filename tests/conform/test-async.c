@@ -0,0 +1,302 @@
+#include <glib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <xgen.h>
+#include <xgen-dispatch.h>
+#include <xgen-async.h>
+
+#include "test-xgen-common.h"
+
+#define MAX_ANSWERS 8
+
+typedef struct _Answer
+{
+  guint64		 sequence;
+  const XGenDefinition	*definition;
+  gboolean		 has_data;
+} Answer;
+
+typedef struct _AsyncLog
+{
+  Answer	     answers[MAX_ANSWERS];
+  guint		     n_answers;
+
+  const XGenEvent   *last_event;
+  guint		     n_events;
+
+  guint64	     error_sequence;
+  const XGenError   *last_error;
+  guint		     n_errors;
+
+  GMainLoop	    *loop;
+  gboolean	     closed;
+} AsyncLog;
+
+static void
+log_answer (XGenReplyDispatcher *dispatcher,
+	    guint64 sequence,
+	    const XGenDefinition *definition,
+	    const guint8 *data,
+	    gsize len,
+	    void *user_data)
+{
+  AsyncLog *log = user_data;
+  Answer *answer;
+
+  g_assert_cmpuint (log->n_answers, <, MAX_ANSWERS);
+  answer = &log->answers[log->n_answers++];
+  answer->sequence = sequence;
+  answer->definition = definition;
+  answer->has_data = data != NULL;
+
+  if (data)
+    g_assert_cmpuint (data[2] | data[3] << 8, ==, sequence & 0xffff);
+}
+
+static void
+log_event (XGenReplyDispatcher *dispatcher,
+	   const XGenEvent *event,
+	   const guint8 *data,
+	   gsize len,
+	   void *user_data)
+{
+  AsyncLog *log = user_data;
+
+  log->last_event = event;
+  log->n_events++;
+}
+
+static void
+log_error (XGenReplyDispatcher *dispatcher,
+	   guint64 sequence,
+	   const XGenError *error,
+	   const guint8 *data,
+	   void *user_data)
+{
+  AsyncLog *log = user_data;
+
+  log->error_sequence = sequence;
+  log->last_error = error;
+  log->n_errors++;
+}
+
+static void
+log_closed (XGenReplyDispatcher *dispatcher, void *user_data)
+{
+  AsyncLog *log = user_data;
+
+  log->closed = TRUE;
+  g_main_loop_quit (log->loop);
+}
+
+static const XGenReplyHandlers log_handlers = {
+  log_event,
+  log_error,
+  log_closed
+};
+
+/* Fills in a 32 byte server message in LSB first order */
+static void
+make_message (guint8 *message, guint8 type, guint8 detail, guint16 sequence)
+{
+  memset (message, 0, 32);
+  message[0] = type;
+  message[1] = detail;
+  message[2] = sequence & 0xff;
+  message[3] = sequence >> 8;
+}
+
+void
+test_async_feed (TestXGENSimpleFixture *fixture,
+		 gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenRequest *map_window =
+    test_xgen_find_request (shared_state, "xproto:MapWindow");
+  const XGenRequest *get_input_focus =
+    test_xgen_find_request (shared_state, "xproto:GetInputFocus");
+  XGenDispatch *dispatch = xgen_dispatch_new (shared_state->state);
+  XGenReplyDispatcher *dispatcher;
+  AsyncLog log;
+  guint8 message[32];
+
+  memset (&log, 0, sizeof (log));
+  dispatcher = xgen_reply_dispatcher_new (dispatch, -1, XGEN_LSB_FIRST);
+  xgen_reply_dispatcher_set_handlers (dispatcher, &log_handlers, &log);
+
+  g_assert_cmpuint (xgen_reply_dispatcher_add_request (dispatcher, map_window,
+						       log_answer, &log),
+		    ==, 1);
+  g_assert_cmpuint (xgen_reply_dispatcher_add_request (dispatcher,
+						       get_input_focus,
+						       NULL, NULL),
+		    ==, 2);
+  xgen_reply_dispatcher_add_request (dispatcher, get_input_focus,
+				     log_answer, &log);
+  xgen_reply_dispatcher_add_request (dispatcher, map_window,
+				     log_answer, &log);
+  xgen_reply_dispatcher_add_request (dispatcher, get_input_focus,
+				     log_answer, &log);
+  g_assert_cmpuint (xgen_reply_dispatcher_get_n_pending (dispatcher), ==, 4);
+
+  /* The reply to request 3 arrives in two parts; requests 1 and 2
+   * completed without a reply */
+  make_message (message, 1, 0, 3);
+  xgen_reply_dispatcher_feed (dispatcher, message, 10);
+  g_assert_cmpuint (log.n_answers, ==, 0);
+  xgen_reply_dispatcher_feed (dispatcher, message + 10, 22);
+  g_assert_cmpuint (log.n_answers, ==, 2);
+  g_assert_cmpuint (log.answers[0].sequence, ==, 1);
+  g_assert (log.answers[0].definition == NULL);
+  g_assert (!log.answers[0].has_data);
+  g_assert_cmpuint (log.answers[1].sequence, ==, 3);
+  g_assert (log.answers[1].definition
+	    == test_xgen_find_definition (shared_state, "xproto:GetInputFocus",
+					  XGEN_REPLY));
+  g_assert (log.answers[1].has_data);
+  g_assert_cmpuint (xgen_reply_dispatcher_get_n_pending (dispatcher), ==, 2);
+
+  /* A Window error for request 4 followed by an event */
+  make_message (message, 0, 3, 4);
+  xgen_reply_dispatcher_feed (dispatcher, message, 32);
+  g_assert_cmpuint (log.n_answers, ==, 3);
+  g_assert_cmpuint (log.answers[2].sequence, ==, 4);
+  g_assert (log.answers[2].definition
+	    == test_xgen_find_definition (shared_state, "xproto:Window",
+					  XGEN_ERROR));
+  g_assert (log.answers[2].has_data);
+  g_assert_cmpuint (log.n_errors, ==, 0);
+  g_assert_cmpuint (xgen_reply_dispatcher_get_n_pending (dispatcher), ==, 1);
+
+  make_message (message, 0x80 | 22, 0, 4);
+  xgen_reply_dispatcher_feed (dispatcher, message, 32);
+  g_assert_cmpuint (log.n_events, ==, 1);
+  g_assert (XGEN_DEF (log.last_event)
+	    == test_xgen_find_definition (shared_state,
+					  "xproto:ConfigureNotify",
+					  XGEN_EVENT));
+  /* Unknown event codes are passed on without a definition */
+  make_message (message, 127, 0, 4);
+  xgen_reply_dispatcher_feed (dispatcher, message, 32);
+  g_assert_cmpuint (log.n_events, ==, 2);
+  g_assert (log.last_event == NULL);
+  g_assert_cmpuint (log.n_answers, ==, 3);
+
+  /* Errors for requests without a callback go to the error handler, and
+   * retire request 5 */
+  xgen_reply_dispatcher_add_request (dispatcher, map_window, NULL, NULL);
+  make_message (message, 0, 3, 6);
+  xgen_reply_dispatcher_feed (dispatcher, message, 32);
+  g_assert_cmpuint (log.n_answers, ==, 4);
+  g_assert_cmpuint (log.answers[3].sequence, ==, 5);
+  g_assert (!log.answers[3].has_data);
+  g_assert_cmpuint (log.n_errors, ==, 1);
+  g_assert_cmpuint (log.error_sequence, ==, 6);
+  g_assert (XGEN_DEF (log.last_error)
+	    == test_xgen_find_definition (shared_state, "xproto:Window",
+					  XGEN_ERROR));
+  g_assert_cmpuint (xgen_reply_dispatcher_get_n_pending (dispatcher), ==, 0);
+
+  xgen_reply_dispatcher_free (dispatcher);
+  xgen_dispatch_free (dispatch);
+}
+
+void
+test_async_sequence_wrap (TestXGENSimpleFixture *fixture,
+			  gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenRequest *get_input_focus =
+    test_xgen_find_request (shared_state, "xproto:GetInputFocus");
+  XGenDispatch *dispatch = xgen_dispatch_new (shared_state->state);
+  XGenReplyDispatcher *dispatcher;
+  AsyncLog log;
+  guint8 message[32];
+  guint64 sequence;
+  guint i;
+
+  memset (&log, 0, sizeof (log));
+  dispatcher = xgen_reply_dispatcher_new (dispatch, -1, XGEN_LSB_FIRST);
+  xgen_reply_dispatcher_set_handlers (dispatcher, &log_handlers, &log);
+
+  /* Enough cookies to grow the ring, each answered in turn */
+  for (i = 0; i < 100; i++)
+    xgen_reply_dispatcher_add_request (dispatcher, get_input_focus,
+				       log_answer, &log);
+  g_assert_cmpuint (xgen_reply_dispatcher_get_n_pending (dispatcher), ==, 100);
+  for (i = 1; i <= 100; i++)
+    {
+      make_message (message, 1, 0, i);
+      xgen_reply_dispatcher_feed (dispatcher, message, 32);
+      g_assert_cmpuint (log.answers[0].sequence, ==, i);
+      log.n_answers = 0;
+    }
+  g_assert_cmpuint (xgen_reply_dispatcher_get_n_pending (dispatcher), ==, 0);
+
+  /* Only the low 16 bits of the sequence number are sent */
+  for (i = 0; i < 70000; i++)
+    xgen_reply_dispatcher_add_request (dispatcher, get_input_focus,
+				       NULL, NULL);
+  sequence = xgen_reply_dispatcher_add_request (dispatcher, get_input_focus,
+						log_answer, &log);
+  g_assert_cmpuint (sequence, ==, 70101);
+  make_message (message, 1, 0, sequence & 0xffff);
+  xgen_reply_dispatcher_feed (dispatcher, message, 32);
+  g_assert_cmpuint (log.n_answers, ==, 1);
+  g_assert_cmpuint (log.answers[0].sequence, ==, sequence);
+
+  xgen_reply_dispatcher_free (dispatcher);
+  xgen_dispatch_free (dispatch);
+}
+
+void
+test_async_attach (TestXGENSimpleFixture *fixture,
+		   gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenRequest *get_input_focus =
+    test_xgen_find_request (shared_state, "xproto:GetInputFocus");
+  XGenDispatch *dispatch = xgen_dispatch_new (shared_state->state);
+  XGenReplyDispatcher *dispatcher;
+  AsyncLog log;
+  guint8 messages[3][32];
+  int fds[2];
+
+  g_assert (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  memset (&log, 0, sizeof (log));
+  log.loop = g_main_loop_new (NULL, FALSE);
+  dispatcher = xgen_reply_dispatcher_new (dispatch, fds[0], XGEN_LSB_FIRST);
+  xgen_reply_dispatcher_set_handlers (dispatcher, &log_handlers, &log);
+  g_assert_cmpuint (xgen_reply_dispatcher_attach (dispatcher, NULL), >, 0);
+
+  xgen_reply_dispatcher_add_request (dispatcher, get_input_focus,
+				     log_answer, &log);
+  xgen_reply_dispatcher_add_request (dispatcher, get_input_focus,
+				     log_answer, &log);
+
+  /* A reply with 4 bytes of extra data, an event and a reply */
+  make_message (messages[0], 1, 0, 1);
+  messages[0][4] = 1;
+  make_message (messages[1], 22, 0, 1);
+  make_message (messages[2], 1, 0, 2);
+  g_assert (write (fds[1], messages[0], 32) == 32);
+  g_assert (write (fds[1], "\0\0\0\0", 4) == 4);
+  g_assert (write (fds[1], messages[1], 32) == 32);
+  g_assert (write (fds[1], messages[2], 32) == 32);
+  close (fds[1]);
+
+  g_main_loop_run (log.loop);
+  g_assert (log.closed);
+  g_assert_cmpuint (log.n_answers, ==, 2);
+  g_assert_cmpuint (log.answers[0].sequence, ==, 1);
+  g_assert_cmpuint (log.answers[1].sequence, ==, 2);
+  g_assert_cmpuint (log.n_events, ==, 1);
+
+  g_main_loop_unref (log.loop);
+  xgen_reply_dispatcher_free (dispatcher);
+  xgen_dispatch_free (dispatch);
+  close (fds[0]);
+}
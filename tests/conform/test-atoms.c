@@ -0,0 +1,181 @@
+#include <glib.h>
+#include <string.h>
+
+#include <xgen.h>
+#include <xgen-dispatch.h>
+#include <xgen-atoms.h>
+
+#include "test-xgen-common.h"
+
+/* The data of the @I'th message the cache passed on */
+#define EMITTED(I) (TEST_XGEN_MESSAGE (emitted, (I))->data)
+
+static guint32
+read_card32 (const guint8 *data)
+{
+  return data[0] | data[1] << 8 | data[2] << 16 | (guint32)data[3] << 24;
+}
+
+static guint16
+read_sequence (const guint8 *message)
+{
+  return message[2] | message[3] << 8;
+}
+
+static gboolean
+intern_atom (XGenAtomCache *cache, const char *name)
+{
+  gsize name_len = strlen (name);
+  guint8 request[16] = { 16, 0, };
+
+  g_assert_cmpuint (name_len, <=, 8);
+  request[2] = 2 + (name_len + 3) / 4;
+  request[4] = name_len;
+  memcpy (request + 8, name, name_len);
+
+  return xgen_atom_cache_handle_request (cache, request, request[2] * 4);
+}
+
+static gboolean
+get_atom_name (XGenAtomCache *cache, guint32 atom)
+{
+  guint8 request[8] = { 17, 0, 2, 0, };
+
+  request[4] = atom & 0xff;
+  request[5] = atom >> 8;
+  return xgen_atom_cache_handle_request (cache, request, sizeof (request));
+}
+
+static gboolean
+send_request (XGenAtomCache *cache, guint8 opcode, guint16 length)
+{
+  guint8 request[8] = { 0, };
+
+  request[0] = opcode;
+  request[2] = length;
+  return xgen_atom_cache_handle_request (cache, request, length * 4);
+}
+
+/* Passes on a 32 byte reply to the InternAtom with server @sequence */
+static void
+reply (XGenAtomCache *cache, guint16 sequence, guint32 atom)
+{
+  guint8 message[32] = { 1, 0, };
+
+  message[2] = sequence & 0xff;
+  message[3] = sequence >> 8;
+  message[8] = atom & 0xff;
+  message[9] = atom >> 8;
+  xgen_atom_cache_handle_message (cache, message, sizeof (message));
+}
+
+void
+test_atoms_cache (TestXGENSimpleFixture *fixture,
+		  gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenDispatch *dispatch = xgen_dispatch_new (shared_state->state);
+  const XGenAtomCacheStats *stats;
+  XGenAtomCache *cache;
+  GArray *emitted = g_array_new (FALSE, FALSE, sizeof (TestXGENMessage));
+
+  cache = xgen_atom_cache_new (shared_state->state, dispatch, XGEN_LSB_FIRST,
+			       test_xgen_record_message, emitted);
+  g_assert (cache);
+  stats = xgen_atom_cache_get_stats (cache);
+
+  /* Request 1 is forwarded and its reply learned */
+  g_assert (!intern_atom (cache, "FOO"));
+  reply (cache, 1, 0x100);
+  g_assert_cmpuint (emitted->len, ==, 1);
+  g_assert_cmpuint (read_sequence (EMITTED (0)), ==, 1);
+  g_assert_cmpuint (stats->n_atoms, ==, 1);
+
+  /* Requests 2 and 3 are answered locally */
+  g_assert (intern_atom (cache, "FOO"));
+  g_assert_cmpuint (emitted->len, ==, 2);
+  g_assert_cmpuint (TEST_XGEN_MESSAGE (emitted, 1)->len, ==, 32);
+  g_assert_cmpuint (EMITTED (1)[0], ==, 1);
+  g_assert_cmpuint (read_sequence (EMITTED (1)), ==, 2);
+  g_assert_cmpuint (read_card32 (EMITTED (1) + 8), ==, 0x100);
+
+  g_assert (get_atom_name (cache, 0x100));
+  g_assert_cmpuint (emitted->len, ==, 3);
+  g_assert_cmpuint (TEST_XGEN_MESSAGE (emitted, 2)->len, ==, 36);
+  g_assert_cmpuint (read_sequence (EMITTED (2)), ==, 3);
+  g_assert_cmpuint (read_card32 (EMITTED (2) + 4), ==, 1);
+  g_assert_cmpuint (EMITTED (2)[8], ==, 3);
+  g_assert (memcmp (EMITTED (2) + 32, "FOO", 3) == 0);
+
+  /* MapWindow (4) could still fail, so the InternAtom after it (5) is
+   * forwarded as the server's request 3 */
+  g_assert (!send_request (cache, 8, 2));
+  g_assert (!intern_atom (cache, "FOO"));
+  g_assert_cmpuint (stats->n_unsafe, ==, 1);
+  reply (cache, 3, 0x100);
+  g_assert_cmpuint (emitted->len, ==, 4);
+  g_assert_cmpuint (read_sequence (EMITTED (3)), ==, 5);
+
+  /* After GetInputFocus (6) the answer to request 7 waits for the reply
+   * to 6 */
+  g_assert (!send_request (cache, 43, 1));
+  g_assert (intern_atom (cache, "FOO"));
+  g_assert_cmpuint (emitted->len, ==, 4);
+  reply (cache, 4, 0);
+  g_assert_cmpuint (emitted->len, ==, 6);
+  g_assert_cmpuint (read_sequence (EMITTED (4)), ==, 6);
+  g_assert_cmpuint (read_sequence (EMITTED (5)), ==, 7);
+  g_assert_cmpuint (read_card32 (EMITTED (5) + 8), ==, 0x100);
+
+  /* Unknown atoms are forwarded */
+  g_assert (!get_atom_name (cache, 0x200));
+  g_assert (!intern_atom (cache, "BAR"));
+
+  g_assert_cmpuint (stats->n_requests, ==, 7);
+  g_assert_cmpuint (stats->n_hits, ==, 3);
+  g_assert_cmpuint (stats->n_atoms, ==, 1);
+
+  xgen_atom_cache_free (cache);
+  g_array_free (emitted, TRUE);
+  xgen_dispatch_free (dispatch);
+}
+
+void
+test_atoms_learn_names (TestXGENSimpleFixture *fixture,
+			gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenDispatch *dispatch = xgen_dispatch_new (shared_state->state);
+  XGenAtomCache *cache;
+  GArray *emitted = g_array_new (FALSE, FALSE, sizeof (TestXGENMessage));
+  guint8 message[40] = { 1, 0, 1, 0, 2, 0, 0, 0, 6, 0, };
+
+  cache = xgen_atom_cache_new (shared_state->state, dispatch, XGEN_LSB_FIRST,
+			       test_xgen_record_message, emitted);
+
+  /* A GetAtomName reply teaches the cache the atom of the name */
+  g_assert (!get_atom_name (cache, 0x123));
+  memcpy (message + 32, "WM_FOO", 6);
+  xgen_atom_cache_handle_message (cache, message, sizeof (message));
+  g_assert_cmpuint (xgen_atom_cache_get_stats (cache)->n_atoms, ==, 1);
+
+  g_assert (intern_atom (cache, "WM_FOO"));
+  g_assert_cmpuint (emitted->len, ==, 2);
+  g_assert_cmpuint (read_sequence (EMITTED (1)), ==, 2);
+  g_assert_cmpuint (read_card32 (EMITTED (1) + 8), ==, 0x123);
+
+  /* An error teaches it nothing */
+  g_assert (!intern_atom (cache, "BAR"));
+  memset (message, 0, 32);
+  message[1] = 5;
+  message[2] = 2;
+  xgen_atom_cache_handle_message (cache, message, 32);
+  g_assert_cmpuint (emitted->len, ==, 3);
+  g_assert_cmpuint (read_sequence (EMITTED (2)), ==, 3);
+  g_assert (!intern_atom (cache, "BAR"));
+  g_assert_cmpuint (xgen_atom_cache_get_stats (cache)->n_atoms, ==, 1);
+
+  xgen_atom_cache_free (cache);
+  g_array_free (emitted, TRUE);
+  xgen_dispatch_free (dispatch);
+}
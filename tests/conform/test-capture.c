@@ -0,0 +1,312 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <xgen.h>
+#include <xgen-capture.h>
+
+#include "test-xgen-common.h"
+
+#define N_RECORDS 200
+
+typedef struct _CaptureCount
+{
+  guint	       n_records;
+  guint64      last_sequence;
+  gboolean     in_order;
+  const char  *last_name;
+} CaptureCount;
+
+/* Writes N_RECORDS MapWindow and GetInputFocus requests with sequence
+ * numbers and timestamps 0, 1, 2... and returns the file name */
+static char *
+write_capture (const XGenState *state, gsize max_segment_size)
+{
+  XGenDefinition *map_window =
+    xgen_state_find_definition (state, "xproto:MapWindow", XGEN_REQUEST);
+  XGenDefinition *get_input_focus =
+    xgen_state_find_definition (state, "xproto:GetInputFocus", XGEN_REQUEST);
+  XGenCaptureWriter *writer;
+  char *filename;
+  guint i;
+  int fd;
+
+  g_assert (map_window && get_input_focus);
+
+  fd = g_file_open_tmp ("test-capture-XXXXXX", &filename, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+
+  writer = xgen_capture_writer_new (filename);
+  g_assert (writer);
+  if (max_segment_size)
+    xgen_capture_writer_set_max_segment_size (writer, max_segment_size);
+
+  for (i = 0; i < N_RECORDS; i++)
+    {
+      guint8 data[8] = { 0, };
+      gboolean status;
+
+      if (i % 2)
+	{
+	  data[0] = 43;
+	  data[2] = 1;
+	  status = xgen_capture_writer_append (writer, i,
+					       XGEN_CLIENT_TO_SERVER, i,
+					       get_input_focus, data, 4);
+	}
+      else
+	{
+	  data[0] = 8;
+	  data[2] = 2;
+	  data[4] = i;
+	  status = xgen_capture_writer_append (writer, i,
+					       XGEN_CLIENT_TO_SERVER, i,
+					       map_window, data, 8);
+	}
+      g_assert (status);
+    }
+
+  g_assert (xgen_capture_writer_close (writer));
+
+  return filename;
+}
+
+static gboolean
+count_record (const XGenCaptureRecord *record,
+	      const char *definition_name,
+	      void *user_data)
+{
+  CaptureCount *count = user_data;
+
+  if (count->n_records && record->sequence <= count->last_sequence)
+    count->in_order = FALSE;
+
+  count->n_records++;
+  count->last_sequence = record->sequence;
+  count->last_name = definition_name;
+
+  return TRUE;
+}
+
+static gboolean
+check_record (const XGenCaptureRecord *record,
+	      const char *definition_name,
+	      void *user_data)
+{
+  const guint8 *data = XGEN_CAPTURE_RECORD_DATA (record);
+
+  g_assert_cmpuint (record->timestamp, ==, record->sequence);
+  if (record->sequence % 2)
+    {
+      g_assert_cmpstr (definition_name, ==, "xproto:GetInputFocus");
+      g_assert_cmpuint (record->length, ==, 4);
+      g_assert_cmpuint (data[0], ==, 43);
+    }
+  else
+    {
+      g_assert_cmpstr (definition_name, ==, "xproto:MapWindow");
+      g_assert_cmpuint (record->length, ==, 8);
+      g_assert_cmpuint (data[0], ==, 8);
+      g_assert_cmpuint (data[4], ==, record->sequence & 0xff);
+    }
+
+  return count_record (record, definition_name, user_data);
+}
+
+/* Checks that every segment of @filename, footer included, fits in
+ * @max_segment_size and returns how many there are */
+static guint
+check_segment_sizes (const char *filename, gsize max_segment_size)
+{
+  char *contents;
+  gsize length;
+  gsize pos;
+  guint n_segments = 0;
+
+  g_assert (g_file_get_contents (filename, &contents, &length, NULL));
+  for (pos = 0; pos < length; n_segments++)
+    {
+      const XGenCaptureSegmentHeader *header =
+	(const XGenCaptureSegmentHeader *)(contents + pos);
+
+      g_assert_cmpuint (header->magic, ==, XGEN_CAPTURE_SEGMENT_MAGIC);
+      g_assert_cmpuint (header->size, >, 0);
+      g_assert_cmpuint (header->size, <=, max_segment_size);
+      pos += header->size;
+    }
+  g_assert_cmpuint (pos, ==, length);
+  g_free (contents);
+
+  return n_segments;
+}
+
+void
+test_capture_round_trip (TestXGENSimpleFixture *fixture,
+			 gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  char *filename = write_capture (shared_state->state, 4096);
+  const XGenCaptureRecord *record;
+  XGenCapture *capture;
+  CaptureCount count;
+
+  capture = xgen_capture_open (filename);
+  g_assert (capture);
+
+  /* Each record takes 32 bytes so they can't fit in one segment */
+  g_assert_cmpuint (xgen_capture_get_n_segments (capture), >, 1);
+  g_assert_cmpuint (check_segment_sizes (filename, 4096), ==,
+		    xgen_capture_get_n_segments (capture));
+  g_assert_cmpuint (xgen_capture_get_n_records (capture), ==, N_RECORDS);
+
+  memset (&count, 0, sizeof (count));
+  count.in_order = TRUE;
+  xgen_capture_foreach_record (capture, check_record, &count);
+  g_assert_cmpuint (count.n_records, ==, N_RECORDS);
+  g_assert (count.in_order);
+
+  memset (&count, 0, sizeof (count));
+  count.in_order = TRUE;
+  xgen_capture_foreach_in_time_range (capture, 50, 59, check_record, &count);
+  g_assert_cmpuint (count.n_records, ==, 10);
+  g_assert_cmpuint (count.last_sequence, ==, 59);
+  g_assert (count.in_order);
+
+  memset (&count, 0, sizeof (count));
+  count.in_order = TRUE;
+  xgen_capture_foreach_definition (capture, XGEN_REQUEST,
+				   "xproto:GetInputFocus", 0, G_MAXUINT64,
+				   check_record, &count);
+  g_assert_cmpuint (count.n_records, ==, N_RECORDS / 2);
+  g_assert_cmpstr (count.last_name, ==, "xproto:GetInputFocus");
+  g_assert (count.in_order);
+
+  memset (&count, 0, sizeof (count));
+  xgen_capture_foreach_definition (capture, XGEN_REPLY,
+				   "xproto:GetInputFocus", 0, G_MAXUINT64,
+				   check_record, &count);
+  g_assert_cmpuint (count.n_records, ==, 0);
+
+  record = xgen_capture_find_sequence (capture, 123);
+  g_assert (record);
+  g_assert_cmpuint (record->sequence, ==, 123);
+  g_assert (xgen_capture_find_sequence (capture, N_RECORDS) == NULL);
+
+  xgen_capture_close (capture);
+  g_unlink (filename);
+  g_free (filename);
+}
+
+/* Writes a modified copy of a single segment capture and opens it */
+static XGenCapture *
+open_corrupt_copy (const char *filename,
+		   const guint8 *contents,
+		   gsize length,
+		   guint *n_warnings)
+{
+  TestXGENWarnings warnings;
+  XGenCapture *capture;
+
+  g_assert (g_file_set_contents (filename, (const char *)contents, length,
+				 NULL));
+
+  test_xgen_warnings_begin (&warnings);
+  capture = xgen_capture_open (filename);
+  *n_warnings = test_xgen_warnings_end (&warnings);
+
+  g_assert (capture);
+  return capture;
+}
+
+void
+test_capture_bounds (TestXGENSimpleFixture *fixture,
+		     gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  char *filename = write_capture (shared_state->state, 0);
+  const XGenCaptureTrailer *trailer;
+  XGenCaptureFooter *footer;
+  XGenCaptureIndexEntry *time_index;
+  XGenCaptureRecord *record;
+  TestXGENWarnings warnings;
+  XGenCapture *capture;
+  CaptureCount count;
+  char *contents;
+  guint8 *copy;
+  gsize length;
+  guint n_warnings;
+
+  g_assert (g_file_get_contents (filename, &contents, &length, NULL));
+  trailer = (const XGenCaptureTrailer *)
+    (contents + length - sizeof (XGenCaptureTrailer));
+  g_assert_cmpuint (trailer->segment_size, ==, length);
+
+  /* A record whose length runs past the end of the records stops the
+   * iteration at that record */
+  copy = g_memdup (contents, length);
+  record = (XGenCaptureRecord *)
+    (copy + sizeof (XGenCaptureSegmentHeader) + 3 * 32);
+  g_assert_cmpuint (record->sequence, ==, 3);
+  record->length = G_MAXUINT32 - 4;
+  capture = open_corrupt_copy (filename, copy, length, &n_warnings);
+  g_assert_cmpuint (n_warnings, ==, 0);
+
+  memset (&count, 0, sizeof (count));
+  test_xgen_warnings_begin (&warnings);
+  xgen_capture_foreach_record (capture, count_record, &count);
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), ==, 1);
+  g_assert_cmpuint (count.n_records, ==, 3);
+  xgen_capture_close (capture);
+  g_free (copy);
+
+  /* An index entry pointing outside of the records is never followed */
+  copy = g_memdup (contents, length);
+  footer = (XGenCaptureFooter *)(copy + trailer->footer);
+  time_index = (XGenCaptureIndexEntry *)(copy + footer->time_index);
+  time_index[5].record = length;
+  time_index[6].record = trailer->footer;
+  capture = open_corrupt_copy (filename, copy, length, &n_warnings);
+  g_assert_cmpuint (n_warnings, ==, 0);
+
+  memset (&count, 0, sizeof (count));
+  test_xgen_warnings_begin (&warnings);
+  xgen_capture_foreach_in_time_range (capture, 0, G_MAXUINT64,
+				      count_record, &count);
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), ==, 1);
+  g_assert_cmpuint (count.n_records, ==, 5);
+  xgen_capture_close (capture);
+  g_free (copy);
+
+  /* Neither may the footer claim more records than fit in the segment */
+  copy = g_memdup (contents, length);
+  footer = (XGenCaptureFooter *)(copy + trailer->footer);
+  footer->n_records = G_MAXUINT32;
+  capture = open_corrupt_copy (filename, copy, length, &n_warnings);
+  g_assert_cmpuint (n_warnings, ==, 1);
+  g_assert_cmpuint (xgen_capture_get_n_segments (capture), ==, 0);
+  xgen_capture_close (capture);
+  g_free (copy);
+
+  /* Nor index or string offsets that are out of range */
+  copy = g_memdup (contents, length);
+  footer = (XGenCaptureFooter *)(copy + trailer->footer);
+  footer->strings = length;
+  capture = open_corrupt_copy (filename, copy, length, &n_warnings);
+  g_assert_cmpuint (n_warnings, ==, 1);
+  g_assert_cmpuint (xgen_capture_get_n_segments (capture), ==, 0);
+  xgen_capture_close (capture);
+  g_free (copy);
+
+  /* A truncated segment is unfinished */
+  capture = open_corrupt_copy (filename, (guint8 *)contents, length - 8,
+			       &n_warnings);
+  g_assert_cmpuint (n_warnings, ==, 1);
+  g_assert_cmpuint (xgen_capture_get_n_segments (capture), ==, 0);
+  xgen_capture_close (capture);
+
+  g_free (contents);
+  g_unlink (filename);
+  g_free (filename);
+}
@@ -0,0 +1,169 @@
+#include <glib.h>
+#include <string.h>
+
+#include <xgen.h>
+#include <xgen-dispatch.h>
+#include <xgen-coalesce.h>
+
+#include "test-xgen-common.h"
+
+#define MOTION_NOTIFY 6
+#define EXPOSE	      12
+
+/* Builds a little endian event with the given sequence number and the
+ * window at @window_offset */
+static guint8 *
+make_event (guint8 *event,
+	    guint8 code,
+	    guint16 sequence,
+	    guint window_offset,
+	    guint8 window)
+{
+  memset (event, 0, 32);
+  event[0] = code;
+  event[2] = sequence;
+  event[3] = sequence >> 8;
+  event[window_offset] = window;
+  return event;
+}
+
+static guint8 *
+make_expose (guint8 *event,
+	     guint16 sequence,
+	     guint8 window,
+	     guint8 x,
+	     guint8 y,
+	     guint8 width,
+	     guint8 height,
+	     guint8 count)
+{
+  make_event (event, EXPOSE, sequence, 4, window);
+  event[8] = x;
+  event[10] = y;
+  event[12] = width;
+  event[14] = height;
+  event[16] = count;
+  return event;
+}
+
+void
+test_coalesce_events (TestXGENSimpleFixture *fixture,
+		      gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenDispatch *dispatch = xgen_dispatch_new (shared_state->state);
+  GArray *emitted = g_array_new (FALSE, FALSE, sizeof (TestXGENMessage));
+  XGenCoalescer *coalescer =
+    xgen_coalescer_new (shared_state->state, dispatch, XGEN_LSB_FIRST,
+			test_xgen_record_timed_message, emitted);
+  const XGenCoalesceStats *stats;
+  guint8 message[32];
+  TestXGENMessage *e;
+
+  xgen_coalescer_add_default_rules (coalescer);
+
+  /* Motion in the same window keeps the latest event */
+  xgen_coalescer_push (coalescer, make_event (message, MOTION_NOTIFY, 1,
+					      12, 1), 32, 1);
+  xgen_coalescer_push (coalescer, make_event (message, MOTION_NOTIFY, 2,
+					      12, 1), 32, 2);
+  g_assert_cmpuint (emitted->len, ==, 0);
+  /* but not across windows */
+  xgen_coalescer_push (coalescer, make_event (message, MOTION_NOTIFY, 3,
+					      12, 2), 32, 3);
+  g_assert_cmpuint (emitted->len, ==, 1);
+
+  /* Replies pass everything held back on first */
+  make_event (message, 1, 4, 8, 0);
+  xgen_coalescer_push (coalescer, message, 32, 4);
+  g_assert_cmpuint (emitted->len, ==, 3);
+
+  /* An Expose series is merged into its bounding box */
+  xgen_coalescer_push (coalescer, make_expose (message, 5, 1, 10, 10, 5, 5, 2),
+		       32, 5);
+  xgen_coalescer_push (coalescer, make_expose (message, 6, 1, 0, 20, 5, 5, 1),
+		       32, 6);
+  g_assert_cmpuint (emitted->len, ==, 3);
+  xgen_coalescer_push (coalescer, make_expose (message, 7, 1, 30, 0, 1, 1, 0),
+		       32, 7);
+  g_assert_cmpuint (emitted->len, ==, 4);
+
+  /* SendEvent events are passed on as they are */
+  xgen_coalescer_push (coalescer, make_event (message, MOTION_NOTIFY, 8,
+					      12, 1), 32, 8);
+  message[0] |= 0x80;
+  xgen_coalescer_push (coalescer, message, 32, 9);
+  g_assert_cmpuint (emitted->len, ==, 6);
+
+  xgen_coalescer_push (coalescer, make_event (message, MOTION_NOTIFY, 10,
+					      12, 1), 32, 10);
+  g_assert_cmpuint (emitted->len, ==, 6);
+  xgen_coalescer_flush (coalescer);
+  g_assert_cmpuint (emitted->len, ==, 7);
+
+  e = TEST_XGEN_MESSAGE (emitted, 0);
+  g_assert_cmpuint (e->data[2], ==, 2);
+  g_assert_cmpuint (e->timestamp, ==, 2);
+  e = TEST_XGEN_MESSAGE (emitted, 1);
+  g_assert_cmpuint (e->data[2], ==, 3);
+  g_assert_cmpuint (e->data[12], ==, 2);
+  e = TEST_XGEN_MESSAGE (emitted, 2);
+  g_assert_cmpuint (e->data[0], ==, 1);
+
+  e = TEST_XGEN_MESSAGE (emitted, 3);
+  g_assert_cmpuint (e->data[0], ==, EXPOSE);
+  g_assert_cmpuint (e->data[2], ==, 7);
+  g_assert_cmpuint (e->timestamp, ==, 7);
+  g_assert_cmpuint (e->data[8], ==, 0);
+  g_assert_cmpuint (e->data[10], ==, 0);
+  g_assert_cmpuint (e->data[12], ==, 31);
+  g_assert_cmpuint (e->data[14], ==, 25);
+  g_assert_cmpuint (e->data[16], ==, 0);
+
+  e = TEST_XGEN_MESSAGE (emitted, 5);
+  g_assert_cmpuint (e->data[0], ==, 0x80 | MOTION_NOTIFY);
+  g_assert_cmpuint (e->timestamp, ==, 9);
+  e = TEST_XGEN_MESSAGE (emitted, 6);
+  g_assert_cmpuint (e->data[2], ==, 10);
+
+  stats = xgen_coalescer_get_stats (coalescer);
+  g_assert_cmpuint (stats->n_messages, ==, 10);
+  g_assert_cmpuint (stats->n_emitted, ==, 7);
+  g_assert_cmpuint (stats->n_dropped, ==, 1);
+  g_assert_cmpuint (stats->n_merged, ==, 2);
+
+  xgen_coalescer_free (coalescer);
+  g_array_free (emitted, TRUE);
+  xgen_dispatch_free (dispatch);
+}
+
+void
+test_coalesce_invalid_rules (TestXGENSimpleFixture *fixture,
+			     gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenDispatch *dispatch = xgen_dispatch_new (shared_state->state);
+  XGenCoalescer *coalescer =
+    xgen_coalescer_new (shared_state->state, dispatch, XGEN_LSB_FIRST,
+			test_xgen_record_timed_message, NULL);
+  TestXGENWarnings warnings;
+
+  test_xgen_warnings_begin (&warnings);
+  g_assert (!xgen_coalescer_add_rule (coalescer, "xproto:NoSuchNotify",
+				      XGEN_COALESCE_KEEP_LAST, NULL));
+  g_assert (!xgen_coalescer_add_rule (coalescer, "xproto:MotionNotify",
+				      XGEN_COALESCE_KEEP_LAST,
+				      "no_such_field", NULL));
+  /* MotionNotify has no rectangle */
+  g_assert (!xgen_coalescer_add_rule (coalescer, "xproto:MotionNotify",
+				      XGEN_COALESCE_UNION_RECTANGLES,
+				      "event", NULL));
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), ==, 3);
+
+  g_assert (xgen_coalescer_add_rule (coalescer, "xproto:Expose",
+				     XGEN_COALESCE_UNION_RECTANGLES,
+				     "window", NULL));
+
+  xgen_coalescer_free (coalescer);
+  xgen_dispatch_free (dispatch);
+}
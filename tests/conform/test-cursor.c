@@ -0,0 +1,211 @@
+#include <glib.h>
+#include <string.h>
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-list.h>
+
+#include "test-xgen-common.h"
+
+static const char test_xml[] =
+  "<xcb header=\"xgentest\" extension-xname=\"XGEN-TEST\" "
+  "extension-name=\"XGenTest\" major-version=\"1\" minor-version=\"0\">\n"
+  "  <request name=\"Lists\" opcode=\"0\">\n"
+  "    <field type=\"CARD8\" name=\"n_a\" />\n"
+  "    <field type=\"CARD16\" name=\"n_b\" />\n"
+  "    <pad bytes=\"2\" />\n"
+  "    <list type=\"CARD8\" name=\"a\"><fieldref>n_a</fieldref></list>\n"
+  "    <list type=\"CARD16\" name=\"b\"><fieldref>n_b</fieldref></list>\n"
+  "    <field type=\"CARD32\" name=\"after\" />\n"
+  "  </request>\n"
+  "</xcb>\n";
+
+/* Fills in a 32 byte Lists request, with @n_a and @n_b elements counting
+ * up from 1 followed by the value 0x12345678. The fields follow the
+ * major and minor opcodes and the length, so the lists start at 9. */
+static void
+make_lists (guint8 *data, guint8 n_a, guint16 n_b)
+{
+  guint8 *pos = data + 9;
+  guint i;
+
+  memset (data, 0, 32);
+  data[2] = 8;
+  data[4] = n_a;
+  data[5] = n_b & 0xff;
+  data[6] = n_b >> 8;
+
+  for (i = 0; i < n_a; i++)
+    *pos++ = i + 1;
+  for (i = 0; i < n_b && pos + 2 <= data + 32; i++, pos += 2)
+    {
+      pos[0] = i + 1;
+      pos[1] = 0;
+    }
+  if (pos + 4 <= data + 32)
+    memcpy (pos, "\x78\x56\x34\x12", 4);
+}
+
+/* Checks that the cursor agrees with xgen_layout_get_extents() and
+ * xgen_layout_decode() on every field, read last to first */
+static void
+check_message (XGenFieldCursor *cursor,
+	       const XGenLayout *layout,
+	       const guint8 *data,
+	       gsize len)
+{
+  XGenFieldExtent *extents = g_new (XGenFieldExtent, layout->n_fields);
+  GList *values = xgen_layout_decode (layout, data, len, XGEN_LSB_FIRST);
+  gint i;
+
+  g_assert (values);
+  g_assert (xgen_layout_get_extents (layout, data, len, XGEN_LSB_FIRST,
+				     layout->n_fields, extents));
+  g_assert (xgen_field_cursor_reset (cursor, data, len, XGEN_LSB_FIRST));
+
+  for (i = layout->n_fields - 1; i >= 0; i--)
+    {
+      const XGenFieldValue *expected = g_list_nth_data (values, i);
+      XGenFieldExtent extent;
+      XGenFieldValue value;
+
+      g_assert (xgen_field_cursor_get_extent (cursor, i, &extent));
+      g_assert_cmpuint (extent.offset, ==, extents[i].offset);
+      g_assert_cmpuint (extent.size, ==, extents[i].size);
+      g_assert_cmpuint (extent.count, ==, extents[i].count);
+
+      memset (&value, 0, sizeof (value));
+      g_assert (xgen_field_cursor_get_value (cursor, i, &value));
+      g_assert (value.field == expected->field);
+      g_assert_cmpuint (value.offset, ==, expected->offset);
+      g_assert_cmpuint (value.unsigned_value, ==, expected->unsigned_value);
+    }
+
+  xgen_field_values_free (values);
+  g_free (extents);
+}
+
+void
+test_cursor_fields (TestXGENSimpleFixture *fixture,
+		    gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenState *state = test_xgen_parse_extension (shared_state, test_xml);
+  const XGenLayout *layout =
+    xgen_definition_get_layout (xgen_state_find_definition
+				(state, "xgentest:Lists", XGEN_REQUEST));
+  XGenFieldCursor *cursor = xgen_field_cursor_new (layout);
+  gint after = xgen_layout_find_field (layout, "after");
+  gint b = xgen_layout_find_field (layout, "b");
+  guint8 message[32];
+  XGenFieldValue value;
+  XGenList list;
+  guint16 elements[4];
+
+  g_assert (after >= 0 && b >= 0);
+
+  make_lists (message, 3, 2);
+  check_message (cursor, layout, message, sizeof (message));
+
+  /* Nothing is remembered from the previous message */
+  make_lists (message, 1, 4);
+  check_message (cursor, layout, message, sizeof (message));
+  g_assert (xgen_field_cursor_reset (cursor, message, sizeof (message),
+				     XGEN_LSB_FIRST));
+  g_assert (xgen_field_cursor_get_value (cursor, after, &value));
+  g_assert_cmphex (value.unsigned_value, ==, 0x12345678);
+
+  g_assert (xgen_field_cursor_get_list (cursor, b, &list));
+  g_assert_cmpuint (list.count, ==, 4);
+  g_assert_cmpuint (list.element_size, ==, 2);
+  xgen_list_read (&list, elements, sizeof (elements[0]));
+  g_assert_cmpuint (elements[0], ==, 1);
+  g_assert_cmpuint (elements[3], ==, 4);
+
+  make_lists (message, 0, 0);
+  check_message (cursor, layout, message, sizeof (message));
+
+  xgen_field_cursor_free (cursor);
+}
+
+void
+test_cursor_truncated (TestXGENSimpleFixture *fixture,
+		       gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenState *state = test_xgen_parse_extension (shared_state, test_xml);
+  const XGenLayout *layout =
+    xgen_definition_get_layout (xgen_state_find_definition
+				(state, "xgentest:Lists", XGEN_REQUEST));
+  XGenFieldCursor *cursor = xgen_field_cursor_new (layout);
+  gint n_b = xgen_layout_find_field (layout, "n_b");
+  gint a = xgen_layout_find_field (layout, "a");
+  gint b = xgen_layout_find_field (layout, "b");
+  gint after = xgen_layout_find_field (layout, "after");
+  guint8 message[32];
+  TestXGENWarnings warnings;
+  XGenFieldExtent extent;
+  XGenFieldValue value;
+  XGenList list;
+
+  /* The request's length doesn't fit */
+  make_lists (message, 3, 2);
+  g_assert (!xgen_field_cursor_reset (cursor, message, 16,
+				      XGEN_LSB_FIRST));
+
+  /* b runs past the end of the request, but the fields before it can
+   * still be read */
+  make_lists (message, 3, 100);
+  g_assert (xgen_field_cursor_reset (cursor, message, sizeof (message),
+				     XGEN_LSB_FIRST));
+  g_assert (!xgen_field_cursor_get_extent (cursor, after, &extent));
+  g_assert (!xgen_field_cursor_get_extent (cursor, b, &extent));
+  g_assert (!xgen_field_cursor_get_list (cursor, b, &list));
+  g_assert (xgen_field_cursor_get_value (cursor, n_b, &value));
+  g_assert_cmpuint (value.unsigned_value, ==, 100);
+  g_assert (xgen_field_cursor_get_list (cursor, a, &list));
+  g_assert_cmpuint (list.count, ==, 3);
+  g_assert (list.data == message + 9);
+
+  /* Scalars aren't lists */
+  test_xgen_warnings_begin (&warnings);
+  g_assert (!xgen_field_cursor_get_list (cursor, n_b, &list));
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), ==, 1);
+
+  xgen_field_cursor_free (cursor);
+}
+
+void
+test_cursor_reply (TestXGENSimpleFixture *fixture,
+		   gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenLayout *layout =
+    xgen_definition_get_layout (test_xgen_find_definition
+				(shared_state, "xproto:GetProperty",
+				 XGEN_REPLY));
+  XGenFieldCursor *cursor = xgen_field_cursor_new (layout);
+  gint value_field = xgen_layout_find_field (layout, "value");
+  /* A GetProperty reply with 3 32 bit values, most significant first */
+  guint8 reply[44] = { 1, 32, 1, 0,  0, 0, 0, 3, };
+  XGenList list;
+  guint32 values[3];
+
+  g_assert (value_field >= 0);
+  reply[19] = 3;
+  reply[35] = 1;
+  reply[39] = 2;
+  reply[40] = 0x80;
+
+  g_assert (xgen_field_cursor_reset (cursor, reply, sizeof (reply),
+				     XGEN_MSB_FIRST));
+  g_assert (xgen_field_cursor_get_list (cursor, value_field, &list));
+  g_assert_cmpuint (list.count, ==, 3);
+  g_assert_cmpuint (list.element_size, ==, 4);
+  xgen_list_read (&list, values, sizeof (values[0]));
+  g_assert_cmphex (values[0], ==, 1);
+  g_assert_cmphex (values[1], ==, 2);
+  g_assert_cmphex (values[2], ==, 0x80000000);
+
+  xgen_field_cursor_free (cursor);
+}
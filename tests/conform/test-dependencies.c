@@ -0,0 +1,105 @@
+#include <glib.h>
+
+#include <xgen.h>
+#include <xgen-dependencies.h>
+#include <xgen-dispatch.h>
+
+#include "test-xgen-common.h"
+
+void
+test_dependencies_closure (TestXGENSimpleFixture *fixture,
+			   gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenDependencyGraph *graph = xgen_dependency_graph_new (shared_state->state);
+  const XGenDefinition *poly_point =
+    test_xgen_find_definition (shared_state, "xproto:PolyPoint",
+			       XGEN_REQUEST);
+  const XGenDefinition *point =
+    test_xgen_find_definition (shared_state, "xproto:POINT", XGEN_STRUCT);
+  const XGenDefinition *get_input_focus =
+    test_xgen_find_definition (shared_state, "xproto:GetInputFocus",
+			       XGEN_REQUEST);
+  GList *roots;
+  GList *closure;
+
+  g_assert (g_list_find (xgen_dependency_graph_get_dependencies (graph,
+								 poly_point),
+			 point));
+  g_assert (g_list_find (xgen_dependency_graph_get_dependents (graph, point),
+			 poly_point));
+  g_assert (!g_list_find (xgen_dependency_graph_get_dependents (graph,
+								poly_point),
+			  point));
+
+  /* Everything a definition uses comes before it */
+  roots = g_list_append (NULL, (gpointer)poly_point);
+  closure = xgen_dependency_graph_get_closure (graph, roots);
+  g_assert (g_list_last (closure)->data == poly_point);
+  g_assert (g_list_find (closure, point));
+  g_assert (g_list_find (closure,
+			 test_xgen_find_definition (shared_state,
+						    "xproto:GCONTEXT",
+						    XGEN_XID)));
+  g_assert (!g_list_find (closure,
+			  test_xgen_find_definition (shared_state,
+						     "xproto:MapWindow",
+						     XGEN_REQUEST)));
+  g_list_free (closure);
+  g_list_free (roots);
+
+  /* Requests bring their replies */
+  roots = g_list_append (NULL, (gpointer)get_input_focus);
+  closure = xgen_dependency_graph_get_closure (graph, roots);
+  g_assert (g_list_find (closure,
+			 test_xgen_find_definition (shared_state,
+						    "xproto:GetInputFocus",
+						    XGEN_REPLY)));
+  g_list_free (closure);
+  g_list_free (roots);
+
+  xgen_dependency_graph_free (graph);
+}
+
+void
+test_dependencies_pruned_state (TestXGENSimpleFixture *fixture,
+				gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenDefinition *rectangles =
+    test_xgen_find_definition (shared_state, "shape:Rectangles",
+			       XGEN_REQUEST);
+  static const guint8 message[16] = { 129, 1, 4, 0 };
+  GList *roots = g_list_append (NULL, (gpointer)rectangles);
+  XGenState *pruned = xgen_state_new_pruned (shared_state->state, roots);
+  XGenDispatch *dispatch;
+
+  g_list_free (roots);
+
+  /* Only the extensions with kept definitions remain */
+  g_assert (xgen_state_find_extension (pruned, "shape") != NULL);
+  g_assert (xgen_state_find_extension (pruned, "xproto") != NULL);
+  g_assert (xgen_state_find_extension (pruned, "bigreq") == NULL);
+
+  /* The kept definitions are shared with the original state */
+  g_assert (xgen_state_find_definition (pruned, "shape:Rectangles",
+					XGEN_REQUEST) == rectangles);
+  g_assert (xgen_state_find_definition (pruned, "xproto:RECTANGLE",
+					XGEN_STRUCT)
+	    == test_xgen_find_definition (shared_state, "xproto:RECTANGLE",
+					  XGEN_STRUCT));
+  g_assert (xgen_state_find_definition (pruned, "xproto:MapWindow",
+					XGEN_REQUEST) == NULL);
+  g_assert (xgen_state_find_definition (pruned, "shape:QueryVersion",
+					XGEN_REQUEST) == NULL);
+
+  /* A dispatcher for the pruned state finds the kept requests */
+  dispatch = xgen_dispatch_new (pruned);
+  g_assert (xgen_dispatch_add_extension (dispatch, "shape", 129, 64, 0));
+  g_assert (XGEN_DEF (xgen_dispatch_lookup_request (dispatch, message,
+						    sizeof (message)))
+	    == rectangles);
+  xgen_dispatch_free (dispatch);
+
+  xgen_pruned_state_free (pruned);
+}
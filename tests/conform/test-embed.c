@@ -0,0 +1,160 @@
+#include <glib.h>
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-embed.h>
+#include <xgen-names.h>
+
+#include "test-xgen-common.h"
+
+/* Generated by xgen-embed from the files of the shared state */
+extern const XGenEmbeddedState test_xgen_embedded_state;
+
+typedef struct { char c; guint16 value; } Align16;
+typedef struct { char c; double value; } AlignDouble;
+
+void
+test_embed_abi (TestXGENSimpleFixture *fixture,
+		gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenNames *names = xgen_names_new (shared_state->state);
+  guint32 abi = xgen_embed_get_abi ();
+  XGenEmbeddedState embedded;
+  TestXGENWarnings warnings;
+
+  /* The format version is in the top byte and the host byte order in
+   * the next bit */
+  g_assert_cmpuint (abi >> 24, >, 0);
+  g_assert_cmpuint ((abi >> 20) & 1, ==, G_BYTE_ORDER == G_LITTLE_ENDIAN);
+  g_assert_cmpuint ((abi >> 16) & 0xf, ==, G_STRUCT_OFFSET (Align16, value));
+  g_assert_cmpuint (abi & 0xf, ==, G_STRUCT_OFFSET (AlignDouble, value));
+
+  embedded.abi = abi;
+  embedded.state = shared_state->state;
+  embedded.names = names;
+  g_assert (xgen_embedded_state_load (&embedded) == shared_state->state);
+  g_assert (xgen_embedded_state_get_names (&embedded) == names);
+
+  /* Tables generated for another host aren't used */
+  embedded.abi = abi ^ (1 << 20);
+  test_xgen_warnings_begin (&warnings);
+  g_assert (xgen_embedded_state_load (&embedded) == NULL);
+  g_assert (xgen_embedded_state_get_names (&embedded) == NULL);
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), ==, 2);
+
+  embedded.abi = abi + (1 << 24);
+  test_xgen_warnings_begin (&warnings);
+  g_assert (xgen_embedded_state_load (&embedded) == NULL);
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), ==, 1);
+
+  xgen_names_free (names);
+}
+
+static void
+compare_layouts (const XGenLayout *embedded, const XGenLayout *parsed)
+{
+  guint i;
+
+  if (!parsed)
+    {
+      g_assert (embedded == NULL);
+      return;
+    }
+
+  g_assert (embedded != NULL);
+  g_assert_cmpuint (embedded->n_fields, ==, parsed->n_fields);
+  g_assert_cmpuint (embedded->fixed_size, ==, parsed->fixed_size);
+  g_assert_cmpuint (embedded->is_fixed, ==, parsed->is_fixed);
+  g_assert_cmpuint (embedded->min_size, ==, parsed->min_size);
+  g_assert_cmpuint (embedded->alignment, ==, parsed->alignment);
+  g_assert_cmpuint (embedded->matches_host_abi, ==,
+		    parsed->matches_host_abi);
+  g_assert_cmpuint (embedded->is_byte_order_neutral, ==,
+		    parsed->is_byte_order_neutral);
+  g_assert_cmpuint (embedded->is_bounded, ==, parsed->is_bounded);
+  g_assert_cmpuint (embedded->max_size, ==, parsed->max_size);
+
+  for (i = 0; i < parsed->n_fields; i++)
+    {
+      const XGenFieldLayout *embedded_field = &embedded->fields[i];
+      const XGenFieldLayout *parsed_field = &parsed->fields[i];
+
+      g_assert_cmpstr (embedded_field->field->name, ==,
+		       parsed_field->field->name);
+      g_assert_cmpstr (embedded_field->type->name, ==,
+		       parsed_field->type->name);
+      g_assert_cmpuint (embedded_field->kind, ==, parsed_field->kind);
+      g_assert_cmpuint (embedded_field->size, ==, parsed_field->size);
+      g_assert_cmpint (embedded_field->offset, ==, parsed_field->offset);
+      g_assert_cmpuint (embedded_field->fills_remainder, ==,
+			parsed_field->fills_remainder);
+    }
+}
+
+void
+test_embed_compare (TestXGENSimpleFixture *fixture,
+		    gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenState *parsed = shared_state->state;
+  const XGenState *embedded =
+    xgen_embedded_state_load (&test_xgen_embedded_state);
+  const XGenNames *names =
+    xgen_embedded_state_get_names (&test_xgen_embedded_state);
+  GList *tmp, *tmp2;
+
+  g_assert (embedded != NULL && names != NULL);
+  g_assert_cmpuint (g_list_length (embedded->extensions), ==,
+		    g_list_length (parsed->extensions));
+
+  /* Both states list the same extensions and definitions in the same
+   * order */
+  for (tmp = embedded->extensions, tmp2 = parsed->extensions;
+       tmp != NULL;
+       tmp = tmp->next, tmp2 = tmp2->next)
+    {
+      const XGenExtension *embedded_extension = tmp->data;
+      const XGenExtension *parsed_extension = tmp2->data;
+      GList *tmp3, *tmp4;
+
+      g_assert_cmpstr (embedded_extension->header, ==,
+		       parsed_extension->header);
+      g_assert_cmpstr (embedded_extension->name, ==,
+		       parsed_extension->name);
+      g_assert_cmpstr (embedded_extension->xname, ==,
+		       parsed_extension->xname);
+      g_assert_cmphex (xgen_extension_get_fingerprint (embedded_extension),
+		       ==,
+		       xgen_extension_get_fingerprint (parsed_extension));
+      g_assert_cmpuint (g_list_length (embedded_extension->all_definitions),
+			==,
+			g_list_length (parsed_extension->all_definitions));
+
+      for (tmp3 = embedded_extension->all_definitions,
+	     tmp4 = parsed_extension->all_definitions;
+	   tmp3 != NULL;
+	   tmp3 = tmp3->next, tmp4 = tmp4->next)
+	{
+	  const XGenDefinition *embedded_def = tmp3->data;
+	  const XGenDefinition *parsed_def = tmp4->data;
+	  char *name = g_strdup_printf ("%s:%s", parsed_extension->header,
+					parsed_def->name);
+
+	  g_assert_cmpstr (embedded_def->name, ==, parsed_def->name);
+	  g_assert_cmpuint (embedded_def->type, ==, parsed_def->type);
+	  g_assert (embedded_def->extension == embedded_extension);
+	  g_assert_cmphex (xgen_definition_get_fingerprint (embedded_def), ==,
+			   xgen_definition_get_fingerprint (parsed_def));
+	  compare_layouts (xgen_definition_get_layout (embedded_def),
+			   xgen_definition_get_layout (parsed_def));
+
+	  /* The name tables point into the embedded state */
+	  g_assert (xgen_names_find_definition (names, name,
+						parsed_def->type)
+		    == xgen_state_find_definition (embedded, name,
+						   parsed_def->type));
+	  g_free (name);
+	}
+    }
+}
@@ -0,0 +1,250 @@
+#include <glib.h>
+#include <string.h>
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-dispatch.h>
+#include <xgen-encoder.h>
+
+#include "test-xgen-common.h"
+
+#define SHAPE_MAJOR_OPCODE 129
+#define TEST_MAJOR_OPCODE  130
+
+#define OTHER_BYTE_ORDER \
+  (G_BYTE_ORDER == G_LITTLE_ENDIAN ? XGEN_MSB_FIRST : XGEN_LSB_FIRST)
+
+/* Reads a 16 bit value written in the other byte order to the host's */
+static guint
+read_swapped_uint16 (const guint8 *data)
+{
+  guint16 value;
+
+  memcpy (&value, data, 2);
+  return GUINT16_SWAP_LE_BE (value);
+}
+
+void
+test_encoder_round_trip (TestXGENSimpleFixture *fixture,
+			 gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenRequest *request =
+    test_xgen_find_request (shared_state, "xproto:PolyPoint");
+  const XGenLayout *layout = xgen_definition_get_layout (XGEN_DEF (request));
+  static const gint16 points[] = { 1, 2, -1, 4 };
+  XGenEncodeValue values[6];
+  XGenByteOrder byte_orders[] = { XGEN_LSB_FIRST, XGEN_MSB_FIRST };
+  guint i;
+
+  g_assert_cmpuint (layout->n_fields, ==, 6);
+  memset (values, 0, sizeof (values));
+  values[1].value = 1;
+  values[3].value = 0x400001;
+  values[4].value = 0x400002;
+  values[5].count = 2;
+  values[5].data = points;
+
+  for (i = 0; i < G_N_ELEMENTS (byte_orders); i++)
+    {
+      XGenEncoder *encoder = xgen_encoder_new (NULL, byte_orders[i]);
+      XGenOutputBuffer *buffer = xgen_output_buffer_new ();
+      XGenFieldValue *value;
+      GList *decoded;
+      guint8 *message;
+      gsize len;
+
+      g_assert (xgen_encoder_append (encoder, buffer, request, values));
+      g_assert_cmpuint (xgen_output_buffer_get_n_requests (buffer), ==, 1);
+      g_assert_cmpuint (xgen_output_buffer_get_size (buffer), ==, 20);
+      message = test_xgen_flush_output_buffer (buffer, &len);
+      g_assert_cmpuint (len, ==, 20);
+      g_assert_cmpuint (message[0], ==, 64);
+
+      decoded = xgen_layout_decode (layout, message, len, byte_orders[i]);
+      g_assert (decoded != NULL);
+      value = g_list_nth_data (decoded, 1);
+      g_assert_cmpuint (value->unsigned_value, ==, 1);
+      value = g_list_nth_data (decoded, 2);
+      g_assert_cmpuint (value->unsigned_value, ==, 5);
+      value = g_list_nth_data (decoded, 4);
+      g_assert_cmpuint (value->unsigned_value, ==, 0x400002);
+      value = g_list_nth_data (decoded, 5);
+      g_assert_cmpuint (value->unsigned_value, ==, 2);
+      xgen_field_values_free (decoded);
+
+      if (byte_orders[i] == XGEN_MSB_FIRST)
+	{
+	  g_assert_cmpuint (message[15], ==, 2);
+	  g_assert_cmpuint (message[16], ==, 0xff);
+	}
+      else
+	{
+	  g_assert_cmpuint (message[14], ==, 2);
+	  g_assert_cmpuint (message[16], ==, 0xff);
+	}
+
+      g_free (message);
+      xgen_output_buffer_free (buffer);
+      xgen_encoder_free (encoder);
+    }
+}
+
+void
+test_encoder_empty_requests (TestXGENSimpleFixture *fixture,
+			     gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenDispatch *dispatch = xgen_dispatch_new (shared_state->state);
+  XGenEncoder *encoder = xgen_encoder_new (dispatch, XGEN_LSB_FIRST);
+  XGenOutputBuffer *buffer = xgen_output_buffer_new ();
+  const XGenRequest *get_input_focus =
+    test_xgen_find_request (shared_state, "xproto:GetInputFocus");
+  const XGenRequest *query_version =
+    test_xgen_find_request (shared_state, "shape:QueryVersion");
+  XGenEncodeValue values[4];
+  guint8 *messages;
+  gsize len;
+
+  g_assert (xgen_dispatch_add_extension (dispatch, "shape",
+					 SHAPE_MAJOR_OPCODE, 64, 0));
+  memset (values, 0, sizeof (values));
+
+  g_assert (xgen_encoder_append (encoder, buffer, get_input_focus, values));
+  g_assert (xgen_encoder_append (encoder, buffer, query_version, values));
+  g_assert_cmpuint (xgen_output_buffer_get_size (buffer), ==, 8);
+
+  messages = test_xgen_flush_output_buffer (buffer, &len);
+  g_assert_cmpuint (len, ==, 8);
+  g_assert (memcmp (messages, "\x2b\x00\x01\x00", 4) == 0);
+  /* The minor opcode goes where the pad was and the length is 1 */
+  g_assert (memcmp (messages + 4, "\x81\x00\x01\x00", 4) == 0);
+  g_free (messages);
+
+  xgen_output_buffer_free (buffer);
+  xgen_encoder_free (encoder);
+  xgen_dispatch_free (dispatch);
+}
+
+void
+test_encoder_big_requests (TestXGENSimpleFixture *fixture,
+			   gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenRequest *request =
+    test_xgen_find_request (shared_state, "xproto:PolyPoint");
+  XGenEncoder *encoder = xgen_encoder_new (NULL, XGEN_LSB_FIRST);
+  XGenOutputBuffer *buffer = xgen_output_buffer_new ();
+  TestXGENWarnings warnings;
+  gint16 points[40];
+  XGenEncodeValue values[6];
+  guint8 *message;
+  gsize len;
+
+  memset (points, 0, sizeof (points));
+  points[39] = 0x1234;
+  memset (values, 0, sizeof (values));
+  values[3].value = 0x400001;
+  values[5].count = 20;
+  values[5].data = points;
+
+  /* 23 units is too long without BIG-REQUESTS */
+  xgen_encoder_set_max_request_length (encoder, 16, 0);
+  test_xgen_warnings_begin (&warnings);
+  g_assert (!xgen_encoder_append (encoder, buffer, request, values));
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), ==, 1);
+  g_assert_cmpuint (xgen_output_buffer_get_size (buffer), ==, 0);
+  g_assert_cmpuint (xgen_output_buffer_get_n_requests (buffer), ==, 0);
+
+  /* With it the length moves after the header and counts itself */
+  xgen_encoder_set_max_request_length (encoder, 16, 1000);
+  g_assert (xgen_encoder_append (encoder, buffer, request, values));
+  g_assert_cmpuint (xgen_output_buffer_get_size (buffer), ==, 96);
+
+  message = test_xgen_flush_output_buffer (buffer, &len);
+  g_assert_cmpuint (len, ==, 96);
+  g_assert (memcmp (message, "\x40\x00\x00\x00\x18\x00\x00\x00", 8) == 0);
+  g_assert (memcmp (message + 8, "\x01\x00\x40\x00", 4) == 0);
+  g_assert (memcmp (message + 94, "\x34\x12", 2) == 0);
+  g_free (message);
+
+  xgen_output_buffer_free (buffer);
+  xgen_encoder_free (encoder);
+}
+
+void
+test_encoder_swap (TestXGENSimpleFixture *fixture,
+		   gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  static const char xml[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+    "<xcb header=\"xgentest\" extension-xname=\"XGEN-TEST\" "
+    "extension-name=\"XGenTest\" major-version=\"1\" minor-version=\"0\">\n"
+    "  <request name=\"SetDoubles\" opcode=\"0\">\n"
+    "    <field type=\"CARD16\" name=\"n_doubles\" />\n"
+    "    <pad bytes=\"2\" />\n"
+    "    <field type=\"CARD32\" name=\"id\" />\n"
+    "    <list type=\"double\" name=\"doubles\">\n"
+    "      <fieldref>n_doubles</fieldref>\n"
+    "    </list>\n"
+    "  </request>\n"
+    "</xcb>\n";
+  const gdouble doubles[] = { 1.5, -2.25 };
+  XGenDispatch *dispatch;
+  XGenEncoder *encoder;
+  XGenOutputBuffer *buffer;
+  XGenEncodeValue values[7];
+  const XGenRequest *request;
+  const XGenLayout *layout;
+  XGenState *state;
+  guint8 *message;
+  gsize len;
+  guint i;
+
+  state = test_xgen_parse_extension (shared_state, xml);
+  request = XGEN_REQUEST_DEF
+    (xgen_state_find_definition (state, "xgentest:SetDoubles", XGEN_REQUEST));
+  g_assert (request != NULL);
+  layout = xgen_definition_get_layout (XGEN_DEF (request));
+
+  dispatch = xgen_dispatch_new (state);
+  g_assert (xgen_dispatch_add_extension (dispatch, "xgentest",
+					 TEST_MAJOR_OPCODE, 0, 0));
+  encoder = xgen_encoder_new (dispatch, OTHER_BYTE_ORDER);
+  buffer = xgen_output_buffer_new ();
+
+  g_assert_cmpuint (layout->n_fields, <=, G_N_ELEMENTS (values));
+  memset (values, 0, sizeof (values));
+  i = xgen_layout_find_field (layout, "id");
+  values[i].value = 0x01020304;
+  i = xgen_layout_find_field (layout, "doubles");
+  values[i].count = G_N_ELEMENTS (doubles);
+  values[i].data = doubles;
+
+  g_assert (xgen_encoder_append (encoder, buffer, request, values));
+  message = test_xgen_flush_output_buffer (buffer, &len);
+  g_assert_cmpuint (len, ==, 12 + sizeof (doubles));
+
+  /* Every multi-byte value is in the other byte order, including each
+   * 8 byte element */
+  g_assert_cmpuint (message[0], ==, TEST_MAJOR_OPCODE);
+  g_assert_cmpuint (message[1], ==, 0);
+  g_assert_cmpuint (read_swapped_uint16 (message + 2), ==, 7);
+  g_assert_cmpuint (read_swapped_uint16 (message + 4), ==, 2);
+  g_assert_cmphex (GUINT32_SWAP_LE_BE (*(guint32 *)(message + 8)), ==,
+		   0x01020304);
+  for (i = 0; i < G_N_ELEMENTS (doubles); i++)
+    {
+      const guint8 *expected = (const guint8 *)&doubles[i];
+      guint j;
+
+      for (j = 0; j < 8; j++)
+	g_assert_cmphex (message[12 + i * 8 + j], ==, expected[7 - j]);
+    }
+  g_free (message);
+
+  xgen_output_buffer_free (buffer);
+  xgen_encoder_free (encoder);
+  xgen_dispatch_free (dispatch);
+}
@@ -0,0 +1,204 @@
+#include <glib.h>
+#include <string.h>
+
+#include <xgen.h>
+#include <xgen-dispatch.h>
+#include <xgen-filter.h>
+
+#include "test-xgen-common.h"
+
+#define SHAPE_MAJOR_OPCODE 129
+#define SHAPE_FIRST_EVENT  64
+
+static XGenDispatch *
+create_dispatch (const TestXGENSharedState *shared_state)
+{
+  XGenDispatch *dispatch = xgen_dispatch_new (shared_state->state);
+
+  g_assert (xgen_dispatch_add_extension (dispatch, "shape",
+					 SHAPE_MAJOR_OPCODE,
+					 SHAPE_FIRST_EVENT, 0));
+  return dispatch;
+}
+
+void
+test_dispatch_lookup (TestXGENSimpleFixture *fixture,
+		      gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenDispatch *dispatch = xgen_dispatch_new (shared_state->state);
+  static const guint8 map_window[] = { 8, 0, 2, 0, 1, 0, 0x40, 0 };
+  static const guint8 rectangles[] = { SHAPE_MAJOR_OPCODE, 1, 4, 0 };
+  guint8 event[32] = { 0, };
+  guint8 error[32] = { 0, };
+  guint8 major_opcode;
+  gint minor_opcode;
+  guint8 code;
+
+  g_assert (XGEN_DEF (xgen_dispatch_lookup_request (dispatch, map_window,
+						    sizeof (map_window)))
+	    == test_xgen_find_definition (shared_state, "xproto:MapWindow",
+					  XGEN_REQUEST));
+
+  /* Extensions are unknown until registered */
+  g_assert (xgen_dispatch_lookup_request (dispatch, rectangles,
+					  sizeof (rectangles)) == NULL);
+  g_assert (xgen_dispatch_add_extension (dispatch, "shape",
+					 SHAPE_MAJOR_OPCODE,
+					 SHAPE_FIRST_EVENT, 0));
+  g_assert (XGEN_DEF (xgen_dispatch_lookup_request (dispatch, rectangles,
+						    sizeof (rectangles)))
+	    == test_xgen_find_definition (shared_state, "shape:Rectangles",
+					  XGEN_REQUEST));
+  /* Too short to have a minor opcode */
+  g_assert (xgen_dispatch_lookup_request (dispatch, rectangles, 1) == NULL);
+
+  g_assert (xgen_dispatch_get_request_opcode
+	    (dispatch,
+	     XGEN_REQUEST_DEF (test_xgen_find_definition (shared_state,
+							  "shape:Rectangles",
+							  XGEN_REQUEST)),
+	     &major_opcode, &minor_opcode));
+  g_assert_cmpuint (major_opcode, ==, SHAPE_MAJOR_OPCODE);
+  g_assert_cmpint (minor_opcode, ==, 1);
+
+  g_assert (xgen_dispatch_get_request_opcode
+	    (dispatch,
+	     XGEN_REQUEST_DEF (test_xgen_find_definition (shared_state,
+							  "xproto:MapWindow",
+							  XGEN_REQUEST)),
+	     &major_opcode, &minor_opcode));
+  g_assert_cmpuint (major_opcode, ==, 8);
+  g_assert_cmpint (minor_opcode, ==, -1);
+
+  /* The send_event bit is ignored */
+  event[0] = 0x80 | 22;
+  g_assert (XGEN_DEF (xgen_dispatch_lookup_event (dispatch, event, 32,
+						  XGEN_LSB_FIRST))
+	    == test_xgen_find_definition (shared_state,
+					  "xproto:ConfigureNotify",
+					  XGEN_EVENT));
+  event[0] = SHAPE_FIRST_EVENT;
+  g_assert (XGEN_DEF (xgen_dispatch_lookup_event (dispatch, event, 32,
+						  XGEN_LSB_FIRST))
+	    == test_xgen_find_definition (shared_state, "shape:Notify",
+					  XGEN_EVENT));
+  g_assert (xgen_dispatch_get_event_code
+	    (dispatch,
+	     XGEN_EVENT_DEF (test_xgen_find_definition (shared_state,
+							"shape:Notify",
+							XGEN_EVENT)),
+	     &code));
+  g_assert_cmpuint (code, ==, SHAPE_FIRST_EVENT);
+
+  error[1] = 3;
+  g_assert (XGEN_DEF (xgen_dispatch_lookup_error (dispatch, error, 32))
+	    == test_xgen_find_definition (shared_state, "xproto:Window",
+					  XGEN_ERROR));
+
+  xgen_dispatch_free (dispatch);
+}
+
+void
+test_filter_match (TestXGENSimpleFixture *fixture,
+		   gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenDispatch *dispatch = create_dispatch (shared_state);
+  XGenFilter *filter;
+  guint8 map_window[] = { 8, 0, 2, 0, 1, 0, 0x40, 0 };
+  guint8 map_window_msb[] = { 8, 0, 0, 2, 0, 0x40, 0, 1 };
+  guint8 rectangles[16] = { SHAPE_MAJOR_OPCODE, 1, 4, 0, 2, };
+  static const guint8 query_version[] = { SHAPE_MAJOR_OPCODE, 0, 1, 0 };
+  static const guint8 get_input_focus[] = { 43, 0, 1, 0 };
+  guint8 event[32] = { 22, };
+
+  filter = xgen_filter_new (shared_state->state, dispatch,
+			    "xproto:MapWindow.window == 0x400001 "
+			    "|| shape:Rectangles.operation >= 2 "
+			    "&& shape:Rectangles.destination_kind != 1 "
+			    "|| shape:QueryVersion "
+			    "|| xproto:ConfigureNotify.width & 0x100");
+  g_assert (filter != NULL);
+
+  g_assert (xgen_filter_match (filter, XGEN_CLIENT_TO_SERVER, map_window,
+			       sizeof (map_window), XGEN_LSB_FIRST)
+	    == test_xgen_find_definition (shared_state, "xproto:MapWindow",
+					  XGEN_REQUEST));
+  g_assert (xgen_filter_match (filter, XGEN_CLIENT_TO_SERVER, map_window_msb,
+			       sizeof (map_window_msb), XGEN_MSB_FIRST));
+  /* The same bytes read the other way round are another window */
+  g_assert (!xgen_filter_match (filter, XGEN_CLIENT_TO_SERVER,
+				map_window_msb, sizeof (map_window_msb),
+				XGEN_LSB_FIRST));
+  /* Requests aren't matched against server messages */
+  g_assert (!xgen_filter_match (filter, XGEN_SERVER_TO_CLIENT, map_window,
+				sizeof (map_window), XGEN_LSB_FIRST));
+  /* Nor are truncated messages */
+  g_assert (!xgen_filter_match (filter, XGEN_CLIENT_TO_SERVER, map_window,
+				6, XGEN_LSB_FIRST));
+  map_window[4] = 2;
+  g_assert (!xgen_filter_match (filter, XGEN_CLIENT_TO_SERVER, map_window,
+				sizeof (map_window), XGEN_LSB_FIRST));
+
+  g_assert (xgen_filter_match (filter, XGEN_CLIENT_TO_SERVER, rectangles,
+			       sizeof (rectangles), XGEN_LSB_FIRST));
+  rectangles[5] = 1;
+  g_assert (!xgen_filter_match (filter, XGEN_CLIENT_TO_SERVER, rectangles,
+				sizeof (rectangles), XGEN_LSB_FIRST));
+  rectangles[5] = 0;
+  rectangles[4] = 1;
+  g_assert (!xgen_filter_match (filter, XGEN_CLIENT_TO_SERVER, rectangles,
+				sizeof (rectangles), XGEN_LSB_FIRST));
+
+  g_assert (xgen_filter_match (filter, XGEN_CLIENT_TO_SERVER, query_version,
+			       sizeof (query_version), XGEN_LSB_FIRST)
+	    == test_xgen_find_definition (shared_state, "shape:QueryVersion",
+					  XGEN_REQUEST));
+  g_assert (!xgen_filter_match (filter, XGEN_CLIENT_TO_SERVER,
+				get_input_focus, sizeof (get_input_focus),
+				XGEN_LSB_FIRST));
+
+  /* ConfigureNotify's width is at offset 20 */
+  g_assert (!xgen_filter_match (filter, XGEN_SERVER_TO_CLIENT, event,
+				sizeof (event), XGEN_LSB_FIRST));
+  event[21] = 0x01;
+  g_assert (xgen_filter_match (filter, XGEN_SERVER_TO_CLIENT, event,
+			       sizeof (event), XGEN_LSB_FIRST));
+
+  xgen_filter_free (filter);
+  xgen_dispatch_free (dispatch);
+}
+
+void
+test_filter_invalid (TestXGENSimpleFixture *fixture,
+		     gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenDispatch *dispatch = xgen_dispatch_new (shared_state->state);
+  static const char *expressions[] = {
+    "",
+    "xproto:NoSuchRequest",
+    "xproto:MapWindow.no_such_field == 1",
+    "xproto:MapWindow.window ==",
+    "xproto:MapWindow.window == 1 && xproto:GetGeometry.drawable == 1",
+    "xproto:MapWindow ||",
+    /* Not registered with the dispatcher */
+    "shape:QueryVersion"
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (expressions); i++)
+    {
+      TestXGENWarnings warnings;
+      XGenFilter *filter;
+
+      test_xgen_warnings_begin (&warnings);
+      filter = xgen_filter_new (shared_state->state, dispatch,
+				expressions[i]);
+      g_assert_cmpuint (test_xgen_warnings_end (&warnings), >, 0);
+      g_assert (filter == NULL);
+    }
+
+  xgen_dispatch_free (dispatch);
+}
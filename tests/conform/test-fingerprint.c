@@ -0,0 +1,98 @@
+#include <glib.h>
+
+#include <xgen.h>
+
+#include "test-xgen-common.h"
+
+/* A request using a struct whose member type is filled in later */
+#define TEST_XML(MEMBER_TYPE) \
+  "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n" \
+  "<xcb header=\"xgentest\" extension-xname=\"XGEN-TEST\" " \
+  "extension-name=\"XGenTest\" major-version=\"1\" minor-version=\"0\">\n" \
+  "  <struct name=\"Member\">\n" \
+  "    <field type=\"" MEMBER_TYPE "\" name=\"value\" />\n" \
+  "  </struct>\n" \
+  "  <request name=\"SetMember\" opcode=\"0\">\n" \
+  "    <field type=\"Member\" name=\"member\" />\n" \
+  "  </request>\n" \
+  "  <request name=\"Other\" opcode=\"1\">\n" \
+  "    <field type=\"CARD32\" name=\"value\" />\n" \
+  "  </request>\n" \
+  "</xcb>\n"
+
+static guint64
+fingerprint (const XGenState *state, const char *name, XGenType type)
+{
+  const XGenDefinition *def = xgen_state_find_definition (state, name, type);
+
+  g_assert (def != NULL);
+  return xgen_definition_get_fingerprint (def);
+}
+
+void
+test_fingerprint_stable (TestXGENSimpleFixture *fixture,
+			 gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenState *state = shared_state->state;
+  GList *files = g_list_append (NULL, "xproto.xml");
+  XGenState *reparsed = xgen_parse_xcb_proto_files (files);
+
+  g_list_free (files);
+  g_assert (reparsed != NULL);
+
+  /* Parsing the same description again gives the same fingerprints */
+  g_assert_cmphex (fingerprint (state, "xproto:MapWindow", XGEN_REQUEST),
+		   ==,
+		   fingerprint (reparsed, "xproto:MapWindow", XGEN_REQUEST));
+  g_assert_cmphex (fingerprint (state, "xproto:POINT", XGEN_STRUCT), ==,
+		   fingerprint (reparsed, "xproto:POINT", XGEN_STRUCT));
+  g_assert_cmphex (xgen_extension_get_fingerprint
+		     (xgen_state_find_extension (state, "xproto")), ==,
+		   xgen_extension_get_fingerprint
+		     (xgen_state_find_extension (reparsed, "xproto")));
+
+  /* Definitions with the same fields still differ by name and opcode */
+  g_assert_cmphex (fingerprint (state, "xproto:PolyPoint", XGEN_REQUEST),
+		   !=,
+		   fingerprint (state, "xproto:PolyLine", XGEN_REQUEST));
+  g_assert_cmphex (fingerprint (state, "xproto:GetInputFocus", XGEN_REQUEST),
+		   !=,
+		   fingerprint (state, "xproto:GetInputFocus", XGEN_REPLY));
+  g_assert_cmphex (xgen_extension_get_fingerprint
+		     (xgen_state_find_extension (state, "xproto")), !=,
+		   xgen_extension_get_fingerprint
+		     (xgen_state_find_extension (state, "shape")));
+  g_assert_cmphex (fingerprint (state, "xproto:MapWindow", XGEN_REQUEST),
+		   !=, 0);
+}
+
+void
+test_fingerprint_dependencies (TestXGENSimpleFixture *fixture,
+			       gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenState *card16 = test_xgen_parse_extension (shared_state,
+						 TEST_XML ("CARD16"));
+  XGenState *card32 = test_xgen_parse_extension (shared_state,
+						 TEST_XML ("CARD32"));
+
+  /* Changing a struct changes the requests using it, but nothing else */
+  g_assert_cmphex (fingerprint (card16, "xgentest:Member", XGEN_STRUCT), !=,
+		   fingerprint (card32, "xgentest:Member", XGEN_STRUCT));
+  g_assert_cmphex (fingerprint (card16, "xgentest:SetMember", XGEN_REQUEST),
+		   !=,
+		   fingerprint (card32, "xgentest:SetMember", XGEN_REQUEST));
+  g_assert_cmphex (fingerprint (card16, "xgentest:Other", XGEN_REQUEST), ==,
+		   fingerprint (card32, "xgentest:Other", XGEN_REQUEST));
+  g_assert_cmphex (xgen_extension_get_fingerprint
+		     (xgen_state_find_extension (card16, "xgentest")), !=,
+		   xgen_extension_get_fingerprint
+		     (xgen_state_find_extension (card32, "xgentest")));
+
+  /* The shared base extensions keep their fingerprints */
+  g_assert_cmphex (fingerprint (card16, "xproto:MapWindow", XGEN_REQUEST),
+		   ==,
+		   fingerprint (shared_state->state, "xproto:MapWindow",
+				XGEN_REQUEST));
+}
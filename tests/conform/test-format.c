@@ -0,0 +1,174 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-format.h>
+
+#include "test-xgen-common.h"
+
+/* Formats one message and returns the text written by the formatter */
+static char *
+format_message (const TestXGENSharedState *shared_state,
+		XGenFormatStyle style,
+		const char *name,
+		XGenType type,
+		const guint8 *data,
+		gsize len)
+{
+  const XGenLayout *layout =
+    xgen_definition_get_layout (test_xgen_find_definition (shared_state,
+							   name, type));
+  XGenFormatter *formatter = xgen_formatter_new (style);
+  char *filename;
+  char *contents;
+  int fd;
+
+  g_assert (xgen_formatter_append (formatter, layout, data, len,
+				   XGEN_LSB_FIRST));
+  g_assert_cmpuint (xgen_formatter_get_size (formatter), >, 0);
+
+  fd = g_file_open_tmp ("test-format-XXXXXX", &filename, NULL);
+  g_assert (fd >= 0);
+  g_assert (xgen_formatter_flush (formatter, fd));
+  g_assert_cmpuint (xgen_formatter_get_size (formatter), ==, 0);
+  close (fd);
+
+  g_assert (g_file_get_contents (filename, &contents, NULL, NULL));
+  g_unlink (filename);
+  g_free (filename);
+  xgen_formatter_free (formatter);
+
+  return contents;
+}
+
+static guint
+count_occurrences (const char *haystack, const char *needle)
+{
+  guint n = 0;
+
+  while ((haystack = strstr (haystack, needle)))
+    {
+      n++;
+      haystack++;
+    }
+  return n;
+}
+
+void
+test_format_json_type (TestXGENSimpleFixture *fixture,
+		       gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  /* GetProperty of property 0x17 with type 0x1f */
+  static const guint8 get_property[] = {
+    20, 0, 6, 0,  1, 0, 0x40, 0,  0x17, 0, 0, 0,  0x1f, 0, 0, 0,
+    0, 0, 0, 0,  0xff, 0xff, 0xff, 0x7f
+  };
+  char *text;
+
+  text = format_message (shared_state, XGEN_FORMAT_JSON, "xproto:GetProperty",
+			 XGEN_REQUEST, get_property, sizeof (get_property));
+  g_assert (g_str_has_prefix (text, "{\"_type\":\"xproto:GetProperty\","));
+  g_assert (g_str_has_suffix (text, "}\n"));
+  /* Only the field uses the key "type" */
+  g_assert_cmpuint (count_occurrences (text, "\"type\":"), ==, 1);
+  g_assert (strstr (text, ",\"window\":4194305,") != NULL);
+  g_assert (strstr (text, ",\"long_length\":2147483647}") != NULL);
+  g_free (text);
+
+  text = format_message (shared_state, XGEN_FORMAT_TEXT, "xproto:GetProperty",
+			 XGEN_REQUEST, get_property, sizeof (get_property));
+  g_assert (g_str_has_prefix (text, "xproto:GetProperty "));
+  g_assert (strstr (text, " window=0x400001 ") != NULL);
+  g_assert (g_str_has_suffix (text, " long_length=2147483647\n"));
+  g_free (text);
+}
+
+void
+test_format_lists (TestXGENSimpleFixture *fixture,
+		   gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  /* PolyPoint with the points (1, 2) and (-1, 4) */
+  static const guint8 poly_point[] = {
+    64, 0, 5, 0,  0x01, 0, 0x40, 0,  0x02, 0, 0x40, 0,
+    1, 0, 2, 0,  0xff, 0xff, 4, 0
+  };
+  /* A ListProperties reply with 3 atoms */
+  guint8 list_properties[44] = {
+    1, 0, 7, 0,  3, 0, 0, 0,  3, 0,
+  };
+  /* ConfigureWindow of the x (bit 0) and width (bit 2) */
+  static const guint8 configure_window[] = {
+    12, 0, 5, 0,  0x01, 0, 0x40, 0,  0x05, 0, 0, 0,
+    10, 0, 0, 0,  0x80, 0x02, 0, 0
+  };
+  char *text;
+
+  list_properties[32] = 1;
+  list_properties[36] = 0x17;
+  list_properties[40] = 0xff;
+  list_properties[41] = 0x01;
+
+  text = format_message (shared_state, XGEN_FORMAT_JSON, "xproto:PolyPoint",
+			 XGEN_REQUEST, poly_point, sizeof (poly_point));
+  g_assert (g_str_has_suffix (text, ",\"points\":[{\"x\":1,\"y\":2},"
+			      "{\"x\":-1,\"y\":4}]}\n"));
+  g_free (text);
+
+  text = format_message (shared_state, XGEN_FORMAT_TEXT, "xproto:PolyPoint",
+			 XGEN_REQUEST, poly_point, sizeof (poly_point));
+  g_assert (g_str_has_suffix (text, " points=[{x=1 y=2},{x=-1 y=4}]\n"));
+  g_free (text);
+
+  text = format_message (shared_state, XGEN_FORMAT_JSON,
+			 "xproto:ListProperties", XGEN_REPLY,
+			 list_properties, sizeof (list_properties));
+  g_assert (g_str_has_prefix (text,
+			      "{\"_type\":\"xproto:ListProperties\","));
+  g_assert (g_str_has_suffix (text, ",\"atoms\":[1,23,511]}\n"));
+  g_free (text);
+
+  text = format_message (shared_state, XGEN_FORMAT_TEXT,
+			 "xproto:ListProperties", XGEN_REPLY,
+			 list_properties, sizeof (list_properties));
+  g_assert (g_str_has_suffix (text, " atoms=[0x1,0x17,0x1ff]\n"));
+  g_free (text);
+
+  text = format_message (shared_state, XGEN_FORMAT_JSON,
+			 "xproto:ConfigureWindow", XGEN_REQUEST,
+			 configure_window, sizeof (configure_window));
+  g_assert (strstr (text, "\"value_list\":[10,640]") != NULL);
+  g_free (text);
+
+  text = format_message (shared_state, XGEN_FORMAT_TEXT,
+			 "xproto:ConfigureWindow", XGEN_REQUEST,
+			 configure_window, sizeof (configure_window));
+  g_assert (strstr (text, " value_list=[10,640]") != NULL);
+  g_free (text);
+}
+
+void
+test_format_truncated (TestXGENSimpleFixture *fixture,
+		       gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenLayout *layout =
+    xgen_definition_get_layout (test_xgen_find_definition (shared_state,
+							   "xproto:PolyPoint",
+							   XGEN_REQUEST));
+  static const guint8 poly_point[] = {
+    64, 0, 5, 0,  0x01, 0, 0x40, 0,  0x02, 0, 0x40, 0,  1, 0, 2, 0
+  };
+  XGenFormatter *formatter = xgen_formatter_new (XGEN_FORMAT_JSON);
+
+  /* The length says there are 2 points but there's only one */
+  g_assert (!xgen_formatter_append (formatter, layout, poly_point,
+				    sizeof (poly_point), XGEN_LSB_FIRST));
+  g_assert_cmpuint (xgen_formatter_get_size (formatter), ==, 0);
+
+  xgen_formatter_free (formatter);
+}
@@ -0,0 +1,328 @@
+#include <glib.h>
+#include <string.h>
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-dispatch.h>
+#include <xgen-encoder.h>
+#include <xgen-generator.h>
+
+#include "test-xgen-common.h"
+
+#define N_REQUESTS 400
+
+/* Generates N_REQUESTS requests and returns the encoded bytes */
+static guint8 *
+generate (XGenGenerator *generator, gsize *len)
+{
+  XGenEncoder *encoder = xgen_encoder_new (NULL, XGEN_LSB_FIRST);
+  XGenOutputBuffer *buffer = xgen_output_buffer_new ();
+  guint8 *data;
+  guint i;
+
+  for (i = 0; i < N_REQUESTS; i++)
+    g_assert (xgen_generator_append (generator, encoder, buffer) != NULL);
+  g_assert_cmpuint (xgen_output_buffer_get_n_requests (buffer), ==,
+		    N_REQUESTS);
+
+  data = test_xgen_flush_output_buffer (buffer, len);
+  xgen_output_buffer_free (buffer);
+  xgen_encoder_free (encoder);
+
+  return data;
+}
+
+static XGenGenerator *
+create_generator (const TestXGENSharedState *shared_state, guint32 seed)
+{
+  XGenGenerator *generator = xgen_generator_new (shared_state->state, seed);
+
+  g_assert (xgen_generator_parse_mix (generator,
+				      "xproto:PolyPoint=75 coordinate_mode=1;"
+				      "xproto:MapWindow=25"));
+  xgen_generator_set_resource (generator, "DRAWABLE", 0x400001);
+  xgen_generator_set_resource (generator, "WINDOW", 0x400002);
+  xgen_generator_set_limits (generator, 100, 8);
+
+  return generator;
+}
+
+void
+test_generator_mix (TestXGENSimpleFixture *fixture,
+		    gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenGenerator *generator = create_generator (shared_state, 42);
+  XGenDispatch *dispatch = xgen_dispatch_new (shared_state->state);
+  guint n_poly_point = 0, n_map_window = 0;
+  guint8 *requests;
+  gsize len, offset;
+
+  requests = generate (generator, &len);
+
+  /* Every request decodes and uses the settings */
+  for (offset = 0; offset < len;)
+    {
+      const guint8 *request = requests + offset;
+      const XGenLayout *layout =
+	xgen_definition_get_layout
+	  (XGEN_DEF (xgen_dispatch_lookup_request (dispatch, request,
+						   len - offset)));
+      gsize request_len =
+	xgen_layout_get_message_length (layout, request, len - offset,
+					XGEN_LSB_FIRST);
+      GList *values;
+      XGenFieldValue *value;
+
+      g_assert_cmpuint (request_len, >=, 4);
+      g_assert_cmpuint (request_len % 4, ==, 0);
+      values = xgen_layout_decode (layout, request, request_len,
+				   XGEN_LSB_FIRST);
+      g_assert (values != NULL);
+
+      if (request[0] == 64)
+	{
+	  n_poly_point++;
+	  value = g_list_nth_data (values, 1);
+	  g_assert_cmpuint (value->unsigned_value, ==, 1);
+	  value = g_list_nth_data (values, 3);
+	  g_assert_cmphex (value->unsigned_value, ==, 0x400001);
+	  value = g_list_nth_data (values, 5);
+	  g_assert_cmpuint (value->unsigned_value, <=, 8);
+	}
+      else
+	{
+	  g_assert_cmpuint (request[0], ==, 8);
+	  n_map_window++;
+	  value = g_list_nth_data (values, 3);
+	  g_assert_cmphex (value->unsigned_value, ==, 0x400002);
+	}
+
+      xgen_field_values_free (values);
+      offset += request_len;
+    }
+
+  g_assert_cmpuint (offset, ==, len);
+  g_assert_cmpuint (n_poly_point + n_map_window, ==, N_REQUESTS);
+  g_assert_cmpuint (n_map_window, >, N_REQUESTS / 8);
+  g_assert_cmpuint (n_poly_point, >, n_map_window);
+
+  g_free (requests);
+  xgen_dispatch_free (dispatch);
+  xgen_generator_free (generator);
+}
+
+void
+test_generator_seed (TestXGENSimpleFixture *fixture,
+		     gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenGenerator *generators[3];
+  guint8 *requests[3];
+  gsize lens[3];
+  guint i;
+
+  generators[0] = create_generator (shared_state, 1);
+  generators[1] = create_generator (shared_state, 1);
+  generators[2] = create_generator (shared_state, 2);
+  for (i = 0; i < 3; i++)
+    requests[i] = generate (generators[i], &lens[i]);
+
+  /* The same seed gives the same requests */
+  g_assert_cmpuint (lens[0], ==, lens[1]);
+  g_assert (memcmp (requests[0], requests[1], lens[0]) == 0);
+  g_assert (lens[0] != lens[2]
+	    || memcmp (requests[0], requests[2], lens[0]) != 0);
+
+  for (i = 0; i < 3; i++)
+    {
+      g_free (requests[i]);
+      xgen_generator_free (generators[i]);
+    }
+}
+
+/* A list of variable sized structs followed by a list of floats, and a
+ * valueparam with a 16 bit mask */
+static const char variable_xml[] =
+  "<xcb header=\"xgentest\" extension-xname=\"XGEN-TEST\" "
+  "extension-name=\"XGenTest\" major-version=\"1\" minor-version=\"0\">\n"
+  "  <struct name=\"Name\">\n"
+  "    <field type=\"CARD8\" name=\"name_len\" />\n"
+  "    <list type=\"char\" name=\"name\">\n"
+  "      <fieldref>name_len</fieldref>\n"
+  "    </list>\n"
+  "  </struct>\n"
+  "  <request name=\"SetNames\" opcode=\"0\">\n"
+  "    <field type=\"CARD16\" name=\"n_names\" />\n"
+  "    <pad bytes=\"2\" />\n"
+  "    <list type=\"Name\" name=\"names\">\n"
+  "      <fieldref>n_names</fieldref>\n"
+  "    </list>\n"
+  "    <list type=\"float\" name=\"weights\"><value>2</value></list>\n"
+  "  </request>\n"
+  "  <request name=\"Configure\" opcode=\"1\">\n"
+  "    <field type=\"CARD32\" name=\"id\" />\n"
+  "    <valueparam value-mask-type=\"CARD16\" value-mask-name=\"value_mask\" "
+  "value-list-name=\"value_list\" />\n"
+  "  </request>\n"
+  "</xcb>\n";
+
+#define TEST_MAJOR_OPCODE 130
+
+static void
+check_set_names (const guint8 *request, gsize len)
+{
+  guint n_names = *(const guint16 *)(request + 4);
+  const guint8 *p = request + 8;
+  guint i, j;
+
+  g_assert_cmpuint (n_names, >=, 1);
+  g_assert_cmpuint (n_names, <=, 8);
+
+  /* Each name is its length then that many printable characters */
+  for (i = 0; i < n_names; i++)
+    {
+      guint name_len = p[0];
+
+      g_assert_cmpuint (name_len, >=, 1);
+      g_assert_cmpuint (name_len, <=, 8);
+      for (j = 1; j <= name_len; j++)
+	g_assert (p[j] >= ' ' && p[j] <= '~');
+      p += 1 + name_len;
+    }
+
+  for (i = 0; i < 2; i++, p += 4)
+    {
+      gfloat weight;
+
+      memcpy (&weight, p, 4);
+      g_assert (weight >= -100 && weight <= 100);
+    }
+
+  g_assert_cmpuint (len, ==, ((p - request) + 3) & ~3);
+}
+
+/* Checks a Configure request and returns its mask */
+static guint32
+check_configure (const guint8 *request, gsize len)
+{
+  guint32 mask = *(const guint16 *)(request + 8);
+  guint n_values = 0;
+  guint i;
+
+  for (i = 0; i < 16; i++)
+    if (mask & (1 << i))
+      n_values++;
+
+  /* The mask is padded to 4 bytes and followed by a value per bit */
+  g_assert_cmpuint (len, ==, 12 + n_values * 4);
+  for (i = 0; i < n_values; i++)
+    g_assert_cmpuint (*(const guint32 *)(request + 12 + i * 4), <=, 100);
+
+  return mask;
+}
+
+void
+test_generator_variable (TestXGENSimpleFixture *fixture,
+			 gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenState *state = test_xgen_parse_extension (shared_state, variable_xml);
+  XGenDispatch *dispatch = xgen_dispatch_new (state);
+  XGenGenerator *generator = xgen_generator_new (state, 7);
+  XGenEncoder *encoder;
+  XGenOutputBuffer *buffer = xgen_output_buffer_new ();
+  guint n_set_names = 0, n_configure = 0;
+  guint32 masks = 0;
+  guint8 *requests;
+  gsize len, offset;
+  guint i;
+
+  g_assert (xgen_dispatch_add_extension (dispatch, "xgentest",
+					 TEST_MAJOR_OPCODE, 0, 0));
+  encoder = xgen_encoder_new (dispatch, XGEN_LSB_FIRST);
+  g_assert (xgen_generator_parse_mix (generator,
+				      "xgentest:SetNames;"
+				      "xgentest:Configure"));
+  xgen_generator_set_limits (generator, 100, 8);
+
+  for (i = 0; i < N_REQUESTS; i++)
+    g_assert (xgen_generator_append (generator, encoder, buffer) != NULL);
+  requests = test_xgen_flush_output_buffer (buffer, &len);
+
+  for (offset = 0; offset < len;)
+    {
+      const guint8 *request = requests + offset;
+      gsize request_len = *(const guint16 *)(request + 2) * 4;
+
+      g_assert_cmpuint (request[0], ==, TEST_MAJOR_OPCODE);
+      g_assert_cmpuint (request_len, >=, 8);
+      g_assert_cmpuint (offset + request_len, <=, len);
+
+      if (request[1] == 0)
+	{
+	  check_set_names (request, request_len);
+	  n_set_names++;
+	}
+      else
+	{
+	  g_assert_cmpuint (request[1], ==, 1);
+	  masks |= check_configure (request, request_len);
+	  n_configure++;
+	}
+      offset += request_len;
+    }
+
+  g_assert_cmpuint (n_set_names + n_configure, ==, N_REQUESTS);
+  g_assert_cmpuint (n_set_names, >, 0);
+  g_assert_cmpuint (n_configure, >, 0);
+  /* Every bit of the mask's type is used */
+  g_assert_cmphex (masks, ==, 0xffff);
+
+  g_free (requests);
+  xgen_output_buffer_free (buffer);
+  xgen_encoder_free (encoder);
+  xgen_generator_free (generator);
+  xgen_dispatch_free (dispatch);
+}
+
+void
+test_generator_invalid (TestXGENSimpleFixture *fixture,
+			gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenGenerator *generator = xgen_generator_new (shared_state->state, 0);
+  XGenEncoder *encoder = xgen_encoder_new (NULL, XGEN_LSB_FIRST);
+  XGenOutputBuffer *buffer = xgen_output_buffer_new ();
+  const XGenRequest *map_window =
+    XGEN_REQUEST_DEF (test_xgen_find_definition (shared_state,
+						 "xproto:MapWindow",
+						 XGEN_REQUEST));
+  static const char *mixes[] = {
+    "xproto:NoSuchRequest",
+    "xproto:MapWindow=x",
+    "xproto:MapWindow=0",
+    "xproto:MapWindow window",
+    "xproto:MapWindow no_such_field=1"
+  };
+  TestXGENWarnings warnings;
+  guint i;
+
+  /* Nothing is generated from an empty mix */
+  test_xgen_warnings_begin (&warnings);
+  g_assert (xgen_generator_append (generator, encoder, buffer) == NULL);
+  g_assert (!xgen_generator_add_request (generator, map_window, 0));
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), ==, 2);
+  g_assert_cmpuint (xgen_output_buffer_get_size (buffer), ==, 0);
+
+  for (i = 0; i < G_N_ELEMENTS (mixes); i++)
+    {
+      test_xgen_warnings_begin (&warnings);
+      g_assert (!xgen_generator_parse_mix (generator, mixes[i]));
+      g_assert_cmpuint (test_xgen_warnings_end (&warnings), >, 0);
+    }
+
+  xgen_output_buffer_free (buffer);
+  xgen_encoder_free (encoder);
+  xgen_generator_free (generator);
+}
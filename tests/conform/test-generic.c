@@ -0,0 +1,229 @@
+#include <glib.h>
+#include <string.h>
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-dispatch.h>
+#include <xgen-filter.h>
+
+#include "test-xgen-common.h"
+
+#define TEST_MAJOR_OPCODE 130
+#define TEST_FIRST_EVENT  80
+#define X_GENERIC_EVENT	  35
+
+static const char test_xml[] =
+  "<xcb header=\"xgentest\" extension-xname=\"XGEN-TEST\" "
+  "extension-name=\"XGenTest\" major-version=\"1\" minor-version=\"0\">\n"
+  "  <event name=\"Plain\" number=\"0\">\n"
+  "    <field type=\"CARD8\" name=\"detail\" />\n"
+  "  </event>\n"
+  "  <event name=\"Motion\" number=\"6\" xge=\"true\">\n"
+  "    <field type=\"CARD16\" name=\"deviceid\" />\n"
+  "    <field type=\"CARD32\" name=\"time\" />\n"
+  "    <field type=\"CARD16\" name=\"n_values\" />\n"
+  "    <pad bytes=\"14\" />\n"
+  "    <list type=\"CARD32\" name=\"values\">\n"
+  "      <fieldref>n_values</fieldref>\n"
+  "    </list>\n"
+  "  </event>\n"
+  "  <event name=\"Enter\" number=\"7\" xge=\"true\">\n"
+  "    <field type=\"CARD16\" name=\"deviceid\" />\n"
+  "    <pad bytes=\"20\" />\n"
+  "  </event>\n"
+  "</xcb>\n";
+
+/* Returns the core event with @number, if the protocol has one */
+static const XGenEvent *
+find_core_event (const XGenState *state, guint number)
+{
+  XGenExtension *core = xgen_state_find_extension (state, "xproto");
+  GList *tmp;
+
+  for (tmp = core->events; tmp != NULL; tmp = tmp->next)
+    {
+      const XGenEvent *event = tmp->data;
+
+      if (event->number == number)
+	return event;
+    }
+  return NULL;
+}
+
+/* Fills in a GenericEvent header in LSB first order */
+static void
+make_generic_event (guint8 *event,
+		    gsize len,
+		    guint8 major_opcode,
+		    guint16 event_type)
+{
+  memset (event, 0, len);
+  event[0] = X_GENERIC_EVENT;
+  event[1] = major_opcode;
+  event[4] = (len - 32) / 4;
+  event[8] = event_type & 0xff;
+  event[9] = event_type >> 8;
+}
+
+void
+test_generic_layout (TestXGENSimpleFixture *fixture,
+		     gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenState *state = test_xgen_parse_extension (shared_state, test_xml);
+  XGenDefinition *motion =
+    xgen_state_find_definition (state, "xgentest:Motion", XGEN_EVENT);
+  XGenDefinition *plain =
+    xgen_state_find_definition (state, "xgentest:Plain", XGEN_EVENT);
+  const XGenLayout *layout;
+  guint8 event[40];
+
+  g_assert (motion && plain);
+  g_assert (XGEN_EVENT_DEF (motion)->is_generic);
+  g_assert (!XGEN_EVENT_DEF (plain)->is_generic);
+
+  /* The fields follow the 10 byte GenericEvent header */
+  layout = xgen_definition_get_layout (motion);
+  g_assert_cmpint (test_xgen_field_offset (layout, "extension"), ==, 1);
+  g_assert_cmpint (test_xgen_field_offset (layout, "length"), ==, 4);
+  g_assert_cmpint (test_xgen_field_offset (layout, "event_type"), ==, 8);
+  g_assert_cmpint (test_xgen_field_offset (layout, "deviceid"), ==, 10);
+  g_assert_cmpint (test_xgen_field_offset (layout, "n_values"), ==, 16);
+  g_assert_cmpint (test_xgen_field_offset (layout, "values"), ==, 32);
+  g_assert_cmpuint (layout->min_size, ==, 32);
+
+  /* Like replies they're framed by their length */
+  make_generic_event (event, sizeof (event), TEST_MAJOR_OPCODE, 6);
+  event[16] = 2;
+  g_assert_cmpuint (xgen_layout_get_message_length (layout, event,
+						    sizeof (event),
+						    XGEN_LSB_FIRST),
+		    ==, 40);
+  g_assert_cmpuint (xgen_layout_get_message_length (layout, event, 4,
+						    XGEN_LSB_FIRST),
+		    ==, 0);
+}
+
+void
+test_generic_dispatch (TestXGENSimpleFixture *fixture,
+		       gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenState *state = test_xgen_parse_extension (shared_state, test_xml);
+  const XGenEvent *generic_event = find_core_event (state, X_GENERIC_EVENT);
+  XGenDispatch *dispatch = xgen_dispatch_new (state);
+  XGenDefinition *motion =
+    xgen_state_find_definition (state, "xgentest:Motion", XGEN_EVENT);
+  XGenDefinition *enter =
+    xgen_state_find_definition (state, "xgentest:Enter", XGEN_EVENT);
+  XGenDefinition *plain =
+    xgen_state_find_definition (state, "xgentest:Plain", XGEN_EVENT);
+  guint8 event[32];
+  guint8 major_opcode;
+  guint16 event_type;
+  guint8 code;
+
+  /* Until the extension is registered the core definition is used */
+  make_generic_event (event, sizeof (event), TEST_MAJOR_OPCODE, 6);
+  g_assert (xgen_dispatch_lookup_event (dispatch, event, sizeof (event),
+					XGEN_LSB_FIRST) == generic_event);
+
+  g_assert (xgen_dispatch_add_extension (dispatch, "xgentest",
+					 TEST_MAJOR_OPCODE, TEST_FIRST_EVENT,
+					 0));
+
+  g_assert (XGEN_DEF (xgen_dispatch_lookup_event (dispatch, event,
+						  sizeof (event),
+						  XGEN_LSB_FIRST)) == motion);
+  make_generic_event (event, sizeof (event), TEST_MAJOR_OPCODE, 7);
+  g_assert (XGEN_DEF (xgen_dispatch_lookup_event (dispatch, event,
+						  sizeof (event),
+						  XGEN_LSB_FIRST)) == enter);
+  /* The event type is read in the byte order of the connection */
+  event[8] = 0;
+  event[9] = 7;
+  g_assert (XGEN_DEF (xgen_dispatch_lookup_event (dispatch, event,
+						  sizeof (event),
+						  XGEN_MSB_FIRST)) == enter);
+
+  /* Unknown event types, other extensions and truncated headers fall
+   * back to the core definition */
+  make_generic_event (event, sizeof (event), TEST_MAJOR_OPCODE, 5);
+  g_assert (xgen_dispatch_lookup_event (dispatch, event, sizeof (event),
+					XGEN_LSB_FIRST) == generic_event);
+  make_generic_event (event, sizeof (event), TEST_MAJOR_OPCODE, 0x106);
+  g_assert (xgen_dispatch_lookup_event (dispatch, event, sizeof (event),
+					XGEN_LSB_FIRST) == generic_event);
+  make_generic_event (event, sizeof (event), TEST_MAJOR_OPCODE + 1, 6);
+  g_assert (xgen_dispatch_lookup_event (dispatch, event, sizeof (event),
+					XGEN_LSB_FIRST) == generic_event);
+  make_generic_event (event, sizeof (event), TEST_MAJOR_OPCODE, 6);
+  g_assert (xgen_dispatch_lookup_event (dispatch, event, 9,
+					XGEN_LSB_FIRST) == generic_event);
+
+  /* Plain events still use the event codes */
+  memset (event, 0, sizeof (event));
+  event[0] = TEST_FIRST_EVENT;
+  g_assert (XGEN_DEF (xgen_dispatch_lookup_event (dispatch, event,
+						  sizeof (event),
+						  XGEN_LSB_FIRST)) == plain);
+  event[0] = TEST_FIRST_EVENT + 6;
+  g_assert (xgen_dispatch_lookup_event (dispatch, event, sizeof (event),
+					XGEN_LSB_FIRST) == NULL);
+
+  g_assert (xgen_dispatch_get_event_code (dispatch, XGEN_EVENT_DEF (motion),
+					  &code));
+  g_assert_cmpuint (code, ==, X_GENERIC_EVENT);
+  g_assert (xgen_dispatch_get_generic_event_opcode (dispatch,
+						    XGEN_EVENT_DEF (enter),
+						    &major_opcode,
+						    &event_type));
+  g_assert_cmpuint (major_opcode, ==, TEST_MAJOR_OPCODE);
+  g_assert_cmpuint (event_type, ==, 7);
+  g_assert (!xgen_dispatch_get_generic_event_opcode (dispatch,
+						     XGEN_EVENT_DEF (plain),
+						     &major_opcode,
+						     &event_type));
+
+  xgen_dispatch_free (dispatch);
+}
+
+void
+test_generic_filter (TestXGENSimpleFixture *fixture,
+		     gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenState *state = test_xgen_parse_extension (shared_state, test_xml);
+  XGenDispatch *dispatch = xgen_dispatch_new (state);
+  XGenFilter *filter;
+  guint8 event[32];
+
+  g_assert (xgen_dispatch_add_extension (dispatch, "xgentest",
+					 TEST_MAJOR_OPCODE, TEST_FIRST_EVENT,
+					 0));
+  filter = xgen_filter_new (state, dispatch, "xgentest:Motion.deviceid == 3");
+  g_assert (filter);
+
+  make_generic_event (event, sizeof (event), TEST_MAJOR_OPCODE, 6);
+  event[10] = 3;
+  g_assert (xgen_filter_match (filter, XGEN_SERVER_TO_CLIENT, event,
+			       sizeof (event), XGEN_LSB_FIRST)
+	    == xgen_state_find_definition (state, "xgentest:Motion",
+					   XGEN_EVENT));
+  event[10] = 4;
+  g_assert (!xgen_filter_match (filter, XGEN_SERVER_TO_CLIENT, event,
+				sizeof (event), XGEN_LSB_FIRST));
+
+  /* The same field of another generic event doesn't match */
+  make_generic_event (event, sizeof (event), TEST_MAJOR_OPCODE, 7);
+  event[10] = 3;
+  g_assert (!xgen_filter_match (filter, XGEN_SERVER_TO_CLIENT, event,
+				sizeof (event), XGEN_LSB_FIRST));
+  make_generic_event (event, sizeof (event), TEST_MAJOR_OPCODE + 1, 6);
+  event[10] = 3;
+  g_assert (!xgen_filter_match (filter, XGEN_SERVER_TO_CLIENT, event,
+				sizeof (event), XGEN_LSB_FIRST));
+
+  xgen_filter_free (filter);
+  xgen_dispatch_free (dispatch);
+}
@@ -0,0 +1,412 @@
+#include <glib.h>
+#include <string.h>
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-batch.h>
+
+#include "test-xgen-common.h"
+
+static const XGenLayout *
+find_layout (const TestXGENSharedState *shared_state,
+	     const char *name,
+	     XGenType type)
+{
+  return xgen_definition_get_layout (test_xgen_find_definition (shared_state,
+								name, type));
+}
+
+void
+test_layout_request_header (TestXGENSimpleFixture *fixture,
+			    gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenLayout *layout;
+
+  /* A core request's first 1 byte field goes between the opcode and
+   * the length */
+  layout = find_layout (shared_state, "xproto:PolyPoint", XGEN_REQUEST);
+  g_assert_cmpint (test_xgen_field_offset (layout, "opcode"), ==, 0);
+  g_assert_cmpint (test_xgen_field_offset (layout, "coordinate_mode"), ==, 1);
+  g_assert_cmpint (test_xgen_field_offset (layout, "length"), ==, 2);
+  g_assert_cmpint (test_xgen_field_offset (layout, "drawable"), ==, 4);
+  g_assert_cmpint (test_xgen_field_offset (layout, "gc"), ==, 8);
+  g_assert_cmpint (test_xgen_field_offset (layout, "points"), ==, 12);
+  g_assert_cmpuint (layout->fixed_size, ==, 12);
+  g_assert (!layout->is_fixed);
+
+  layout = find_layout (shared_state, "xproto:MapWindow", XGEN_REQUEST);
+  g_assert_cmpint (test_xgen_field_offset (layout, "window"), ==, 4);
+  g_assert_cmpuint (layout->fixed_size, ==, 8);
+  g_assert_cmpuint (layout->min_size, ==, 8);
+  g_assert (layout->is_fixed);
+
+  /* An extension request's fields follow the length since the minor
+   * opcode takes the byte before it */
+  layout = find_layout (shared_state, "shape:Rectangles", XGEN_REQUEST);
+  g_assert_cmpint (test_xgen_field_offset (layout, "opcode"), ==, 0);
+  g_assert_cmpint (test_xgen_field_offset (layout, "minor_opcode"), ==, 1);
+  g_assert_cmpint (test_xgen_field_offset (layout, "length"), ==, 2);
+  g_assert_cmpint (test_xgen_field_offset (layout, "operation"), ==, 4);
+  g_assert_cmpint (test_xgen_field_offset (layout, "destination_window"),
+		   ==, 8);
+  g_assert_cmpint (test_xgen_field_offset (layout, "rectangles"), ==, 16);
+  g_assert_cmpuint (layout->fixed_size, ==, 16);
+}
+
+void
+test_layout_empty_requests (TestXGENSimpleFixture *fixture,
+			    gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  static const char *names[] = {
+    "xproto:GetInputFocus",
+    "shape:QueryVersion",
+    "bigreq:Enable"
+  };
+  guint i;
+
+  /* Requests without fields are just the 4 byte header */
+  for (i = 0; i < G_N_ELEMENTS (names); i++)
+    {
+      const XGenLayout *layout =
+	find_layout (shared_state, names[i], XGEN_REQUEST);
+      guint8 message[4] = { 0x80, 0, 1, 0 };
+      const char *second;
+      GList *values;
+
+      g_assert (layout->is_fixed);
+      g_assert_cmpuint (layout->fixed_size, ==, 4);
+      g_assert_cmpuint (layout->min_size, ==, 4);
+      g_assert_cmpuint (layout->max_size, ==, 4);
+
+      g_assert_cmpuint (xgen_layout_get_message_length (layout, message, 4,
+							XGEN_LSB_FIRST),
+			==, 4);
+      values = xgen_layout_decode (layout, message, 4, XGEN_LSB_FIRST);
+      g_assert (values != NULL);
+      g_assert_cmpuint (g_list_length (values), ==, layout->n_fields);
+      xgen_field_values_free (values);
+
+      /* The second byte is a pad for core requests and the minor
+       * opcode for extension requests */
+      g_assert_cmpuint (layout->n_fields, ==, 3);
+      g_assert_cmpint (test_xgen_field_offset (layout, "opcode"), ==, 0);
+      second = g_str_has_prefix (names[i], "xproto:") ? "pad" : "minor_opcode";
+      g_assert_cmpint (test_xgen_field_offset (layout, second), ==, 1);
+      g_assert_cmpint (test_xgen_field_offset (layout, "length"), ==, 2);
+    }
+}
+
+void
+test_layout_decode (TestXGENSimpleFixture *fixture,
+		    gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenLayout *layout =
+    find_layout (shared_state, "xproto:PolyPoint", XGEN_REQUEST);
+  /* PolyPoint (Previous, drawable 0x400001, gc 0x400002, 2 points) */
+  static const guint8 lsb[] = {
+    64, 1, 5, 0,  0x01, 0, 0x40, 0,  0x02, 0, 0x40, 0,
+    1, 0, 2, 0,  0xff, 0xff, 4, 0
+  };
+  static const guint8 msb[] = {
+    64, 1, 0, 5,  0, 0x40, 0, 0x01,  0, 0x40, 0, 0x02,
+    0, 1, 0, 2,  0xff, 0xff, 0, 4
+  };
+  const guint8 *messages[] = { lsb, msb };
+  XGenByteOrder byte_orders[] = { XGEN_LSB_FIRST, XGEN_MSB_FIRST };
+  XGenFieldExtent extents[6];
+  guint i;
+
+  g_assert_cmpuint (layout->n_fields, ==, 6);
+
+  for (i = 0; i < 2; i++)
+    {
+      GList *values;
+      XGenFieldValue *value;
+
+      g_assert_cmpuint (xgen_layout_get_message_length (layout, messages[i],
+							sizeof (lsb),
+							byte_orders[i]),
+			==, sizeof (lsb));
+      g_assert (xgen_layout_get_extents (layout, messages[i], sizeof (lsb),
+					 byte_orders[i], 6, extents));
+      g_assert_cmpuint (extents[5].offset, ==, 12);
+      g_assert_cmpuint (extents[5].size, ==, 8);
+      g_assert_cmpuint (extents[5].count, ==, 2);
+
+      values = xgen_layout_decode (layout, messages[i], sizeof (lsb),
+				   byte_orders[i]);
+      g_assert (values != NULL);
+      value = g_list_nth_data (values, 1);
+      g_assert_cmpstr (value->field->name, ==, "coordinate_mode");
+      g_assert_cmpuint (value->unsigned_value, ==, 1);
+      value = g_list_nth_data (values, 3);
+      g_assert_cmpstr (value->field->name, ==, "drawable");
+      g_assert_cmpuint (value->unsigned_value, ==, 0x400001);
+      value = g_list_nth_data (values, 5);
+      g_assert_cmpstr (value->field->name, ==, "points");
+      g_assert_cmpuint (value->unsigned_value, ==, 2);
+      g_assert_cmpuint (value->offset, ==, 12);
+      xgen_field_values_free (values);
+
+      /* Truncated messages aren't decoded */
+      g_assert (xgen_layout_decode (layout, messages[i], sizeof (lsb) - 4,
+				    byte_orders[i]) == NULL);
+    }
+}
+
+void
+test_layout_batch_decode (TestXGENSimpleFixture *fixture,
+			  gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenLayout *layout =
+    find_layout (shared_state, "xproto:PolyPoint", XGEN_REQUEST);
+  const XGenLayout *query_version =
+    find_layout (shared_state, "shape:QueryVersion", XGEN_REQUEST);
+  /* PolyPoint in the BIG-REQUESTS form: 5 units with 1 point */
+  static const guint8 big_request[] = {
+    64, 0, 0, 0,  0, 0, 0, 5,  0, 0x40, 0, 0x01,  0, 0x40, 0, 0x02,
+    0, 1, 0, 2
+  };
+  guint8 storage[3][16];
+  const guint8 *messages[4];
+  gsize lengths[4] = { 16, 16, 16, 4 };
+  const XGenColumn *column;
+  XGenBatch *batch;
+  guint i;
+
+  for (i = 0; i < 3; i++)
+    {
+      guint8 *message = storage[i];
+
+      memset (message, 0, sizeof (storage[i]));
+      message[0] = 64;
+      message[1] = i;
+      message[3] = 4;  /* 4 units, big endian */
+      message[7] = 1 + i;
+      message[11] = 0x10;
+      messages[i] = message;
+    }
+
+  batch = xgen_batch_decode (layout, messages, lengths, 3, XGEN_MSB_FIRST);
+  g_assert_cmpuint (batch->n_rows, ==, 3);
+
+  column = xgen_batch_get_column (batch, "coordinate_mode");
+  g_assert (column != NULL);
+  g_assert_cmpuint (column->width, ==, 1);
+  column = xgen_batch_get_column (batch, "drawable");
+  g_assert (column != NULL);
+  g_assert_cmpuint (column->width, ==, 4);
+  for (i = 0; i < 3; i++)
+    {
+      g_assert (batch->valid[i]);
+      g_assert_cmpuint (XGEN_COLUMN_UINT32 (column)[i], ==, 1 + i);
+    }
+  column = xgen_batch_get_column (batch, "gc");
+  g_assert_cmpuint (XGEN_COLUMN_UINT32 (column)[2], ==, 0x10);
+  g_assert (xgen_batch_get_column (batch, "points") == NULL);
+  xgen_batch_free (batch);
+
+  /* Rows are rejected when the header claims more than the caller has
+   * or the fixed fields aren't all there. A BIG-REQUESTS row is walked
+   * within its length. */
+  messages[2] = big_request;
+  lengths[0] = 12;
+  lengths[1] = 8;
+  lengths[2] = sizeof (big_request) - 4;
+  batch = xgen_batch_decode (layout, messages, lengths, 3, XGEN_MSB_FIRST);
+  column = xgen_batch_get_column (batch, "drawable");
+  for (i = 0; i < 3; i++)
+    {
+      g_assert (!batch->valid[i]);
+      g_assert_cmpuint (XGEN_COLUMN_UINT32 (column)[i], ==, 0);
+    }
+  xgen_batch_free (batch);
+
+  lengths[2] = sizeof (big_request);
+  batch = xgen_batch_decode (layout, messages + 2, lengths + 2, 1,
+			     XGEN_MSB_FIRST);
+  column = xgen_batch_get_column (batch, "drawable");
+  g_assert (batch->valid[0]);
+  g_assert_cmphex (XGEN_COLUMN_UINT32 (column)[0], ==, 0x400001);
+  xgen_batch_free (batch);
+
+  /* 4 byte extension requests */
+  for (i = 0; i < 4; i++)
+    {
+      messages[i] = (const guint8 *)"\x80\x00\x01\x00";
+      lengths[i] = 4;
+    }
+  batch = xgen_batch_decode (query_version, messages, lengths, 4,
+			     XGEN_LSB_FIRST);
+  g_assert_cmpuint (batch->n_rows, ==, 4);
+  for (i = 0; i < 4; i++)
+    g_assert (batch->valid[i]);
+  column = xgen_batch_get_column (batch, "length");
+  g_assert (column != NULL);
+  g_assert_cmpuint (XGEN_COLUMN_UINT16 (column)[3], ==, 1);
+  xgen_batch_free (batch);
+}
+
+void
+test_layout_host_abi (TestXGENSimpleFixture *fixture,
+		      gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  static const char xml[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+    "<xcb header=\"xgentest\" extension-xname=\"XGEN-TEST\" "
+    "extension-name=\"XGenTest\" major-version=\"1\" minor-version=\"0\">\n"
+    "  <struct name=\"Unaligned\">\n"
+    "    <field type=\"CARD8\" name=\"a\" />\n"
+    "    <field type=\"CARD32\" name=\"b\" />\n"
+    "  </struct>\n"
+    "  <struct name=\"Unpadded\">\n"
+    "    <field type=\"CARD32\" name=\"a\" />\n"
+    "    <field type=\"CARD8\" name=\"b\" />\n"
+    "  </struct>\n"
+    "</xcb>\n";
+  const XGenByteOrder host_order =
+    G_BYTE_ORDER == G_LITTLE_ENDIAN ? XGEN_LSB_FIRST : XGEN_MSB_FIRST;
+  const XGenByteOrder other_order =
+    G_BYTE_ORDER == G_LITTLE_ENDIAN ? XGEN_MSB_FIRST : XGEN_LSB_FIRST;
+  const XGenLayout *layout;
+  XGenState *state;
+  guint32 message[4] = { 0, };
+  const guint8 *bytes = (const guint8 *)message;
+
+  layout = find_layout (shared_state, "xproto:MapWindow", XGEN_REQUEST);
+  g_assert (layout->matches_host_abi);
+  g_assert (!layout->is_byte_order_neutral);
+  g_assert_cmpuint (layout->alignment, ==, 4);
+  g_assert (xgen_layout_is_host_compatible (layout, host_order));
+  g_assert (!xgen_layout_is_host_compatible (layout, other_order));
+
+  /* A view is only given of complete, aligned messages */
+  g_assert (xgen_layout_get_host_view (layout, bytes, 8, host_order)
+	    == bytes);
+  g_assert (xgen_layout_get_host_view (layout, bytes, 7, host_order)
+	    == NULL);
+  g_assert (xgen_layout_get_host_view (layout, bytes + 2, 8, host_order)
+	    == NULL);
+  g_assert (xgen_layout_get_host_view (layout, bytes, 8, other_order)
+	    == NULL);
+
+  layout = find_layout (shared_state, "xproto:POINT", XGEN_STRUCT);
+  g_assert (layout->matches_host_abi);
+  g_assert_cmpuint (layout->alignment, ==, 2);
+
+  /* Single byte fields read the same in either byte order */
+  layout = find_layout (shared_state, "xproto:FORMAT", XGEN_STRUCT);
+  g_assert (layout->is_byte_order_neutral);
+  g_assert_cmpuint (layout->alignment, ==, 1);
+  g_assert (xgen_layout_is_host_compatible (layout, other_order));
+  g_assert (xgen_layout_get_host_view (layout, bytes + 1, 8, other_order)
+	    == bytes + 1);
+
+  layout = find_layout (shared_state, "xproto:PolyPoint", XGEN_REQUEST);
+  g_assert (!layout->matches_host_abi);
+  g_assert (!xgen_layout_is_host_compatible (layout, host_order));
+
+  state = test_xgen_parse_extension (shared_state, xml);
+  layout = xgen_definition_get_layout
+    (xgen_state_find_definition (state, "xgentest:Unaligned", XGEN_STRUCT));
+  g_assert_cmpuint (layout->fixed_size, ==, 5);
+  g_assert (!layout->matches_host_abi);
+  layout = xgen_definition_get_layout
+    (xgen_state_find_definition (state, "xgentest:Unpadded", XGEN_STRUCT));
+  g_assert_cmpuint (layout->fields[1].offset, ==, 4);
+  g_assert (!layout->matches_host_abi);
+}
+
+void
+test_layout_max_size (TestXGENSimpleFixture *fixture,
+		      gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  static const char xml[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+    "<xcb header=\"xgentest\" extension-xname=\"XGEN-TEST\" "
+    "extension-name=\"XGenTest\" major-version=\"1\" minor-version=\"0\">\n"
+    "  <struct name=\"Bounds\">\n"
+    "    <field type=\"CARD8\" name=\"n\" />\n"
+    "    <field type=\"INT8\" name=\"s\" />\n"
+    "    <field type=\"CARD16\" name=\"m\" />\n"
+    "    <list type=\"CARD8\" name=\"product\">\n"
+    "      <op op=\"*\"><fieldref>n</fieldref><value>2</value></op>\n"
+    "    </list>\n"
+    "    <list type=\"CARD8\" name=\"difference\">\n"
+    "      <op op=\"-\"><fieldref>m</fieldref><fieldref>n</fieldref></op>\n"
+    "    </list>\n"
+    "    <list type=\"CARD8\" name=\"masked\">\n"
+    "      <op op=\"&amp;\"><fieldref>m</fieldref><value>15</value></op>\n"
+    "    </list>\n"
+    "    <list type=\"CARD32\" name=\"signed\">\n"
+    "      <fieldref>s</fieldref>\n"
+    "    </list>\n"
+    "  </struct>\n"
+    "</xcb>\n";
+  static const struct {
+    const char *field;
+    guint64	min;
+    guint64	max;
+  } bounds[] = {
+    { "product", 0, 510 },
+    { "difference", 0, 65535 },
+    { "masked", 0, 15 },
+    { "signed", 0, 127 }
+  };
+  const XGenDefinition *def;
+  const XGenLayout *layout;
+  XGenState *state;
+  guint i;
+
+  layout = find_layout (shared_state, "xproto:MapWindow", XGEN_REQUEST);
+  g_assert (layout->is_bounded);
+  g_assert_cmpuint (layout->max_size, ==, 8);
+
+  /* Events are always 32 bytes */
+  layout = find_layout (shared_state, "xproto:ConfigureNotify", XGEN_EVENT);
+  g_assert (layout->is_bounded);
+  g_assert_cmpuint (layout->max_size, ==, 32);
+
+  /* The name is at most 65535 bytes, padded to 4 */
+  layout = find_layout (shared_state, "xproto:InternAtom", XGEN_REQUEST);
+  g_assert (layout->is_bounded);
+  g_assert_cmpuint (layout->max_size, ==, 8 + 65536);
+
+  /* Up to 65535 STRs of up to 256 bytes each */
+  layout = find_layout (shared_state, "xproto:ListFonts", XGEN_REPLY);
+  g_assert (layout->is_bounded);
+  g_assert_cmpuint (layout->max_size, ==, 32 + 65535 * 256);
+
+  /* The points fill the rest of the request so only its length limits
+   * them */
+  layout = find_layout (shared_state, "xproto:PolyPoint", XGEN_REQUEST);
+  g_assert (!layout->is_bounded);
+  g_assert_cmpuint (layout->max_size, ==, 0);
+
+  state = test_xgen_parse_extension (shared_state, xml);
+  def = xgen_state_find_definition (state, "xgentest:Bounds", XGEN_STRUCT);
+  g_assert (def != NULL);
+  layout = xgen_definition_get_layout (def);
+
+  for (i = 0; i < G_N_ELEMENTS (bounds); i++)
+    {
+      gint index = xgen_layout_find_field (layout, bounds[i].field);
+      const XGenExpression *length;
+      guint64 min, max;
+
+      g_assert_cmpint (index, >=, 0);
+      length = layout->fields[index].field->length;
+      g_assert (xgen_expression_get_bounds (length, def, &min, &max));
+      g_assert_cmpuint (min, ==, bounds[i].min);
+      g_assert_cmpuint (max, ==, bounds[i].max);
+    }
+
+  g_assert (layout->is_bounded);
+  g_assert_cmpuint (layout->max_size, ==, 4 + 510 + 65535 + 15 + 127 * 4);
+}
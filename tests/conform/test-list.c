@@ -0,0 +1,179 @@
+#include <glib.h>
+#include <string.h>
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-list.h>
+
+#include "test-xgen-common.h"
+
+/* Enough elements to go through the vector loops and their tails */
+#define N_ELEMENTS 77
+
+static guint32
+truncate_value (guint32 value, guint size)
+{
+  return size == 4 ? value : value & ((1U << (size * 8)) - 1);
+}
+
+static guint32
+get_element (const void *array, guint size, guint i)
+{
+  switch (size)
+    {
+    case 1:
+      return ((const guint8 *)array)[i];
+    case 2:
+      return ((const guint16 *)array)[i];
+    }
+  return ((const guint32 *)array)[i];
+}
+
+static void
+set_element (void *array, guint size, guint i, guint32 value)
+{
+  switch (size)
+    {
+    case 1:
+      ((guint8 *)array)[i] = value;
+      break;
+    case 2:
+      ((guint16 *)array)[i] = value;
+      break;
+    case 4:
+      ((guint32 *)array)[i] = value;
+      break;
+    }
+}
+
+void
+test_list_convert (TestXGENSimpleFixture *fixture,
+		   gconstpointer data)
+{
+  static const guint sizes[] = { 1, 2, 4 };
+  static const XGenByteOrder byte_orders[] = {
+    XGEN_LSB_FIRST, XGEN_MSB_FIRST
+  };
+  guint32 src[N_ELEMENTS];
+  guint32 dest[N_ELEMENTS];
+  guint8 wire[N_ELEMENTS * 4];
+  guint32 seed = 1;
+  guint s, w, d, o, i;
+
+  for (s = 0; s < G_N_ELEMENTS (sizes); s++)
+    for (w = 0; w < G_N_ELEMENTS (sizes); w++)
+      for (d = 0; d < G_N_ELEMENTS (sizes); d++)
+	for (o = 0; o < G_N_ELEMENTS (byte_orders); o++)
+	  {
+	    guint src_size = sizes[s];
+	    guint wire_size = sizes[w];
+	    guint dest_size = sizes[d];
+	    XGenList list;
+
+	    for (i = 0; i < N_ELEMENTS; i++)
+	      {
+		seed = seed * 1103515245 + 12345;
+		set_element (src, src_size, i, seed);
+	      }
+
+	    xgen_list_write (src, src_size, N_ELEMENTS, wire, wire_size,
+			     byte_orders[o]);
+
+	    /* Check the wire bytes of the first and last elements */
+	    for (i = 0; i < N_ELEMENTS; i += N_ELEMENTS - 1)
+	      {
+		guint32 value = truncate_value (get_element (src, src_size, i),
+						wire_size);
+		const guint8 *bytes = wire + i * wire_size;
+		guint32 read = 0;
+		guint b;
+
+		for (b = 0; b < wire_size; b++)
+		  if (byte_orders[o] == XGEN_LSB_FIRST)
+		    read |= (guint32)bytes[b] << (b * 8);
+		  else
+		    read = (read << 8) | bytes[b];
+		g_assert_cmphex (read, ==, value);
+	      }
+
+	    list.data = wire;
+	    list.count = N_ELEMENTS;
+	    list.element_size = wire_size;
+	    list.byte_order = byte_orders[o];
+	    memset (dest, 0xaa, sizeof (dest));
+	    xgen_list_read (&list, dest, dest_size);
+
+	    for (i = 0; i < N_ELEMENTS; i++)
+	      {
+		guint32 value = get_element (src, src_size, i);
+
+		value = truncate_value (value, MIN (src_size, wire_size));
+		value = truncate_value (value, dest_size);
+		g_assert_cmphex (get_element (dest, dest_size, i), ==, value);
+	      }
+	  }
+}
+
+void
+test_list_get (TestXGENSimpleFixture *fixture,
+	       gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenDefinition *get_property =
+    test_xgen_find_definition (shared_state, "xproto:GetProperty",
+			       XGEN_REPLY);
+  const XGenDefinition *poly_point_def =
+    test_xgen_find_definition (shared_state, "xproto:PolyPoint",
+			       XGEN_REQUEST);
+  const XGenLayout *layout = xgen_definition_get_layout (get_property);
+  const XGenLayout *poly_point = xgen_definition_get_layout (poly_point_def);
+  /* A GetProperty reply with 3 16 bit values */
+  guint8 reply[40] = {
+    1, 16, 0, 1,  0, 0, 0, 2,  0, 0, 0, 0x13,  0, 0, 0, 0,
+    0, 0, 0, 3,
+  };
+  static const guint8 point[16] = { 64, 0, 4, 0 };
+  TestXGENWarnings warnings;
+  guint32 values[3];
+  XGenList list;
+
+  reply[32] = 0x12;
+  reply[33] = 0x34;
+  reply[35] = 0x02;
+  reply[36] = 0xff;
+
+  g_assert (xgen_layout_get_list (layout, reply, sizeof (reply),
+				  XGEN_MSB_FIRST,
+				  xgen_layout_find_field (layout, "value"),
+				  &list));
+  g_assert (list.data == reply + 32);
+  g_assert_cmpuint (list.count, ==, 3);
+  g_assert_cmpuint (list.element_size, ==, 2);
+  xgen_list_read (&list, values, 4);
+  g_assert_cmphex (values[0], ==, 0x1234);
+  g_assert_cmphex (values[1], ==, 0x0002);
+  g_assert_cmphex (values[2], ==, 0xff00);
+
+  /* The format gives the element size of void lists */
+  reply[1] = 8;
+  g_assert (xgen_layout_get_list (layout, reply, sizeof (reply),
+				  XGEN_MSB_FIRST,
+				  xgen_layout_find_field (layout, "value"),
+				  &list));
+  g_assert_cmpuint (list.element_size, ==, 1);
+  g_assert_cmpuint (list.count, ==, 3);
+
+  /* The list must be within the message */
+  reply[1] = 32;
+  g_assert (!xgen_layout_get_list (layout, reply, 40, XGEN_MSB_FIRST,
+				   xgen_layout_find_field (layout, "value"),
+				   &list));
+
+  test_xgen_warnings_begin (&warnings);
+  g_assert (!xgen_layout_get_list (poly_point, point, sizeof (point),
+				   XGEN_LSB_FIRST,
+				   xgen_layout_find_field (poly_point,
+							   "points"),
+				   &list));
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), ==, 1);
+}
@@ -0,0 +1,318 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-io.h>
+#include <xgen-mock.h>
+
+#include "test-xgen-common.h"
+
+#define RESOURCE_ID_BASE 0x200000
+#define ROOT_WINDOW 0x100
+#define ROOT_VISUAL 0x102
+
+typedef struct _MockClient
+{
+  XGenMockServer *server;
+  char		 *socket_path;
+  int		  fd;
+  gboolean	  swap;
+} MockClient;
+
+static guint32
+read_unsigned (const MockClient *client, const guint8 *data, guint size)
+{
+  guint32 value = 0;
+  guint i;
+
+  for (i = 0; i < size; i++)
+    if (client->swap)
+      value = (value << 8) | data[i];
+    else
+      value |= (guint32)data[i] << (i * 8);
+  return value;
+}
+
+/* Reads a field of a fixed size struct, or of the fixed part of one */
+static guint32
+get_member (const MockClient *client,
+	    const TestXGENSharedState *shared_state,
+	    const char *struct_name,
+	    const guint8 *data,
+	    const char *name)
+{
+  const XGenLayout *layout =
+    xgen_definition_get_layout (test_xgen_find_definition (shared_state,
+							   struct_name,
+							   XGEN_STRUCT));
+  gint index = xgen_layout_find_field (layout, name);
+
+  g_assert (index >= 0);
+  g_assert ((guint)layout->fields[index].offset < layout->fixed_size);
+  return read_unsigned (client, data + layout->fields[index].offset,
+			layout->fields[index].size);
+}
+
+static guint
+get_fixed_size (const TestXGENSharedState *shared_state,
+		const char *struct_name)
+{
+  return xgen_definition_get_layout
+    (test_xgen_find_definition (shared_state, struct_name,
+				XGEN_STRUCT))->fixed_size;
+}
+
+static void
+mock_start (MockClient *client, const TestXGENSharedState *shared_state)
+{
+  int fd;
+
+  memset (client, 0, sizeof (MockClient));
+
+  /* A unique name for the socket */
+  fd = g_file_open_tmp ("test-mock-XXXXXX", &client->socket_path, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  g_unlink (client->socket_path);
+
+  client->server = xgen_mock_server_new (shared_state->state,
+					 client->socket_path);
+  g_assert (client->server);
+}
+
+static void
+mock_open_socket (MockClient *client)
+{
+  struct sockaddr_un addr;
+
+  client->fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  g_assert (client->fd >= 0);
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, client->socket_path);
+  g_assert (connect (client->fd, (struct sockaddr *)&addr,
+		     sizeof (addr)) == 0);
+}
+
+/* Connects in @byte_order and returns the setup reply */
+static guint8 *
+mock_connect (MockClient *client, XGenByteOrder byte_order, gsize *len)
+{
+  guint8 request[12];
+  guint8 header[8];
+  guint8 *setup;
+
+  mock_open_socket (client);
+
+  client->swap = byte_order == XGEN_MSB_FIRST;
+  memset (request, 0, sizeof (request));
+  request[0] = client->swap ? 'B' : 'l';
+  request[client->swap ? 3 : 2] = 11;
+  g_assert (write (client->fd, request, sizeof (request))
+	    == sizeof (request));
+
+  g_assert (xgen_io_read_exactly (client->fd, header, sizeof (header)));
+  *len = 8 + read_unsigned (client, header + 6, 2) * 4;
+  setup = g_malloc (*len);
+  memcpy (setup, header, sizeof (header));
+  g_assert (xgen_io_read_exactly (client->fd, setup + 8, *len - 8));
+
+  return setup;
+}
+
+static void
+mock_stop (MockClient *client)
+{
+  close (client->fd);
+  xgen_mock_server_free (client->server);
+  g_free (client->socket_path);
+}
+
+void
+test_mock_setup (TestXGENSimpleFixture *fixture,
+		 gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  static const XGenByteOrder byte_orders[] = {
+    XGEN_LSB_FIRST, XGEN_MSB_FIRST
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (byte_orders); i++)
+    {
+      MockClient client;
+      const guint8 *p;
+      guint8 *setup;
+      guint vendor_len;
+      guint n_formats;
+      gsize len;
+
+      mock_start (&client, shared_state);
+      g_assert (xgen_mock_server_start (client.server));
+      setup = mock_connect (&client, byte_orders[i], &len);
+
+#define SETUP(NAME) \
+  get_member (&client, shared_state, "xproto:Setup", setup, NAME)
+      g_assert_cmpuint (SETUP ("status"), ==, 1);
+      g_assert_cmpuint (SETUP ("protocol_major_version"), ==, 11);
+      g_assert_cmphex (SETUP ("resource_id_base"), ==, RESOURCE_ID_BASE);
+      g_assert_cmpuint (SETUP ("roots_len"), ==, 1);
+      g_assert_cmpuint (SETUP ("image_byte_order"), ==, i);
+      g_assert_cmpuint (SETUP ("min_keycode"), ==, 8);
+      vendor_len = SETUP ("vendor_len");
+      n_formats = SETUP ("pixmap_formats_len");
+#undef SETUP
+
+      /* The lists follow the fixed part back to back */
+      p = setup + get_fixed_size (shared_state, "xproto:Setup");
+      g_assert (vendor_len > 0 && vendor_len % 4 == 0);
+      g_assert (memcmp (p, "XGen", 4) == 0);
+      p += vendor_len;
+      g_assert_cmpuint (n_formats, ==, 2);
+      g_assert_cmpuint (get_member (&client, shared_state, "xproto:FORMAT",
+				    p + get_fixed_size (shared_state,
+							"xproto:FORMAT"),
+				    "depth"), ==, 24);
+      p += n_formats * get_fixed_size (shared_state, "xproto:FORMAT");
+
+#define SCREEN(NAME) \
+  get_member (&client, shared_state, "xproto:SCREEN", p, NAME)
+      g_assert_cmphex (SCREEN ("root"), ==, ROOT_WINDOW);
+      g_assert_cmphex (SCREEN ("root_visual"), ==, ROOT_VISUAL);
+      g_assert_cmpuint (SCREEN ("width_in_pixels"), ==, 1920);
+      g_assert_cmpuint (SCREEN ("root_depth"), ==, 24);
+      g_assert_cmpuint (SCREEN ("allowed_depths_len"), ==, 1);
+#undef SCREEN
+      p += get_fixed_size (shared_state, "xproto:SCREEN");
+
+      g_assert_cmpuint (get_member (&client, shared_state, "xproto:DEPTH",
+				    p, "depth"), ==, 24);
+      g_assert_cmpuint (get_member (&client, shared_state, "xproto:DEPTH",
+				    p, "visuals_len"), ==, 1);
+      p += get_fixed_size (shared_state, "xproto:DEPTH");
+
+      g_assert_cmphex (get_member (&client, shared_state,
+				   "xproto:VISUALTYPE", p, "visual_id"),
+		       ==, ROOT_VISUAL);
+      g_assert_cmphex (get_member (&client, shared_state,
+				   "xproto:VISUALTYPE", p, "red_mask"),
+		       ==, 0xff0000);
+      p += get_fixed_size (shared_state, "xproto:VISUALTYPE");
+
+      /* The visual is the last thing in the setup */
+      g_assert (p == setup + len);
+
+      g_free (setup);
+      mock_stop (&client);
+    }
+}
+
+void
+test_mock_setup_info (TestXGENSimpleFixture *fixture,
+		      gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  static const XGenByteOrder byte_orders[] = {
+    XGEN_LSB_FIRST, XGEN_MSB_FIRST
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (byte_orders); i++)
+    {
+      XGenSetupInfo info;
+      MockClient client;
+
+      mock_start (&client, shared_state);
+      g_assert (xgen_mock_server_start (client.server));
+      mock_open_socket (&client);
+
+      /* The shared client side of the setup finds the first screen past
+       * the vendor string and pixmap formats */
+      memset (&info, 0, sizeof (info));
+      g_assert (xgen_io_setup_connection (shared_state->state, client.fd,
+					  byte_orders[i], &info));
+      g_assert_cmphex (info.resource_id_base, ==, RESOURCE_ID_BASE);
+      g_assert_cmphex (info.resource_id_mask, !=, 0);
+      g_assert_cmpuint (info.maximum_request_length, >, 0);
+      g_assert_cmphex (info.root, ==, ROOT_WINDOW);
+      g_assert_cmphex (info.root_visual, ==, ROOT_VISUAL);
+
+      mock_stop (&client);
+    }
+}
+
+/* Waits for the connection to add up its counts */
+static void
+wait_for_requests (XGenMockServer *server,
+		   guint64 n_requests,
+		   XGenMockServerStats *stats)
+{
+  guint i;
+
+  for (i = 0; i < 5000; i++)
+    {
+      xgen_mock_server_get_stats (server, stats);
+      if (stats->n_requests >= n_requests)
+	return;
+      g_usleep (1000);
+    }
+}
+
+void
+test_mock_requests (TestXGENSimpleFixture *fixture,
+		    gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  /* An unknown core request, an unknown request of the first extension,
+   * then GetInputFocus */
+  guint8 requests[12] = { 120, 55, 1, 0,  128, 99, 1, 0,  43, 0, 1, 0 };
+  XGenMockServerStats stats;
+  MockClient client;
+  guint8 *setup;
+  guint8 reply[32];
+  guint8 error[32];
+  gsize len;
+
+  mock_start (&client, shared_state);
+  g_assert (xgen_mock_server_set_value (client.server, "GetInputFocus",
+					"focus", 0x1234));
+  g_assert (xgen_mock_server_start (client.server));
+  setup = mock_connect (&client, XGEN_LSB_FIRST, &len);
+  g_free (setup);
+
+  g_assert (write (client.fd, requests, sizeof (requests))
+	    == sizeof (requests));
+
+  /* Core requests have no minor opcode */
+  g_assert (xgen_io_read_exactly (client.fd, error, sizeof (error)));
+  g_assert_cmpuint (error[0], ==, 0);
+  g_assert_cmpuint (error[1], ==, 1);
+  g_assert_cmpuint (read_unsigned (&client, error + 2, 2), ==, 1);
+  g_assert_cmpuint (read_unsigned (&client, error + 8, 2), ==, 0);
+  g_assert_cmpuint (error[10], ==, 120);
+
+  g_assert (xgen_io_read_exactly (client.fd, error, sizeof (error)));
+  g_assert_cmpuint (error[0], ==, 0);
+  g_assert_cmpuint (read_unsigned (&client, error + 2, 2), ==, 2);
+  g_assert_cmpuint (read_unsigned (&client, error + 8, 2), ==, 99);
+  g_assert_cmpuint (error[10], ==, 128);
+
+  g_assert (xgen_io_read_exactly (client.fd, reply, sizeof (reply)));
+  g_assert_cmpuint (reply[0], ==, 1);
+  g_assert_cmpuint (read_unsigned (&client, reply + 2, 2), ==, 3);
+  g_assert_cmphex (read_unsigned (&client, reply + 8, 4), ==, 0x1234);
+
+  wait_for_requests (client.server, 3, &stats);
+  g_assert_cmpuint (stats.n_connections, ==, 1);
+  g_assert_cmpuint (stats.n_requests, ==, 3);
+  g_assert_cmpuint (stats.n_unknown, ==, 2);
+  g_assert_cmpuint (stats.n_replies, ==, 1);
+  g_assert_cmpuint (stats.n_bytes, ==, sizeof (requests));
+
+  mock_stop (&client);
+}
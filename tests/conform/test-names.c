@@ -0,0 +1,150 @@
+#include <glib.h>
+#include <string.h>
+
+#include <xgen.h>
+#include <xgen-names.h>
+
+#include "test-xgen-common.h"
+
+/* Reuses a core request and enum name so the unqualified names clash */
+static const char test_xml[] =
+  "<xcb header=\"xgentest\" extension-xname=\"XGEN-TEST\" "
+  "extension-name=\"XGenTest\" major-version=\"1\" minor-version=\"0\">\n"
+  "  <request name=\"MapWindow\" opcode=\"0\" />\n"
+  "  <enum name=\"EventMask\">\n"
+  "    <item name=\"NoEvent\"><value>7</value></item>\n"
+  "    <item name=\"TestOnly\"><value>8</value></item>\n"
+  "  </enum>\n"
+  "</xcb>\n";
+
+/* Checks that every definition of @state is found the same way by the
+ * name tables as by xgen_state_find_definition() */
+static void
+check_definitions (const XGenState *state, const XGenNames *names)
+{
+  GList *tmp;
+
+  for (tmp = state->extensions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+      GList *tmp2;
+
+      for (tmp2 = extension->all_definitions; tmp2 != NULL; tmp2 = tmp2->next)
+	{
+	  XGenDefinition *def = tmp2->data;
+	  char *name = g_strdup_printf ("%s:%s", extension->header,
+					def->name);
+
+	  g_assert (xgen_names_find_definition (names, name, def->type)
+		    == xgen_state_find_definition (state, name, def->type));
+	  g_assert (xgen_names_find_definition (names, def->name, def->type)
+		    == xgen_state_find_definition (state, def->name,
+						   def->type));
+	  g_free (name);
+	}
+    }
+}
+
+/* Checks that every enum item of @state is found by its qualified name */
+static void
+check_items (const XGenState *state, const XGenNames *names)
+{
+  GList *tmp;
+
+  for (tmp = state->extensions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+      GList *tmp2;
+
+      for (tmp2 = extension->enums; tmp2 != NULL; tmp2 = tmp2->next)
+	{
+	  XGenDefinition *def = tmp2->data;
+	  GList *tmp3;
+
+	  for (tmp3 = XGEN_ENUM_DEF (def)->items; tmp3; tmp3 = tmp3->next)
+	    {
+	      XGenItemDefinition *item = tmp3->data;
+	      const XGenDefinition *enum_def = NULL;
+	      char *name = g_strdup_printf ("%s:%s.%s", extension->header,
+					    def->name, item->name);
+
+	      g_assert (xgen_names_find_item (names, name, &enum_def) == item);
+	      g_assert (enum_def == def);
+	      g_free (name);
+	    }
+	}
+    }
+}
+
+void
+test_names_core (TestXGENSimpleFixture *fixture,
+		 gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenNames *names = xgen_names_new (shared_state->state);
+
+  check_definitions (shared_state->state, names);
+  check_items (shared_state->state, names);
+
+  /* Misses aren't confused with whatever name owns their entry */
+  g_assert (xgen_names_find_definition (names, "xproto:NoSuchRequest",
+					XGEN_REQUEST) == NULL);
+  g_assert (xgen_names_find_definition (names, "nosuch:MapWindow",
+					XGEN_REQUEST) == NULL);
+  g_assert (xgen_names_find_definition (names, "shape:MapWindow",
+					XGEN_REQUEST) == NULL);
+  g_assert (xgen_names_find_definition (names, "xproto:MapWindow",
+					XGEN_EVENT) == NULL);
+  g_assert (xgen_names_find_definition (names, "", XGEN_REQUEST) == NULL);
+  g_assert (xgen_names_find_item (names, "EventMask.NoSuchItem", NULL)
+	    == NULL);
+  g_assert (xgen_names_find_item (names, "EventMask", NULL) == NULL);
+
+  xgen_names_free (names);
+}
+
+void
+test_names_clash (TestXGENSimpleFixture *fixture,
+		  gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenState *state = test_xgen_parse_extension (shared_state, test_xml);
+  XGenNames *names = xgen_names_new (state);
+  XGenDefinition *test_enum =
+    xgen_state_find_definition (state, "xgentest:EventMask", XGEN_ENUM);
+  XGenDefinition *core_enum =
+    xgen_state_find_definition (state, "xproto:EventMask", XGEN_ENUM);
+  const XGenItemDefinition *item;
+  const XGenDefinition *enum_def;
+
+  g_assert (test_enum && core_enum);
+  check_definitions (state, names);
+  check_items (state, names);
+
+  /* Both extensions keep their own qualified names, and the unqualified
+   * name goes to whichever xgen_state_find_definition() finds first */
+  g_assert (xgen_names_find_definition (names, "xgentest:MapWindow",
+					XGEN_REQUEST)
+	    != xgen_names_find_definition (names, "xproto:MapWindow",
+					   XGEN_REQUEST));
+  g_assert (xgen_names_find_definition (names, "MapWindow", XGEN_REQUEST)
+	    == xgen_state_find_definition (state, "MapWindow", XGEN_REQUEST));
+
+  item = xgen_names_find_item (names, "xproto:EventMask.NoEvent",
+			       &enum_def);
+  g_assert (item && enum_def == core_enum);
+  item = xgen_names_find_item (names, "xgentest:EventMask.NoEvent",
+			       &enum_def);
+  g_assert (item && enum_def == test_enum);
+  g_assert_cmpstr (item->value, ==, "7");
+  item = xgen_names_find_item (names, "EventMask.NoEvent", &enum_def);
+  g_assert (item);
+  g_assert (enum_def == xgen_state_find_definition (state, "EventMask",
+						    XGEN_ENUM));
+
+  /* Names only one extension has are always found unqualified */
+  item = xgen_names_find_item (names, "EventMask.TestOnly", &enum_def);
+  g_assert (item && enum_def == test_enum);
+
+  xgen_names_free (names);
+}
@@ -0,0 +1,209 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <xgen.h>
+#include <xgen-notifier.h>
+
+#include "test-xgen-common.h"
+
+/* The names notified for each extension, in order, by header */
+static GHashTable *notified = NULL;
+static GMutex *notified_lock = NULL;
+static guint n_notified = 0;
+
+static void
+record (XGenDefinition *def, char kind)
+{
+  GString *names;
+
+  g_mutex_lock (notified_lock);
+  names = g_hash_table_lookup (notified, def->extension->header);
+  if (!names)
+    {
+      names = g_string_new (NULL);
+      g_hash_table_insert (notified, def->extension->header, names);
+    }
+  g_string_append_printf (names, "%c:%s ", kind, def->name);
+  n_notified++;
+  g_mutex_unlock (notified_lock);
+}
+
+static void
+record_request (XGenRequest *request)
+{
+  XGenDefinition *def = XGEN_DEF (request);
+
+  /* Each definition is only seen by one worker so this isn't locked */
+  g_assert (xgen_definition_get_private (def) == NULL);
+  xgen_definition_set_private (def, request);
+  record (def, 'r');
+}
+
+static void
+record_event (XGenEvent *event)
+{
+  record (XGEN_DEF (event), 'e');
+}
+
+static void
+free_names (gpointer data)
+{
+  g_string_free (data, TRUE);
+}
+
+static void
+reset_notified (void)
+{
+  if (notified)
+    g_hash_table_destroy (notified);
+  notified = g_hash_table_new_full (g_str_hash, g_str_equal,
+				    NULL, free_names);
+  n_notified = 0;
+}
+
+static GList *
+get_files (void)
+{
+  GList *files = NULL;
+
+  files = g_list_append (files, "xproto.xml");
+  files = g_list_append (files, "shape.xml");
+  return files;
+}
+
+static char *
+take_names (const char *header)
+{
+  GString *names = g_hash_table_lookup (notified, header);
+
+  g_assert (names);
+  return g_strdup (names->str);
+}
+
+void
+test_notifier_order (TestXGENSimpleFixture *fixture,
+		     gconstpointer data)
+{
+  XGenEventHandlers handlers;
+  XGenNotifier *notifier;
+  XGenState *state;
+  GList *files = get_files ();
+  char *xproto_names;
+  char *shape_names;
+  guint n_expected;
+  GList *tmp;
+
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
+  notified_lock = g_mutex_new ();
+
+  memset (&handlers, 0, sizeof (handlers));
+  handlers.request_notify = record_request;
+  handlers.event_notify = record_event;
+
+  /* A synchronous parse gives the expected order */
+  reset_notified ();
+  xgen_set_handlers (&handlers);
+  state = xgen_parse_xcb_proto_files (files);
+  xgen_set_handlers (NULL);
+  g_assert (state);
+  xproto_names = take_names ("xproto");
+  shape_names = take_names ("shape");
+  n_expected = n_notified;
+
+  reset_notified ();
+  notifier = xgen_notifier_new (&handlers, 2);
+  state = xgen_notifier_parse (notifier, NULL, files);
+  g_assert (state);
+  xgen_notifier_wait (notifier);
+
+  g_assert_cmpuint (n_notified, ==, n_expected);
+  g_assert_cmpuint (g_hash_table_size (notified), ==, 2);
+  g_assert_cmpstr (((GString *)g_hash_table_lookup (notified,
+						    "xproto"))->str,
+		   ==, xproto_names);
+  g_assert_cmpstr (((GString *)g_hash_table_lookup (notified,
+						    "shape"))->str,
+		   ==, shape_names);
+
+  /* What the handlers stored is visible once the notifier is done */
+  for (tmp = xgen_state_find_extension (state, "shape")->requests;
+       tmp != NULL;
+       tmp = tmp->next)
+    g_assert (xgen_definition_get_private (tmp->data) == tmp->data);
+
+  /* The notifier can be reused after waiting */
+  reset_notified ();
+  g_assert (xgen_notifier_parse (notifier, NULL, files));
+  xgen_notifier_wait (notifier);
+  g_assert_cmpuint (n_notified, ==, n_expected);
+
+  xgen_notifier_free (notifier);
+  g_free (xproto_names);
+  g_free (shape_names);
+  g_list_free (files);
+  g_hash_table_destroy (notified);
+  notified = NULL;
+  g_mutex_free (notified_lock);
+}
+
+void
+test_notifier_invalid (TestXGENSimpleFixture *fixture,
+		       gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  static const char xml[] =
+    "<xcb header=\"xgentest\" extension-xname=\"XGEN-TEST\" "
+    "extension-name=\"XGenTest\" major-version=\"1\" minor-version=\"0\">\n"
+    "  <import>nosuchextension</import>\n"
+    "  <request name=\"Request\" opcode=\"0\" />\n"
+    "</xcb>\n";
+  XGenEventHandlers handlers;
+  TestXGENWarnings warnings;
+  XGenNotifier *notifier;
+  GList *files = get_files ();
+  GList *invalid = NULL;
+  char *filename;
+  int fd;
+
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
+  notified_lock = g_mutex_new ();
+  reset_notified ();
+
+  memset (&handlers, 0, sizeof (handlers));
+  handlers.request_notify = record_request;
+  notifier = xgen_notifier_new (&handlers, 0);
+
+  /* Nothing is delivered for a failed parse */
+  fd = g_file_open_tmp ("test-notifier-XXXXXX", &filename, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  g_assert (g_file_set_contents (filename, xml, -1, NULL));
+  invalid = g_list_append (invalid, filename);
+  test_xgen_warnings_begin (&warnings);
+  g_assert (xgen_notifier_parse (notifier, shared_state->state,
+				 invalid) == NULL);
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), >, 0);
+  xgen_notifier_wait (notifier);
+  g_assert_cmpuint (n_notified, ==, 0);
+  g_list_free (invalid);
+  g_unlink (filename);
+  g_free (filename);
+
+  /* Nor can another parse start before the last one is delivered */
+  g_assert (xgen_notifier_parse (notifier, NULL, files));
+  test_xgen_warnings_begin (&warnings);
+  g_assert (xgen_notifier_parse (notifier, NULL, files) == NULL);
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), ==, 1);
+
+  xgen_notifier_free (notifier);
+  g_assert_cmpuint (n_notified, >, 0);
+
+  g_list_free (files);
+  g_hash_table_destroy (notified);
+  notified = NULL;
+  g_mutex_free (notified_lock);
+}
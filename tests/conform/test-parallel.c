@@ -0,0 +1,371 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-capture.h>
+#include <xgen-dispatch.h>
+#include <xgen-filter.h>
+#include <xgen-parallel.h>
+
+#include "test-xgen-common.h"
+
+#define N_CONNECTIONS 5
+#define N_WORKERS     3
+
+typedef struct _ParallelState
+{
+  volatile gint  busy[N_CONNECTIONS];
+  guint		 n_records[N_CONNECTIONS];
+  guint64	 last_sequence[N_CONNECTIONS];
+  gboolean	 in_order;
+  gboolean	 concurrent;
+} ParallelState;
+
+/* Writes n_records alternating MapWindow and GetInputFocus requests in
+ * small segments, so each capture has many segments to hand out. Each
+ * MapWindow maps the window whose XID is its sequence number. */
+static char *
+write_capture (const XGenState *state, guint n_records)
+{
+  XGenDefinition *map_window =
+    xgen_state_find_definition (state, "xproto:MapWindow", XGEN_REQUEST);
+  XGenDefinition *get_input_focus =
+    xgen_state_find_definition (state, "xproto:GetInputFocus", XGEN_REQUEST);
+  XGenCaptureWriter *writer;
+  char *filename;
+  guint i;
+  int fd;
+
+  fd = g_file_open_tmp ("test-parallel-XXXXXX", &filename, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+
+  writer = xgen_capture_writer_new (filename);
+  g_assert (writer);
+  xgen_capture_writer_set_max_segment_size (writer, 1024);
+
+  for (i = 0; i < n_records; i++)
+    {
+      guint8 data[8] = { 0, };
+
+      if (i % 2)
+	{
+	  data[0] = 43;
+	  data[2] = 1;
+	  g_assert (xgen_capture_writer_append (writer, i,
+						XGEN_CLIENT_TO_SERVER, i,
+						get_input_focus, data, 4));
+	}
+      else
+	{
+	  data[0] = 8;
+	  data[2] = 2;
+	  data[4] = i & 0xff;
+	  data[5] = i >> 8;
+	  g_assert (xgen_capture_writer_append (writer, i,
+						XGEN_CLIENT_TO_SERVER, i,
+						map_window, data, 8));
+	}
+    }
+
+  g_assert (xgen_capture_writer_close (writer));
+
+  return filename;
+}
+
+/* Reads a field of a little endian record using the extents the
+ * decoder found */
+static guint32
+read_field (const XGenCaptureRecord *record,
+	    const XGenDefinition *definition,
+	    const XGenFieldExtent *extents,
+	    const char *name)
+{
+  const guint8 *data = XGEN_CAPTURE_RECORD_DATA (record);
+  gint index =
+    xgen_layout_find_field (xgen_definition_get_layout (definition), name);
+  guint32 value = 0;
+  guint i;
+
+  g_assert (index >= 0);
+  g_assert_cmpuint (extents[index].offset + extents[index].size, <=,
+		    record->length);
+  for (i = 0; i < extents[index].size && i < 4; i++)
+    value |= (guint32)data[extents[index].offset + i] << (i * 8);
+  return value;
+}
+
+static void
+check_record (guint worker,
+	      guint connection,
+	      const XGenCaptureRecord *record,
+	      const XGenDefinition *definition,
+	      const XGenFieldExtent *extents,
+	      XGenByteOrder byte_order,
+	      void *user_data)
+{
+  ParallelState *state = user_data;
+
+  g_assert_cmpuint (worker, <, N_WORKERS);
+  g_assert_cmpuint (connection, <, N_CONNECTIONS);
+  g_assert (definition != NULL);
+  g_assert (definition->type == XGEN_REQUEST);
+
+  if (strcmp (definition->name, "MapWindow") == 0)
+    {
+      g_assert_cmpuint (read_field (record, definition, extents, "length"),
+			==, 2);
+      g_assert_cmpuint (read_field (record, definition, extents, "window"),
+			==, record->sequence);
+    }
+  else
+    g_assert_cmpuint (read_field (record, definition, extents, "length"),
+		      ==, 1);
+
+  if (!g_atomic_int_compare_and_exchange (&state->busy[connection], 0, 1))
+    state->concurrent = TRUE;
+
+  if (state->n_records[connection]
+      && record->sequence <= state->last_sequence[connection])
+    state->in_order = FALSE;
+  state->n_records[connection]++;
+  state->last_sequence[connection] = record->sequence;
+
+  g_atomic_int_set (&state->busy[connection], 0);
+}
+
+static XGenParallelDecoder *
+create_decoder (const TestXGENSharedState *shared_state, char **filenames)
+{
+  XGenParallelDecoder *decoder =
+    xgen_parallel_decoder_new (shared_state->state, N_WORKERS);
+  guint i;
+
+  /* Captures of different sizes so that workers run out at different
+   * times and have to steal or wait */
+  for (i = 0; i < N_CONNECTIONS; i++)
+    {
+      filenames[i] = write_capture (shared_state->state, (i + 1) * 300);
+      g_assert_cmpint (xgen_parallel_decoder_add_capture (decoder,
+							  filenames[i],
+							  XGEN_LSB_FIRST),
+		       ==, i);
+    }
+
+  return decoder;
+}
+
+static void
+remove_captures (char **filenames)
+{
+  guint i;
+
+  for (i = 0; i < N_CONNECTIONS; i++)
+    {
+      g_unlink (filenames[i]);
+      g_free (filenames[i]);
+    }
+}
+
+void
+test_parallel_decode (TestXGENSimpleFixture *fixture,
+		      gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  char *filenames[N_CONNECTIONS];
+  XGenParallelDecoder *decoder = create_decoder (shared_state, filenames);
+  ParallelState state;
+  XGenDecodeStats stats;
+  guint64 n_segments = 0;
+  guint i, run;
+
+  /* Runs can be repeated */
+  for (run = 0; run < 2; run++)
+    {
+      memset (&state, 0, sizeof (state));
+      state.in_order = TRUE;
+      xgen_parallel_decoder_run (decoder, check_record, &state, &stats);
+
+      g_assert (state.in_order);
+      g_assert (!state.concurrent);
+      for (i = 0; i < N_CONNECTIONS; i++)
+	g_assert_cmpuint (state.n_records[i], ==, (i + 1) * 300);
+
+      g_assert_cmpuint (stats.n_records, ==, 300 * 15);
+      g_assert_cmpuint (stats.n_decoded, ==, stats.n_records);
+      g_assert_cmpuint (stats.n_filtered, ==, 0);
+      g_assert_cmpuint (stats.n_unknown, ==, 0);
+      g_assert_cmpuint (stats.n_malformed, ==, 0);
+      g_assert_cmpuint (stats.n_bytes, ==, 300 * 15 / 2 * (4 + 8));
+      g_assert_cmpuint (stats.n_segments, >, N_CONNECTIONS);
+    }
+
+  for (i = 0; i < N_WORKERS; i++)
+    n_segments += xgen_parallel_decoder_get_worker_stats (decoder,
+							   i)->n_segments;
+  g_assert_cmpuint (n_segments, ==, stats.n_segments);
+
+  xgen_parallel_decoder_free (decoder);
+  remove_captures (filenames);
+}
+
+void
+test_parallel_filter (TestXGENSimpleFixture *fixture,
+		      gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  char *filenames[N_CONNECTIONS];
+  XGenParallelDecoder *decoder = create_decoder (shared_state, filenames);
+  XGenDispatch *dispatch = xgen_dispatch_new (shared_state->state);
+  XGenFilter *filter = xgen_filter_new (shared_state->state, dispatch,
+					"xproto:MapWindow");
+  TestXGENWarnings warnings;
+  ParallelState state;
+  XGenDecodeStats stats;
+
+  g_assert (filter != NULL);
+
+  test_xgen_warnings_begin (&warnings);
+  g_assert_cmpint (xgen_parallel_decoder_add_capture (decoder,
+						      "/nonexistent.xgc",
+						      XGEN_LSB_FIRST),
+		   ==, -1);
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), ==, 1);
+
+  memset (&state, 0, sizeof (state));
+  state.in_order = TRUE;
+  xgen_parallel_decoder_set_filter (decoder, filter);
+  xgen_parallel_decoder_run (decoder, check_record, &state, &stats);
+
+  g_assert (state.in_order);
+  g_assert_cmpuint (stats.n_decoded, ==, 300 * 15 / 2);
+  g_assert_cmpuint (stats.n_filtered, ==, 300 * 15 / 2);
+  g_assert_cmpuint (state.n_records[4], ==, 5 * 300 / 2);
+
+  xgen_parallel_decoder_free (decoder);
+  xgen_filter_free (filter);
+  xgen_dispatch_free (dispatch);
+  remove_captures (filenames);
+}
+
+typedef struct _TypeState
+{
+  guint	    n_events;
+  guint	    n_errors;
+} TypeState;
+
+static void
+check_type (guint worker,
+	    guint connection,
+	    const XGenCaptureRecord *record,
+	    const XGenDefinition *definition,
+	    const XGenFieldExtent *extents,
+	    XGenByteOrder byte_order,
+	    void *user_data)
+{
+  TypeState *state = user_data;
+
+  /* A single connection is never delivered concurrently */
+  g_assert_cmpstr (definition->name, ==, "Clash");
+  if (definition->type == XGEN_EVENT)
+    {
+      g_assert_cmphex (read_field (record, definition, extents, "value"),
+		       ==, 0x1000 + record->sequence);
+      state->n_events++;
+    }
+  else
+    {
+      g_assert (definition->type == XGEN_ERROR);
+      g_assert_cmphex (read_field (record, definition, extents,
+				   "bad_thing"),
+		       ==, 0x2000 + record->sequence);
+      state->n_errors++;
+    }
+}
+
+/* Writes @value little endian to the named field of a 32 byte message */
+static void
+set_field (guint8 *data, const XGenDefinition *definition,
+	   const char *name, guint32 value)
+{
+  const XGenLayout *layout = xgen_definition_get_layout (definition);
+  gint index = xgen_layout_find_field (layout, name);
+  guint i;
+
+  g_assert (index >= 0);
+  for (i = 0; i < 4; i++)
+    data[layout->fields[index].offset + i] = value >> (i * 8);
+}
+
+void
+test_parallel_types (TestXGENSimpleFixture *fixture,
+		     gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  /* An event and an error of the same name, both sent by the server */
+  static const char xml[] =
+    "<xcb header=\"xgentest\" extension-xname=\"XGEN-TEST\" "
+    "extension-name=\"XGenTest\" major-version=\"1\" minor-version=\"0\">\n"
+    "  <event name=\"Clash\" number=\"0\">\n"
+    "    <pad bytes=\"1\" />\n"
+    "    <field type=\"CARD32\" name=\"value\" />\n"
+    "  </event>\n"
+    "  <error name=\"Clash\" number=\"0\">\n"
+    "    <field type=\"CARD32\" name=\"bad_thing\" />\n"
+    "  </error>\n"
+    "</xcb>\n";
+  XGenState *state = test_xgen_parse_extension (shared_state, xml);
+  XGenDefinition *event =
+    xgen_state_find_definition (state, "xgentest:Clash", XGEN_EVENT);
+  XGenDefinition *error =
+    xgen_state_find_definition (state, "xgentest:Clash", XGEN_ERROR);
+  XGenParallelDecoder *decoder;
+  XGenCaptureWriter *writer;
+  XGenDecodeStats stats;
+  TypeState type_state;
+  char *filename;
+  guint i;
+  int fd;
+
+  g_assert (event && error);
+
+  fd = g_file_open_tmp ("test-parallel-XXXXXX", &filename, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  writer = xgen_capture_writer_new (filename);
+  g_assert (writer);
+  for (i = 0; i < 20; i++)
+    {
+      guint8 message[32] = { 0, };
+      gboolean is_error = i % 3 == 0;
+
+      if (is_error)
+	set_field (message, error, "bad_thing", 0x2000 + i);
+      else
+	set_field (message, event, "value", 0x1000 + i);
+      g_assert (xgen_capture_writer_append (writer, i,
+					    XGEN_SERVER_TO_CLIENT, i,
+					    is_error ? error : event,
+					    message, sizeof (message)));
+    }
+  g_assert (xgen_capture_writer_close (writer));
+
+  decoder = xgen_parallel_decoder_new (state, 2);
+  g_assert_cmpint (xgen_parallel_decoder_add_capture (decoder, filename,
+						      XGEN_LSB_FIRST),
+		   ==, 0);
+  memset (&type_state, 0, sizeof (type_state));
+  xgen_parallel_decoder_run (decoder, check_type, &type_state, &stats);
+
+  /* Each record is decoded as the type it was captured as */
+  g_assert_cmpuint (stats.n_decoded, ==, 20);
+  g_assert_cmpuint (type_state.n_errors, ==, 7);
+  g_assert_cmpuint (type_state.n_events, ==, 13);
+
+  xgen_parallel_decoder_free (decoder);
+  g_unlink (filename);
+  g_free (filename);
+}
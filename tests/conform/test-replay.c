@@ -0,0 +1,335 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-capture.h>
+#include <xgen-mock.h>
+#include <xgen-replay.h>
+
+#include "test-xgen-common.h"
+
+#define CAPTURED_BASE 0x400000
+#define CAPTURED_ROOT 0x999
+#define LOCAL_BASE    0x200000
+#define LOCAL_ROOT    0x100
+
+typedef struct _ReplayTest
+{
+  const TestXGENSharedState *shared_state;
+  XGenMockServer	    *server;
+  char			    *display;
+  char			    *socket_path;
+  char			    *capture;
+  guint32		     drawables[2]; /* As the mock server saw them */
+  guint			     n_drawables;
+  guint			     n_differences;
+  guint64		     difference_sequence;
+} ReplayTest;
+
+/* Writes a field of a message in LSB first order */
+static void
+put_field (const TestXGENSharedState *shared_state,
+	   const char *name,
+	   XGenType type,
+	   guint8 *data,
+	   const char *field,
+	   guint32 value)
+{
+  const XGenLayout *layout =
+    xgen_definition_get_layout (test_xgen_find_definition (shared_state,
+							   name, type));
+  gint index = xgen_layout_find_field (layout, field);
+  guint i;
+
+  g_assert (index >= 0);
+  for (i = 0; i < layout->fields[index].size; i++)
+    data[layout->fields[index].offset + i] = value >> (i * 8);
+}
+
+static void
+append_record (ReplayTest *test,
+	       XGenCaptureWriter *writer,
+	       guint64 timestamp,
+	       XGenDirection direction,
+	       guint64 sequence,
+	       const char *name,
+	       XGenType type,
+	       const guint8 *data,
+	       guint32 len)
+{
+  const XGenDefinition *def = name
+    ? test_xgen_find_definition (test->shared_state, name, type) : NULL;
+
+  g_assert (xgen_capture_writer_append (writer, timestamp, direction,
+					sequence, def, data, len));
+}
+
+/* A session that creates a window, asks for its geometry twice and maps
+ * it. The second geometry reply was 800 wide, which the mock server
+ * won't agree with. */
+static void
+write_capture (ReplayTest *test)
+{
+  const TestXGENSharedState *shared_state = test->shared_state;
+  XGenCaptureWriter *writer;
+  guint8 create_window[32];
+  guint8 get_geometry[8];
+  guint8 map_window[8];
+  guint8 unknown[4] = { 120, 0, 1, 0 };
+  guint8 reply[32];
+  int fd;
+
+  fd = g_file_open_tmp ("test-replay-XXXXXX", &test->capture, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  writer = xgen_capture_writer_new (test->capture);
+  g_assert (writer);
+
+  memset (create_window, 0, sizeof (create_window));
+  create_window[0] = 1;
+  create_window[2] = sizeof (create_window) / 4;
+  put_field (shared_state, "xproto:CreateWindow", XGEN_REQUEST,
+	     create_window, "wid", CAPTURED_BASE | 1);
+  put_field (shared_state, "xproto:CreateWindow", XGEN_REQUEST,
+	     create_window, "parent", CAPTURED_ROOT);
+  put_field (shared_state, "xproto:CreateWindow", XGEN_REQUEST,
+	     create_window, "width", 640);
+  append_record (test, writer, 0, XGEN_CLIENT_TO_SERVER, 1,
+		 "xproto:CreateWindow", XGEN_REQUEST,
+		 create_window, sizeof (create_window));
+
+  memset (get_geometry, 0, sizeof (get_geometry));
+  get_geometry[0] = 14;
+  get_geometry[2] = sizeof (get_geometry) / 4;
+  put_field (shared_state, "xproto:GetGeometry", XGEN_REQUEST,
+	     get_geometry, "drawable", CAPTURED_BASE | 1);
+  memset (reply, 0, sizeof (reply));
+  reply[0] = 1;
+  put_field (shared_state, "xproto:GetGeometry", XGEN_REPLY,
+	     reply, "root", CAPTURED_ROOT);
+  put_field (shared_state, "xproto:GetGeometry", XGEN_REPLY,
+	     reply, "width", 640);
+  append_record (test, writer, 5000, XGEN_CLIENT_TO_SERVER, 2,
+		 "xproto:GetGeometry", XGEN_REQUEST,
+		 get_geometry, sizeof (get_geometry));
+  reply[2] = 2;
+  append_record (test, writer, 6000, XGEN_SERVER_TO_CLIENT, 2,
+		 "xproto:GetGeometry", XGEN_REPLY, reply, sizeof (reply));
+
+  append_record (test, writer, 10000, XGEN_CLIENT_TO_SERVER, 3,
+		 "xproto:GetGeometry", XGEN_REQUEST,
+		 get_geometry, sizeof (get_geometry));
+  reply[2] = 3;
+  put_field (shared_state, "xproto:GetGeometry", XGEN_REPLY,
+	     reply, "width", 800);
+  append_record (test, writer, 11000, XGEN_SERVER_TO_CLIENT, 3,
+		 "xproto:GetGeometry", XGEN_REPLY, reply, sizeof (reply));
+
+  /* Requests the protocol files don't describe are skipped */
+  append_record (test, writer, 15000, XGEN_CLIENT_TO_SERVER, 4,
+		 NULL, XGEN_REQUEST, unknown, sizeof (unknown));
+
+  memset (map_window, 0, sizeof (map_window));
+  map_window[0] = 8;
+  map_window[2] = sizeof (map_window) / 4;
+  put_field (shared_state, "xproto:MapWindow", XGEN_REQUEST,
+	     map_window, "window", CAPTURED_BASE | 1);
+  append_record (test, writer, 20000, XGEN_CLIENT_TO_SERVER, 5,
+		 "xproto:MapWindow", XGEN_REQUEST,
+		 map_window, sizeof (map_window));
+
+  g_assert (xgen_capture_writer_close (writer));
+}
+
+static void
+record_drawable (const XGenRequest *request,
+		 const guint8 *data,
+		 gsize len,
+		 XGenByteOrder byte_order,
+		 XGenEncodeValue *values,
+		 void *user_data)
+{
+  ReplayTest *test = user_data;
+
+  if (strcmp (XGEN_DEF (request)->name, "GetGeometry") != 0
+      || test->n_drawables >= G_N_ELEMENTS (test->drawables))
+    return;
+
+  test->drawables[test->n_drawables++] =
+    data[4] | data[5] << 8 | data[6] << 16 | (guint32)data[7] << 24;
+}
+
+/* Serves the mock server on the first free local display */
+static void
+start_server (ReplayTest *test, const TestXGENSharedState *shared_state)
+{
+  guint display;
+
+  memset (test, 0, sizeof (ReplayTest));
+  test->shared_state = shared_state;
+
+  mkdir ("/tmp/.X11-unix", 01777);
+  for (display = 90; ; display++)
+    {
+      test->socket_path = g_strdup_printf ("/tmp/.X11-unix/X%u", display);
+      if (access (test->socket_path, F_OK) != 0)
+	break;
+      g_free (test->socket_path);
+    }
+  test->display = g_strdup_printf (":%u", display);
+
+  test->server = xgen_mock_server_new (shared_state->state,
+				       test->socket_path);
+  g_assert (test->server);
+  g_assert (xgen_mock_server_set_value (test->server, "GetGeometry",
+					"root", LOCAL_ROOT));
+  g_assert (xgen_mock_server_set_value (test->server, "GetGeometry",
+					"width", 640));
+  xgen_mock_server_set_reply_func (test->server, record_drawable, test);
+  g_assert (xgen_mock_server_start (test->server));
+
+  write_capture (test);
+}
+
+static void
+stop_server (ReplayTest *test)
+{
+  xgen_mock_server_free (test->server);
+  g_unlink (test->capture);
+  g_free (test->capture);
+  g_free (test->socket_path);
+  g_free (test->display);
+}
+
+static XGenReplay *
+connect_replay (ReplayTest *test)
+{
+  XGenReplay *replay =
+    xgen_replay_new (test->shared_state->state, XGEN_LSB_FIRST);
+
+  g_assert (xgen_replay_connect (replay, test->display));
+  g_assert_cmphex (xgen_replay_get_root (replay), ==, LOCAL_ROOT);
+  xgen_replay_map_xid (replay, CAPTURED_ROOT, xgen_replay_get_root (replay));
+  return replay;
+}
+
+static void
+note_difference (const XGenRequest *request,
+		 guint64 sequence,
+		 const char *description,
+		 void *user_data)
+{
+  ReplayTest *test = user_data;
+
+  g_assert_cmpstr (XGEN_DEF (request)->name, ==, "GetGeometry");
+  g_assert (strstr (description, "width") != NULL);
+  test->n_differences++;
+  test->difference_sequence = sequence;
+}
+
+void
+test_replay_run (TestXGENSimpleFixture *fixture,
+		 gconstpointer data)
+{
+  ReplayTest test;
+  XGenReplayTotals totals;
+  XGenReplay *replay;
+  GList *report;
+  GList *tmp;
+  gboolean found = FALSE;
+
+  start_server (&test, data);
+  replay = connect_replay (&test);
+  xgen_replay_set_difference_func (replay, note_difference, &test);
+
+  g_assert (xgen_replay_run (replay, test.capture));
+
+  /* The captured client's XIDs are moved into the local resource range */
+  g_assert_cmpuint (test.n_drawables, ==, 2);
+  g_assert_cmphex (test.drawables[0], ==, LOCAL_BASE | 1);
+  g_assert_cmphex (test.drawables[1], ==, LOCAL_BASE | 1);
+
+  /* Only the second reply differs from the capture */
+  g_assert_cmpuint (test.n_differences, ==, 1);
+  g_assert_cmpuint (test.difference_sequence, ==, 3);
+
+  xgen_replay_get_totals (replay, &totals);
+  g_assert_cmpuint (totals.n_requests, ==, 4);
+  g_assert_cmpuint (totals.n_skipped, ==, 1);
+  g_assert_cmpuint (totals.n_replies, ==, 2);
+  g_assert_cmpuint (totals.n_errors, ==, 0);
+  g_assert_cmpuint (totals.n_differences, ==, 1);
+  g_assert_cmpuint (totals.n_bytes, ==, 32 + 8 + 8 + 8);
+
+  report = xgen_replay_get_report (replay);
+  g_assert_cmpuint (g_list_length (report), ==, 3);
+  for (tmp = report; tmp != NULL; tmp = tmp->next)
+    {
+      const XGenReplayStats *stats = tmp->data;
+
+      if (strcmp (XGEN_DEF (stats->request)->name, "GetGeometry") != 0)
+	continue;
+      g_assert_cmpuint (stats->n_requests, ==, 2);
+      g_assert_cmpuint (stats->n_replies, ==, 2);
+      g_assert_cmpuint (stats->n_differences, ==, 1);
+      g_assert (stats->time >= 0);
+      found = TRUE;
+    }
+  g_assert (found);
+  g_list_free (report);
+
+  xgen_replay_free (replay);
+  stop_server (&test);
+}
+
+void
+test_replay_options (TestXGENSimpleFixture *fixture,
+		     gconstpointer data)
+{
+  TestXGENWarnings warnings;
+  XGenReplayTotals totals;
+  XGenReplay *replay;
+  ReplayTest test;
+
+  start_server (&test, data);
+  replay = connect_replay (&test);
+
+  /* Ignored fields aren't compared */
+  g_assert (xgen_replay_ignore_field (replay, "GetGeometry", "width"));
+  test_xgen_warnings_begin (&warnings);
+  g_assert (!xgen_replay_ignore_field (replay, "MapWindow", "width"));
+  g_assert (!xgen_replay_ignore_field (replay, "GetGeometry", "nosuch"));
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), ==, 2);
+
+  /* Keeping to the captured timing takes at least the 20ms captured, and
+   * a batch of 1 syncs after every request without a reply */
+  xgen_replay_set_speed (replay, 1, 1000000);
+  xgen_replay_set_batch (replay, 1);
+  g_assert (xgen_replay_run (replay, test.capture));
+
+  xgen_replay_get_totals (replay, &totals);
+  g_assert_cmpuint (totals.n_requests, ==, 4);
+  g_assert_cmpuint (totals.n_differences, ==, 0);
+  g_assert_cmpuint (totals.n_syncs, >=, 2);
+  g_assert (totals.elapsed >= 0.02);
+
+  /* A missing capture fails */
+  test_xgen_warnings_begin (&warnings);
+  g_assert (!xgen_replay_run (replay, "/nonexistent/capture"));
+  test_xgen_warnings_end (&warnings);
+
+  xgen_replay_free (replay);
+
+  /* So does a display that isn't one */
+  replay = xgen_replay_new (test.shared_state->state, XGEN_LSB_FIRST);
+  test_xgen_warnings_begin (&warnings);
+  g_assert (!xgen_replay_connect (replay, "nodisplay"));
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), ==, 1);
+  xgen_replay_free (replay);
+
+  stop_server (&test);
+}
@@ -0,0 +1,353 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <xgen.h>
+#include <xgen-capture.h>
+#include <xgen-roundtrips.h>
+
+#include "test-xgen-common.h"
+
+#define WINDOW 0x400001
+
+typedef struct _Session
+{
+  const TestXGENSharedState *shared_state;
+  XGenRoundTripAnalyzer	    *analyzer;
+  XGenCaptureWriter	    *writer;
+} Session;
+
+typedef struct _Message
+{
+  XGenCaptureRecord record;
+  guint8	    data[32];
+} Message;
+
+static void
+write_card16 (guint8 *data, guint16 value)
+{
+  data[0] = value & 0xff;
+  data[1] = value >> 8;
+}
+
+static void
+write_card32 (guint8 *data, guint32 value)
+{
+  write_card16 (data, value & 0xffff);
+  write_card16 (data + 2, value >> 16);
+}
+
+/* Adds a message to the analyzer and the capture, if there is one */
+static void
+add (Session *session,
+     XGenDirection direction,
+     guint64 sequence,
+     guint64 timestamp,
+     const char *name,
+     XGenType type,
+     const guint8 *data,
+     gsize len)
+{
+  const XGenDefinition *def = NULL;
+  Message message;
+
+  if (name)
+    def = test_xgen_find_definition (session->shared_state, name, type);
+
+  memset (&message, 0, sizeof (message));
+  message.record.sequence = sequence;
+  message.record.timestamp = timestamp;
+  message.record.length = len;
+  message.record.direction = direction;
+  memcpy (message.data, data, len);
+  xgen_round_trip_analyzer_add_record (session->analyzer, &message.record,
+				       name);
+
+  if (session->writer)
+    g_assert (xgen_capture_writer_append (session->writer, timestamp,
+					  direction, sequence, def, data,
+					  len));
+}
+
+/* Starts a session that's only given to an analyzer */
+static void
+session_init (Session *session, const TestXGENSharedState *shared_state)
+{
+  session->shared_state = shared_state;
+  session->analyzer = xgen_round_trip_analyzer_new (shared_state->state,
+						    XGEN_LSB_FIRST);
+  session->writer = NULL;
+}
+
+static void
+get_input_focus (Session *session, guint64 sequence, guint64 timestamp)
+{
+  static const guint8 request[] = { 43, 0, 1, 0 };
+
+  add (session, XGEN_CLIENT_TO_SERVER, sequence, timestamp,
+       "xproto:GetInputFocus", XGEN_REQUEST, request, sizeof (request));
+}
+
+static void
+reply (Session *session,
+       guint64 sequence,
+       guint64 timestamp,
+       const char *name,
+       guint offset,
+       guint32 value)
+{
+  guint8 message[32] = { 1, 0, };
+
+  write_card16 (message + 2, sequence);
+  write_card32 (message + offset, value);
+  add (session, XGEN_SERVER_TO_CLIENT, sequence, timestamp, name,
+       XGEN_REPLY, message, sizeof (message));
+}
+
+static void
+get_geometry (Session *session, guint64 sequence, guint64 timestamp)
+{
+  guint8 request[8] = { 14, 0, 2, 0, };
+
+  write_card32 (request + 4, WINDOW);
+  add (session, XGEN_CLIENT_TO_SERVER, sequence, timestamp,
+       "xproto:GetGeometry", XGEN_REQUEST, request, sizeof (request));
+}
+
+static void
+map_window (Session *session, guint64 sequence, guint64 timestamp)
+{
+  guint8 request[8] = { 8, 0, 2, 0, };
+
+  write_card32 (request + 4, WINDOW);
+  add (session, XGEN_CLIENT_TO_SERVER, sequence, timestamp,
+       "xproto:MapWindow", XGEN_REQUEST, request, sizeof (request));
+}
+
+/* Records the session analyzed by check_stats() */
+static void
+record_session (Session *session)
+{
+  guint8 configure_notify[32] = { 22, 0, };
+
+  /* Two blocking GetInputFocus calls with the same reply, then one that
+   * doesn't block since MapWindow follows it */
+  get_input_focus (session, 1, 0);
+  reply (session, 1, 10, "xproto:GetInputFocus", 8, WINDOW);
+  get_input_focus (session, 2, 20);
+  reply (session, 2, 25, "xproto:GetInputFocus", 8, WINDOW);
+  get_input_focus (session, 3, 30);
+  map_window (session, 4, 31);
+  reply (session, 3, 40, "xproto:GetInputFocus", 8, WINDOW + 1);
+
+  /* A chain of three blocking GetGeometry calls whose second reply has
+   * the width reported by a ConfigureNotify */
+  get_geometry (session, 5, 100);
+  reply (session, 5, 110, "xproto:GetGeometry", 16, 100);
+  write_card16 (configure_notify + 2, 5);
+  write_card32 (configure_notify + 8, WINDOW);
+  write_card16 (configure_notify + 20, 200);
+  add (session, XGEN_SERVER_TO_CLIENT, 5, 115, "xproto:ConfigureNotify",
+       XGEN_EVENT, configure_notify, sizeof (configure_notify));
+  get_geometry (session, 6, 120);
+  reply (session, 6, 124, "xproto:GetGeometry", 16, 200);
+  get_geometry (session, 7, 130);
+  reply (session, 7, 132, "xproto:GetGeometry", 16, 300);
+}
+
+static void
+check_stats (const TestXGENSharedState *shared_state,
+	     XGenRoundTripAnalyzer *analyzer)
+{
+  GList *report = xgen_round_trip_analyzer_get_report (analyzer);
+  const XGenRoundTripStats *stats;
+
+  g_assert_cmpuint (g_list_length (report), ==, 2);
+  g_assert_cmpuint (xgen_round_trip_analyzer_get_longest_chain (analyzer),
+		    ==, 3);
+
+  /* The largest saving comes first */
+  stats = report->data;
+  g_assert (XGEN_DEF (stats->request)
+	    == test_xgen_find_definition (shared_state,
+					  "xproto:GetInputFocus",
+					  XGEN_REQUEST));
+  g_assert_cmpuint (stats->n_calls, ==, 3);
+  g_assert_cmpuint (stats->n_blocking, ==, 2);
+  g_assert_cmpuint (stats->n_repeated, ==, 1);
+  g_assert_cmpuint (stats->n_predictable, ==, 0);
+  g_assert_cmpuint (stats->total_latency, ==, 25);
+  g_assert_cmpuint (stats->blocking_latency, ==, 15);
+  g_assert_cmpuint (stats->saved_latency, ==, 5);
+  g_assert_cmpuint (stats->longest_chain, ==, 2);
+
+  stats = report->next->data;
+  g_assert (XGEN_DEF (stats->request)
+	    == test_xgen_find_definition (shared_state, "xproto:GetGeometry",
+					  XGEN_REQUEST));
+  g_assert_cmpuint (stats->n_calls, ==, 3);
+  g_assert_cmpuint (stats->n_blocking, ==, 3);
+  g_assert_cmpuint (stats->n_repeated, ==, 0);
+  g_assert_cmpuint (stats->n_predictable, ==, 1);
+  g_assert_cmpuint (stats->blocking_latency, ==, 16);
+  g_assert_cmpuint (stats->saved_latency, ==, 4);
+  g_assert_cmpuint (stats->longest_chain, ==, 3);
+
+  g_list_free (report);
+}
+
+void
+test_roundtrips_analyze (TestXGENSimpleFixture *fixture,
+			 gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  XGenRoundTripAnalyzer *analyzer;
+  TestXGENWarnings warnings;
+  Session session;
+  char *filename;
+  int fd;
+
+  fd = g_file_open_tmp ("test-roundtrips-XXXXXX", &filename, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+
+  session.shared_state = shared_state;
+  session.analyzer = xgen_round_trip_analyzer_new (shared_state->state,
+						   XGEN_LSB_FIRST);
+  session.writer = xgen_capture_writer_new (filename);
+  g_assert (session.writer);
+
+  record_session (&session);
+  g_assert (xgen_capture_writer_close (session.writer));
+  check_stats (shared_state, session.analyzer);
+  xgen_round_trip_analyzer_free (session.analyzer);
+
+  /* The capture gives the same results */
+  analyzer = xgen_round_trip_analyzer_new (shared_state->state,
+					   XGEN_LSB_FIRST);
+  g_assert (xgen_round_trip_analyzer_add_capture (analyzer, filename));
+  check_stats (shared_state, analyzer);
+  xgen_round_trip_analyzer_free (analyzer);
+
+  g_unlink (filename);
+
+  analyzer = xgen_round_trip_analyzer_new (shared_state->state,
+					   XGEN_LSB_FIRST);
+  test_xgen_warnings_begin (&warnings);
+  g_assert (!xgen_round_trip_analyzer_add_capture (analyzer, filename));
+  test_xgen_warnings_end (&warnings);
+  g_assert (xgen_round_trip_analyzer_get_report (analyzer) == NULL);
+  xgen_round_trip_analyzer_free (analyzer);
+
+  g_free (filename);
+}
+
+void
+test_roundtrips_no_reply (TestXGENSimpleFixture *fixture,
+			  gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  Session session;
+  guint i;
+
+  session_init (&session, shared_state);
+
+  /* Requests without replies are never calls, and a stray reply to one
+   * is ignored */
+  for (i = 1; i <= 3; i++)
+    map_window (&session, i, i * 10);
+  reply (&session, 2, 40, "xproto:GetInputFocus", 8, WINDOW);
+
+  g_assert (xgen_round_trip_analyzer_get_report (session.analyzer) == NULL);
+  g_assert_cmpuint (xgen_round_trip_analyzer_get_longest_chain
+		      (session.analyzer), ==, 0);
+
+  xgen_round_trip_analyzer_free (session.analyzer);
+}
+
+void
+test_roundtrips_single (TestXGENSimpleFixture *fixture,
+			gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenRoundTripStats *stats;
+  Session session;
+  GList *report;
+
+  session_init (&session, shared_state);
+
+  /* One call that waits for its reply, with nothing to compare it to */
+  get_geometry (&session, 1, 100);
+  reply (&session, 1, 107, "xproto:GetGeometry", 16, 100);
+
+  report = xgen_round_trip_analyzer_get_report (session.analyzer);
+  g_assert_cmpuint (g_list_length (report), ==, 1);
+  stats = report->data;
+  g_assert (XGEN_DEF (stats->request)
+	    == test_xgen_find_definition (shared_state, "xproto:GetGeometry",
+					  XGEN_REQUEST));
+  g_assert_cmpuint (stats->n_calls, ==, 1);
+  g_assert_cmpuint (stats->n_blocking, ==, 1);
+  g_assert_cmpuint (stats->n_repeated, ==, 0);
+  g_assert_cmpuint (stats->n_predictable, ==, 0);
+  g_assert_cmpuint (stats->total_latency, ==, 7);
+  g_assert_cmpuint (stats->blocking_latency, ==, 7);
+  g_assert_cmpuint (stats->saved_latency, ==, 0);
+  g_assert_cmpuint (stats->longest_chain, ==, 1);
+  g_assert_cmpuint (xgen_round_trip_analyzer_get_longest_chain
+		      (session.analyzer), ==, 1);
+
+  g_list_free (report);
+  xgen_round_trip_analyzer_free (session.analyzer);
+}
+
+void
+test_roundtrips_batched (TestXGENSimpleFixture *fixture,
+			 gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenRoundTripStats *stats;
+  Session session;
+  GList *report;
+  guint i;
+
+  session_init (&session, shared_state);
+
+  /* Calls sent back to back before any reply only cost one round trip,
+   * which is put down to the last of them */
+  for (i = 1; i <= 3; i++)
+    get_geometry (&session, i, i);
+  for (i = 1; i <= 3; i++)
+    reply (&session, i, 10 + i, "xproto:GetGeometry", 16, i * 100);
+
+  report = xgen_round_trip_analyzer_get_report (session.analyzer);
+  g_assert_cmpuint (g_list_length (report), ==, 1);
+  stats = report->data;
+  g_assert_cmpuint (stats->n_calls, ==, 3);
+  g_assert_cmpuint (stats->n_blocking, ==, 1);
+  g_assert_cmpuint (stats->n_repeated, ==, 0);
+  g_assert_cmpuint (stats->total_latency, ==, 30);
+  g_assert_cmpuint (stats->blocking_latency, ==, 10);
+  g_assert_cmpuint (stats->saved_latency, ==, 0);
+  g_assert_cmpuint (stats->longest_chain, ==, 1);
+  g_list_free (report);
+
+  /* A batch that only repeats the last call could be answered from a
+   * cache */
+  for (i = 4; i <= 6; i++)
+    get_geometry (&session, i, i * 10);
+  for (i = 4; i <= 6; i++)
+    reply (&session, i, 100 + i, "xproto:GetGeometry", 16, 300);
+
+  report = xgen_round_trip_analyzer_get_report (session.analyzer);
+  stats = report->data;
+  g_assert_cmpuint (stats->n_calls, ==, 6);
+  g_assert_cmpuint (stats->n_blocking, ==, 2);
+  g_assert_cmpuint (stats->n_repeated, ==, 3);
+  g_assert_cmpuint (stats->blocking_latency, ==, 10 + 46);
+  g_assert_cmpuint (stats->saved_latency, ==, 46);
+  g_list_free (report);
+
+  xgen_round_trip_analyzer_free (session.analyzer);
+}
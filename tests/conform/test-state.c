@@ -0,0 +1,131 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include <xgen.h>
+#include <xgen-layout.h>
+
+#include "test-xgen-common.h"
+
+void
+test_state_shared_base (TestXGENSimpleFixture *fixture,
+			gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenState *base = shared_state->state;
+  static const char xml[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+    "<xcb header=\"xgentest\" extension-xname=\"XGEN-TEST\" "
+    "extension-name=\"XGenTest\" major-version=\"1\" minor-version=\"0\">\n"
+    "  <import>xproto</import>\n"
+    "  <request name=\"SetPoints\" opcode=\"0\">\n"
+    "    <field type=\"WINDOW\" name=\"window\" />\n"
+    "    <list type=\"POINT\" name=\"points\" />\n"
+    "  </request>\n"
+    "</xcb>\n";
+  guint n_base_extensions = g_list_length (base->extensions);
+  const XGenDefinition *point =
+    test_xgen_find_definition (shared_state, "xproto:POINT", XGEN_STRUCT);
+  const XGenDefinition *map_window =
+    test_xgen_find_definition (shared_state, "xproto:MapWindow",
+			       XGEN_REQUEST);
+  guint64 fingerprint = xgen_definition_get_fingerprint (map_window);
+  XGenState *state = test_xgen_parse_extension (shared_state, xml);
+  const XGenDefinition *set_points =
+    xgen_state_find_definition (state, "xgentest:SetPoints", XGEN_REQUEST);
+  const XGenLayout *layout;
+
+  /* The base extensions are shared rather than copied */
+  g_assert_cmpuint (g_list_length (state->extensions), ==,
+		    n_base_extensions + 1);
+  g_assert (xgen_state_find_extension (state, "xproto")
+	    == xgen_state_find_extension (base, "xproto"));
+  g_assert (xgen_state_find_definition (state, "xproto:MapWindow",
+					XGEN_REQUEST) == map_window);
+
+  /* and the new definitions can use their types */
+  g_assert (set_points != NULL);
+  layout = xgen_definition_get_layout (set_points);
+  g_assert (layout->fields[xgen_layout_find_field (layout, "points")].type
+	    == point);
+  g_assert_cmpuint (layout->fields[xgen_layout_find_field (layout,
+							   "window")].size,
+		    ==, 4);
+
+  /* The base isn't changed */
+  g_assert_cmpuint (g_list_length (base->extensions), ==, n_base_extensions);
+  g_assert (xgen_state_find_extension (base, "xgentest") == NULL);
+  g_assert (xgen_state_find_definition (base, "xgentest:SetPoints",
+					XGEN_REQUEST) == NULL);
+  g_assert_cmphex (xgen_definition_get_fingerprint (map_window), ==,
+		   fingerprint);
+}
+
+void
+test_state_skip_base_files (TestXGENSimpleFixture *fixture,
+			    gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenState *base = shared_state->state;
+  GList *files = NULL;
+  XGenState *state;
+
+  /* Files for extensions the base already has aren't parsed again */
+  files = g_list_append (files, "xproto.xml");
+  files = g_list_append (files, "shape.xml");
+  state = xgen_parse_xcb_proto_files_with_base (base, files);
+  g_list_free (files);
+
+  g_assert (state != NULL);
+  g_assert_cmpuint (g_list_length (state->extensions), ==,
+		    g_list_length (base->extensions));
+  g_assert (xgen_state_find_extension (state, "shape")
+	    == xgen_state_find_extension (base, "shape"));
+  g_assert (xgen_state_find_definition (state, "shape:Rectangles",
+					XGEN_REQUEST)
+	    == test_xgen_find_definition (shared_state, "shape:Rectangles",
+					  XGEN_REQUEST));
+}
+
+void
+test_state_missing_import (TestXGENSimpleFixture *fixture,
+			   gconstpointer data)
+{
+  const TestXGENSharedState *shared_state = data;
+  const XGenState *base = shared_state->state;
+  static const char xml[] =
+    "<xcb header=\"xgentest\" extension-xname=\"XGEN-TEST\" "
+    "extension-name=\"XGenTest\" major-version=\"1\" minor-version=\"0\">\n"
+    "  <import>nosuchextension</import>\n"
+    "  <request name=\"Request\" opcode=\"0\" />\n"
+    "</xcb>\n";
+  TestXGENWarnings warnings;
+  GList *files = NULL;
+  guint n_extensions = g_list_length (base->extensions);
+  char *filename;
+  int fd;
+
+  fd = g_file_open_tmp ("test-state-XXXXXX", &filename, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  g_assert (g_file_set_contents (filename, xml, -1, NULL));
+
+  /* The partly parsed state is thrown away without touching the base */
+  files = g_list_append (files, filename);
+  files = g_list_append (files, "shape.xml");
+  test_xgen_warnings_begin (&warnings);
+  g_assert (xgen_parse_xcb_proto_files_with_base (base, files) == NULL);
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), ==, 1);
+  g_assert_cmpuint (g_list_length (base->extensions), ==, n_extensions);
+  g_assert (xgen_state_find_extension (base, "xgentest") == NULL);
+
+  /* Without a base, the core types of xproto are freed as well */
+  files = g_list_append (files, "xproto.xml");
+  test_xgen_warnings_begin (&warnings);
+  g_assert (xgen_parse_xcb_proto_files (files) == NULL);
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), ==, 1);
+
+  g_list_free (files);
+  g_unlink (filename);
+  g_free (filename);
+}
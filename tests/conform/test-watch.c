@@ -0,0 +1,171 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <xgen.h>
+#include <xgen-watch.h>
+
+#include "test-xgen-common.h"
+
+#define TEST_XML(REQUEST_TYPE, EXTRA) \
+  "<xcb header=\"xgentest\" extension-xname=\"XGEN-TEST\" " \
+  "extension-name=\"XGenTest\" major-version=\"1\" minor-version=\"0\">\n" \
+  "  <import>xproto</import>\n" \
+  "  <request name=\"Changed\" opcode=\"0\">\n" \
+  "    <field type=\"" REQUEST_TYPE "\" name=\"value\" />\n" \
+  "  </request>\n" \
+  "  <request name=\"Same\" opcode=\"1\">\n" \
+  "    <field type=\"WINDOW\" name=\"window\" />\n" \
+  "  </request>\n" \
+  EXTRA \
+  "</xcb>\n"
+
+typedef struct _WatchLog
+{
+  GMainLoop *loop;
+  guint	     n_updates;
+  GList	    *changed;
+} WatchLog;
+
+static void
+log_update (XGenWatcher *watcher,
+	    const XGenState *state,
+	    GList *changed,
+	    void *user_data)
+{
+  WatchLog *log = user_data;
+
+  g_assert (state == xgen_watcher_get_state (watcher));
+
+  log->n_updates++;
+  g_list_free (log->changed);
+  log->changed = g_list_copy (changed);
+  g_main_loop_quit (log->loop);
+}
+
+static gboolean
+quit_loop (gpointer user_data)
+{
+  WatchLog *log = user_data;
+
+  g_main_loop_quit (log->loop);
+  return FALSE;
+}
+
+/* Runs the main loop until the watcher updates its state or @timeout
+ * milliseconds pass */
+static void
+wait_for_update (WatchLog *log, guint timeout)
+{
+  guint id = g_timeout_add (timeout, quit_loop, log);
+  guint n_updates = log->n_updates;
+
+  g_main_loop_run (log->loop);
+  if (log->n_updates != n_updates)
+    g_source_remove (id);
+}
+
+static gboolean
+has_changed (GList *changed, const char *name, XGenType type)
+{
+  GList *tmp;
+
+  for (tmp = changed; tmp != NULL; tmp = tmp->next)
+    {
+      XGenDefinition *def = tmp->data;
+
+      if (def->type == type && strcmp (def->name, name) == 0)
+	return TRUE;
+    }
+  return FALSE;
+}
+
+void
+test_watch_reparse (TestXGENSimpleFixture *fixture,
+		    gconstpointer data)
+{
+  XGenDefinition *map_window;
+  XGenDefinition *same;
+  TestXGENWarnings warnings;
+  XGenWatcher *watcher;
+  GList *files = NULL;
+  const XGenState *state;
+  WatchLog log;
+  char *filename;
+  int fd;
+
+  fd = g_file_open_tmp ("test-watch-XXXXXX", &filename, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  g_assert (g_file_set_contents (filename, TEST_XML ("CARD16", ""), -1,
+				 NULL));
+
+  memset (&log, 0, sizeof (log));
+  log.loop = g_main_loop_new (NULL, FALSE);
+
+  files = g_list_append (files, "xproto.xml");
+  files = g_list_append (files, filename);
+  watcher = xgen_watcher_new (files, log_update, &log);
+  g_list_free (files);
+  g_assert (watcher);
+  g_assert_cmpuint (xgen_watcher_attach (watcher, NULL), >, 0);
+
+  state = xgen_watcher_get_state (watcher);
+  map_window = xgen_state_find_definition (state, "xproto:MapWindow",
+					   XGEN_REQUEST);
+  same = xgen_state_find_definition (state, "xgentest:Same", XGEN_REQUEST);
+  g_assert (map_window && same);
+  g_assert (xgen_state_find_definition (state, "xgentest:Added",
+					XGEN_REQUEST) == NULL);
+
+  /* Only the new and changed definitions are reported */
+  g_assert (g_file_set_contents (filename,
+				 TEST_XML ("CARD32",
+					   "  <request name=\"Added\" "
+					   "opcode=\"2\" />\n"),
+				 -1, NULL));
+  wait_for_update (&log, 5000);
+  g_assert_cmpuint (log.n_updates, ==, 1);
+  g_assert_cmpuint (g_list_length (log.changed), ==, 2);
+  g_assert (has_changed (log.changed, "Changed", XGEN_REQUEST));
+  g_assert (has_changed (log.changed, "Added", XGEN_REQUEST));
+
+  /* The untouched extensions are kept */
+  state = xgen_watcher_get_state (watcher);
+  g_assert (xgen_state_find_definition (state, "xproto:MapWindow",
+					XGEN_REQUEST) == map_window);
+  g_assert (xgen_state_find_definition (state, "xgentest:Same",
+					XGEN_REQUEST) != same);
+  g_assert (xgen_state_find_definition (state, "xgentest:Added",
+					XGEN_REQUEST));
+
+  /* A file that fails to parse leaves the state as it was */
+  g_assert (g_file_set_contents (filename, "<xcb header=\"xgentest\">\n"
+				 "  <request name=\"Broken\"\n", -1, NULL));
+  test_xgen_warnings_begin (&warnings);
+  wait_for_update (&log, 500);
+  g_assert_cmpuint (test_xgen_warnings_end (&warnings), >, 0);
+  g_assert_cmpuint (log.n_updates, ==, 1);
+  g_assert (xgen_watcher_get_state (watcher) == state);
+
+  xgen_watcher_free (watcher);
+  g_list_free (log.changed);
+  g_main_loop_unref (log.loop);
+  g_unlink (filename);
+  g_free (filename);
+}
+
+void
+test_watch_invalid (TestXGENSimpleFixture *fixture,
+		    gconstpointer data)
+{
+  TestXGENWarnings warnings;
+  GList *files = NULL;
+
+  files = g_list_append (files, "/nonexistent/xgentest.xml");
+  test_xgen_warnings_begin (&warnings);
+  g_assert (xgen_watcher_new (files, NULL, NULL) == NULL);
+  test_xgen_warnings_end (&warnings);
+  g_list_free (files);
+}
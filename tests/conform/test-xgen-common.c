@@ -1,4 +1,8 @@
 
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
 #include "test-xgen-common.h"
 
 /**
@@ -26,3 +30,188 @@ test_xgen_simple_fixture_teardown (TestXGENSimpleFixture *fixture,
   /* const TestXGENSharedState *shared_state = data; */
 }
 
+
+
+/**
+ * test_xgen_find_definition:
+ *
+ * Looks up a definition as "header:Name" in the shared state, failing the
+ * test if it's missing
+ */
+const XGenDefinition *
+test_xgen_find_definition (const TestXGENSharedState *shared_state,
+			   const char *name,
+			   XGenType type)
+{
+  const XGenDefinition *def =
+    xgen_state_find_definition (shared_state->state, name, type);
+
+  g_assert (def != NULL);
+  return def;
+}
+
+/**
+ * test_xgen_find_request:
+ *
+ * Looks up a request as "header:Name" in the shared state, failing the
+ * test if it's missing
+ */
+const XGenRequest *
+test_xgen_find_request (const TestXGENSharedState *shared_state,
+			const char *name)
+{
+  return XGEN_REQUEST_DEF (test_xgen_find_definition (shared_state, name,
+						      XGEN_REQUEST));
+}
+
+/**
+ * test_xgen_field_offset:
+ *
+ * Returns the offset of the field @name of @layout, failing the test if
+ * the layout has no such field
+ */
+gint
+test_xgen_field_offset (const XGenLayout *layout, const char *name)
+{
+  gint index = xgen_layout_find_field (layout, name);
+
+  g_assert_cmpint (index, >=, 0);
+  return layout->fields[index].offset;
+}
+
+
+static void
+count_warning (const gchar *log_domain,
+	       GLogLevelFlags log_level,
+	       const gchar *message,
+	       gpointer user_data)
+{
+  TestXGENWarnings *warnings = user_data;
+
+  warnings->n_warnings++;
+}
+
+
+/**
+ * test_xgen_warnings_begin:
+ *
+ * Starts counting warnings instead of aborting on them
+ */
+void
+test_xgen_warnings_begin (TestXGENWarnings *warnings)
+{
+  warnings->n_warnings = 0;
+  warnings->old_fatal_mask = g_log_set_always_fatal (G_LOG_FATAL_MASK);
+  warnings->handler = g_log_set_handler (NULL, G_LOG_LEVEL_WARNING,
+					 count_warning, warnings);
+}
+
+
+/**
+ * test_xgen_warnings_end:
+ *
+ * Makes warnings fatal again and returns the number seen since
+ * test_xgen_warnings_begin()
+ */
+guint
+test_xgen_warnings_end (TestXGENWarnings *warnings)
+{
+  g_log_remove_handler (NULL, warnings->handler);
+  g_log_set_always_fatal (warnings->old_fatal_mask);
+  return warnings->n_warnings;
+}
+
+
+/**
+ * test_xgen_flush_output_buffer:
+ *
+ * Flushes an output buffer to a temporary file and returns the bytes that
+ * were written, to be freed with g_free()
+ */
+guint8 *
+test_xgen_flush_output_buffer (XGenOutputBuffer *buffer, gsize *len)
+{
+  char *filename;
+  char *contents;
+  int fd;
+
+  fd = g_file_open_tmp ("test-xgen-XXXXXX", &filename, NULL);
+  g_assert (fd >= 0);
+  g_assert (xgen_output_buffer_flush (buffer, fd));
+  g_assert_cmpuint (xgen_output_buffer_get_size (buffer), ==, 0);
+  close (fd);
+
+  g_assert (g_file_get_contents (filename, &contents, len, NULL));
+  g_unlink (filename);
+  g_free (filename);
+
+  return (guint8 *)contents;
+}
+
+
+/**
+ * test_xgen_parse_extension:
+ *
+ * Parses the protocol description @xml on top of the shared state, for
+ * tests needing definitions that aren't part of xcb-proto
+ */
+XGenState *
+test_xgen_parse_extension (const TestXGENSharedState *shared_state,
+			   const char *xml)
+{
+  GList *files = NULL;
+  XGenState *state;
+  char *filename;
+  int fd;
+
+  fd = g_file_open_tmp ("test-xgen-XXXXXX", &filename, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  g_assert (g_file_set_contents (filename, xml, -1, NULL));
+
+  files = g_list_append (files, filename);
+  state = xgen_parse_xcb_proto_files_with_base (shared_state->state, files);
+  g_list_free (files);
+  g_unlink (filename);
+  g_free (filename);
+
+  g_assert (state != NULL);
+  return state;
+}
+
+
+/**
+ * test_xgen_record_timed_message:
+ *
+ * A callback for the stages that pass messages on with a timestamp, such
+ * as the event coalescer, that appends each message to the GArray of
+ * TestXGENMessages given as @user_data
+ */
+void
+test_xgen_record_timed_message (const guint8 *data,
+				gsize len,
+				guint64 timestamp,
+				void *user_data)
+{
+  GArray *messages = user_data;
+  TestXGENMessage message;
+
+  g_assert_cmpuint (len, <=, sizeof (message.data));
+  memset (&message, 0, sizeof (message));
+  memcpy (message.data, data, len);
+  message.len = len;
+  message.timestamp = timestamp;
+  g_array_append_val (messages, message);
+}
+
+/**
+ * test_xgen_record_message:
+ *
+ * Like test_xgen_record_timed_message() for the stages that don't give a
+ * timestamp, such as the atom cache
+ */
+void
+test_xgen_record_message (const guint8 *data, gsize len, void *user_data)
+{
+  test_xgen_record_timed_message (data, len, 0, user_data);
+}
@@ -1,4 +1,7 @@
 #include <glib.h>
+#include <xgen.h>
+#include <xgen-encoder.h>
+#include <xgen-layout.h>
 
 /* Stuff you put in here is setup once in main() and gets passed around to
  * all test functions and fixture setup/teardown functions in the data
@@ -7,8 +10,33 @@ typedef struct _TestXGENSharedState
 {
   int	 *argc_addr;
   char ***argv_addr;
+
+  /* xproto.xml, shape.xml and bigreq.xml from the installed xcb-proto */
+  XGenState *state;
 } TestXGENSharedState;
 
+/* Lets a test check that the library warns about bad input, since
+ * g_test_init() otherwise makes warnings fatal. */
+typedef struct _TestXGENWarnings
+{
+  GLogLevelFlags old_fatal_mask;
+  guint		 handler;
+  guint		 n_warnings;
+} TestXGENWarnings;
+
+
+/* A message passed on by a stage under test, such as the event coalescer
+ * or the atom cache, as recorded by test_xgen_record_message() */
+typedef struct _TestXGENMessage
+{
+  guint8  data[64];
+  gsize	  len;
+  guint64 timestamp;
+} TestXGENMessage;
+
+#define TEST_XGEN_MESSAGE(MESSAGES, I) \
+  (&g_array_index ((MESSAGES), TestXGENMessage, (I)))
+
 
 /* This fixture structure is allocated by glib, and before running each test
  * the test_xgen_simple_fixture_setup func (see below) is called to
@@ -24,3 +52,27 @@ void test_xgen_simple_fixture_setup (TestXGENSimpleFixture *fixture,
 void test_xgen_simple_fixture_teardown (TestXGENSimpleFixture *fixture,
 				        gconstpointer data);
 
+const XGenDefinition *
+test_xgen_find_definition (const TestXGENSharedState *shared_state,
+			   const char *name,
+			   XGenType type);
+const XGenRequest *
+test_xgen_find_request (const TestXGENSharedState *shared_state,
+			const char *name);
+gint test_xgen_field_offset (const XGenLayout *layout, const char *name);
+
+void test_xgen_warnings_begin (TestXGENWarnings *warnings);
+guint test_xgen_warnings_end (TestXGENWarnings *warnings);
+
+guint8 *test_xgen_flush_output_buffer (XGenOutputBuffer *buffer, gsize *len);
+
+XGenState *test_xgen_parse_extension (const TestXGENSharedState *shared_state,
+				      const char *xml);
+
+void test_xgen_record_message (const guint8 *data,
+			       gsize len,
+			       void *user_data);
+void test_xgen_record_timed_message (const guint8 *data,
+				     gsize len,
+				     guint64 timestamp,
+				     void *user_data);
@@ -30,6 +30,7 @@ int
 main (int argc, char **argv)
 {
   TestXGENSharedState *shared_state = g_new0 (TestXGENSharedState, 1);
+  GList *files = NULL;
 
   g_test_init (&argc, &argv, NULL);
 
@@ -41,8 +42,103 @@ main (int argc, char **argv)
   shared_state->argc_addr = &argc;
   shared_state->argv_addr = &argv;
 
+  files = g_list_append (files, "xproto.xml");
+  files = g_list_append (files, "shape.xml");
+  files = g_list_append (files, "bigreq.xml");
+  shared_state->state = xgen_parse_xcb_proto_files (files);
+  g_list_free (files);
+  if (!shared_state->state)
+    return EXIT_FAILURE;
+
   /* TEST_XGEN_SIMPLE ("", test_blah); */
 
+  TEST_XGEN_SIMPLE ("/capture", test_capture_round_trip);
+  TEST_XGEN_SIMPLE ("/capture", test_capture_bounds);
+
+  TEST_XGEN_SIMPLE ("/layout", test_layout_request_header);
+  TEST_XGEN_SIMPLE ("/layout", test_layout_empty_requests);
+  TEST_XGEN_SIMPLE ("/layout", test_layout_decode);
+  TEST_XGEN_SIMPLE ("/layout", test_layout_batch_decode);
+  TEST_XGEN_SIMPLE ("/layout", test_layout_host_abi);
+  TEST_XGEN_SIMPLE ("/layout", test_layout_max_size);
+
+  TEST_XGEN_SIMPLE ("/filter", test_dispatch_lookup);
+  TEST_XGEN_SIMPLE ("/filter", test_filter_match);
+  TEST_XGEN_SIMPLE ("/filter", test_filter_invalid);
+
+  TEST_XGEN_SIMPLE ("/format", test_format_json_type);
+  TEST_XGEN_SIMPLE ("/format", test_format_lists);
+  TEST_XGEN_SIMPLE ("/format", test_format_truncated);
+
+  TEST_XGEN_SIMPLE ("/parallel", test_parallel_decode);
+  TEST_XGEN_SIMPLE ("/parallel", test_parallel_filter);
+  TEST_XGEN_SIMPLE ("/parallel", test_parallel_types);
+
+  TEST_XGEN_SIMPLE ("/encoder", test_encoder_round_trip);
+  TEST_XGEN_SIMPLE ("/encoder", test_encoder_empty_requests);
+  TEST_XGEN_SIMPLE ("/encoder", test_encoder_big_requests);
+  TEST_XGEN_SIMPLE ("/encoder", test_encoder_swap);
+
+  TEST_XGEN_SIMPLE ("/generator", test_generator_mix);
+  TEST_XGEN_SIMPLE ("/generator", test_generator_seed);
+  TEST_XGEN_SIMPLE ("/generator", test_generator_variable);
+  TEST_XGEN_SIMPLE ("/generator", test_generator_invalid);
+
+  TEST_XGEN_SIMPLE ("/embed", test_embed_abi);
+  TEST_XGEN_SIMPLE ("/embed", test_embed_compare);
+
+  TEST_XGEN_SIMPLE ("/fingerprint", test_fingerprint_stable);
+  TEST_XGEN_SIMPLE ("/fingerprint", test_fingerprint_dependencies);
+
+  TEST_XGEN_SIMPLE ("/state", test_state_shared_base);
+  TEST_XGEN_SIMPLE ("/state", test_state_skip_base_files);
+  TEST_XGEN_SIMPLE ("/state", test_state_missing_import);
+
+  TEST_XGEN_SIMPLE ("/dependencies", test_dependencies_closure);
+  TEST_XGEN_SIMPLE ("/dependencies", test_dependencies_pruned_state);
+
+  TEST_XGEN_SIMPLE ("/list", test_list_convert);
+  TEST_XGEN_SIMPLE ("/list", test_list_get);
+
+  TEST_XGEN_SIMPLE ("/coalesce", test_coalesce_events);
+  TEST_XGEN_SIMPLE ("/coalesce", test_coalesce_invalid_rules);
+
+  TEST_XGEN_SIMPLE ("/async", test_async_feed);
+  TEST_XGEN_SIMPLE ("/async", test_async_sequence_wrap);
+  TEST_XGEN_SIMPLE ("/async", test_async_attach);
+
+  TEST_XGEN_SIMPLE ("/atoms", test_atoms_cache);
+  TEST_XGEN_SIMPLE ("/atoms", test_atoms_learn_names);
+
+  TEST_XGEN_SIMPLE ("/roundtrips", test_roundtrips_analyze);
+  TEST_XGEN_SIMPLE ("/roundtrips", test_roundtrips_no_reply);
+  TEST_XGEN_SIMPLE ("/roundtrips", test_roundtrips_single);
+  TEST_XGEN_SIMPLE ("/roundtrips", test_roundtrips_batched);
+
+  TEST_XGEN_SIMPLE ("/watch", test_watch_reparse);
+  TEST_XGEN_SIMPLE ("/watch", test_watch_invalid);
+
+  TEST_XGEN_SIMPLE ("/generic", test_generic_layout);
+  TEST_XGEN_SIMPLE ("/generic", test_generic_dispatch);
+  TEST_XGEN_SIMPLE ("/generic", test_generic_filter);
+
+  TEST_XGEN_SIMPLE ("/cursor", test_cursor_fields);
+  TEST_XGEN_SIMPLE ("/cursor", test_cursor_truncated);
+  TEST_XGEN_SIMPLE ("/cursor", test_cursor_reply);
+
+  TEST_XGEN_SIMPLE ("/notifier", test_notifier_order);
+  TEST_XGEN_SIMPLE ("/notifier", test_notifier_invalid);
+
+  TEST_XGEN_SIMPLE ("/names", test_names_core);
+  TEST_XGEN_SIMPLE ("/names", test_names_clash);
+
+  TEST_XGEN_SIMPLE ("/mock", test_mock_setup);
+  TEST_XGEN_SIMPLE ("/mock", test_mock_setup_info);
+  TEST_XGEN_SIMPLE ("/mock", test_mock_requests);
+
+  TEST_XGEN_SIMPLE ("/replay", test_replay_run);
+  TEST_XGEN_SIMPLE ("/replay", test_replay_options);
+
   g_test_run ();
   return EXIT_SUCCESS;
 }
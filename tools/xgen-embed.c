@@ -0,0 +1,842 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+/* xgen-embed parses protocol descriptions and writes the resolved model,
+ * including the layouts and name tables, as static const C data that can
+ * be loaded with xgen_embedded_state_load() (see xgen-embed.h).
+ *
+ * Every kind of object goes into one array and pointers between objects
+ * become addresses of array elements. GLists are written as arrays of
+ * GList nodes so code walking a parsed state works unchanged, and all
+ * strings are interned into a single character pool.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-names.h>
+#include <xgen-embed.h>
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum _TableId
+{
+  TABLE_EXTENSIONS,
+  TABLE_BASE_TYPES,
+  TABLE_STRUCTS,
+  TABLE_UNIONS,
+  TABLE_XID_UNIONS,
+  TABLE_ENUMS,
+  TABLE_TYPEDEFS,
+  TABLE_VALUEPARAMS,
+  TABLE_REQUESTS,
+  TABLE_REPLIES,
+  TABLE_EVENTS,
+  TABLE_ERRORS,
+  TABLE_FIELDS,
+  TABLE_ITEMS,
+  TABLE_EXPRESSIONS,
+  TABLE_LAYOUTS,
+  TABLE_FIELD_LAYOUTS,
+  TABLE_LISTS,
+  N_TABLES
+} TableId;
+
+typedef struct _Table
+{
+  const char *name;
+  const char *type;
+  GPtrArray  *objects;
+} Table;
+
+static Table tables[N_TABLES] = {
+  { "extensions", "XGenExtension" },
+  { "base_types", "XGenBaseType" },
+  { "structs", "XGenStruct" },
+  { "unions", "XGenUnion" },
+  { "xid_unions", "XGenXIDUnion" },
+  { "enums", "XGenEnum" },
+  { "typedefs", "XGenTypedef" },
+  { "valueparams", "XGenValueParam" },
+  { "requests", "XGenRequest" },
+  { "replies", "XGenReply" },
+  { "events", "XGenEvent" },
+  { "errors", "XGenError" },
+  { "fields", "XGenFieldDefinition" },
+  { "items", "XGenItemDefinition" },
+  { "expressions", "XGenExpression" },
+  { "layouts", "XGenLayout" },
+  { "field_layouts", "XGenFieldLayout" },
+  { "lists", "GList" }
+};
+
+/* Object -> the C expression for its address */
+static GHashTable *addresses;
+
+/* Interned strings */
+static GString *string_pool;
+static GHashTable *string_offsets;
+
+static char *option_name = "xgen_embedded_state";
+static char *option_output = NULL;
+static char **option_files = NULL;
+
+static GOptionEntry entries[] = {
+  { "name", 'n', 0, G_OPTION_ARG_STRING, &option_name,
+    "The name of the XGenEmbeddedState to define", "NAME" },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &option_output,
+    "The file to write (stdout by default)", "FILE" },
+  { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &option_files,
+    NULL, "PROTOCOL FILES..." },
+  { NULL }
+};
+
+/* The parser reports progress with g_print(), which mustn't end up in
+ * generated code written to stdout */
+static void
+print_to_stderr (const gchar *message)
+{
+  fputs (message, stderr);
+}
+
+static gboolean
+add_object (TableId id, gconstpointer object)
+{
+  Table *table = &tables[id];
+
+  if (!object || g_hash_table_lookup (addresses, object))
+    return FALSE;
+
+  g_hash_table_insert (addresses, (gpointer)object,
+		       g_strdup_printf ("(void *)&%s[%u]", table->name,
+					table->objects->len));
+  g_ptr_array_add (table->objects, (gpointer)object);
+  return TRUE;
+}
+
+static const char *
+address (gconstpointer object)
+{
+  const char *address;
+
+  if (!object)
+    return "NULL";
+
+  address = g_hash_table_lookup (addresses, object);
+  if (!address)
+    g_error ("Found a reference to an object outside the state");
+  return address;
+}
+
+static void
+intern (gconstpointer data)
+{
+  const char *string = data;
+
+  if (!string || g_hash_table_lookup_extended (string_offsets, string,
+					       NULL, NULL))
+    return;
+
+  g_hash_table_insert (string_offsets, (gpointer)string,
+		       GSIZE_TO_POINTER (string_pool->len));
+  g_string_append_len (string_pool, string, strlen (string) + 1);
+}
+
+/* NB: the returned string is only valid until the next call */
+static const char *
+string (const char *string)
+{
+  static char buffer[64];
+
+  if (!string)
+    return "NULL";
+
+  snprintf (buffer, sizeof (buffer), "(char *)strings + %lu",
+	    (unsigned long)GPOINTER_TO_SIZE (g_hash_table_lookup
+					     (string_offsets, string)));
+  return buffer;
+}
+
+static void add_definition (gconstpointer data);
+
+static void
+add_list (GList *list, void (*add_data) (gconstpointer data))
+{
+  GList *tmp;
+
+  for (tmp = list; tmp != NULL; tmp = tmp->next)
+    {
+      /* Lists can share nodes, e.g. the fields of an event copy */
+      if (!add_object (TABLE_LISTS, tmp))
+	break;
+      if (add_data)
+	add_data (tmp->data);
+    }
+}
+
+static void
+add_expression (const XGenExpression *expression)
+{
+  if (!add_object (TABLE_EXPRESSIONS, expression))
+    return;
+
+  switch (expression->type)
+    {
+    case XGEN_FIELDREF:
+      intern (expression->field);
+      break;
+    case XGEN_OP:
+      add_expression (expression->left);
+      add_expression (expression->right);
+      break;
+    case XGEN_VALUE:
+      break;
+    }
+}
+
+static void
+add_field (gconstpointer data)
+{
+  const XGenFieldDefinition *field = data;
+
+  if (!add_object (TABLE_FIELDS, field))
+    return;
+
+  intern (field->name);
+  intern (field->_enum_name);
+  add_definition (field->definition);
+  add_definition (field->enum_def);
+  if (field->length)
+    add_expression (field->length);
+}
+
+static void
+add_item (gconstpointer data)
+{
+  const XGenItemDefinition *item = data;
+
+  if (!add_object (TABLE_ITEMS, item))
+    return;
+
+  intern (item->name);
+  intern (item->value);
+}
+
+static void
+add_layout (const XGenLayout *layout)
+{
+  guint i;
+
+  if (!layout || !add_object (TABLE_LAYOUTS, layout))
+    return;
+
+  /* The field layouts of a layout are one contiguous block */
+  for (i = 0; i < layout->n_fields; i++)
+    {
+      add_object (TABLE_FIELD_LAYOUTS, &layout->fields[i]);
+      add_field (layout->fields[i].field);
+      add_definition (layout->fields[i].type);
+    }
+}
+
+static void
+add_definition (gconstpointer data)
+{
+  const XGenDefinition *def = data;
+  static const TableId table_ids[] = {
+    [XGEN_VOID] = TABLE_BASE_TYPES,
+    [XGEN_BOOLEAN] = TABLE_BASE_TYPES,
+    [XGEN_CHAR] = TABLE_BASE_TYPES,
+    [XGEN_SIGNED] = TABLE_BASE_TYPES,
+    [XGEN_UNSIGNED] = TABLE_BASE_TYPES,
+    [XGEN_XID] = TABLE_BASE_TYPES,
+    [XGEN_FLOAT] = TABLE_BASE_TYPES,
+    [XGEN_DOUBLE] = TABLE_BASE_TYPES,
+    [XGEN_STRUCT] = TABLE_STRUCTS,
+    [XGEN_UNION] = TABLE_UNIONS,
+    [XGEN_XIDUNION] = TABLE_XID_UNIONS,
+    [XGEN_ENUM] = TABLE_ENUMS,
+    [XGEN_TYPEDEF] = TABLE_TYPEDEFS,
+    [XGEN_REQUEST] = TABLE_REQUESTS,
+    [XGEN_VALUEPARAM] = TABLE_VALUEPARAMS,
+    [XGEN_REPLY] = TABLE_REPLIES,
+    [XGEN_EVENT] = TABLE_EVENTS,
+    [XGEN_ERROR] = TABLE_ERRORS
+  };
+
+  if (!def || !add_object (table_ids[def->type], def))
+    return;
+
+  intern (def->name);
+
+  switch (def->type)
+    {
+    case XGEN_STRUCT:
+      add_list (XGEN_STRUCT_DEF (def)->fields, add_field);
+      break;
+    case XGEN_UNION:
+      add_list (XGEN_UNION_DEF (def)->fields, add_field);
+      break;
+    case XGEN_XIDUNION:
+      add_list (XGEN_XID_UNION_DEF (def)->fields, add_field);
+      break;
+    case XGEN_ENUM:
+      add_list (XGEN_ENUM_DEF (def)->items, add_item);
+      break;
+    case XGEN_TYPEDEF:
+      add_definition (XGEN_TYPEDEF_DEF (def)->reference);
+      break;
+    case XGEN_VALUEPARAM:
+      add_definition (XGEN_VALUE_PARAM_DEF (def)->reference);
+      intern (XGEN_VALUE_PARAM_DEF (def)->mask_name);
+      intern (XGEN_VALUE_PARAM_DEF (def)->list_name);
+      break;
+    case XGEN_REQUEST:
+      add_list (XGEN_REQUEST_DEF (def)->fields, add_field);
+      add_definition (XGEN_REQUEST_DEF (def)->reply);
+      break;
+    case XGEN_REPLY:
+      add_list (XGEN_REPLYDEF (def)->fields, add_field);
+      break;
+    case XGEN_EVENT:
+      add_list (XGEN_EVENT_DEF (def)->fields, add_field);
+      break;
+    case XGEN_ERROR:
+      add_list (XGEN_ERROR_DEF (def)->fields, add_field);
+      break;
+    default:
+      break;
+    }
+
+  add_layout (xgen_definition_get_layout (def));
+}
+
+static void
+add_extension (gconstpointer data)
+{
+  const XGenExtension *extension = data;
+
+  if (!add_object (TABLE_EXTENSIONS, extension))
+    return;
+
+  intern (extension->name);
+  intern (extension->header);
+  intern (extension->xname);
+
+  add_list (extension->imports, add_extension);
+  add_list (extension->base_types, add_definition);
+  add_list (extension->structs, add_definition);
+  add_list (extension->unions, add_definition);
+  add_list (extension->xid_unions, add_definition);
+  add_list (extension->enums, add_definition);
+  add_list (extension->typedefs, add_definition);
+  add_list (extension->requests, add_definition);
+  add_list (extension->replys, add_definition);
+  add_list (extension->errors, add_definition);
+  add_list (extension->events, add_definition);
+  add_list (extension->all_definitions, add_definition);
+  add_list (extension->_import_headers, intern);
+}
+
+static const char *
+boolean (gboolean value)
+{
+  return value ? "TRUE" : "FALSE";
+}
+
+static void
+write_parent (FILE *out, const XGenDefinition *def)
+{
+  static const char *types[] = {
+    "XGEN_VOID", "XGEN_BOOLEAN", "XGEN_CHAR", "XGEN_SIGNED",
+    "XGEN_UNSIGNED", "XGEN_XID", "XGEN_FLOAT", "XGEN_DOUBLE",
+    "XGEN_STRUCT", "XGEN_UNION", "XGEN_XIDUNION", "XGEN_ENUM",
+    "XGEN_TYPEDEF", "XGEN_REQUEST", "XGEN_VALUEPARAM", "XGEN_REPLY",
+    "XGEN_EVENT", "XGEN_ERROR"
+  };
+
+  fprintf (out, "._parent = { .extension = %s, .type = %s, ",
+	   address (def->extension), types[def->type]);
+  fprintf (out, ".name = %s, ._layout = %s,\n    ",
+	   string (def->name), address (xgen_definition_get_layout (def)));
+  fprintf (out, "._fingerprint = G_GUINT64_CONSTANT (0x%016" G_GINT64_MODIFIER
+	   "x) }", xgen_definition_get_fingerprint (def));
+}
+
+static void
+write_object (FILE *out, TableId id, gconstpointer object)
+{
+  const XGenDefinition *def = object;
+
+  switch (id)
+    {
+    case TABLE_EXTENSIONS:
+      {
+	const XGenExtension *extension = object;
+
+	fprintf (out, ".name = %s, ", string (extension->name));
+	fprintf (out, ".header = %s, ", string (extension->header));
+	fprintf (out, ".xname = %s,\n    ", string (extension->xname));
+	fprintf (out, ".imports = %s, ", address (extension->imports));
+	fprintf (out, ".base_types = %s, ", address (extension->base_types));
+	fprintf (out, ".structs = %s,\n    ", address (extension->structs));
+	fprintf (out, ".unions = %s, ", address (extension->unions));
+	fprintf (out, ".xid_unions = %s, ", address (extension->xid_unions));
+	fprintf (out, ".enums = %s,\n    ", address (extension->enums));
+	fprintf (out, ".typedefs = %s, ", address (extension->typedefs));
+	fprintf (out, ".requests = %s, ", address (extension->requests));
+	fprintf (out, ".replys = %s,\n    ", address (extension->replys));
+	fprintf (out, ".errors = %s, ", address (extension->errors));
+	fprintf (out, ".events = %s,\n    ", address (extension->events));
+	fprintf (out, ".all_definitions = %s,\n    ",
+		 address (extension->all_definitions));
+	fprintf (out, "._import_headers = %s, ._parsed = TRUE,\n    ",
+		 address (extension->_import_headers));
+	fprintf (out, "._fingerprint = G_GUINT64_CONSTANT (0x%016"
+		 G_GINT64_MODIFIER "x)",
+		 xgen_extension_get_fingerprint (extension));
+	break;
+      }
+
+    case TABLE_BASE_TYPES:
+      write_parent (out, def);
+      fprintf (out, ", .size = %u", XGEN_BASE_TYPE_DEF (def)->size);
+      break;
+    case TABLE_STRUCTS:
+      write_parent (out, def);
+      fprintf (out, ", .fields = %s", address (XGEN_STRUCT_DEF (def)->fields));
+      break;
+    case TABLE_UNIONS:
+      write_parent (out, def);
+      fprintf (out, ", .fields = %s", address (XGEN_UNION_DEF (def)->fields));
+      break;
+    case TABLE_XID_UNIONS:
+      write_parent (out, def);
+      fprintf (out, ", .fields = %s",
+	       address (XGEN_XID_UNION_DEF (def)->fields));
+      break;
+    case TABLE_ENUMS:
+      write_parent (out, def);
+      fprintf (out, ", .items = %s", address (XGEN_ENUM_DEF (def)->items));
+      break;
+    case TABLE_TYPEDEFS:
+      write_parent (out, def);
+      fprintf (out, ", .reference = %s",
+	       address (XGEN_TYPEDEF_DEF (def)->reference));
+      break;
+    case TABLE_VALUEPARAMS:
+      write_parent (out, def);
+      fprintf (out, ",\n    .reference = %s, ",
+	       address (XGEN_VALUE_PARAM_DEF (def)->reference));
+      fprintf (out, ".mask_name = %s, ",
+	       string (XGEN_VALUE_PARAM_DEF (def)->mask_name));
+      fprintf (out, ".list_name = %s",
+	       string (XGEN_VALUE_PARAM_DEF (def)->list_name));
+      break;
+    case TABLE_REQUESTS:
+      write_parent (out, def);
+      fprintf (out, ",\n    .opcode = %u, .fields = %s, ",
+	       XGEN_REQUEST_DEF (def)->opcode,
+	       address (XGEN_REQUEST_DEF (def)->fields));
+      fprintf (out, ".reply = %s", address (XGEN_REQUEST_DEF (def)->reply));
+      break;
+    case TABLE_REPLIES:
+      write_parent (out, def);
+      fprintf (out, ",\n    .opcode = %u, .fields = %s",
+	       XGEN_REPLYDEF (def)->opcode,
+	       address (XGEN_REPLYDEF (def)->fields));
+      break;
+    case TABLE_EVENTS:
+      write_parent (out, def);
+      fprintf (out, ",\n    .number = %u, .fields = %s, .is_copy = %s, "
+	       ".is_generic = %s",
+	       XGEN_EVENT_DEF (def)->number,
+	       address (XGEN_EVENT_DEF (def)->fields),
+	       boolean (XGEN_EVENT_DEF (def)->is_copy),
+	       boolean (XGEN_EVENT_DEF (def)->is_generic));
+      break;
+    case TABLE_ERRORS:
+      write_parent (out, def);
+      fprintf (out, ",\n    .number = %u, .fields = %s, .is_copy = %s",
+	       XGEN_ERROR_DEF (def)->number,
+	       address (XGEN_ERROR_DEF (def)->fields),
+	       boolean (XGEN_ERROR_DEF (def)->is_copy));
+      break;
+
+    case TABLE_FIELDS:
+      {
+	const XGenFieldDefinition *field = object;
+
+	fprintf (out, ".name = %s, ", string (field->name));
+	fprintf (out, ".definition = %s,\n    ", address (field->definition));
+	fprintf (out, ".length = %s, .implicit = %s, ",
+		 address (field->length), boolean (field->implicit));
+	fprintf (out, ".enum_def = %s, .is_mask = %s, ",
+		 address (field->enum_def), boolean (field->is_mask));
+	fprintf (out, "._enum_name = %s", string (field->_enum_name));
+	break;
+      }
+
+    case TABLE_ITEMS:
+      {
+	const XGenItemDefinition *item = object;
+
+	fprintf (out, ".type = %s, ",
+		 item->type == XGEN_ITEM_AS_BIT
+		 ? "XGEN_ITEM_AS_BIT" : "XGEN_ITEM_AS_VALUE");
+	fprintf (out, ".name = %s, ", string (item->name));
+	fprintf (out, ".value = %s, ", string (item->value));
+	fprintf (out, ".bit = %u", item->bit);
+	break;
+      }
+
+    case TABLE_EXPRESSIONS:
+      {
+	const XGenExpression *expression = object;
+	static const char *ops[] = {
+	  "XGEN_ADD", "XGEN_SUBTRACT", "XGEN_MULTIPLY", "XGEN_DIVIDE",
+	  "XGEN_LEFT_SHIFT", "XGEN_BITWISE_AND"
+	};
+
+	switch (expression->type)
+	  {
+	  case XGEN_FIELDREF:
+	    fprintf (out, ".type = XGEN_FIELDREF, .field = %s",
+		     string (expression->field));
+	    break;
+	  case XGEN_VALUE:
+	    fprintf (out, ".type = XGEN_VALUE, .value = %luUL",
+		     expression->value);
+	    break;
+	  case XGEN_OP:
+	    fprintf (out, ".type = XGEN_OP, .op = %s, ", ops[expression->op]);
+	    fprintf (out, ".left = %s, ", address (expression->left));
+	    fprintf (out, ".right = %s", address (expression->right));
+	    break;
+	  }
+	break;
+      }
+
+    case TABLE_LAYOUTS:
+      {
+	const XGenLayout *layout = object;
+
+	fprintf (out, ".definition = %s, ", address (layout->definition));
+	fprintf (out, ".n_fields = %u, .fields = %s,\n    ",
+		 layout->n_fields,
+		 layout->n_fields ? address (&layout->fields[0]) : "NULL");
+	fprintf (out, ".fixed_size = %u, .is_fixed = %s, "
+		 ".min_size = %u,\n    ",
+		 layout->fixed_size, boolean (layout->is_fixed),
+		 layout->min_size);
+	fprintf (out, ".alignment = %u, .matches_host_abi = %s, ",
+		 layout->alignment, boolean (layout->matches_host_abi));
+	fprintf (out, ".is_byte_order_neutral = %s,\n    ",
+		 boolean (layout->is_byte_order_neutral));
+	fprintf (out, ".is_bounded = %s, .max_size = %u",
+		 boolean (layout->is_bounded), layout->max_size);
+	break;
+      }
+
+    case TABLE_FIELD_LAYOUTS:
+      {
+	const XGenFieldLayout *field_layout = object;
+	static const char *kinds[] = {
+	  "XGEN_LAYOUT_SCALAR", "XGEN_LAYOUT_STRUCT", "XGEN_LAYOUT_LIST",
+	  "XGEN_LAYOUT_VALUEPARAM"
+	};
+
+	fprintf (out, ".field = %s, ", address (field_layout->field));
+	fprintf (out, ".type = %s,\n    ", address (field_layout->type));
+	fprintf (out, ".kind = %s, .size = %u, .offset = %d, "
+		 ".fills_remainder = %s",
+		 kinds[field_layout->kind], field_layout->size,
+		 field_layout->offset,
+		 boolean (field_layout->fills_remainder));
+	break;
+      }
+
+    case TABLE_LISTS:
+      {
+	const GList *node = object;
+
+	/* The data of string lists are interned strings */
+	if (node->data && g_hash_table_lookup (addresses, node->data))
+	  fprintf (out, ".data = %s, ", address (node->data));
+	else
+	  fprintf (out, ".data = %s, ", string (node->data));
+	fprintf (out, ".next = %s, ", address (node->next));
+	fprintf (out, ".prev = %s", address (node->prev));
+	break;
+      }
+
+    case N_TABLES:
+      g_assert_not_reached ();
+    }
+}
+
+static void
+intern_names (const XGenNameTable *table)
+{
+  guint i;
+
+  for (i = 0; i < table->size; i++)
+    intern (table->entries[i].name);
+}
+
+static void
+write_name_table (FILE *out, const XGenNameTable *table, const char *name)
+{
+  guint i;
+
+  if (!table->size)
+    return;
+
+  fprintf (out, "static const guint32 %s_displacements[%u] = {",
+	   name, table->n_buckets);
+  for (i = 0; i < table->n_buckets; i++)
+    fprintf (out, "%s%u,", i % 10 ? " " : "\n  ", table->displacements[i]);
+  fprintf (out, "\n};\n\n");
+
+  fprintf (out, "static const XGenNameEntry %s_entries[%u] = {\n",
+	   name, table->size);
+  for (i = 0; i < table->size; i++)
+    {
+      const XGenNameEntry *entry = &table->entries[i];
+
+      fprintf (out, "  { %s, ", string (entry->name));
+      fprintf (out, "%s, ", address (entry->definition));
+      fprintf (out, "%s },\n", address (entry->item));
+    }
+  fprintf (out, "};\n\n");
+}
+
+static void
+write_name_table_fields (FILE *out, const XGenNameTable *table,
+			 const char *name)
+{
+  fprintf (out, "{ .seed = %u, .n_buckets = %u,\n"
+	   "      .displacements = %s_displacements,\n"
+	   "      .size = %u, .entries = %s_entries }",
+	   table->seed, table->n_buckets, name, table->size, name);
+}
+
+static void
+write_names (FILE *out, const XGenNames *names)
+{
+  static const char *types[][2] = {
+    { "XGEN_VOID", "void" }, { "XGEN_BOOLEAN", "boolean" },
+    { "XGEN_CHAR", "char" }, { "XGEN_SIGNED", "signed" },
+    { "XGEN_UNSIGNED", "unsigned" }, { "XGEN_XID", "xid" },
+    { "XGEN_FLOAT", "float" }, { "XGEN_DOUBLE", "double" },
+    { "XGEN_STRUCT", "struct" }, { "XGEN_UNION", "union" },
+    { "XGEN_XIDUNION", "xid_union" }, { "XGEN_ENUM", "enum" },
+    { "XGEN_TYPEDEF", "typedef" }, { "XGEN_REQUEST", "request" },
+    { "XGEN_VALUEPARAM", "valueparam" }, { "XGEN_REPLY", "reply" },
+    { "XGEN_EVENT", "event" }, { "XGEN_ERROR", "error" }
+  };
+  char *name;
+  guint i;
+
+  for (i = 0; i < XGEN_NAMES_N_TYPES; i++)
+    {
+      name = g_strdup_printf ("%s_names", types[i][1]);
+      write_name_table (out, &names->definitions[i], name);
+      g_free (name);
+    }
+  write_name_table (out, &names->items, "item_names");
+
+  fprintf (out, "static const XGenNames names = {\n  .definitions = {\n");
+  for (i = 0; i < XGEN_NAMES_N_TYPES; i++)
+    {
+      if (!names->definitions[i].size)
+	continue;
+
+      name = g_strdup_printf ("%s_names", types[i][1]);
+      fprintf (out, "    [%s] = ", types[i][0]);
+      write_name_table_fields (out, &names->definitions[i], name);
+      fprintf (out, ",\n");
+      g_free (name);
+    }
+  fprintf (out, "  }");
+  if (names->items.size)
+    {
+      fprintf (out, ",\n  .items = ");
+      write_name_table_fields (out, &names->items, "item_names");
+    }
+  fprintf (out, "\n};\n\n");
+}
+
+static void
+write_strings (FILE *out)
+{
+  gsize i;
+  guint column = 0;
+
+  fprintf (out, "static const char strings[] =\n  \"");
+  for (i = 0; i < string_pool->len; i++)
+    {
+      guchar c = string_pool->str[i];
+
+      if (c == '\0')
+	{
+	  /* Break lines between strings; the final NUL is implicit */
+	  if (i + 1 == string_pool->len)
+	    break;
+	  fprintf (out, "\\0");
+	  column += 2;
+	  /* Don't let a following digit extend the octal escape */
+	  if (column > 60 || g_ascii_isdigit (string_pool->str[i + 1]))
+	    {
+	      fprintf (out, "\"\n  \"");
+	      column = 0;
+	    }
+	  continue;
+	}
+
+      if (c == '"' || c == '\\')
+	column += fprintf (out, "\\%c", c);
+      else if (c < ' ' || c > '~' || c == '?')
+	column += fprintf (out, "\\%03o", c);
+      else
+	column += fprintf (out, "%c", c);
+    }
+  fprintf (out, "\";\n\n");
+}
+
+static void
+write_state (FILE *out,
+	     const XGenState *state,
+	     const XGenNames *names,
+	     char **files)
+{
+  guint i, j;
+
+  fprintf (out, "/* Generated by xgen-embed from");
+  for (i = 0; files[i]; i++)
+    fprintf (out, " %s", files[i]);
+  fprintf (out, "; do not edit.\n *\n"
+	   " * extern const XGenEmbeddedState %s;\n */\n\n", option_name);
+  fprintf (out, "#include <xgen.h>\n#include <xgen-layout.h>\n"
+	   "#include <xgen-embed.h>\n\n");
+
+  write_strings (out);
+
+  for (i = 0; i < N_TABLES; i++)
+    if (tables[i].objects->len)
+      fprintf (out, "static const %s %s[%u];\n", tables[i].type,
+	       tables[i].name, tables[i].objects->len);
+  fprintf (out, "\n");
+
+  for (i = 0; i < N_TABLES; i++)
+    {
+      if (!tables[i].objects->len)
+	continue;
+
+      fprintf (out, "static const %s %s[%u] = {\n", tables[i].type,
+	       tables[i].name, tables[i].objects->len);
+      for (j = 0; j < tables[i].objects->len; j++)
+	{
+	  fprintf (out, "  { ");
+	  write_object (out, i, g_ptr_array_index (tables[i].objects, j));
+	  fprintf (out, " },\n");
+	}
+      fprintf (out, "};\n\n");
+    }
+
+  fprintf (out, "static const XGenState state = {\n"
+	   "  .host_is_little_endian = %s,\n"
+	   "  .extensions = %s\n};\n\n",
+	   boolean (state->host_is_little_endian),
+	   address (state->extensions));
+
+  write_names (out, names);
+
+  fprintf (out, "const XGenEmbeddedState %s = {\n"
+	   "  .abi = 0x%08x,\n  .state = &state,\n  .names = &names\n};\n",
+	   option_name, xgen_embed_get_abi ());
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GList *files = NULL;
+  XGenState *state;
+  XGenNames *names;
+  FILE *out = stdout;
+  guint i;
+
+  context = g_option_context_new ("- write protocol descriptions as "
+				  "static C data");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      fprintf (stderr, "%s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (!option_files)
+    {
+      fprintf (stderr, "No protocol files given\n");
+      return 1;
+    }
+
+  g_set_print_handler (print_to_stderr);
+
+  for (i = 0; option_files[i]; i++)
+    files = g_list_append (files, option_files[i]);
+  state = xgen_parse_xcb_proto_files (files);
+  g_list_free (files);
+  if (!state)
+    return 1;
+
+  addresses = g_hash_table_new (g_direct_hash, g_direct_equal);
+  string_pool = g_string_new (NULL);
+  string_offsets = g_hash_table_new (g_str_hash, g_str_equal);
+  for (i = 0; i < N_TABLES; i++)
+    tables[i].objects = g_ptr_array_new ();
+
+  add_list (state->extensions, add_extension);
+
+  names = xgen_names_new (state);
+  for (i = 0; i < XGEN_NAMES_N_TYPES; i++)
+    intern_names (&names->definitions[i]);
+  intern_names (&names->items);
+
+  if (option_output)
+    {
+      out = fopen (option_output, "w");
+      if (!out)
+	{
+	  perror (option_output);
+	  return 1;
+	}
+    }
+
+  write_state (out, state, names, option_files);
+
+  if (fclose (out) != 0)
+    {
+      perror (option_output ? option_output : "stdout");
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,634 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+/* xgen-load drives a local X server, such as Xvfb, with a synthetic
+ * request stream and reports the throughput it achieves, e.g.:
+ *
+ *   Xvfb :9 -ac &
+ *   xgen-load -d :9 -r 50000 -t 30 \
+ *     -m "xproto:PolyFillRectangle=40;
+ *	   xproto:ChangeProperty=20 format=8 mode=0"
+ *
+ * Every batch of generated requests is followed by a GetInputFocus whose
+ * reply shows the server has processed the batch, which both measures
+ * the rate the server sustains and stops the client running ahead of it.
+ * Only unauthenticated local connections are supported.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-dispatch.h>
+#include <xgen-encoder.h>
+#include <xgen-generator.h>
+#include <xgen-io.h>
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+
+/* The number of synchronisation points the client may run ahead of the
+ * server by */
+#define MAX_OUTSTANDING_SYNCS 4
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define HOST_BYTE_ORDER XGEN_LSB_FIRST
+#else
+#define HOST_BYTE_ORDER XGEN_MSB_FIRST
+#endif
+
+typedef struct _Sync
+{
+  guint64 sequence;
+  guint64 n_requests;	/* Generated requests sent before this sync */
+} Sync;
+
+typedef struct _Connection
+{
+  int		      fd;
+  const XGenState    *state;
+  XGenDispatch	     *dispatch;
+  XGenEncoder	     *encoder;
+  XGenOutputBuffer   *buffer;
+
+  guint8	     *in;
+  gsize		      in_len;
+  gsize		      in_allocated;
+
+  guint64	      sequence;	  /* Of the last request sent */
+
+  const XGenRequest  *sync_request;
+  XGenEncodeValue    *sync_values;
+
+  Sync		      syncs[MAX_OUTSTANDING_SYNCS];
+  guint		      n_syncs;
+
+  guint64	      n_completed;
+  guint64	      n_replies;
+  guint64	      n_events;
+  guint64	      n_errors;
+  GHashTable	     *error_counts; /* Error name -> count */
+} Connection;
+
+static char *option_display = NULL;
+static char *option_mix =
+  "xproto:PolyFillRectangle=40; xproto:ChangeProperty=20 format=8 mode=0; "
+  "xproto:PolyLine=20; xproto:ClearArea=10; xproto:NoOperation=10";
+static gint option_seed = -1;
+static gint option_rate = 0;
+static gint option_duration = 10;
+static gint option_batch = 64;
+static gint option_max_value = 256;
+static gint option_max_list_length = 16;
+static char **option_files = NULL;
+
+static GOptionEntry entries[] = {
+  { "display", 'd', 0, G_OPTION_ARG_STRING, &option_display,
+    "The X display to connect to", "DISPLAY" },
+  { "mix", 'm', 0, G_OPTION_ARG_STRING, &option_mix,
+    "The request mix, e.g. \"xproto:PolyFillRectangle=40; "
+    "xproto:ChangeProperty=20 format=8\"", "MIX" },
+  { "seed", 's', 0, G_OPTION_ARG_INT, &option_seed,
+    "The random seed (by default one is chosen and printed)", "SEED" },
+  { "rate", 'r', 0, G_OPTION_ARG_INT, &option_rate,
+    "The target rate in requests per second, or 0 for no limit", "RATE" },
+  { "time", 't', 0, G_OPTION_ARG_INT, &option_duration,
+    "How many seconds to run for", "SECONDS" },
+  { "batch", 'b', 0, G_OPTION_ARG_INT, &option_batch,
+    "The number of requests written at a time", "N" },
+  { "max-value", 0, 0, G_OPTION_ARG_INT, &option_max_value,
+    "The largest random value given to a field", "N" },
+  { "max-list-length", 0, 0, G_OPTION_ARG_INT, &option_max_list_length,
+    "The most elements given to a list", "N" },
+  { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &option_files,
+    NULL, "[PROTOCOL FILES...]" },
+  { NULL }
+};
+
+static guint32
+read_host (const guint8 *data, guint size)
+{
+  guint16 value16;
+  guint32 value32;
+
+  switch (size)
+    {
+    case 1:
+      return data[0];
+    case 2:
+      memcpy (&value16, data, 2);
+      return value16;
+    case 4:
+      memcpy (&value32, data, 4);
+      return value32;
+    }
+  return 0;
+}
+
+/* Reads a fixed position field of a message in the host byte order */
+static guint32
+get_field (const XGenDefinition *def, const guint8 *data, const char *name)
+{
+  const XGenLayout *layout = xgen_definition_get_layout (def);
+  gint index = xgen_layout_find_field (layout, name);
+
+  g_assert (index >= 0
+	    && layout->fields[index].offset != XGEN_LAYOUT_VARIABLE_OFFSET);
+  return read_host (data + layout->fields[index].offset,
+		    layout->fields[index].size);
+}
+
+static void
+set_value (const XGenRequest *request,
+	   XGenEncodeValue *values,
+	   const char *name,
+	   guint32 value,
+	   guint32 count,
+	   const void *data)
+{
+  const XGenLayout *layout = xgen_definition_get_layout (XGEN_DEF (request));
+  gint index = xgen_layout_find_field (layout, name);
+
+  g_assert (index >= 0);
+  values[index].value = value;
+  values[index].count = count;
+  values[index].data = data;
+}
+
+static const XGenRequest *
+find_request (const XGenState *state, const char *name)
+{
+  const XGenDefinition *def =
+    xgen_state_find_definition (state, name, XGEN_REQUEST);
+
+  if (!def)
+    {
+      fprintf (stderr, "The protocol files don't define %s\n", name);
+      exit (1);
+    }
+  return XGEN_REQUEST_DEF (def);
+}
+
+/* Reads whatever the server has sent; if @block is set this waits for
+ * at least some data */
+static gboolean
+read_input (Connection *connection, gboolean block)
+{
+  ssize_t n;
+
+  if (connection->in_allocated - connection->in_len < 4096)
+    {
+      connection->in_allocated = MAX (connection->in_allocated * 2, 65536);
+      connection->in = g_realloc (connection->in, connection->in_allocated);
+    }
+
+  if (!block)
+    {
+      struct pollfd pfd = { connection->fd, POLLIN, 0 };
+      if (poll (&pfd, 1, 0) <= 0)
+	return TRUE;
+    }
+
+  do
+    n = read (connection->fd, connection->in + connection->in_len,
+	      connection->in_allocated - connection->in_len);
+  while (n < 0 && errno == EINTR);
+
+  if (n <= 0)
+    {
+      fprintf (stderr, "The X server closed the connection\n");
+      return FALSE;
+    }
+  connection->in_len += n;
+  return TRUE;
+}
+
+static void
+handle_message (Connection *connection, const guint8 *data, gsize len)
+{
+  guint16 sequence = read_host (data + 2, 2);
+  const XGenError *error;
+  const char *name;
+  gpointer count;
+
+  switch (data[0])
+    {
+    case 0:
+      connection->n_errors++;
+      error = xgen_dispatch_lookup_error (connection->dispatch, data, len);
+      name = error ? XGEN_DEF (error)->name : "Unknown";
+      count = g_hash_table_lookup (connection->error_counts, name);
+      g_hash_table_insert (connection->error_counts, (gpointer)name,
+			   GUINT_TO_POINTER (GPOINTER_TO_UINT (count) + 1));
+      break;
+    case 1:
+      if (connection->n_syncs
+	  && sequence == (connection->syncs[0].sequence & 0xffff))
+	{
+	  connection->n_completed = connection->syncs[0].n_requests;
+	  memmove (connection->syncs, connection->syncs + 1,
+		   --connection->n_syncs * sizeof (Sync));
+	}
+      else
+	connection->n_replies++;
+      break;
+    default:
+      connection->n_events++;
+    }
+}
+
+/* Handles every complete message in the input buffer */
+static void
+process_input (Connection *connection)
+{
+  gsize pos = 0;
+
+  while (connection->in_len - pos >= 32)
+    {
+      const guint8 *data = connection->in + pos;
+      gsize len = 32;
+
+      /* Replies and generic events can be longer than 32 bytes */
+      if (data[0] == 1 || (data[0] & 0x7f) == 35)
+	len += (gsize)read_host (data + 4, 4) * 4;
+      if (connection->in_len - pos < len)
+	break;
+
+      handle_message (connection, data, len);
+      pos += len;
+    }
+
+  memmove (connection->in, connection->in + pos, connection->in_len - pos);
+  connection->in_len -= pos;
+}
+
+/* Reads and handles input until a reply to @sequence arrives, which is
+ * then left at the start of the input buffer */
+static const guint8 *
+wait_for_reply (Connection *connection, guint64 sequence)
+{
+  for (;;)
+    {
+      while (connection->in_len >= 32)
+	{
+	  const guint8 *data = connection->in;
+	  gsize len = 32;
+
+	  if (data[0] == 1 || (data[0] & 0x7f) == 35)
+	    len += (gsize)read_host (data + 4, 4) * 4;
+	  if (connection->in_len < len)
+	    break;
+
+	  if (data[0] <= 1 && read_host (data + 2, 2) == (sequence & 0xffff))
+	    return data[0] == 1 ? data : NULL;
+
+	  handle_message (connection, data, len);
+	  memmove (connection->in, connection->in + len,
+		   connection->in_len - len);
+	  connection->in_len -= len;
+	}
+      if (!read_input (connection, TRUE))
+	return NULL;
+    }
+}
+
+static void
+consume_message (Connection *connection)
+{
+  gsize len = 32 + (gsize)read_host (connection->in + 4, 4) * 4;
+
+  memmove (connection->in, connection->in + len, connection->in_len - len);
+  connection->in_len -= len;
+}
+
+static gboolean
+append (Connection *connection,
+	const XGenRequest *request,
+	const XGenEncodeValue *values)
+{
+  if (!xgen_encoder_append (connection->encoder, connection->buffer,
+			    request, values))
+    return FALSE;
+  connection->sequence++;
+  return TRUE;
+}
+
+/* Appends a GetInputFocus whose reply shows the server has processed the
+ * first @n_requests generated requests */
+static gboolean
+append_sync (Connection *connection, guint64 n_requests)
+{
+  Sync *sync = &connection->syncs[connection->n_syncs];
+
+  if (!append (connection, connection->sync_request, connection->sync_values))
+    return FALSE;
+  sync->sequence = connection->sequence;
+  sync->n_requests = n_requests;
+  connection->n_syncs++;
+  return TRUE;
+}
+
+static gboolean
+flush (Connection *connection)
+{
+  return xgen_output_buffer_flush (connection->buffer, connection->fd);
+}
+
+/* Registers every extension besides the core protocol with the values
+ * the server gives for it */
+static gboolean
+query_extensions (Connection *connection)
+{
+  const XGenRequest *query = find_request (connection->state,
+					   "xproto:QueryExtension");
+  const XGenLayout *layout = xgen_definition_get_layout (XGEN_DEF (query));
+  XGenEncodeValue *values = g_new0 (XGenEncodeValue, layout->n_fields);
+  GList *tmp;
+
+  for (tmp = connection->state->extensions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+      const guint8 *reply;
+
+      if (!extension->xname)
+	continue;
+
+      set_value (query, values, "name", 0, strlen (extension->xname),
+		 extension->xname);
+      if (!append (connection, query, values) || !flush (connection))
+	goto error;
+
+      reply = wait_for_reply (connection, connection->sequence);
+      if (!reply)
+	goto error;
+      if (!get_field (XGEN_DEF (query->reply), reply, "present"))
+	{
+	  fprintf (stderr, "The X server doesn't support %s\n",
+		   extension->name);
+	  goto error;
+	}
+      xgen_dispatch_add_extension (connection->dispatch, extension->header,
+				   get_field (XGEN_DEF (query->reply), reply,
+					      "major_opcode"),
+				   get_field (XGEN_DEF (query->reply), reply,
+					      "first_event"),
+				   get_field (XGEN_DEF (query->reply), reply,
+					      "first_error"));
+      consume_message (connection);
+    }
+
+  g_free (values);
+  return TRUE;
+
+error:
+  g_free (values);
+  return FALSE;
+}
+
+/* Creates a mapped window and a GC for the generated requests to use */
+static gboolean
+create_resources (Connection *connection,
+		  XGenGenerator *generator,
+		  const XGenSetupInfo *setup)
+{
+  const XGenState *state = connection->state;
+  const XGenRequest *create_window =
+    find_request (state, "xproto:CreateWindow");
+  const XGenRequest *map_window = find_request (state, "xproto:MapWindow");
+  const XGenRequest *create_gc = find_request (state, "xproto:CreateGC");
+  XGenEncodeValue values[32];
+  guint32 window = setup->resource_id_base | 1;
+  guint32 gc = setup->resource_id_base | 2;
+
+  xgen_encoder_set_max_request_length (connection->encoder,
+				       setup->maximum_request_length, 0);
+
+  memset (values, 0, sizeof (values));
+  set_value (create_window, values, "wid", window, 0, NULL);
+  set_value (create_window, values, "parent", setup->root, 0, NULL);
+  set_value (create_window, values, "width", 640, 0, NULL);
+  set_value (create_window, values, "height", 480, 0, NULL);
+  set_value (create_window, values, "class", 1 /* InputOutput */, 0, NULL);
+  if (!append (connection, create_window, values))
+    return FALSE;
+
+  memset (values, 0, sizeof (values));
+  set_value (map_window, values, "window", window, 0, NULL);
+  if (!append (connection, map_window, values))
+    return FALSE;
+
+  memset (values, 0, sizeof (values));
+  set_value (create_gc, values, "cid", gc, 0, NULL);
+  set_value (create_gc, values, "drawable", window, 0, NULL);
+  if (!append (connection, create_gc, values))
+    return FALSE;
+
+  xgen_generator_set_resource (generator, "WINDOW", window);
+  xgen_generator_set_resource (generator, "DRAWABLE", window);
+  xgen_generator_set_resource (generator, "GCONTEXT", gc);
+  xgen_generator_set_resource (generator, "COLORMAP",
+			       setup->default_colormap);
+  xgen_generator_set_resource (generator, "VISUALID", setup->root_visual);
+  /* WM_NAME; any predefined atom will do */
+  xgen_generator_set_resource (generator, "ATOM", 39);
+
+  return flush (connection);
+}
+
+static void
+print_error_count (gpointer key, gpointer value, gpointer user_data)
+{
+  printf ("  %-20s %u\n", (const char *)key, GPOINTER_TO_UINT (value));
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GList *files = NULL;
+  XGenState *state;
+  XGenGenerator *generator;
+  Connection connection;
+  XGenSetupInfo setup;
+  GTimer *timer;
+  guint64 n_sent = 0, n_bytes = 0, last_sync = 0;
+  guint64 last_sent = 0, last_completed = 0, last_bytes = 0;
+  gdouble last_report = 0, elapsed;
+  guint i;
+
+  context = g_option_context_new ("- drive an X server with synthetic "
+				  "requests");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      fprintf (stderr, "%s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (!option_display)
+    option_display = getenv ("DISPLAY");
+  if (!option_display)
+    option_display = ":0";
+  if (option_seed < 0)
+    option_seed = g_random_int_range (0, G_MAXINT32);
+  option_batch = MAX (option_batch, 1);
+
+  if (option_files)
+    for (i = 0; option_files[i]; i++)
+      files = g_list_append (files, option_files[i]);
+  else
+    files = g_list_append (files, "xproto.xml");
+
+  state = xgen_parse_xcb_proto_files (files);
+  g_list_free (files);
+  if (!state)
+    return 1;
+
+  generator = xgen_generator_new (state, option_seed);
+  xgen_generator_set_limits (generator, option_max_value,
+			     option_max_list_length);
+  if (!xgen_generator_parse_mix (generator, option_mix))
+    return 1;
+
+  memset (&connection, 0, sizeof (connection));
+  connection.state = state;
+  connection.dispatch = xgen_dispatch_new (state);
+  connection.encoder = xgen_encoder_new (connection.dispatch,
+					 HOST_BYTE_ORDER);
+  connection.buffer = xgen_output_buffer_new ();
+  connection.error_counts = g_hash_table_new (g_str_hash, g_str_equal);
+
+  connection.fd = xgen_io_connect_display (option_display);
+  if (connection.fd < 0)
+    return 1;
+  if (!xgen_io_setup_connection (state, connection.fd, HOST_BYTE_ORDER,
+				 &setup)
+      || !query_extensions (&connection)
+      || !create_resources (&connection, generator, &setup))
+    return 1;
+
+  connection.sync_request = find_request (state, "xproto:GetInputFocus");
+  connection.sync_values =
+    g_new0 (XGenEncodeValue,
+	    xgen_definition_get_layout (XGEN_DEF (connection.sync_request))
+	    ->n_fields);
+
+  printf ("Seed: %d\n", option_seed);
+
+  timer = g_timer_new ();
+  while ((elapsed = g_timer_elapsed (timer, NULL)) < option_duration)
+    {
+      guint n = option_batch;
+
+      if (option_rate > 0)
+	{
+	  gdouble due = elapsed * option_rate - n_sent;
+
+	  if (due < 1)
+	    {
+	      /* Wait for the next request to be due, handling input */
+	      struct pollfd pfd = { connection.fd, POLLIN, 0 };
+	      int timeout = (1 - due) * 1000 / option_rate;
+
+	      if (poll (&pfd, 1, MAX (timeout, 1)) > 0)
+		{
+		  if (!read_input (&connection, TRUE))
+		    return 1;
+		  process_input (&connection);
+		}
+	      continue;
+	    }
+	  n = MIN (n, (guint)due);
+	}
+
+      for (i = 0; i < n; i++)
+	{
+	  if (!xgen_generator_append (generator, connection.encoder,
+				      connection.buffer))
+	    return 1;
+	  connection.sequence++;
+	}
+      n_sent += n;
+      n_bytes += xgen_output_buffer_get_size (connection.buffer);
+
+      /* A rate limit can make for short batches so syncs are only added
+       * once a full batch has been sent since the last one */
+      if (n_sent - last_sync >= (guint64)option_batch)
+	{
+	  if (!append_sync (&connection, n_sent))
+	    return 1;
+	  last_sync = n_sent;
+	}
+
+      if (!flush (&connection) || !read_input (&connection, FALSE))
+	return 1;
+      process_input (&connection);
+      while (connection.n_syncs == MAX_OUTSTANDING_SYNCS)
+	{
+	  if (!read_input (&connection, TRUE))
+	    return 1;
+	  process_input (&connection);
+	}
+
+      if (elapsed - last_report >= 1)
+	{
+	  gdouble interval = elapsed - last_report;
+
+	  printf ("%6.1fs: sent %9.0f req/s, completed %9.0f req/s, "
+		  "%7.2f MB/s, %" G_GUINT64_FORMAT " errors\n",
+		  elapsed,
+		  (n_sent - last_sent) / interval,
+		  (connection.n_completed - last_completed) / interval,
+		  (n_bytes - last_bytes) / interval / (1024 * 1024),
+		  connection.n_errors);
+	  last_report = elapsed;
+	  last_sent = n_sent;
+	  last_completed = connection.n_completed;
+	  last_bytes = n_bytes;
+	}
+    }
+
+  if (last_sync != n_sent)
+    {
+      if (!append_sync (&connection, n_sent) || !flush (&connection))
+	return 1;
+    }
+  while (connection.n_syncs)
+    {
+      if (!read_input (&connection, TRUE))
+	return 1;
+      process_input (&connection);
+    }
+  elapsed = g_timer_elapsed (timer, NULL);
+
+  printf ("Sent %" G_GUINT64_FORMAT " requests (%" G_GUINT64_FORMAT
+	  " bytes) in %.2fs: %.0f req/s, %.2f MB/s\n",
+	  n_sent, n_bytes, elapsed, n_sent / elapsed,
+	  n_bytes / elapsed / (1024 * 1024));
+  printf ("Received %" G_GUINT64_FORMAT " replies, %" G_GUINT64_FORMAT
+	  " events and %" G_GUINT64_FORMAT " errors\n",
+	  connection.n_replies, connection.n_events, connection.n_errors);
+  g_hash_table_foreach (connection.error_counts, print_error_count, NULL);
+
+  g_timer_destroy (timer);
+  close (connection.fd);
+  return 0;
+}
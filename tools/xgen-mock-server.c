@@ -0,0 +1,153 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+/* xgen-mock-server answers X clients without a real display, e.g.:
+ *
+ *   xgen-mock-server -d :99 -p xproto.xml -p bigreq.xml \
+ *     -s "GetInputFocus.focus=0x100"
+ *   xgen-load -d :99 -p xproto.xml
+ *
+ * It runs until interrupted and then prints what the clients sent.
+ */
+
+#include <xgen.h>
+#include <xgen-mock.h>
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+
+static char *option_display = ":99";
+static char **option_protocols = NULL;
+static char **option_values = NULL;
+
+static GOptionEntry entries[] = {
+  { "display", 'd', 0, G_OPTION_ARG_STRING, &option_display,
+    "The display to serve (default :99)", "DISPLAY" },
+  { "protocol", 'p', 0, G_OPTION_ARG_FILENAME_ARRAY, &option_protocols,
+    "A protocol file to serve (default xproto.xml)", "FILE" },
+  { "set", 's', 0, G_OPTION_ARG_STRING_ARRAY, &option_values,
+    "A canned reply value, e.g. \"xproto:GetInputFocus.focus=0x100\"",
+    "REQUEST.FIELD=VALUE" },
+  { NULL }
+};
+
+static gboolean
+set_value (XGenMockServer *server, const char *option)
+{
+  const char *equals = strchr (option, '=');
+  const char *dot;
+  char *request, *field;
+  gboolean ret;
+
+  if (!equals)
+    return FALSE;
+  for (dot = equals; dot > option && *dot != '.'; dot--)
+    ;
+  if (dot == option)
+    return FALSE;
+
+  request = g_strndup (option, dot - option);
+  field = g_strndup (dot + 1, equals - (dot + 1));
+  ret = xgen_mock_server_set_value (server, request, field,
+				    strtoul (equals + 1, NULL, 0));
+  g_free (request);
+  g_free (field);
+
+  return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GList *files = NULL;
+  XGenState *state;
+  XGenMockServer *server;
+  XGenMockServerStats stats;
+  const char *number;
+  char *socket_path;
+  sigset_t signals;
+  int signal_number;
+  int i;
+
+  context = g_option_context_new ("- answer X clients without a display");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      fprintf (stderr, "%s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  number = strrchr (option_display, ':');
+  if (!number || !g_ascii_isdigit (number[1]))
+    {
+      fprintf (stderr, "Invalid display \"%s\"\n", option_display);
+      return 1;
+    }
+
+  if (option_protocols)
+    for (i = 0; option_protocols[i]; i++)
+      files = g_list_append (files, option_protocols[i]);
+  else
+    files = g_list_append (files, "xproto.xml");
+
+  state = xgen_parse_xcb_proto_files (files);
+  g_list_free (files);
+  if (!state)
+    return 1;
+
+  socket_path = g_strdup_printf ("/tmp/.X11-unix/X%d", atoi (number + 1));
+  server = xgen_mock_server_new (state, socket_path);
+  g_free (socket_path);
+  if (!server)
+    return 1;
+
+  if (option_values)
+    for (i = 0; option_values[i]; i++)
+      if (!set_value (server, option_values[i]))
+	{
+	  fprintf (stderr, "Invalid value \"%s\"\n", option_values[i]);
+	  xgen_mock_server_free (server);
+	  return 1;
+	}
+
+  /* The server's threads inherit the blocked signals so they can only be
+   * received here */
+  sigemptyset (&signals);
+  sigaddset (&signals, SIGINT);
+  sigaddset (&signals, SIGTERM);
+  pthread_sigmask (SIG_BLOCK, &signals, NULL);
+
+  xgen_mock_server_start (server);
+  sigwait (&signals, &signal_number);
+
+  xgen_mock_server_get_stats (server, &stats);
+  xgen_mock_server_free (server);
+
+  printf ("Connections: %" G_GUINT64_FORMAT "\n", stats.n_connections);
+  printf ("Requests:    %" G_GUINT64_FORMAT "\n", stats.n_requests);
+  printf ("Replies:     %" G_GUINT64_FORMAT "\n", stats.n_replies);
+  printf ("Unknown:     %" G_GUINT64_FORMAT "\n", stats.n_unknown);
+  printf ("Bytes:       %" G_GUINT64_FORMAT "\n", stats.n_bytes);
+
+  return 0;
+}
@@ -0,0 +1,242 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+/* xgen-replay replays a captured client session against a local X server
+ * and reports the throughput it achieves for each type of request, e.g.:
+ *
+ *   Xvfb :9 -ac &
+ *   xgen-replay -d :9 -p xproto.xml -p shape.xml session.xgc
+ *
+ * Requests are sent as fast as possible unless a speed is given, with
+ * 1 keeping to the captured timing. Replies and errors that differ from
+ * the captured ones are listed. Only unauthenticated local connections
+ * are supported.
+ */
+
+#include <xgen.h>
+#include <xgen-replay.h>
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char *option_display = NULL;
+static char **option_protocols = NULL;
+static gboolean option_msb_first = FALSE;
+static gdouble option_speed = 0;
+static gint64 option_units_per_second = 1000000;
+static gint option_batch = 256;
+static char *option_resource_base = NULL;
+static char *option_root = NULL;
+static char **option_ignore = NULL;
+static gint option_max_differences = 20;
+static char **option_captures = NULL;
+
+static GOptionEntry entries[] = {
+  { "display", 'd', 0, G_OPTION_ARG_STRING, &option_display,
+    "The X display to connect to", "DISPLAY" },
+  { "protocol", 'p', 0, G_OPTION_ARG_FILENAME_ARRAY, &option_protocols,
+    "A protocol file describing the capture (default xproto.xml)", "FILE" },
+  { "msb-first", 0, 0, G_OPTION_ARG_NONE, &option_msb_first,
+    "The captured connection is big endian", NULL },
+  { "speed", 's', 0, G_OPTION_ARG_DOUBLE, &option_speed,
+    "1 for the captured timing, 2 for twice as fast... or 0 for as fast as "
+    "possible (the default)", "FACTOR" },
+  { "units-per-second", 0, 0, G_OPTION_ARG_INT64, &option_units_per_second,
+    "The capture timestamps per second (default 1000000)", "N" },
+  { "batch", 'b', 0, G_OPTION_ARG_INT, &option_batch,
+    "The number of requests written at a time", "N" },
+  { "resource-base", 0, 0, G_OPTION_ARG_STRING, &option_resource_base,
+    "The captured client's resource-id-base (by default it's guessed)",
+    "XID" },
+  { "root", 0, 0, G_OPTION_ARG_STRING, &option_root,
+    "The captured root window, to use the local one instead", "XID" },
+  { "ignore", 'i', 0, G_OPTION_ARG_STRING_ARRAY, &option_ignore,
+    "A reply field not to compare, e.g. \"QueryPointer.root_x\"",
+    "REQUEST.FIELD" },
+  { "max-differences", 0, 0, G_OPTION_ARG_INT, &option_max_differences,
+    "The most differences from the capture to list", "N" },
+  { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &option_captures,
+    NULL, "CAPTURE" },
+  { NULL }
+};
+
+static char *
+get_request_name (const XGenRequest *request)
+{
+  const XGenDefinition *def = XGEN_DEF (request);
+
+  return g_strdup_printf ("%s:%s", def->extension->header, def->name);
+}
+
+static void
+print_difference (const XGenRequest *request,
+		  guint64 sequence,
+		  const char *description,
+		  void *user_data)
+{
+  guint64 *n_printed = user_data;
+  char *name;
+
+  if ((*n_printed)++ >= (guint64)option_max_differences)
+    return;
+
+  name = get_request_name (request);
+  printf ("%" G_GUINT64_FORMAT " %s: %s\n", sequence, name, description);
+  g_free (name);
+}
+
+static gboolean
+ignore_field (XGenReplay *replay, const char *option)
+{
+  const char *dot = strrchr (option, '.');
+  char *request;
+  gboolean ret;
+
+  if (!dot || dot == option)
+    return FALSE;
+
+  request = g_strndup (option, dot - option);
+  ret = xgen_replay_ignore_field (replay, request, dot + 1);
+  g_free (request);
+
+  return ret;
+}
+
+static void
+print_report (XGenReplay *replay)
+{
+  GList *report = xgen_replay_get_report (replay);
+  XGenReplayTotals totals;
+  GList *tmp;
+
+  printf ("%-32s %9s %11s %8s %8s %8s %10s %10s\n",
+	  "Request", "Count", "Bytes", "Replies", "Errors", "Differ",
+	  "Time (ms)", "Req/s");
+
+  for (tmp = report; tmp != NULL; tmp = tmp->next)
+    {
+      const XGenReplayStats *stats = tmp->data;
+      char *name = get_request_name (stats->request);
+
+      printf ("%-32s %9" G_GUINT64_FORMAT " %11" G_GUINT64_FORMAT
+	      " %8" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT
+	      " %8" G_GUINT64_FORMAT " %10.2f %10.0f\n",
+	      name, stats->n_requests, stats->n_bytes, stats->n_replies,
+	      stats->n_errors, stats->n_differences, stats->time * 1000,
+	      stats->time > 0 ? stats->n_requests / stats->time : 0);
+      g_free (name);
+    }
+  g_list_free (report);
+
+  xgen_replay_get_totals (replay, &totals);
+  printf ("Replayed %" G_GUINT64_FORMAT " requests (%" G_GUINT64_FORMAT
+	  " bytes) in %.2fs: %.0f req/s, %.2f MB/s\n",
+	  totals.n_requests, totals.n_bytes, totals.elapsed,
+	  totals.elapsed > 0 ? totals.n_requests / totals.elapsed : 0,
+	  totals.elapsed > 0
+	  ? totals.n_bytes / totals.elapsed / (1024 * 1024) : 0);
+  printf ("Skipped %" G_GUINT64_FORMAT " requests and added %"
+	  G_GUINT64_FORMAT " GetInputFocus requests\n",
+	  totals.n_skipped, totals.n_syncs);
+  printf ("Received %" G_GUINT64_FORMAT " replies, %" G_GUINT64_FORMAT
+	  " events and %" G_GUINT64_FORMAT " errors; %" G_GUINT64_FORMAT
+	  " requests were answered differently than captured\n",
+	  totals.n_replies, totals.n_events, totals.n_errors,
+	  totals.n_differences);
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GList *files = NULL;
+  XGenState *state;
+  XGenReplay *replay;
+  guint64 n_printed = 0;
+  int i;
+
+  context = g_option_context_new ("- replay a captured session against "
+				  "a local X server");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      fprintf (stderr, "%s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (!option_captures || option_captures[1])
+    {
+      fprintf (stderr, "Give one capture to replay\n");
+      return 1;
+    }
+
+  if (!option_display)
+    option_display = getenv ("DISPLAY");
+  if (!option_display)
+    option_display = ":0";
+
+  if (option_protocols)
+    for (i = 0; option_protocols[i]; i++)
+      files = g_list_append (files, option_protocols[i]);
+  else
+    files = g_list_append (files, "xproto.xml");
+
+  state = xgen_parse_xcb_proto_files (files);
+  g_list_free (files);
+  if (!state)
+    return 1;
+
+  replay = xgen_replay_new (state, option_msb_first
+			    ? XGEN_MSB_FIRST : XGEN_LSB_FIRST);
+  xgen_replay_set_speed (replay, option_speed,
+			 MAX (option_units_per_second, 1));
+  xgen_replay_set_batch (replay, MAX (option_batch, 1));
+  xgen_replay_set_difference_func (replay, print_difference, &n_printed);
+  if (option_resource_base)
+    xgen_replay_set_resource_base (replay,
+				   strtoul (option_resource_base, NULL, 0));
+  if (option_ignore)
+    for (i = 0; option_ignore[i]; i++)
+      if (!ignore_field (replay, option_ignore[i]))
+	{
+	  fprintf (stderr, "Invalid field \"%s\"\n", option_ignore[i]);
+	  return 1;
+	}
+
+  if (!xgen_replay_connect (replay, option_display))
+    return 1;
+  if (option_root)
+    xgen_replay_map_xid (replay, strtoul (option_root, NULL, 0),
+			 xgen_replay_get_root (replay));
+
+  if (!xgen_replay_run (replay, option_captures[0]))
+    {
+      fprintf (stderr, "Failed to replay %s\n", option_captures[0]);
+      return 1;
+    }
+
+  if (n_printed > (guint64)option_max_differences)
+    printf ("... and %" G_GUINT64_FORMAT " more differences\n",
+	    n_printed - option_max_differences);
+  print_report (replay);
+
+  xgen_replay_free (replay);
+  return 0;
+}
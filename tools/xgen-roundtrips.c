@@ -0,0 +1,138 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+/* xgen-roundtrips reports where a captured client waited on round trips
+ * it could have avoided, e.g.:
+ *
+ *   xgen-roundtrips -p xproto.xml -p shape.xml session.xgc
+ *
+ * Each capture should hold one client session. Requests are listed with
+ * the largest estimated saving first; latencies are in the units of the
+ * capture timestamps.
+ */
+
+#include <xgen.h>
+#include <xgen-roundtrips.h>
+
+#include <glib.h>
+
+#include <stdio.h>
+
+static char **option_protocols = NULL;
+static gboolean option_msb_first = FALSE;
+static char **option_captures = NULL;
+
+static GOptionEntry entries[] = {
+  { "protocol", 'p', 0, G_OPTION_ARG_FILENAME_ARRAY, &option_protocols,
+    "A protocol file describing the captures (default xproto.xml)", "FILE" },
+  { "msb-first", 0, 0, G_OPTION_ARG_NONE, &option_msb_first,
+    "The captured connections are big endian", NULL },
+  { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &option_captures,
+    NULL, "CAPTURES..." },
+  { NULL }
+};
+
+static void
+print_report (XGenRoundTripAnalyzer *analyzer)
+{
+  GList *report = xgen_round_trip_analyzer_get_report (analyzer);
+  GList *tmp;
+
+  printf ("%-32s %8s %8s %8s %8s %12s %12s %6s\n",
+	  "Request", "Calls", "Blocking", "Repeated", "Predict",
+	  "Waited", "Saved", "Chain");
+
+  for (tmp = report; tmp != NULL; tmp = tmp->next)
+    {
+      const XGenRoundTripStats *stats = tmp->data;
+      const XGenDefinition *def = (XGenDefinition *)stats->request;
+      char *name = g_strdup_printf ("%s:%s", def->extension->header,
+				    def->name);
+
+      printf ("%-32s %8" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT
+	      " %8" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT
+	      " %12" G_GUINT64_FORMAT " %12" G_GUINT64_FORMAT " %6u\n",
+	      name, stats->n_calls, stats->n_blocking,
+	      stats->n_repeated, stats->n_predictable,
+	      stats->blocking_latency, stats->saved_latency,
+	      stats->longest_chain);
+      g_free (name);
+    }
+
+  printf ("Longest synchronous chain: %u calls\n",
+	  xgen_round_trip_analyzer_get_longest_chain (analyzer));
+
+  g_list_free (report);
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GList *files = NULL;
+  XGenState *state;
+  int i;
+
+  context = g_option_context_new ("- find avoidable round trips in "
+				  "captured sessions");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      fprintf (stderr, "%s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (!option_captures)
+    {
+      fprintf (stderr, "No captures given\n");
+      return 1;
+    }
+
+  if (option_protocols)
+    for (i = 0; option_protocols[i]; i++)
+      files = g_list_append (files, option_protocols[i]);
+  else
+    files = g_list_append (files, "xproto.xml");
+
+  state = xgen_parse_xcb_proto_files (files);
+  g_list_free (files);
+  if (!state)
+    return 1;
+
+  for (i = 0; option_captures[i]; i++)
+    {
+      XGenRoundTripAnalyzer *analyzer =
+	xgen_round_trip_analyzer_new (state, option_msb_first
+				      ? XGEN_MSB_FIRST : XGEN_LSB_FIRST);
+
+      if (!xgen_round_trip_analyzer_add_capture (analyzer,
+						 option_captures[i]))
+	{
+	  fprintf (stderr, "Failed to read %s\n", option_captures[i]);
+	  xgen_round_trip_analyzer_free (analyzer);
+	  return 1;
+	}
+
+      if (option_captures[1])
+	printf ("%s:\n", option_captures[i]);
+      print_report (analyzer);
+
+      xgen_round_trip_analyzer_free (analyzer);
+    }
+
+  return 0;
+}
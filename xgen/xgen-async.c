@@ -0,0 +1,499 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-dispatch.h>
+#include <xgen-async.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+
+#define MESSAGE_SIZE 32
+#define READ_SIZE 4096
+#define INITIAL_N_COOKIES 64
+
+#define X_ERROR 0
+#define X_REPLY 1
+#define X_KEYMAP_NOTIFY 11 /* The only message without a sequence number */
+#define X_GENERIC_EVENT 35
+
+/* A request with a callback that hasn't completed yet */
+typedef struct _Cookie
+{
+  guint64	   sequence;
+  const XGenReply *reply;
+  XGenReplyFunc	   func;
+  void		  *user_data;
+  gboolean	   answered;
+} Cookie;
+
+typedef struct _ReplySource
+{
+  GSource		source;
+  GPollFD		poll_fd;
+  XGenReplyDispatcher  *dispatcher;
+} ReplySource;
+
+struct _XGenReplyDispatcher
+{
+  const XGenDispatch *dispatch;
+  int		      fd;
+  XGenByteOrder	      byte_order;
+  gboolean	      swap;
+
+  XGenReplyHandlers   handlers;
+  void		     *user_data;
+
+  /* The sequence number of the last request written */
+  guint64	      last_sequence;
+
+  /* The pending cookies, oldest first, in a ring whose size is a power
+   * of two. Since the server answers requests in order the cookie for
+   * any incoming message is always at or near the head. */
+  Cookie	     *cookies;
+  guint		      cookies_mask;
+  guint		      head;
+  guint		      n_cookies;
+
+  /* Data read but not yet passed on, up to the first incomplete
+   * message */
+  guint8	     *buffer;
+  gsize		      buffer_len;
+  gsize		      buffer_size;
+
+  GSource	     *source;
+};
+
+/**
+ * xgen_reply_dispatcher_new:
+ * @dispatch: A dispatcher with every extension of the connection added
+ * @fd: The connection socket, read once attached to a main loop
+ * @byte_order: The byte order of the connection
+ *
+ * Creates a reply dispatcher for a connection whose setup has completed,
+ * so that the next request written gets sequence number 1.
+ */
+XGenReplyDispatcher *
+xgen_reply_dispatcher_new (const XGenDispatch *dispatch,
+			   int fd,
+			   XGenByteOrder byte_order)
+{
+  XGenReplyDispatcher *dispatcher = g_new0 (XGenReplyDispatcher, 1);
+
+  dispatcher->dispatch = dispatch;
+  dispatcher->fd = fd;
+  dispatcher->byte_order = byte_order;
+  dispatcher->swap = _XGEN_NEEDS_SWAP (byte_order);
+
+  dispatcher->cookies = g_new (Cookie, INITIAL_N_COOKIES);
+  dispatcher->cookies_mask = INITIAL_N_COOKIES - 1;
+
+  dispatcher->buffer_size = READ_SIZE;
+  dispatcher->buffer = g_malloc (dispatcher->buffer_size);
+
+  return dispatcher;
+}
+
+void
+xgen_reply_dispatcher_set_handlers (XGenReplyDispatcher *dispatcher,
+				    const XGenReplyHandlers *handlers,
+				    void *user_data)
+{
+  dispatcher->handlers = *handlers;
+  dispatcher->user_data = user_data;
+}
+
+static Cookie *
+get_cookie (XGenReplyDispatcher *dispatcher, guint i)
+{
+  return &dispatcher->cookies[(dispatcher->head + i)
+			      & dispatcher->cookies_mask];
+}
+
+static void
+grow_cookies (XGenReplyDispatcher *dispatcher)
+{
+  guint size = dispatcher->cookies_mask + 1;
+  Cookie *cookies = g_new (Cookie, size * 2);
+  guint i;
+
+  for (i = 0; i < dispatcher->n_cookies; i++)
+    cookies[i] = *get_cookie (dispatcher, i);
+
+  g_free (dispatcher->cookies);
+  dispatcher->cookies = cookies;
+  dispatcher->cookies_mask = size * 2 - 1;
+  dispatcher->head = 0;
+}
+
+/**
+ * xgen_reply_dispatcher_add_request:
+ * @dispatcher: A reply dispatcher
+ * @request: The request written to the connection
+ * @func: The function to call once the request is answered, or NULL
+ * @user_data: Data to pass to @func
+ *
+ * Announces a request written to the connection. This must be called for
+ * every request, in the order they are written, even those without a
+ * callback.
+ *
+ * A request without a reply is only known to have succeeded once a later
+ * request has been answered, so to check one, follow it with a request
+ * that has a reply such as GetInputFocus.
+ *
+ * Returns: The sequence number of the request
+ */
+guint64
+xgen_reply_dispatcher_add_request (XGenReplyDispatcher *dispatcher,
+				   const XGenRequest *request,
+				   XGenReplyFunc func,
+				   void *user_data)
+{
+  Cookie *cookie;
+
+  dispatcher->last_sequence++;
+  if (!func)
+    return dispatcher->last_sequence;
+
+  if (dispatcher->n_cookies == dispatcher->cookies_mask + 1)
+    grow_cookies (dispatcher);
+
+  cookie = get_cookie (dispatcher, dispatcher->n_cookies++);
+  cookie->sequence = dispatcher->last_sequence;
+  cookie->reply = request->reply;
+  cookie->func = func;
+  cookie->user_data = user_data;
+  cookie->answered = FALSE;
+
+  return dispatcher->last_sequence;
+}
+
+/**
+ * xgen_reply_dispatcher_get_n_pending:
+ * @dispatcher: A reply dispatcher
+ *
+ * Returns: The number of cookies still waiting for an answer
+ */
+guint
+xgen_reply_dispatcher_get_n_pending (XGenReplyDispatcher *dispatcher)
+{
+  /* Only the head can have been answered; it's kept until a later
+   * request is answered in case of further replies */
+  if (dispatcher->n_cookies && get_cookie (dispatcher, 0)->answered)
+    return dispatcher->n_cookies - 1;
+  return dispatcher->n_cookies;
+}
+
+/* Recovers the full sequence number of a message from its low 16 bits,
+ * relying on the server never being more than 65535 requests behind */
+static guint64
+widen_sequence (XGenReplyDispatcher *dispatcher, guint16 sequence)
+{
+  return dispatcher->last_sequence
+    - (guint16)(dispatcher->last_sequence - sequence);
+}
+
+/* Completes the cookies of requests before @sequence; the server has
+ * finished with them */
+static void
+retire_cookies (XGenReplyDispatcher *dispatcher, guint64 sequence)
+{
+  while (dispatcher->n_cookies)
+    {
+      Cookie cookie = *get_cookie (dispatcher, 0);
+
+      if (cookie.sequence >= sequence)
+	break;
+
+      /* Pop the cookie first in case the callback adds requests */
+      dispatcher->head = (dispatcher->head + 1) & dispatcher->cookies_mask;
+      dispatcher->n_cookies--;
+
+      if (!cookie.answered)
+	cookie.func (dispatcher, cookie.sequence, NULL, NULL, 0,
+		     cookie.user_data);
+    }
+}
+
+/* Returns the cookie for @sequence if it has one. It's left in the ring
+ * since further replies may follow. */
+static Cookie *
+find_cookie (XGenReplyDispatcher *dispatcher, guint64 sequence)
+{
+  Cookie *cookie;
+
+  if (!dispatcher->n_cookies)
+    return NULL;
+
+  cookie = get_cookie (dispatcher, 0);
+  return cookie->sequence == sequence ? cookie : NULL;
+}
+
+static void
+handle_message (XGenReplyDispatcher *dispatcher,
+		const guint8 *data,
+		gsize len)
+{
+  const XGenReplyHandlers *handlers = &dispatcher->handlers;
+  guint64 sequence = 0;
+  Cookie *cookie;
+
+  if ((data[0] & 0x7f) != X_KEYMAP_NOTIFY)
+    {
+      sequence =
+	widen_sequence (dispatcher,
+			_xgen_read_unsigned (data + 2, 2, dispatcher->swap));
+      retire_cookies (dispatcher, sequence);
+    }
+
+  switch (data[0])
+    {
+    case X_REPLY:
+      /* Replies to requests added without a callback are dropped */
+      cookie = find_cookie (dispatcher, sequence);
+      if (!cookie)
+	break;
+      cookie->answered = TRUE;
+      cookie->func (dispatcher, sequence,
+		    (const XGenDefinition *)cookie->reply,
+		    data, len, cookie->user_data);
+      break;
+
+    case X_ERROR:
+      {
+	const XGenError *error =
+	  xgen_dispatch_lookup_error (dispatcher->dispatch, data, len);
+
+	cookie = find_cookie (dispatcher, sequence);
+	if (cookie)
+	  {
+	    cookie->answered = TRUE;
+	    cookie->func (dispatcher, sequence, (const XGenDefinition *)error,
+			  data, len, cookie->user_data);
+	  }
+	else if (handlers->error)
+	  handlers->error (dispatcher, sequence, error, data,
+			   dispatcher->user_data);
+	break;
+      }
+
+    default:
+      if (handlers->event)
+	handlers->event (dispatcher,
+			 xgen_dispatch_lookup_event (dispatcher->dispatch,
+						     data, len,
+						     dispatcher->byte_order),
+			 data, len, dispatcher->user_data);
+      break;
+    }
+}
+
+/* Passes on each complete message in the buffer and keeps the rest */
+static void
+handle_buffer (XGenReplyDispatcher *dispatcher)
+{
+  const guint8 *data = dispatcher->buffer;
+  gsize remaining = dispatcher->buffer_len;
+
+  while (remaining >= MESSAGE_SIZE)
+    {
+      gsize len = MESSAGE_SIZE;
+
+      /* Replies and generic events carry their extra length in 4 byte
+       * units */
+      if (data[0] == X_REPLY || (data[0] & 0x7f) == X_GENERIC_EVENT)
+	len += (gsize)_xgen_read_unsigned (data + 4, 4, dispatcher->swap) * 4;
+      if (len > remaining)
+	break;
+
+      handle_message (dispatcher, data, len);
+      data += len;
+      remaining -= len;
+    }
+
+  memmove (dispatcher->buffer, data, remaining);
+  dispatcher->buffer_len = remaining;
+}
+
+static void
+reserve_buffer (XGenReplyDispatcher *dispatcher, gsize len)
+{
+  if (dispatcher->buffer_size - dispatcher->buffer_len >= len)
+    return;
+
+  while (dispatcher->buffer_size - dispatcher->buffer_len < len)
+    dispatcher->buffer_size *= 2;
+  dispatcher->buffer = g_realloc (dispatcher->buffer, dispatcher->buffer_size);
+}
+
+/**
+ * xgen_reply_dispatcher_feed:
+ * @dispatcher: A reply dispatcher
+ * @data: Data read from the connection
+ * @len: The length of @data
+ *
+ * Passes on the messages in data read from the connection by the caller,
+ * for a dispatcher that isn't attached to a main loop. Incomplete
+ * messages are kept until the rest of their data is fed.
+ */
+void
+xgen_reply_dispatcher_feed (XGenReplyDispatcher *dispatcher,
+			    const guint8 *data,
+			    gsize len)
+{
+  reserve_buffer (dispatcher, len);
+  memcpy (dispatcher->buffer + dispatcher->buffer_len, data, len);
+  dispatcher->buffer_len += len;
+  handle_buffer (dispatcher);
+}
+
+/* Reads everything available on the connection without blocking. Returns
+ * FALSE once the connection is closed. */
+static gboolean
+read_available (XGenReplyDispatcher *dispatcher)
+{
+  for (;;)
+    {
+      struct pollfd poll_fd;
+      gsize space;
+      ssize_t n_read;
+
+      reserve_buffer (dispatcher, READ_SIZE);
+      space = dispatcher->buffer_size - dispatcher->buffer_len;
+
+      n_read = read (dispatcher->fd,
+		     dispatcher->buffer + dispatcher->buffer_len, space);
+      if (n_read < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  if (errno == EAGAIN)
+	    return TRUE;
+	  g_warning ("Failed to read from the connection: %s",
+		     strerror (errno));
+	  return FALSE;
+	}
+      if (n_read == 0)
+	return FALSE;
+
+      dispatcher->buffer_len += n_read;
+      if ((gsize)n_read < space)
+	return TRUE;
+
+      /* The read filled the buffer so check for more without blocking */
+      poll_fd.fd = dispatcher->fd;
+      poll_fd.events = POLLIN;
+      if (poll (&poll_fd, 1, 0) != 1 || !(poll_fd.revents & POLLIN))
+	return TRUE;
+    }
+}
+
+static gboolean
+reply_source_prepare (GSource *source, gint *timeout)
+{
+  *timeout = -1;
+  return FALSE;
+}
+
+static gboolean
+reply_source_check (GSource *source)
+{
+  ReplySource *reply_source = (ReplySource *)source;
+
+  return reply_source->poll_fd.revents != 0;
+}
+
+static gboolean
+reply_source_dispatch (GSource *source,
+		       GSourceFunc callback,
+		       gpointer user_data)
+{
+  XGenReplyDispatcher *dispatcher = ((ReplySource *)source)->dispatcher;
+  gboolean open = read_available (dispatcher);
+
+  handle_buffer (dispatcher);
+
+  if (!open)
+    {
+      if (dispatcher->handlers.closed)
+	dispatcher->handlers.closed (dispatcher, dispatcher->user_data);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static GSourceFuncs reply_source_funcs = {
+  reply_source_prepare,
+  reply_source_check,
+  reply_source_dispatch,
+  NULL
+};
+
+/**
+ * xgen_reply_dispatcher_attach:
+ * @dispatcher: A reply dispatcher
+ * @context: The main context to read the connection from, or NULL for
+ *	     the default context
+ *
+ * Starts reading the connection whenever data is available. The source
+ * is removed once the connection is closed.
+ *
+ * Returns: The id of the source within @context
+ */
+guint
+xgen_reply_dispatcher_attach (XGenReplyDispatcher *dispatcher,
+			      GMainContext *context)
+{
+  ReplySource *source;
+
+  g_return_val_if_fail (dispatcher->source == NULL, 0);
+
+  source = (ReplySource *)g_source_new (&reply_source_funcs,
+					sizeof (ReplySource));
+  source->dispatcher = dispatcher;
+  source->poll_fd.fd = dispatcher->fd;
+  source->poll_fd.events = G_IO_IN | G_IO_HUP | G_IO_ERR;
+  g_source_add_poll (&source->source, &source->poll_fd);
+
+  dispatcher->source = &source->source;
+  return g_source_attach (dispatcher->source, context);
+}
+
+/**
+ * xgen_reply_dispatcher_free:
+ * @dispatcher: A reply dispatcher
+ *
+ * Detaches the dispatcher from its main loop and frees it. The callbacks
+ * of pending cookies are not called. This must not be called from one of
+ * the dispatcher's callbacks.
+ */
+void
+xgen_reply_dispatcher_free (XGenReplyDispatcher *dispatcher)
+{
+  if (dispatcher->source)
+    {
+      g_source_destroy (dispatcher->source);
+      g_source_unref (dispatcher->source);
+    }
+  g_free (dispatcher->cookies);
+  g_free (dispatcher->buffer);
+  g_free (dispatcher);
+}
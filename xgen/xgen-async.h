@@ -0,0 +1,81 @@
+#ifndef _XGEN_ASYNC_H_
+#define _XGEN_ASYNC_H_
+
+#include <xgen.h>
+#include <xgen-dispatch.h>
+
+#include <glib.h>
+
+/**
+ * Reads replies, errors and events off an X connection inside a GLib main
+ * loop and passes them to callbacks.
+ *
+ * Every request written to the connection must be announced with
+ * xgen_reply_dispatcher_add_request() so the dispatcher can follow the
+ * sequence numbers. The sequence number returned is the request's cookie:
+ * when its reply or error arrives, the callback given for it is called.
+ * Since the cookies are matched in the order the server answers them, any
+ * number of requests can be in flight at once.
+ *
+ * Each wakeup of the main loop reads all the data available and passes on
+ * every complete message in one batch.
+ */
+typedef struct _XGenReplyDispatcher XGenReplyDispatcher;
+
+/**
+ * Called when a cookie is answered. @definition is the request's
+ * XGenReply for a reply, or the XGenError for an error, NULL if the error
+ * code isn't known. If the request completed without a reply or error,
+ * e.g. a request without a reply once a later request has been answered,
+ * both @definition and @data are NULL.
+ *
+ * A request may get several replies, as with ListFontsWithInfo; the
+ * callback is then called for each of them.
+ */
+typedef void (*XGenReplyFunc) (XGenReplyDispatcher *dispatcher,
+			       guint64 sequence,
+			       const XGenDefinition *definition,
+			       const guint8 *data,
+			       gsize len,
+			       void *user_data);
+
+/**
+ * Called for messages that don't answer a cookie
+ */
+typedef struct _XGenReplyHandlers
+{
+  /* @event is NULL for an unknown event code */
+  void (*event) (XGenReplyDispatcher *dispatcher,
+		 const XGenEvent *event,
+		 const guint8 *data,
+		 gsize len,
+		 void *user_data);
+  /* Errors for requests without a callback */
+  void (*error) (XGenReplyDispatcher *dispatcher,
+		 guint64 sequence,
+		 const XGenError *error,
+		 const guint8 *data,
+		 void *user_data);
+  /* The server closed the connection or reading failed */
+  void (*closed) (XGenReplyDispatcher *dispatcher, void *user_data);
+} XGenReplyHandlers;
+
+XGenReplyDispatcher *xgen_reply_dispatcher_new (const XGenDispatch *dispatch,
+						int fd,
+						XGenByteOrder byte_order);
+void xgen_reply_dispatcher_set_handlers (XGenReplyDispatcher *dispatcher,
+					 const XGenReplyHandlers *handlers,
+					 void *user_data);
+guint xgen_reply_dispatcher_attach (XGenReplyDispatcher *dispatcher,
+				    GMainContext *context);
+guint64 xgen_reply_dispatcher_add_request (XGenReplyDispatcher *dispatcher,
+					   const XGenRequest *request,
+					   XGenReplyFunc func,
+					   void *user_data);
+void xgen_reply_dispatcher_feed (XGenReplyDispatcher *dispatcher,
+				 const guint8 *data,
+				 gsize len);
+guint xgen_reply_dispatcher_get_n_pending (XGenReplyDispatcher *dispatcher);
+void xgen_reply_dispatcher_free (XGenReplyDispatcher *dispatcher);
+
+#endif /* _XGEN_ASYNC_H_ */
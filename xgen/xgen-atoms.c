@@ -0,0 +1,590 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-dispatch.h>
+#include <xgen-atoms.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+#define MESSAGE_SIZE 32
+
+#define X_ERROR 0
+#define X_REPLY 1
+#define X_KEYMAP_NOTIFY 11 /* The only message without a sequence number */
+
+/* Where the fields the cache needs live in the requests and replies */
+typedef struct _Offsets
+{
+  guint intern_name_len;
+  guint intern_name;
+  guint intern_reply_atom;
+  guint intern_reply_size;
+
+  guint get_name_atom;
+  guint get_name_reply_name_len;
+  guint get_name_reply_name;
+} Offsets;
+
+/* Where server sequence numbers start to map to client sequence numbers
+ * with a new offset */
+typedef struct _Mapping
+{
+  guint64 server;
+  guint64 client;
+} Mapping;
+
+/* A forwarded InternAtom or GetAtomName whose reply will be learned */
+typedef struct _Lookup
+{
+  guint64 sequence;
+  char	 *name;	/* For InternAtom */
+  guint32 atom;	/* For GetAtomName */
+} Lookup;
+
+/* A synthesised reply waiting for the request before it to complete */
+typedef struct _HeldReply
+{
+  guint64 release;  /* The server sequence number to wait for */
+  guint64 sequence; /* The client sequence number of the reply */
+  gsize	  len;
+  guint8  data[1];
+} HeldReply;
+
+struct _XGenAtomCache
+{
+  const XGenDispatch *dispatch;
+  gboolean	      swap;
+
+  XGenAtomCacheFunc   func;
+  void		     *user_data;
+
+  const XGenRequest  *intern_atom;
+  const XGenRequest  *get_atom_name;
+  const XGenRequest  *list_fonts_with_info;
+  Offsets	      offsets;
+
+  GHashTable	     *atoms;	/* name -> atom */
+  GHashTable	     *names;	/* atom -> name, owning the names */
+
+  /* The sequence numbers of the last requests seen from the client and
+   * forwarded to the server */
+  guint64	      client_sequence;
+  guint64	      server_sequence;
+  gboolean	      last_has_reply;
+  /* A forwarded request that may get several replies, or 0 */
+  guint64	      multi_reply_sequence;
+
+  /* The last request the server is known to have finished with */
+  guint64	      completed;
+  /* The client sequence number of the last message passed on */
+  guint64	      last_emitted;
+
+  GQueue	     *mappings;
+  GQueue	     *lookups;
+  GQueue	     *held;
+
+  XGenAtomCacheStats  stats;
+};
+
+static gboolean
+find_offset (const XGenDefinition *def, const char *name, guint *offset)
+{
+  const XGenLayout *layout = xgen_definition_get_layout (def);
+  gint i = xgen_layout_find_field (layout, name);
+
+  if (i < 0 || layout->fields[i].offset == XGEN_LAYOUT_VARIABLE_OFFSET)
+    {
+      g_warning ("Failed to find field %s of %s", name, def->name);
+      return FALSE;
+    }
+
+  *offset = layout->fields[i].offset;
+  return TRUE;
+}
+
+static gboolean
+find_offsets (XGenAtomCache *cache)
+{
+  const XGenDefinition *intern_atom = (XGenDefinition *)cache->intern_atom;
+  const XGenDefinition *intern_reply =
+    (XGenDefinition *)cache->intern_atom->reply;
+  const XGenDefinition *get_name = (XGenDefinition *)cache->get_atom_name;
+  const XGenDefinition *get_name_reply =
+    (XGenDefinition *)cache->get_atom_name->reply;
+  Offsets *offsets = &cache->offsets;
+
+  offsets->intern_reply_size =
+    xgen_definition_get_layout (intern_reply)->min_size;
+
+  return find_offset (intern_atom, "name_len", &offsets->intern_name_len)
+    && find_offset (intern_atom, "name", &offsets->intern_name)
+    && find_offset (intern_reply, "atom", &offsets->intern_reply_atom)
+    && find_offset (get_name, "atom", &offsets->get_name_atom)
+    && find_offset (get_name_reply, "name_len",
+		    &offsets->get_name_reply_name_len)
+    && find_offset (get_name_reply, "name", &offsets->get_name_reply_name);
+}
+
+/**
+ * xgen_atom_cache_new:
+ * @state: The parsed protocol state, including xproto
+ * @dispatch: A dispatcher with every extension of the connection added,
+ *	      to tell which requests have replies
+ * @byte_order: The byte order of the connection
+ * @func: The function to pass messages for the client to
+ * @user_data: Data to pass to @func
+ *
+ * Creates an empty atom cache for a connection whose setup has completed.
+ *
+ * This function returns NULL if the state doesn't describe the core atom
+ * requests.
+ */
+XGenAtomCache *
+xgen_atom_cache_new (const XGenState *state,
+		     const XGenDispatch *dispatch,
+		     XGenByteOrder byte_order,
+		     XGenAtomCacheFunc func,
+		     void *user_data)
+{
+  XGenAtomCache *cache = g_new0 (XGenAtomCache, 1);
+  Mapping *mapping;
+
+  cache->dispatch = dispatch;
+  cache->swap = _XGEN_NEEDS_SWAP (byte_order);
+  cache->func = func;
+  cache->user_data = user_data;
+
+  cache->intern_atom = (XGenRequest *)
+    xgen_state_find_definition (state, "xproto:InternAtom", XGEN_REQUEST);
+  cache->get_atom_name = (XGenRequest *)
+    xgen_state_find_definition (state, "xproto:GetAtomName", XGEN_REQUEST);
+  cache->list_fonts_with_info = (XGenRequest *)
+    xgen_state_find_definition (state, "xproto:ListFontsWithInfo",
+				XGEN_REQUEST);
+  if (!cache->intern_atom || !cache->get_atom_name
+      || !cache->intern_atom->reply || !cache->get_atom_name->reply
+      || !find_offsets (cache))
+    {
+      g_warning ("Failed to find the atom requests");
+      g_free (cache);
+      return NULL;
+    }
+
+  cache->atoms = g_hash_table_new (g_str_hash, g_str_equal);
+  cache->names = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					NULL, g_free);
+
+  cache->mappings = g_queue_new ();
+  cache->lookups = g_queue_new ();
+  cache->held = g_queue_new ();
+
+  mapping = g_new0 (Mapping, 1);
+  g_queue_push_tail (cache->mappings, mapping);
+
+  return cache;
+}
+
+static void
+add_atom (XGenAtomCache *cache, const char *name, gsize name_len,
+	  guint32 atom)
+{
+  char *copy;
+
+  if (atom == 0
+      || g_hash_table_lookup (cache->names, GUINT_TO_POINTER (atom)))
+    return;
+
+  copy = g_strndup (name, name_len);
+  if (g_hash_table_lookup (cache->atoms, copy))
+    {
+      g_free (copy);
+      return;
+    }
+
+  g_hash_table_insert (cache->names, GUINT_TO_POINTER (atom), copy);
+  g_hash_table_insert (cache->atoms, copy, GUINT_TO_POINTER (atom));
+  cache->stats.n_atoms++;
+}
+
+static void
+emit (XGenAtomCache *cache, const guint8 *data, gsize len)
+{
+  cache->func (data, len, cache->user_data);
+}
+
+static void
+release_held (XGenAtomCache *cache)
+{
+  HeldReply *held;
+
+  while ((held = g_queue_peek_head (cache->held))
+	 && held->release <= cache->completed)
+    {
+      g_queue_pop_head (cache->held);
+      emit (cache, held->data, held->len);
+      cache->last_emitted = held->sequence;
+      g_free (held);
+    }
+}
+
+/* Passes on a synthesised reply, or holds it until the server has
+ * answered the request before it. Returns FALSE if that might take
+ * forever. */
+static gboolean
+answer (XGenAtomCache *cache, guint8 *reply, gsize len)
+{
+  HeldReply *held;
+
+  _xgen_write_unsigned (reply + 2, 2, cache->client_sequence, cache->swap);
+
+  if (cache->server_sequence <= cache->completed)
+    {
+      emit (cache, reply, len);
+      cache->last_emitted = cache->client_sequence;
+      return TRUE;
+    }
+
+  /* A request without a reply may still fail, and its error can arrive
+   * at any time */
+  if (!cache->last_has_reply)
+    return FALSE;
+
+  held = g_malloc (sizeof (HeldReply) + len);
+  held->release = cache->server_sequence;
+  held->sequence = cache->client_sequence;
+  held->len = len;
+  memcpy (held->data, reply, len);
+  g_queue_push_tail (cache->held, held);
+
+  return TRUE;
+}
+
+static gboolean
+answer_intern_atom (XGenAtomCache *cache, guint32 atom)
+{
+  const Offsets *offsets = &cache->offsets;
+  guint8 reply[MESSAGE_SIZE];
+
+  memset (reply, 0, sizeof (reply));
+  reply[0] = X_REPLY;
+  _xgen_write_unsigned (reply + offsets->intern_reply_atom, 4, atom,
+			cache->swap);
+
+  return answer (cache, reply, offsets->intern_reply_size);
+}
+
+static gboolean
+answer_get_atom_name (XGenAtomCache *cache, const char *name)
+{
+  const Offsets *offsets = &cache->offsets;
+  gsize name_len = strlen (name);
+  gsize len = _XGEN_ALIGN4 (offsets->get_name_reply_name + name_len);
+  guint8 *reply = g_malloc0 (len);
+  gboolean ret;
+
+  reply[0] = X_REPLY;
+  _xgen_write_unsigned (reply + 4, 4, (len - MESSAGE_SIZE) / 4, cache->swap);
+  _xgen_write_unsigned (reply + offsets->get_name_reply_name_len, 2,
+			name_len, cache->swap);
+  memcpy (reply + offsets->get_name_reply_name, name, name_len);
+
+  ret = answer (cache, reply, len);
+  g_free (reply);
+  return ret;
+}
+
+static void
+forward (XGenAtomCache *cache, const XGenRequest *request)
+{
+  Mapping *mapping = g_queue_peek_tail (cache->mappings);
+
+  cache->server_sequence++;
+  cache->last_has_reply = request && request->reply;
+
+  /* There's no telling which reply is the last without parsing them, so
+   * this is treated like a request that may fail at any time */
+  if (request && request == cache->list_fonts_with_info)
+    {
+      cache->multi_reply_sequence = cache->server_sequence;
+      cache->last_has_reply = FALSE;
+    }
+
+  if (cache->client_sequence - mapping->client
+      != cache->server_sequence - mapping->server)
+    {
+      mapping = g_new (Mapping, 1);
+      mapping->server = cache->server_sequence;
+      mapping->client = cache->client_sequence;
+      g_queue_push_tail (cache->mappings, mapping);
+    }
+}
+
+static gboolean
+handle_intern_atom (XGenAtomCache *cache, const guint8 *data, gsize len)
+{
+  const Offsets *offsets = &cache->offsets;
+  gsize name_len;
+  gpointer atom;
+  char *name;
+  Lookup *lookup;
+
+  if (len < offsets->intern_name)
+    return FALSE;
+  name_len = _xgen_read_unsigned (data + offsets->intern_name_len, 2,
+				  cache->swap);
+  if (len < offsets->intern_name + name_len)
+    return FALSE;
+
+  name = g_strndup ((const char *)data + offsets->intern_name, name_len);
+  atom = g_hash_table_lookup (cache->atoms, name);
+  if (atom && answer_intern_atom (cache, GPOINTER_TO_UINT (atom)))
+    {
+      g_free (name);
+      return TRUE;
+    }
+  if (atom)
+    cache->stats.n_unsafe++;
+
+  /* Learn from the reply once the request is forwarded */
+  lookup = g_new0 (Lookup, 1);
+  lookup->sequence = cache->server_sequence + 1;
+  lookup->name = name;
+  g_queue_push_tail (cache->lookups, lookup);
+  return FALSE;
+}
+
+static gboolean
+handle_get_atom_name (XGenAtomCache *cache, const guint8 *data, gsize len)
+{
+  const Offsets *offsets = &cache->offsets;
+  guint32 atom;
+  const char *name;
+  Lookup *lookup;
+
+  if (len < offsets->get_name_atom + 4)
+    return FALSE;
+  atom = _xgen_read_unsigned (data + offsets->get_name_atom, 4, cache->swap);
+
+  name = g_hash_table_lookup (cache->names, GUINT_TO_POINTER (atom));
+  if (name && answer_get_atom_name (cache, name))
+    return TRUE;
+  if (name)
+    cache->stats.n_unsafe++;
+
+  lookup = g_new0 (Lookup, 1);
+  lookup->sequence = cache->server_sequence + 1;
+  lookup->atom = atom;
+  g_queue_push_tail (cache->lookups, lookup);
+  return FALSE;
+}
+
+/**
+ * xgen_atom_cache_handle_request:
+ * @cache: An atom cache
+ * @data: A complete request from the client
+ * @len: The length of the request
+ *
+ * Looks at a request on its way to the server. Every request must be
+ * passed through the cache in order.
+ *
+ * Returns: TRUE if the cache answered the request, in which case it
+ *	    must not be forwarded to the server
+ */
+gboolean
+xgen_atom_cache_handle_request (XGenAtomCache *cache,
+				const guint8 *data,
+				gsize len)
+{
+  const XGenRequest *request =
+    xgen_dispatch_lookup_request (cache->dispatch, data, len);
+  gboolean answered = FALSE;
+
+  cache->client_sequence++;
+
+  if (request == cache->intern_atom)
+    {
+      cache->stats.n_requests++;
+      answered = handle_intern_atom (cache, data, len);
+    }
+  else if (request == cache->get_atom_name)
+    {
+      cache->stats.n_requests++;
+      answered = handle_get_atom_name (cache, data, len);
+    }
+
+  if (answered)
+    {
+      cache->stats.n_hits++;
+      return TRUE;
+    }
+
+  forward (cache, request);
+  return FALSE;
+}
+
+static void
+free_lookup (Lookup *lookup)
+{
+  g_free (lookup->name);
+  g_free (lookup);
+}
+
+/* Learns from the reply to a forwarded InternAtom or GetAtomName */
+static void
+learn (XGenAtomCache *cache,
+       guint64 sequence,
+       const guint8 *data,
+       gsize len)
+{
+  const Offsets *offsets = &cache->offsets;
+  Lookup *lookup;
+
+  while ((lookup = g_queue_peek_head (cache->lookups))
+	 && lookup->sequence < sequence)
+    free_lookup (g_queue_pop_head (cache->lookups));
+
+  if (!lookup || lookup->sequence != sequence)
+    return;
+  g_queue_pop_head (cache->lookups);
+
+  if (data[0] == X_REPLY && lookup->name)
+    {
+      if (len >= offsets->intern_reply_atom + 4)
+	add_atom (cache, lookup->name, strlen (lookup->name),
+		  _xgen_read_unsigned (data + offsets->intern_reply_atom, 4,
+				       cache->swap));
+    }
+  else if (data[0] == X_REPLY
+	   && len >= offsets->get_name_reply_name_len + 2)
+    {
+      gsize name_len =
+	_xgen_read_unsigned (data + offsets->get_name_reply_name_len, 2,
+			     cache->swap);
+
+      if (len >= offsets->get_name_reply_name + name_len)
+	add_atom (cache, (const char *)data + offsets->get_name_reply_name,
+		  name_len, lookup->atom);
+    }
+
+  free_lookup (lookup);
+}
+
+/* Maps a server sequence number to the client's numbering */
+static guint64
+map_sequence (XGenAtomCache *cache, guint64 sequence)
+{
+  Mapping *mapping;
+
+  /* Messages come in sequence order so older mappings can go */
+  while (g_queue_get_length (cache->mappings) > 1
+	 && ((Mapping *)g_queue_peek_nth (cache->mappings, 1))->server
+	    <= sequence)
+    g_free (g_queue_pop_head (cache->mappings));
+
+  mapping = g_queue_peek_head (cache->mappings);
+  return mapping->client + (sequence - mapping->server);
+}
+
+static void
+set_completed (XGenAtomCache *cache, guint64 sequence)
+{
+  if (sequence > cache->completed)
+    cache->completed = sequence;
+  release_held (cache);
+}
+
+/**
+ * xgen_atom_cache_handle_message:
+ * @cache: An atom cache
+ * @data: A complete reply, error or event from the server, which is
+ *	  modified
+ * @len: The length of the message
+ *
+ * Learns from a message on its way to the client and passes it on with
+ * its sequence number rewritten, along with any synthesised replies that
+ * were waiting for it.
+ */
+void
+xgen_atom_cache_handle_message (XGenAtomCache *cache,
+				guint8 *data,
+				gsize len)
+{
+  guint64 sequence;
+  guint64 client_sequence;
+  gboolean is_response;
+
+  if (len < MESSAGE_SIZE || (data[0] & 0x7f) == X_KEYMAP_NOTIFY)
+    {
+      emit (cache, data, len);
+      return;
+    }
+
+  /* The server is never more than 65535 requests behind */
+  sequence = cache->server_sequence
+    - (guint16)(cache->server_sequence
+		- _xgen_read_unsigned (data + 2, 2, cache->swap));
+  is_response = data[0] == X_ERROR || data[0] == X_REPLY;
+
+  /* Anything about a request means those before it are finished */
+  if (sequence > 0)
+    set_completed (cache, sequence - 1);
+
+  if (is_response)
+    learn (cache, sequence, data, len);
+
+  /* Events don't go back before the last reply passed on */
+  client_sequence = map_sequence (cache, sequence);
+  if (!is_response)
+    client_sequence = MAX (client_sequence, cache->last_emitted);
+  cache->last_emitted = client_sequence;
+  _xgen_write_unsigned (data + 2, 2, client_sequence, cache->swap);
+
+  emit (cache, data, len);
+
+  if (is_response
+      && !(data[0] == X_REPLY && sequence == cache->multi_reply_sequence))
+    set_completed (cache, sequence);
+}
+
+const XGenAtomCacheStats *
+xgen_atom_cache_get_stats (XGenAtomCache *cache)
+{
+  return &cache->stats;
+}
+
+void
+xgen_atom_cache_free (XGenAtomCache *cache)
+{
+  Lookup *lookup;
+
+  while (!g_queue_is_empty (cache->mappings))
+    g_free (g_queue_pop_head (cache->mappings));
+  g_queue_free (cache->mappings);
+  while ((lookup = g_queue_pop_head (cache->lookups)))
+    free_lookup (lookup);
+  g_queue_free (cache->lookups);
+  while (!g_queue_is_empty (cache->held))
+    g_free (g_queue_pop_head (cache->held));
+  g_queue_free (cache->held);
+
+  g_hash_table_destroy (cache->atoms);
+  g_hash_table_destroy (cache->names);
+  g_free (cache);
+}
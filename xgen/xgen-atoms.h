@@ -0,0 +1,59 @@
+#ifndef _XGEN_ATOMS_H_
+#define _XGEN_ATOMS_H_
+
+#include <xgen.h>
+#include <xgen-dispatch.h>
+
+#include <glib.h>
+
+/**
+ * Answers repeated InternAtom and GetAtomName requests on behalf of the
+ * server, for a proxy between a client and a server.
+ *
+ * Atoms never change once interned, so the cache learns the mapping
+ * between names and atoms from the server's replies. Every request from
+ * the client and every message from the server is passed through the
+ * cache. Requests it can answer aren't forwarded; the cache synthesises
+ * their replies instead. The sequence numbers of the server's messages
+ * are rewritten to account for the requests the server never saw.
+ *
+ * Replies must reach the client in request order. A synthesised reply is
+ * therefore held back until the server has answered the request before
+ * it. If that request has no reply and might still fail, the request is
+ * forwarded anyway.
+ */
+typedef struct _XGenAtomCacheStats
+{
+  guint64 n_requests; /* InternAtom and GetAtomName requests seen */
+  guint64 n_hits;     /* Requests answered locally: round trips saved */
+  guint64 n_unsafe;   /* Requests that could have been answered but were
+			 forwarded to keep the replies in order */
+  guint64 n_atoms;    /* Atoms learned */
+} XGenAtomCacheStats;
+
+/**
+ * Called with each message for the client, in order: the server's
+ * messages with their sequence numbers rewritten and synthesised
+ * replies.
+ */
+typedef void (*XGenAtomCacheFunc) (const guint8 *data,
+				   gsize len,
+				   void *user_data);
+
+typedef struct _XGenAtomCache XGenAtomCache;
+
+XGenAtomCache *xgen_atom_cache_new (const XGenState *state,
+				    const XGenDispatch *dispatch,
+				    XGenByteOrder byte_order,
+				    XGenAtomCacheFunc func,
+				    void *user_data);
+gboolean xgen_atom_cache_handle_request (XGenAtomCache *cache,
+					 const guint8 *data,
+					 gsize len);
+void xgen_atom_cache_handle_message (XGenAtomCache *cache,
+				     guint8 *data,
+				     gsize len);
+const XGenAtomCacheStats *xgen_atom_cache_get_stats (XGenAtomCache *cache);
+void xgen_atom_cache_free (XGenAtomCache *cache);
+
+#endif /* _XGEN_ATOMS_H_ */
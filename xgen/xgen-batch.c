@@ -0,0 +1,349 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-batch.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+#if defined(__AVX2__) && defined(__x86_64__)
+#include <immintrin.h>
+#define USE_AVX2_GATHER 1
+#endif
+
+static inline void
+store_value (void *column_data, guint width, guint row, guint32 value)
+{
+  switch (width)
+    {
+    case 1:
+      ((guint8 *)column_data)[row] = value;
+      break;
+    case 2:
+      ((guint16 *)column_data)[row] = value;
+      break;
+    case 4:
+      ((guint32 *)column_data)[row] = value;
+      break;
+    }
+}
+
+/* Rows too short for the field are left as 0 */
+static void
+extract_column (const guint8 * const *messages,
+		const gsize *lengths,
+		guint first,
+		guint n_messages,
+		guint offset,
+		guint width,
+		gboolean swap,
+		void *column_data)
+{
+  guint i;
+
+  for (i = first; i < n_messages; i++)
+    if (lengths[i] >= offset + width)
+      store_value (column_data, width, i,
+		   _xgen_read_unsigned (messages[i] + offset, width, swap));
+}
+
+#ifdef USE_AVX2_GATHER
+/* Gathers a 32bit word at the same offset from 4 messages at a time,
+ * then swaps and narrows it to the field width with a single shuffle.
+ * The caller has to ensure that offset + 4 is within every message */
+static guint
+gather_column_avx2 (const guint8 * const *messages,
+		    guint n_messages,
+		    guint offset,
+		    guint width,
+		    gboolean swap,
+		    void *column_data)
+{
+  const int *base = (const int *)(gsize)offset;
+  __m128i shuffle;
+  guint i;
+
+  switch (width)
+    {
+    case 1:
+      shuffle = _mm_setr_epi8 (0, 4, 8, 12, -1, -1, -1, -1,
+			       -1, -1, -1, -1, -1, -1, -1, -1);
+      break;
+    case 2:
+      shuffle = swap
+	? _mm_setr_epi8 (1, 0, 5, 4, 9, 8, 13, 12,
+			 -1, -1, -1, -1, -1, -1, -1, -1)
+	: _mm_setr_epi8 (0, 1, 4, 5, 8, 9, 12, 13,
+			 -1, -1, -1, -1, -1, -1, -1, -1);
+      break;
+    default:
+      shuffle = swap
+	? _mm_setr_epi8 (3, 2, 1, 0, 7, 6, 5, 4,
+			 11, 10, 9, 8, 15, 14, 13, 12)
+	: _mm_setr_epi8 (0, 1, 2, 3, 4, 5, 6, 7,
+			 8, 9, 10, 11, 12, 13, 14, 15);
+      break;
+    }
+
+  for (i = 0; i + 4 <= n_messages; i += 4)
+    {
+      __m256i addresses =
+	_mm256_loadu_si256 ((const __m256i *)(messages + i));
+      __m128i values = _mm256_i64gather_epi32 (base, addresses, 1);
+
+      values = _mm_shuffle_epi8 (values, shuffle);
+
+      switch (width)
+	{
+	case 1:
+	  {
+	    guint32 packed = _mm_cvtsi128_si32 (values);
+	    memcpy ((guint8 *)column_data + i, &packed, 4);
+	    break;
+	  }
+	case 2:
+	  _mm_storel_epi64 ((__m128i *)((guint16 *)column_data + i), values);
+	  break;
+	default:
+	  _mm_storeu_si128 ((__m128i *)((guint32 *)column_data + i), values);
+	  break;
+	}
+    }
+
+  return i;
+}
+#endif
+
+/* @min_length is the length of the shortest message */
+static void
+gather_column (const guint8 * const *messages,
+	       const gsize *lengths,
+	       gsize min_length,
+	       guint n_messages,
+	       guint offset,
+	       guint width,
+	       gboolean swap,
+	       void *column_data)
+{
+  guint first = 0;
+
+#ifdef USE_AVX2_GATHER
+  if (offset + 4 <= min_length)
+    first = gather_column_avx2 (messages, n_messages, offset, width, swap,
+				column_data);
+#endif
+
+  extract_column (messages, lengths, first, n_messages, offset, width, swap,
+		  column_data);
+}
+
+static void
+clear_row (XGenBatch *batch, guint row)
+{
+  guint i;
+
+  for (i = 0; i < batch->n_columns; i++)
+    store_value (batch->columns[i].data, batch->columns[i].width, row, 0);
+}
+
+/* Re-extracts the columns of one row by walking the message. This is
+ * used for fields that follow a variable length field and for requests
+ * using the BIG-REQUESTS form, where the fixed offsets don't apply */
+static gboolean
+walk_row (XGenBatch *batch,
+	  const guint8 *message,
+	  gsize length,
+	  guint row,
+	  guint n_fields,
+	  gboolean all_columns,
+	  XGenByteOrder byte_order)
+{
+  const XGenLayout *layout = batch->layout;
+  XGenFieldExtent *extents = g_newa (XGenFieldExtent, n_fields);
+  gboolean swap = _XGEN_NEEDS_SWAP (byte_order);
+  gsize len;
+  guint i;
+
+  /* Fields have to lie within both the length the header gives and the
+   * bytes the caller has */
+  len = xgen_layout_get_message_length (layout, message, length,
+					byte_order);
+  if (!len
+      || len > length
+      || !xgen_layout_get_extents (layout, message, len, byte_order,
+				   n_fields, extents))
+    {
+      clear_row (batch, row);
+      return FALSE;
+    }
+
+  for (i = 0; i < batch->n_columns; i++)
+    {
+      XGenColumn *column = &batch->columns[i];
+      guint index = column->field - layout->fields;
+
+      if (!all_columns
+	  && column->field->offset != XGEN_LAYOUT_VARIABLE_OFFSET)
+	continue;
+
+      store_value (column->data, column->width, row,
+		   _xgen_read_unsigned (message + extents[index].offset,
+					column->width, swap));
+    }
+
+  return TRUE;
+}
+
+/**
+ * xgen_batch_decode:
+ * @layout: The layout shared by all the messages
+ * @messages: An array of @n_messages pointers to complete raw messages
+ * @lengths: The number of bytes available at each of @messages
+ * @n_messages: The number of messages
+ * @byte_order: The byte order of the messages
+ *
+ * Decodes the scalar fields of many messages of the same definition into
+ * columns, so that analysis like following pointer motion paths can run
+ * over contiguous arrays instead of per-message field lists. Fields at a
+ * fixed offset are extracted a column at a time (using AVX2 gathers when
+ * available); only fields that follow a variable length field require
+ * walking each message. Rows whose fields don't all lie within their
+ * length are marked invalid.
+ *
+ * The batch should be freed with xgen_batch_free().
+ */
+XGenBatch *
+xgen_batch_decode (const XGenLayout *layout,
+		   const guint8 * const *messages,
+		   const gsize *lengths,
+		   guint n_messages,
+		   XGenByteOrder byte_order)
+{
+  XGenBatch *batch = g_new0 (XGenBatch, 1);
+  gboolean swap = _XGEN_NEEDS_SWAP (byte_order);
+  gsize min_length = G_MAXSIZE;
+  guint n_walk_fields = 0;
+  guint i, j;
+
+  batch->layout = layout;
+  batch->n_rows = n_messages;
+
+  for (i = 0; i < n_messages; i++)
+    min_length = MIN (min_length, lengths[i]);
+
+  for (i = 0; i < layout->n_fields; i++)
+    {
+      const XGenFieldLayout *field_layout = &layout->fields[i];
+      if (field_layout->kind == XGEN_LAYOUT_SCALAR
+	  && (field_layout->size == 1 || field_layout->size == 2
+	      || field_layout->size == 4))
+	batch->n_columns++;
+    }
+
+  batch->columns = g_new0 (XGenColumn, batch->n_columns);
+  batch->valid = g_malloc (n_messages);
+  memset (batch->valid, TRUE, n_messages);
+
+  for (i = 0, j = 0; i < layout->n_fields; i++)
+    {
+      const XGenFieldLayout *field_layout = &layout->fields[i];
+      XGenColumn *column;
+
+      if (field_layout->kind != XGEN_LAYOUT_SCALAR
+	  || (field_layout->size != 1 && field_layout->size != 2
+	      && field_layout->size != 4))
+	continue;
+
+      column = &batch->columns[j++];
+      column->field = field_layout;
+      column->width = field_layout->size;
+      column->is_signed = field_layout->type->type == XGEN_SIGNED;
+      column->data = g_malloc0 (MAX (n_messages, 1) * column->width);
+
+      if (field_layout->offset == XGEN_LAYOUT_VARIABLE_OFFSET)
+	{
+	  n_walk_fields = i + 1;
+	  continue;
+	}
+
+      gather_column (messages, lengths, min_length, n_messages,
+		     field_layout->offset, column->width, swap,
+		     column->data);
+    }
+
+  for (i = 0; i < n_messages; i++)
+    {
+      const guint8 *message = messages[i];
+      gsize len = lengths[i] < layout->fixed_size ? 0
+	: xgen_layout_get_message_length (layout, message, lengths[i],
+					  byte_order);
+      gboolean big_request;
+
+      /* The fixed fields were extracted without looking at the length
+       * the header gives */
+      if (len < layout->fixed_size || len > lengths[i])
+	{
+	  clear_row (batch, i);
+	  batch->valid[i] = FALSE;
+	  continue;
+	}
+
+      big_request = layout->definition->type == XGEN_REQUEST
+	&& message[2] == 0 && message[3] == 0;
+      if (big_request)
+	batch->valid[i] = walk_row (batch, message, lengths[i], i,
+				    layout->n_fields, TRUE, byte_order);
+      else if (n_walk_fields)
+	batch->valid[i] = walk_row (batch, message, lengths[i], i,
+				    n_walk_fields, FALSE, byte_order);
+    }
+
+  return batch;
+}
+
+/**
+ * xgen_batch_get_column:
+ * @batch: A batch
+ * @field_name: The name of a scalar field
+ *
+ * This function returns the column for the named field or NULL if there
+ * is no such scalar field.
+ */
+const XGenColumn *
+xgen_batch_get_column (const XGenBatch *batch, const char *field_name)
+{
+  guint i;
+
+  for (i = 0; i < batch->n_columns; i++)
+    if (strcmp (batch->columns[i].field->field->name, field_name) == 0)
+      return &batch->columns[i];
+  return NULL;
+}
+
+void
+xgen_batch_free (XGenBatch *batch)
+{
+  guint i;
+
+  for (i = 0; i < batch->n_columns; i++)
+    g_free (batch->columns[i].data);
+  g_free (batch->columns);
+  g_free (batch->valid);
+  g_free (batch);
+}
@@ -0,0 +1,54 @@
+#ifndef _XGEN_BATCH_H_
+#define _XGEN_BATCH_H_
+
+#include <xgen.h>
+#include <xgen-layout.h>
+
+#include <glib.h>
+
+/**
+ * One decoded field across every message of a batch, stored in the
+ * field's native width and host byte order.
+ */
+typedef struct _XGenColumn
+{
+  const XGenFieldLayout *field;
+  guint			 width;	    /* 1, 2 or 4 bytes per row */
+  gboolean		 is_signed;
+  void			*data;	    /* n_rows values, each width bytes */
+} XGenColumn;
+
+#define XGEN_COLUMN_UINT8(COLUMN)  ((const guint8 *)(COLUMN)->data)
+#define XGEN_COLUMN_INT8(COLUMN)   ((const gint8 *)(COLUMN)->data)
+#define XGEN_COLUMN_UINT16(COLUMN) ((const guint16 *)(COLUMN)->data)
+#define XGEN_COLUMN_INT16(COLUMN)  ((const gint16 *)(COLUMN)->data)
+#define XGEN_COLUMN_UINT32(COLUMN) ((const guint32 *)(COLUMN)->data)
+#define XGEN_COLUMN_INT32(COLUMN)  ((const gint32 *)(COLUMN)->data)
+
+/**
+ * A struct-of-arrays decoding of many messages of the same definition.
+ * There is one column per scalar field; lists and inline structs aren't
+ * decoded.
+ */
+typedef struct _XGenBatch
+{
+  const XGenLayout *layout;
+  guint		    n_rows;
+  guint		    n_columns;
+  XGenColumn	   *columns;
+  guint8	   *valid;     /* Per row; FALSE if the message was
+				  truncated or malformed so that some of
+				  its fields couldn't be found. The values
+				  for such rows are 0. */
+} XGenBatch;
+
+XGenBatch *xgen_batch_decode (const XGenLayout *layout,
+			      const guint8 * const *messages,
+			      const gsize *lengths,
+			      guint n_messages,
+			      XGenByteOrder byte_order);
+const XGenColumn *xgen_batch_get_column (const XGenBatch *batch,
+					 const char *field_name);
+void xgen_batch_free (XGenBatch *batch);
+
+#endif /* _XGEN_BATCH_H_ */
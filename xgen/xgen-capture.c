@@ -0,0 +1,1077 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-capture.h>
+
+#include <glib.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_MAX_SEGMENT_SIZE (64 * 1024 * 1024)
+#define WRITE_BUFFER_SIZE (256 * 1024)
+
+#define ALIGN8(X) (((X) + 7) & ~7)
+
+typedef struct _CaptureDefinition
+{
+  const XGenDefinition *definition;
+  GArray *entries;
+} CaptureDefinition;
+
+struct _XGenCaptureWriter
+{
+  int	       fd;
+  gsize	       max_segment_size;
+
+  /* Data that has been appended but not yet written to fd */
+  GByteArray  *buffer;
+
+  /* State for the segment currently being written */
+  gboolean     segment_open;
+  guint64      segment_start; /* file offset */
+  guint32      segment_pos;   /* bytes written so far, including buffer */
+  guint32      index_size;    /* bytes the footer will add to the segment */
+  guint32      n_records;
+  guint64      min_timestamp;
+  guint64      max_timestamp;
+  GArray      *sequence_index;
+  GArray      *time_index;
+  GArray      *definitions;
+  GHashTable  *definition_ids; /* XGenDefinition * -> index + 1 */
+};
+
+typedef struct _CaptureSegment
+{
+  const guint8		  *base;
+  const XGenCaptureFooter *footer;
+  guint32		   records_end; /* The records end where the footer
+					   starts */
+} CaptureSegment;
+
+struct _XGenCapture
+{
+  int	   fd;
+  guint8  *map;
+  gsize	   size;
+  GArray  *segments;
+};
+
+
+static gboolean
+write_all (int fd, const guint8 *data, gsize len)
+{
+  while (len)
+    {
+      ssize_t written = write (fd, data, len);
+      if (written < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  g_warning ("Failed to write capture data: %s", strerror (errno));
+	  return FALSE;
+	}
+      data += written;
+      len -= written;
+    }
+  return TRUE;
+}
+
+static gboolean
+flush_buffer (XGenCaptureWriter *writer)
+{
+  gboolean status = write_all (writer->fd,
+			       writer->buffer->data,
+			       writer->buffer->len);
+  g_byte_array_set_size (writer->buffer, 0);
+  return status;
+}
+
+static void
+buffer_append (XGenCaptureWriter *writer, const void *data, guint len)
+{
+  g_byte_array_append (writer->buffer, data, len);
+  writer->segment_pos += len;
+}
+
+static void
+buffer_pad (XGenCaptureWriter *writer)
+{
+  static const guint8 zeros[8] = { 0, };
+  guint pad = ALIGN8 (writer->segment_pos) - writer->segment_pos;
+
+  if (pad)
+    buffer_append (writer, zeros, pad);
+}
+
+static gint
+index_entry_compare (gconstpointer a, gconstpointer b)
+{
+  const XGenCaptureIndexEntry *entry0 = a;
+  const XGenCaptureIndexEntry *entry1 = b;
+
+  if (entry0->key != entry1->key)
+    return entry0->key < entry1->key ? -1 : 1;
+  if (entry0->record != entry1->record)
+    return entry0->record < entry1->record ? -1 : 1;
+  return 0;
+}
+
+static void
+begin_segment (XGenCaptureWriter *writer)
+{
+  XGenCaptureSegmentHeader header;
+
+  header.magic = XGEN_CAPTURE_SEGMENT_MAGIC;
+  header.byte_order = XGEN_CAPTURE_BYTE_ORDER;
+  header.size = 0;
+
+  writer->segment_pos = 0;
+  buffer_append (writer, &header, sizeof (header));
+
+  /* The string table is padded by up to 7 bytes */
+  writer->index_size =
+    sizeof (XGenCaptureFooter) + sizeof (XGenCaptureTrailer) + 7;
+
+  writer->n_records = 0;
+  writer->min_timestamp = G_MAXUINT64;
+  writer->max_timestamp = 0;
+  writer->segment_open = TRUE;
+}
+
+/**
+ * xgen_capture_writer_new:
+ * @filename: The capture file to create
+ *
+ * Creates a new capture file, truncating any existing file of the same
+ * name. Messages are appended with xgen_capture_writer_append() and are
+ * grouped into segments, each with its own footer index.
+ *
+ * This function returns NULL if the file couldn't be created.
+ */
+XGenCaptureWriter *
+xgen_capture_writer_new (const char *filename)
+{
+  XGenCaptureWriter *writer;
+  int fd;
+
+  fd = open (filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    {
+      g_warning ("Failed to create capture file %s: %s",
+		 filename, strerror (errno));
+      return NULL;
+    }
+
+  writer = g_new0 (XGenCaptureWriter, 1);
+  writer->fd = fd;
+  writer->max_segment_size = DEFAULT_MAX_SEGMENT_SIZE;
+  writer->buffer = g_byte_array_sized_new (WRITE_BUFFER_SIZE);
+  writer->sequence_index =
+    g_array_new (FALSE, FALSE, sizeof (XGenCaptureIndexEntry));
+  writer->time_index =
+    g_array_new (FALSE, FALSE, sizeof (XGenCaptureIndexEntry));
+  writer->definitions =
+    g_array_new (FALSE, FALSE, sizeof (CaptureDefinition));
+  writer->definition_ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  return writer;
+}
+
+/**
+ * xgen_capture_writer_set_max_segment_size:
+ * @writer: A capture writer
+ * @max_segment_size: The size in bytes, including the footer indices,
+ *		      that a segment is kept under.
+ *
+ * Segments are the unit that readers index and that tools can skip over
+ * wholesale, so smaller segments trade a little footer overhead for
+ * finer grained time ranges. Since offsets within a segment are 32bit
+ * the size is clamped to 2GB. A segment only exceeds the size if its
+ * first record alone doesn't fit.
+ */
+void
+xgen_capture_writer_set_max_segment_size (XGenCaptureWriter *writer,
+					  gsize max_segment_size)
+{
+  writer->max_segment_size = CLAMP (max_segment_size, 4096, G_MAXINT32);
+}
+
+static guint16
+lookup_definition_id (XGenCaptureWriter *writer,
+		      const XGenDefinition *definition)
+{
+  CaptureDefinition capture_def;
+  guint id;
+
+  if (!definition)
+    return XGEN_CAPTURE_NO_DEFINITION;
+
+  id = GPOINTER_TO_UINT (g_hash_table_lookup (writer->definition_ids,
+					      definition));
+  if (id)
+    return id - 1;
+
+  if (writer->definitions->len >= XGEN_CAPTURE_NO_DEFINITION)
+    return XGEN_CAPTURE_NO_DEFINITION;
+
+  capture_def.definition = definition;
+  capture_def.entries =
+    g_array_new (FALSE, FALSE, sizeof (XGenCaptureIndexEntry));
+  g_array_append_val (writer->definitions, capture_def);
+
+  id = writer->definitions->len;
+  g_hash_table_insert (writer->definition_ids,
+		       (XGenDefinition *)definition,
+		       GUINT_TO_POINTER (id));
+  return id - 1;
+}
+
+/* Returns how many bytes the footer of the current segment grows by when
+ * a message of @definition is appended */
+static guint32
+get_index_size (XGenCaptureWriter *writer,
+		const XGenDefinition *definition)
+{
+  /* An entry in the sequence and time indices */
+  guint32 size = 2 * sizeof (XGenCaptureIndexEntry);
+
+  if (!definition)
+    return size;
+
+  size += sizeof (XGenCaptureIndexEntry);
+  if (!g_hash_table_lookup (writer->definition_ids, definition))
+    size += sizeof (XGenCaptureDefinitionEntry)
+      + strlen (definition->extension->header) + 1
+      + strlen (definition->name) + 1;
+  return size;
+}
+
+/**
+ * xgen_capture_writer_append:
+ * @writer: A capture writer
+ * @timestamp: The time the message was seen, in whatever units the
+ *	       tracer uses consistently (typically microseconds)
+ * @direction: Whether the message was sent by the client or the server
+ * @sequence: The full 64bit sequence number associated with the message
+ * @definition: The definition of the message if known, or NULL
+ * @data: The raw message
+ * @length: The length of @data in bytes
+ *
+ * Appends one raw message to the current segment. This only copies the
+ * message into a write buffer and updates the in-memory indices; the
+ * indices are sorted and written out when the segment is finished.
+ *
+ * This function returns FALSE if writing to the capture file failed.
+ */
+gboolean
+xgen_capture_writer_append (XGenCaptureWriter *writer,
+			    guint64 timestamp,
+			    XGenDirection direction,
+			    guint64 sequence,
+			    const XGenDefinition *definition,
+			    const guint8 *data,
+			    guint32 length)
+{
+  XGenCaptureRecord record;
+  XGenCaptureIndexEntry entry;
+  guint64 record_size = sizeof (XGenCaptureRecord) + ALIGN8 (length);
+  guint32 index_size;
+  guint16 id;
+
+  /* Records and indices are addressed by 32bit offsets into the segment
+   * so even a segment of its own must stay within that */
+  if (record_size > G_MAXINT32)
+    {
+      g_warning ("Capture message of %u bytes is too large", length);
+      return FALSE;
+    }
+
+  if (writer->segment_open
+      && writer->n_records
+      && ((guint64)writer->segment_pos + writer->index_size + record_size
+	  + get_index_size (writer, definition)
+	  > writer->max_segment_size))
+    {
+      if (!xgen_capture_writer_finish_segment (writer))
+	return FALSE;
+    }
+
+  if (!writer->segment_open)
+    begin_segment (writer);
+
+  index_size = get_index_size (writer, definition);
+  id = lookup_definition_id (writer, definition);
+
+  record.sequence = sequence;
+  record.timestamp = timestamp;
+  record.length = length;
+  record.definition = id;
+  record.direction = direction;
+  record._pad = 0;
+
+  entry.record = writer->segment_pos;
+  entry._pad = 0;
+
+  buffer_append (writer, &record, sizeof (record));
+  buffer_append (writer, data, length);
+  buffer_pad (writer);
+
+  entry.key = sequence;
+  g_array_append_val (writer->sequence_index, entry);
+  entry.key = timestamp;
+  g_array_append_val (writer->time_index, entry);
+  if (id != XGEN_CAPTURE_NO_DEFINITION)
+    {
+      CaptureDefinition *capture_def =
+	&g_array_index (writer->definitions, CaptureDefinition, id);
+      g_array_append_val (capture_def->entries, entry);
+    }
+
+  writer->n_records++;
+  writer->index_size += index_size;
+  writer->min_timestamp = MIN (writer->min_timestamp, timestamp);
+  writer->max_timestamp = MAX (writer->max_timestamp, timestamp);
+
+  if (writer->buffer->len >= WRITE_BUFFER_SIZE)
+    return flush_buffer (writer);
+
+  return TRUE;
+}
+
+/**
+ * xgen_capture_writer_finish_segment:
+ * @writer: A capture writer
+ *
+ * Writes the footer indices for the current segment and makes it
+ * visible to readers. Subsequent appends will start a new segment. This
+ * is called automatically when a segment reaches the maximum segment
+ * size, but a tracer may also call it periodically so that a live
+ * capture can be inspected.
+ *
+ * This function returns FALSE if writing to the capture file failed.
+ */
+gboolean
+xgen_capture_writer_finish_segment (XGenCaptureWriter *writer)
+{
+  XGenCaptureFooter footer;
+  XGenCaptureTrailer trailer;
+  GArray *definition_table;
+  GArray *definition_index;
+  GByteArray *strings;
+  guint64 size;
+  guint32 pos;
+  guint i;
+
+  if (!writer->segment_open)
+    return TRUE;
+
+  /* Records are appended roughly in time order, but for instance replies
+   * share the sequence number of their request so we have to sort. */
+  g_array_sort (writer->sequence_index, index_entry_compare);
+  g_array_sort (writer->time_index, index_entry_compare);
+
+  definition_table =
+    g_array_sized_new (FALSE, FALSE, sizeof (XGenCaptureDefinitionEntry),
+		       writer->definitions->len);
+  definition_index =
+    g_array_sized_new (FALSE, FALSE, sizeof (XGenCaptureIndexEntry),
+		       writer->n_records);
+  strings = g_byte_array_new ();
+
+  for (i = 0; i < writer->definitions->len; i++)
+    {
+      CaptureDefinition *capture_def =
+	&g_array_index (writer->definitions, CaptureDefinition, i);
+      const XGenDefinition *def = capture_def->definition;
+      XGenCaptureDefinitionEntry table_entry;
+      char *name;
+
+      name = g_strdup_printf ("%s:%s", def->extension->header, def->name);
+
+      memset (&table_entry, 0, sizeof (table_entry));
+      table_entry.name = strings->len;
+      table_entry.first = definition_index->len;
+      table_entry.n_entries = capture_def->entries->len;
+      table_entry.type = def->type;
+      g_array_append_val (definition_table, table_entry);
+
+      g_byte_array_append (strings, (guint8 *)name, strlen (name) + 1);
+      g_free (name);
+
+      g_array_sort (capture_def->entries, index_entry_compare);
+      g_array_append_vals (definition_index,
+			   capture_def->entries->data,
+			   capture_def->entries->len);
+      g_array_free (capture_def->entries, TRUE);
+    }
+  g_byte_array_set_size (strings, ALIGN8 (strings->len));
+
+  pos = writer->segment_pos + sizeof (XGenCaptureFooter);
+
+  memset (&footer, 0, sizeof (footer));
+  footer.min_timestamp = writer->n_records ? writer->min_timestamp : 0;
+  footer.max_timestamp = writer->max_timestamp;
+  footer.n_records = writer->n_records;
+  footer.n_definitions = definition_table->len;
+  footer.sequence_index = pos;
+  pos += writer->n_records * sizeof (XGenCaptureIndexEntry);
+  footer.time_index = pos;
+  pos += writer->n_records * sizeof (XGenCaptureIndexEntry);
+  footer.definition_table = pos;
+  pos += definition_table->len * sizeof (XGenCaptureDefinitionEntry);
+  footer.definition_index = pos;
+  pos += definition_index->len * sizeof (XGenCaptureIndexEntry);
+  footer.strings = pos;
+  footer.strings_size = strings->len;
+
+  trailer.magic = XGEN_CAPTURE_TRAILER_MAGIC;
+  trailer.footer = writer->segment_pos;
+
+  buffer_append (writer, &footer, sizeof (footer));
+  buffer_append (writer, writer->sequence_index->data,
+		 writer->sequence_index->len * sizeof (XGenCaptureIndexEntry));
+  buffer_append (writer, writer->time_index->data,
+		 writer->time_index->len * sizeof (XGenCaptureIndexEntry));
+  buffer_append (writer, definition_table->data,
+		 definition_table->len * sizeof (XGenCaptureDefinitionEntry));
+  buffer_append (writer, definition_index->data,
+		 definition_index->len * sizeof (XGenCaptureIndexEntry));
+  buffer_append (writer, strings->data, strings->len);
+
+  trailer.segment_size = writer->segment_pos + sizeof (trailer);
+  buffer_append (writer, &trailer, sizeof (trailer));
+
+  g_array_free (definition_table, TRUE);
+  g_array_free (definition_index, TRUE);
+  g_byte_array_free (strings, TRUE);
+
+  g_array_set_size (writer->sequence_index, 0);
+  g_array_set_size (writer->time_index, 0);
+  g_array_set_size (writer->definitions, 0);
+  g_hash_table_remove_all (writer->definition_ids);
+  writer->segment_open = FALSE;
+
+  if (!flush_buffer (writer))
+    return FALSE;
+
+  /* Only once everything else has hit the file do we fill in the size in
+   * the segment header, so a reader never sees a partial segment as
+   * complete. */
+  size = trailer.segment_size;
+  if (pwrite (writer->fd, &size, sizeof (size),
+	      writer->segment_start
+	      + offsetof (XGenCaptureSegmentHeader, size)) != sizeof (size))
+    {
+      g_warning ("Failed to finish capture segment: %s", strerror (errno));
+      return FALSE;
+    }
+
+  writer->segment_start += size;
+
+  return TRUE;
+}
+
+/**
+ * xgen_capture_writer_close:
+ * @writer: A capture writer
+ *
+ * Finishes the current segment, closes the capture file and frees the
+ * writer.
+ *
+ * This function returns FALSE if writing to the capture file failed.
+ */
+gboolean
+xgen_capture_writer_close (XGenCaptureWriter *writer)
+{
+  gboolean status = xgen_capture_writer_finish_segment (writer);
+
+  if (close (writer->fd) < 0)
+    status = FALSE;
+
+  g_byte_array_free (writer->buffer, TRUE);
+  g_array_free (writer->sequence_index, TRUE);
+  g_array_free (writer->time_index, TRUE);
+  g_array_free (writer->definitions, TRUE);
+  g_hash_table_destroy (writer->definition_ids);
+  g_free (writer);
+
+  return status;
+}
+
+static gboolean
+validate_index (guint32 offset, guint64 n_entries, gsize entry_size,
+		guint64 end)
+{
+  return offset % 8 == 0 && offset + n_entries * entry_size <= end;
+}
+
+static gboolean
+validate_segment (const guint8 *base, guint64 size)
+{
+  const XGenCaptureTrailer *trailer;
+  const XGenCaptureFooter *footer;
+  guint64 end;
+
+  if (size < sizeof (XGenCaptureSegmentHeader) + sizeof (XGenCaptureFooter)
+	     + sizeof (XGenCaptureTrailer))
+    return FALSE;
+
+  trailer = (const XGenCaptureTrailer *)
+    (base + size - sizeof (XGenCaptureTrailer));
+  if (trailer->magic != XGEN_CAPTURE_TRAILER_MAGIC
+      || trailer->segment_size != size
+      || trailer->footer % 8 != 0
+      || trailer->footer < sizeof (XGenCaptureSegmentHeader)
+      || trailer->footer + sizeof (XGenCaptureFooter)
+	 + sizeof (XGenCaptureTrailer) > size)
+    return FALSE;
+
+  footer = (const XGenCaptureFooter *)(base + trailer->footer);
+  end = size - sizeof (XGenCaptureTrailer);
+
+  /* Each record needs at least a header */
+  if ((guint64)footer->n_records * sizeof (XGenCaptureRecord)
+      > trailer->footer - sizeof (XGenCaptureSegmentHeader))
+    return FALSE;
+
+  /* The definition index is only bounded by the string table that
+   * follows it; the entries of each definition are checked against
+   * that when they are used. */
+  if (!validate_index (footer->sequence_index, footer->n_records,
+		       sizeof (XGenCaptureIndexEntry), end)
+      || !validate_index (footer->time_index, footer->n_records,
+			  sizeof (XGenCaptureIndexEntry), end)
+      || !validate_index (footer->definition_table, footer->n_definitions,
+			  sizeof (XGenCaptureDefinitionEntry), end)
+      || !validate_index (footer->definition_index, 0,
+			  sizeof (XGenCaptureIndexEntry), footer->strings)
+      || (guint64)footer->strings + footer->strings_size > end)
+    return FALSE;
+
+  /* So that every name offset within the table gives a terminated
+   * string */
+  if (footer->strings_size
+      && base[footer->strings + footer->strings_size - 1] != '\0')
+    return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * xgen_capture_open:
+ * @filename: A capture file written by an XGenCaptureWriter
+ *
+ * Maps a capture file into memory so that it can be queried via the
+ * segment indices without reading or scanning the messages. A segment
+ * that a writer hasn't finished yet is ignored.
+ *
+ * This function returns NULL if the file couldn't be opened or isn't a
+ * valid capture.
+ */
+XGenCapture *
+xgen_capture_open (const char *filename)
+{
+  XGenCapture *capture;
+  struct stat buf;
+  guint64 offset;
+  void *map;
+  int fd;
+
+  fd = open (filename, O_RDONLY);
+  if (fd < 0)
+    {
+      g_warning ("Failed to open capture file %s: %s",
+		 filename, strerror (errno));
+      return NULL;
+    }
+
+  if (fstat (fd, &buf) < 0 || buf.st_size == 0)
+    {
+      g_warning ("Failed to open empty capture file %s", filename);
+      close (fd);
+      return NULL;
+    }
+
+  map = mmap (NULL, buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    {
+      g_warning ("Failed to map capture file %s: %s",
+		 filename, strerror (errno));
+      close (fd);
+      return NULL;
+    }
+
+  capture = g_new0 (XGenCapture, 1);
+  capture->fd = fd;
+  capture->map = map;
+  capture->size = buf.st_size;
+  capture->segments = g_array_new (FALSE, FALSE, sizeof (CaptureSegment));
+
+  for (offset = 0;
+       offset + sizeof (XGenCaptureSegmentHeader) <= capture->size;)
+    {
+      const XGenCaptureSegmentHeader *header =
+	(const XGenCaptureSegmentHeader *)(capture->map + offset);
+      const XGenCaptureTrailer *trailer;
+      CaptureSegment segment;
+
+      if (header->magic != XGEN_CAPTURE_SEGMENT_MAGIC)
+	{
+	  g_warning ("Corrupt capture segment in %s at offset %"
+		     G_GUINT64_FORMAT, filename, offset);
+	  break;
+	}
+      if (header->byte_order != XGEN_CAPTURE_BYTE_ORDER)
+	{
+	  g_warning ("Capture %s was written with a different byte order",
+		     filename);
+	  break;
+	}
+      if (header->size == 0 || offset + header->size > capture->size)
+	{
+	  g_warning ("Ignoring unfinished capture segment in %s", filename);
+	  break;
+	}
+      if (!validate_segment (capture->map + offset, header->size))
+	{
+	  g_warning ("Corrupt capture segment index in %s at offset %"
+		     G_GUINT64_FORMAT, filename, offset);
+	  break;
+	}
+
+      trailer = (const XGenCaptureTrailer *)
+	(capture->map + offset + header->size - sizeof (XGenCaptureTrailer));
+
+      segment.base = capture->map + offset;
+      segment.footer =
+	(const XGenCaptureFooter *)(segment.base + trailer->footer);
+      segment.records_end = trailer->footer;
+      g_array_append_val (capture->segments, segment);
+
+      offset += header->size;
+    }
+
+  return capture;
+}
+
+/**
+ * xgen_capture_close:
+ * @capture: A capture opened with xgen_capture_open()
+ *
+ * Unmaps the capture. Any record pointers returned from queries are
+ * invalid after this.
+ */
+void
+xgen_capture_close (XGenCapture *capture)
+{
+  munmap (capture->map, capture->size);
+  close (capture->fd);
+  g_array_free (capture->segments, TRUE);
+  g_free (capture);
+}
+
+guint
+xgen_capture_get_n_segments (XGenCapture *capture)
+{
+  return capture->segments->len;
+}
+
+guint64
+xgen_capture_get_n_records (XGenCapture *capture)
+{
+  guint64 n_records = 0;
+  guint i;
+
+  for (i = 0; i < capture->segments->len; i++)
+    n_records +=
+      g_array_index (capture->segments, CaptureSegment, i).footer->n_records;
+
+  return n_records;
+}
+
+static const XGenCaptureIndexEntry *
+segment_index (const CaptureSegment *segment, guint32 offset)
+{
+  return (const XGenCaptureIndexEntry *)(segment->base + offset);
+}
+
+static const XGenCaptureDefinitionEntry *
+segment_definition_table (const CaptureSegment *segment)
+{
+  return (const XGenCaptureDefinitionEntry *)
+    (segment->base + segment->footer->definition_table);
+}
+
+/**
+ * xgen_capture_get_definitions:
+ * @capture: A capture
+ * @segment: The index of a segment
+ * @n_definitions: Where to store the number of entries
+ *
+ * Gives the definition table of one segment, which the definition
+ * member of the segment's records indexes. This lets a reader tell
+ * definitions of the same name but different types apart, such as a
+ * request and its reply.
+ *
+ * This function returns NULL if @segment is out of range.
+ */
+const XGenCaptureDefinitionEntry *
+xgen_capture_get_definitions (XGenCapture *capture,
+			      guint segment,
+			      guint *n_definitions)
+{
+  const CaptureSegment *capture_segment;
+
+  *n_definitions = 0;
+  if (segment >= capture->segments->len)
+    return NULL;
+
+  capture_segment = &g_array_index (capture->segments, CaptureSegment,
+				    segment);
+  *n_definitions = capture_segment->footer->n_definitions;
+  return segment_definition_table (capture_segment);
+}
+
+/* Returns the record at @offset or NULL if the record header or its
+ * message data would lie outside the records of the segment */
+static const XGenCaptureRecord *
+segment_record (const CaptureSegment *segment, guint32 offset)
+{
+  const XGenCaptureRecord *record;
+
+  if (offset % 8 != 0
+      || offset < sizeof (XGenCaptureSegmentHeader)
+      || (guint64)offset + sizeof (XGenCaptureRecord) > segment->records_end)
+    return NULL;
+
+  record = (const XGenCaptureRecord *)(segment->base + offset);
+  if ((guint64)offset + sizeof (XGenCaptureRecord) + record->length
+      > segment->records_end)
+    return NULL;
+
+  return record;
+}
+
+static const char *
+segment_string (const CaptureSegment *segment, guint32 offset)
+{
+  if (offset >= segment->footer->strings_size)
+    return NULL;
+
+  return (const char *)segment->base + segment->footer->strings + offset;
+}
+
+static const char *
+segment_definition_name (const CaptureSegment *segment,
+			 const XGenCaptureRecord *record)
+{
+  const XGenCaptureDefinitionEntry *table;
+
+  if (record->definition == XGEN_CAPTURE_NO_DEFINITION
+      || record->definition >= segment->footer->n_definitions)
+    return NULL;
+
+  table = segment_definition_table (segment);
+  return segment_string (segment, table[record->definition].name);
+}
+
+static void
+warn_corrupt_record (guint64 offset)
+{
+  g_warning ("Corrupt capture record at segment offset %" G_GUINT64_FORMAT,
+	     offset);
+}
+
+/* Returns the first entry with a key >= @key */
+static guint32
+index_lower_bound (const XGenCaptureIndexEntry *entries,
+		   guint32 n_entries,
+		   guint64 key)
+{
+  guint32 low = 0;
+  guint32 high = n_entries;
+
+  while (low < high)
+    {
+      guint32 mid = low + (high - low) / 2;
+      if (entries[mid].key < key)
+	low = mid + 1;
+      else
+	high = mid;
+    }
+  return low;
+}
+
+/* Calls func for the entries with keys in the inclusive range [start, end]
+ * and returns FALSE if func asked to stop. */
+static gboolean
+foreach_index_range (const CaptureSegment *segment,
+		     const XGenCaptureIndexEntry *entries,
+		     guint32 n_entries,
+		     guint64 start,
+		     guint64 end,
+		     XGenCaptureFunc func,
+		     void *user_data)
+{
+  guint32 i;
+
+  for (i = index_lower_bound (entries, n_entries, start);
+       i < n_entries && entries[i].key <= end;
+       i++)
+    {
+      const XGenCaptureRecord *record =
+	segment_record (segment, entries[i].record);
+
+      /* The index is corrupt so give up on this segment */
+      if (!record)
+	{
+	  warn_corrupt_record (entries[i].record);
+	  return TRUE;
+	}
+
+      if (!func (record, segment_definition_name (segment, record),
+		 user_data))
+	return FALSE;
+    }
+  return TRUE;
+}
+
+/**
+ * xgen_capture_foreach_record:
+ * @capture: A capture
+ * @func: The function to call for each record
+ * @user_data: Private data passed to @func
+ *
+ * Iterates all records in the order they were written.
+ */
+void
+xgen_capture_foreach_record (XGenCapture *capture,
+			     XGenCaptureFunc func,
+			     void *user_data)
+{
+  guint i;
+
+  for (i = 0; i < capture->segments->len; i++)
+    if (!xgen_capture_foreach_record_in_segment (capture, i, func, user_data))
+      return;
+}
+
+/**
+ * xgen_capture_foreach_record_in_segment:
+ * @capture: A capture
+ * @segment: The index of a segment
+ * @func: The function to call for each record
+ * @user_data: Private data passed to @func
+ *
+ * Iterates the records of one segment in the order they were written.
+ * Since a capture is read only once opened, different segments can be
+ * iterated from different threads at the same time. If a record doesn't
+ * fit within the segment the rest of the segment is skipped with a
+ * warning.
+ *
+ * This function returns FALSE if @func stopped the iteration.
+ */
+gboolean
+xgen_capture_foreach_record_in_segment (XGenCapture *capture,
+					guint segment,
+					XGenCaptureFunc func,
+					void *user_data)
+{
+  const CaptureSegment *capture_segment;
+  guint64 pos = sizeof (XGenCaptureSegmentHeader);
+  guint32 i;
+
+  if (segment >= capture->segments->len)
+    {
+      g_warning ("Capture segment %u out of range", segment);
+      return TRUE;
+    }
+
+  capture_segment = &g_array_index (capture->segments, CaptureSegment,
+				    segment);
+
+  for (i = 0; i < capture_segment->footer->n_records; i++)
+    {
+      const XGenCaptureRecord *record = NULL;
+
+      if (pos <= G_MAXUINT32)
+	record = segment_record (capture_segment, pos);
+      if (!record)
+	{
+	  warn_corrupt_record (pos);
+	  return TRUE;
+	}
+
+      if (!func (record, segment_definition_name (capture_segment, record),
+		 user_data))
+	return FALSE;
+
+      pos += sizeof (XGenCaptureRecord) + ALIGN8 (record->length);
+    }
+
+  return TRUE;
+}
+
+/**
+ * xgen_capture_foreach_in_time_range:
+ * @capture: A capture
+ * @start: The first timestamp of interest
+ * @end: The last timestamp of interest (inclusive)
+ * @func: The function to call for each matching record
+ * @user_data: Private data passed to @func
+ *
+ * Iterates the records with timestamps between @start and @end in time
+ * order. Segments outside the range are skipped entirely and the time
+ * index is binary searched within each overlapping segment.
+ */
+void
+xgen_capture_foreach_in_time_range (XGenCapture *capture,
+				    guint64 start,
+				    guint64 end,
+				    XGenCaptureFunc func,
+				    void *user_data)
+{
+  guint i;
+
+  for (i = 0; i < capture->segments->len; i++)
+    {
+      const CaptureSegment *segment =
+	&g_array_index (capture->segments, CaptureSegment, i);
+      const XGenCaptureFooter *footer = segment->footer;
+
+      if (!footer->n_records
+	  || footer->max_timestamp < start
+	  || footer->min_timestamp > end)
+	continue;
+
+      if (!foreach_index_range (segment,
+				segment_index (segment, footer->time_index),
+				footer->n_records,
+				start, end, func, user_data))
+	return;
+    }
+}
+
+/**
+ * xgen_capture_foreach_definition:
+ * @capture: A capture
+ * @type: The type of definition, such as XGEN_EVENT. (Replies share
+ *	  their names with requests so the name alone is ambiguous.)
+ * @name: The definition name as "header:Name", e.g. "xproto:ConfigureNotify"
+ * @start: The first timestamp of interest
+ * @end: The last timestamp of interest (inclusive)
+ * @func: The function to call for each matching record
+ * @user_data: Private data passed to @func
+ *
+ * Iterates the records for one definition with timestamps between
+ * @start and @end, using the per definition index of each segment.
+ */
+void
+xgen_capture_foreach_definition (XGenCapture *capture,
+				 XGenType type,
+				 const char *name,
+				 guint64 start,
+				 guint64 end,
+				 XGenCaptureFunc func,
+				 void *user_data)
+{
+  guint i;
+
+  for (i = 0; i < capture->segments->len; i++)
+    {
+      const CaptureSegment *segment =
+	&g_array_index (capture->segments, CaptureSegment, i);
+      const XGenCaptureFooter *footer = segment->footer;
+      const XGenCaptureDefinitionEntry *table;
+      guint32 j;
+
+      if (!footer->n_records
+	  || footer->max_timestamp < start
+	  || footer->min_timestamp > end)
+	continue;
+
+      table = segment_definition_table (segment);
+
+      for (j = 0; j < footer->n_definitions; j++)
+	{
+	  const XGenCaptureIndexEntry *entries;
+	  const char *table_name = segment_string (segment, table[j].name);
+
+	  if (table[j].type != type
+	      || !table_name
+	      || strcmp (table_name, name) != 0)
+	    continue;
+
+	  if (footer->definition_index
+	      + ((guint64)table[j].first + table[j].n_entries)
+	      * sizeof (XGenCaptureIndexEntry) > footer->strings)
+	    break;
+
+	  entries = segment_index (segment, footer->definition_index);
+	  if (!foreach_index_range (segment,
+				    entries + table[j].first,
+				    table[j].n_entries,
+				    start, end, func, user_data))
+	    return;
+	  break;
+	}
+    }
+}
+
+/**
+ * xgen_capture_find_sequence:
+ * @capture: A capture
+ * @sequence: A full 64bit sequence number
+ *
+ * Finds the first record written with the given sequence number, which
+ * for a request with a reply will be the request itself.
+ *
+ * This function returns NULL if no record has the sequence number.
+ */
+const XGenCaptureRecord *
+xgen_capture_find_sequence (XGenCapture *capture, guint64 sequence)
+{
+  guint i;
+
+  for (i = 0; i < capture->segments->len; i++)
+    {
+      const CaptureSegment *segment =
+	&g_array_index (capture->segments, CaptureSegment, i);
+      const XGenCaptureFooter *footer = segment->footer;
+      const XGenCaptureIndexEntry *entries =
+	segment_index (segment, footer->sequence_index);
+      guint32 j = index_lower_bound (entries, footer->n_records, sequence);
+
+      if (j < footer->n_records && entries[j].key == sequence)
+	{
+	  const XGenCaptureRecord *record =
+	    segment_record (segment, entries[j].record);
+
+	  if (!record)
+	    warn_corrupt_record (entries[j].record);
+	  return record;
+	}
+    }
+
+  return NULL;
+}
@@ -0,0 +1,150 @@
+#ifndef _XGEN_CAPTURE_H_
+#define _XGEN_CAPTURE_H_
+
+#include <xgen.h>
+
+#include <glib.h>
+
+/*
+ * A capture file is a sequence of self contained segments:
+ *
+ *   [XGenCaptureSegmentHeader]
+ *   [XGenCaptureRecord + message data, padded to 8 bytes] * n_records
+ *   [XGenCaptureFooter]
+ *   [sequence index] [time index] [definition table] [definition index]
+ *   [string table]
+ *   [XGenCaptureTrailer]
+ *
+ * Everything is written in host byte order and 8 byte aligned so that a
+ * reader can mmap the file and use the records and indices in place.
+ */
+
+#define XGEN_CAPTURE_SEGMENT_MAGIC  0x31534758 /* "XGS1" */
+#define XGEN_CAPTURE_TRAILER_MAGIC  0x45534758 /* "XGSE" */
+#define XGEN_CAPTURE_BYTE_ORDER	    0x01020304
+
+#define XGEN_CAPTURE_NO_DEFINITION  0xffff
+
+typedef struct _XGenCaptureSegmentHeader
+{
+  guint32 magic;
+  guint32 byte_order;
+  guint64 size; /* Written when the segment is finished; 0 means the
+		   writer never finished the segment. */
+} XGenCaptureSegmentHeader;
+
+/**
+ * Each raw message in a capture is prefixed with one of these
+ */
+typedef struct _XGenCaptureRecord
+{
+  guint64 sequence;
+  guint64 timestamp;
+  guint32 length;     /* Length of the message data in bytes */
+  guint16 definition; /* Index into the segment's definition table or
+			 XGEN_CAPTURE_NO_DEFINITION */
+  guint8  direction;  /* An XGenDirection */
+  guint8  _pad;
+} XGenCaptureRecord;
+
+/**
+ * Returns a pointer to the raw message data following a capture record
+ */
+#define XGEN_CAPTURE_RECORD_DATA(RECORD) \
+  ((const guint8 *)(RECORD) + sizeof (XGenCaptureRecord))
+
+typedef struct _XGenCaptureIndexEntry
+{
+  guint64 key;	   /* sequence number or timestamp */
+  guint32 record;  /* record offset relative to the segment start */
+  guint32 _pad;
+} XGenCaptureIndexEntry;
+
+typedef struct _XGenCaptureDefinitionEntry
+{
+  guint32 name;	     /* "header:Name" offset into the string table */
+  guint32 first;     /* first entry in the definition index */
+  guint32 n_entries;
+  guint8  type;	     /* An XGenType */
+  guint8  _pad[3];
+} XGenCaptureDefinitionEntry;
+
+typedef struct _XGenCaptureFooter
+{
+  guint64 min_timestamp;
+  guint64 max_timestamp;
+  guint32 n_records;
+  guint32 n_definitions;
+  /* The following are offsets relative to the segment start */
+  guint32 sequence_index;     /* n_records XGenCaptureIndexEntrys */
+  guint32 time_index;	      /* n_records XGenCaptureIndexEntrys */
+  guint32 definition_table;   /* n_definitions XGenCaptureDefinitionEntrys */
+  guint32 definition_index;   /* XGenCaptureIndexEntrys keyed by time */
+  guint32 strings;
+  guint32 strings_size;
+} XGenCaptureFooter;
+
+typedef struct _XGenCaptureTrailer
+{
+  guint32 magic;
+  guint32 footer;	/* footer offset relative to the segment start */
+  guint64 segment_size;
+} XGenCaptureTrailer;
+
+
+typedef struct _XGenCaptureWriter XGenCaptureWriter;
+typedef struct _XGenCapture XGenCapture;
+
+/**
+ * Called for each record matched by a capture query. The definition
+ * name is of the form "header:Name" or NULL if the writer didn't
+ * know the definition of the message. Return FALSE to stop iterating.
+ */
+typedef gboolean (*XGenCaptureFunc) (const XGenCaptureRecord *record,
+				     const char *definition_name,
+				     void *user_data);
+
+XGenCaptureWriter *xgen_capture_writer_new (const char *filename);
+void xgen_capture_writer_set_max_segment_size (XGenCaptureWriter *writer,
+					       gsize max_segment_size);
+gboolean xgen_capture_writer_append (XGenCaptureWriter *writer,
+				     guint64 timestamp,
+				     XGenDirection direction,
+				     guint64 sequence,
+				     const XGenDefinition *definition,
+				     const guint8 *data,
+				     guint32 length);
+gboolean xgen_capture_writer_finish_segment (XGenCaptureWriter *writer);
+gboolean xgen_capture_writer_close (XGenCaptureWriter *writer);
+
+XGenCapture *xgen_capture_open (const char *filename);
+void xgen_capture_close (XGenCapture *capture);
+guint xgen_capture_get_n_segments (XGenCapture *capture);
+guint64 xgen_capture_get_n_records (XGenCapture *capture);
+const XGenCaptureDefinitionEntry *
+xgen_capture_get_definitions (XGenCapture *capture,
+			      guint segment,
+			      guint *n_definitions);
+void xgen_capture_foreach_record (XGenCapture *capture,
+				  XGenCaptureFunc func,
+				  void *user_data);
+gboolean xgen_capture_foreach_record_in_segment (XGenCapture *capture,
+						 guint segment,
+						 XGenCaptureFunc func,
+						 void *user_data);
+void xgen_capture_foreach_in_time_range (XGenCapture *capture,
+					 guint64 start,
+					 guint64 end,
+					 XGenCaptureFunc func,
+					 void *user_data);
+void xgen_capture_foreach_definition (XGenCapture *capture,
+				      XGenType type,
+				      const char *name,
+				      guint64 start,
+				      guint64 end,
+				      XGenCaptureFunc func,
+				      void *user_data);
+const XGenCaptureRecord *xgen_capture_find_sequence (XGenCapture *capture,
+						     guint64 sequence);
+
+#endif /* _XGEN_CAPTURE_H_ */
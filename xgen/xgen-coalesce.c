@@ -0,0 +1,398 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-dispatch.h>
+#include <xgen-coalesce.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <stdarg.h>
+#include <string.h>
+
+#define EVENT_SIZE 32
+#define SEND_EVENT_FLAG 0x80
+#define MAX_KEY_FIELDS 4
+
+enum
+{
+  RECT_X,
+  RECT_Y,
+  RECT_WIDTH,
+  RECT_HEIGHT,
+  RECT_COUNT,
+  N_RECT_FIELDS
+};
+
+typedef struct _Rule
+{
+  XGenCoalesceRule rule;
+
+  guint n_keys;
+  guint key_offsets[MAX_KEY_FIELDS];
+  guint key_sizes[MAX_KEY_FIELDS];
+
+  /* The offsets of the CARD16 fields merged by
+   * XGEN_COALESCE_UNION_RECTANGLES */
+  guint rect_offsets[N_RECT_FIELDS];
+} Rule;
+
+struct _XGenCoalescer
+{
+  const XGenState    *state;
+  const XGenDispatch *dispatch;
+  XGenByteOrder	      byte_order;
+  gboolean	      swap;
+
+  XGenCoalesceFunc    func;
+  void		     *user_data;
+
+  GHashTable	     *rules; /* XGenEvent -> Rule */
+
+  /* The event held back in case the next one can be merged into it */
+  const Rule	     *pending_rule;
+  guint8	      pending[EVENT_SIZE];
+  guint64	      pending_timestamp;
+
+  XGenCoalesceStats   stats;
+};
+
+/**
+ * xgen_coalescer_new:
+ * @state: The parsed protocol state
+ * @dispatch: A dispatcher with every extension of the connection added
+ * @byte_order: The byte order of the connection
+ * @func: The function to pass messages on to
+ * @user_data: Data to pass to @func
+ *
+ * Creates a coalescer without any rules. The state and dispatcher must
+ * outlive it.
+ */
+XGenCoalescer *
+xgen_coalescer_new (const XGenState *state,
+		    const XGenDispatch *dispatch,
+		    XGenByteOrder byte_order,
+		    XGenCoalesceFunc func,
+		    void *user_data)
+{
+  XGenCoalescer *coalescer = g_new0 (XGenCoalescer, 1);
+
+  coalescer->state = state;
+  coalescer->dispatch = dispatch;
+  coalescer->byte_order = byte_order;
+  coalescer->swap = _XGEN_NEEDS_SWAP (byte_order);
+  coalescer->func = func;
+  coalescer->user_data = user_data;
+  coalescer->rules =
+    g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+
+  return coalescer;
+}
+
+/* Finds a fixed position field of an event */
+static gboolean
+find_field (const XGenLayout *layout,
+	    const char *name,
+	    guint *offset,
+	    guint *size)
+{
+  gint i = xgen_layout_find_field (layout, name);
+
+  if (i < 0
+      || layout->fields[i].kind != XGEN_LAYOUT_SCALAR
+      || layout->fields[i].offset == XGEN_LAYOUT_VARIABLE_OFFSET)
+    {
+      g_warning ("Event %s has no field %s that can be used for coalescing",
+		 layout->definition->name, name);
+      return FALSE;
+    }
+
+  *offset = layout->fields[i].offset;
+  *size = layout->fields[i].size;
+  return TRUE;
+}
+
+/**
+ * xgen_coalescer_add_rule:
+ * @coalescer: A coalescer
+ * @event: An event name, as "header:Name" or "Name"
+ * @rule: How to merge consecutive events
+ * @first_key_field: The name of the first field consecutive events must
+ *		     agree on to be merged, typically the window
+ * @...: More key field names, terminated by NULL
+ *
+ * Events for XGEN_COALESCE_UNION_RECTANGLES need CARD16 x, y, width,
+ * height and count fields.
+ *
+ * This function returns FALSE if the event or one of its fields isn't
+ * known.
+ */
+gboolean
+xgen_coalescer_add_rule (XGenCoalescer *coalescer,
+			 const char *event,
+			 XGenCoalesceRule rule,
+			 const char *first_key_field,
+			 ...)
+{
+  static const char *rect_fields[N_RECT_FIELDS] = {
+    "x", "y", "width", "height", "count"
+  };
+  const XGenDefinition *def;
+  const XGenLayout *layout;
+  const char *name;
+  Rule *new_rule;
+  va_list args;
+  guint i;
+
+  def = xgen_state_find_definition (coalescer->state, event, XGEN_EVENT);
+  if (!def)
+    {
+      g_warning ("Failed to find event %s", event);
+      return FALSE;
+    }
+  layout = xgen_definition_get_layout (def);
+
+  new_rule = g_new0 (Rule, 1);
+  new_rule->rule = rule;
+
+  va_start (args, first_key_field);
+  for (name = first_key_field; name; name = va_arg (args, const char *))
+    {
+      if (new_rule->n_keys == MAX_KEY_FIELDS
+	  || !find_field (layout, name,
+			  &new_rule->key_offsets[new_rule->n_keys],
+			  &new_rule->key_sizes[new_rule->n_keys]))
+	{
+	  va_end (args);
+	  g_free (new_rule);
+	  return FALSE;
+	}
+      new_rule->n_keys++;
+    }
+  va_end (args);
+
+  if (rule == XGEN_COALESCE_UNION_RECTANGLES)
+    for (i = 0; i < N_RECT_FIELDS; i++)
+      {
+	guint size;
+
+	if (!find_field (layout, rect_fields[i],
+			 &new_rule->rect_offsets[i], &size)
+	    || size != 2)
+	  {
+	    g_free (new_rule);
+	    return FALSE;
+	  }
+      }
+
+  g_hash_table_insert (coalescer->rules, (gpointer)def, new_rule);
+  return TRUE;
+}
+
+/**
+ * xgen_coalescer_add_default_rules:
+ * @coalescer: A coalescer
+ *
+ * Adds rules keeping the latest MotionNotify per event window and the
+ * latest ConfigureNotify per window, and merging the Expose rectangles
+ * of each window.
+ */
+void
+xgen_coalescer_add_default_rules (XGenCoalescer *coalescer)
+{
+  xgen_coalescer_add_rule (coalescer, "xproto:MotionNotify",
+			   XGEN_COALESCE_KEEP_LAST, "event", NULL);
+  /* The same window is reported to its parent for SubstructureNotify */
+  xgen_coalescer_add_rule (coalescer, "xproto:ConfigureNotify",
+			   XGEN_COALESCE_KEEP_LAST, "event", "window", NULL);
+  xgen_coalescer_add_rule (coalescer, "xproto:Expose",
+			   XGEN_COALESCE_UNION_RECTANGLES, "window", NULL);
+}
+
+static void
+emit (XGenCoalescer *coalescer,
+      const guint8 *data,
+      gsize len,
+      guint64 timestamp)
+{
+  coalescer->stats.n_emitted++;
+  coalescer->func (data, len, timestamp, coalescer->user_data);
+}
+
+/**
+ * xgen_coalescer_flush:
+ * @coalescer: A coalescer
+ *
+ * Passes on any event being held back for merging. A proxy should call
+ * this whenever it has no more input ready, so events aren't delayed
+ * until the next message arrives; a replay should call it at the end.
+ */
+void
+xgen_coalescer_flush (XGenCoalescer *coalescer)
+{
+  if (!coalescer->pending_rule)
+    return;
+
+  coalescer->pending_rule = NULL;
+  emit (coalescer, coalescer->pending, EVENT_SIZE,
+	coalescer->pending_timestamp);
+}
+
+static gboolean
+same_keys (const Rule *rule, const guint8 *a, const guint8 *b)
+{
+  guint i;
+
+  for (i = 0; i < rule->n_keys; i++)
+    if (memcmp (a + rule->key_offsets[i], b + rule->key_offsets[i],
+		rule->key_sizes[i]) != 0)
+      return FALSE;
+  return TRUE;
+}
+
+static guint
+read_card16 (XGenCoalescer *coalescer, const guint8 *data, guint field,
+	     const Rule *rule)
+{
+  return _xgen_read_unsigned (data + rule->rect_offsets[field], 2,
+			      coalescer->swap);
+}
+
+static void
+write_card16 (XGenCoalescer *coalescer, guint8 *data, guint field,
+	      const Rule *rule, guint value)
+{
+  _xgen_write_unsigned (data + rule->rect_offsets[field], 2, value,
+			coalescer->swap);
+}
+
+/* Extends the pending rectangle to cover that of @data */
+static void
+union_rectangles (XGenCoalescer *coalescer,
+		  const Rule *rule,
+		  const guint8 *data)
+{
+  guint8 *pending = coalescer->pending;
+  guint x1 = read_card16 (coalescer, pending, RECT_X, rule);
+  guint y1 = read_card16 (coalescer, pending, RECT_Y, rule);
+  guint x2 = x1 + read_card16 (coalescer, pending, RECT_WIDTH, rule);
+  guint y2 = y1 + read_card16 (coalescer, pending, RECT_HEIGHT, rule);
+  guint x = read_card16 (coalescer, data, RECT_X, rule);
+  guint y = read_card16 (coalescer, data, RECT_Y, rule);
+
+  x2 = MAX (x2, x + read_card16 (coalescer, data, RECT_WIDTH, rule));
+  y2 = MAX (y2, y + read_card16 (coalescer, data, RECT_HEIGHT, rule));
+  x1 = MIN (x1, x);
+  y1 = MIN (y1, y);
+
+  write_card16 (coalescer, pending, RECT_X, rule, x1);
+  write_card16 (coalescer, pending, RECT_Y, rule, y1);
+  write_card16 (coalescer, pending, RECT_WIDTH, rule, MIN (x2 - x1, 0xffff));
+  write_card16 (coalescer, pending, RECT_HEIGHT, rule, MIN (y2 - y1, 0xffff));
+  write_card16 (coalescer, pending, RECT_COUNT, rule,
+		read_card16 (coalescer, data, RECT_COUNT, rule));
+
+  /* The sequence number of the latest event */
+  memcpy (pending + 2, data + 2, 2);
+}
+
+/**
+ * xgen_coalescer_push:
+ * @coalescer: A coalescer
+ * @data: A complete raw message from the server
+ * @len: The length of the message
+ * @timestamp: A timestamp to pass on with the message, e.g. from a capture
+ *
+ * Passes on the message, or holds it back if it's an event that later
+ * events might be merged into.
+ */
+void
+xgen_coalescer_push (XGenCoalescer *coalescer,
+		     const guint8 *data,
+		     gsize len,
+		     guint64 timestamp)
+{
+  const Rule *rule = NULL;
+
+  coalescer->stats.n_messages++;
+
+  /* Replies and errors start with 1 and 0 */
+  if (len == EVENT_SIZE && data[0] > 1 && !(data[0] & SEND_EVENT_FLAG))
+    {
+      const XGenEvent *event =
+	xgen_dispatch_lookup_event (coalescer->dispatch, data, len,
+				    coalescer->byte_order);
+      if (event)
+	rule = g_hash_table_lookup (coalescer->rules, event);
+    }
+
+  if (!rule)
+    {
+      xgen_coalescer_flush (coalescer);
+      emit (coalescer, data, len, timestamp);
+      return;
+    }
+
+  if (coalescer->pending_rule == rule
+      && same_keys (rule, coalescer->pending, data))
+    {
+      switch (rule->rule)
+	{
+	case XGEN_COALESCE_KEEP_LAST:
+	  memcpy (coalescer->pending, data, EVENT_SIZE);
+	  coalescer->stats.n_dropped++;
+	  break;
+	case XGEN_COALESCE_UNION_RECTANGLES:
+	  union_rectangles (coalescer, rule, data);
+	  coalescer->stats.n_merged++;
+	  break;
+	}
+      coalescer->pending_timestamp = timestamp;
+    }
+  else
+    {
+      xgen_coalescer_flush (coalescer);
+      memcpy (coalescer->pending, data, EVENT_SIZE);
+      coalescer->pending_rule = rule;
+      coalescer->pending_timestamp = timestamp;
+    }
+
+  /* The last event of an Expose series completes it */
+  if (rule->rule == XGEN_COALESCE_UNION_RECTANGLES
+      && read_card16 (coalescer, coalescer->pending, RECT_COUNT, rule) == 0)
+    xgen_coalescer_flush (coalescer);
+}
+
+const XGenCoalesceStats *
+xgen_coalescer_get_stats (XGenCoalescer *coalescer)
+{
+  return &coalescer->stats;
+}
+
+/**
+ * xgen_coalescer_free:
+ * @coalescer: A coalescer
+ *
+ * Frees the coalescer. Any event still held back is dropped, so call
+ * xgen_coalescer_flush() first to pass it on.
+ */
+void
+xgen_coalescer_free (XGenCoalescer *coalescer)
+{
+  g_hash_table_destroy (coalescer->rules);
+  g_free (coalescer);
+}
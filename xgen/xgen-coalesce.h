@@ -0,0 +1,69 @@
+#ifndef _XGEN_COALESCE_H_
+#define _XGEN_COALESCE_H_
+
+#include <xgen.h>
+#include <xgen-dispatch.h>
+
+#include <glib.h>
+
+/**
+ * Merges bursts of events on their way from the server to a client.
+ *
+ * Every server message is pushed through the coalescer, which passes it
+ * on to a callback. Consecutive events that have a rule and that agree
+ * on the rule's key fields, e.g. the window, are merged before being
+ * passed on. Since only consecutive events are merged, replies and errors
+ * are never reordered and sequence numbers stay in order; a merged event
+ * carries the sequence number of the latest event it replaces.
+ *
+ * Events sent with SendEvent are never merged.
+ */
+typedef enum _XGenCoalesceRule
+{
+  XGEN_COALESCE_KEEP_LAST,	  /* Only pass on the latest event, e.g. for
+				     MotionNotify */
+  XGEN_COALESCE_UNION_RECTANGLES  /* Merge the x, y, width and height
+				     fields into their bounding box until
+				     an event with a count of 0, e.g. for
+				     Expose */
+} XGenCoalesceRule;
+
+typedef struct _XGenCoalesceStats
+{
+  guint64 n_messages;	/* Messages pushed */
+  guint64 n_emitted;	/* Messages passed on */
+  guint64 n_dropped;	/* Events replaced by a later event */
+  guint64 n_merged;	/* Events merged into the bounding box of another */
+} XGenCoalesceStats;
+
+/**
+ * Called with each message passed on. The timestamp is the one pushed
+ * with the latest message merged into it.
+ */
+typedef void (*XGenCoalesceFunc) (const guint8 *data,
+				  gsize len,
+				  guint64 timestamp,
+				  void *user_data);
+
+typedef struct _XGenCoalescer XGenCoalescer;
+
+XGenCoalescer *xgen_coalescer_new (const XGenState *state,
+				   const XGenDispatch *dispatch,
+				   XGenByteOrder byte_order,
+				   XGenCoalesceFunc func,
+				   void *user_data);
+gboolean xgen_coalescer_add_rule (XGenCoalescer *coalescer,
+				  const char *event,
+				  XGenCoalesceRule rule,
+				  const char *first_key_field,
+				  ...) G_GNUC_NULL_TERMINATED;
+void xgen_coalescer_add_default_rules (XGenCoalescer *coalescer);
+void xgen_coalescer_push (XGenCoalescer *coalescer,
+			  const guint8 *data,
+			  gsize len,
+			  guint64 timestamp);
+void xgen_coalescer_flush (XGenCoalescer *coalescer);
+const XGenCoalesceStats *xgen_coalescer_get_stats (XGenCoalescer *coalescer);
+void xgen_coalescer_free (XGenCoalescer *coalescer);
+
+#endif /* _XGEN_COALESCE_H_ */
@@ -0,0 +1,408 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-dependencies.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+struct _XGenDependencyGraph
+{
+  const XGenState *state;
+
+  GHashTable	  *dependencies; /* XGenDefinition -> GList of the
+				    definitions it refers to */
+  GHashTable	  *dependents;	 /* XGenDefinition -> GList of the
+				    definitions referring to it */
+
+  GHashTable	  *copied;	 /* The fields of an event or error -> the
+				    event or error, for resolving copies.
+				    Only used while building */
+};
+
+static void add_definition (XGenDependencyGraph *graph,
+			    const XGenDefinition *def);
+
+static void
+add_edge (XGenDependencyGraph *graph,
+	  const XGenDefinition *from,
+	  const XGenDefinition *to)
+{
+  GList *dependencies;
+  GList *dependents;
+
+  if (!to)
+    return;
+
+  dependencies = g_hash_table_lookup (graph->dependencies, from);
+  if (g_list_find (dependencies, to))
+    return;
+  g_hash_table_insert (graph->dependencies, (gpointer)from,
+		       g_list_append (dependencies, (gpointer)to));
+
+  add_definition (graph, to);
+
+  dependents = g_hash_table_lookup (graph->dependents, to);
+  g_hash_table_insert (graph->dependents, (gpointer)to,
+		       g_list_append (dependents, (gpointer)from));
+}
+
+static void
+add_definition (XGenDependencyGraph *graph, const XGenDefinition *def)
+{
+  GList *tmp;
+
+  if (g_hash_table_lookup_extended (graph->dependencies, def, NULL, NULL))
+    return;
+  g_hash_table_insert (graph->dependencies, (gpointer)def, NULL);
+
+  switch (def->type)
+    {
+    case XGEN_TYPEDEF:
+      add_edge (graph, def, XGEN_TYPEDEF_DEF (def)->reference);
+      return;
+    case XGEN_VALUEPARAM:
+      add_edge (graph, def, XGEN_VALUE_PARAM_DEF (def)->reference);
+      return;
+    case XGEN_REQUEST:
+      add_edge (graph, def, XGEN_DEF (XGEN_REQUEST_DEF (def)->reply));
+      break;
+    case XGEN_EVENT:
+      if (XGEN_EVENT_DEF (def)->is_copy)
+	{
+	  add_edge (graph, def,
+		    g_hash_table_lookup (graph->copied,
+					 XGEN_EVENT_DEF (def)->fields));
+	  return;
+	}
+      break;
+    case XGEN_ERROR:
+      if (XGEN_ERROR_DEF (def)->is_copy)
+	{
+	  add_edge (graph, def,
+		    g_hash_table_lookup (graph->copied,
+					 XGEN_ERROR_DEF (def)->fields));
+	  return;
+	}
+      break;
+    case XGEN_XIDUNION:
+      for (tmp = XGEN_XID_UNION_DEF (def)->fields; tmp; tmp = tmp->next)
+	{
+	  XGenFieldDefinition *field = tmp->data;
+	  add_edge (graph, def, field->definition);
+	}
+      return;
+    default:
+      break;
+    }
+
+  for (tmp = _xgen_definition_get_fields (def); tmp != NULL; tmp = tmp->next)
+    {
+      XGenFieldDefinition *field = tmp->data;
+
+      add_edge (graph, def, field->definition);
+      add_edge (graph, def, XGEN_DEF (field->enum_def));
+    }
+}
+
+static void
+free_list (gpointer key, gpointer value, gpointer user_data)
+{
+  g_list_free (value);
+}
+
+/**
+ * xgen_dependency_graph_new:
+ * @state: The parsed protocol state
+ *
+ * Builds the graph of references between all the definitions of @state.
+ */
+XGenDependencyGraph *
+xgen_dependency_graph_new (const XGenState *state)
+{
+  XGenDependencyGraph *graph = g_new0 (XGenDependencyGraph, 1);
+  GList *tmp;
+
+  graph->state = state;
+  graph->dependencies = g_hash_table_new (g_direct_hash, g_direct_equal);
+  graph->dependents = g_hash_table_new (g_direct_hash, g_direct_equal);
+  graph->copied = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  /* eventcopy and errorcopy definitions only share the field list of the
+   * definition they copy */
+  for (tmp = state->extensions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+      GList *tmp2;
+
+      for (tmp2 = extension->events; tmp2 != NULL; tmp2 = tmp2->next)
+	{
+	  XGenEvent *event = tmp2->data;
+	  if (!event->is_copy)
+	    g_hash_table_insert (graph->copied, event->fields, event);
+	}
+      for (tmp2 = extension->errors; tmp2 != NULL; tmp2 = tmp2->next)
+	{
+	  XGenError *error = tmp2->data;
+	  if (!error->is_copy)
+	    g_hash_table_insert (graph->copied, error->fields, error);
+	}
+    }
+
+  for (tmp = state->extensions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+      GList *tmp2;
+
+      for (tmp2 = extension->all_definitions; tmp2 != NULL; tmp2 = tmp2->next)
+	add_definition (graph, tmp2->data);
+    }
+
+  g_hash_table_destroy (graph->copied);
+  graph->copied = NULL;
+
+  return graph;
+}
+
+/**
+ * xgen_dependency_graph_get_dependencies:
+ * @graph: A dependency graph
+ * @def: A definition
+ *
+ * This function returns the definitions that @def refers to directly.
+ * The list belongs to the graph.
+ */
+GList *
+xgen_dependency_graph_get_dependencies (XGenDependencyGraph *graph,
+					const XGenDefinition *def)
+{
+  return g_hash_table_lookup (graph->dependencies, def);
+}
+
+/**
+ * xgen_dependency_graph_get_dependents:
+ * @graph: A dependency graph
+ * @def: A definition
+ *
+ * This function returns the definitions that refer to @def directly. The
+ * list belongs to the graph.
+ */
+GList *
+xgen_dependency_graph_get_dependents (XGenDependencyGraph *graph,
+				      const XGenDefinition *def)
+{
+  return g_hash_table_lookup (graph->dependents, def);
+}
+
+static void
+visit (XGenDependencyGraph *graph,
+       GHashTable *visited,
+       const XGenDefinition *def,
+       GList **closure)
+{
+  GList *tmp;
+
+  if (g_hash_table_lookup (visited, def))
+    return;
+  g_hash_table_insert (visited, (gpointer)def, (gpointer)def);
+
+  for (tmp = g_hash_table_lookup (graph->dependencies, def);
+       tmp != NULL;
+       tmp = tmp->next)
+    visit (graph, visited, tmp->data, closure);
+
+  *closure = g_list_prepend (*closure, (gpointer)def);
+}
+
+/**
+ * xgen_dependency_graph_get_closure:
+ * @graph: A dependency graph
+ * @roots: A list of definitions
+ *
+ * Finds every definition that is needed to describe @roots, i.e. the
+ * roots themselves and everything they refer to directly or indirectly.
+ * The definitions are ordered so that each comes after everything it
+ * refers to, which is the order a code generator wants to emit them in.
+ *
+ * This function returns a list of definitions that should be freed with
+ * g_list_free().
+ */
+GList *
+xgen_dependency_graph_get_closure (XGenDependencyGraph *graph, GList *roots)
+{
+  GHashTable *visited = g_hash_table_new (g_direct_hash, g_direct_equal);
+  GList *closure = NULL;
+  GList *tmp;
+
+  for (tmp = roots; tmp != NULL; tmp = tmp->next)
+    visit (graph, visited, tmp->data, &closure);
+
+  g_hash_table_destroy (visited);
+
+  return g_list_reverse (closure);
+}
+
+void
+xgen_dependency_graph_free (XGenDependencyGraph *graph)
+{
+  g_hash_table_foreach (graph->dependencies, free_list, NULL);
+  g_hash_table_foreach (graph->dependents, free_list, NULL);
+  g_hash_table_destroy (graph->dependencies);
+  g_hash_table_destroy (graph->dependents);
+  g_free (graph);
+}
+
+static GList *
+filter_definitions (GList *definitions, GHashTable *keep)
+{
+  GList *filtered = NULL;
+  GList *tmp;
+
+  for (tmp = definitions; tmp != NULL; tmp = tmp->next)
+    if (g_hash_table_lookup (keep, tmp->data))
+      filtered = g_list_prepend (filtered, tmp->data);
+
+  return g_list_reverse (filtered);
+}
+
+/**
+ * xgen_state_new_pruned:
+ * @state: The parsed protocol state
+ * @roots: The definitions to keep
+ *
+ * Creates a state with just the closure of @roots (see
+ * xgen_dependency_graph_get_closure()), e.g. for generating bindings
+ * for only the requests and events a client uses.
+ *
+ * The pruned state has its own extensions, which only list the kept
+ * definitions; extensions left with no definitions are dropped. The
+ * definitions themselves are shared with @state, so @state must outlive
+ * the pruned state, and a definition's extension member still points at
+ * the extension of @state; compare extensions by header.
+ *
+ * This function returns a new state that should be freed with
+ * xgen_pruned_state_free().
+ */
+XGenState *
+xgen_state_new_pruned (const XGenState *state, GList *roots)
+{
+  XGenDependencyGraph *graph = xgen_dependency_graph_new (state);
+  GList *closure = xgen_dependency_graph_get_closure (graph, roots);
+  GHashTable *keep = g_hash_table_new (g_direct_hash, g_direct_equal);
+  GHashTable *copies = g_hash_table_new (g_direct_hash, g_direct_equal);
+  XGenState *pruned = g_new0 (XGenState, 1);
+  GList *tmp;
+
+  for (tmp = closure; tmp != NULL; tmp = tmp->next)
+    g_hash_table_insert (keep, tmp->data, tmp->data);
+  g_list_free (closure);
+  xgen_dependency_graph_free (graph);
+
+  pruned->host_is_little_endian = state->host_is_little_endian;
+
+  for (tmp = state->extensions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+      XGenExtension *copy;
+      GList *all_definitions;
+
+      all_definitions = filter_definitions (extension->all_definitions, keep);
+      if (!all_definitions)
+	continue;
+
+      copy = g_new0 (XGenExtension, 1);
+      copy->name = extension->name;
+      copy->header = extension->header;
+      copy->xname = extension->xname;
+      copy->base_types = filter_definitions (extension->base_types, keep);
+      copy->structs = filter_definitions (extension->structs, keep);
+      copy->unions = filter_definitions (extension->unions, keep);
+      copy->xid_unions = filter_definitions (extension->xid_unions, keep);
+      copy->enums = filter_definitions (extension->enums, keep);
+      copy->typedefs = filter_definitions (extension->typedefs, keep);
+      copy->requests = filter_definitions (extension->requests, keep);
+      copy->replys = filter_definitions (extension->replys, keep);
+      copy->errors = filter_definitions (extension->errors, keep);
+      copy->events = filter_definitions (extension->events, keep);
+      copy->all_definitions = all_definitions;
+      copy->_parsed = TRUE;
+
+      g_hash_table_insert (copies, extension, copy);
+      pruned->extensions = g_list_prepend (pruned->extensions, copy);
+    }
+  pruned->extensions = g_list_reverse (pruned->extensions);
+
+  /* Imports of dropped extensions are dropped too */
+  for (tmp = state->extensions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *copy = g_hash_table_lookup (copies, tmp->data);
+      GList *tmp2;
+
+      if (!copy)
+	continue;
+
+      for (tmp2 = ((XGenExtension *)tmp->data)->imports;
+	   tmp2 != NULL;
+	   tmp2 = tmp2->next)
+	{
+	  XGenExtension *import = g_hash_table_lookup (copies, tmp2->data);
+	  if (import)
+	    copy->imports = g_list_append (copy->imports, import);
+	}
+    }
+
+  g_hash_table_destroy (copies);
+  g_hash_table_destroy (keep);
+
+  /* Definitions keep their fingerprints but the extensions' change */
+  _xgen_compute_fingerprints (pruned);
+
+  return pruned;
+}
+
+/**
+ * xgen_pruned_state_free:
+ * @state: A state created by xgen_state_new_pruned()
+ *
+ * Frees a pruned state. The definitions belong to the original state and
+ * aren't affected.
+ */
+void
+xgen_pruned_state_free (XGenState *state)
+{
+  GList *tmp;
+
+  for (tmp = state->extensions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+
+      g_list_free (extension->imports);
+      g_list_free (extension->base_types);
+      g_list_free (extension->structs);
+      g_list_free (extension->unions);
+      g_list_free (extension->xid_unions);
+      g_list_free (extension->enums);
+      g_list_free (extension->typedefs);
+      g_list_free (extension->requests);
+      g_list_free (extension->replys);
+      g_list_free (extension->errors);
+      g_list_free (extension->events);
+      g_list_free (extension->all_definitions);
+      g_free (extension);
+    }
+  g_list_free (state->extensions);
+  g_free (state);
+}
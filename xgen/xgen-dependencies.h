@@ -0,0 +1,31 @@
+#ifndef _XGEN_DEPENDENCIES_H_
+#define _XGEN_DEPENDENCIES_H_
+
+#include <xgen.h>
+
+#include <glib.h>
+
+/**
+ * The graph of references between the definitions of a state: field
+ * types, enums naming field values, typedef and valueparam types, request
+ * replies and the events and errors that eventcopy and errorcopy refer
+ * to.
+ *
+ * The graph doesn't change once created so it can be shared between
+ * threads. It must not outlive its state.
+ */
+typedef struct _XGenDependencyGraph XGenDependencyGraph;
+
+XGenDependencyGraph *xgen_dependency_graph_new (const XGenState *state);
+GList *xgen_dependency_graph_get_dependencies (XGenDependencyGraph *graph,
+					       const XGenDefinition *def);
+GList *xgen_dependency_graph_get_dependents (XGenDependencyGraph *graph,
+					     const XGenDefinition *def);
+GList *xgen_dependency_graph_get_closure (XGenDependencyGraph *graph,
+					  GList *roots);
+void xgen_dependency_graph_free (XGenDependencyGraph *graph);
+
+XGenState *xgen_state_new_pruned (const XGenState *state, GList *roots);
+void xgen_pruned_state_free (XGenState *state);
+
+#endif /* _XGEN_DEPENDENCIES_H_ */
@@ -0,0 +1,461 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-dispatch.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+/* Core requests use opcodes 0-127; major opcodes 128-255 belong to
+ * extensions and the second byte is then the minor opcode */
+#define CORE_OPCODE_LIMIT 128
+
+/* The top bit of an event code is set for events sent with SendEvent */
+#define EVENT_CODE_MASK 0x7f
+
+/* Extensions such as XInputExtension 2 send their events as a core
+ * GenericEvent carrying the extension's major opcode and an event type */
+#define X_GENERIC_EVENT 35
+
+typedef struct _ExtensionCodes
+{
+  guint8 major_opcode;
+  guint8 first_event;
+  guint8 first_error;
+} ExtensionCodes;
+
+struct _XGenDispatch
+{
+  const XGenState      *state;
+
+  const XGenRequest    *core_requests[CORE_OPCODE_LIMIT];
+  const XGenRequest   **extension_requests[256]; /* Indexed by major then
+						    minor opcode */
+  const XGenEvent      *events[128];
+  const XGenEvent     **generic_events[256]; /* Indexed by major opcode
+						then event type */
+  guint16		n_generic_events[256];
+  const XGenError      *errors[256];
+
+  GHashTable	       *extension_codes; /* Extension header ->
+					    ExtensionCodes */
+};
+
+static gboolean
+is_core (const XGenExtension *extension)
+{
+  return strcmp (extension->header, "xproto") == 0;
+}
+
+/**
+ * xgen_dispatch_new:
+ * @state: The parsed protocol state
+ *
+ * Creates a dispatcher with the core protocol registered. The state must
+ * outlive the dispatcher.
+ */
+XGenDispatch *
+xgen_dispatch_new (const XGenState *state)
+{
+  XGenDispatch *dispatch = g_new0 (XGenDispatch, 1);
+  XGenExtension *core;
+  GList *tmp;
+
+  dispatch->state = state;
+  dispatch->extension_codes =
+    g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+
+  core = xgen_state_find_extension (state, "xproto");
+  if (!core)
+    return dispatch;
+
+  for (tmp = core->requests; tmp != NULL; tmp = tmp->next)
+    {
+      XGenRequest *request = tmp->data;
+      if (request->opcode < CORE_OPCODE_LIMIT)
+	dispatch->core_requests[request->opcode] = request;
+    }
+  for (tmp = core->events; tmp != NULL; tmp = tmp->next)
+    {
+      XGenEvent *event = tmp->data;
+      dispatch->events[event->number & EVENT_CODE_MASK] = event;
+    }
+  for (tmp = core->errors; tmp != NULL; tmp = tmp->next)
+    {
+      XGenError *error = tmp->data;
+      dispatch->errors[error->number] = error;
+    }
+
+  return dispatch;
+}
+
+/**
+ * xgen_dispatch_add_extension:
+ * @dispatch: A dispatcher
+ * @header: The extension header name, e.g. "shape"
+ * @major_opcode: The major opcode assigned to the extension
+ * @first_event: The first event code assigned to the extension
+ * @first_error: The first error code assigned to the extension
+ *
+ * Registers the requests, events and errors of an extension using the
+ * codes the server assigned to it. Generic events are registered by the
+ * major opcode and their event type instead, and don't use event codes.
+ *
+ * This function returns FALSE if the extension isn't known or the codes
+ * would overlap an already registered extension.
+ */
+gboolean
+xgen_dispatch_add_extension (XGenDispatch *dispatch,
+			     const char *header,
+			     guint8 major_opcode,
+			     guint8 first_event,
+			     guint8 first_error)
+{
+  XGenExtension *extension =
+    xgen_state_find_extension (dispatch->state, header);
+  ExtensionCodes *codes;
+  const XGenRequest **requests;
+  guint n_generic_events = 0;
+  GList *tmp;
+
+  if (!extension)
+    {
+      g_warning ("Failed to register unknown extension \"%s\"", header);
+      return FALSE;
+    }
+  if (is_core (extension))
+    return TRUE;
+
+  if (major_opcode < CORE_OPCODE_LIMIT
+      || dispatch->extension_requests[major_opcode])
+    {
+      g_warning ("Failed to register extension \"%s\": major opcode %d "
+		 "is not available", header, major_opcode);
+      return FALSE;
+    }
+
+  for (tmp = extension->events; tmp != NULL; tmp = tmp->next)
+    {
+      XGenEvent *event = tmp->data;
+      guint code = first_event + event->number;
+
+      if (event->is_generic)
+	{
+	  n_generic_events = MAX (n_generic_events, event->number + 1);
+	  continue;
+	}
+      if (code > EVENT_CODE_MASK || dispatch->events[code])
+	{
+	  g_warning ("Failed to register extension \"%s\": event code %d "
+		     "is not available", header, code);
+	  return FALSE;
+	}
+    }
+  for (tmp = extension->errors; tmp != NULL; tmp = tmp->next)
+    {
+      XGenError *error = tmp->data;
+      guint code = first_error + error->number;
+      if (code > 255 || dispatch->errors[code])
+	{
+	  g_warning ("Failed to register extension \"%s\": error code %d "
+		     "is not available", header, code);
+	  return FALSE;
+	}
+    }
+
+  requests = g_new0 (const XGenRequest *, 256);
+  for (tmp = extension->requests; tmp != NULL; tmp = tmp->next)
+    {
+      XGenRequest *request = tmp->data;
+      requests[request->opcode] = request;
+    }
+  dispatch->extension_requests[major_opcode] = requests;
+
+  if (n_generic_events)
+    {
+      dispatch->generic_events[major_opcode] =
+	g_new0 (const XGenEvent *, n_generic_events);
+      dispatch->n_generic_events[major_opcode] = n_generic_events;
+    }
+
+  for (tmp = extension->events; tmp != NULL; tmp = tmp->next)
+    {
+      XGenEvent *event = tmp->data;
+      if (event->is_generic)
+	dispatch->generic_events[major_opcode][event->number] = event;
+      else
+	dispatch->events[first_event + event->number] = event;
+    }
+  for (tmp = extension->errors; tmp != NULL; tmp = tmp->next)
+    {
+      XGenError *error = tmp->data;
+      dispatch->errors[first_error + error->number] = error;
+    }
+
+  codes = g_new (ExtensionCodes, 1);
+  codes->major_opcode = major_opcode;
+  codes->first_event = first_event;
+  codes->first_error = first_error;
+  g_hash_table_insert (dispatch->extension_codes, extension->header, codes);
+
+  return TRUE;
+}
+
+/**
+ * xgen_dispatch_lookup_request:
+ * @dispatch: A dispatcher
+ * @data: The start of a raw request
+ * @len: The number of bytes available at @data
+ *
+ * This function returns the request definition for the opcodes at the
+ * start of @data or NULL if they aren't registered.
+ */
+const XGenRequest *
+xgen_dispatch_lookup_request (const XGenDispatch *dispatch,
+			      const guint8 *data,
+			      gsize len)
+{
+  const XGenRequest **requests;
+
+  if (len < 1)
+    return NULL;
+
+  if (data[0] < CORE_OPCODE_LIMIT)
+    return dispatch->core_requests[data[0]];
+
+  requests = dispatch->extension_requests[data[0]];
+  if (!requests || len < 2)
+    return NULL;
+  return requests[data[1]];
+}
+
+/**
+ * xgen_dispatch_lookup_event:
+ * @dispatch: A dispatcher
+ * @data: The start of a raw event
+ * @len: The number of bytes available at @data
+ * @byte_order: The byte order of the event
+ *
+ * The SendEvent flag of the event code is ignored. A GenericEvent is
+ * looked up by the major opcode and event type in its header, falling
+ * back to the core GenericEvent definition if the extension or event
+ * type isn't registered.
+ *
+ * This function returns the event definition for the code at the start of
+ * @data or NULL if it isn't registered.
+ */
+const XGenEvent *
+xgen_dispatch_lookup_event (const XGenDispatch *dispatch,
+			    const guint8 *data,
+			    gsize len,
+			    XGenByteOrder byte_order)
+{
+  guint8 code;
+
+  if (len < 1)
+    return NULL;
+
+  code = data[0] & EVENT_CODE_MASK;
+  if (code == X_GENERIC_EVENT && len >= 10)
+    {
+      const XGenEvent **events = dispatch->generic_events[data[1]];
+
+      if (events)
+	{
+	  guint event_type =
+	    _xgen_read_unsigned (data + 8, 2, _XGEN_NEEDS_SWAP (byte_order));
+
+	  if (event_type < dispatch->n_generic_events[data[1]]
+	      && events[event_type])
+	    return events[event_type];
+	}
+    }
+
+  return dispatch->events[code];
+}
+
+/**
+ * xgen_dispatch_lookup_error:
+ * @dispatch: A dispatcher
+ * @data: The start of a raw error
+ * @len: The number of bytes available at @data
+ *
+ * This function returns the error definition for the error code of @data
+ * or NULL if it isn't registered.
+ */
+const XGenError *
+xgen_dispatch_lookup_error (const XGenDispatch *dispatch,
+			    const guint8 *data,
+			    gsize len)
+{
+  if (len < 2 || data[0] != 0)
+    return NULL;
+  return dispatch->errors[data[1]];
+}
+
+static const ExtensionCodes *
+get_extension_codes (const XGenDispatch *dispatch,
+		     const XGenDefinition *def)
+{
+  /* Looked up by name since pruned states have their own copies of the
+   * extensions */
+  return g_hash_table_lookup (dispatch->extension_codes,
+			      def->extension->header);
+}
+
+/**
+ * xgen_dispatch_get_request_opcode:
+ * @dispatch: A dispatcher
+ * @request: A request definition
+ * @major_opcode: Return location for the major opcode
+ * @minor_opcode: Return location for the minor opcode, or -1 for a core
+ *		  request
+ *
+ * This function returns FALSE if the request's extension isn't registered.
+ */
+gboolean
+xgen_dispatch_get_request_opcode (const XGenDispatch *dispatch,
+				  const XGenRequest *request,
+				  guint8 *major_opcode,
+				  gint *minor_opcode)
+{
+  const XGenDefinition *def = XGEN_DEF (request);
+  const ExtensionCodes *codes;
+
+  if (is_core (def->extension))
+    {
+      *major_opcode = request->opcode;
+      *minor_opcode = -1;
+      return TRUE;
+    }
+
+  codes = get_extension_codes (dispatch, def);
+  if (!codes)
+    return FALSE;
+  *major_opcode = codes->major_opcode;
+  *minor_opcode = request->opcode;
+  return TRUE;
+}
+
+/**
+ * xgen_dispatch_get_event_code:
+ * @dispatch: A dispatcher
+ * @event: An event definition
+ * @code: Return location for the event code
+ *
+ * The code of a generic event is that of the core GenericEvent; see
+ * xgen_dispatch_get_generic_event_opcode() for the rest of its header.
+ *
+ * This function returns FALSE if the event's extension isn't registered.
+ */
+gboolean
+xgen_dispatch_get_event_code (const XGenDispatch *dispatch,
+			      const XGenEvent *event,
+			      guint8 *code)
+{
+  const XGenDefinition *def = XGEN_DEF (event);
+  const ExtensionCodes *codes;
+
+  if (is_core (def->extension))
+    {
+      *code = event->number;
+      return TRUE;
+    }
+
+  codes = get_extension_codes (dispatch, def);
+  if (!codes)
+    return FALSE;
+  if (event->is_generic)
+    *code = X_GENERIC_EVENT;
+  else
+    *code = codes->first_event + event->number;
+  return TRUE;
+}
+
+/**
+ * xgen_dispatch_get_generic_event_opcode:
+ * @dispatch: A dispatcher
+ * @event: A generic event definition
+ * @major_opcode: Return location for the major opcode of the event's
+ *		  extension
+ * @event_type: Return location for the event type
+ *
+ * This function returns FALSE if @event isn't a generic event or its
+ * extension isn't registered.
+ */
+gboolean
+xgen_dispatch_get_generic_event_opcode (const XGenDispatch *dispatch,
+					const XGenEvent *event,
+					guint8 *major_opcode,
+					guint16 *event_type)
+{
+  const ExtensionCodes *codes;
+
+  if (!event->is_generic)
+    return FALSE;
+
+  codes = get_extension_codes (dispatch, XGEN_DEF (event));
+  if (!codes)
+    return FALSE;
+  *major_opcode = codes->major_opcode;
+  *event_type = event->number;
+  return TRUE;
+}
+
+/**
+ * xgen_dispatch_get_error_code:
+ * @dispatch: A dispatcher
+ * @error: An error definition
+ * @code: Return location for the error code
+ *
+ * This function returns FALSE if the error's extension isn't registered.
+ */
+gboolean
+xgen_dispatch_get_error_code (const XGenDispatch *dispatch,
+			      const XGenError *error,
+			      guint8 *code)
+{
+  const XGenDefinition *def = XGEN_DEF (error);
+  const ExtensionCodes *codes;
+
+  if (is_core (def->extension))
+    {
+      *code = error->number;
+      return TRUE;
+    }
+
+  codes = get_extension_codes (dispatch, def);
+  if (!codes)
+    return FALSE;
+  *code = codes->first_error + error->number;
+  return TRUE;
+}
+
+void
+xgen_dispatch_free (XGenDispatch *dispatch)
+{
+  guint i;
+
+  for (i = CORE_OPCODE_LIMIT; i < 256; i++)
+    {
+      g_free (dispatch->extension_requests[i]);
+      g_free (dispatch->generic_events[i]);
+    }
+  g_hash_table_destroy (dispatch->extension_codes);
+  g_free (dispatch);
+}
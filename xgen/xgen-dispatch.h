@@ -0,0 +1,58 @@
+#ifndef _XGEN_DISPATCH_H_
+#define _XGEN_DISPATCH_H_
+
+#include <xgen.h>
+
+#include <glib.h>
+
+/**
+ * Maps the first bytes of raw messages to their definitions.
+ *
+ * Core requests, events and errors are registered when the dispatcher is
+ * created. Extensions are assigned their major opcode, first event and
+ * first error by the server at runtime so they have to be registered
+ * explicitly, typically with the values of a QueryExtension reply.
+ * Generic events are found with two array lookups, by the major opcode
+ * and then the event type in their header.
+ *
+ * A dispatcher should be completely set up before use; lookups don't
+ * modify it so it can then be shared between threads.
+ */
+typedef struct _XGenDispatch XGenDispatch;
+
+XGenDispatch *xgen_dispatch_new (const XGenState *state);
+gboolean xgen_dispatch_add_extension (XGenDispatch *dispatch,
+				      const char *header,
+				      guint8 major_opcode,
+				      guint8 first_event,
+				      guint8 first_error);
+
+const XGenRequest *xgen_dispatch_lookup_request (const XGenDispatch *dispatch,
+						 const guint8 *data,
+						 gsize len);
+const XGenEvent *xgen_dispatch_lookup_event (const XGenDispatch *dispatch,
+					     const guint8 *data,
+					     gsize len,
+					     XGenByteOrder byte_order);
+const XGenError *xgen_dispatch_lookup_error (const XGenDispatch *dispatch,
+					     const guint8 *data,
+					     gsize len);
+
+gboolean xgen_dispatch_get_request_opcode (const XGenDispatch *dispatch,
+					   const XGenRequest *request,
+					   guint8 *major_opcode,
+					   gint *minor_opcode);
+gboolean xgen_dispatch_get_event_code (const XGenDispatch *dispatch,
+				       const XGenEvent *event,
+				       guint8 *code);
+gboolean xgen_dispatch_get_generic_event_opcode (const XGenDispatch *dispatch,
+						 const XGenEvent *event,
+						 guint8 *major_opcode,
+						 guint16 *event_type);
+gboolean xgen_dispatch_get_error_code (const XGenDispatch *dispatch,
+				       const XGenError *error,
+				       guint8 *code);
+
+void xgen_dispatch_free (XGenDispatch *dispatch);
+
+#endif /* _XGEN_DISPATCH_H_ */
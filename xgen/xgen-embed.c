@@ -0,0 +1,91 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-embed.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+/* Bump this whenever the structures written by xgen-embed change in a
+ * way the compiler wouldn't catch */
+#define EMBED_FORMAT_VERSION 5
+
+/**
+ * xgen_embed_get_abi:
+ *
+ * Layouts record facts about the host, such as whether they match the
+ * equivalent C structs, so an embedded state is only valid on hosts that
+ * agree with the one it was generated on.
+ *
+ * This function returns a value identifying the embedding format along
+ * with the host byte order and base type alignments.
+ */
+guint32
+xgen_embed_get_abi (void)
+{
+  return EMBED_FORMAT_VERSION << 24
+    | (G_BYTE_ORDER == G_LITTLE_ENDIAN) << 20
+    | _xgen_base_type_alignment (XGEN_UNSIGNED, 2) << 16
+    | _xgen_base_type_alignment (XGEN_UNSIGNED, 4) << 12
+    | _xgen_base_type_alignment (XGEN_UNSIGNED, 8) << 8
+    | _xgen_base_type_alignment (XGEN_FLOAT, 4) << 4
+    | _xgen_base_type_alignment (XGEN_DOUBLE, 8);
+}
+
+/**
+ * xgen_embedded_state_load:
+ * @embedded: A state generated by xgen-embed
+ *
+ * Gives access to an embedded state through the same API as a state
+ * returned by xgen_parse_xcb_proto_files(). Nothing is copied, so the
+ * state mustn't be modified; in particular xgen_definition_set_private()
+ * can't be used with its definitions.
+ *
+ * This function returns the state, or NULL if it was generated for a
+ * host with a different ABI, e.g. when cross compiling.
+ */
+const XGenState *
+xgen_embedded_state_load (const XGenEmbeddedState *embedded)
+{
+  if (embedded->abi != xgen_embed_get_abi ())
+    {
+      g_warning ("The embedded protocol state was generated for a "
+		 "different host (ABI 0x%08x, expected 0x%08x)",
+		 embedded->abi, xgen_embed_get_abi ());
+      return NULL;
+    }
+  return embedded->state;
+}
+
+/**
+ * xgen_embedded_state_get_names:
+ * @embedded: A state generated by xgen-embed
+ *
+ * Gives access to the name tables written along with an embedded state,
+ * for finding its definitions by name without building them at run
+ * time.
+ *
+ * This function returns the tables, or NULL if the state was generated
+ * for a host with a different ABI.
+ */
+const XGenNames *
+xgen_embedded_state_get_names (const XGenEmbeddedState *embedded)
+{
+  if (!xgen_embedded_state_load (embedded))
+    return NULL;
+  return embedded->names;
+}
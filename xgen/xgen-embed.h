@@ -0,0 +1,37 @@
+#ifndef _XGEN_EMBED_H_
+#define _XGEN_EMBED_H_
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-names.h>
+
+#include <glib.h>
+
+/**
+ * A parsed protocol description compiled into a program as static const
+ * data by the xgen-embed tool, e.g.:
+ *
+ *   xgen-embed -n xproto_embedded -o xproto-embedded.c xproto.xml
+ *
+ * and then:
+ *
+ *   extern const XGenEmbeddedState xproto_embedded;
+ *   const XGenState *state = xgen_embedded_state_load (&xproto_embedded);
+ *
+ * The state, with its layouts and name tables, needs no parsing or
+ * allocation and lives in read-only pages shared between every process
+ * using it.
+ */
+typedef struct _XGenEmbeddedState
+{
+  guint32	   abi;	  /* xgen_embed_get_abi() where it was generated */
+  const XGenState *state;
+  const XGenNames *names;
+} XGenEmbeddedState;
+
+guint32 xgen_embed_get_abi (void);
+const XGenState *xgen_embedded_state_load (const XGenEmbeddedState *embedded);
+const XGenNames *
+xgen_embedded_state_get_names (const XGenEmbeddedState *embedded);
+
+#endif /* _XGEN_EMBED_H_ */
@@ -0,0 +1,795 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-dispatch.h>
+#include <xgen-encoder.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+/* A run of output that is either in the buffer's own storage or, for
+ * large lists, in memory owned by the caller */
+typedef struct _Span
+{
+  const guint8 *external;
+  gsize		offset;	 /* Into the buffer storage, if not external */
+  gsize		len;
+} Span;
+
+struct _XGenOutputBuffer
+{
+  guint8 *data;
+  gsize	  len;
+  gsize	  allocated;
+
+  GArray *spans;      /* Completed spans */
+  gsize	  span_start; /* The start of the span still being written */
+
+  gsize	  size;	      /* Total bytes of encoded requests */
+  guint	  n_requests;
+};
+
+/* Per request details worked out once per encoder */
+typedef struct _EncodePlan
+{
+  gint	opcode_index;
+  gint	length_index;
+  gint *list_length_index; /* For each list field, the index of the
+			      scalar field holding its length or -1 */
+} EncodePlan;
+
+struct _XGenEncoder
+{
+  const XGenDispatch *dispatch;
+  gboolean	      swap;
+  guint32	      max_request_length;
+  guint32	      big_request_length;
+  gsize		      zero_copy_threshold;
+
+  GHashTable	     *plans; /* XGenLayout -> EncodePlan */
+};
+
+/**
+ * xgen_output_buffer_new:
+ *
+ * Creates an empty buffer that requests can be appended to with
+ * xgen_encoder_append().
+ */
+XGenOutputBuffer *
+xgen_output_buffer_new (void)
+{
+  XGenOutputBuffer *buffer = g_new0 (XGenOutputBuffer, 1);
+
+  buffer->allocated = 4096;
+  buffer->data = g_malloc (buffer->allocated);
+  buffer->spans = g_array_new (FALSE, FALSE, sizeof (Span));
+
+  return buffer;
+}
+
+static inline guint8 *
+buffer_reserve (XGenOutputBuffer *buffer, gsize n)
+{
+  if (G_UNLIKELY (buffer->len + n > buffer->allocated))
+    {
+      while (buffer->len + n > buffer->allocated)
+	buffer->allocated *= 2;
+      buffer->data = g_realloc (buffer->data, buffer->allocated);
+    }
+  return buffer->data + buffer->len;
+}
+
+static void
+buffer_add_external (XGenOutputBuffer *buffer, const guint8 *data, gsize len)
+{
+  Span span;
+
+  if (buffer->len > buffer->span_start)
+    {
+      span.external = NULL;
+      span.offset = buffer->span_start;
+      span.len = buffer->len - buffer->span_start;
+      g_array_append_val (buffer->spans, span);
+    }
+
+  span.external = data;
+  span.offset = 0;
+  span.len = len;
+  g_array_append_val (buffer->spans, span);
+
+  buffer->span_start = buffer->len;
+}
+
+/**
+ * xgen_output_buffer_get_size:
+ * @buffer: An output buffer
+ *
+ * This function returns the number of bytes of encoded requests.
+ */
+gsize
+xgen_output_buffer_get_size (const XGenOutputBuffer *buffer)
+{
+  return buffer->size;
+}
+
+/**
+ * xgen_output_buffer_get_n_requests:
+ * @buffer: An output buffer
+ *
+ * This can be used to keep track of the sequence numbers of the requests.
+ *
+ * This function returns the number of requests in the buffer.
+ */
+guint
+xgen_output_buffer_get_n_requests (const XGenOutputBuffer *buffer)
+{
+  return buffer->n_requests;
+}
+
+/**
+ * xgen_output_buffer_clear:
+ * @buffer: An output buffer
+ *
+ * Discards all the requests in the buffer; the storage is kept for reuse.
+ */
+void
+xgen_output_buffer_clear (XGenOutputBuffer *buffer)
+{
+  buffer->len = 0;
+  buffer->span_start = 0;
+  buffer->size = 0;
+  buffer->n_requests = 0;
+  g_array_set_size (buffer->spans, 0);
+}
+
+/**
+ * xgen_output_buffer_append_raw:
+ * @buffer: An output buffer
+ * @data: A complete request in the byte order of the connection
+ * @len: The length of @data in bytes
+ *
+ * Copies a request that is already encoded, e.g. one read from a
+ * capture, into the buffer.
+ *
+ * This function returns the copy, which may be changed in place until
+ * another request is appended.
+ */
+guint8 *
+xgen_output_buffer_append_raw (XGenOutputBuffer *buffer,
+			       const guint8 *data,
+			       gsize len)
+{
+  guint8 *copy = buffer_reserve (buffer, len);
+
+  memcpy (copy, data, len);
+  buffer->len += len;
+  buffer->size += len;
+  buffer->n_requests++;
+
+  return copy;
+}
+
+/**
+ * xgen_output_buffer_flush:
+ * @buffer: An output buffer
+ * @fd: The file descriptor of the connection
+ *
+ * Writes all of the requests in the buffer with as few writev() calls as
+ * possible and then clears the buffer. The buffer is cleared even if
+ * writing fails.
+ *
+ * This function returns FALSE if writing failed.
+ */
+gboolean
+xgen_output_buffer_flush (XGenOutputBuffer *buffer, int fd)
+{
+  struct iovec iov[_XGEN_IOV_MAX];
+  gboolean ret = TRUE;
+  int n_iov = 0;
+  guint i;
+
+  /* Close the span still being written */
+  buffer_add_external (buffer, NULL, 0);
+
+  for (i = 0; i < buffer->spans->len && ret; i++)
+    {
+      Span *span = &g_array_index (buffer->spans, Span, i);
+
+      if (!span->len)
+	continue;
+
+      iov[n_iov].iov_base = span->external
+	? (void *)span->external : buffer->data + span->offset;
+      iov[n_iov].iov_len = span->len;
+      if (++n_iov == _XGEN_IOV_MAX)
+	{
+	  ret = _xgen_writev_all (fd, iov, n_iov);
+	  n_iov = 0;
+	}
+    }
+  if (ret && n_iov)
+    ret = _xgen_writev_all (fd, iov, n_iov);
+  if (!ret)
+    g_warning ("Failed to write requests: %s", strerror (errno));
+
+  xgen_output_buffer_clear (buffer);
+  return ret;
+}
+
+void
+xgen_output_buffer_free (XGenOutputBuffer *buffer)
+{
+  g_array_free (buffer->spans, TRUE);
+  g_free (buffer->data);
+  g_free (buffer);
+}
+
+/**
+ * xgen_encoder_new:
+ * @dispatch: A dispatcher with the extensions whose requests will be
+ *	      encoded registered, or NULL for core requests only
+ * @byte_order: The byte order of the connection
+ *
+ * Creates a request encoder. The maximum request length defaults to the
+ * core protocol limit with BIG-REQUESTS disabled.
+ */
+XGenEncoder *
+xgen_encoder_new (const XGenDispatch *dispatch, XGenByteOrder byte_order)
+{
+  XGenEncoder *encoder = g_new0 (XGenEncoder, 1);
+
+  encoder->dispatch = dispatch;
+  encoder->swap = _XGEN_NEEDS_SWAP (byte_order);
+  encoder->max_request_length = 65535;
+  encoder->plans = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  return encoder;
+}
+
+/**
+ * xgen_encoder_set_max_request_length:
+ * @encoder: An encoder
+ * @max_request_length: The maximum request length in 4 byte units from
+ *			the connection setup
+ * @big_request_length: The maximum request length in 4 byte units from
+ *			BigReqEnable, or 0 if BIG-REQUESTS isn't enabled
+ *
+ * Requests longer than @max_request_length are encoded in the
+ * BIG-REQUESTS form if it's enabled.
+ */
+void
+xgen_encoder_set_max_request_length (XGenEncoder *encoder,
+				     guint32 max_request_length,
+				     guint32 big_request_length)
+{
+  encoder->max_request_length = MIN (max_request_length, 65535);
+  encoder->big_request_length = big_request_length;
+}
+
+/**
+ * xgen_encoder_set_zero_copy_threshold:
+ * @encoder: An encoder
+ * @threshold: The size in bytes above which list data isn't copied, or 0
+ *	       to always copy
+ *
+ * Large lists, such as the data of a PutImage, can be written straight
+ * from the caller's memory instead of being copied into the output
+ * buffer. This is only possible when the list doesn't need byte swapping
+ * and the caller must then keep the data unchanged until the buffer has
+ * been flushed or cleared.
+ */
+void
+xgen_encoder_set_zero_copy_threshold (XGenEncoder *encoder, gsize threshold)
+{
+  encoder->zero_copy_threshold = threshold;
+}
+
+static EncodePlan *
+get_plan (XGenEncoder *encoder, const XGenLayout *layout)
+{
+  EncodePlan *plan = g_hash_table_lookup (encoder->plans, layout);
+  guint i;
+
+  if (plan)
+    return plan;
+
+  plan = g_new0 (EncodePlan, 1);
+  plan->opcode_index = layout->definition->type == XGEN_REQUEST
+    ? xgen_layout_find_field (layout, "opcode") : -1;
+  /* A struct's length field is an ordinary value, e.g. that of Setup */
+  plan->length_index = layout->definition->type == XGEN_REQUEST
+    || layout->definition->type == XGEN_REPLY
+    ? xgen_layout_find_field (layout, "length") : -1;
+  plan->list_length_index = g_new (gint, layout->n_fields);
+
+  for (i = 0; i < layout->n_fields; i++)
+    {
+      const XGenFieldDefinition *field = layout->fields[i].field;
+      gint index = -1;
+
+      if (layout->fields[i].kind == XGEN_LAYOUT_LIST
+	  && field->length && field->length->type == XGEN_FIELDREF)
+	{
+	  index = xgen_layout_find_field (layout, field->length->field);
+	  if (index >= 0 && layout->fields[index].kind != XGEN_LAYOUT_SCALAR)
+	    index = -1;
+	}
+      plan->list_length_index[i] = index;
+    }
+
+  g_hash_table_insert (encoder->plans, (gpointer)layout, plan);
+  return plan;
+}
+
+static void
+plan_free (gpointer key, gpointer value, gpointer user_data)
+{
+  EncodePlan *plan = value;
+
+  g_free (plan->list_length_index);
+  g_free (plan);
+}
+
+/* Swaps list elements, or an inline struct, from host order in place. A
+ * NULL @type means plain @size byte integers. */
+static void
+swap_elements (const XGenDefinition *type,
+	       guint size,
+	       guint8 *data,
+	       guint32 count)
+{
+  const XGenLayout *layout;
+  guint32 i;
+  guint j;
+
+  if (size == 1)
+    return;
+
+  if (!type || (type->type != XGEN_STRUCT && type->type != XGEN_UNION))
+    {
+      if (size == 2 || size == 4)
+	_xgen_convert_elements (data, size, TRUE, count, data, size);
+      else if (size == 8)
+	for (i = 0; i < count; i++, data += 8)
+	  {
+	    guint64 value;
+	    memcpy (&value, data, 8);
+	    value = GUINT64_SWAP_LE_BE (value);
+	    memcpy (data, &value, 8);
+	  }
+      return;
+    }
+
+  /* The members of a union can't be told apart so they're sent as is */
+  layout = xgen_definition_get_layout (type);
+  if (type->type == XGEN_UNION || !layout->is_fixed)
+    return;
+
+  for (i = 0; i < count; i++, data += size)
+    for (j = 0; j < layout->n_fields; j++)
+      {
+	const XGenFieldLayout *field_layout = &layout->fields[j];
+	const XGenExpression *length = field_layout->field->length;
+
+	switch (field_layout->kind)
+	  {
+	  case XGEN_LAYOUT_SCALAR:
+	  case XGEN_LAYOUT_STRUCT:
+	    swap_elements (field_layout->type, field_layout->size,
+			   data + field_layout->offset, 1);
+	    break;
+	  case XGEN_LAYOUT_LIST:
+	    swap_elements (field_layout->type, field_layout->size,
+			   data + field_layout->offset, length->value);
+	    break;
+	  default:
+	    break;
+	  }
+      }
+}
+
+/* Appends @count host order elements, swapping them as needed, and
+ * returns the number of bytes added to the request */
+static gsize
+put_elements (XGenEncoder *encoder,
+	      XGenOutputBuffer *buffer,
+	      const XGenDefinition *type,
+	      guint size,
+	      const void *data,
+	      guint32 count)
+{
+  gsize len = (gsize)size * count;
+  guint8 *dest;
+
+  if (!len)
+    return 0;
+
+  if (data && encoder->zero_copy_threshold
+      && len >= encoder->zero_copy_threshold
+      && (!encoder->swap || size == 1))
+    {
+      buffer_add_external (buffer, data, len);
+      return len;
+    }
+
+  dest = buffer_reserve (buffer, len);
+  if (data)
+    {
+      memcpy (dest, data, len);
+      if (encoder->swap)
+	swap_elements (type, size, dest, count);
+    }
+  else
+    memset (dest, 0, len);
+  buffer->len += len;
+
+  return len;
+}
+
+static gsize
+put_zeros (XGenOutputBuffer *buffer, gsize len)
+{
+  memset (buffer_reserve (buffer, len), 0, len);
+  buffer->len += len;
+  return len;
+}
+
+/* Inserts the 32bit length of the BIG-REQUESTS form after the first 4
+ * bytes of the request starting at @start */
+static void
+insert_big_length (XGenEncoder *encoder,
+		   XGenOutputBuffer *buffer,
+		   gsize start,
+		   guint first_span,
+		   guint32 length)
+{
+  guint8 *header;
+  guint i;
+
+  buffer_reserve (buffer, 4);
+  memmove (buffer->data + start + 8, buffer->data + start + 4,
+	   buffer->len - (start + 4));
+  buffer->len += 4;
+
+  /* Spans of this request that follow the header move along while the
+   * one holding the header grows */
+  for (i = first_span; i < buffer->spans->len; i++)
+    {
+      Span *span = &g_array_index (buffer->spans, Span, i);
+
+      if (span->external)
+	continue;
+      if (span->offset <= start)
+	span->len += 4;
+      else
+	span->offset += 4;
+    }
+  if (buffer->span_start > start)
+    buffer->span_start += 4;
+
+  header = buffer->data + start;
+  _xgen_write_unsigned (header + 2, 2, 0, encoder->swap);
+  _xgen_write_unsigned (header + 4, 4, length, encoder->swap);
+}
+
+static gsize put_fields (XGenEncoder *encoder,
+			 XGenOutputBuffer *buffer,
+			 const XGenLayout *layout,
+			 const EncodePlan *plan,
+			 gsize start,
+			 const XGenEncodeValue *values);
+
+/* Appends @count variable sized structs, each given by its own array of
+ * values, and returns the number of bytes added */
+static gsize
+put_structs (XGenEncoder *encoder,
+	     XGenOutputBuffer *buffer,
+	     const XGenDefinition *type,
+	     const XGenEncodeValue *const *elements,
+	     guint32 count)
+{
+  const XGenLayout *layout = xgen_definition_get_layout (type);
+  EncodePlan *plan = get_plan (encoder, layout);
+  gsize len = 0;
+  guint32 i;
+
+  for (i = 0; i < count && elements; i++)
+    {
+      gsize start = buffer->len;
+
+      put_zeros (buffer, layout->fixed_size);
+      len += put_fields (encoder, buffer, layout, plan, start, elements[i]);
+    }
+
+  return len;
+}
+
+/* TRUE if a field lies within the fixed part of its request, which is
+ * written in place rather than appended */
+static inline gboolean
+in_fixed_part (const XGenLayout *layout, const XGenFieldLayout *field_layout)
+{
+  return field_layout->offset != XGEN_LAYOUT_VARIABLE_OFFSET
+    && (guint)field_layout->offset < layout->fixed_size;
+}
+
+/* Writes the fields of a message or struct whose fixed part starts at
+ * @start and has already been zeroed, and returns the length of the
+ * message so far */
+static gsize
+put_fields (XGenEncoder *encoder,
+	    XGenOutputBuffer *buffer,
+	    const XGenLayout *layout,
+	    const EncodePlan *plan,
+	    gsize start,
+	    const XGenEncodeValue *values)
+{
+  gboolean swap = encoder->swap;
+  gsize message_len = layout->fixed_size;
+  guint i;
+
+  for (i = 0; i < layout->n_fields; i++)
+    {
+      const XGenFieldLayout *field_layout = &layout->fields[i];
+      const XGenEncodeValue *value = &values[i];
+      guint8 *dest;
+      guint32 count = 1;
+
+      if ((gint)i == plan->opcode_index || (gint)i == plan->length_index)
+	continue;
+
+      switch (field_layout->kind)
+	{
+	case XGEN_LAYOUT_SCALAR:
+	  if (in_fixed_part (layout, field_layout))
+	    dest = buffer->data + start + field_layout->offset;
+	  else
+	    {
+	      dest = buffer_reserve (buffer, field_layout->size);
+	      buffer->len += field_layout->size;
+	      message_len += field_layout->size;
+	    }
+	  _xgen_write_unsigned (dest, field_layout->size, value->value, swap);
+	  break;
+
+	case XGEN_LAYOUT_LIST:
+	  if (field_layout->field->length->type == XGEN_VALUE)
+	    count = field_layout->field->length->value;
+	  else
+	    {
+	      gint length_index = plan->list_length_index[i];
+
+	      count = value->count;
+	      if (length_index >= 0
+		  && in_fixed_part (layout, &layout->fields[length_index]))
+		_xgen_write_unsigned (buffer->data + start
+				      + layout->fields[length_index].offset,
+				      layout->fields[length_index].size,
+				      count, swap);
+	    }
+	  /* Fall through */
+	case XGEN_LAYOUT_STRUCT:
+	  if (!field_layout->size && field_layout->type
+	      && field_layout->type->type == XGEN_STRUCT)
+	    message_len += put_structs (encoder, buffer, field_layout->type,
+					value->data, count);
+	  else if (in_fixed_part (layout, field_layout))
+	    {
+	      /* Already zeroed if there's no data, as for a pad */
+	      if (!value->data)
+		break;
+	      dest = buffer->data + start + field_layout->offset;
+	      memcpy (dest, value->data, field_layout->size * count);
+	      if (swap)
+		swap_elements (field_layout->type, field_layout->size,
+			       dest, count);
+	    }
+	  else
+	    message_len += put_elements (encoder, buffer, field_layout->type,
+					 field_layout->size, value->data,
+					 count);
+	  break;
+
+	case XGEN_LAYOUT_VALUEPARAM:
+	  /* The mask padded to 4 bytes, then a CARD32 per set bit */
+	  message_len += put_zeros (buffer, _XGEN_ALIGN4 (field_layout->size));
+	  _xgen_write_unsigned (buffer->data + buffer->len
+				- _XGEN_ALIGN4 (field_layout->size),
+				field_layout->size, value->value, swap);
+	  message_len += put_elements (encoder, buffer, NULL, 4, value->data,
+				       _xgen_bit_count (value->value));
+	  break;
+	}
+    }
+
+
+  return message_len;
+}
+
+/**
+ * xgen_encoder_append:
+ * @encoder: An encoder
+ * @buffer: The buffer to append the request to
+ * @request: The request to encode
+ * @values: One value per field of the request's layout, in layout order
+ *
+ * Encodes a request at the end of @buffer. The opcodes, the request length
+ * and padding are filled in, so the values given for the opcode, length
+ * and pad fields are ignored. So is the value of any field giving the
+ * length of a list, which is taken from the list's count instead.
+ *
+ * Requests too long for the maximum request length are encoded in the
+ * BIG-REQUESTS form when that's enabled.
+ *
+ * Nothing is allocated per request once the buffer has grown to its
+ * working size.
+ *
+ * This function returns FALSE, leaving the buffer unchanged, if the
+ * request's extension isn't registered with the dispatcher or the
+ * request is too long.
+ */
+gboolean
+xgen_encoder_append (XGenEncoder *encoder,
+		     XGenOutputBuffer *buffer,
+		     const XGenRequest *request,
+		     const XGenEncodeValue *values)
+{
+  const XGenDefinition *def = XGEN_DEF (request);
+  const XGenLayout *layout = xgen_definition_get_layout (def);
+  EncodePlan *plan = get_plan (encoder, layout);
+  gboolean swap = encoder->swap;
+  gsize start = buffer->len;
+  gsize start_span_start = buffer->span_start;
+  guint first_span = buffer->spans->len;
+  guint8 major_opcode = request->opcode;
+  gint minor_opcode = -1;
+  gsize message_len;
+  guint32 length;
+
+  if (encoder->dispatch)
+    {
+      if (!xgen_dispatch_get_request_opcode (encoder->dispatch, request,
+					     &major_opcode, &minor_opcode))
+	{
+	  g_warning ("Can't encode %s: the %s extension isn't registered",
+		     def->name, def->extension->header);
+	  return FALSE;
+	}
+    }
+  else if (strcmp (def->extension->header, "xproto") != 0)
+    {
+      g_warning ("Can't encode extension request %s without a dispatcher",
+		 def->name);
+      return FALSE;
+    }
+
+  put_zeros (buffer, layout->fixed_size);
+  message_len = put_fields (encoder, buffer, layout, plan, start, values);
+
+  if (_XGEN_ALIGN4 (message_len) != message_len)
+    message_len += put_zeros (buffer,
+			      _XGEN_ALIGN4 (message_len) - message_len);
+
+  buffer->data[start] = major_opcode;
+  if (minor_opcode >= 0)
+    buffer->data[start + 1] = minor_opcode;
+
+  length = message_len / 4;
+  if (length <= encoder->max_request_length)
+    _xgen_write_unsigned (buffer->data + start + 2, 2, length, swap);
+  else if (length < encoder->big_request_length)
+    {
+      insert_big_length (encoder, buffer, start, first_span, length + 1);
+      message_len += 4;
+    }
+  else
+    {
+      g_warning ("Can't encode %s: %lu bytes is longer than the maximum "
+		 "request length", def->name, (unsigned long)message_len);
+      buffer->len = start;
+      buffer->span_start = start_span_start;
+      g_array_set_size (buffer->spans, first_span);
+      return FALSE;
+    }
+
+  buffer->size += message_len;
+  buffer->n_requests++;
+  return TRUE;
+}
+
+/**
+ * xgen_encoder_append_reply:
+ * @encoder: An encoder
+ * @buffer: The buffer to append the reply to
+ * @reply: The reply to encode
+ * @sequence: The sequence number of the request being answered
+ * @values: One value per field of the reply's layout, in layout order
+ *
+ * Encodes a reply at the end of @buffer, for programs standing in for an
+ * X server. The response type, sequence number, reply length and padding
+ * are filled in, as are the lengths of lists as with
+ * xgen_encoder_append(). Replies are padded to the 32 byte minimum.
+ */
+void
+xgen_encoder_append_reply (XGenEncoder *encoder,
+			   XGenOutputBuffer *buffer,
+			   const XGenReply *reply,
+			   guint16 sequence,
+			   const XGenEncodeValue *values)
+{
+  const XGenDefinition *def = XGEN_DEF (reply);
+  const XGenLayout *layout = xgen_definition_get_layout (def);
+  EncodePlan *plan = get_plan (encoder, layout);
+  gsize start = buffer->len;
+  gsize message_len;
+
+  put_zeros (buffer, layout->fixed_size);
+  message_len = put_fields (encoder, buffer, layout, plan, start, values);
+
+  if (message_len < 32)
+    message_len += put_zeros (buffer, 32 - message_len);
+  else if (_XGEN_ALIGN4 (message_len) != message_len)
+    message_len += put_zeros (buffer,
+			      _XGEN_ALIGN4 (message_len) - message_len);
+
+  buffer->data[start] = 1; /* Reply */
+  _xgen_write_unsigned (buffer->data + start + 2, 2, sequence, encoder->swap);
+  _xgen_write_unsigned (buffer->data + start + 4, 4, (message_len - 32) / 4,
+			encoder->swap);
+
+  buffer->size += message_len;
+  buffer->n_requests++;
+}
+
+/**
+ * xgen_encoder_append_struct:
+ * @encoder: An encoder
+ * @buffer: The buffer to append the struct to
+ * @struct_def: The struct to encode
+ * @values: One value per field of the struct's layout, in layout order
+ *
+ * Encodes a struct that is sent on its own, such as the Setup that
+ * answers a connection, at the end of @buffer. The lengths of lists are
+ * filled in as with xgen_encoder_append() but nothing else is, so any
+ * length field the struct has must be given, and the struct isn't padded.
+ */
+void
+xgen_encoder_append_struct (XGenEncoder *encoder,
+			    XGenOutputBuffer *buffer,
+			    const XGenDefinition *struct_def,
+			    const XGenEncodeValue *values)
+{
+  const XGenLayout *layout = xgen_definition_get_layout (struct_def);
+  EncodePlan *plan = get_plan (encoder, layout);
+  gsize start = buffer->len;
+
+  put_zeros (buffer, layout->fixed_size);
+  buffer->size += put_fields (encoder, buffer, layout, plan, start, values);
+  buffer->n_requests++;
+}
+
+void
+xgen_encoder_free (XGenEncoder *encoder)
+{
+  g_hash_table_foreach (encoder->plans, plan_free, NULL);
+  g_hash_table_destroy (encoder->plans);
+  g_free (encoder);
+}
@@ -0,0 +1,71 @@
+#ifndef _XGEN_ENCODER_H_
+#define _XGEN_ENCODER_H_
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-dispatch.h>
+
+#include <glib.h>
+
+/**
+ * The value of one field of a request being encoded. An array of these
+ * is passed to xgen_encoder_append() with one entry per field of the
+ * request's layout, in the same order.
+ */
+typedef struct _XGenEncodeValue
+{
+  guint32     value;  /* A scalar value (signed values cast to guint32) or
+			 a valueparam mask */
+  guint32     count;  /* The number of list elements */
+  const void *data;   /* List elements, the values of a valueparam (one
+			 guint32 per set bit of the mask) or an inline
+			 struct, in host byte order. Variable sized structs
+			 are given as an array of pointers to the values of
+			 each element instead. */
+} XGenEncodeValue;
+
+/**
+ * Requests encoded back to back, ready to be written to a connection with
+ * as few writev() calls as possible.
+ */
+typedef struct _XGenOutputBuffer XGenOutputBuffer;
+
+/**
+ * Serialises requests for one connection. An encoder caches per request
+ * state so it isn't thread safe; use one encoder per thread.
+ */
+typedef struct _XGenEncoder XGenEncoder;
+
+XGenOutputBuffer *xgen_output_buffer_new (void);
+gsize xgen_output_buffer_get_size (const XGenOutputBuffer *buffer);
+guint xgen_output_buffer_get_n_requests (const XGenOutputBuffer *buffer);
+gboolean xgen_output_buffer_flush (XGenOutputBuffer *buffer, int fd);
+void xgen_output_buffer_clear (XGenOutputBuffer *buffer);
+guint8 *xgen_output_buffer_append_raw (XGenOutputBuffer *buffer,
+				       const guint8 *data,
+				       gsize len);
+void xgen_output_buffer_free (XGenOutputBuffer *buffer);
+
+XGenEncoder *xgen_encoder_new (const XGenDispatch *dispatch,
+			       XGenByteOrder byte_order);
+void xgen_encoder_set_max_request_length (XGenEncoder *encoder,
+					  guint32 max_request_length,
+					  guint32 big_request_length);
+void xgen_encoder_set_zero_copy_threshold (XGenEncoder *encoder,
+					   gsize threshold);
+gboolean xgen_encoder_append (XGenEncoder *encoder,
+			      XGenOutputBuffer *buffer,
+			      const XGenRequest *request,
+			      const XGenEncodeValue *values);
+void xgen_encoder_append_reply (XGenEncoder *encoder,
+				XGenOutputBuffer *buffer,
+				const XGenReply *reply,
+				guint16 sequence,
+				const XGenEncodeValue *values);
+void xgen_encoder_append_struct (XGenEncoder *encoder,
+				 XGenOutputBuffer *buffer,
+				 const XGenDefinition *struct_def,
+				 const XGenEncodeValue *values);
+void xgen_encoder_free (XGenEncoder *encoder);
+
+#endif /* _XGEN_ENCODER_H_ */
@@ -0,0 +1,506 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-dispatch.h>
+#include <xgen-filter.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+typedef enum _CheckOp
+{
+  CHECK_EQUAL,
+  CHECK_NOT_EQUAL,
+  CHECK_LESS,
+  CHECK_LESS_EQUAL,
+  CHECK_GREATER,
+  CHECK_GREATER_EQUAL,
+  CHECK_MASK
+} CheckOp;
+
+static const struct
+{
+  const char *token;
+  CheckOp     op;
+} check_ops[] = {
+  /* NB: two character operators must come first */
+  { "==", CHECK_EQUAL },
+  { "!=", CHECK_NOT_EQUAL },
+  { "<=", CHECK_LESS_EQUAL },
+  { ">=", CHECK_GREATER_EQUAL },
+  { "<", CHECK_LESS },
+  { ">", CHECK_GREATER },
+  { "&", CHECK_MASK }
+};
+
+typedef struct _Check
+{
+  gint	   offset;	/* The fixed offset or XGEN_LAYOUT_VARIABLE_OFFSET */
+  guint	   field_index;
+  guint8   width;
+  guint8   op;
+  gboolean is_signed;
+  gint64   value;
+} Check;
+
+typedef struct _Clause Clause;
+struct _Clause
+{
+  const XGenDefinition *definition;
+  const XGenLayout     *layout;
+  gint			minor_opcode;	/* The required second byte; -1 unless
+					   an extension request, or a generic
+					   event where it's the major
+					   opcode */
+  gint			event_type;	/* -1 unless a generic event */
+  guint			n_checks;
+  Check		       *checks;
+  guint			n_extent_fields; /* Non zero if any check needs the
+					    message to be walked */
+  Clause	       *next;		/* The next clause for the same
+					   first byte */
+};
+
+struct _XGenFilter
+{
+  /* Indexed by the first byte of a request, the event code or the error
+   * code so most messages are rejected with a single lookup */
+  Clause *requests[256];
+  Clause *events[128];
+  Clause *errors[256];
+
+  GList  *clauses;
+};
+
+static const XGenDefinition *
+resolve_definition (const XGenState *state, const char *name)
+{
+  static const XGenType types[] = { XGEN_REQUEST, XGEN_EVENT, XGEN_ERROR };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (types); i++)
+    {
+      const XGenDefinition *def =
+	xgen_state_find_definition (state, name, types[i]);
+      if (def)
+	return def;
+    }
+  return NULL;
+}
+
+static gboolean
+parse_check (const XGenLayout *layout,
+	     const char *field_name,
+	     CheckOp op,
+	     const char *value,
+	     Check *check)
+{
+  const XGenFieldLayout *field_layout;
+  char *end;
+  gint index;
+
+  index = _xgen_layout_find_field_or_mask (layout, field_name);
+  if (index < 0)
+    {
+      g_warning ("Filter: %s has no field \"%s\"",
+		 layout->definition->name, field_name);
+      return FALSE;
+    }
+
+  field_layout = &layout->fields[index];
+  if ((field_layout->kind != XGEN_LAYOUT_SCALAR
+       && field_layout->kind != XGEN_LAYOUT_VALUEPARAM)
+      || (field_layout->size != 1 && field_layout->size != 2
+	  && field_layout->size != 4))
+    {
+      g_warning ("Filter: %s.%s isn't an integer field",
+		 layout->definition->name, field_name);
+      return FALSE;
+    }
+
+  check->value = g_ascii_strtoll (value, &end, 0);
+  if (end == value || *end != '\0')
+    {
+      g_warning ("Filter: \"%s\" isn't an integer", value);
+      return FALSE;
+    }
+
+  check->offset = field_layout->offset;
+  check->field_index = index;
+  check->width = field_layout->size;
+  check->op = op;
+  check->is_signed = field_layout->kind == XGEN_LAYOUT_SCALAR
+		     && field_layout->type->type == XGEN_SIGNED;
+
+  return TRUE;
+}
+
+/* Parses one term, "Definition" or "Definition.field OP value", adding
+ * any check to the clause. All the terms of a clause have to refer to
+ * the same definition. */
+static gboolean
+parse_term (const XGenState *state, Clause *clause, const char *term)
+{
+  const XGenDefinition *def;
+  char *lhs;
+  char *field_name = NULL;
+  char *value = NULL;
+  CheckOp op = CHECK_EQUAL;
+  gboolean ret = FALSE;
+  gsize op_pos = strcspn (term, "=!<>&");
+
+  lhs = g_strstrip (g_strndup (term, op_pos));
+
+  if (term[op_pos])
+    {
+      guint i;
+
+      for (i = 0; i < G_N_ELEMENTS (check_ops); i++)
+	if (strncmp (term + op_pos, check_ops[i].token,
+		     strlen (check_ops[i].token)) == 0)
+	  break;
+      if (i == G_N_ELEMENTS (check_ops))
+	{
+	  g_warning ("Filter: Invalid operator in \"%s\"", term);
+	  goto out;
+	}
+      op = check_ops[i].op;
+      value = g_strstrip (g_strdup (term + op_pos
+				    + strlen (check_ops[i].token)));
+
+      field_name = strrchr (lhs, '.');
+      if (!field_name)
+	{
+	  g_warning ("Filter: Expected a field name in \"%s\"", term);
+	  goto out;
+	}
+      *field_name++ = '\0';
+    }
+
+  def = resolve_definition (state, lhs);
+  if (!def)
+    {
+      g_warning ("Filter: Unknown request, event or error \"%s\"", lhs);
+      goto out;
+    }
+  if (clause->definition && clause->definition != def)
+    {
+      g_warning ("Filter: \"%s\" and \"%s\" can't be combined with &&",
+		 clause->definition->name, def->name);
+      goto out;
+    }
+  clause->definition = def;
+  clause->layout = xgen_definition_get_layout (def);
+
+  if (field_name)
+    {
+      Check check;
+
+      if (!parse_check (clause->layout, field_name, op, value, &check))
+	goto out;
+
+      clause->checks = g_renew (Check, clause->checks, clause->n_checks + 1);
+      clause->checks[clause->n_checks++] = check;
+
+      if (check.offset == XGEN_LAYOUT_VARIABLE_OFFSET)
+	clause->n_extent_fields =
+	  MAX (clause->n_extent_fields, check.field_index + 1);
+    }
+
+  ret = TRUE;
+
+out:
+  g_free (lhs);
+  g_free (value);
+  return ret;
+}
+
+static void
+clause_free (Clause *clause)
+{
+  g_free (clause->checks);
+  g_free (clause);
+}
+
+static gboolean
+add_clause (XGenFilter *filter,
+	    const XGenDispatch *dispatch,
+	    Clause *clause)
+{
+  const XGenDefinition *def = clause->definition;
+  Clause **slot;
+  guint8 code;
+
+  clause->minor_opcode = -1;
+  clause->event_type = -1;
+
+  switch (def->type)
+    {
+    case XGEN_REQUEST:
+      if (!xgen_dispatch_get_request_opcode (dispatch, XGEN_REQUEST_DEF (def),
+					     &code, &clause->minor_opcode))
+	goto unregistered;
+      slot = &filter->requests[code];
+      break;
+    case XGEN_EVENT:
+      if (!xgen_dispatch_get_event_code (dispatch, XGEN_EVENT_DEF (def),
+					 &code))
+	goto unregistered;
+      if (XGEN_EVENT_DEF (def)->is_generic)
+	{
+	  guint8 major_opcode;
+	  guint16 event_type;
+
+	  xgen_dispatch_get_generic_event_opcode (dispatch,
+						  XGEN_EVENT_DEF (def),
+						  &major_opcode,
+						  &event_type);
+	  clause->minor_opcode = major_opcode;
+	  clause->event_type = event_type;
+	}
+      slot = &filter->events[code & 0x7f];
+      break;
+    case XGEN_ERROR:
+      if (!xgen_dispatch_get_error_code (dispatch, XGEN_ERROR_DEF (def),
+					 &code))
+	goto unregistered;
+      slot = &filter->errors[code];
+      break;
+    default:
+      g_assert_not_reached ();
+      return FALSE;
+    }
+
+  while (*slot)
+    slot = &(*slot)->next;
+  *slot = clause;
+
+  filter->clauses = g_list_prepend (filter->clauses, clause);
+  return TRUE;
+
+unregistered:
+  g_warning ("Filter: The \"%s\" extension of %s isn't registered with "
+	     "the dispatcher", def->extension->header, def->name);
+  return FALSE;
+}
+
+/**
+ * xgen_filter_new:
+ * @state: The parsed protocol state
+ * @dispatch: A dispatcher with any extensions used by the filter
+ *	      registered
+ * @expression: A filter expression
+ *
+ * Compiles a filter expression such as:
+ *
+ *   xproto:ConfigureWindow.window == 0x400001 || xproto:MapWindow
+ *
+ * An expression is one or more clauses separated by "||" and a clause is
+ * one or more terms separated by "&&". Each term is either a request,
+ * event or error name, which matches every such message, or a comparison
+ * of one of its integer fields with an integer constant using one of
+ * ==, !=, <, <=, >, >= or & (true if any of the given bits are set). All
+ * the terms of a clause must name the same definition. Replies can't be
+ * filtered since identifying them needs the sequence numbers of their
+ * requests.
+ *
+ * The opcodes and event and error codes are taken from @dispatch when
+ * the filter is compiled; the dispatcher isn't referenced afterwards.
+ *
+ * This function returns NULL if the expression is invalid.
+ */
+XGenFilter *
+xgen_filter_new (const XGenState *state,
+		 const XGenDispatch *dispatch,
+		 const char *expression)
+{
+  XGenFilter *filter = g_new0 (XGenFilter, 1);
+  char **clauses = g_strsplit (expression, "||", 0);
+  guint i;
+
+  for (i = 0; clauses[i]; i++)
+    {
+      Clause *clause = g_new0 (Clause, 1);
+      char **terms = g_strsplit (clauses[i], "&&", 0);
+      guint j;
+
+      for (j = 0; terms[j]; j++)
+	if (!parse_term (state, clause, terms[j]))
+	  break;
+
+      if (terms[j] || !add_clause (filter, dispatch, clause))
+	{
+	  g_strfreev (terms);
+	  g_strfreev (clauses);
+	  clause_free (clause);
+	  xgen_filter_free (filter);
+	  return NULL;
+	}
+      g_strfreev (terms);
+    }
+
+  g_strfreev (clauses);
+  return filter;
+}
+
+static gboolean
+compare (const Check *check, gint64 field_value)
+{
+  switch (check->op)
+    {
+    case CHECK_EQUAL:
+      return field_value == check->value;
+    case CHECK_NOT_EQUAL:
+      return field_value != check->value;
+    case CHECK_LESS:
+      return field_value < check->value;
+    case CHECK_LESS_EQUAL:
+      return field_value <= check->value;
+    case CHECK_GREATER:
+      return field_value > check->value;
+    case CHECK_GREATER_EQUAL:
+      return field_value >= check->value;
+    case CHECK_MASK:
+      return (field_value & check->value) != 0;
+    }
+  return FALSE;
+}
+
+static gboolean
+clause_matches (const Clause *clause,
+		const guint8 *data,
+		gsize len,
+		XGenByteOrder byte_order)
+{
+  gboolean swap = _XGEN_NEEDS_SWAP (byte_order);
+  XGenFieldExtent *extents = NULL;
+  guint shift = 0;
+  guint i;
+
+  if (len < clause->layout->min_size)
+    return FALSE;
+
+  /* BIG-REQUESTS: see request_shift() in xgen-layout.c */
+  if (clause->definition->type == XGEN_REQUEST && data[2] == 0 && data[3] == 0)
+    shift = 4;
+
+  for (i = 0; i < clause->n_checks; i++)
+    {
+      const Check *check = &clause->checks[i];
+      gsize offset;
+      gint64 value;
+
+      if (check->offset != XGEN_LAYOUT_VARIABLE_OFFSET)
+	{
+	  offset = check->offset;
+	  if (offset >= 4)
+	    offset += shift;
+	}
+      else
+	{
+	  if (!extents)
+	    {
+	      extents = g_newa (XGenFieldExtent, clause->n_extent_fields);
+	      if (!xgen_layout_get_extents (clause->layout, data, len,
+					    byte_order,
+					    clause->n_extent_fields, extents))
+		return FALSE;
+	    }
+	  offset = extents[check->field_index].offset;
+	}
+
+      if (offset + check->width > len)
+	return FALSE;
+
+      if (check->is_signed)
+	value = _xgen_read_signed (data + offset, check->width, swap);
+      else
+	value = _xgen_read_unsigned (data + offset, check->width, swap);
+
+      if (!compare (check, value))
+	return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * xgen_filter_match:
+ * @filter: A filter
+ * @direction: The direction the message was sent in
+ * @data: The start of a raw message
+ * @len: The number of bytes available at @data
+ * @byte_order: The byte order of the message
+ *
+ * Tests a raw message against the filter without decoding it. Messages
+ * of a type the filter doesn't mention are rejected after looking at
+ * their first byte (or the error code for errors).
+ *
+ * This function returns the definition of the message if it matches, so
+ * it can then be decoded, or NULL if it doesn't.
+ */
+const XGenDefinition *
+xgen_filter_match (const XGenFilter *filter,
+		   XGenDirection direction,
+		   const guint8 *data,
+		   gsize len,
+		   XGenByteOrder byte_order)
+{
+  const Clause *clause;
+
+  if (len < 1)
+    return NULL;
+
+  if (direction == XGEN_CLIENT_TO_SERVER)
+    clause = filter->requests[data[0]];
+  else if (data[0] == 0)
+    clause = len >= 2 ? filter->errors[data[1]] : NULL;
+  else if (data[0] == 1)
+    clause = NULL;
+  else
+    clause = filter->events[data[0] & 0x7f];
+
+  for (; clause; clause = clause->next)
+    {
+      if (clause->minor_opcode >= 0
+	  && (len < 2 || data[1] != clause->minor_opcode))
+	continue;
+      if (clause->event_type >= 0
+	  && (len < 10
+	      || (_xgen_read_unsigned (data + 8, 2,
+				       _XGEN_NEEDS_SWAP (byte_order))
+		  != clause->event_type)))
+	continue;
+      if (clause_matches (clause, data, len, byte_order))
+	return clause->definition;
+    }
+
+  return NULL;
+}
+
+void
+xgen_filter_free (XGenFilter *filter)
+{
+  GList *tmp;
+
+  for (tmp = filter->clauses; tmp != NULL; tmp = tmp->next)
+    clause_free (tmp->data);
+  g_list_free (filter->clauses);
+  g_free (filter);
+}
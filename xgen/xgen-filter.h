@@ -0,0 +1,26 @@
+#ifndef _XGEN_FILTER_H_
+#define _XGEN_FILTER_H_
+
+#include <xgen.h>
+#include <xgen-dispatch.h>
+
+#include <glib.h>
+
+/**
+ * A predicate over raw messages, compiled from a filter expression into
+ * offset/width/comparison checks so that messages can be selected before
+ * they are decoded. A filter is immutable once created.
+ */
+typedef struct _XGenFilter XGenFilter;
+
+XGenFilter *xgen_filter_new (const XGenState *state,
+			     const XGenDispatch *dispatch,
+			     const char *expression);
+const XGenDefinition *xgen_filter_match (const XGenFilter *filter,
+					 XGenDirection direction,
+					 const guint8 *data,
+					 gsize len,
+					 XGenByteOrder byte_order);
+void xgen_filter_free (XGenFilter *filter);
+
+#endif /* _XGEN_FILTER_H_ */
@@ -0,0 +1,283 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+/* Fingerprints are 64 bit FNV-1a hashes over a canonical serialization of
+ * a definition. Only names, numbers and the structure are hashed, never
+ * pointers or host properties, so a fingerprint is the same on every host
+ * and in every run, and changes only if the protocol description of the
+ * definition, or of a type it uses, changes. */
+
+#define FNV_OFFSET_BASIS G_GUINT64_CONSTANT (0xcbf29ce484222325)
+#define FNV_PRIME G_GUINT64_CONSTANT (0x100000001b3)
+
+static guint64 definition_fingerprint (XGenDefinition *def,
+				       GHashTable *visiting);
+
+static guint64
+hash_bytes (guint64 hash, const void *data, gsize len)
+{
+  const guint8 *bytes = data;
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    {
+      hash ^= bytes[i];
+      hash *= FNV_PRIME;
+    }
+  return hash;
+}
+
+static guint64
+hash_uint (guint64 hash, guint64 value)
+{
+  guint8 bytes[8];
+  int i;
+
+  /* Always hash in little endian order */
+  for (i = 0; i < 8; i++)
+    bytes[i] = value >> (i * 8);
+  return hash_bytes (hash, bytes, 8);
+}
+
+static guint64
+hash_string (guint64 hash, const char *string)
+{
+  /* The terminator separates adjacent strings; NULL hashes differently
+   * from "" */
+  if (!string)
+    return hash_uint (hash, 0);
+  hash = hash_uint (hash, 1);
+  return hash_bytes (hash, string, strlen (string) + 1);
+}
+
+static guint64
+hash_expression (guint64 hash, const XGenExpression *expression)
+{
+  if (!expression)
+    return hash_uint (hash, G_MAXUINT64);
+
+  hash = hash_uint (hash, expression->type);
+  switch (expression->type)
+    {
+    case XGEN_FIELDREF:
+      return hash_string (hash, expression->field);
+    case XGEN_VALUE:
+      return hash_uint (hash, expression->value);
+    case XGEN_OP:
+      hash = hash_uint (hash, expression->op);
+      hash = hash_expression (hash, expression->left);
+      return hash_expression (hash, expression->right);
+    }
+  return hash;
+}
+
+static guint64
+hash_reference (guint64 hash, XGenDefinition *def, GHashTable *visiting)
+{
+  if (!def)
+    return hash_uint (hash, 0);
+  return hash_uint (hash, definition_fingerprint (def, visiting));
+}
+
+static guint64
+hash_fields (guint64 hash, GList *fields, GHashTable *visiting)
+{
+  GList *tmp;
+
+  hash = hash_uint (hash, g_list_length (fields));
+  for (tmp = fields; tmp != NULL; tmp = tmp->next)
+    {
+      XGenFieldDefinition *field = tmp->data;
+
+      hash = hash_string (hash, field->name);
+      hash = hash_reference (hash, field->definition, visiting);
+      hash = hash_expression (hash, field->length);
+      hash = hash_uint (hash, field->implicit);
+      hash = hash_reference (hash, XGEN_DEF (field->enum_def), visiting);
+      hash = hash_uint (hash, field->is_mask);
+    }
+  return hash;
+}
+
+static guint64
+hash_items (guint64 hash, GList *items)
+{
+  GList *tmp;
+
+  hash = hash_uint (hash, g_list_length (items));
+  for (tmp = items; tmp != NULL; tmp = tmp->next)
+    {
+      XGenItemDefinition *item = tmp->data;
+
+      hash = hash_uint (hash, item->type);
+      hash = hash_string (hash, item->name);
+      hash = hash_string (hash, item->value);
+      hash = hash_uint (hash, item->bit);
+    }
+  return hash;
+}
+
+static guint64
+definition_fingerprint (XGenDefinition *def, GHashTable *visiting)
+{
+  guint64 hash = FNV_OFFSET_BASIS;
+
+  if (def->_fingerprint)
+    return def->_fingerprint;
+
+  hash = hash_uint (hash, def->type);
+  hash = hash_string (hash, def->extension ? def->extension->header : NULL);
+  hash = hash_string (hash, def->name);
+
+  /* The protocol doesn't allow recursive types but don't loop forever on
+   * a bad description; a cycle is hashed by name alone */
+  if (g_hash_table_lookup (visiting, def))
+    return hash;
+  g_hash_table_insert (visiting, def, def);
+
+  switch (def->type)
+    {
+    case XGEN_VOID:
+    case XGEN_BOOLEAN:
+    case XGEN_CHAR:
+    case XGEN_SIGNED:
+    case XGEN_UNSIGNED:
+    case XGEN_XID:
+    case XGEN_FLOAT:
+    case XGEN_DOUBLE:
+      hash = hash_uint (hash, XGEN_BASE_TYPE_DEF (def)->size);
+      break;
+    case XGEN_STRUCT:
+      hash = hash_fields (hash, XGEN_STRUCT_DEF (def)->fields, visiting);
+      break;
+    case XGEN_UNION:
+      hash = hash_fields (hash, XGEN_UNION_DEF (def)->fields, visiting);
+      break;
+    case XGEN_XIDUNION:
+      hash = hash_fields (hash, XGEN_XID_UNION_DEF (def)->fields, visiting);
+      break;
+    case XGEN_ENUM:
+      hash = hash_items (hash, XGEN_ENUM_DEF (def)->items);
+      break;
+    case XGEN_TYPEDEF:
+      hash = hash_reference (hash, XGEN_TYPEDEF_DEF (def)->reference,
+			     visiting);
+      break;
+    case XGEN_VALUEPARAM:
+      hash = hash_reference (hash, XGEN_VALUE_PARAM_DEF (def)->reference,
+			     visiting);
+      hash = hash_string (hash, XGEN_VALUE_PARAM_DEF (def)->mask_name);
+      hash = hash_string (hash, XGEN_VALUE_PARAM_DEF (def)->list_name);
+      break;
+    case XGEN_REQUEST:
+      hash = hash_uint (hash, XGEN_REQUEST_DEF (def)->opcode);
+      hash = hash_fields (hash, XGEN_REQUEST_DEF (def)->fields, visiting);
+      hash = hash_reference (hash, XGEN_DEF (XGEN_REQUEST_DEF (def)->reply),
+			     visiting);
+      break;
+    case XGEN_REPLY:
+      hash = hash_uint (hash, XGEN_REPLYDEF (def)->opcode);
+      hash = hash_fields (hash, XGEN_REPLYDEF (def)->fields, visiting);
+      break;
+    case XGEN_EVENT:
+      hash = hash_uint (hash, XGEN_EVENT_DEF (def)->number);
+      hash = hash_fields (hash, XGEN_EVENT_DEF (def)->fields, visiting);
+      break;
+    case XGEN_ERROR:
+      hash = hash_uint (hash, XGEN_ERROR_DEF (def)->number);
+      hash = hash_fields (hash, XGEN_ERROR_DEF (def)->fields, visiting);
+      break;
+    }
+
+  g_hash_table_remove (visiting, def);
+
+  /* 0 means "not computed yet" */
+  def->_fingerprint = hash ? hash : 1;
+  return def->_fingerprint;
+}
+
+void
+_xgen_compute_fingerprints (XGenState *state)
+{
+  GHashTable *visiting = g_hash_table_new (g_direct_hash, g_direct_equal);
+  GList *tmp;
+
+  for (tmp = state->extensions;
+       tmp != state->_shared_extensions;
+       tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+      guint64 hash = FNV_OFFSET_BASIS;
+      GList *tmp2;
+
+      hash = hash_string (hash, extension->name);
+      hash = hash_string (hash, extension->header);
+
+      hash = hash_uint (hash, g_list_length (extension->imports));
+      for (tmp2 = extension->imports; tmp2 != NULL; tmp2 = tmp2->next)
+	{
+	  XGenExtension *import = tmp2->data;
+	  hash = hash_string (hash, import->header);
+	}
+
+      hash = hash_uint (hash, g_list_length (extension->all_definitions));
+      for (tmp2 = extension->all_definitions; tmp2 != NULL; tmp2 = tmp2->next)
+	hash = hash_uint (hash, definition_fingerprint (tmp2->data, visiting));
+
+      extension->_fingerprint = hash ? hash : 1;
+    }
+
+  g_hash_table_destroy (visiting);
+}
+
+/**
+ * xgen_definition_get_fingerprint:
+ * @def: A definition
+ *
+ * A fingerprint is a hash of everything in the protocol description that
+ * code generated for a definition depends on: its name, its fields with
+ * their length expressions and the fingerprints of the types they use, so
+ * changing a struct also changes the fingerprint of every request using
+ * it. Fingerprints don't depend on the host, so a code generator can
+ * store them and skip regenerating any definition whose fingerprint is
+ * unchanged.
+ *
+ * This function returns the fingerprint of the definition.
+ */
+guint64
+xgen_definition_get_fingerprint (const XGenDefinition *def)
+{
+  return def->_fingerprint;
+}
+
+/**
+ * xgen_extension_get_fingerprint:
+ * @extension: An extension
+ *
+ * This function returns a fingerprint covering the extension's name,
+ * imports and the fingerprints of all of its definitions, in order.
+ */
+guint64
+xgen_extension_get_fingerprint (const XGenExtension *extension)
+{
+  return extension->_fingerprint;
+}
@@ -0,0 +1,973 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-format.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#define CHUNK_SIZE 65536
+
+/* Enough for "-2147483648" or "0xffffffff" */
+#define MAX_NUMBER_LEN 11
+
+typedef enum _FieldStyle
+{
+  STYLE_UNSIGNED,
+  STYLE_SIGNED,
+  STYLE_HEX,
+  STYLE_BOOL,
+  STYLE_ENUM,
+  STYLE_MASK,
+  STYLE_STRING,
+  STYLE_LIST,	    /* Each element in the element_style */
+  STYLE_COUNT,	    /* A list rendered as its number of elements */
+  STYLE_NESTED,	    /* A fixed size struct rendered with its own template */
+  STYLE_OPAQUE,	    /* Rendered as its size in bytes */
+  STYLE_VALUEPARAM
+} FieldStyle;
+
+typedef struct _EnumItem
+{
+  guint32     value;
+  const char *name;
+  guint	      name_len;
+  guint	      order;	/* The position in the enum definition */
+} EnumItem;
+
+typedef struct _EnumTable
+{
+  guint	    n_items;
+  EnumItem *items;	   /* Sorted by value */
+  guint	    max_len;	   /* The longest rendering of a single value */
+  guint	    max_mask_len;  /* The longest rendering of a mask */
+} EnumTable;
+
+typedef struct _Template Template;
+
+typedef struct _TemplateField
+{
+  guint		   index;   /* Into the layout fields */
+  FieldStyle	   style;
+  FieldStyle	   element_style; /* For STYLE_LIST */
+  guint		   size;
+  char		  *prefix;  /* e.g. " window=" or ",\"window\":" */
+  guint		   prefix_len;
+  char		  *prefix2; /* For the list of a valueparam */
+  guint		   prefix2_len;
+  const char	  *suffix;
+  guint		   suffix_len;
+  const EnumTable *enum_table;
+  const Template  *nested;
+} TemplateField;
+
+struct _Template
+{
+  const XGenLayout *layout;
+  char		   *header;
+  guint		    header_len;
+  const char	   *trailer;
+  guint		    trailer_len;
+  guint		    n_fields;
+  TemplateField	   *fields;
+};
+
+typedef struct _Chunk
+{
+  gsize len;
+  gsize size;
+  char  data[1];
+} Chunk;
+
+struct _XGenFormatter
+{
+  XGenFormatStyle style;
+
+  GHashTable	 *templates;	     /* XGenLayout -> Template */
+  GHashTable	 *nested_templates;  /* XGenLayout -> Template */
+  GHashTable	 *enum_tables;	     /* XGenEnum -> EnumTable */
+
+  GPtrArray	 *chunks;
+  Chunk		 *current;
+  gsize		  size;
+};
+
+static const char digit_pairs[] =
+  "0001020304050607080910111213141516171819"
+  "2021222324252627282930313233343536373839"
+  "4041424344454647484950515253545556575859"
+  "6061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static inline guint
+format_unsigned (char *out, guint32 value)
+{
+  char buf[10];
+  char *p = buf + sizeof (buf);
+  guint len;
+
+  while (value >= 100)
+    {
+      guint i = (value % 100) * 2;
+      value /= 100;
+      *--p = digit_pairs[i + 1];
+      *--p = digit_pairs[i];
+    }
+  if (value >= 10)
+    {
+      *--p = digit_pairs[value * 2 + 1];
+      *--p = digit_pairs[value * 2];
+    }
+  else
+    *--p = '0' + value;
+
+  len = buf + sizeof (buf) - p;
+  memcpy (out, p, len);
+  return len;
+}
+
+static inline guint
+format_signed (char *out, gint32 value)
+{
+  if (value >= 0)
+    return format_unsigned (out, value);
+  *out = '-';
+  return 1 + format_unsigned (out + 1, -(guint32)value);
+}
+
+static inline guint
+format_hex (char *out, guint32 value)
+{
+  char buf[8];
+  char *p = buf + sizeof (buf);
+  guint len;
+
+  do
+    {
+      *--p = hex_digits[value & 0xf];
+      value >>= 4;
+    }
+  while (value);
+
+  len = buf + sizeof (buf) - p;
+  out[0] = '0';
+  out[1] = 'x';
+  memcpy (out + 2, p, len);
+  return len + 2;
+}
+
+static Chunk *
+chunk_new (gsize size)
+{
+  Chunk *chunk = g_malloc (G_STRUCT_OFFSET (Chunk, data) + size);
+  chunk->len = 0;
+  chunk->size = size;
+  return chunk;
+}
+
+/* Returns space for at least n more bytes of output. The space is only
+ * used once it's committed. */
+static inline char *
+reserve (XGenFormatter *formatter, gsize n)
+{
+  Chunk *current = formatter->current;
+
+  if (G_UNLIKELY (current->size - current->len < n))
+    {
+      current = chunk_new (MAX (CHUNK_SIZE, n));
+      g_ptr_array_add (formatter->chunks, current);
+      formatter->current = current;
+    }
+  return current->data + current->len;
+}
+
+static inline void
+commit (XGenFormatter *formatter, char *end)
+{
+  Chunk *current = formatter->current;
+  gsize len = end - (current->data + current->len);
+
+  current->len += len;
+  formatter->size += len;
+}
+
+static inline char *
+put (char *p, const char *data, guint len)
+{
+  memcpy (p, data, len);
+  return p + len;
+}
+
+static int
+compare_enum_items (const void *a, const void *b)
+{
+  const EnumItem *item_a = a;
+  const EnumItem *item_b = b;
+
+  if (item_a->value != item_b->value)
+    return item_a->value < item_b->value ? -1 : 1;
+  /* Keep the first of several names for the same value */
+  return item_a->order < item_b->order ? -1 : 1;
+}
+
+static const EnumTable *
+get_enum_table (XGenFormatter *formatter, const XGenEnum *enum_def)
+{
+  EnumTable *table = g_hash_table_lookup (formatter->enum_tables, enum_def);
+  GList *tmp;
+  guint i;
+
+  if (table)
+    return table;
+
+  table = g_new0 (EnumTable, 1);
+  table->n_items = g_list_length (enum_def->items);
+  table->items = g_new (EnumItem, table->n_items);
+  table->max_len = MAX_NUMBER_LEN;
+  table->max_mask_len = MAX_NUMBER_LEN + 3;
+
+  for (tmp = enum_def->items, i = 0; tmp != NULL; tmp = tmp->next, i++)
+    {
+      XGenItemDefinition *item = tmp->data;
+      EnumItem *enum_item = &table->items[i];
+
+      if (item->type == XGEN_ITEM_AS_BIT)
+	enum_item->value = 1U << item->bit;
+      else
+	enum_item->value = strtoul (item->value, NULL, 0);
+      enum_item->name = item->name;
+      enum_item->name_len = strlen (item->name);
+      enum_item->order = i;
+
+      /* Allow for the quotes and separators of the JSON form */
+      table->max_len = MAX (table->max_len, enum_item->name_len + 2);
+      table->max_mask_len += enum_item->name_len + 3;
+    }
+
+  qsort (table->items, table->n_items, sizeof (EnumItem),
+	 compare_enum_items);
+
+  g_hash_table_insert (formatter->enum_tables, (gpointer)enum_def, table);
+  return table;
+}
+
+static void
+enum_table_free (EnumTable *table)
+{
+  g_free (table->items);
+  g_free (table);
+}
+
+static const EnumItem *
+lookup_enum_item (const EnumTable *table, guint32 value)
+{
+  guint low = 0;
+  guint high = table->n_items;
+
+  while (low < high)
+    {
+      guint mid = (low + high) / 2;
+      if (table->items[mid].value < value)
+	low = mid + 1;
+      else
+	high = mid;
+    }
+
+  if (low < table->n_items && table->items[low].value == value)
+    return &table->items[low];
+  return NULL;
+}
+
+static const Template *get_template (XGenFormatter *formatter,
+				     const XGenLayout *layout,
+				     gboolean nested);
+
+/* Chooses how to show a value of @type, either a scalar field or a list
+ * element, ignoring any enum */
+static FieldStyle
+choose_value_style (XGenFormatter *formatter,
+		    const XGenDefinition *type,
+		    guint size,
+		    TemplateField *template_field)
+{
+  if (type && (type->type == XGEN_STRUCT || type->type == XGEN_UNION))
+    {
+      const XGenLayout *struct_layout = xgen_definition_get_layout (type);
+      if (!struct_layout || !struct_layout->is_fixed)
+	return STYLE_OPAQUE;
+      template_field->nested = get_template (formatter, struct_layout, TRUE);
+      return STYLE_NESTED;
+    }
+
+  if (size != 1 && size != 2 && size != 4)
+    return STYLE_OPAQUE;
+
+  switch (type ? type->type : XGEN_UNSIGNED)
+    {
+    case XGEN_BOOLEAN:
+      return STYLE_BOOL;
+    case XGEN_SIGNED:
+      return STYLE_SIGNED;
+    case XGEN_XID:
+    case XGEN_XIDUNION:
+      /* JSON has no hex notation */
+      return formatter->style == XGEN_FORMAT_TEXT
+	? STYLE_HEX : STYLE_UNSIGNED;
+    default:
+      return STYLE_UNSIGNED;
+    }
+}
+
+static FieldStyle
+choose_style (XGenFormatter *formatter,
+	      const XGenFieldLayout *field_layout,
+	      TemplateField *template_field)
+{
+  const XGenFieldDefinition *field = field_layout->field;
+  const XGenDefinition *type = field_layout->type;
+
+  switch (field_layout->kind)
+    {
+    case XGEN_LAYOUT_SCALAR:
+      if (field->enum_def
+	  && (field_layout->size == 1 || field_layout->size == 2
+	      || field_layout->size == 4))
+	{
+	  template_field->enum_table =
+	    get_enum_table (formatter, field->enum_def);
+	  return field->is_mask ? STYLE_MASK : STYLE_ENUM;
+	}
+      /* Fall through */
+    case XGEN_LAYOUT_STRUCT:
+      return choose_value_style (formatter, type, field_layout->size,
+				 template_field);
+    case XGEN_LAYOUT_LIST:
+      if (type && type->type == XGEN_CHAR && field_layout->size == 1)
+	return STYLE_STRING;
+      template_field->element_style =
+	choose_value_style (formatter, type, field_layout->size,
+			    template_field);
+      return template_field->element_style == STYLE_OPAQUE
+	? STYLE_COUNT : STYLE_LIST;
+    case XGEN_LAYOUT_VALUEPARAM:
+      return STYLE_VALUEPARAM;
+    }
+
+  return STYLE_OPAQUE;
+}
+
+static char *
+make_prefix (XGenFormatStyle style,
+	     gboolean first,
+	     const char *name,
+	     const char *open)
+{
+  if (style == XGEN_FORMAT_TEXT)
+    return g_strdup_printf ("%s%s%s", first ? "" : " ", name, open);
+  else
+    return g_strdup_printf ("%s\"%s\":%s", first ? "" : ",", name, open);
+}
+
+static void
+init_field_text (XGenFormatter *formatter,
+		 TemplateField *template_field,
+		 const XGenFieldLayout *field_layout,
+		 gboolean first)
+{
+  XGenFormatStyle style = formatter->style;
+  gboolean text = style == XGEN_FORMAT_TEXT;
+  const char *name = field_layout->field->name;
+  const char *open = text ? "=" : "";
+
+  template_field->suffix = "";
+
+  switch (template_field->style)
+    {
+    case STYLE_LIST:
+      open = text ? "=[" : "[";
+      template_field->suffix = "]";
+      break;
+    case STYLE_COUNT:
+      open = text ? "[" : "{\"count\":";
+      template_field->suffix = text ? "]" : "}";
+      break;
+    case STYLE_OPAQUE:
+      open = text ? "=<" : "{\"size\":";
+      template_field->suffix = text ? " bytes>" : "}";
+      break;
+    case STYLE_VALUEPARAM:
+      {
+	const XGenValueParam *valueparam =
+	  XGEN_VALUE_PARAM_DEF (field_layout->field->definition);
+
+	name = valueparam->mask_name;
+	template_field->prefix2 =
+	  make_prefix (style, FALSE, valueparam->list_name,
+		       text ? "=[" : "[");
+	template_field->prefix2_len = strlen (template_field->prefix2);
+	template_field->suffix = "]";
+	break;
+      }
+    default:
+      break;
+    }
+
+  template_field->prefix = make_prefix (style, first, name, open);
+  template_field->prefix_len = strlen (template_field->prefix);
+  template_field->suffix_len = strlen (template_field->suffix);
+}
+
+static Template *
+template_new (XGenFormatter *formatter,
+	      const XGenLayout *layout,
+	      gboolean nested)
+{
+  const XGenDefinition *def = layout->definition;
+  Template *template = g_new0 (Template, 1);
+  gboolean text = formatter->style == XGEN_FORMAT_TEXT;
+  gboolean first = nested;  /* Top level fields follow the header */
+  guint i;
+
+  template->layout = layout;
+
+  if (nested)
+    {
+      template->header = g_strdup ("{");
+      template->trailer = "}";
+    }
+  else if (text)
+    {
+      template->header = g_strdup_printf ("%s:%s", def->extension->header,
+					  def->name);
+      template->trailer = "\n";
+    }
+  else
+    {
+      /* The underscore keeps the key apart from fields named "type" */
+      template->header =
+	g_strdup_printf ("{\"_type\":\"%s:%s\"", def->extension->header,
+			 def->name);
+      template->trailer = "}\n";
+    }
+  template->header_len = strlen (template->header);
+  template->trailer_len = strlen (template->trailer);
+
+  template->fields = g_new0 (TemplateField, layout->n_fields);
+
+  for (i = 0; i < layout->n_fields; i++)
+    {
+      const XGenFieldLayout *field_layout = &layout->fields[i];
+      TemplateField *template_field = &template->fields[template->n_fields];
+
+      if (strcmp (field_layout->field->name, "pad") == 0)
+	continue;
+
+      template_field->index = i;
+      template_field->size = field_layout->size;
+      template_field->style =
+	choose_style (formatter, field_layout, template_field);
+      init_field_text (formatter, template_field, field_layout, first);
+
+      first = FALSE;
+      template->n_fields++;
+    }
+
+  return template;
+}
+
+static void
+template_free (Template *template)
+{
+  guint i;
+
+  for (i = 0; i < template->n_fields; i++)
+    {
+      g_free (template->fields[i].prefix);
+      g_free (template->fields[i].prefix2);
+    }
+  g_free (template->fields);
+  g_free (template->header);
+  g_free (template);
+}
+
+static const Template *
+get_template (XGenFormatter *formatter,
+	      const XGenLayout *layout,
+	      gboolean nested)
+{
+  GHashTable *templates =
+    nested ? formatter->nested_templates : formatter->templates;
+  Template *template = g_hash_table_lookup (templates, layout);
+
+  if (!template)
+    {
+      template = template_new (formatter, layout, nested);
+      g_hash_table_insert (templates, (gpointer)layout, template);
+    }
+  return template;
+}
+
+/**
+ * xgen_formatter_new:
+ * @style: The output format
+ *
+ * Creates a formatter. Formatted messages are buffered until
+ * xgen_formatter_flush() is called.
+ */
+XGenFormatter *
+xgen_formatter_new (XGenFormatStyle style)
+{
+  XGenFormatter *formatter = g_new0 (XGenFormatter, 1);
+
+  formatter->style = style;
+  formatter->templates =
+    g_hash_table_new_full (g_direct_hash, g_direct_equal,
+			   NULL, (GDestroyNotify)template_free);
+  formatter->nested_templates =
+    g_hash_table_new_full (g_direct_hash, g_direct_equal,
+			   NULL, (GDestroyNotify)template_free);
+  formatter->enum_tables =
+    g_hash_table_new_full (g_direct_hash, g_direct_equal,
+			   NULL, (GDestroyNotify)enum_table_free);
+
+  formatter->chunks = g_ptr_array_new ();
+  formatter->current = chunk_new (CHUNK_SIZE);
+  g_ptr_array_add (formatter->chunks, formatter->current);
+
+  return formatter;
+}
+
+static char *
+format_enum (XGenFormatStyle style,
+	     char *p,
+	     const EnumTable *table,
+	     guint32 value)
+{
+  const EnumItem *item = lookup_enum_item (table, value);
+
+  if (!item)
+    return p + format_unsigned (p, value);
+
+  if (style == XGEN_FORMAT_JSON)
+    *p++ = '"';
+  p = put (p, item->name, item->name_len);
+  if (style == XGEN_FORMAT_JSON)
+    *p++ = '"';
+  return p;
+}
+
+static char *
+format_mask (XGenFormatStyle style,
+	     char *p,
+	     const EnumTable *table,
+	     guint32 value)
+{
+  gboolean text = style == XGEN_FORMAT_TEXT;
+  gboolean first = TRUE;
+  guint i;
+
+  if (!text)
+    *p++ = '[';
+  else if (!value)
+    *p++ = '0';
+
+  for (i = 0; i < table->n_items && value; i++)
+    {
+      const EnumItem *item = &table->items[i];
+
+      if (!item->value || (value & item->value) != item->value)
+	continue;
+      value &= ~item->value;
+
+      if (!first)
+	*p++ = text ? '|' : ',';
+      if (!text)
+	*p++ = '"';
+      p = put (p, item->name, item->name_len);
+      if (!text)
+	*p++ = '"';
+      first = FALSE;
+    }
+
+  /* Any bits without a name */
+  if (value)
+    {
+      if (!first)
+	*p++ = text ? '|' : ',';
+      p += text ? format_hex (p, value) : format_unsigned (p, value);
+    }
+
+  if (!text)
+    *p++ = ']';
+  return p;
+}
+
+static char *
+format_string (XGenFormatStyle style,
+	       char *p,
+	       const guint8 *data,
+	       guint32 len)
+{
+  guint32 i;
+
+  *p++ = '"';
+  for (i = 0; i < len; i++)
+    {
+      guint8 c = data[i];
+
+      if (c == '"' || c == '\\')
+	{
+	  *p++ = '\\';
+	  *p++ = c;
+	}
+      else if (c >= 0x20 && c < 0x7f)
+	*p++ = c;
+      else if (style == XGEN_FORMAT_TEXT)
+	{
+	  p = put (p, "\\x", 2);
+	  *p++ = hex_digits[c >> 4];
+	  *p++ = hex_digits[c & 0xf];
+	}
+      else
+	{
+	  p = put (p, "\\u00", 4);
+	  *p++ = hex_digits[c >> 4];
+	  *p++ = hex_digits[c & 0xf];
+	}
+    }
+  *p++ = '"';
+  return p;
+}
+
+static void format_nested (XGenFormatter *formatter,
+			   const Template *template,
+			   const guint8 *data,
+			   XGenByteOrder byte_order);
+
+/* Formats a plain scalar value, taking at most MAX_NUMBER_LEN bytes */
+static inline char *
+format_value (FieldStyle style,
+	      char *p,
+	      const guint8 *data,
+	      guint size,
+	      gboolean swap)
+{
+  guint32 value = _xgen_read_unsigned (data, size, swap);
+
+  switch (style)
+    {
+    case STYLE_SIGNED:
+      return p + format_signed (p, _xgen_read_signed (data, size, swap));
+    case STYLE_HEX:
+      return p + format_hex (p, value);
+    case STYLE_BOOL:
+      return value ? put (p, "true", 4) : put (p, "false", 5);
+    default:
+      return p + format_unsigned (p, value);
+    }
+}
+
+/* Formats the elements of a list, without the brackets */
+static void
+format_elements (XGenFormatter *formatter,
+		 const TemplateField *field,
+		 const guint8 *data,
+		 guint32 count,
+		 XGenByteOrder byte_order)
+{
+  gboolean swap = _XGEN_NEEDS_SWAP (byte_order);
+  char *p;
+  guint32 i;
+
+  if (field->element_style == STYLE_NESTED)
+    {
+      for (i = 0; i < count; i++, data += field->size)
+	{
+	  if (i)
+	    {
+	      p = reserve (formatter, 1);
+	      *p++ = ',';
+	      commit (formatter, p);
+	    }
+	  format_nested (formatter, field->nested, data, byte_order);
+	}
+      return;
+    }
+
+  p = reserve (formatter, (gsize)count * (MAX_NUMBER_LEN + 1));
+  for (i = 0; i < count; i++, data += field->size)
+    {
+      if (i)
+	*p++ = ',';
+      p = format_value (field->element_style, p, data, field->size, swap);
+    }
+  commit (formatter, p);
+}
+
+static void
+format_fields (XGenFormatter *formatter,
+	       const Template *template,
+	       const guint8 *data,
+	       const XGenFieldExtent *extents,
+	       XGenByteOrder byte_order)
+{
+  XGenFormatStyle style = formatter->style;
+  gboolean swap = _XGEN_NEEDS_SWAP (byte_order);
+  char *p;
+  guint i;
+
+  p = reserve (formatter, template->header_len);
+  commit (formatter, put (p, template->header, template->header_len));
+
+  for (i = 0; i < template->n_fields; i++)
+    {
+      const TemplateField *field = &template->fields[i];
+      const XGenFieldExtent *extent = &extents[field->index];
+      const guint8 *value_data = data + extent->offset;
+      guint32 count = extent->count;
+      guint32 value;
+
+      switch (field->style)
+	{
+	case STYLE_STRING:
+	  p = reserve (formatter, field->prefix_len + count * 6 + 2);
+	  break;
+	case STYLE_ENUM:
+	  p = reserve (formatter,
+		       field->prefix_len + field->enum_table->max_len);
+	  break;
+	case STYLE_MASK:
+	  p = reserve (formatter,
+		       field->prefix_len + field->enum_table->max_mask_len);
+	  break;
+	case STYLE_VALUEPARAM:
+	  p = reserve (formatter,
+		       field->prefix_len + field->prefix2_len
+		       + field->suffix_len + 2 * MAX_NUMBER_LEN);
+	  break;
+	default:
+	  p = reserve (formatter,
+		       field->prefix_len + field->suffix_len + MAX_NUMBER_LEN);
+	  break;
+	}
+
+      p = put (p, field->prefix, field->prefix_len);
+
+      switch (field->style)
+	{
+	case STYLE_UNSIGNED:
+	case STYLE_SIGNED:
+	case STYLE_HEX:
+	case STYLE_BOOL:
+	  p = format_value (field->style, p, value_data, field->size, swap);
+	  break;
+	case STYLE_ENUM:
+	  value = _xgen_read_unsigned (value_data, field->size, swap);
+	  p = format_enum (style, p, field->enum_table, value);
+	  break;
+	case STYLE_MASK:
+	  value = _xgen_read_unsigned (value_data, field->size, swap);
+	  p = format_mask (style, p, field->enum_table, value);
+	  break;
+	case STYLE_STRING:
+	  p = format_string (style, p, value_data, count);
+	  break;
+	case STYLE_LIST:
+	  commit (formatter, p);
+	  format_elements (formatter, field, value_data, count, byte_order);
+	  p = reserve (formatter, field->suffix_len);
+	  break;
+	case STYLE_COUNT:
+	  p += format_unsigned (p, count);
+	  break;
+	case STYLE_OPAQUE:
+	  p += format_unsigned (p, extent->size);
+	  break;
+	case STYLE_VALUEPARAM:
+	  {
+	    guint32 j;
+
+	    value = _xgen_read_unsigned (value_data, field->size, swap);
+	    p += style == XGEN_FORMAT_TEXT
+	      ? format_hex (p, value) : format_unsigned (p, value);
+	    p = put (p, field->prefix2, field->prefix2_len);
+	    commit (formatter, p);
+
+	    /* A CARD32 per set bit of the mask, after the padded mask */
+	    value_data += _XGEN_ALIGN4 (field->size);
+	    p = reserve (formatter, (gsize)count * (MAX_NUMBER_LEN + 1)
+			 + field->suffix_len);
+	    for (j = 0; j < count; j++)
+	      {
+		if (j)
+		  *p++ = ',';
+		p += format_unsigned (p,
+				      _xgen_read_unsigned (value_data + j * 4,
+							   4, swap));
+	      }
+	    break;
+	  }
+	case STYLE_NESTED:
+	  commit (formatter, p);
+	  format_nested (formatter, field->nested, value_data, byte_order);
+	  continue;
+	}
+
+      p = put (p, field->suffix, field->suffix_len);
+      commit (formatter, p);
+    }
+
+  p = reserve (formatter, template->trailer_len);
+  commit (formatter, put (p, template->trailer, template->trailer_len));
+}
+
+/* Formats a fixed size struct that's inline in a message. The message has
+ * already been checked to be long enough. */
+static void
+format_nested (XGenFormatter *formatter,
+	       const Template *template,
+	       const guint8 *data,
+	       XGenByteOrder byte_order)
+{
+  const XGenLayout *layout = template->layout;
+  XGenFieldExtent *extents = g_newa (XGenFieldExtent, layout->n_fields);
+
+  xgen_layout_get_extents (layout, data, layout->fixed_size, byte_order,
+			   layout->n_fields, extents);
+  format_fields (formatter, template, data, extents, byte_order);
+}
+
+/**
+ * xgen_formatter_append:
+ * @formatter: A formatter
+ * @layout: The layout of the message
+ * @data: The start of a raw message
+ * @len: The number of bytes available at @data
+ * @byte_order: The byte order of the message
+ *
+ * Formats a message as a single line at the end of the output buffer.
+ * Enum fields are shown by name and masks as the names of the set bits.
+ * Lists of integers and fixed size structs are shown element by element
+ * and other lists as their length. In the JSON form the definition name
+ * is given by a "_type" member.
+ *
+ * This function returns FALSE, without adding anything, if the message is
+ * truncated or malformed.
+ */
+gboolean
+xgen_formatter_append (XGenFormatter *formatter,
+		       const XGenLayout *layout,
+		       const guint8 *data,
+		       gsize len,
+		       XGenByteOrder byte_order)
+{
+  XGenFieldExtent *extents = g_newa (XGenFieldExtent, layout->n_fields);
+
+  if (len < layout->min_size
+      || !xgen_layout_get_extents (layout, data, len, byte_order,
+				   layout->n_fields, extents))
+    return FALSE;
+
+  format_fields (formatter, get_template (formatter, layout, FALSE),
+		 data, extents, byte_order);
+  return TRUE;
+}
+
+/**
+ * xgen_formatter_get_size:
+ * @formatter: A formatter
+ *
+ * This function returns the number of bytes waiting to be flushed.
+ */
+gsize
+xgen_formatter_get_size (const XGenFormatter *formatter)
+{
+  return formatter->size;
+}
+
+/**
+ * xgen_formatter_flush:
+ * @formatter: A formatter
+ * @fd: The file descriptor to write to
+ *
+ * Writes out everything formatted so far, gathering the buffered chunks
+ * into as few writev() calls as possible, and empties the buffer. The
+ * buffer is emptied even if writing fails.
+ *
+ * This function returns FALSE if writing failed.
+ */
+gboolean
+xgen_formatter_flush (XGenFormatter *formatter, int fd)
+{
+  GPtrArray *chunks = formatter->chunks;
+  struct iovec iov[_XGEN_IOV_MAX];
+  gboolean ret = TRUE;
+  int n_iov = 0;
+  guint i;
+
+  for (i = 0; i < chunks->len && ret; i++)
+    {
+      Chunk *chunk = g_ptr_array_index (chunks, i);
+
+      if (!chunk->len)
+	continue;
+
+      iov[n_iov].iov_base = chunk->data;
+      iov[n_iov].iov_len = chunk->len;
+      if (++n_iov == _XGEN_IOV_MAX)
+	{
+	  ret = _xgen_writev_all (fd, iov, n_iov);
+	  n_iov = 0;
+	}
+    }
+  if (ret && n_iov)
+    ret = _xgen_writev_all (fd, iov, n_iov);
+  if (!ret)
+    g_warning ("Failed to write formatted messages: %s", strerror (errno));
+
+  /* Keep the first chunk for reuse */
+  for (i = 1; i < chunks->len; i++)
+    g_free (g_ptr_array_index (chunks, i));
+  g_ptr_array_set_size (chunks, 1);
+  formatter->current = g_ptr_array_index (chunks, 0);
+  formatter->current->len = 0;
+  formatter->size = 0;
+
+  return ret;
+}
+
+void
+xgen_formatter_free (XGenFormatter *formatter)
+{
+  guint i;
+
+  for (i = 0; i < formatter->chunks->len; i++)
+    g_free (g_ptr_array_index (formatter->chunks, i));
+  g_ptr_array_free (formatter->chunks, TRUE);
+
+  g_hash_table_destroy (formatter->templates);
+  g_hash_table_destroy (formatter->nested_templates);
+  g_hash_table_destroy (formatter->enum_tables);
+  g_free (formatter);
+}
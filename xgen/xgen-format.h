@@ -0,0 +1,33 @@
+#ifndef _XGEN_FORMAT_H_
+#define _XGEN_FORMAT_H_
+
+#include <xgen.h>
+#include <xgen-layout.h>
+
+#include <glib.h>
+
+typedef enum _XGenFormatStyle
+{
+  XGEN_FORMAT_TEXT,   /* One "header:Name field=value ..." line per message */
+  XGEN_FORMAT_JSON    /* One JSON object per line (NDJSON) with the
+			 definition name as "_type" */
+} XGenFormatStyle;
+
+/**
+ * Renders raw messages as text into a reusable output buffer that is
+ * written out in batches. A formatter caches a template per definition so
+ * it isn't thread safe; use one formatter per thread.
+ */
+typedef struct _XGenFormatter XGenFormatter;
+
+XGenFormatter *xgen_formatter_new (XGenFormatStyle style);
+gboolean xgen_formatter_append (XGenFormatter *formatter,
+				const XGenLayout *layout,
+				const guint8 *data,
+				gsize len,
+				XGenByteOrder byte_order);
+gsize xgen_formatter_get_size (const XGenFormatter *formatter);
+gboolean xgen_formatter_flush (XGenFormatter *formatter, int fd);
+void xgen_formatter_free (XGenFormatter *formatter);
+
+#endif /* _XGEN_FORMAT_H_ */
@@ -0,0 +1,1045 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-encoder.h>
+#include <xgen-generator.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <string.h>
+#include <stdlib.h>
+
+/* The values of an enum's items, or their bits for a mask */
+typedef struct _ItemSet
+{
+  guint	   n_items;
+  guint32 *items;
+} ItemSet;
+
+typedef enum _ValueSource
+{
+  VALUE_RANDOM,
+  VALUE_RESOURCE,
+  VALUE_FIXED	  /* Set with xgen_generator_set_field() */
+} ValueSource;
+
+typedef struct _FieldPlan
+{
+  ValueSource	 source;
+  guint32	 value;
+  const ItemSet *items;	       /* NULL if the field has no enum */
+  gint		 length_index; /* For a list, the scalar field holding its
+				  length or -1 */
+} FieldPlan;
+
+/* A pointer within the scratch space to something else in it, which is
+ * only written once the scratch space has stopped moving */
+typedef struct _Fixup
+{
+  gsize pointer;  /* The offset of the pointer */
+  gsize target;
+} Fixup;
+
+typedef struct _MixEntry
+{
+  const XGenRequest *request;
+  const XGenLayout  *layout;
+  guint		     weight;
+  FieldPlan	    *fields;
+} MixEntry;
+
+struct _XGenGenerator
+{
+  const XGenState *state;
+  GRand		  *rand;
+  guint32	   max_value;
+  guint		   max_list_length;
+
+  GPtrArray	  *entries;
+  guint64	  *cumulative;	/* The running total of the entry weights */
+  guint64	   total_weight;
+
+  GHashTable	  *resources;	/* Type name -> XID */
+  GHashTable	  *item_sets;	/* XGenEnum -> ItemSet */
+
+  /* Scratch space for the values and list data of the request being
+   * generated */
+  guint8	  *scratch;
+  gsize		   scratch_len;
+  gsize		   scratch_allocated;
+  GArray	  *fixups;
+};
+
+/* Each value of a valueparam is a 32 bit VALUE */
+static const XGenBaseType value_type = {
+  ._parent = {
+    .name = "CARD32",
+    .type = XGEN_UNSIGNED
+  },
+  .size = 4
+};
+
+/**
+ * xgen_generator_new:
+ * @state: The parsed protocol state
+ * @seed: The seed for the random number generator; the same seed, mix
+ *	  and settings always produce the same requests
+ *
+ * Creates a generator with an empty mix. By default scalar values are
+ * limited to 1023 and lists to 16 elements.
+ */
+XGenGenerator *
+xgen_generator_new (const XGenState *state, guint32 seed)
+{
+  XGenGenerator *generator = g_new0 (XGenGenerator, 1);
+
+  generator->state = state;
+  generator->rand = g_rand_new_with_seed (seed);
+  generator->max_value = 1023;
+  generator->max_list_length = 16;
+  generator->entries = g_ptr_array_new ();
+  generator->resources = g_hash_table_new_full (g_str_hash, g_str_equal,
+						g_free, NULL);
+  generator->item_sets = g_hash_table_new (g_direct_hash, g_direct_equal);
+  generator->fixups = g_array_new (FALSE, FALSE, sizeof (Fixup));
+
+  return generator;
+}
+
+static const ItemSet *
+get_item_set (XGenGenerator *generator, const XGenEnum *enum_def)
+{
+  ItemSet *item_set = g_hash_table_lookup (generator->item_sets, enum_def);
+  GList *tmp;
+
+  if (item_set)
+    return item_set;
+
+  item_set = g_new0 (ItemSet, 1);
+  item_set->items = g_new (guint32, g_list_length (enum_def->items));
+  for (tmp = enum_def->items; tmp != NULL; tmp = tmp->next)
+    {
+      const XGenItemDefinition *item = tmp->data;
+
+      if (item->type == XGEN_ITEM_AS_BIT)
+	item_set->items[item_set->n_items++] = 1U << item->bit;
+      else
+	item_set->items[item_set->n_items++] = strtoul (item->value, NULL, 0);
+    }
+
+  g_hash_table_insert (generator->item_sets, (gpointer)enum_def, item_set);
+  return item_set;
+}
+
+/* Finds the scalar field holding the length of a list, or returns -1 */
+static gint
+find_length_index (const XGenLayout *layout, guint index)
+{
+  const XGenFieldLayout *field_layout = &layout->fields[index];
+  gint length_index;
+
+  if (field_layout->kind != XGEN_LAYOUT_LIST
+      || field_layout->field->length->type != XGEN_FIELDREF)
+    return -1;
+
+  length_index = xgen_layout_find_field (layout,
+					 field_layout->field->length->field);
+  if (length_index < 0
+      || layout->fields[length_index].kind != XGEN_LAYOUT_SCALAR)
+    return -1;
+  return length_index;
+}
+
+/* Finds the resource for a type, or any type it's a typedef of */
+static gboolean
+lookup_resource (XGenGenerator *generator,
+		 const XGenDefinition *type,
+		 guint32 *xid)
+{
+  while (type)
+    {
+      gpointer value;
+
+      if (g_hash_table_lookup_extended (generator->resources, type->name,
+					NULL, &value))
+	{
+	  *xid = GPOINTER_TO_UINT (value);
+	  return TRUE;
+	}
+      type = type->type == XGEN_TYPEDEF
+	? XGEN_TYPEDEF_DEF (type)->reference : NULL;
+    }
+  return FALSE;
+}
+
+static void
+update_cumulative_weights (XGenGenerator *generator)
+{
+  guint i;
+
+  generator->cumulative = g_renew (guint64, generator->cumulative,
+				   generator->entries->len);
+  generator->total_weight = 0;
+  for (i = 0; i < generator->entries->len; i++)
+    {
+      MixEntry *entry = g_ptr_array_index (generator->entries, i);
+
+      generator->total_weight += entry->weight;
+      generator->cumulative[i] = generator->total_weight;
+    }
+}
+
+static MixEntry *
+find_entry (XGenGenerator *generator, const XGenRequest *request)
+{
+  guint i;
+
+  for (i = 0; i < generator->entries->len; i++)
+    {
+      MixEntry *entry = g_ptr_array_index (generator->entries, i);
+      if (entry->request == request)
+	return entry;
+    }
+  return NULL;
+}
+
+/**
+ * xgen_generator_add_request:
+ * @generator: A generator
+ * @request: A request to add to the mix
+ * @weight: How often the request is chosen relative to the others
+ *
+ * Adds a request to the mix, or changes its weight if it's already part of
+ * it. A request with a weight of 40 is chosen twice as often as one with a
+ * weight of 20, so weights can be given as percentages.
+ *
+ * This function returns FALSE if @weight is 0.
+ */
+gboolean
+xgen_generator_add_request (XGenGenerator *generator,
+			    const XGenRequest *request,
+			    guint weight)
+{
+  MixEntry *entry;
+  guint i;
+
+  if (!weight)
+    {
+      g_warning ("Generator: %s needs a non zero weight",
+		 XGEN_DEF (request)->name);
+      return FALSE;
+    }
+
+  entry = find_entry (generator, request);
+  if (entry)
+    {
+      entry->weight = weight;
+      update_cumulative_weights (generator);
+      return TRUE;
+    }
+
+  entry = g_new0 (MixEntry, 1);
+  entry->request = request;
+  entry->layout = xgen_definition_get_layout (XGEN_DEF (request));
+  entry->weight = weight;
+  entry->fields = g_new0 (FieldPlan, entry->layout->n_fields);
+
+  for (i = 0; i < entry->layout->n_fields; i++)
+    {
+      const XGenFieldLayout *field_layout = &entry->layout->fields[i];
+      const XGenFieldDefinition *field = field_layout->field;
+      FieldPlan *plan = &entry->fields[i];
+
+      if (lookup_resource (generator, field->definition, &plan->value))
+	plan->source = VALUE_RESOURCE;
+      if (field->enum_def)
+	plan->items = get_item_set (generator, field->enum_def);
+
+      plan->length_index = find_length_index (entry->layout, i);
+    }
+
+  g_ptr_array_add (generator->entries, entry);
+  update_cumulative_weights (generator);
+  return TRUE;
+}
+
+/**
+ * xgen_generator_set_field:
+ * @generator: A generator
+ * @request: A request that's part of the mix
+ * @field: The name of an integer field, or the mask name of a valueparam
+ * @value: The value to always use
+ *
+ * Fixes the value of a field instead of choosing it randomly, e.g. to
+ * give ChangeProperty a valid format. Setting the length field of a list
+ * fixes the number of elements in the list.
+ *
+ * This function returns FALSE if @request isn't part of the mix or
+ * doesn't have such a field.
+ */
+gboolean
+xgen_generator_set_field (XGenGenerator *generator,
+			  const XGenRequest *request,
+			  const char *field,
+			  guint32 value)
+{
+  MixEntry *entry = find_entry (generator, request);
+  gint index;
+
+  if (!entry)
+    {
+      g_warning ("Generator: %s isn't part of the mix",
+		 XGEN_DEF (request)->name);
+      return FALSE;
+    }
+
+  index = _xgen_layout_find_field_or_mask (entry->layout, field);
+  if (index < 0
+      || (entry->layout->fields[index].kind != XGEN_LAYOUT_SCALAR
+	  && entry->layout->fields[index].kind != XGEN_LAYOUT_VALUEPARAM))
+    {
+      g_warning ("Generator: %s has no integer field \"%s\"",
+		 XGEN_DEF (request)->name, field);
+      return FALSE;
+    }
+
+  entry->fields[index].source = VALUE_FIXED;
+  entry->fields[index].value = value;
+  return TRUE;
+}
+
+/**
+ * xgen_generator_parse_mix:
+ * @generator: A generator
+ * @mix: A description of a request mix
+ *
+ * Adds the requests of a mix description such as:
+ *
+ *   xproto:PolyFillRectangle=40; xproto:ChangeProperty=20 format=8 mode=0
+ *
+ * Entries are separated by ';' and each is a request name, optionally
+ * followed by '=' and its weight (1 by default) and then any number of
+ * field=value settings as for xgen_generator_set_field().
+ *
+ * This function returns FALSE if the description is invalid, in which
+ * case some of its entries may already have been added.
+ */
+gboolean
+xgen_generator_parse_mix (XGenGenerator *generator, const char *mix)
+{
+  char **entries = g_strsplit (mix, ";", 0);
+  gboolean ret = FALSE;
+  guint i;
+
+  for (i = 0; entries[i]; i++)
+    {
+      char **tokens;
+      const XGenDefinition *request;
+      char *weight_str;
+      guint weight = 1;
+      guint j;
+
+      g_strstrip (entries[i]);
+      if (!entries[i][0])
+	continue;
+
+      tokens = g_strsplit_set (entries[i], " \t", 0);
+
+      weight_str = strchr (tokens[0], '=');
+      if (weight_str)
+	{
+	  char *end;
+
+	  *weight_str++ = '\0';
+	  weight = strtoul (weight_str, &end, 0);
+	  if (*end || end == weight_str)
+	    {
+	      g_warning ("Generator: Invalid weight in \"%s\"", entries[i]);
+	      g_strfreev (tokens);
+	      goto out;
+	    }
+	}
+
+      request = xgen_state_find_definition (generator->state, tokens[0],
+					    XGEN_REQUEST);
+      if (!request)
+	{
+	  g_warning ("Generator: Unknown request \"%s\"", tokens[0]);
+	  g_strfreev (tokens);
+	  goto out;
+	}
+      if (!xgen_generator_add_request (generator, XGEN_REQUEST_DEF (request),
+				       weight))
+	{
+	  g_strfreev (tokens);
+	  goto out;
+	}
+
+      for (j = 1; tokens[j]; j++)
+	{
+	  char *value_str = strchr (tokens[j], '=');
+	  char *end = NULL;
+	  guint32 value = 0;
+
+	  if (!tokens[j][0])
+	    continue;
+
+	  if (value_str)
+	    {
+	      *value_str++ = '\0';
+	      value = strtoul (value_str, &end, 0);
+	    }
+	  if (!value_str || *end || end == value_str)
+	    {
+	      g_warning ("Generator: Expected field=value in \"%s\"",
+			 entries[i]);
+	      g_strfreev (tokens);
+	      goto out;
+	    }
+	  if (!xgen_generator_set_field (generator,
+					 XGEN_REQUEST_DEF (request),
+					 tokens[j], value))
+	    {
+	      g_strfreev (tokens);
+	      goto out;
+	    }
+	}
+
+      g_strfreev (tokens);
+    }
+
+  ret = TRUE;
+
+out:
+  g_strfreev (entries);
+  return ret;
+}
+
+/**
+ * xgen_generator_set_resource:
+ * @generator: A generator
+ * @type: A type name such as "WINDOW", "DRAWABLE" or "GCONTEXT"
+ * @xid: The value to use for fields of that type
+ *
+ * Makes every field of the given type, including typedefs of it, use
+ * @xid rather than a random value so requests refer to resources that
+ * exist. Values fixed with xgen_generator_set_field() take precedence.
+ */
+void
+xgen_generator_set_resource (XGenGenerator *generator,
+			     const char *type,
+			     guint32 xid)
+{
+  guint i, j;
+
+  g_hash_table_insert (generator->resources, g_strdup (type),
+		       GUINT_TO_POINTER (xid));
+
+  for (i = 0; i < generator->entries->len; i++)
+    {
+      MixEntry *entry = g_ptr_array_index (generator->entries, i);
+
+      for (j = 0; j < entry->layout->n_fields; j++)
+	{
+	  FieldPlan *plan = &entry->fields[j];
+
+	  if (plan->source != VALUE_FIXED
+	      && lookup_resource (generator,
+				  entry->layout->fields[j].field->definition,
+				  &plan->value))
+	    plan->source = VALUE_RESOURCE;
+	}
+    }
+}
+
+/**
+ * xgen_generator_set_limits:
+ * @generator: A generator
+ * @max_value: The largest random value given to an integer field
+ * @max_list_length: The most elements in a list whose length is chosen
+ *		     randomly
+ *
+ * Keeps random values small enough for realistic traffic; e.g. a
+ * rectangle with random 16 bit dimensions would take far longer to draw
+ * than a typical one. Enum and mask fields aren't limited.
+ */
+void
+xgen_generator_set_limits (XGenGenerator *generator,
+			   guint32 max_value,
+			   guint max_list_length)
+{
+  generator->max_value = max_value;
+  generator->max_list_length = MAX (max_list_length, 1);
+}
+
+/* Writes a random float or double of @size bytes within the value limit */
+static void
+random_float (XGenGenerator *generator, guint size, guint8 *data)
+{
+  gdouble value = g_rand_double_range (generator->rand,
+				       -(gdouble)generator->max_value,
+				       generator->max_value);
+
+  if (size == 8)
+    memcpy (data, &value, 8);
+  else
+    {
+      gfloat value32 = value;
+      memcpy (data, &value32, 4);
+    }
+}
+
+static guint32
+random_scalar (XGenGenerator *generator,
+	       const XGenDefinition *type,
+	       guint size)
+{
+  guint32 max = size >= 4 ? G_MAXUINT32 : (1U << (size * 8)) - 1;
+  guint32 bits;
+
+  switch (type->type)
+    {
+    case XGEN_FLOAT:
+      /* Scalars are given by their raw bits */
+      random_float (generator, 4, (guint8 *)&bits);
+      return bits;
+    case XGEN_DOUBLE:
+      /* Too wide for a scalar value, so only lists of doubles are random */
+      return 0;
+    case XGEN_BOOLEAN:
+      return g_rand_int_range (generator->rand, 0, 2);
+    case XGEN_CHAR:
+      return g_rand_int_range (generator->rand, ' ', '~' + 1);
+    case XGEN_SIGNED:
+      max = MIN (MIN (max >> 1, generator->max_value), G_MAXINT32 - 1);
+      return (guint32)g_rand_int_range (generator->rand, -(gint32)max,
+					(gint32)max + 1);
+    default:
+      max = MIN (max, generator->max_value);
+      if (max >= G_MAXINT32)
+	return g_rand_int (generator->rand) & max;
+      return g_rand_int_range (generator->rand, 0, max + 1);
+    }
+}
+
+static guint32
+random_from_items (XGenGenerator *generator,
+		   const ItemSet *items,
+		   gboolean is_mask)
+{
+  guint32 value = 0;
+  guint i;
+
+  if (!is_mask)
+    return items->items[g_rand_int_range (generator->rand, 0,
+					  items->n_items)];
+
+  for (i = 0; i < items->n_items; i++)
+    if (g_rand_boolean (generator->rand))
+      value |= items->items[i];
+  return value;
+}
+
+static guint32
+random_field_value (XGenGenerator *generator,
+		    const XGenFieldDefinition *field,
+		    const XGenDefinition *type,
+		    guint size)
+{
+  guint32 xid;
+
+  if (lookup_resource (generator, field->definition, &xid))
+    return xid;
+  if (field->enum_def && field->enum_def->items)
+    return random_from_items (generator,
+			      get_item_set (generator, field->enum_def),
+			      field->is_mask);
+  return random_scalar (generator, type, size);
+}
+
+/* Reserves @n bytes of scratch space, aligned for the values and pointers
+ * that are kept there as well as for list elements */
+static guint8 *
+scratch_reserve (XGenGenerator *generator, gsize n)
+{
+  guint8 *data;
+
+  generator->scratch_len = (generator->scratch_len + 7) & ~(gsize)7;
+  if (generator->scratch_len + n > generator->scratch_allocated)
+    {
+      generator->scratch_allocated = MAX (generator->scratch_allocated, 1024);
+      while (generator->scratch_len + n > generator->scratch_allocated)
+	generator->scratch_allocated *= 2;
+      generator->scratch = g_realloc (generator->scratch,
+				      generator->scratch_allocated);
+    }
+
+  data = generator->scratch + generator->scratch_len;
+  generator->scratch_len += n;
+  return data;
+}
+
+static void
+add_fixup (XGenGenerator *generator, gsize pointer, gsize target)
+{
+  Fixup fixup;
+
+  fixup.pointer = pointer;
+  fixup.target = target;
+  g_array_append_val (generator->fixups, fixup);
+}
+
+/* The offset of the data pointer of a value in a values array that's
+ * kept in the scratch space */
+static inline gsize
+value_data_offset (gsize values_offset, guint index)
+{
+  return values_offset + index * sizeof (XGenEncodeValue)
+    + G_STRUCT_OFFSET (XGenEncodeValue, data);
+}
+
+static void random_elements (XGenGenerator *generator,
+			     const XGenFieldDefinition *field,
+			     const XGenDefinition *type,
+			     guint size,
+			     guint8 *data,
+			     guint32 count);
+
+/* Fills in a fixed size struct in host byte order */
+static void
+random_struct (XGenGenerator *generator,
+	       const XGenLayout *layout,
+	       guint8 *data)
+{
+  guint i;
+
+  memset (data, 0, layout->fixed_size);
+
+  for (i = 0; i < layout->n_fields; i++)
+    {
+      const XGenFieldLayout *field_layout = &layout->fields[i];
+
+      if (field_layout->kind == XGEN_LAYOUT_LIST
+	  && strcmp (field_layout->field->name, "pad") == 0)
+	continue;
+
+      random_elements (generator, field_layout->field, field_layout->type,
+		       field_layout->size, data + field_layout->offset,
+		       field_layout->kind == XGEN_LAYOUT_LIST
+		       ? field_layout->field->length->value : 1);
+    }
+}
+
+static void
+random_elements (XGenGenerator *generator,
+		 const XGenFieldDefinition *field,
+		 const XGenDefinition *type,
+		 guint size,
+		 guint8 *data,
+		 guint32 count)
+{
+  guint32 i;
+
+  /* Variable sized structs are generated by random_structs() instead */
+  if (type->type == XGEN_STRUCT)
+    {
+      const XGenLayout *layout = xgen_definition_get_layout (type);
+
+      for (i = 0; i < count; i++, data += size)
+	random_struct (generator, layout, data);
+    }
+  else if (type->type == XGEN_UNION || type->type == XGEN_VOID)
+    {
+      for (i = 0; i < count * size; i++)
+	data[i] = g_rand_int_range (generator->rand, 0, 256);
+    }
+  else if (type->type == XGEN_FLOAT || type->type == XGEN_DOUBLE)
+    {
+      for (i = 0; i < count; i++, data += size)
+	random_float (generator, size, data);
+    }
+  else
+    {
+      for (i = 0; i < count; i++, data += size)
+	_xgen_write_unsigned (data, size,
+			      random_field_value (generator, field,
+						  type, size),
+			      FALSE);
+    }
+}
+
+static gboolean
+evaluate (const XGenExpression *expression,
+	  const XGenLayout *layout,
+	  const XGenEncodeValue *values,
+	  guint n_known,
+	  long *value)
+{
+  long left, right;
+  gint i;
+
+  switch (expression->type)
+    {
+    case XGEN_VALUE:
+      *value = expression->value;
+      return TRUE;
+
+    case XGEN_FIELDREF:
+      for (i = n_known - 1; i >= 0; i--)
+	{
+	  const XGenFieldLayout *field_layout = &layout->fields[i];
+
+	  if (field_layout->kind != XGEN_LAYOUT_SCALAR
+	      || strcmp (field_layout->field->name, expression->field) != 0)
+	    continue;
+
+	  *value = field_layout->type->type == XGEN_SIGNED
+	    ? (long)(gint32)values[i].value : (long)values[i].value;
+	  return TRUE;
+	}
+      return FALSE;
+
+    case XGEN_OP:
+      if (!evaluate (expression->left, layout, values, n_known, &left)
+	  || !evaluate (expression->right, layout, values, n_known, &right))
+	return FALSE;
+      switch (expression->op)
+	{
+	case XGEN_ADD:
+	  *value = left + right;
+	  return TRUE;
+	case XGEN_SUBTRACT:
+	  *value = left - right;
+	  return TRUE;
+	case XGEN_MULTIPLY:
+	  *value = left * right;
+	  return TRUE;
+	case XGEN_DIVIDE:
+	  if (right == 0)
+	    return FALSE;
+	  *value = left / right;
+	  return TRUE;
+	case XGEN_LEFT_SHIFT:
+	  *value = left << right;
+	  return TRUE;
+	case XGEN_BITWISE_AND:
+	  *value = left & right;
+	  return TRUE;
+	}
+    }
+
+  return FALSE;
+}
+
+/* Works out how many elements a list gets. @plans are the plans of the
+ * request's fields, or NULL within a struct */
+static guint32
+list_count (XGenGenerator *generator,
+	    const XGenLayout *layout,
+	    const FieldPlan *plans,
+	    const XGenEncodeValue *values,
+	    guint index)
+{
+  const XGenFieldLayout *field_layout = &layout->fields[index];
+  const XGenExpression *length = field_layout->field->length;
+  long count;
+
+  /* Elements of a variable size other than structs, such as variable
+   * sized unions, aren't supported */
+  if (!field_layout->size && field_layout->type->type != XGEN_STRUCT)
+    return 0;
+
+  switch (length->type)
+    {
+    case XGEN_VALUE:
+      return length->value;
+    case XGEN_FIELDREF:
+      if (plans && plans[index].length_index >= 0
+	  && plans[plans[index].length_index].source == VALUE_FIXED)
+	return plans[plans[index].length_index].value;
+      break;
+    case XGEN_OP:
+      /* The length follows from fields that were already chosen */
+      if (!field_layout->fills_remainder)
+	{
+	  if (!evaluate (length, layout, values, index, &count) || count < 0)
+	    return 0;
+	  return count;
+	}
+      break;
+    }
+
+  return g_rand_int_range (generator->rand, 1,
+			   generator->max_list_length + 1);
+}
+
+/* Generates the mask of a valueparam, as wide as its declared mask type,
+ * then a value for each bit that's set, and returns the offset of the
+ * values in the scratch space */
+static gsize
+random_valueparam (XGenGenerator *generator,
+		   const XGenFieldLayout *field_layout,
+		   const FieldPlan *plan,
+		   guint32 *mask)
+{
+  guint8 *data;
+  guint32 count;
+  guint32 j;
+
+  if (plan && plan->source == VALUE_FIXED)
+    *mask = plan->value;
+  else if (field_layout->size >= 4)
+    *mask = g_rand_int (generator->rand);
+  else
+    *mask = g_rand_int (generator->rand)
+      & ((1U << (field_layout->size * 8)) - 1);
+
+  count = _xgen_bit_count (*mask);
+  data = scratch_reserve (generator, (gsize)count * value_type.size);
+  for (j = 0; j < count; j++)
+    _xgen_write_unsigned (data + j * value_type.size, value_type.size,
+			  random_scalar (generator, XGEN_DEF (&value_type),
+					 value_type.size),
+			  FALSE);
+  return data - generator->scratch;
+}
+
+static gsize random_structs (XGenGenerator *generator,
+			     const XGenDefinition *type,
+			     guint32 count);
+
+/* Generates the values of the fields of @layout into the values array at
+ * @values_offset in the scratch space. @plans are the plans of the
+ * request's fields, or NULL for a variable sized struct. */
+static void
+random_values (XGenGenerator *generator,
+	       const XGenLayout *layout,
+	       const FieldPlan *plans,
+	       gsize values_offset)
+{
+  guint i;
+
+  memset (generator->scratch + values_offset, 0,
+	  sizeof (XGenEncodeValue) * layout->n_fields);
+
+  for (i = 0; i < layout->n_fields; i++)
+    {
+      const XGenFieldLayout *field_layout = &layout->fields[i];
+      const XGenFieldDefinition *field = field_layout->field;
+      const FieldPlan *plan = plans ? &plans[i] : NULL;
+      XGenEncodeValue *values;
+      gsize data_offset;
+      guint8 *data;
+      guint32 count = 0;
+      guint32 mask;
+      gint length_index;
+
+      /* The scratch space moves as it grows so the values are found
+       * afresh for each field */
+      values = (XGenEncodeValue *)(generator->scratch + values_offset);
+
+      switch (field_layout->kind)
+	{
+	case XGEN_LAYOUT_SCALAR:
+	  if (!plan)
+	    values[i].value = random_field_value (generator, field,
+						  field_layout->type,
+						  field_layout->size);
+	  else if (plan->source != VALUE_RANDOM)
+	    values[i].value = plan->value;
+	  else if (plan->items && plan->items->n_items)
+	    values[i].value = random_from_items (generator, plan->items,
+						 field->is_mask);
+	  else
+	    values[i].value = random_scalar (generator, field_layout->type,
+					     field_layout->size);
+	  continue;
+
+	case XGEN_LAYOUT_STRUCT:
+	  count = 1;
+	  break;
+
+	case XGEN_LAYOUT_LIST:
+	  if (strcmp (field->name, "pad") == 0)
+	    continue;
+	  count = list_count (generator, layout, plans, values, i);
+	  values[i].count = count;
+	  length_index = plan ? plan->length_index
+			      : find_length_index (layout, i);
+	  if (length_index >= 0)
+	    values[length_index].value = count;
+	  break;
+
+	case XGEN_LAYOUT_VALUEPARAM:
+	  data_offset = random_valueparam (generator, field_layout, plan,
+					   &mask);
+	  values = (XGenEncodeValue *)(generator->scratch + values_offset);
+	  values[i].value = mask;
+	  add_fixup (generator, value_data_offset (values_offset, i),
+		     data_offset);
+	  continue;
+	}
+
+      if (!field_layout->size && field_layout->type->type == XGEN_STRUCT)
+	data_offset = random_structs (generator, field_layout->type, count);
+      else
+	{
+	  data = scratch_reserve (generator,
+				  (gsize)count * field_layout->size);
+	  random_elements (generator, field, field_layout->type,
+			   field_layout->size, data, count);
+	  data_offset = data - generator->scratch;
+	}
+      add_fixup (generator, value_data_offset (values_offset, i),
+		 data_offset);
+    }
+}
+
+/* Generates @count variable sized structs as the encoder takes them, an
+ * array of pointers to the values of each, and returns the offset of the
+ * array in the scratch space */
+static gsize
+random_structs (XGenGenerator *generator,
+		const XGenDefinition *type,
+		guint32 count)
+{
+  const XGenLayout *layout = xgen_definition_get_layout (type);
+  gsize pointers_offset;
+  guint32 i;
+
+  pointers_offset =
+    scratch_reserve (generator, (gsize)count * sizeof (gpointer))
+    - generator->scratch;
+
+  for (i = 0; i < count; i++)
+    {
+      gsize values_offset =
+	scratch_reserve (generator,
+			 sizeof (XGenEncodeValue) * layout->n_fields)
+	- generator->scratch;
+
+      add_fixup (generator, pointers_offset + i * sizeof (gpointer),
+		 values_offset);
+      random_values (generator, layout, NULL, values_offset);
+    }
+
+  return pointers_offset;
+}
+
+/**
+ * xgen_generator_append:
+ * @generator: A generator with a non-empty mix
+ * @encoder: The encoder for the connection
+ * @buffer: The buffer to append the request to
+ *
+ * Chooses a request from the mix, generates values for its fields and
+ * appends it to @buffer. The list data is generated into memory that's
+ * reused by the next call, so the encoder mustn't have a zero copy
+ * threshold set.
+ *
+ * This function returns the request that was appended, or NULL if the
+ * mix is empty or the request couldn't be encoded.
+ */
+const XGenRequest *
+xgen_generator_append (XGenGenerator *generator,
+		       XGenEncoder *encoder,
+		       XGenOutputBuffer *buffer)
+{
+  const MixEntry *entry;
+  gsize values_offset;
+  guint64 pick;
+  guint lo, hi, i;
+
+  if (!generator->total_weight)
+    {
+      g_warning ("Generator: The request mix is empty");
+      return NULL;
+    }
+
+  /* Binary search for the first entry whose running total exceeds a
+   * random point within the total weight */
+  pick = (((guint64)g_rand_int (generator->rand) << 32)
+	  | g_rand_int (generator->rand)) % generator->total_weight;
+  lo = 0;
+  hi = generator->entries->len - 1;
+  while (lo < hi)
+    {
+      guint mid = (lo + hi) / 2;
+      if (generator->cumulative[mid] > pick)
+	hi = mid;
+      else
+	lo = mid + 1;
+    }
+  entry = g_ptr_array_index (generator->entries, lo);
+
+  generator->scratch_len = 0;
+  g_array_set_size (generator->fixups, 0);
+  values_offset =
+    scratch_reserve (generator,
+		     sizeof (XGenEncodeValue) * entry->layout->n_fields)
+    - generator->scratch;
+  random_values (generator, entry->layout, entry->fields, values_offset);
+
+  /* The scratch space may have moved while it grew so the pointers
+   * within it are only written once it's complete */
+  for (i = 0; i < generator->fixups->len; i++)
+    {
+      const Fixup *fixup = &g_array_index (generator->fixups, Fixup, i);
+      const guint8 *target = generator->scratch + fixup->target;
+
+      memcpy (generator->scratch + fixup->pointer, &target, sizeof (target));
+    }
+
+  if (!xgen_encoder_append (encoder, buffer, entry->request,
+			    (XGenEncodeValue *)(generator->scratch
+						+ values_offset)))
+    return NULL;
+  return entry->request;
+}
+
+void
+xgen_generator_free (XGenGenerator *generator)
+{
+  GHashTableIter iter;
+  gpointer value;
+  guint i;
+
+  for (i = 0; i < generator->entries->len; i++)
+    {
+      MixEntry *entry = g_ptr_array_index (generator->entries, i);
+      g_free (entry->fields);
+      g_free (entry);
+    }
+  g_ptr_array_free (generator->entries, TRUE);
+
+  g_hash_table_iter_init (&iter, generator->item_sets);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      ItemSet *item_set = value;
+      g_free (item_set->items);
+      g_free (item_set);
+    }
+  g_hash_table_destroy (generator->item_sets);
+  g_hash_table_destroy (generator->resources);
+
+  g_rand_free (generator->rand);
+  g_free (generator->cumulative);
+  g_free (generator->scratch);
+  g_array_free (generator->fixups, TRUE);
+  g_free (generator);
+}
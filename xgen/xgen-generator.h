@@ -0,0 +1,38 @@
+#ifndef _XGEN_GENERATOR_H_
+#define _XGEN_GENERATOR_H_
+
+#include <xgen.h>
+#include <xgen-encoder.h>
+
+#include <glib.h>
+
+/**
+ * Produces a reproducible stream of random but well formed requests
+ * chosen from a weighted mix. Field values are derived from the protocol
+ * definitions: enum fields take one of their items, mask fields a set of
+ * their bits and lists a length consistent with their length expression.
+ */
+typedef struct _XGenGenerator XGenGenerator;
+
+XGenGenerator *xgen_generator_new (const XGenState *state, guint32 seed);
+gboolean xgen_generator_add_request (XGenGenerator *generator,
+				     const XGenRequest *request,
+				     guint weight);
+gboolean xgen_generator_set_field (XGenGenerator *generator,
+				   const XGenRequest *request,
+				   const char *field,
+				   guint32 value);
+gboolean xgen_generator_parse_mix (XGenGenerator *generator,
+				   const char *mix);
+void xgen_generator_set_resource (XGenGenerator *generator,
+				  const char *type,
+				  guint32 xid);
+void xgen_generator_set_limits (XGenGenerator *generator,
+				guint32 max_value,
+				guint max_list_length);
+const XGenRequest *xgen_generator_append (XGenGenerator *generator,
+					  XGenEncoder *encoder,
+					  XGenOutputBuffer *buffer);
+void xgen_generator_free (XGenGenerator *generator);
+
+#endif /* _XGEN_GENERATOR_H_ */
@@ -0,0 +1,254 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-io.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+/**
+ * _xgen_writev_all:
+ * @fd: The file descriptor to write to
+ * @iov: The buffers to write, which are modified
+ * @n_iov: The number of buffers, at most _XGEN_IOV_MAX
+ *
+ * Writes all of the buffers, retrying after partial writes and signals.
+ *
+ * This function returns FALSE with errno set if writing fails.
+ */
+gboolean
+_xgen_writev_all (int fd, struct iovec *iov, int n_iov)
+{
+  while (n_iov > 0)
+    {
+      ssize_t written = writev (fd, iov, n_iov);
+
+      if (written < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return FALSE;
+	}
+
+      while (n_iov > 0 && (gsize)written >= iov->iov_len)
+	{
+	  written -= iov->iov_len;
+	  iov++;
+	  n_iov--;
+	}
+      if (n_iov > 0)
+	{
+	  iov->iov_base = (char *)iov->iov_base + written;
+	  iov->iov_len -= written;
+	}
+    }
+
+  return TRUE;
+}
+
+/**
+ * xgen_io_connect_display:
+ * @display: An X display name such as ":9"
+ *
+ * Connects to the unix socket of a local X server. Only the display
+ * number is used; any host name is ignored.
+ *
+ * This function returns -1 if the display name is invalid or the
+ * connection fails.
+ */
+int
+xgen_io_connect_display (const char *display)
+{
+  struct sockaddr_un addr;
+  const char *number;
+  int fd;
+
+  number = strrchr (display, ':');
+  if (!number || !g_ascii_isdigit (number[1]))
+    {
+      g_warning ("Invalid display \"%s\"", display);
+      return -1;
+    }
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  snprintf (addr.sun_path, sizeof (addr.sun_path), "/tmp/.X11-unix/X%d",
+	    atoi (number + 1));
+
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0)
+    {
+      g_warning ("Failed to connect to %s: %s", addr.sun_path,
+		 strerror (errno));
+      if (fd >= 0)
+	close (fd);
+      return -1;
+    }
+  return fd;
+}
+
+/**
+ * xgen_io_read_exactly:
+ * @fd: The file descriptor to read from
+ * @data: Where to store the data
+ * @len: The number of bytes to read
+ *
+ * Reads exactly @len bytes, retrying after short reads and signals.
+ *
+ * This function returns FALSE if reading fails or the end of the file
+ * comes first.
+ */
+gboolean
+xgen_io_read_exactly (int fd, guint8 *data, gsize len)
+{
+  while (len)
+    {
+      ssize_t n = read (fd, data, len);
+
+      if (n < 0 && errno == EINTR)
+	continue;
+      if (n <= 0)
+	return FALSE;
+      data += n;
+      len -= n;
+    }
+  return TRUE;
+}
+
+/* Reads a fixed position field of a setup struct */
+static guint32
+get_field (const XGenDefinition *def,
+	   const guint8 *data,
+	   const char *name,
+	   gboolean swap)
+{
+  const XGenLayout *layout = xgen_definition_get_layout (def);
+  gint index = xgen_layout_find_field (layout, name);
+
+  g_assert (index >= 0
+	    && layout->fields[index].offset != XGEN_LAYOUT_VARIABLE_OFFSET);
+  return _xgen_read_unsigned (data + layout->fields[index].offset,
+			      layout->fields[index].size, swap);
+}
+
+/**
+ * xgen_io_setup_connection:
+ * @state: The protocol description, which must include xproto:Setup,
+ *	   xproto:FORMAT and xproto:SCREEN
+ * @fd: A new connection to an X server
+ * @byte_order: The byte order to use for the connection
+ * @info: Where to store what the setup reply says
+ *
+ * Performs the connection setup and reads the setup reply.
+ *
+ * This function returns FALSE if the setup fails or the server refuses
+ * the connection.
+ */
+gboolean
+xgen_io_setup_connection (const XGenState *state,
+			  int fd,
+			  XGenByteOrder byte_order,
+			  XGenSetupInfo *info)
+{
+  const XGenDefinition *setup_def =
+    xgen_state_find_definition (state, "xproto:Setup", XGEN_STRUCT);
+  const XGenDefinition *screen_def =
+    xgen_state_find_definition (state, "xproto:SCREEN", XGEN_STRUCT);
+  const XGenDefinition *format_def =
+    xgen_state_find_definition (state, "xproto:FORMAT", XGEN_STRUCT);
+  gboolean swap = _XGEN_NEEDS_SWAP (byte_order);
+  guint8 request[12] = { 0 };
+  guint8 header[8];
+  gsize screen_offset;
+  const guint8 *screen;
+  guint8 *setup;
+  gsize len;
+
+  if (!setup_def || !screen_def || !format_def)
+    {
+      g_warning ("The protocol files don't describe the connection setup");
+      return FALSE;
+    }
+
+  request[0] = byte_order == XGEN_LSB_FIRST ? 'l' : 'B';
+  _xgen_write_unsigned (request + 2, 2, 11, swap);
+  if (write (fd, request, sizeof (request)) != sizeof (request)
+      || !xgen_io_read_exactly (fd, header, sizeof (header)))
+    {
+      g_warning ("Failed to set up the connection");
+      return FALSE;
+    }
+
+  len = 8 + _xgen_read_unsigned (header + 6, 2, swap) * 4;
+  setup = g_malloc (len);
+  memcpy (setup, header, sizeof (header));
+  if (!xgen_io_read_exactly (fd, setup + 8, len - 8))
+    {
+      g_warning ("Failed to read the connection setup reply");
+      g_free (setup);
+      return FALSE;
+    }
+
+  if (setup[0] != 1)
+    {
+      g_warning ("The X server refused the connection: %.*s",
+		 (int)MIN (header[1], len - 8), setup + 8);
+      g_free (setup);
+      return FALSE;
+    }
+
+  /* The vendor string is padded to 4 bytes, then come the pixmap formats
+   * and the first screen */
+  screen_offset = xgen_definition_get_layout (setup_def)->fixed_size;
+  if (screen_offset <= len)
+    screen_offset += _XGEN_ALIGN4 (get_field (setup_def, setup,
+					      "vendor_len", swap))
+      + get_field (setup_def, setup, "pixmap_formats_len", swap)
+	* xgen_definition_get_layout (format_def)->fixed_size;
+  if (screen_offset + xgen_definition_get_layout (screen_def)->fixed_size
+      > len
+      || !get_field (setup_def, setup, "roots_len", swap))
+    {
+      g_warning ("The connection setup reply has no screens");
+      g_free (setup);
+      return FALSE;
+    }
+  screen = setup + screen_offset;
+
+  info->resource_id_base =
+    get_field (setup_def, setup, "resource_id_base", swap);
+  info->resource_id_mask =
+    get_field (setup_def, setup, "resource_id_mask", swap);
+  info->maximum_request_length =
+    get_field (setup_def, setup, "maximum_request_length", swap);
+  info->root = get_field (screen_def, screen, "root", swap);
+  info->root_visual = get_field (screen_def, screen, "root_visual", swap);
+  info->default_colormap =
+    get_field (screen_def, screen, "default_colormap", swap);
+
+  g_free (setup);
+  return TRUE;
+}
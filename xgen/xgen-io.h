@@ -0,0 +1,35 @@
+#ifndef _XGEN_IO_H_
+#define _XGEN_IO_H_
+
+#include <xgen.h>
+
+#include <glib.h>
+
+/**
+ * Helpers for clients of a local X server, such as Xvfb, shared by the
+ * replay and the load generator. Only unauthenticated connections to
+ * the server's unix socket are supported.
+ */
+
+/**
+ * What a client needs to know from the connection setup reply. The
+ * screen values are those of the first screen.
+ */
+typedef struct _XGenSetupInfo
+{
+  guint32 resource_id_base;
+  guint32 resource_id_mask;
+  guint32 maximum_request_length;
+  guint32 root;
+  guint32 root_visual;
+  guint32 default_colormap;
+} XGenSetupInfo;
+
+int xgen_io_connect_display (const char *display);
+gboolean xgen_io_read_exactly (int fd, guint8 *data, gsize len);
+gboolean xgen_io_setup_connection (const XGenState *state,
+				   int fd,
+				   XGenByteOrder byte_order,
+				   XGenSetupInfo *info);
+
+#endif /* _XGEN_IO_H_ */
@@ -0,0 +1,1373 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+static const XGenLayout *get_layout (const XGenDefinition *def);
+static gboolean cursor_resolve (XGenFieldCursor *cursor, guint field);
+
+const XGenDefinition *
+_xgen_resolve_typedefs (const XGenDefinition *def)
+{
+  while (def && def->type == XGEN_TYPEDEF)
+    def = XGEN_TYPEDEF_DEF (def)->reference;
+  return def;
+}
+
+/* Returns the wire size of a type, or 0 if it has a variable size */
+static guint
+type_size (const XGenDefinition *type)
+{
+  const XGenLayout *layout;
+
+  if (!type)
+    return 0;
+
+  switch (type->type)
+    {
+    case XGEN_VOID:
+    case XGEN_BOOLEAN:
+    case XGEN_CHAR:
+    case XGEN_SIGNED:
+    case XGEN_UNSIGNED:
+    case XGEN_XID:
+    case XGEN_FLOAT:
+    case XGEN_DOUBLE:
+      return XGEN_BASE_TYPE_DEF (type)->size;
+    case XGEN_XIDUNION:
+      return 4;
+    case XGEN_STRUCT:
+    case XGEN_UNION:
+      layout = get_layout (type);
+      return layout->is_fixed ? layout->fixed_size : 0;
+    default:
+      return 0;
+    }
+}
+
+static void
+init_field_layout (XGenFieldLayout *field_layout,
+		   const XGenFieldDefinition *field)
+{
+  const XGenDefinition *type = _xgen_resolve_typedefs (field->definition);
+
+  field_layout->field = field;
+  field_layout->type = type;
+  field_layout->offset = XGEN_LAYOUT_VARIABLE_OFFSET;
+
+  if (field->definition->type == XGEN_VALUEPARAM)
+    {
+      const XGenValueParam *valueparam =
+	XGEN_VALUE_PARAM_DEF (field->definition);
+
+      field_layout->kind = XGEN_LAYOUT_VALUEPARAM;
+      field_layout->size =
+	type_size (_xgen_resolve_typedefs (valueparam->reference));
+    }
+  else if (field->length)
+    {
+      field_layout->kind = XGEN_LAYOUT_LIST;
+      /* Lists of void are untyped bytes, such as property data */
+      field_layout->size = type->type == XGEN_VOID ? 1 : type_size (type);
+    }
+  else if (type->type == XGEN_STRUCT || type->type == XGEN_UNION)
+    {
+      field_layout->kind = XGEN_LAYOUT_STRUCT;
+      field_layout->size = type_size (type);
+    }
+  else
+    {
+      field_layout->kind = XGEN_LAYOUT_SCALAR;
+      field_layout->size = type_size (type);
+    }
+}
+
+/* Returns the wire size of a field if it's the same for every message,
+ * else 0 */
+static guint
+field_fixed_size (const XGenFieldLayout *field_layout)
+{
+  const XGenExpression *length = field_layout->field->length;
+
+  switch (field_layout->kind)
+    {
+    case XGEN_LAYOUT_SCALAR:
+    case XGEN_LAYOUT_STRUCT:
+      return field_layout->size;
+    case XGEN_LAYOUT_LIST:
+      if (length->type == XGEN_VALUE)
+	return field_layout->size * length->value;
+      return 0;
+    default:
+      return 0;
+    }
+}
+
+/* A request list whose length isn't sent fills the remainder of the
+ * request (see xgen_parse_field_elements) */
+static gboolean
+is_implicit_fieldref (GList *fields, const XGenExpression *length)
+{
+  GList *tmp;
+
+  if (!length || length->type != XGEN_FIELDREF)
+    return FALSE;
+
+  for (tmp = fields; tmp != NULL; tmp = tmp->next)
+    {
+      XGenFieldDefinition *field = tmp->data;
+      if (field->implicit && strcmp (field->name, length->field) == 0)
+	return TRUE;
+    }
+  return FALSE;
+}
+
+/* The C alignments of the base types on this host; these aren't always
+ * the same as their sizes, e.g. doubles are 4 byte aligned within
+ * structs on i386 */
+typedef struct { char c; guint16 value; } Align16;
+typedef struct { char c; guint32 value; } Align32;
+typedef struct { char c; guint64 value; } Align64;
+typedef struct { char c; float value; } AlignFloat;
+typedef struct { char c; double value; } AlignDouble;
+
+guint
+_xgen_base_type_alignment (XGenType type, guint size)
+{
+  if (type == XGEN_FLOAT)
+    return G_STRUCT_OFFSET (AlignFloat, value);
+  if (type == XGEN_DOUBLE)
+    return G_STRUCT_OFFSET (AlignDouble, value);
+
+  switch (size)
+    {
+    case 2:
+      return G_STRUCT_OFFSET (Align16, value);
+    case 4:
+      return G_STRUCT_OFFSET (Align32, value);
+    case 8:
+      return G_STRUCT_OFFSET (Align64, value);
+    }
+  return 1;
+}
+
+/* Works out whether a layout is the same as that of the naturally
+ * aligned C struct with the same fields, so messages could be used in
+ * place through a struct pointer */
+static void
+compute_host_abi (XGenLayout *layout)
+{
+  guint i;
+
+  layout->alignment = 1;
+  layout->matches_host_abi = layout->is_fixed;
+  layout->is_byte_order_neutral = TRUE;
+
+  for (i = 0; i < layout->n_fields; i++)
+    {
+      const XGenFieldLayout *field_layout = &layout->fields[i];
+      const XGenDefinition *type = field_layout->type;
+      guint alignment;
+
+      if (field_layout->kind == XGEN_LAYOUT_VALUEPARAM
+	  || field_layout->offset == XGEN_LAYOUT_VARIABLE_OFFSET
+	  || !field_layout->size)
+	{
+	  layout->matches_host_abi = FALSE;
+	  continue;
+	}
+
+      if (type->type == XGEN_STRUCT || type->type == XGEN_UNION)
+	{
+	  const XGenLayout *type_layout = get_layout (type);
+
+	  alignment = type_layout->alignment;
+	  if (!type_layout->matches_host_abi)
+	    layout->matches_host_abi = FALSE;
+	  if (!type_layout->is_byte_order_neutral)
+	    layout->is_byte_order_neutral = FALSE;
+	}
+      else
+	{
+	  alignment = _xgen_base_type_alignment (type->type,
+						  field_layout->size);
+	  if (field_layout->size > 1)
+	    layout->is_byte_order_neutral = FALSE;
+	}
+
+      if (field_layout->offset % alignment)
+	layout->matches_host_abi = FALSE;
+      layout->alignment = MAX (layout->alignment, alignment);
+    }
+
+  /* A C struct is padded to a multiple of its alignment */
+  if (layout->fixed_size % layout->alignment)
+    layout->matches_host_abi = FALSE;
+}
+
+/* Interval arithmetic on sizes and list lengths, saturating at
+ * UNBOUNDED */
+#define UNBOUNDED G_MAXUINT64
+
+static guint64
+bound_add (guint64 a, guint64 b)
+{
+  return a > UNBOUNDED - b ? UNBOUNDED : a + b;
+}
+
+static guint64
+bound_mul (guint64 a, guint64 b)
+{
+  if (a == 0 || b == 0)
+    return 0;
+  return a > UNBOUNDED / b ? UNBOUNDED : a * b;
+}
+
+static guint64
+bound_shift (guint64 a, guint64 b)
+{
+  if (a == 0)
+    return 0;
+  if (b >= 64 || a > (UNBOUNDED >> b))
+    return UNBOUNDED;
+  return a << b;
+}
+
+/* The range of values a field used in a length expression can have. List
+ * lengths can't be negative so the negative values of signed fields are
+ * ignored. */
+static void
+fieldref_bounds (const XGenDefinition *def,
+		 const char *name,
+		 guint64 *min,
+		 guint64 *max)
+{
+  const XGenDefinition *type = NULL;
+  guint bits;
+  GList *tmp;
+
+  for (tmp = _xgen_definition_get_fields (def); tmp != NULL; tmp = tmp->next)
+    {
+      XGenFieldDefinition *field = tmp->data;
+      if (strcmp (field->name, name) == 0 && !field->length)
+	{
+	  type = _xgen_resolve_typedefs (field->definition);
+	  break;
+	}
+    }
+
+  *min = 0;
+  *max = UNBOUNDED;
+
+  /* The field may belong to an enclosing definition, which we can't know
+   * about */
+  if (!type)
+    return;
+
+  switch (type->type)
+    {
+    case XGEN_BOOLEAN:
+      *max = 1;
+      break;
+    case XGEN_CHAR:
+    case XGEN_UNSIGNED:
+    case XGEN_XID:
+      bits = XGEN_BASE_TYPE_DEF (type)->size * 8;
+      if (bits < 64)
+	*max = (G_GUINT64_CONSTANT (1) << bits) - 1;
+      break;
+    case XGEN_SIGNED:
+      bits = XGEN_BASE_TYPE_DEF (type)->size * 8;
+      *max = (G_GUINT64_CONSTANT (1) << (bits - 1)) - 1;
+      break;
+    default:
+      break;
+    }
+}
+
+/**
+ * xgen_expression_get_bounds:
+ * @expression: A list length expression
+ * @def: The definition whose fields the expression refers to
+ * @min: Return location for the smallest value
+ * @max: Return location for the largest value
+ *
+ * Works out the range of values a length expression can take from the
+ * widths of the fields it refers to, e.g. a list whose length is a CARD8
+ * field has at most 255 elements.
+ *
+ * This function returns FALSE, with @max set to G_MAXUINT64, if the
+ * expression has no upper bound, e.g. because it refers to a field of
+ * another definition.
+ */
+gboolean
+xgen_expression_get_bounds (const XGenExpression *expression,
+			    const XGenDefinition *def,
+			    guint64 *min,
+			    guint64 *max)
+{
+  guint64 left_min, left_max, right_min, right_max;
+
+  switch (expression->type)
+    {
+    case XGEN_VALUE:
+      *min = *max = expression->value;
+      return TRUE;
+    case XGEN_FIELDREF:
+      fieldref_bounds (def, expression->field, min, max);
+      return *max != UNBOUNDED;
+    case XGEN_OP:
+      break;
+    }
+
+  xgen_expression_get_bounds (expression->left, def, &left_min, &left_max);
+  xgen_expression_get_bounds (expression->right, def, &right_min, &right_max);
+
+  switch (expression->op)
+    {
+    case XGEN_ADD:
+      *min = bound_add (left_min, right_min);
+      *max = bound_add (left_max, right_max);
+      break;
+    case XGEN_SUBTRACT:
+      *min = right_max < left_min ? left_min - right_max : 0;
+      if (left_max == UNBOUNDED)
+	*max = UNBOUNDED;
+      else
+	*max = right_min < left_max ? left_max - right_min : 0;
+      break;
+    case XGEN_MULTIPLY:
+      *min = bound_mul (left_min, right_min);
+      *max = bound_mul (left_max, right_max);
+      break;
+    case XGEN_DIVIDE:
+      *min = right_max == UNBOUNDED ? 0 : left_min / MAX (right_max, 1);
+      if (left_max == UNBOUNDED)
+	*max = UNBOUNDED;
+      else
+	*max = left_max / MAX (right_min, 1);
+      break;
+    case XGEN_LEFT_SHIFT:
+      *min = bound_shift (left_min, right_min);
+      *max = bound_shift (left_max, right_max);
+      break;
+    case XGEN_BITWISE_AND:
+      *min = 0;
+      *max = MIN (left_max, right_max);
+      break;
+    }
+
+  return *max != UNBOUNDED;
+}
+
+/* The largest size of a list element or an inline struct */
+static guint64
+type_max_size (const XGenDefinition *type, guint size)
+{
+  const XGenLayout *layout;
+
+  if (size)
+    return size;
+  if (type->type != XGEN_STRUCT && type->type != XGEN_UNION)
+    return UNBOUNDED;
+  layout = get_layout (type);
+  return layout->is_bounded ? layout->max_size : UNBOUNDED;
+}
+
+static guint64
+field_max_size (const XGenLayout *layout,
+		const XGenFieldLayout *field_layout)
+{
+  guint64 min, max;
+
+  switch (field_layout->kind)
+    {
+    case XGEN_LAYOUT_SCALAR:
+      return field_layout->size;
+    case XGEN_LAYOUT_STRUCT:
+      return type_max_size (field_layout->type, field_layout->size);
+    case XGEN_LAYOUT_LIST:
+      /* Only the message length limits these */
+      if (field_layout->fills_remainder)
+	return UNBOUNDED;
+      xgen_expression_get_bounds (field_layout->field->length,
+				  layout->definition, &min, &max);
+      return bound_mul (max, type_max_size (field_layout->type,
+					    field_layout->size));
+    case XGEN_LAYOUT_VALUEPARAM:
+      /* At most one value per bit of the mask */
+      return _XGEN_ALIGN4 (field_layout->size) + field_layout->size * 8 * 4;
+    }
+  return UNBOUNDED;
+}
+
+/* Works out the largest message a layout allows, if there is a limit */
+static void
+compute_bounds (XGenLayout *layout)
+{
+  const XGenDefinition *def = layout->definition;
+  guint64 max_size = layout->fixed_size;
+  guint i;
+
+  /* Everything after the fixed length prefix */
+  for (i = 0; i < layout->n_fields; i++)
+    {
+      const XGenFieldLayout *field_layout = &layout->fields[i];
+      guint64 size = field_max_size (layout, field_layout);
+
+      if (def->type == XGEN_UNION)
+	max_size = MAX (max_size, size);
+      else if (field_layout->offset == XGEN_LAYOUT_VARIABLE_OFFSET
+	       || !field_fixed_size (field_layout))
+	max_size = bound_add (max_size, size);
+    }
+
+  switch (def->type)
+    {
+    case XGEN_EVENT:
+      if (XGEN_EVENT_DEF (def)->is_generic)
+	{
+	  /* Like replies, generic events can be longer than 32 bytes */
+	  max_size = MAX (max_size, 32);
+	  if (max_size != UNBOUNDED)
+	    max_size = _XGEN_ALIGN4 (max_size);
+	  break;
+	}
+      /* fall through */
+    case XGEN_ERROR:
+      /* Always exactly 32 bytes */
+      max_size = 32;
+      break;
+    case XGEN_REPLY:
+      max_size = MAX (max_size, 32);
+      /* fall through */
+    case XGEN_REQUEST:
+      /* Lengths are sent in 4 byte units */
+      if (max_size != UNBOUNDED)
+	max_size = _XGEN_ALIGN4 (max_size);
+      break;
+    default:
+      break;
+    }
+
+  layout->is_bounded = max_size <= G_MAXUINT;
+  layout->max_size = layout->is_bounded ? max_size : 0;
+}
+
+static XGenLayout *
+build_layout (const XGenDefinition *def)
+{
+  XGenLayout *layout = g_new0 (XGenLayout, 1);
+  GList *fields = _xgen_definition_get_fields (def);
+  GList *wire_fields = NULL;
+  GList *tmp;
+  gboolean fixed = TRUE;
+  guint pos = 0;
+  guint max_size = 0;
+  guint i;
+
+  layout->definition = def;
+
+  for (tmp = fields; tmp != NULL; tmp = tmp->next)
+    {
+      XGenFieldDefinition *field = tmp->data;
+      if (!field->implicit)
+	wire_fields = g_list_prepend (wire_fields, field);
+    }
+  wire_fields = g_list_reverse (wire_fields);
+
+  layout->n_fields = g_list_length (wire_fields);
+  layout->fields = g_new0 (XGenFieldLayout, layout->n_fields);
+
+  for (tmp = wire_fields, i = 0; tmp != NULL; tmp = tmp->next, i++)
+    {
+      XGenFieldLayout *field_layout = &layout->fields[i];
+
+      init_field_layout (field_layout, tmp->data);
+      field_layout->fills_remainder =
+	field_layout->kind == XGEN_LAYOUT_LIST
+	&& is_implicit_fieldref (fields, field_layout->field->length);
+    }
+  g_list_free (wire_fields);
+
+  i = 0;
+
+  /* The parser synthesises the request header fields as "opcode" then
+   * "length", with "minor_opcode" between them for extension requests,
+   * which is also their order on the wire. A core request instead puts
+   * its first 1 byte field between the two; the parser gives core
+   * requests without fields a 1 byte pad for that. */
+  if (def->type == XGEN_REQUEST && layout->n_fields >= 2)
+    {
+      gboolean core = strcmp (def->extension->header, "xproto") == 0;
+
+      if (core
+	  && layout->n_fields >= 3
+	  && field_fixed_size (&layout->fields[2]) == 1)
+	{
+	  XGenFieldLayout length = layout->fields[1];
+	  layout->fields[1] = layout->fields[2];
+	  layout->fields[2] = length;
+	}
+      else if (core)
+	{
+	  /* Leave a gap for the unused byte */
+	  layout->fields[0].offset = 0;
+	  layout->fields[1].offset = 2;
+	  pos = 4;
+	  i = 2;
+	}
+    }
+
+  for (; i < layout->n_fields; i++)
+    {
+      XGenFieldLayout *field_layout = &layout->fields[i];
+      guint size = field_fixed_size (field_layout);
+
+      if (def->type == XGEN_UNION)
+	{
+	  field_layout->offset = 0;
+	  if (size)
+	    max_size = MAX (max_size, size);
+	  else
+	    fixed = FALSE;
+	  continue;
+	}
+
+      if (!fixed)
+	continue;
+
+      field_layout->offset = pos;
+      if (size)
+	pos += size;
+      else
+	fixed = FALSE;
+    }
+
+  layout->is_fixed = fixed;
+  layout->fixed_size = def->type == XGEN_UNION ? max_size : pos;
+
+  switch (def->type)
+    {
+    case XGEN_EVENT:
+      if (XGEN_EVENT_DEF (def)->is_generic)
+	{
+	  layout->min_size = MAX (32, layout->fixed_size);
+	  break;
+	}
+      /* fall through */
+    case XGEN_ERROR:
+      layout->min_size = 32;
+      break;
+    case XGEN_REPLY:
+      layout->min_size = MAX (32, layout->fixed_size);
+      break;
+    case XGEN_REQUEST:
+      layout->min_size = _XGEN_ALIGN4 (layout->fixed_size);
+      break;
+    default:
+      layout->min_size = layout->fixed_size;
+    }
+
+  compute_host_abi (layout);
+  compute_bounds (layout);
+
+  return layout;
+}
+
+static const XGenLayout *
+get_layout (const XGenDefinition *def)
+{
+  if (!def->_layout)
+    ((XGenDefinition *)def)->_layout = build_layout (def);
+  return def->_layout;
+}
+
+/**
+ * Layouts are built eagerly once parsing has finished so that they can
+ * be shared read-only by any number of threads afterwards.
+ */
+void
+_xgen_compute_layouts (XGenState *state)
+{
+  GList *tmp;
+
+  for (tmp = state->extensions;
+       tmp != state->_shared_extensions;
+       tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+      GList *tmp2;
+
+      for (tmp2 = extension->all_definitions; tmp2 != NULL; tmp2 = tmp2->next)
+	{
+	  XGenDefinition *def = tmp2->data;
+
+	  switch (def->type)
+	    {
+	    case XGEN_STRUCT:
+	    case XGEN_UNION:
+	    case XGEN_REQUEST:
+	    case XGEN_REPLY:
+	    case XGEN_EVENT:
+	    case XGEN_ERROR:
+	      get_layout (def);
+	      break;
+	    default:
+	      break;
+	    }
+	}
+    }
+}
+
+/**
+ * xgen_definition_get_layout:
+ * @def: A request, reply, event, error, struct or union definition
+ *
+ * This function returns the wire layout of the definition or NULL for
+ * definitions that don't have one, such as base types and enums.
+ */
+const XGenLayout *
+xgen_definition_get_layout (const XGenDefinition *def)
+{
+  return def->_layout;
+}
+
+/**
+ * xgen_layout_find_field:
+ * @layout: A layout
+ * @name: A field name
+ *
+ * This function returns the index of the named field within
+ * @layout->fields or -1 if there is no such field.
+ */
+gint
+xgen_layout_find_field (const XGenLayout *layout, const char *name)
+{
+  guint i;
+
+  for (i = 0; i < layout->n_fields; i++)
+    if (strcmp (layout->fields[i].field->name, name) == 0)
+      return i;
+  return -1;
+}
+
+/* Like xgen_layout_find_field() but a valueparam is found by its mask
+ * name, since the mask is the only part of it that's a plain integer */
+gint
+_xgen_layout_find_field_or_mask (const XGenLayout *layout, const char *name)
+{
+  guint i;
+
+  for (i = 0; i < layout->n_fields; i++)
+    {
+      const XGenFieldLayout *field_layout = &layout->fields[i];
+
+      if (field_layout->kind == XGEN_LAYOUT_VALUEPARAM)
+	{
+	  if (strcmp (XGEN_VALUE_PARAM_DEF (field_layout->field->definition)
+		      ->mask_name, name) == 0)
+	    return i;
+	}
+      else if (strcmp (field_layout->field->name, name) == 0)
+	return i;
+    }
+  return -1;
+}
+
+/**
+ * xgen_layout_is_host_compatible:
+ * @layout: A layout
+ * @byte_order: The byte order of the messages
+ *
+ * Checks whether messages with this layout can be accessed in place
+ * through a pointer to the equivalent naturally aligned C struct, i.e.
+ * whether the layout is fixed, its fields are at the offsets the host C
+ * ABI would give them and either @byte_order is the host byte order or
+ * there are no multi-byte values. Code generators can emit zero-copy
+ * views for such definitions and only decode the rest.
+ *
+ * This function returns TRUE if the layout is host compatible.
+ */
+gboolean
+xgen_layout_is_host_compatible (const XGenLayout *layout,
+				XGenByteOrder byte_order)
+{
+  return layout->matches_host_abi
+    && (layout->is_byte_order_neutral
+	|| !_XGEN_NEEDS_SWAP (byte_order));
+}
+
+/**
+ * xgen_layout_get_host_view:
+ * @layout: A layout
+ * @data: The start of a raw message
+ * @len: The number of bytes available at @data
+ * @byte_order: The byte order of the message
+ *
+ * Gives zero-copy access to a message whose layout is host compatible
+ * (see xgen_layout_is_host_compatible()), so the result can be cast to
+ * a pointer to the equivalent C struct.
+ *
+ * This function returns @data, or NULL if the layout isn't host
+ * compatible, the message is too short or @data isn't suitably aligned,
+ * in which case the message has to be decoded instead.
+ */
+const void *
+xgen_layout_get_host_view (const XGenLayout *layout,
+			   const guint8 *data,
+			   gsize len,
+			   XGenByteOrder byte_order)
+{
+  if (!xgen_layout_is_host_compatible (layout, byte_order)
+      || len < layout->fixed_size
+      || (gsize)data % layout->alignment)
+    return NULL;
+  return data;
+}
+
+static gboolean get_extents (const XGenLayout *layout,
+			     const guint8 *data,
+			     gsize len,
+			     gboolean swap,
+			     guint n_fields,
+			     XGenFieldExtent *extents);
+
+/* The size of a message is the end of its furthest field; for unions
+ * that isn't necessarily the last field */
+static gsize
+extents_size (const XGenFieldExtent *extents, guint n_extents)
+{
+  gsize size = 0;
+  guint i;
+
+  for (i = 0; i < n_extents; i++)
+    size = MAX (size, extents[i].offset + extents[i].size);
+  return size;
+}
+
+static guint
+request_shift (const XGenLayout *layout,
+	       const guint8 *data,
+	       gsize len,
+	       gboolean swap)
+{
+  /* With BIG-REQUESTS a zero length is followed by a 32bit length which
+   * shifts the rest of the request along by 4 bytes. */
+  if (layout->definition->type == XGEN_REQUEST
+      && len >= 4
+      && _xgen_read_unsigned (data + 2, 2, swap) == 0)
+    return 4;
+  return 0;
+}
+
+static gsize
+message_length (const XGenLayout *layout,
+		const guint8 *data,
+		gsize len,
+		gboolean swap)
+{
+  gsize length;
+
+  switch (layout->definition->type)
+    {
+    case XGEN_REQUEST:
+      if (len < 4)
+	return 0;
+      length = _xgen_read_unsigned (data + 2, 2, swap);
+      if (length)
+	return length * 4;
+      if (len < 8)
+	return 0;
+      return (gsize)_xgen_read_unsigned (data + 4, 4, swap) * 4;
+    case XGEN_EVENT:
+      if (!XGEN_EVENT_DEF (layout->definition)->is_generic)
+	return 32;
+      /* fall through */
+    case XGEN_REPLY:
+      if (len < 8)
+	return 0;
+      return 32 + (gsize)_xgen_read_unsigned (data + 4, 4, swap) * 4;
+    case XGEN_ERROR:
+      return 32;
+    default:
+      {
+	XGenFieldExtent *extents = g_newa (XGenFieldExtent, layout->n_fields);
+
+	if (layout->is_fixed)
+	  return layout->fixed_size;
+	if (!get_extents (layout, data, len, swap, layout->n_fields, extents))
+	  return 0;
+	return extents_size (extents, layout->n_fields);
+      }
+    }
+}
+
+/**
+ * xgen_layout_get_message_length:
+ * @layout: The layout of a request, reply, event or error
+ * @data: The start of a raw message
+ * @len: The number of bytes available at @data
+ * @byte_order: The byte order of the message
+ *
+ * Determines the full length of a message from its header; for requests,
+ * replies and generic events the length field, and for other events and
+ * errors the fixed 32 bytes.
+ *
+ * This function returns 0 if @len doesn't cover enough of the header to
+ * tell.
+ */
+gsize
+xgen_layout_get_message_length (const XGenLayout *layout,
+				const guint8 *data,
+				gsize len,
+				XGenByteOrder byte_order)
+{
+  return message_length (layout, data, len, _XGEN_NEEDS_SWAP (byte_order));
+}
+
+/* Evaluates a length expression using the fields before the first
+ * @n_known. Their @extents are all known unless a @cursor is given, in
+ * which case only the fields referenced are resolved. */
+static gboolean
+evaluate (const XGenExpression *expression,
+	  const XGenLayout *layout,
+	  const XGenFieldExtent *extents,
+	  guint n_known,
+	  XGenFieldCursor *cursor,
+	  const guint8 *data,
+	  gboolean swap,
+	  long *value)
+{
+  long left, right;
+  gint i;
+
+  switch (expression->type)
+    {
+    case XGEN_VALUE:
+      *value = expression->value;
+      return TRUE;
+
+    case XGEN_FIELDREF:
+      for (i = n_known - 1; i >= 0; i--)
+	{
+	  const XGenFieldLayout *field_layout = &layout->fields[i];
+
+	  if (field_layout->kind != XGEN_LAYOUT_SCALAR
+	      || strcmp (field_layout->field->name, expression->field) != 0)
+	    continue;
+	  if (cursor && !cursor_resolve (cursor, i))
+	    return FALSE;
+
+	  if (field_layout->type->type == XGEN_SIGNED)
+	    *value = _xgen_read_signed (data + extents[i].offset,
+					field_layout->size, swap);
+	  else
+	    *value = _xgen_read_unsigned (data + extents[i].offset,
+					  field_layout->size, swap);
+	  return TRUE;
+	}
+      return FALSE;
+
+    case XGEN_OP:
+      if (!evaluate (expression->left, layout, extents, n_known, cursor,
+		     data, swap, &left)
+	  || !evaluate (expression->right, layout, extents, n_known, cursor,
+			data, swap, &right))
+	return FALSE;
+      switch (expression->op)
+	{
+	case XGEN_ADD:
+	  *value = left + right;
+	  return TRUE;
+	case XGEN_SUBTRACT:
+	  *value = left - right;
+	  return TRUE;
+	case XGEN_MULTIPLY:
+	  *value = left * right;
+	  return TRUE;
+	case XGEN_DIVIDE:
+	  if (right == 0)
+	    return FALSE;
+	  *value = left / right;
+	  return TRUE;
+	case XGEN_LEFT_SHIFT:
+	  *value = left << right;
+	  return TRUE;
+	case XGEN_BITWISE_AND:
+	  *value = left & right;
+	  return TRUE;
+	}
+    }
+
+  return FALSE;
+}
+
+static gboolean
+measure (const XGenDefinition *type,
+	 const guint8 *data,
+	 gsize len,
+	 gboolean swap,
+	 gsize *size)
+{
+  const XGenLayout *layout = type->_layout;
+  XGenFieldExtent *extents;
+
+  if (!layout)
+    return FALSE;
+
+  if (layout->is_fixed)
+    {
+      *size = layout->fixed_size;
+      return *size <= len;
+    }
+
+  extents = g_newa (XGenFieldExtent, layout->n_fields);
+  if (!get_extents (layout, data, len, swap, layout->n_fields, extents))
+    return FALSE;
+
+  *size = extents_size (extents, layout->n_fields);
+  return TRUE;
+}
+
+/* Finds the size and count of field @i given its offset @pos, filling in
+ * @extents[i] */
+static gboolean
+get_field_extent (const XGenLayout *layout,
+		  guint i,
+		  gsize pos,
+		  const guint8 *data,
+		  gsize len,
+		  gsize message_len,
+		  gboolean swap,
+		  XGenFieldExtent *extents,
+		  XGenFieldCursor *cursor)
+{
+  const XGenFieldLayout *field_layout = &layout->fields[i];
+  XGenFieldExtent *extent = &extents[i];
+  gsize size = 0;
+  long count = 1;
+
+  switch (field_layout->kind)
+    {
+    case XGEN_LAYOUT_SCALAR:
+      size = field_layout->size;
+      break;
+    case XGEN_LAYOUT_STRUCT:
+      size = field_layout->size;
+      if (!size && (pos > len
+		    || !measure (field_layout->type, data + pos, len - pos,
+				 swap, &size)))
+	return FALSE;
+      break;
+    case XGEN_LAYOUT_LIST:
+      if (field_layout->fills_remainder)
+	{
+	  if (!field_layout->size || pos > message_len)
+	    return FALSE;
+	  count = (message_len - pos) / field_layout->size;
+	}
+      else if (!evaluate (field_layout->field->length, layout, extents, i,
+			  cursor, data, swap, &count)
+	       || count < 0
+	       || count > len)
+	return FALSE;
+
+      if (field_layout->size)
+	size = (gsize)count * field_layout->size;
+      else
+	{
+	  long j;
+	  for (j = 0; j < count; j++)
+	    {
+	      gsize element_size;
+	      if (pos + size > len
+		  || !measure (field_layout->type, data + pos + size,
+			       len - pos - size, swap, &element_size))
+		return FALSE;
+	      size += element_size;
+	    }
+	}
+      break;
+    case XGEN_LAYOUT_VALUEPARAM:
+      if (pos + field_layout->size > len)
+	return FALSE;
+      count = _xgen_bit_count (_xgen_read_unsigned (data + pos,
+						    field_layout->size,
+						    swap));
+      size = _XGEN_ALIGN4 (field_layout->size) + count * 4;
+      break;
+    }
+
+  if (pos + size > len)
+    return FALSE;
+
+  extent->offset = pos;
+  extent->size = size;
+  extent->count = count;
+  return TRUE;
+}
+
+/* Checks the length of requests and replies, returning the length of
+ * the message and how far BIG-REQUESTS shifts the fields after the
+ * header */
+static gboolean
+check_message (const XGenLayout *layout,
+	       const guint8 *data,
+	       gsize len,
+	       gboolean swap,
+	       gsize *message_len,
+	       guint *shift)
+{
+  XGenType def_type = layout->definition->type;
+
+  *message_len = len;
+  *shift = 0;
+
+  if (def_type == XGEN_REQUEST || def_type == XGEN_REPLY)
+    {
+      *message_len = message_length (layout, data, len, swap);
+      if (!*message_len || *message_len > len)
+	return FALSE;
+      *shift = request_shift (layout, data, len, swap);
+    }
+
+  return TRUE;
+}
+
+static gsize
+fixed_offset (const XGenFieldLayout *field_layout, guint shift)
+{
+  gsize pos = field_layout->offset;
+
+  return pos >= 4 ? pos + shift : pos;
+}
+
+static gboolean
+get_extents (const XGenLayout *layout,
+	     const guint8 *data,
+	     gsize len,
+	     gboolean swap,
+	     guint n_fields,
+	     XGenFieldExtent *extents)
+{
+  gsize message_len;
+  guint shift;
+  gsize pos = 0;
+  guint i;
+
+  if (!check_message (layout, data, len, swap, &message_len, &shift))
+    return FALSE;
+
+  n_fields = MIN (n_fields, layout->n_fields);
+
+  for (i = 0; i < n_fields; i++)
+    {
+      const XGenFieldLayout *field_layout = &layout->fields[i];
+
+      if (field_layout->offset != XGEN_LAYOUT_VARIABLE_OFFSET)
+	pos = fixed_offset (field_layout, shift);
+
+      if (!get_field_extent (layout, i, pos, data, len, message_len, swap,
+			     extents, NULL))
+	return FALSE;
+
+      if (layout->definition->type != XGEN_UNION)
+	pos += extents[i].size;
+    }
+
+  return TRUE;
+}
+
+/**
+ * xgen_layout_get_extents:
+ * @layout: A layout
+ * @data: The start of a raw message
+ * @len: The number of bytes available at @data
+ * @byte_order: The byte order of the message
+ * @n_fields: The number of leading fields to find extents for
+ * @extents: An array of at least @n_fields extents to fill in
+ *
+ * Finds the offset and size of the first @n_fields fields of a message,
+ * evaluating list length expressions as needed.
+ *
+ * This function returns FALSE if the message is truncated or malformed.
+ */
+gboolean
+xgen_layout_get_extents (const XGenLayout *layout,
+			 const guint8 *data,
+			 gsize len,
+			 XGenByteOrder byte_order,
+			 guint n_fields,
+			 XGenFieldExtent *extents)
+{
+  return get_extents (layout, data, len, _XGEN_NEEDS_SWAP (byte_order),
+		      n_fields, extents);
+}
+
+static void
+decode_value (const XGenFieldLayout *field_layout,
+	      const XGenFieldExtent *extent,
+	      const guint8 *data,
+	      gboolean swap,
+	      XGenFieldValue *value)
+{
+  const guint8 *field_data = data + extent->offset;
+
+  value->field = (XGenFieldDefinition *)field_layout->field;
+  value->offset = extent->offset;
+
+  if (field_layout->kind != XGEN_LAYOUT_SCALAR)
+    value->unsigned_value =
+      field_layout->kind == XGEN_LAYOUT_STRUCT ? extent->size : extent->count;
+  else
+    switch (field_layout->type->type)
+      {
+      case XGEN_BOOLEAN:
+	value->bool_value = field_data[0];
+	break;
+      case XGEN_CHAR:
+	value->char_value = field_data[0];
+	break;
+      case XGEN_SIGNED:
+	value->signed_value =
+	  _xgen_read_signed (field_data, field_layout->size, swap);
+	break;
+      case XGEN_DOUBLE:
+	{
+	  guint64 bits;
+	  memcpy (&bits, field_data, 8);
+	  value->unsigned_value = swap ? GUINT64_SWAP_LE_BE (bits) : bits;
+	  break;
+	}
+      default:
+	/* NB: floats are returned as their raw bits */
+	value->unsigned_value =
+	  _xgen_read_unsigned (field_data, field_layout->size, swap);
+	break;
+      }
+}
+
+/**
+ * xgen_layout_decode:
+ * @layout: A layout
+ * @data: The start of a raw message
+ * @len: The number of bytes available at @data
+ * @byte_order: The byte order of the message
+ *
+ * Decodes a message into a list of XGenFieldValues, one per field in
+ * wire order. Scalar values are decoded while for lists and valueparams
+ * the unsigned_value is the number of elements and for inline structs
+ * it's the size in bytes; the offset can be used to find the data.
+ *
+ * This function returns NULL if the message is truncated or malformed.
+ * The list should be freed with xgen_field_values_free().
+ */
+GList *
+xgen_layout_decode (const XGenLayout *layout,
+		    const guint8 *data,
+		    gsize len,
+		    XGenByteOrder byte_order)
+{
+  gboolean swap = _XGEN_NEEDS_SWAP (byte_order);
+  XGenFieldExtent *extents = g_newa (XGenFieldExtent, layout->n_fields);
+  GList *values = NULL;
+  guint i;
+
+  if (!xgen_layout_get_extents (layout, data, len, byte_order,
+				layout->n_fields, extents))
+    return NULL;
+
+  for (i = 0; i < layout->n_fields; i++)
+    {
+      XGenFieldValue *value = g_new0 (XGenFieldValue, 1);
+
+      decode_value (&layout->fields[i], &extents[i], data, swap, value);
+      values = g_list_prepend (values, value);
+    }
+
+  return g_list_reverse (values);
+}
+
+/**
+ * xgen_field_cursor_new:
+ * @layout: The layout of the messages to read
+ *
+ * Creates a cursor for reading individual fields of messages with
+ * @layout, without decoding the fields before them. Finding a field at a
+ * fixed offset is a single read and for any other field only the fields
+ * back to the last one at a fixed offset, and those its length depends
+ * on, are measured. The extents found are kept until the cursor is reset
+ * for the next message.
+ *
+ * Fields are given by their index in @layout->fields; look names up once
+ * with xgen_layout_find_field() rather than for every message.
+ */
+XGenFieldCursor *
+xgen_field_cursor_new (const XGenLayout *layout)
+{
+  XGenFieldCursor *cursor = g_new0 (XGenFieldCursor, 1);
+
+  cursor->layout = layout;
+  cursor->extents = g_new (XGenFieldExtent, layout->n_fields);
+  cursor->status = g_new0 (guint8, layout->n_fields);
+
+  return cursor;
+}
+
+/**
+ * xgen_field_cursor_reset:
+ * @cursor: A field cursor
+ * @data: The start of a raw message
+ * @len: The number of bytes available at @data
+ * @byte_order: The byte order of the message
+ *
+ * Points the cursor at a new message, forgetting the extents found in
+ * the previous one. @data must stay valid while the cursor is used.
+ *
+ * This function returns FALSE if the length of a request or reply
+ * doesn't fit in @len, in which case no fields can be read.
+ */
+gboolean
+xgen_field_cursor_reset (XGenFieldCursor *cursor,
+			 const guint8 *data,
+			 gsize len,
+			 XGenByteOrder byte_order)
+{
+  cursor->data = data;
+  cursor->len = len;
+  cursor->byte_order = byte_order;
+  cursor->swap = _XGEN_NEEDS_SWAP (byte_order);
+  memset (cursor->status, _XGEN_CURSOR_UNKNOWN, cursor->layout->n_fields);
+
+  cursor->is_valid = check_message (cursor->layout, data, len, cursor->swap,
+				    &cursor->message_len, &cursor->shift);
+  return cursor->is_valid;
+}
+
+static gboolean
+cursor_resolve (XGenFieldCursor *cursor, guint field)
+{
+  const XGenLayout *layout = cursor->layout;
+  const XGenFieldLayout *field_layout = &layout->fields[field];
+  gsize pos;
+
+  switch (cursor->status[field])
+    {
+    case _XGEN_CURSOR_KNOWN:
+      return TRUE;
+    case _XGEN_CURSOR_INVALID:
+      return FALSE;
+    }
+
+  if (!cursor->is_valid)
+    return FALSE;
+
+  /* Until it's measured, so that a failure is remembered */
+  cursor->status[field] = _XGEN_CURSOR_INVALID;
+
+  if (field_layout->offset != XGEN_LAYOUT_VARIABLE_OFFSET)
+    pos = fixed_offset (field_layout, cursor->shift);
+  else
+    {
+      /* Only ever follows a variable length field */
+      if (!cursor_resolve (cursor, field - 1))
+	return FALSE;
+      pos = cursor->extents[field - 1].offset
+	+ cursor->extents[field - 1].size;
+    }
+
+  if (!get_field_extent (layout, field, pos, cursor->data, cursor->len,
+			 cursor->message_len, cursor->swap, cursor->extents,
+			 cursor))
+    return FALSE;
+
+  cursor->status[field] = _XGEN_CURSOR_KNOWN;
+  return TRUE;
+}
+
+/**
+ * xgen_field_cursor_get_extent:
+ * @cursor: A field cursor
+ * @field: The index of a field in the cursor's layout
+ * @extent: Return location for the extent of the field
+ *
+ * This function returns FALSE if the message is truncated or malformed
+ * before the end of the field.
+ */
+gboolean
+xgen_field_cursor_get_extent (XGenFieldCursor *cursor,
+			      guint field,
+			      XGenFieldExtent *extent)
+{
+  g_return_val_if_fail (field < cursor->layout->n_fields, FALSE);
+
+  if (!cursor_resolve (cursor, field))
+    return FALSE;
+
+  *extent = cursor->extents[field];
+  return TRUE;
+}
+
+/**
+ * xgen_field_cursor_get_value:
+ * @cursor: A field cursor
+ * @field: The index of a field in the cursor's layout
+ * @value: Return location for the value
+ *
+ * Decodes a single field like xgen_layout_decode(). Use
+ * xgen_field_cursor_get_list() for a view of a list of integers.
+ *
+ * This function returns FALSE if the message is truncated or malformed
+ * before the end of the field.
+ */
+gboolean
+xgen_field_cursor_get_value (XGenFieldCursor *cursor,
+			     guint field,
+			     XGenFieldValue *value)
+{
+  g_return_val_if_fail (field < cursor->layout->n_fields, FALSE);
+
+  if (!cursor_resolve (cursor, field))
+    return FALSE;
+
+  decode_value (&cursor->layout->fields[field], &cursor->extents[field],
+		cursor->data, cursor->swap, value);
+  return TRUE;
+}
+
+void
+xgen_field_cursor_free (XGenFieldCursor *cursor)
+{
+  g_free (cursor->extents);
+  g_free (cursor->status);
+  g_free (cursor);
+}
+
+void
+xgen_field_values_free (GList *field_values)
+{
+  GList *tmp;
+
+  for (tmp = field_values; tmp != NULL; tmp = tmp->next)
+    g_free (tmp->data);
+  g_list_free (field_values);
+}
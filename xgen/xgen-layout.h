@@ -0,0 +1,132 @@
+#ifndef _XGEN_LAYOUT_H_
+#define _XGEN_LAYOUT_H_
+
+#include <xgen.h>
+
+#include <glib.h>
+
+typedef enum _XGenLayoutKind
+{
+  XGEN_LAYOUT_SCALAR,
+  XGEN_LAYOUT_STRUCT,	  /* An inline struct or union */
+  XGEN_LAYOUT_LIST,
+  XGEN_LAYOUT_VALUEPARAM  /* A value mask followed by a CARD32 per set bit */
+} XGenLayoutKind;
+
+#define XGEN_LAYOUT_VARIABLE_OFFSET (-1)
+
+/**
+ * Describes where a field lives in the wire format of a definition
+ */
+typedef struct _XGenFieldLayout
+{
+  const XGenFieldDefinition *field;
+  const XGenDefinition	    *type;   /* The field type with any typedefs
+					resolved */
+  XGenLayoutKind	     kind;
+  guint			     size;   /* The scalar or struct size, the list
+					element size or the valueparam mask
+					size. 0 if variable. */
+  gint			     offset; /* The offset from the start of the
+					message or XGEN_LAYOUT_VARIABLE_OFFSET
+					if it follows a variable length
+					field */
+  gboolean		     fills_remainder; /* A list whose length is
+						 implied by the message
+						 length */
+} XGenFieldLayout;
+
+/**
+ * Describes the wire format of a request, reply, event, error, struct or
+ * union. Layouts are computed once after parsing and are immutable.
+ */
+struct _XGenLayout
+{
+  const XGenDefinition *definition;
+  guint		        n_fields;
+  XGenFieldLayout      *fields;	     /* In wire order, excluding implicit
+					fields */
+  guint		        fixed_size;  /* The size of the fixed length
+					prefix of the message */
+  gboolean	        is_fixed;    /* TRUE if there are no variable length
+					fields */
+  guint		        min_size;    /* The smallest valid message, e.g. 32
+					bytes for an event */
+
+  /* How the wire layout compares to the equivalent C struct on this
+   * host; see xgen_layout_is_host_compatible() */
+  guint		        alignment;   /* The C alignment of the struct */
+  gboolean	        matches_host_abi; /* TRUE if the layout is fixed and
+					     every field is at the offset
+					     the C ABI would give it, with
+					     no trailing padding */
+  gboolean	        is_byte_order_neutral; /* TRUE if there are no multi
+						  byte values */
+
+  gboolean	        is_bounded;  /* TRUE if the lengths of all the
+					variable length fields are limited
+					by the widths of the fields giving
+					them */
+  guint		        max_size;    /* The largest valid message if
+					is_bounded, else 0 */
+};
+
+/**
+ * The position of a field within one particular message
+ */
+typedef struct _XGenFieldExtent
+{
+  guint32 offset;
+  guint32 size;	  /* in bytes */
+  guint32 count;  /* Number of list elements or valueparam values, or 1 */
+} XGenFieldExtent;
+
+const XGenLayout *xgen_definition_get_layout (const XGenDefinition *def);
+gint xgen_layout_find_field (const XGenLayout *layout, const char *name);
+gboolean xgen_expression_get_bounds (const XGenExpression *expression,
+				     const XGenDefinition *def,
+				     guint64 *min,
+				     guint64 *max);
+gboolean xgen_layout_is_host_compatible (const XGenLayout *layout,
+					 XGenByteOrder byte_order);
+const void *xgen_layout_get_host_view (const XGenLayout *layout,
+				       const guint8 *data,
+				       gsize len,
+				       XGenByteOrder byte_order);
+gsize xgen_layout_get_message_length (const XGenLayout *layout,
+				      const guint8 *data,
+				      gsize len,
+				      XGenByteOrder byte_order);
+gboolean xgen_layout_get_extents (const XGenLayout *layout,
+				  const guint8 *data,
+				  gsize len,
+				  XGenByteOrder byte_order,
+				  guint n_fields,
+				  XGenFieldExtent *extents);
+GList *xgen_layout_decode (const XGenLayout *layout,
+			   const guint8 *data,
+			   gsize len,
+			   XGenByteOrder byte_order);
+void xgen_field_values_free (GList *field_values);
+
+/**
+ * Reads single fields of a message, only measuring the fields their
+ * offsets and lengths depend on and remembering them for later reads
+ * of the same message.
+ */
+typedef struct _XGenFieldCursor XGenFieldCursor;
+
+XGenFieldCursor *xgen_field_cursor_new (const XGenLayout *layout);
+gboolean xgen_field_cursor_reset (XGenFieldCursor *cursor,
+				  const guint8 *data,
+				  gsize len,
+				  XGenByteOrder byte_order);
+gboolean xgen_field_cursor_get_extent (XGenFieldCursor *cursor,
+				       guint field,
+				       XGenFieldExtent *extent);
+gboolean xgen_field_cursor_get_value (XGenFieldCursor *cursor,
+				      guint field,
+				      XGenFieldValue *value);
+void xgen_field_cursor_free (XGenFieldCursor *cursor);
+
+#endif /* _XGEN_LAYOUT_H_ */
@@ -0,0 +1,479 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-list.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+/* As with the batch decoder the vector kernels are chosen at build time;
+ * SSE2 is always available on x86-64 */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define USE_AVX2 1
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2 1
+#endif
+
+static inline void
+store_element (void *dest, guint size, guint32 i, guint32 value)
+{
+  switch (size)
+    {
+    case 1:
+      ((guint8 *)dest)[i] = value;
+      break;
+    case 2:
+      ((guint16 *)dest)[i] = value;
+      break;
+    case 4:
+      ((guint32 *)dest)[i] = value;
+      break;
+    }
+}
+
+#ifdef USE_SSE2
+static inline __m128i
+swap16_sse2 (__m128i v)
+{
+  return _mm_or_si128 (_mm_slli_epi16 (v, 8), _mm_srli_epi16 (v, 8));
+}
+
+static inline __m128i
+swap32_sse2 (__m128i v)
+{
+  v = swap16_sse2 (v);
+  v = _mm_shufflelo_epi16 (v, _MM_SHUFFLE (2, 3, 0, 1));
+  return _mm_shufflehi_epi16 (v, _MM_SHUFFLE (2, 3, 0, 1));
+}
+
+/* Loads 8 16bit or 4 32bit elements, in host order */
+static inline __m128i
+load_sse2 (const guint8 *src, guint size, gboolean swap)
+{
+  __m128i v = _mm_loadu_si128 ((const __m128i *)src);
+
+  if (!swap)
+    return v;
+  return size == 2 ? swap16_sse2 (v) : swap32_sse2 (v);
+}
+
+/* Truncates the 32bit elements of two vectors to 16 bits. packs
+ * saturates, so the low halves are sign extended first to make it
+ * exact */
+static inline __m128i
+narrow32_sse2 (__m128i a, __m128i b)
+{
+  a = _mm_srai_epi32 (_mm_slli_epi32 (a, 16), 16);
+  b = _mm_srai_epi32 (_mm_slli_epi32 (b, 16), 16);
+  return _mm_packs_epi32 (a, b);
+}
+
+/* Truncates the 16bit elements of two vectors to 8 bits */
+static inline __m128i
+narrow16_sse2 (__m128i a, __m128i b)
+{
+  const __m128i mask = _mm_set1_epi16 (0xff);
+  return _mm_packus_epi16 (_mm_and_si128 (a, mask), _mm_and_si128 (b, mask));
+}
+
+/* Converts as many whole vectors as there are and returns the number of
+ * elements done */
+static guint32
+convert_sse2 (const guint8 *src,
+	      guint src_size,
+	      gboolean swap,
+	      guint32 count,
+	      guint8 *dest,
+	      guint dest_size)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  guint32 i = 0;
+
+  switch (src_size << 4 | dest_size)
+    {
+    case 0x22:
+    case 0x44:
+      {
+	guint32 step = 16 / src_size;
+	for (; i + step <= count; i += step)
+	  _mm_storeu_si128 ((__m128i *)(dest + i * dest_size),
+			    load_sse2 (src + i * src_size, src_size, swap));
+	break;
+      }
+    case 0x12:
+      for (; i + 16 <= count; i += 16)
+	{
+	  __m128i v = _mm_loadu_si128 ((const __m128i *)(src + i));
+	  _mm_storeu_si128 ((__m128i *)(dest + i * 2),
+			    _mm_unpacklo_epi8 (v, zero));
+	  _mm_storeu_si128 ((__m128i *)(dest + i * 2 + 16),
+			    _mm_unpackhi_epi8 (v, zero));
+	}
+      break;
+    case 0x14:
+      for (; i + 16 <= count; i += 16)
+	{
+	  __m128i v = _mm_loadu_si128 ((const __m128i *)(src + i));
+	  __m128i lo = _mm_unpacklo_epi8 (v, zero);
+	  __m128i hi = _mm_unpackhi_epi8 (v, zero);
+	  guint8 *out = dest + i * 4;
+
+	  _mm_storeu_si128 ((__m128i *)out, _mm_unpacklo_epi16 (lo, zero));
+	  _mm_storeu_si128 ((__m128i *)(out + 16),
+			    _mm_unpackhi_epi16 (lo, zero));
+	  _mm_storeu_si128 ((__m128i *)(out + 32),
+			    _mm_unpacklo_epi16 (hi, zero));
+	  _mm_storeu_si128 ((__m128i *)(out + 48),
+			    _mm_unpackhi_epi16 (hi, zero));
+	}
+      break;
+    case 0x24:
+      for (; i + 8 <= count; i += 8)
+	{
+	  __m128i v = load_sse2 (src + i * 2, 2, swap);
+	  _mm_storeu_si128 ((__m128i *)(dest + i * 4),
+			    _mm_unpacklo_epi16 (v, zero));
+	  _mm_storeu_si128 ((__m128i *)(dest + i * 4 + 16),
+			    _mm_unpackhi_epi16 (v, zero));
+	}
+      break;
+    case 0x21:
+      for (; i + 16 <= count; i += 16)
+	{
+	  __m128i a = load_sse2 (src + i * 2, 2, swap);
+	  __m128i b = load_sse2 (src + i * 2 + 16, 2, swap);
+	  _mm_storeu_si128 ((__m128i *)(dest + i), narrow16_sse2 (a, b));
+	}
+      break;
+    case 0x42:
+      for (; i + 8 <= count; i += 8)
+	{
+	  __m128i a = load_sse2 (src + i * 4, 4, swap);
+	  __m128i b = load_sse2 (src + i * 4 + 16, 4, swap);
+	  _mm_storeu_si128 ((__m128i *)(dest + i * 2), narrow32_sse2 (a, b));
+	}
+      break;
+    case 0x41:
+      for (; i + 16 <= count; i += 16)
+	{
+	  const guint8 *in = src + i * 4;
+	  __m128i a = narrow32_sse2 (load_sse2 (in, 4, swap),
+				     load_sse2 (in + 16, 4, swap));
+	  __m128i b = narrow32_sse2 (load_sse2 (in + 32, 4, swap),
+				     load_sse2 (in + 48, 4, swap));
+	  _mm_storeu_si128 ((__m128i *)(dest + i), narrow16_sse2 (a, b));
+	}
+      break;
+    }
+
+  return i;
+}
+#endif
+
+#ifdef USE_AVX2
+/* The byte swaps and the widening conversions are twice as wide with
+ * AVX2; narrowing is left to SSE2 since the 256bit packs work within
+ * 128bit lanes */
+static guint32
+convert_avx2 (const guint8 *src,
+	      guint src_size,
+	      gboolean swap,
+	      guint32 count,
+	      guint8 *dest,
+	      guint dest_size)
+{
+  const __m256i swap16 =
+    _mm256_setr_epi8 (1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+		      1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  const __m256i swap32 =
+    _mm256_setr_epi8 (3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		      3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  guint32 i = 0;
+
+  switch (src_size << 4 | dest_size)
+    {
+    case 0x22:
+    case 0x44:
+      {
+	guint32 step = 32 / src_size;
+	__m256i shuffle = src_size == 2 ? swap16 : swap32;
+
+	for (; i + step <= count; i += step)
+	  {
+	    __m256i v =
+	      _mm256_loadu_si256 ((const __m256i *)(src + i * src_size));
+	    if (swap)
+	      v = _mm256_shuffle_epi8 (v, shuffle);
+	    _mm256_storeu_si256 ((__m256i *)(dest + i * dest_size), v);
+	  }
+	break;
+      }
+    case 0x12:
+      for (; i + 16 <= count; i += 16)
+	{
+	  __m128i v = _mm_loadu_si128 ((const __m128i *)(src + i));
+	  _mm256_storeu_si256 ((__m256i *)(dest + i * 2),
+			       _mm256_cvtepu8_epi16 (v));
+	}
+      break;
+    case 0x14:
+      for (; i + 8 <= count; i += 8)
+	{
+	  __m128i v = _mm_loadl_epi64 ((const __m128i *)(src + i));
+	  _mm256_storeu_si256 ((__m256i *)(dest + i * 4),
+			       _mm256_cvtepu8_epi32 (v));
+	}
+      break;
+    case 0x24:
+      for (; i + 8 <= count; i += 8)
+	{
+	  __m128i v = _mm_loadu_si128 ((const __m128i *)(src + i * 2));
+	  if (swap)
+	    v = _mm_shuffle_epi8 (v, _mm256_castsi256_si128 (swap16));
+	  _mm256_storeu_si256 ((__m256i *)(dest + i * 4),
+			       _mm256_cvtepu16_epi32 (v));
+	}
+      break;
+    }
+
+  return i;
+}
+#endif
+
+/**
+ * _xgen_convert_elements:
+ * @src: The source elements
+ * @src_size: The size of the source elements; 1, 2 or 4
+ * @swap: Whether the multi-byte source elements need swapping
+ * @count: The number of elements
+ * @dest: Where to store the converted elements
+ * @dest_size: The size of the destination elements; 1, 2 or 4
+ *
+ * Swaps, zero extends or truncates a run of unsigned integers. @dest may
+ * be the same as @src if the sizes are equal.
+ */
+void
+_xgen_convert_elements (const guint8 *src,
+			guint src_size,
+			gboolean swap,
+			guint32 count,
+			void *dest,
+			guint dest_size)
+{
+  guint32 i = 0;
+
+  if (src_size == 1)
+    swap = FALSE;
+
+  if (src_size == dest_size && !swap)
+    {
+      /* Copies of large payloads such as images are best left to memcpy,
+       * which already uses the widest moves the host has */
+      if (src != dest)
+	memcpy (dest, src, (gsize)count * src_size);
+      return;
+    }
+
+#ifdef USE_AVX2
+  i = convert_avx2 (src, src_size, swap, count, dest, dest_size);
+#endif
+#ifdef USE_SSE2
+  i += convert_sse2 (src + i * src_size, src_size, swap, count - i,
+		     (guint8 *)dest + i * dest_size, dest_size);
+#endif
+
+  for (; i < count; i++)
+    store_element (dest, dest_size, i,
+		   _xgen_read_unsigned (src + i * src_size, src_size, swap));
+}
+
+/* Finds the element size of a list of integers, or returns 0 */
+static guint
+get_element_size (const XGenLayout *layout,
+		  const guint8 *data,
+		  gsize len,
+		  guint field)
+{
+  const XGenFieldLayout *field_layout = &layout->fields[field];
+  guint size = field_layout->size;
+
+  if (field_layout->kind != XGEN_LAYOUT_LIST
+      || field_layout->type->type == XGEN_STRUCT
+      || field_layout->type->type == XGEN_UNION
+      || (size != 1 && size != 2 && size != 4))
+    {
+      g_warning ("%s of %s isn't a list of integers",
+		 field_layout->field->name, layout->definition->name);
+      return 0;
+    }
+
+  if (field_layout->type->type == XGEN_VOID)
+    {
+      gint format = xgen_layout_find_field (layout, "format");
+
+      if (format >= 0
+	  && layout->fields[format].offset != XGEN_LAYOUT_VARIABLE_OFFSET
+	  && layout->fields[format].size == 1
+	  && layout->fields[format].offset < len)
+	{
+	  switch (data[layout->fields[format].offset])
+	    {
+	    case 16:
+	      size = 2;
+	      break;
+	    case 32:
+	      size = 4;
+	      break;
+	    }
+	}
+    }
+
+  return size;
+}
+
+static void
+init_list (XGenList *list,
+	   const guint8 *data,
+	   const XGenFieldExtent *extent,
+	   guint element_size,
+	   XGenByteOrder byte_order)
+{
+  list->data = data + extent->offset;
+  list->count = extent->size / element_size;
+  list->element_size = element_size;
+  list->byte_order = byte_order;
+}
+
+/**
+ * xgen_layout_get_list:
+ * @layout: A layout
+ * @data: The start of a raw message
+ * @len: The number of bytes available at @data
+ * @byte_order: The byte order of the message
+ * @field: The index of a list field in @layout->fields
+ * @list: Return location for the list
+ *
+ * Finds a list of integers within a message. Lists of void, such as
+ * property data, are taken to have elements of the width given by a
+ * "format" field of the message (8, 16 or 32 bits), else bytes.
+ *
+ * This function returns FALSE if the message is truncated or the field
+ * isn't a list of integers.
+ */
+gboolean
+xgen_layout_get_list (const XGenLayout *layout,
+		      const guint8 *data,
+		      gsize len,
+		      XGenByteOrder byte_order,
+		      guint field,
+		      XGenList *list)
+{
+  XGenFieldExtent *extents;
+  guint size = get_element_size (layout, data, len, field);
+
+  if (!size)
+    return FALSE;
+
+  extents = g_newa (XGenFieldExtent, field + 1);
+  if (!xgen_layout_get_extents (layout, data, len, byte_order,
+				field + 1, extents))
+    return FALSE;
+
+  init_list (list, data, &extents[field], size, byte_order);
+  return TRUE;
+}
+
+/**
+ * xgen_field_cursor_get_list:
+ * @cursor: A field cursor
+ * @field: The index of a list field in the cursor's layout
+ * @list: Return location for the list
+ *
+ * Finds a list of integers like xgen_layout_get_list(), within the
+ * message the cursor was last reset to.
+ *
+ * This function returns FALSE if the message is truncated or the field
+ * isn't a list of integers.
+ */
+gboolean
+xgen_field_cursor_get_list (XGenFieldCursor *cursor,
+			    guint field,
+			    XGenList *list)
+{
+  XGenFieldExtent extent;
+  guint size;
+
+  g_return_val_if_fail (field < cursor->layout->n_fields, FALSE);
+
+  size = get_element_size (cursor->layout, cursor->data, cursor->len, field);
+  if (!size || !xgen_field_cursor_get_extent (cursor, field, &extent))
+    return FALSE;
+
+  init_list (list, cursor->data, &extent, size, cursor->byte_order);
+  return TRUE;
+}
+
+/**
+ * xgen_list_read:
+ * @list: A list within a raw message
+ * @dest: An array of @list->count elements
+ * @dest_size: The size of the elements of @dest; 1, 2 or 4
+ *
+ * Converts the elements of @list to host order, zero extending or
+ * truncating them to @dest_size bytes.
+ */
+void
+xgen_list_read (const XGenList *list, void *dest, guint dest_size)
+{
+  _xgen_convert_elements (list->data, list->element_size,
+			  _XGEN_NEEDS_SWAP (list->byte_order),
+			  list->count, dest, dest_size);
+}
+
+/**
+ * xgen_list_write:
+ * @src: An array of @count host order elements
+ * @src_size: The size of the elements of @src; 1, 2 or 4
+ * @count: The number of elements
+ * @dest: Where to write the list in a raw message
+ * @element_size: The size of the elements on the wire; 1, 2 or 4
+ * @byte_order: The byte order of the message
+ *
+ * Writes host order elements as a list in a raw message, zero extending
+ * or truncating them to @element_size bytes.
+ */
+void
+xgen_list_write (const void *src,
+		 guint src_size,
+		 guint32 count,
+		 guint8 *dest,
+		 guint element_size,
+		 XGenByteOrder byte_order)
+{
+  gboolean swap = _XGEN_NEEDS_SWAP (byte_order);
+
+  /* Elements are resized in host order, then swapped in place */
+  _xgen_convert_elements (src, src_size, FALSE, count, dest, element_size);
+  if (swap && element_size > 1)
+    _xgen_convert_elements (dest, element_size, TRUE, count,
+			    dest, element_size);
+}
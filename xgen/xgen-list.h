@@ -0,0 +1,38 @@
+#ifndef _XGEN_LIST_H_
+#define _XGEN_LIST_H_
+
+#include <xgen.h>
+#include <xgen-layout.h>
+
+#include <glib.h>
+
+/**
+ * A list of integers within a raw message, such as property data or an
+ * image, to be converted to or from a host array in bulk.
+ */
+typedef struct _XGenList
+{
+  const guint8	*data;		/* The first element */
+  guint32	 count;
+  guint		 element_size;	/* 1, 2 or 4 bytes */
+  XGenByteOrder	 byte_order;
+} XGenList;
+
+gboolean xgen_layout_get_list (const XGenLayout *layout,
+			       const guint8 *data,
+			       gsize len,
+			       XGenByteOrder byte_order,
+			       guint field,
+			       XGenList *list);
+gboolean xgen_field_cursor_get_list (XGenFieldCursor *cursor,
+				     guint field,
+				     XGenList *list);
+void xgen_list_read (const XGenList *list, void *dest, guint dest_size);
+void xgen_list_write (const void *src,
+		      guint src_size,
+		      guint32 count,
+		      guint8 *dest,
+		      guint element_size,
+		      XGenByteOrder byte_order);
+
+#endif /* _XGEN_LIST_H_ */
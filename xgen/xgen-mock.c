@@ -0,0 +1,1033 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-dispatch.h>
+#include <xgen-encoder.h>
+#include <xgen-io.h>
+#include <xgen-mock.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define FIRST_EXTENSION_OPCODE 128
+#define FIRST_EXTENSION_EVENT 64
+#define FIRST_EXTENSION_ERROR 128
+
+#define BAD_REQUEST 1
+
+/* In 4 byte units, as answered to BigReqEnable */
+#define MAX_BIG_REQUEST_LENGTH 0x3fffff
+
+/* The ids of the connection setup; those of the clients' resources start
+ * above them */
+#define ROOT_WINDOW 0x100
+#define DEFAULT_COLORMAP 0x101
+#define ROOT_VISUAL 0x102
+#define RESOURCE_ID_MASK 0x1fffff
+
+typedef struct _ExtensionCodes
+{
+  guint8 major_opcode;
+  guint8 first_event;
+  guint8 first_error;
+} ExtensionCodes;
+
+/* A reply field taken from the fixed part of the request */
+typedef struct _CopiedField
+{
+  guint reply_field;
+  guint request_offset;
+  guint size;
+} CopiedField;
+
+/* How to answer one request, worked out before the server starts and
+ * then only read */
+typedef struct _ReplyPlan
+{
+  const XGenReply *reply;
+  const XGenLayout *layout;
+  XGenEncodeValue *values;	/* The defaults and canned values */
+  GArray *copied_fields;
+} ReplyPlan;
+
+typedef struct _Connection
+{
+  XGenMockServer     *server;
+  int		      fd;
+  guint		      index;
+  GThread	     *thread;
+
+  /* Everything below is private to the connection's thread */
+  XGenByteOrder	      byte_order;
+  gboolean	      swap;
+  guint32	      sequence;
+  XGenEncoder	     *encoder;
+  XGenOutputBuffer   *buffer;
+  XGenEncodeValue    *values;
+  guint8	     *input;
+  gsize		      input_len;
+  gsize		      input_allocated;
+  guint8	     *scratch;	/* A big request in the normal form */
+  gsize		      scratch_allocated;
+  XGenMockServerStats stats;	/* Not yet added to the server's */
+} Connection;
+
+struct _XGenMockServer
+{
+  const XGenState   *state;
+  XGenDispatch	    *dispatch;
+  GHashTable	    *extensions;  /* xname -> ExtensionCodes */
+  GHashTable	    *plans;	  /* XGenRequest -> ReplyPlan */
+  guint		     max_reply_fields;
+
+  /* The structs of the connection setup; all but Setup and SCREEN are
+   * optional */
+  const XGenDefinition *setup_def;
+  const XGenDefinition *format_def;
+  const XGenDefinition *screen_def;
+  const XGenDefinition *depth_def;
+  const XGenDefinition *visual_def;
+
+  const XGenRequest *query_extension;
+  gint		     present_index;
+  gint		     major_opcode_index;
+  gint		     first_event_index;
+  gint		     first_error_index;
+
+  XGenMockReplyFunc  func;
+  void		    *user_data;
+
+  char		    *socket_path;
+  int		     listen_fd;
+  GThread	    *accept_thread;
+
+  GMutex	    *lock;
+  gboolean	     stopping;
+  GList		    *connections;
+  XGenMockServerStats stats;
+};
+
+/* Numbers the events or errors of an extension need */
+static guint
+count_codes (GList *definitions, gboolean events)
+{
+  guint n = 0;
+  GList *tmp;
+
+  for (tmp = definitions; tmp != NULL; tmp = tmp->next)
+    {
+      guint number;
+
+      if (events)
+	{
+	  XGenEvent *event = tmp->data;
+
+	  if (event->is_generic)
+	    continue;
+	  number = event->number;
+	}
+      else
+	number = XGEN_ERROR_DEF (tmp->data)->number;
+
+      n = MAX (n, number + 1);
+    }
+
+  return n;
+}
+
+/* Gives every extension with a name the codes a server might assign */
+static void
+assign_extension_codes (XGenMockServer *server)
+{
+  guint major_opcode = FIRST_EXTENSION_OPCODE;
+  guint first_event = FIRST_EXTENSION_EVENT;
+  guint first_error = FIRST_EXTENSION_ERROR;
+  GList *tmp;
+
+  for (tmp = server->state->extensions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+      guint n_events = count_codes (extension->events, TRUE);
+      guint n_errors = count_codes (extension->errors, FALSE);
+      ExtensionCodes *codes;
+
+      if (!extension->xname)
+	continue;
+
+      if (major_opcode > 255
+	  || first_event + n_events > 256 || first_error + n_errors > 256)
+	{
+	  g_warning ("Too many extensions for the mock server; %s won't be "
+		     "available", extension->xname);
+	  continue;
+	}
+
+      codes = g_new0 (ExtensionCodes, 1);
+      codes->major_opcode = major_opcode++;
+      if (n_events)
+	{
+	  codes->first_event = first_event;
+	  first_event += n_events;
+	}
+      if (n_errors)
+	{
+	  codes->first_error = first_error;
+	  first_error += n_errors;
+	}
+
+      g_hash_table_insert (server->extensions, extension->xname, codes);
+      xgen_dispatch_add_extension (server->dispatch, extension->header,
+				   codes->major_opcode, codes->first_event,
+				   codes->first_error);
+    }
+}
+
+static gboolean
+is_header_field (const char *name)
+{
+  return strcmp (name, "pad") == 0
+    || strcmp (name, "response_type") == 0
+    || strcmp (name, "opcode") == 0
+    || strcmp (name, "sequence") == 0
+    || strcmp (name, "length") == 0;
+}
+
+static ReplyPlan *
+plan_reply (const XGenRequest *request)
+{
+  const XGenLayout *request_layout =
+    xgen_definition_get_layout (XGEN_DEF (request));
+  ReplyPlan *plan = g_new0 (ReplyPlan, 1);
+  guint i;
+
+  plan->reply = request->reply;
+  plan->layout = xgen_definition_get_layout (XGEN_DEF (request->reply));
+  plan->values = g_new0 (XGenEncodeValue, plan->layout->n_fields);
+  plan->copied_fields = g_array_new (FALSE, FALSE, sizeof (CopiedField));
+
+  for (i = 0; i < plan->layout->n_fields; i++)
+    {
+      const XGenFieldLayout *field_layout = &plan->layout->fields[i];
+      const XGenFieldLayout *request_field;
+      CopiedField copied;
+      gint index;
+
+      if (field_layout->kind != XGEN_LAYOUT_SCALAR
+	  || is_header_field (field_layout->field->name))
+	continue;
+
+      index = xgen_layout_find_field (request_layout,
+				      field_layout->field->name);
+      if (index < 0)
+	continue;
+
+      request_field = &request_layout->fields[index];
+      if (request_field->kind != XGEN_LAYOUT_SCALAR
+	  || request_field->offset == XGEN_LAYOUT_VARIABLE_OFFSET
+	  || (guint)request_field->offset >= request_layout->fixed_size
+	  || request_field->size > 4)
+	continue;
+
+      copied.reply_field = i;
+      copied.request_offset = request_field->offset;
+      copied.size = request_field->size;
+      g_array_append_val (plan->copied_fields, copied);
+    }
+
+  return plan;
+}
+
+static void
+free_plan (gpointer data)
+{
+  ReplyPlan *plan = data;
+
+  g_free (plan->values);
+  g_array_free (plan->copied_fields, TRUE);
+  g_free (plan);
+}
+
+static ReplyPlan *
+lookup_plan (XGenMockServer *server, const char *name)
+{
+  const XGenDefinition *def =
+    xgen_state_find_definition (server->state, name, XGEN_REQUEST);
+
+  return def ? g_hash_table_lookup (server->plans, def) : NULL;
+}
+
+static const XGenDefinition *
+find_struct (const XGenState *state, const char *name)
+{
+  return xgen_state_find_definition (state, name, XGEN_STRUCT);
+}
+
+/**
+ * xgen_mock_server_new:
+ * @state: The parsed protocol state, which must outlive the server
+ * @socket_path: The path of the Unix socket to listen on
+ *
+ * Creates a mock server listening on @socket_path. Clients are only
+ * accepted once xgen_mock_server_start() has been called.
+ *
+ * This function returns the server, or NULL if the socket couldn't be
+ * created or the protocol files don't describe the connection setup.
+ */
+XGenMockServer *
+xgen_mock_server_new (const XGenState *state, const char *socket_path)
+{
+  const XGenDefinition *setup_def = find_struct (state, "xproto:Setup");
+  const XGenDefinition *screen_def = find_struct (state, "xproto:SCREEN");
+  XGenMockServer *server;
+  struct sockaddr_un addr;
+  ReplyPlan *plan;
+  GList *tmp;
+  int fd;
+
+  if (!setup_def || !screen_def)
+    {
+      g_warning ("The protocol files don't describe the connection setup");
+      return NULL;
+    }
+
+  if (strlen (socket_path) >= sizeof (addr.sun_path))
+    {
+      g_warning ("The socket path %s is too long", socket_path);
+      return NULL;
+    }
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, socket_path);
+
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0
+      || bind (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0
+      || listen (fd, 64) < 0)
+    {
+      g_warning ("Failed to listen on %s: %s", socket_path, strerror (errno));
+      if (fd >= 0)
+	close (fd);
+      return NULL;
+    }
+
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
+
+  server = g_new0 (XGenMockServer, 1);
+  server->state = state;
+  server->setup_def = setup_def;
+  server->format_def = find_struct (state, "xproto:FORMAT");
+  server->screen_def = screen_def;
+  server->depth_def = find_struct (state, "xproto:DEPTH");
+  server->visual_def = find_struct (state, "xproto:VISUALTYPE");
+  server->socket_path = g_strdup (socket_path);
+  server->listen_fd = fd;
+  server->lock = g_mutex_new ();
+  server->dispatch = xgen_dispatch_new (state);
+  server->extensions = g_hash_table_new_full (g_str_hash, g_str_equal,
+					      NULL, g_free);
+  server->plans = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					 NULL, free_plan);
+
+  assign_extension_codes (server);
+
+  for (tmp = state->extensions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+      GList *tmp2;
+
+      for (tmp2 = extension->requests; tmp2 != NULL; tmp2 = tmp2->next)
+	{
+	  XGenRequest *request = tmp2->data;
+
+	  if (!request->reply)
+	    continue;
+
+	  plan = plan_reply (request);
+	  server->max_reply_fields = MAX (server->max_reply_fields,
+					  plan->layout->n_fields);
+	  g_hash_table_insert (server->plans, request, plan);
+	}
+    }
+
+  plan = lookup_plan (server, "xproto:QueryExtension");
+  if (plan)
+    {
+      server->query_extension =
+	XGEN_REQUEST_DEF (xgen_state_find_definition (state,
+						      "xproto:QueryExtension",
+						      XGEN_REQUEST));
+      server->present_index = xgen_layout_find_field (plan->layout,
+						      "present");
+      server->major_opcode_index = xgen_layout_find_field (plan->layout,
+							   "major_opcode");
+      server->first_event_index = xgen_layout_find_field (plan->layout,
+							  "first_event");
+      server->first_error_index = xgen_layout_find_field (plan->layout,
+							  "first_error");
+    }
+
+  /* Clients that enable BIG-REQUESTS can't cope with a maximum of 0 */
+  if (lookup_plan (server, "bigreq:Enable"))
+    xgen_mock_server_set_value (server, "bigreq:Enable",
+				"maximum_request_length",
+				MAX_BIG_REQUEST_LENGTH);
+
+  return server;
+}
+
+/**
+ * xgen_mock_server_set_value:
+ * @server: A server that hasn't been started
+ * @reply: The name of the request whose reply to change, e.g.
+ *	   "xproto:GetInputFocus" or "GetInputFocus"
+ * @field: The name of a scalar field of the reply
+ * @value: The value to always answer with
+ *
+ * This function returns FALSE if there is no such reply field.
+ */
+gboolean
+xgen_mock_server_set_value (XGenMockServer *server,
+			    const char *reply,
+			    const char *field,
+			    guint32 value)
+{
+  ReplyPlan *plan = lookup_plan (server, reply);
+  gint index;
+  guint i;
+
+  if (!plan)
+    {
+      g_warning ("The mock server has no reply for %s", reply);
+      return FALSE;
+    }
+
+  index = xgen_layout_find_field (plan->layout, field);
+  if (index < 0 || plan->layout->fields[index].kind != XGEN_LAYOUT_SCALAR)
+    {
+      g_warning ("The %s reply has no field %s", reply, field);
+      return FALSE;
+    }
+
+  plan->values[index].value = value;
+
+  /* Canned values take precedence over those of the request */
+  for (i = 0; i < plan->copied_fields->len; i++)
+    if (g_array_index (plan->copied_fields, CopiedField, i).reply_field
+	== (guint)index)
+      {
+	g_array_remove_index (plan->copied_fields, i);
+	break;
+      }
+
+  return TRUE;
+}
+
+/**
+ * xgen_mock_server_set_reply_func:
+ * @server: A server that hasn't been started
+ * @func: The function to call before each reply is sent, or NULL
+ * @user_data: Private data passed to @func
+ *
+ * Lets the replies be changed per request. @func is called concurrently
+ * from the threads of different connections.
+ */
+void
+xgen_mock_server_set_reply_func (XGenMockServer *server,
+				 XGenMockReplyFunc func,
+				 void *user_data)
+{
+  server->func = func;
+  server->user_data = user_data;
+}
+
+static gboolean
+write_all (int fd, const guint8 *data, gsize len)
+{
+  struct iovec iov;
+
+  iov.iov_base = (void *)data;
+  iov.iov_len = len;
+  return _xgen_writev_all (fd, &iov, 1);
+}
+
+/* Sets a field of a struct's values by name. Fields the protocol files
+ * don't have are skipped. */
+static void
+set_value (const XGenDefinition *def,
+	   XGenEncodeValue *values,
+	   const char *name,
+	   guint32 value,
+	   guint32 count,
+	   const void *data)
+{
+  gint index = xgen_layout_find_field (xgen_definition_get_layout (def),
+				       name);
+
+  if (index < 0)
+    return;
+  values[index].value = value;
+  values[index].count = count;
+  values[index].data = data;
+}
+
+/* Sets a field of a fixed size struct in host byte order */
+static void
+set_member (const XGenDefinition *def,
+	    guint8 *data,
+	    const char *name,
+	    guint32 value)
+{
+  const XGenLayout *layout = xgen_definition_get_layout (def);
+  gint index = xgen_layout_find_field (layout, name);
+
+  if (index >= 0)
+    _xgen_write_unsigned (data + layout->fields[index].offset,
+			  layout->fields[index].size, value, FALSE);
+}
+
+static guint
+n_struct_fields (const XGenDefinition *def)
+{
+  return def ? xgen_definition_get_layout (def)->n_fields : 0;
+}
+
+/* Encodes the Setup that accepts a connection, with one screen holding
+ * one TrueColor visual */
+static void
+encode_setup (Connection *connection,
+	      XGenEncoder *encoder,
+	      XGenOutputBuffer *buffer)
+{
+  /* A multiple of 4 long, since the protocol files leave out the pad
+   * that follows it */
+  static const char vendor[] = "XGen mock server";
+  XGenMockServer *server = connection->server;
+  const XGenDefinition *setup_def = server->setup_def;
+  const XGenDefinition *format_def = server->format_def;
+  const XGenDefinition *screen_def = server->screen_def;
+  const XGenDefinition *depth_def = server->depth_def;
+  const XGenDefinition *visual_def = server->visual_def;
+  gboolean msb_first = connection->byte_order == XGEN_MSB_FIRST;
+  XGenEncodeValue *setup = g_new0 (XGenEncodeValue,
+				   n_struct_fields (setup_def));
+  XGenEncodeValue *screen = g_new0 (XGenEncodeValue,
+				    n_struct_fields (screen_def));
+  XGenEncodeValue *depth = g_new0 (XGenEncodeValue,
+				   n_struct_fields (depth_def));
+  const XGenEncodeValue *screens[1];
+  const XGenEncodeValue *depths[1];
+  guint8 formats[2][8];
+  guint8 visual[24];
+  gsize len;
+
+  screens[0] = screen;
+  depths[0] = depth;
+
+  memset (formats, 0, sizeof (formats));
+  if (format_def)
+    {
+      g_assert (xgen_definition_get_layout (format_def)->fixed_size
+		== sizeof (formats[0]));
+      set_member (format_def, formats[0], "depth", 1);
+      set_member (format_def, formats[0], "bits_per_pixel", 1);
+      set_member (format_def, formats[0], "scanline_pad", 32);
+      set_member (format_def, formats[1], "depth", 24);
+      set_member (format_def, formats[1], "bits_per_pixel", 32);
+      set_member (format_def, formats[1], "scanline_pad", 32);
+    }
+
+  memset (visual, 0, sizeof (visual));
+  if (visual_def)
+    {
+      g_assert (xgen_definition_get_layout (visual_def)->fixed_size
+		== sizeof (visual));
+      set_member (visual_def, visual, "visual_id", ROOT_VISUAL);
+      set_member (visual_def, visual, "_class", 4); /* TrueColor */
+      set_member (visual_def, visual, "bits_per_rgb_value", 8);
+      set_member (visual_def, visual, "colormap_entries", 256);
+      set_member (visual_def, visual, "red_mask", 0xff0000);
+      set_member (visual_def, visual, "green_mask", 0x00ff00);
+      set_member (visual_def, visual, "blue_mask", 0x0000ff);
+    }
+
+  if (depth_def)
+    {
+      set_value (depth_def, depth, "depth", 24, 0, NULL);
+      set_value (depth_def, depth, "visuals", 0, 1, visual);
+    }
+
+  set_value (screen_def, screen, "root", ROOT_WINDOW, 0, NULL);
+  set_value (screen_def, screen, "default_colormap", DEFAULT_COLORMAP,
+	     0, NULL);
+  set_value (screen_def, screen, "white_pixel", 0xffffff, 0, NULL);
+  set_value (screen_def, screen, "width_in_pixels", 1920, 0, NULL);
+  set_value (screen_def, screen, "height_in_pixels", 1080, 0, NULL);
+  set_value (screen_def, screen, "width_in_millimeters", 508, 0, NULL);
+  set_value (screen_def, screen, "height_in_millimeters", 286, 0, NULL);
+  set_value (screen_def, screen, "min_installed_maps", 1, 0, NULL);
+  set_value (screen_def, screen, "max_installed_maps", 1, 0, NULL);
+  set_value (screen_def, screen, "root_visual", ROOT_VISUAL, 0, NULL);
+  set_value (screen_def, screen, "root_depth", 24, 0, NULL);
+  set_value (screen_def, screen, "allowed_depths", 0, 1, depths);
+
+  set_value (setup_def, setup, "status", 1, 0, NULL); /* Success */
+  set_value (setup_def, setup, "protocol_major_version", 11, 0, NULL);
+  set_value (setup_def, setup, "release_number", 1, 0, NULL);
+  set_value (setup_def, setup, "resource_id_base",
+	     (connection->index + 1) * (RESOURCE_ID_MASK + 1), 0, NULL);
+  set_value (setup_def, setup, "resource_id_mask", RESOURCE_ID_MASK,
+	     0, NULL);
+  set_value (setup_def, setup, "maximum_request_length", 65535, 0, NULL);
+  set_value (setup_def, setup, "image_byte_order", msb_first, 0, NULL);
+  set_value (setup_def, setup, "bitmap_format_bit_order", msb_first,
+	     0, NULL);
+  set_value (setup_def, setup, "bitmap_format_scanline_unit", 32, 0, NULL);
+  set_value (setup_def, setup, "bitmap_format_scanline_pad", 32, 0, NULL);
+  set_value (setup_def, setup, "min_keycode", 8, 0, NULL);
+  set_value (setup_def, setup, "max_keycode", 255, 0, NULL);
+  set_value (setup_def, setup, "vendor", 0, sizeof (vendor) - 1, vendor);
+  set_value (setup_def, setup, "pixmap_formats", 0, 2, formats);
+  set_value (setup_def, setup, "roots", 0, 1, screens);
+
+  /* The length, in 4 byte units after the first 8 bytes, is only known
+   * once the rest has been encoded */
+  xgen_encoder_append_struct (encoder, buffer, setup_def, setup);
+  len = xgen_output_buffer_get_size (buffer);
+  xgen_output_buffer_clear (buffer);
+  set_value (setup_def, setup, "length", (len - 8) / 4, 0, NULL);
+  xgen_encoder_append_struct (encoder, buffer, setup_def, setup);
+
+  g_free (setup);
+  g_free (screen);
+  g_free (depth);
+}
+
+/* Reads the client's connection setup and accepts it */
+static gboolean
+setup_connection (Connection *connection)
+{
+  guint8 request[12];
+  guint8 *auth;
+  gsize auth_len;
+
+  if (!xgen_io_read_exactly (connection->fd, request, sizeof (request)))
+    return FALSE;
+
+  if (request[0] == 'l')
+    connection->byte_order = XGEN_LSB_FIRST;
+  else if (request[0] == 'B')
+    connection->byte_order = XGEN_MSB_FIRST;
+  else
+    return FALSE;
+  connection->swap = _XGEN_NEEDS_SWAP (connection->byte_order);
+
+  /* The authorization is accepted whatever it is */
+  auth_len =
+    _XGEN_ALIGN4 (_xgen_read_unsigned (request + 6, 2, connection->swap))
+    + _XGEN_ALIGN4 (_xgen_read_unsigned (request + 8, 2, connection->swap));
+  auth = g_malloc (auth_len + 1);
+  if (!xgen_io_read_exactly (connection->fd, auth, auth_len))
+    {
+      g_free (auth);
+      return FALSE;
+    }
+  g_free (auth);
+
+  connection->encoder = xgen_encoder_new (NULL, connection->byte_order);
+  connection->buffer = xgen_output_buffer_new ();
+  encode_setup (connection, connection->encoder, connection->buffer);
+
+  return xgen_output_buffer_flush (connection->buffer, connection->fd);
+}
+
+/* Errors are rare so they are written straight away */
+static gboolean
+send_error (Connection *connection,
+	    guint8 code,
+	    const guint8 *request)
+{
+  guint8 error[32];
+
+  memset (error, 0, sizeof (error));
+  error[0] = 0;
+  error[1] = code;
+  _xgen_write_unsigned (error + 2, 2, connection->sequence, connection->swap);
+  /* Only extension requests have a minor opcode */
+  _xgen_write_unsigned (error + 8, 2,
+			request[0] >= FIRST_EXTENSION_OPCODE ? request[1] : 0,
+			connection->swap);
+  error[10] = request[0];
+
+  return xgen_output_buffer_flush (connection->buffer, connection->fd)
+    && write_all (connection->fd, error, sizeof (error));
+}
+
+static void
+answer_query_extension (Connection *connection,
+			const guint8 *data,
+			gsize len,
+			XGenEncodeValue *values)
+{
+  XGenMockServer *server = connection->server;
+  const ExtensionCodes *codes = NULL;
+  guint name_len;
+  char *name;
+
+  name_len = _xgen_read_unsigned (data + 4, 2, connection->swap);
+  if (8 + name_len <= len)
+    {
+      name = g_strndup ((const char *)data + 8, name_len);
+      codes = g_hash_table_lookup (server->extensions, name);
+      g_free (name);
+    }
+  if (!codes)
+    return;
+
+  if (server->present_index >= 0)
+    values[server->present_index].value = TRUE;
+  if (server->major_opcode_index >= 0)
+    values[server->major_opcode_index].value = codes->major_opcode;
+  if (server->first_event_index >= 0)
+    values[server->first_event_index].value = codes->first_event;
+  if (server->first_error_index >= 0)
+    values[server->first_error_index].value = codes->first_error;
+}
+
+static void
+answer (Connection *connection,
+	const XGenRequest *request,
+	const ReplyPlan *plan,
+	const guint8 *data,
+	gsize len)
+{
+  XGenMockServer *server = connection->server;
+  XGenEncodeValue *values = connection->values;
+  guint i;
+
+  memcpy (values, plan->values,
+	  plan->layout->n_fields * sizeof (XGenEncodeValue));
+
+  for (i = 0; i < plan->copied_fields->len; i++)
+    {
+      const CopiedField *copied =
+	&g_array_index (plan->copied_fields, CopiedField, i);
+
+      if (copied->request_offset + copied->size <= len)
+	values[copied->reply_field].value =
+	  _xgen_read_unsigned (data + copied->request_offset, copied->size,
+			       connection->swap);
+    }
+
+  if (request == server->query_extension)
+    answer_query_extension (connection, data, len, values);
+
+  if (server->func)
+    server->func (request, data, len, connection->byte_order, values,
+		  server->user_data);
+
+  xgen_encoder_append_reply (connection->encoder, connection->buffer,
+			     plan->reply, connection->sequence, values);
+  connection->stats.n_replies++;
+}
+
+/* The fields of a request in the BIG-REQUESTS form follow its 32 bit
+ * length, so it is copied into the normal form to find them */
+static const guint8 *
+normal_form (Connection *connection, const guint8 *data, gsize *len)
+{
+  if (*len - 4 > connection->scratch_allocated)
+    {
+      connection->scratch_allocated = *len - 4;
+      connection->scratch = g_realloc (connection->scratch,
+				       connection->scratch_allocated);
+    }
+
+  memcpy (connection->scratch, data, 4);
+  memcpy (connection->scratch + 4, data + 8, *len - 8);
+  *len -= 4;
+  return connection->scratch;
+}
+
+/* Handles all the complete requests in the input and returns the
+ * number of bytes used, or -1 if the client broke the protocol */
+static gssize
+handle_requests (Connection *connection)
+{
+  XGenMockServer *server = connection->server;
+  const guint8 *data = connection->input;
+  gsize remaining = connection->input_len;
+
+  while (remaining >= 4)
+    {
+      const XGenRequest *request;
+      const ReplyPlan *plan;
+      gsize len = _xgen_read_unsigned (data + 2, 2, connection->swap) * 4;
+      gboolean big = FALSE;
+
+      if (!len)
+	{
+	  if (remaining < 8)
+	    break;
+	  len = (gsize)_xgen_read_unsigned (data + 4, 4, connection->swap) * 4;
+	  big = TRUE;
+	  if (len < 8 || len > MAX_BIG_REQUEST_LENGTH * 4)
+	    return -1;
+	}
+
+      /* Make room for a request that doesn't fit yet */
+      if (len > remaining)
+	{
+	  if (len > connection->input_allocated)
+	    {
+	      gsize offset = data - connection->input;
+
+	      connection->input_allocated = len;
+	      connection->input = g_realloc (connection->input, len);
+	      data = connection->input + offset;
+	    }
+	  break;
+	}
+
+      connection->sequence++;
+      connection->stats.n_requests++;
+
+      request = xgen_dispatch_lookup_request (server->dispatch, data, len);
+      if (!request)
+	{
+	  connection->stats.n_unknown++;
+	  if (!send_error (connection, BAD_REQUEST, data))
+	    return -1;
+	}
+      else if ((plan = g_hash_table_lookup (server->plans, request)))
+	{
+	  gsize normal_len = len;
+	  const guint8 *normal = big
+	    ? normal_form (connection, data, &normal_len) : data;
+
+	  answer (connection, request, plan, normal, normal_len);
+	}
+
+      data += len;
+      remaining -= len;
+    }
+
+  return data - connection->input;
+}
+
+static void
+merge_stats (XGenMockServerStats *total, XGenMockServerStats *stats)
+{
+  total->n_connections += stats->n_connections;
+  total->n_requests += stats->n_requests;
+  total->n_replies += stats->n_replies;
+  total->n_unknown += stats->n_unknown;
+  total->n_bytes += stats->n_bytes;
+  memset (stats, 0, sizeof (XGenMockServerStats));
+}
+
+static gpointer
+connection_main (gpointer data)
+{
+  Connection *connection = data;
+  XGenMockServer *server = connection->server;
+
+  if (!setup_connection (connection))
+    return NULL;
+
+  connection->values = g_new0 (XGenEncodeValue,
+			       MAX (server->max_reply_fields, 1));
+  connection->input_allocated = 65536;
+  connection->input = g_malloc (connection->input_allocated);
+  connection->stats.n_connections = 1;
+
+  for (;;)
+    {
+      ssize_t n = read (connection->fd,
+			connection->input + connection->input_len,
+			connection->input_allocated - connection->input_len);
+      gssize used;
+
+      if (n < 0 && errno == EINTR)
+	continue;
+      if (n <= 0)
+	break;
+
+      connection->input_len += n;
+      connection->stats.n_bytes += n;
+
+      used = handle_requests (connection);
+      if (used < 0
+	  || !xgen_output_buffer_flush (connection->buffer, connection->fd))
+	break;
+
+      connection->input_len -= used;
+      memmove (connection->input, connection->input + used,
+	       connection->input_len);
+
+      g_mutex_lock (server->lock);
+      merge_stats (&server->stats, &connection->stats);
+      g_mutex_unlock (server->lock);
+    }
+
+  g_mutex_lock (server->lock);
+  merge_stats (&server->stats, &connection->stats);
+  g_mutex_unlock (server->lock);
+
+  return NULL;
+}
+
+static gpointer
+accept_main (gpointer data)
+{
+  XGenMockServer *server = data;
+  guint index = 0;
+
+  for (;;)
+    {
+      Connection *connection;
+      int fd = accept (server->listen_fd, NULL, NULL);
+
+      if (fd < 0)
+	{
+	  if (errno == EINTR || errno == ECONNABORTED)
+	    continue;
+	  break;
+	}
+
+      connection = g_new0 (Connection, 1);
+      connection->server = server;
+      connection->fd = fd;
+      connection->index = index++;
+
+      g_mutex_lock (server->lock);
+      if (server->stopping)
+	{
+	  g_mutex_unlock (server->lock);
+	  close (fd);
+	  g_free (connection);
+	  break;
+	}
+      connection->thread = g_thread_create (connection_main, connection,
+					    TRUE, NULL);
+      server->connections = g_list_prepend (server->connections, connection);
+      g_mutex_unlock (server->lock);
+    }
+
+  return NULL;
+}
+
+/**
+ * xgen_mock_server_start:
+ * @server: A mock server
+ *
+ * Starts accepting clients from a thread of its own, after which the
+ * server's replies can't be changed any more.
+ *
+ * This function returns FALSE if the server was already started.
+ */
+gboolean
+xgen_mock_server_start (XGenMockServer *server)
+{
+  if (server->accept_thread)
+    {
+      g_warning ("The mock server has already been started");
+      return FALSE;
+    }
+
+  server->accept_thread = g_thread_create (accept_main, server, TRUE, NULL);
+  return TRUE;
+}
+
+/**
+ * xgen_mock_server_get_stats:
+ * @server: A mock server
+ * @stats: Return location for the statistics
+ *
+ * Gets the totals of all the connections so far. Connections add their
+ * counts after handling each batch of requests they read.
+ */
+void
+xgen_mock_server_get_stats (XGenMockServer *server,
+			    XGenMockServerStats *stats)
+{
+  g_mutex_lock (server->lock);
+  *stats = server->stats;
+  g_mutex_unlock (server->lock);
+}
+
+static void
+free_connection (Connection *connection)
+{
+  if (connection->encoder)
+    xgen_encoder_free (connection->encoder);
+  if (connection->buffer)
+    xgen_output_buffer_free (connection->buffer);
+  g_free (connection->values);
+  g_free (connection->input);
+  g_free (connection->scratch);
+  g_free (connection);
+}
+
+/**
+ * xgen_mock_server_free:
+ * @server: A mock server
+ *
+ * Disconnects every client, waits for their threads to finish and
+ * removes the socket.
+ */
+void
+xgen_mock_server_free (XGenMockServer *server)
+{
+  GList *tmp;
+
+  g_mutex_lock (server->lock);
+  server->stopping = TRUE;
+  g_mutex_unlock (server->lock);
+
+  /* Wakes up the accepting thread */
+  shutdown (server->listen_fd, SHUT_RDWR);
+  if (server->accept_thread)
+    g_thread_join (server->accept_thread);
+  close (server->listen_fd);
+  unlink (server->socket_path);
+
+  for (tmp = server->connections; tmp != NULL; tmp = tmp->next)
+    {
+      Connection *connection = tmp->data;
+
+      shutdown (connection->fd, SHUT_RDWR);
+      g_thread_join (connection->thread);
+      close (connection->fd);
+      free_connection (connection);
+    }
+  g_list_free (server->connections);
+
+  g_hash_table_destroy (server->plans);
+  g_hash_table_destroy (server->extensions);
+  xgen_dispatch_free (server->dispatch);
+  g_mutex_free (server->lock);
+  g_free (server->socket_path);
+  g_free (server);
+}
@@ -0,0 +1,67 @@
+#ifndef _XGEN_MOCK_H_
+#define _XGEN_MOCK_H_
+
+#include <xgen.h>
+#include <xgen-encoder.h>
+
+#include <glib.h>
+
+/**
+ * A stand-in X server for load testing clients without the cost of a
+ * real one. It listens on a Unix socket, e.g. /tmp/.X11-unix/X99 for
+ * DISPLAY=:99, and performs the connection setup with a single 24 bit
+ * TrueColor screen.
+ *
+ * The server is driven entirely by the parsed definitions. Every
+ * extension with a name is reported as present by QueryExtension.
+ * Requests without replies are only counted. Requests with replies are
+ * answered with a valid reply built from the reply's layout:
+ * - fields are 0 and lists are empty by default;
+ * - canned values set with xgen_mock_server_set_value() come next;
+ * - otherwise a scalar field takes the value of the request field with
+ *   the same name, e.g. the window of a GetWindowAttributes.
+ * Requests that aren't in the parsed state get a Request error.
+ *
+ * Each connection is served by its own thread.
+ */
+typedef struct _XGenMockServer XGenMockServer;
+
+typedef struct _XGenMockServerStats
+{
+  guint64 n_connections;
+  guint64 n_requests;
+  guint64 n_replies;
+  guint64 n_unknown; /* Requests answered with a Request error */
+  guint64 n_bytes;   /* Bytes of requests read */
+} XGenMockServerStats;
+
+/**
+ * Called from a connection's thread before a reply is sent, with @values
+ * holding one value per field of the reply's layout as set by the rules
+ * above. The function can change any of them, or provide lists, to
+ * answer @request, a raw request of @len bytes in @byte_order, more
+ * realistically. List data must stay valid until the function is next
+ * called from the same thread.
+ */
+typedef void (*XGenMockReplyFunc) (const XGenRequest *request,
+				   const guint8 *data,
+				   gsize len,
+				   XGenByteOrder byte_order,
+				   XGenEncodeValue *values,
+				   void *user_data);
+
+XGenMockServer *xgen_mock_server_new (const XGenState *state,
+				      const char *socket_path);
+gboolean xgen_mock_server_set_value (XGenMockServer *server,
+				     const char *reply,
+				     const char *field,
+				     guint32 value);
+void xgen_mock_server_set_reply_func (XGenMockServer *server,
+				      XGenMockReplyFunc func,
+				      void *user_data);
+gboolean xgen_mock_server_start (XGenMockServer *server);
+void xgen_mock_server_get_stats (XGenMockServer *server,
+				 XGenMockServerStats *stats);
+void xgen_mock_server_free (XGenMockServer *server);
+
+#endif /* _XGEN_MOCK_H_ */
@@ -0,0 +1,411 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+/* The tables use hash and displace: the names are spread over a quarter
+ * as many buckets by their hash, and each bucket gets a displacement
+ * that moves all of its names to free entries. Buckets are placed
+ * biggest first, while there is still plenty of room. The hash of a name
+ * gives both its bucket and, mixed with the displacement, its entry, so
+ * the name itself is only read once.
+ *
+ * The tables are written into generated code, so the hash must not
+ * change without bumping EMBED_FORMAT_VERSION in xgen-embed.c.
+ */
+
+#include <xgen.h>
+#include <xgen-names.h>
+
+#include <glib.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NAMES_PER_BUCKET 4
+
+/* If a bucket can't be placed with this many displacements the table is
+ * rebuilt with another seed */
+#define MAX_DISPLACEMENTS (1 << 16)
+
+#define FREE_ENTRY G_MAXUINT
+
+static guint64
+mix (guint64 hash)
+{
+  hash ^= hash >> 33;
+  hash *= G_GUINT64_CONSTANT (0xff51afd7ed558ccd);
+  hash ^= hash >> 33;
+  hash *= G_GUINT64_CONSTANT (0xc4ceb9fe1a85ec53);
+  hash ^= hash >> 33;
+  return hash;
+}
+
+/* FNV-1a, with its poorly mixed high bits finished off */
+static guint64
+hash_name (const char *name, guint32 seed)
+{
+  guint64 hash = G_GUINT64_CONSTANT (0xcbf29ce484222325) ^ seed;
+  const guchar *p;
+
+  for (p = (const guchar *)name; *p; p++)
+    {
+      hash ^= *p;
+      hash *= G_GUINT64_CONSTANT (0x100000001b3);
+    }
+
+  return mix (hash);
+}
+
+static guint
+get_entry_index (guint64 hash, guint32 displacement, guint size)
+{
+  return mix (hash + displacement * G_GUINT64_CONSTANT (0x9e3779b97f4a7c15))
+    % size;
+}
+
+/**
+ * xgen_name_table_lookup:
+ * @table: A name table
+ * @name: The name to find
+ *
+ * This function returns the entry for @name, or NULL if there is none.
+ */
+const XGenNameEntry *
+xgen_name_table_lookup (const XGenNameTable *table, const char *name)
+{
+  const XGenNameEntry *entry;
+  guint64 hash;
+
+  if (!table->size)
+    return NULL;
+
+  hash = hash_name (name, table->seed);
+  entry = &table->entries[get_entry_index (hash, table->displacements
+					   [hash % table->n_buckets],
+					   table->size)];
+
+  return strcmp (entry->name, name) == 0 ? entry : NULL;
+}
+
+/**
+ * xgen_names_find_definition:
+ * @names: The name tables of a state
+ * @name: A definition name as "header:Name", or just "Name" to search every
+ *	  extension
+ * @type: The type of definition to find
+ *
+ * A constant time equivalent of xgen_state_find_definition().
+ *
+ * This function returns the definition or NULL if there is no match.
+ */
+const XGenDefinition *
+xgen_names_find_definition (const XGenNames *names,
+			    const char *name,
+			    XGenType type)
+{
+  const XGenNameEntry *entry;
+
+  entry = xgen_name_table_lookup (&names->definitions[type], name);
+  return entry ? entry->definition : NULL;
+}
+
+/**
+ * xgen_names_find_item:
+ * @names: The name tables of a state
+ * @name: An item name as "Enum.Item" or "header:Enum.Item"
+ * @enum_def: Return location for the enum of the item, or NULL
+ *
+ * This function returns the item or NULL if there is no match.
+ */
+const XGenItemDefinition *
+xgen_names_find_item (const XGenNames *names,
+		      const char *name,
+		      const XGenDefinition **enum_def)
+{
+  const XGenNameEntry *entry;
+
+  entry = xgen_name_table_lookup (&names->items, name);
+  if (!entry)
+    return NULL;
+
+  if (enum_def)
+    *enum_def = entry->definition;
+  return entry->item;
+}
+
+typedef struct _Builder
+{
+  GArray     *entries;
+  GHashTable *names;
+} Builder;
+
+static void
+add_entry (Builder *builder,
+	   char *name,
+	   const XGenDefinition *definition,
+	   const XGenItemDefinition *item)
+{
+  XGenNameEntry entry;
+
+  /* The first extension to use a name gets it unqualified */
+  if (g_hash_table_lookup (builder->names, name))
+    {
+      g_free (name);
+      return;
+    }
+  g_hash_table_insert (builder->names, name, name);
+
+  entry.name = name;
+  entry.definition = definition;
+  entry.item = item;
+  g_array_append_val (builder->entries, entry);
+}
+
+static int
+compare_bucket_size (gconstpointer a, gconstpointer b)
+{
+  const GArray *bucket_a = *(const GArray **)a;
+  const GArray *bucket_b = *(const GArray **)b;
+
+  return (gint)bucket_b->len - (gint)bucket_a->len;
+}
+
+static gboolean
+place_bucket (const GArray *bucket,
+	      const guint64 *hashes,
+	      guint size,
+	      guint *slots,
+	      guint32 *displacement)
+{
+  guint32 d;
+  guint i, j;
+
+  for (d = 0; d < MAX_DISPLACEMENTS; d++)
+    {
+      for (i = 0; i < bucket->len; i++)
+	{
+	  guint key = g_array_index (bucket, guint, i);
+	  guint index = get_entry_index (hashes[key], d, size);
+
+	  if (slots[index] != FREE_ENTRY)
+	    break;
+	  slots[index] = key;
+	}
+
+      if (i == bucket->len)
+	{
+	  *displacement = d;
+	  return TRUE;
+	}
+
+      /* Undo the partial placement */
+      for (j = 0; j < i; j++)
+	{
+	  guint key = g_array_index (bucket, guint, j);
+	  slots[get_entry_index (hashes[key], d, size)] = FREE_ENTRY;
+	}
+    }
+
+  return FALSE;
+}
+
+static gboolean
+try_seed (const GArray *entries,
+	  guint32 seed,
+	  guint n_buckets,
+	  guint32 *displacements,
+	  guint *slots)
+{
+  guint64 *hashes = g_new (guint64, entries->len);
+  GPtrArray *buckets = g_ptr_array_sized_new (n_buckets);
+  gboolean placed = TRUE;
+  guint i;
+
+  for (i = 0; i < n_buckets; i++)
+    g_ptr_array_add (buckets, g_array_new (FALSE, FALSE, sizeof (guint)));
+
+  for (i = 0; i < entries->len; i++)
+    {
+      const XGenNameEntry *entry = &g_array_index (entries, XGenNameEntry, i);
+
+      hashes[i] = hash_name (entry->name, seed);
+      g_array_append_val (g_ptr_array_index (buckets, hashes[i] % n_buckets),
+			  i);
+    }
+
+  for (i = 0; i < entries->len; i++)
+    slots[i] = FREE_ENTRY;
+  memset (displacements, 0, n_buckets * sizeof (guint32));
+
+  /* A bucket's index is found again from the hash of its first name */
+  qsort (buckets->pdata, n_buckets, sizeof (gpointer), compare_bucket_size);
+
+  for (i = 0; i < n_buckets; i++)
+    {
+      GArray *bucket = g_ptr_array_index (buckets, i);
+      guint key;
+
+      if (!bucket->len)
+	break;
+
+      key = g_array_index (bucket, guint, 0);
+      if (!place_bucket (bucket, hashes, entries->len, slots,
+			 &displacements[hashes[key] % n_buckets]))
+	{
+	  placed = FALSE;
+	  break;
+	}
+    }
+
+  for (i = 0; i < n_buckets; i++)
+    g_array_free (g_ptr_array_index (buckets, i), TRUE);
+  g_ptr_array_free (buckets, TRUE);
+  g_free (hashes);
+
+  return placed;
+}
+
+static void
+build_table (XGenNameTable *table, Builder *builder)
+{
+  GArray *entries = builder->entries;
+  guint32 *displacements;
+  XGenNameEntry *table_entries;
+  guint *slots;
+  guint32 seed;
+  guint i;
+
+  g_hash_table_destroy (builder->names);
+
+  memset (table, 0, sizeof (XGenNameTable));
+  if (!entries->len)
+    {
+      g_array_free (entries, TRUE);
+      return;
+    }
+
+  table->n_buckets = (entries->len + NAMES_PER_BUCKET - 1) / NAMES_PER_BUCKET;
+  table->size = entries->len;
+  displacements = g_new (guint32, table->n_buckets);
+  slots = g_new (guint, entries->len);
+
+  /* Starting from the same seed every time keeps generated code stable */
+  for (seed = 0; !try_seed (entries, seed, table->n_buckets,
+			    displacements, slots); seed++)
+    ;
+
+  table_entries = g_new (XGenNameEntry, entries->len);
+  for (i = 0; i < entries->len; i++)
+    table_entries[i] = g_array_index (entries, XGenNameEntry, slots[i]);
+
+  table->seed = seed;
+  table->displacements = displacements;
+  table->entries = table_entries;
+
+  g_free (slots);
+  g_array_free (entries, TRUE);
+}
+
+/**
+ * xgen_names_new:
+ * @state: The parsed protocol state
+ *
+ * Builds the name tables for every definition and enum item of @state.
+ * Valueparams aren't included since they have no name of their own.
+ */
+XGenNames *
+xgen_names_new (const XGenState *state)
+{
+  XGenNames *names = g_new0 (XGenNames, 1);
+  Builder builders[XGEN_NAMES_N_TYPES];
+  Builder items;
+  GList *tmp;
+  guint i;
+
+  for (i = 0; i < XGEN_NAMES_N_TYPES; i++)
+    {
+      builders[i].entries = g_array_new (FALSE, FALSE, sizeof (XGenNameEntry));
+      builders[i].names = g_hash_table_new (g_str_hash, g_str_equal);
+    }
+  items.entries = g_array_new (FALSE, FALSE, sizeof (XGenNameEntry));
+  items.names = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (tmp = state->extensions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+      GList *tmp2;
+
+      for (tmp2 = extension->all_definitions; tmp2 != NULL; tmp2 = tmp2->next)
+	{
+	  const XGenDefinition *def = tmp2->data;
+	  Builder *builder = &builders[def->type];
+	  GList *tmp3;
+
+	  add_entry (builder,
+		     g_strdup_printf ("%s:%s", extension->header, def->name),
+		     def, NULL);
+	  add_entry (builder, g_strdup (def->name), def, NULL);
+
+	  if (def->type != XGEN_ENUM)
+	    continue;
+
+	  for (tmp3 = XGEN_ENUM_DEF (def)->items; tmp3; tmp3 = tmp3->next)
+	    {
+	      const XGenItemDefinition *item = tmp3->data;
+
+	      add_entry (&items, g_strdup_printf ("%s:%s.%s",
+						  extension->header,
+						  def->name, item->name),
+			 def, item);
+	      add_entry (&items, g_strdup_printf ("%s.%s", def->name,
+						  item->name),
+			 def, item);
+	    }
+	}
+    }
+
+  for (i = 0; i < XGEN_NAMES_N_TYPES; i++)
+    build_table (&names->definitions[i], &builders[i]);
+  build_table (&names->items, &items);
+
+  return names;
+}
+
+static void
+free_table (XGenNameTable *table)
+{
+  guint i;
+
+  for (i = 0; i < table->size; i++)
+    g_free ((char *)table->entries[i].name);
+  g_free ((XGenNameEntry *)table->entries);
+  g_free ((guint32 *)table->displacements);
+}
+
+/**
+ * xgen_names_free:
+ * @names: Name tables returned by xgen_names_new()
+ *
+ * Frees the tables. Those of an embedded state mustn't be freed.
+ */
+void
+xgen_names_free (XGenNames *names)
+{
+  guint i;
+
+  for (i = 0; i < XGEN_NAMES_N_TYPES; i++)
+    free_table (&names->definitions[i]);
+  free_table (&names->items);
+  g_free (names);
+}
@@ -0,0 +1,59 @@
+#ifndef _XGEN_NAMES_H_
+#define _XGEN_NAMES_H_
+
+#include <xgen.h>
+
+#include <glib.h>
+
+/**
+ * Minimal perfect hash tables for finding definitions and enum items by
+ * name at run time, e.g. for scripting bindings and debugging tools.
+ *
+ * Names follow xgen_state_find_definition(): every definition can be
+ * found as "header:Name", and as just "Name" when no earlier extension
+ * has a definition of the same type and name. Enum items are named
+ * after their enum, as "EventMask.ButtonPress" or
+ * "shape:SK.Bounding".
+ *
+ * A lookup hashes the name once and compares it with the single entry
+ * the hash leads to. The tables can be built for a parsed state with
+ * xgen_names_new(), and xgen-embed writes them as static data along with
+ * an embedded state (see xgen_embedded_state_get_names()).
+ */
+typedef struct _XGenNameEntry
+{
+  const char		   *name;
+  const XGenDefinition	   *definition; /* For items, the enum */
+  const XGenItemDefinition *item;	/* NULL for definitions */
+} XGenNameEntry;
+
+typedef struct _XGenNameTable
+{
+  guint32		seed;
+  guint			n_buckets;
+  const guint32	       *displacements; /* One per bucket */
+  guint			size;
+  const XGenNameEntry  *entries;       /* Indexed by hash */
+} XGenNameTable;
+
+#define XGEN_NAMES_N_TYPES (XGEN_ERROR + 1)
+
+typedef struct _XGenNames
+{
+  XGenNameTable definitions[XGEN_NAMES_N_TYPES]; /* By XGenType */
+  XGenNameTable items;
+} XGenNames;
+
+XGenNames *xgen_names_new (const XGenState *state);
+const XGenNameEntry *xgen_name_table_lookup (const XGenNameTable *table,
+					     const char *name);
+const XGenDefinition *xgen_names_find_definition (const XGenNames *names,
+						  const char *name,
+						  XGenType type);
+const XGenItemDefinition *
+xgen_names_find_item (const XGenNames *names,
+		      const char *name,
+		      const XGenDefinition **enum_def);
+void xgen_names_free (XGenNames *names);
+
+#endif /* _XGEN_NAMES_H_ */
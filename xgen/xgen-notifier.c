@@ -0,0 +1,428 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-notifier.h>
+#include <xgen-private.h>
+
+#include <glib.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef enum
+{
+  NOTIFY_DEFINITION,
+  NOTIFY_BASE,
+  NOTIFY_REQUEST,
+  NOTIFY_REPLY,
+  NOTIFY_ERROR,
+  NOTIFY_EVENT,
+  NOTIFY_STRUCT,
+  NOTIFY_XID_UNION,
+  NOTIFY_UNION,
+  NOTIFY_ENUM,
+  NOTIFY_TYPEDEF,
+  NOTIFY_VALUEPARAM
+} NotifyKind;
+
+typedef struct _Notification
+{
+  NotifyKind	  kind;
+  XGenDefinition *definition;
+} Notification;
+
+/* A shard holds the notifications of one extension in parse order. It is
+ * delivered whole by a single worker, which keeps the extension ordered
+ * without any locking of its own. */
+typedef struct _Shard
+{
+  const XGenExtension *extension;
+  GArray	*notifications;
+} Shard;
+
+struct _XGenNotifier
+{
+  XGenEventHandlers  handlers;
+  XGenEventHandlers  queue_handlers;
+  guint		     n_workers;
+  GThread	   **threads;
+
+  GHashTable	    *shards_by_extension;
+  GPtrArray	    *shards;
+
+  /* Shards waiting for a worker, biggest first */
+  GMutex	    *lock;
+  GQueue	     queue;
+};
+
+/* The parser isn't reentrant, so only one notifier can be queuing at a
+ * time */
+static XGenNotifier *queuing_notifier = NULL;
+
+static void
+queue_notification (NotifyKind kind, XGenDefinition *def)
+{
+  XGenNotifier *notifier = queuing_notifier;
+  Notification notification;
+  Shard *shard;
+
+  shard = g_hash_table_lookup (notifier->shards_by_extension,
+			       def->extension);
+  if (!shard)
+    {
+      shard = g_new0 (Shard, 1);
+      shard->extension = def->extension;
+      shard->notifications = g_array_new (FALSE, FALSE,
+					  sizeof (Notification));
+      g_hash_table_insert (notifier->shards_by_extension,
+			   (gpointer)def->extension, shard);
+      g_ptr_array_add (notifier->shards, shard);
+    }
+
+  notification.kind = kind;
+  notification.definition = def;
+  g_array_append_val (shard->notifications, notification);
+}
+
+static void
+queue_definition (XGenDefinition *definition)
+{
+  queue_notification (NOTIFY_DEFINITION, definition);
+}
+
+static void
+queue_base (XGenBaseType *base_type)
+{
+  queue_notification (NOTIFY_BASE, (XGenDefinition *)base_type);
+}
+
+static void
+queue_request (XGenRequest *request)
+{
+  queue_notification (NOTIFY_REQUEST, (XGenDefinition *)request);
+}
+
+static void
+queue_reply (XGenReply *reply)
+{
+  queue_notification (NOTIFY_REPLY, (XGenDefinition *)reply);
+}
+
+static void
+queue_error (XGenError *error)
+{
+  queue_notification (NOTIFY_ERROR, (XGenDefinition *)error);
+}
+
+static void
+queue_event (XGenEvent *event)
+{
+  queue_notification (NOTIFY_EVENT, (XGenDefinition *)event);
+}
+
+static void
+queue_struct (XGenStruct *struct_def)
+{
+  queue_notification (NOTIFY_STRUCT, (XGenDefinition *)struct_def);
+}
+
+static void
+queue_xid_union (XGenXIDUnion *xid_union)
+{
+  queue_notification (NOTIFY_XID_UNION, (XGenDefinition *)xid_union);
+}
+
+static void
+queue_union (XGenUnion *union_def)
+{
+  queue_notification (NOTIFY_UNION, (XGenDefinition *)union_def);
+}
+
+static void
+queue_enum (XGenEnum *enum_def)
+{
+  queue_notification (NOTIFY_ENUM, (XGenDefinition *)enum_def);
+}
+
+static void
+queue_typedef (XGenTypedef *typedef_def)
+{
+  queue_notification (NOTIFY_TYPEDEF, (XGenDefinition *)typedef_def);
+}
+
+static void
+queue_valueparam (XGenValueParam *valueparam)
+{
+  queue_notification (NOTIFY_VALUEPARAM, (XGenDefinition *)valueparam);
+}
+
+/**
+ * xgen_notifier_new:
+ * @handlers: The handlers to call from the workers; any of them may be NULL
+ * @n_workers: The number of worker threads, or 0 for one per processor
+ *
+ * Creates a notifier that calls @handlers for the definitions parsed with
+ * xgen_notifier_parse(). The handlers are called from the worker threads,
+ * so anything they share between extensions needs to be locked.
+ */
+XGenNotifier *
+xgen_notifier_new (const XGenEventHandlers *handlers, guint n_workers)
+{
+  XGenNotifier *notifier = g_new0 (XGenNotifier, 1);
+  XGenEventHandlers *queue = &notifier->queue_handlers;
+
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
+
+  if (!n_workers)
+    {
+      long n_processors = sysconf (_SC_NPROCESSORS_ONLN);
+      n_workers = n_processors > 0 ? n_processors : 1;
+    }
+
+  notifier->handlers = *handlers;
+  notifier->n_workers = n_workers;
+  notifier->threads = g_new0 (GThread *, n_workers);
+  notifier->lock = g_mutex_new ();
+  g_queue_init (&notifier->queue);
+
+  /* Only queue what will be delivered */
+#define QUEUE_IF_HANDLED(NAME, FUNC) \
+  queue->NAME = handlers->NAME ? FUNC : NULL
+
+  QUEUE_IF_HANDLED (definition_notify, queue_definition);
+  QUEUE_IF_HANDLED (base_notify, queue_base);
+  QUEUE_IF_HANDLED (request_notify, queue_request);
+  QUEUE_IF_HANDLED (reply_notify, queue_reply);
+  QUEUE_IF_HANDLED (error_notify, queue_error);
+  QUEUE_IF_HANDLED (event_notify, queue_event);
+  QUEUE_IF_HANDLED (struct_notify, queue_struct);
+  QUEUE_IF_HANDLED (xid_union_notify, queue_xid_union);
+  QUEUE_IF_HANDLED (union_notify, queue_union);
+  QUEUE_IF_HANDLED (enum_notify, queue_enum);
+  QUEUE_IF_HANDLED (typedef_notify, queue_typedef);
+  QUEUE_IF_HANDLED (valueparam_notify, queue_valueparam);
+
+#undef QUEUE_IF_HANDLED
+
+  return notifier;
+}
+
+static void
+deliver (const XGenEventHandlers *handlers,
+	 const Notification *notification)
+{
+  XGenDefinition *def = notification->definition;
+
+  switch (notification->kind)
+    {
+    case NOTIFY_DEFINITION:
+      handlers->definition_notify (def);
+      break;
+    case NOTIFY_BASE:
+      handlers->base_notify (XGEN_BASE_TYPE_DEF (def));
+      break;
+    case NOTIFY_REQUEST:
+      handlers->request_notify (XGEN_REQUEST_DEF (def));
+      break;
+    case NOTIFY_REPLY:
+      handlers->reply_notify (XGEN_REPLYDEF (def));
+      break;
+    case NOTIFY_ERROR:
+      handlers->error_notify (XGEN_ERROR_DEF (def));
+      break;
+    case NOTIFY_EVENT:
+      handlers->event_notify (XGEN_EVENT_DEF (def));
+      break;
+    case NOTIFY_STRUCT:
+      handlers->struct_notify (XGEN_STRUCT_DEF (def));
+      break;
+    case NOTIFY_XID_UNION:
+      handlers->xid_union_notify (XGEN_XID_UNION_DEF (def));
+      break;
+    case NOTIFY_UNION:
+      handlers->union_notify (XGEN_UNION_DEF (def));
+      break;
+    case NOTIFY_ENUM:
+      handlers->enum_notify (XGEN_ENUM_DEF (def));
+      break;
+    case NOTIFY_TYPEDEF:
+      handlers->typedef_notify (XGEN_TYPEDEF_DEF (def));
+      break;
+    case NOTIFY_VALUEPARAM:
+      handlers->valueparam_notify (XGEN_VALUE_PARAM_DEF (def));
+      break;
+    }
+}
+
+static gpointer
+worker_main (gpointer data)
+{
+  XGenNotifier *notifier = data;
+
+  for (;;)
+    {
+      Shard *shard;
+      guint i;
+
+      g_mutex_lock (notifier->lock);
+      shard = g_queue_pop_head (&notifier->queue);
+      g_mutex_unlock (notifier->lock);
+
+      if (!shard)
+	break;
+
+      for (i = 0; i < shard->notifications->len; i++)
+	deliver (&notifier->handlers,
+		 &g_array_index (shard->notifications, Notification, i));
+    }
+
+  return NULL;
+}
+
+static void
+free_shards (XGenNotifier *notifier)
+{
+  guint i;
+
+  for (i = 0; i < notifier->shards->len; i++)
+    {
+      Shard *shard = g_ptr_array_index (notifier->shards, i);
+      g_array_free (shard->notifications, TRUE);
+      g_free (shard);
+    }
+  g_ptr_array_free (notifier->shards, TRUE);
+  g_hash_table_destroy (notifier->shards_by_extension);
+  notifier->shards = NULL;
+  notifier->shards_by_extension = NULL;
+}
+
+static int
+compare_shard_size (gconstpointer a, gconstpointer b)
+{
+  const Shard *shard_a = *(const Shard **)a;
+  const Shard *shard_b = *(const Shard **)b;
+
+  return (gint)shard_b->notifications->len
+    - (gint)shard_a->notifications->len;
+}
+
+/**
+ * xgen_notifier_parse:
+ * @notifier: A notifier that isn't currently delivering
+ * @base: A previously parsed state to import from, or NULL
+ * @files: The protocol files to parse
+ *
+ * Parses @files like xgen_parse_xcb_proto_files_with_base() and then
+ * starts delivering their notifications from the worker threads, largest
+ * extension first. This returns as soon as the workers are started; use
+ * xgen_notifier_wait() to wait for them to finish. The state must not be
+ * freed before then.
+ *
+ * Returns: The new state, or NULL if the files couldn't be parsed, in
+ *	    which case nothing is delivered.
+ */
+XGenState *
+xgen_notifier_parse (XGenNotifier *notifier,
+		     const XGenState *base,
+		     GList *files)
+{
+  XGenEventHandlers *previous_handlers;
+  XGenState *state;
+  guint i;
+
+  if (notifier->shards)
+    {
+      g_warning ("Notifier is still delivering a previous parse");
+      return NULL;
+    }
+  if (queuing_notifier)
+    {
+      g_warning ("Notifiers can't be used from within a handler");
+      return NULL;
+    }
+
+  notifier->shards_by_extension = g_hash_table_new (g_direct_hash,
+						    g_direct_equal);
+  notifier->shards = g_ptr_array_new ();
+
+  previous_handlers = _xgen_get_handlers ();
+  queuing_notifier = notifier;
+  xgen_set_handlers (&notifier->queue_handlers);
+
+  if (base)
+    state = xgen_parse_xcb_proto_files_with_base (base, files);
+  else
+    state = xgen_parse_xcb_proto_files (files);
+
+  xgen_set_handlers (previous_handlers);
+  queuing_notifier = NULL;
+
+  if (!state)
+    {
+      free_shards (notifier);
+      return NULL;
+    }
+
+  qsort (notifier->shards->pdata, notifier->shards->len, sizeof (gpointer),
+	 compare_shard_size);
+  for (i = 0; i < notifier->shards->len; i++)
+    g_queue_push_tail (&notifier->queue,
+		       g_ptr_array_index (notifier->shards, i));
+
+  /* The workers only ever read the state, which is complete by now */
+  for (i = 0; i < notifier->n_workers && i < notifier->shards->len; i++)
+    notifier->threads[i] =
+      g_thread_create (worker_main, notifier, TRUE, NULL);
+
+  return state;
+}
+
+/**
+ * xgen_notifier_wait:
+ * @notifier: A notifier
+ *
+ * Blocks until every notification of the last xgen_notifier_parse() has
+ * been delivered. Once this returns, anything the handlers stored with
+ * xgen_definition_set_private() can be read from the calling thread.
+ */
+void
+xgen_notifier_wait (XGenNotifier *notifier)
+{
+  guint i;
+
+  if (!notifier->shards)
+    return;
+
+  for (i = 0; i < notifier->n_workers; i++)
+    if (notifier->threads[i])
+      {
+	g_thread_join (notifier->threads[i]);
+	notifier->threads[i] = NULL;
+      }
+
+  free_shards (notifier);
+}
+
+void
+xgen_notifier_free (XGenNotifier *notifier)
+{
+  xgen_notifier_wait (notifier);
+
+  g_mutex_free (notifier->lock);
+  g_free (notifier->threads);
+  g_free (notifier);
+}
@@ -0,0 +1,35 @@
+#ifndef _XGEN_NOTIFIER_H_
+#define _XGEN_NOTIFIER_H_
+
+#include <xgen.h>
+
+#include <glib.h>
+
+/**
+ * Delivers the notifications of a parse to a set of XGenEventHandlers
+ * from a pool of worker threads, for handlers that do heavy work such as
+ * generating code.
+ *
+ * The notifications are queued per extension while parsing and
+ * delivered once the state is complete, so unlike with
+ * xgen_set_handlers() the handlers can use layouts and fingerprints.
+ * The notifications of one extension are delivered in parse order by a
+ * single thread at a time, while different extensions are handled
+ * concurrently.
+ *
+ * Handlers can return a result for each definition with
+ * xgen_definition_set_private(); since a definition is only ever seen by
+ * one thread this needs no locking, and the results can be read once
+ * xgen_notifier_wait() returns.
+ */
+typedef struct _XGenNotifier XGenNotifier;
+
+XGenNotifier *xgen_notifier_new (const XGenEventHandlers *handlers,
+				 guint n_workers);
+XGenState *xgen_notifier_parse (XGenNotifier *notifier,
+				const XGenState *base,
+				GList *files);
+void xgen_notifier_wait (XGenNotifier *notifier);
+void xgen_notifier_free (XGenNotifier *notifier);
+
+#endif /* _XGEN_NOTIFIER_H_ */
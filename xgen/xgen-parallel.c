@@ -0,0 +1,513 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-capture.h>
+#include <xgen-filter.h>
+#include <xgen-parallel.h>
+
+#include <glib.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* A shard is the capture of one connection. Its segments are decoded in
+ * order by whichever worker currently holds it; a shard is only ever
+ * held by one worker at a time, which keeps each connection ordered. */
+typedef struct _Shard
+{
+  guint		 connection;
+  XGenCapture	*capture;
+  XGenByteOrder	 byte_order;
+  guint		 n_segments;
+  guint		 next_segment;
+} Shard;
+
+typedef struct _Worker
+{
+  XGenParallelDecoder *decoder;
+  guint		       index;
+  GThread	      *thread;
+
+  /* Shards waiting to be decoded. The owner takes from the head and idle
+   * workers steal from the tail. This is the only shared state, and is
+   * only touched once per segment. */
+  GMutex	      *lock;
+  GQueue	       queue;
+  guint		       n_queued_segments; /* Used when distributing shards */
+
+  /* Everything below is private to the worker thread */
+  GHashTable	      *definitions; /* definition name in a capture map ->
+				       XGenDefinition or NULL */
+  const Shard	      *shard;	    /* The shard being decoded */
+  /* The definition table of the segment being decoded */
+  const XGenCaptureDefinitionEntry *table;
+  guint		       n_definitions;
+  XGenDecodeStats      stats;
+} Worker;
+
+struct _XGenParallelDecoder
+{
+  const XGenState  *state;
+  const XGenFilter *filter;
+
+  guint		    n_workers;
+  Worker	   *workers;
+  GPtrArray	   *shards;
+
+  XGenParallelFunc  func;
+  void		   *user_data;
+  volatile gint	    n_pending_segments;
+
+  /* Workers with nothing to steal sleep on idle_cond until a shard is
+   * requeued (which bumps n_requeued) or the last segment is done. The
+   * requeueing worker only takes idle_lock when someone is waiting. */
+  GMutex	   *idle_lock;
+  GCond		   *idle_cond;
+  volatile gint	    n_idle_workers;
+  volatile gint	    n_requeued;
+};
+
+/**
+ * xgen_parallel_decoder_new:
+ * @state: The parsed protocol state, which is shared read-only by all the
+ *	   workers
+ * @n_workers: The number of worker threads, or 0 for one per processor
+ *
+ * Creates a decoder that spreads the decoding of many captures across
+ * several threads.
+ */
+XGenParallelDecoder *
+xgen_parallel_decoder_new (const XGenState *state, guint n_workers)
+{
+  XGenParallelDecoder *decoder = g_new0 (XGenParallelDecoder, 1);
+  guint i;
+
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
+
+  if (!n_workers)
+    {
+      long n_processors = sysconf (_SC_NPROCESSORS_ONLN);
+      n_workers = n_processors > 0 ? n_processors : 1;
+    }
+
+  decoder->state = state;
+  decoder->n_workers = n_workers;
+  decoder->workers = g_new0 (Worker, n_workers);
+  decoder->shards = g_ptr_array_new ();
+  decoder->idle_lock = g_mutex_new ();
+  decoder->idle_cond = g_cond_new ();
+
+  for (i = 0; i < n_workers; i++)
+    {
+      Worker *worker = &decoder->workers[i];
+
+      worker->decoder = decoder;
+      worker->index = i;
+      worker->lock = g_mutex_new ();
+      g_queue_init (&worker->queue);
+      worker->definitions = g_hash_table_new (g_direct_hash, g_direct_equal);
+    }
+
+  return decoder;
+}
+
+/**
+ * xgen_parallel_decoder_add_capture:
+ * @decoder: A decoder
+ * @filename: A capture file holding the messages of one connection
+ * @byte_order: The byte order of the connection
+ *
+ * Adds a connection to be decoded by the next xgen_parallel_decoder_run().
+ *
+ * This function returns the connection number passed to the callback for
+ * the records of this capture, or -1 if the capture can't be opened.
+ */
+gint
+xgen_parallel_decoder_add_capture (XGenParallelDecoder *decoder,
+				   const char *filename,
+				   XGenByteOrder byte_order)
+{
+  XGenCapture *capture = xgen_capture_open (filename);
+  Shard *shard;
+
+  if (!capture)
+    return -1;
+
+  shard = g_new0 (Shard, 1);
+  shard->connection = decoder->shards->len;
+  shard->capture = capture;
+  shard->byte_order = byte_order;
+  shard->n_segments = xgen_capture_get_n_segments (capture);
+  g_ptr_array_add (decoder->shards, shard);
+
+  return shard->connection;
+}
+
+/**
+ * xgen_parallel_decoder_set_filter:
+ * @decoder: A decoder
+ * @filter: A filter, or NULL to decode every record
+ *
+ * Only records matching @filter will be passed to the callback. Since
+ * filters can't match replies, replies are dropped while a filter is set.
+ */
+void
+xgen_parallel_decoder_set_filter (XGenParallelDecoder *decoder,
+				  const XGenFilter *filter)
+{
+  decoder->filter = filter;
+}
+
+static const XGenDefinition *
+resolve_definition (Worker *worker,
+		    const XGenCaptureRecord *record,
+		    const char *name)
+{
+  const XGenState *state = worker->decoder->state;
+  gpointer key;
+  gpointer def;
+
+  /* Each segment stores a name for every entry of its definition table,
+   * so the address of the name identifies the entry, and so the type,
+   * for all the records of the segment */
+  if (g_hash_table_lookup_extended (worker->definitions, name, &key, &def))
+    return def;
+
+  def = NULL;
+  if (record->definition < worker->n_definitions)
+    def = xgen_state_find_definition
+      (state, name, worker->table[record->definition].type);
+
+  g_hash_table_insert (worker->definitions, (gpointer)name, def);
+  return def;
+}
+
+static gboolean
+decode_record (const XGenCaptureRecord *record,
+	       const char *definition_name,
+	       void *user_data)
+{
+  Worker *worker = user_data;
+  XGenParallelDecoder *decoder = worker->decoder;
+  const Shard *shard = worker->shard;
+  const guint8 *data = XGEN_CAPTURE_RECORD_DATA (record);
+  const XGenDefinition *def = NULL;
+  const XGenLayout *layout = NULL;
+  XGenFieldExtent *extents;
+
+  worker->stats.n_records++;
+  worker->stats.n_bytes += record->length;
+
+  if (definition_name)
+    def = resolve_definition (worker, record, definition_name);
+  if (def)
+    layout = xgen_definition_get_layout (def);
+  if (!layout)
+    {
+      worker->stats.n_unknown++;
+      return TRUE;
+    }
+
+  if (decoder->filter
+      && !xgen_filter_match (decoder->filter, record->direction,
+			     data, record->length, shard->byte_order))
+    {
+      worker->stats.n_filtered++;
+      return TRUE;
+    }
+
+  extents = g_newa (XGenFieldExtent, layout->n_fields);
+  if (record->length < layout->min_size
+      || !xgen_layout_get_extents (layout, data, record->length,
+				   shard->byte_order, layout->n_fields,
+				   extents))
+    {
+      worker->stats.n_malformed++;
+      return TRUE;
+    }
+
+  worker->stats.n_decoded++;
+  decoder->func (worker->index, shard->connection, record, def, extents,
+		 shard->byte_order, decoder->user_data);
+  return TRUE;
+}
+
+static Shard *
+steal_shard (Worker *thief)
+{
+  XGenParallelDecoder *decoder = thief->decoder;
+  guint i;
+
+  for (i = 1; i < decoder->n_workers; i++)
+    {
+      Worker *victim =
+	&decoder->workers[(thief->index + i) % decoder->n_workers];
+      Shard *shard;
+
+      g_mutex_lock (victim->lock);
+      shard = g_queue_pop_tail (&victim->queue);
+      g_mutex_unlock (victim->lock);
+
+      if (shard)
+	return shard;
+    }
+
+  return NULL;
+}
+
+/* Sleeps until another worker requeues a shard or all the segments are
+ * done. n_requeued is read before looking for work so that a shard
+ * requeued after the last look isn't slept through. */
+static void
+wait_for_work (XGenParallelDecoder *decoder, gint n_requeued)
+{
+  g_mutex_lock (decoder->idle_lock);
+  g_atomic_int_inc (&decoder->n_idle_workers);
+  while (g_atomic_int_get (&decoder->n_requeued) == n_requeued
+	 && g_atomic_int_get (&decoder->n_pending_segments) > 0)
+    g_cond_wait (decoder->idle_cond, decoder->idle_lock);
+  g_atomic_int_add (&decoder->n_idle_workers, -1);
+  g_mutex_unlock (decoder->idle_lock);
+}
+
+static void
+wake_idle_workers (XGenParallelDecoder *decoder)
+{
+  g_mutex_lock (decoder->idle_lock);
+  g_cond_broadcast (decoder->idle_cond);
+  g_mutex_unlock (decoder->idle_lock);
+}
+
+static gpointer
+worker_main (gpointer data)
+{
+  Worker *worker = data;
+  XGenParallelDecoder *decoder = worker->decoder;
+
+  while (g_atomic_int_get (&decoder->n_pending_segments) > 0)
+    {
+      gint n_requeued = g_atomic_int_get (&decoder->n_requeued);
+      Shard *shard;
+
+      g_mutex_lock (worker->lock);
+      shard = g_queue_pop_head (&worker->queue);
+      g_mutex_unlock (worker->lock);
+
+      if (!shard)
+	{
+	  shard = steal_shard (worker);
+	  if (!shard)
+	    {
+	      /* The remaining segments belong to shards that other workers
+	       * are in the middle of */
+	      wait_for_work (decoder, n_requeued);
+	      continue;
+	    }
+	  worker->stats.n_stolen_segments++;
+	}
+
+      worker->shard = shard;
+      worker->table = xgen_capture_get_definitions (shard->capture,
+						    shard->next_segment,
+						    &worker->n_definitions);
+      xgen_capture_foreach_record_in_segment (shard->capture,
+					      shard->next_segment++,
+					      decode_record, worker);
+      worker->shard = NULL;
+      worker->stats.n_segments++;
+
+      /* Only requeue the shard once its segment is done so that no one
+       * else can start on its next segment early */
+      if (shard->next_segment < shard->n_segments)
+	{
+	  g_mutex_lock (worker->lock);
+	  g_queue_push_head (&worker->queue, shard);
+	  g_mutex_unlock (worker->lock);
+
+	  g_atomic_int_inc (&decoder->n_requeued);
+	  if (g_atomic_int_get (&decoder->n_idle_workers) > 0)
+	    wake_idle_workers (decoder);
+	}
+
+      if (g_atomic_int_dec_and_test (&decoder->n_pending_segments))
+	wake_idle_workers (decoder);
+    }
+
+  return NULL;
+}
+
+static int
+compare_shard_size (gconstpointer a, gconstpointer b)
+{
+  const Shard *shard_a = *(const Shard **)a;
+  const Shard *shard_b = *(const Shard **)b;
+
+  return (gint)shard_b->n_segments - (gint)shard_a->n_segments;
+}
+
+/* Hands out the biggest shards first, each to the least loaded worker, so
+ * that stealing is only needed to even out the tail end */
+static void
+distribute_shards (XGenParallelDecoder *decoder)
+{
+  GPtrArray *sorted = g_ptr_array_sized_new (decoder->shards->len);
+  guint i, j;
+
+  for (i = 0; i < decoder->shards->len; i++)
+    g_ptr_array_add (sorted, g_ptr_array_index (decoder->shards, i));
+  qsort (sorted->pdata, sorted->len, sizeof (gpointer), compare_shard_size);
+
+  for (i = 0; i < sorted->len; i++)
+    {
+      Shard *shard = g_ptr_array_index (sorted, i);
+      Worker *least_loaded = &decoder->workers[0];
+
+      if (shard->next_segment >= shard->n_segments)
+	continue;
+
+      for (j = 1; j < decoder->n_workers; j++)
+	if (decoder->workers[j].n_queued_segments
+	    < least_loaded->n_queued_segments)
+	  least_loaded = &decoder->workers[j];
+
+      g_queue_push_tail (&least_loaded->queue, shard);
+      least_loaded->n_queued_segments += shard->n_segments;
+      decoder->n_pending_segments += shard->n_segments;
+    }
+
+  g_ptr_array_free (sorted, TRUE);
+}
+
+static void
+merge_stats (XGenDecodeStats *total, const XGenDecodeStats *stats)
+{
+  total->n_segments += stats->n_segments;
+  total->n_stolen_segments += stats->n_stolen_segments;
+  total->n_records += stats->n_records;
+  total->n_bytes += stats->n_bytes;
+  total->n_decoded += stats->n_decoded;
+  total->n_filtered += stats->n_filtered;
+  total->n_unknown += stats->n_unknown;
+  total->n_malformed += stats->n_malformed;
+}
+
+/**
+ * xgen_parallel_decoder_run:
+ * @decoder: A decoder
+ * @func: The function to call for each decoded record
+ * @user_data: Private data passed to @func
+ * @stats: Return location for the merged statistics of all the workers,
+ *	   or NULL
+ *
+ * Decodes all the captures that have been added, blocking until every
+ * worker has finished. Each worker starts with its share of the
+ * connections; a worker that runs out steals whole segments from the
+ * connections still queued by other workers.
+ *
+ * The protocol state and layouts are only read while decoding, so they
+ * are shared by all the workers without any locking.
+ */
+void
+xgen_parallel_decoder_run (XGenParallelDecoder *decoder,
+			   XGenParallelFunc func,
+			   void *user_data,
+			   XGenDecodeStats *stats)
+{
+  guint i;
+
+  decoder->func = func;
+  decoder->user_data = user_data;
+
+  for (i = 0; i < decoder->shards->len; i++)
+    {
+      Shard *shard = g_ptr_array_index (decoder->shards, i);
+      shard->next_segment = 0;
+    }
+  for (i = 0; i < decoder->n_workers; i++)
+    {
+      memset (&decoder->workers[i].stats, 0, sizeof (XGenDecodeStats));
+      decoder->workers[i].n_queued_segments = 0;
+    }
+
+  decoder->n_pending_segments = 0;
+  decoder->n_idle_workers = 0;
+  decoder->n_requeued = 0;
+  distribute_shards (decoder);
+
+  for (i = 0; i < decoder->n_workers; i++)
+    decoder->workers[i].thread =
+      g_thread_create (worker_main, &decoder->workers[i], TRUE, NULL);
+
+  for (i = 0; i < decoder->n_workers; i++)
+    {
+      g_thread_join (decoder->workers[i].thread);
+      decoder->workers[i].thread = NULL;
+    }
+
+  if (stats)
+    {
+      memset (stats, 0, sizeof (XGenDecodeStats));
+      for (i = 0; i < decoder->n_workers; i++)
+	merge_stats (stats, &decoder->workers[i].stats);
+    }
+}
+
+/**
+ * xgen_parallel_decoder_get_worker_stats:
+ * @decoder: A decoder
+ * @worker: A worker index
+ *
+ * This function returns the statistics of one worker from the last run.
+ */
+const XGenDecodeStats *
+xgen_parallel_decoder_get_worker_stats (XGenParallelDecoder *decoder,
+					guint worker)
+{
+  g_return_val_if_fail (worker < decoder->n_workers, NULL);
+
+  return &decoder->workers[worker].stats;
+}
+
+void
+xgen_parallel_decoder_free (XGenParallelDecoder *decoder)
+{
+  guint i;
+
+  for (i = 0; i < decoder->n_workers; i++)
+    {
+      Worker *worker = &decoder->workers[i];
+
+      g_mutex_free (worker->lock);
+      g_queue_clear (&worker->queue);
+      g_hash_table_destroy (worker->definitions);
+    }
+  g_free (decoder->workers);
+
+  for (i = 0; i < decoder->shards->len; i++)
+    {
+      Shard *shard = g_ptr_array_index (decoder->shards, i);
+      xgen_capture_close (shard->capture);
+      g_free (shard);
+    }
+  g_ptr_array_free (decoder->shards, TRUE);
+
+  g_cond_free (decoder->idle_cond);
+  g_mutex_free (decoder->idle_lock);
+  g_free (decoder);
+}
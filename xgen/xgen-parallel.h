@@ -0,0 +1,61 @@
+#ifndef _XGEN_PARALLEL_H_
+#define _XGEN_PARALLEL_H_
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-capture.h>
+#include <xgen-filter.h>
+
+#include <glib.h>
+
+/**
+ * Counters gathered by each worker and merged once decoding finishes
+ */
+typedef struct _XGenDecodeStats
+{
+  guint64 n_segments;
+  guint64 n_stolen_segments; /* Segments taken from another worker */
+  guint64 n_records;
+  guint64 n_bytes;
+  guint64 n_decoded;	     /* Records passed to the callback */
+  guint64 n_filtered;	     /* Records rejected by the filter */
+  guint64 n_unknown;	     /* Records without a known definition */
+  guint64 n_malformed;	     /* Records that don't fit their layout */
+} XGenDecodeStats;
+
+/**
+ * Called from a worker thread for each decoded record. Records of the
+ * same connection are delivered in capture order and never concurrently;
+ * records of different connections may be delivered concurrently.
+ *
+ * @extents has an entry for each field of the definition's layout,
+ * giving where it lies within the record data. It's only valid for the
+ * duration of the call.
+ */
+typedef void (*XGenParallelFunc) (guint worker,
+				  guint connection,
+				  const XGenCaptureRecord *record,
+				  const XGenDefinition *definition,
+				  const XGenFieldExtent *extents,
+				  XGenByteOrder byte_order,
+				  void *user_data);
+
+typedef struct _XGenParallelDecoder XGenParallelDecoder;
+
+XGenParallelDecoder *xgen_parallel_decoder_new (const XGenState *state,
+						guint n_workers);
+gint xgen_parallel_decoder_add_capture (XGenParallelDecoder *decoder,
+					const char *filename,
+					XGenByteOrder byte_order);
+void xgen_parallel_decoder_set_filter (XGenParallelDecoder *decoder,
+				       const XGenFilter *filter);
+void xgen_parallel_decoder_run (XGenParallelDecoder *decoder,
+				XGenParallelFunc func,
+				void *user_data,
+				XGenDecodeStats *stats);
+const XGenDecodeStats *
+xgen_parallel_decoder_get_worker_stats (XGenParallelDecoder *decoder,
+					guint worker);
+void xgen_parallel_decoder_free (XGenParallelDecoder *decoder);
+
+#endif /* _XGEN_PARALLEL_H_ */
@@ -0,0 +1,145 @@
+#ifndef _XGEN_PRIVATE_H_
+#define _XGEN_PRIVATE_H_
+
+#include <xgen.h>
+#include <xgen-layout.h>
+
+#include <glib.h>
+
+#include <string.h>
+#include <sys/uio.h>
+
+/* NB: Only symbols prefixed with "xgen_" are exported from the library
+ * so the internal helpers shared between the source files use a leading
+ * underscore */
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define _XGEN_HOST_BYTE_ORDER XGEN_LSB_FIRST
+#else
+#define _XGEN_HOST_BYTE_ORDER XGEN_MSB_FIRST
+#endif
+
+/* Whether multi-byte values in a message need swapping on this host */
+#define _XGEN_NEEDS_SWAP(BYTE_ORDER) ((BYTE_ORDER) != _XGEN_HOST_BYTE_ORDER)
+
+/* Messages, lists and strings are padded to 4 bytes */
+#define _XGEN_ALIGN4(X) (((X) + 3) & ~(gsize)3)
+
+static inline guint32
+_xgen_read_unsigned (const guint8 *data, guint size, gboolean swap)
+{
+  switch (size)
+    {
+    case 1:
+      return data[0];
+    case 2:
+      {
+	guint16 value;
+	memcpy (&value, data, 2);
+	return swap ? GUINT16_SWAP_LE_BE (value) : value;
+      }
+    case 4:
+      {
+	guint32 value;
+	memcpy (&value, data, 4);
+	return swap ? GUINT32_SWAP_LE_BE (value) : value;
+      }
+    }
+  return 0;
+}
+
+static inline gint32
+_xgen_read_signed (const guint8 *data, guint size, gboolean swap)
+{
+  guint32 value = _xgen_read_unsigned (data, size, swap);
+
+  switch (size)
+    {
+    case 1:
+      return (gint8)value;
+    case 2:
+      return (gint16)value;
+    }
+  return (gint32)value;
+}
+
+static inline void
+_xgen_write_unsigned (guint8 *data, guint size, guint32 value, gboolean swap)
+{
+  switch (size)
+    {
+    case 1:
+      data[0] = value;
+      break;
+    case 2:
+      {
+	guint16 value16 = value;
+	if (swap)
+	  value16 = GUINT16_SWAP_LE_BE (value16);
+	memcpy (data, &value16, 2);
+	break;
+      }
+    case 4:
+      if (swap)
+	value = GUINT32_SWAP_LE_BE (value);
+      memcpy (data, &value, 4);
+      break;
+    }
+}
+
+static inline guint
+_xgen_bit_count (guint32 value)
+{
+  value = value - ((value >> 1) & 0x55555555);
+  value = (value & 0x33333333) + ((value >> 2) & 0x33333333);
+  return (((value + (value >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
+/* The most buffers handed to a single writev() call */
+#define _XGEN_IOV_MAX 64
+
+gboolean _xgen_writev_all (int fd, struct iovec *iov, int n_iov);
+
+void _xgen_convert_elements (const guint8 *src,
+			     guint src_size,
+			     gboolean swap,
+			     guint32 count,
+			     void *dest,
+			     guint dest_size);
+
+XGenEventHandlers *_xgen_get_handlers (void);
+void _xgen_notify_definition (XGenDefinition *def);
+enum
+{
+  _XGEN_CURSOR_UNKNOWN,
+  _XGEN_CURSOR_KNOWN,
+  _XGEN_CURSOR_INVALID
+};
+
+/* Shared with xgen-list.c for xgen_field_cursor_get_list() */
+struct _XGenFieldCursor
+{
+  const XGenLayout *layout;
+
+  const guint8	   *data;
+  gsize		    len;
+  XGenByteOrder	    byte_order;
+  gboolean	    swap;
+
+  gboolean	    is_valid;
+  gsize		    message_len;
+  guint		    shift;	/* See request_shift() */
+
+  XGenFieldExtent  *extents;
+  guint8	   *status;	/* The _XGEN_CURSOR_ state of each extent */
+};
+
+GList *_xgen_definition_get_fields (const XGenDefinition *def);
+const XGenDefinition *_xgen_resolve_typedefs (const XGenDefinition *def);
+void _xgen_compute_layouts (XGenState *state);
+void _xgen_compute_fingerprints (XGenState *state);
+guint _xgen_base_type_alignment (XGenType type, guint size);
+gint _xgen_layout_find_field_or_mask (const XGenLayout *layout,
+				      const char *name);
+
+#endif /* _XGEN_PRIVATE_H_ */
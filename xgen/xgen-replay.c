@@ -0,0 +1,1508 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+/* The replay keeps two sequence numbers for every request: the one it had
+ * in the capture and the one it has on the local connection, which differ
+ * since the capture may start mid-session, requests may be skipped and
+ * GetInputFocus requests are added. Requests sent but not yet known to be
+ * processed are queued in local sequence order with their captured
+ * sequence number and the captured reply or error, so each local reply or
+ * error can be compared with the captured one.
+ *
+ * A reply or error also shows the server has processed every request
+ * before it. The time since the previous such point is shared between
+ * the requests it completes, which gives the per-request estimates.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-dispatch.h>
+#include <xgen-encoder.h>
+#include <xgen-capture.h>
+#include <xgen-names.h>
+#include <xgen-io.h>
+#include <xgen-replay.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+
+#define X_ERROR		0
+#define X_REPLY		1
+#define X_GENERIC_EVENT 35
+
+#define DEFAULT_BATCH 256
+
+/* The number of batches the replay may run ahead of the server by */
+#define MAX_OUTSTANDING_BATCHES 4
+
+/* What the replay needs to send a request, worked out when it's first
+ * seen */
+typedef struct _RequestInfo
+{
+  XGenReplayStats   stats;
+  const XGenLayout *layout;
+  gboolean	    resolved;
+  gboolean	    supported;	  /* The local server has the extension */
+  guint8	    major_opcode; /* On the local server */
+  GArray	   *xid_fields;	  /* Indices of XID scalars and lists */
+  XGenFieldExtent  *extents;
+  gboolean	   *ignored;	  /* For each reply field, or NULL */
+} RequestInfo;
+
+/* A captured reply or error */
+typedef struct _Expected
+{
+  guint64		   sequence;
+  const XGenCaptureRecord *record;
+  gboolean		   is_error;
+  const XGenError	  *error; /* NULL if unknown */
+} Expected;
+
+/* A request that the server isn't known to have processed yet */
+typedef struct _Pending
+{
+  guint64	  sequence; /* On the local connection */
+  guint64	  captured;
+  RequestInfo	 *info;	    /* NULL for the GetInputFocus requests the
+			       replay adds */
+  const Expected *expected;
+  gboolean	  completed;
+  gboolean	  answered;
+  gboolean	  differs;
+} Pending;
+
+struct _XGenReplay
+{
+  const XGenState	   *state;
+  XGenNames		   *names;
+  XGenByteOrder		    byte_order;
+  gboolean		    swap;
+
+  gdouble		    speed;
+  guint64		    units_per_second;
+  guint			    batch;
+
+  int			    fd;
+  XGenDispatch		   *dispatch;
+  XGenEncoder		   *encoder;
+  XGenOutputBuffer	   *buffer;
+  const XGenRequest	   *sync_request;
+  XGenEncodeValue	   *sync_values;
+
+  guint8		   *in;
+  gsize			    in_pos;
+  gsize			    in_len;
+  gsize			    in_allocated;
+  gsize			    in_needed;	/* For the incomplete message */
+
+  guint8		   *scratch;	/* A big request in the normal form */
+  gsize			    scratch_allocated;
+
+  guint32		    resource_base; /* Given to the replay */
+  guint32		    resource_mask;
+  guint32		    root;
+  guint32		    captured_base; /* Of the captured client, or 0 */
+
+  GHashTable		   *xids;     /* Other captured XIDs -> local XIDs */
+  GHashTable		   *requests; /* XGenRequest -> RequestInfo */
+
+  GArray		   *expected; /* In captured sequence order */
+  guint			    next_expected;
+  gboolean		    has_responses;
+
+  GQueue		   *pending;
+  guint64		    sequence;	   /* Of the last request sent */
+  guint64		    last_sequence; /* Of the last reply or error */
+  guint			    n_since_reply; /* Requests sent since the last
+					      one with a reply */
+
+  GTimer		   *timer;
+  gdouble		    last_completion;
+  gboolean		    started;
+  guint64		    first_timestamp;
+  gboolean		    failed;
+
+  XGenReplayTotals	    totals;
+
+  XGenReplayDifferenceFunc  func;
+  void			   *user_data;
+};
+
+static void
+request_info_free (RequestInfo *info)
+{
+  g_array_free (info->xid_fields, TRUE);
+  g_free (info->extents);
+  g_free (info->ignored);
+  g_free (info);
+}
+
+/**
+ * xgen_replay_new:
+ * @state: The parsed protocol state, describing every extension in the
+ *	   captures to replay
+ * @byte_order: The byte order of the captured connections, which the
+ *		replay connection also uses
+ *
+ * Creates a replay that sends requests as fast as possible. Connect it
+ * to a server with xgen_replay_connect() before running it.
+ */
+XGenReplay *
+xgen_replay_new (const XGenState *state, XGenByteOrder byte_order)
+{
+  XGenReplay *replay = g_new0 (XGenReplay, 1);
+
+  replay->state = state;
+  replay->names = xgen_names_new (state);
+  replay->byte_order = byte_order;
+  replay->swap = _XGEN_NEEDS_SWAP (byte_order);
+  replay->units_per_second = 1000000;
+  replay->batch = DEFAULT_BATCH;
+  replay->fd = -1;
+
+  replay->xids = g_hash_table_new (g_direct_hash, g_direct_equal);
+  replay->requests =
+    g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+			   (GDestroyNotify)request_info_free);
+  replay->expected = g_array_new (FALSE, FALSE, sizeof (Expected));
+  replay->pending = g_queue_new ();
+  replay->timer = g_timer_new ();
+
+  /* The local server assigns extensions their own numbers */
+  if (xgen_names_find_definition (replay->names, "xproto:QueryExtension",
+				  XGEN_REQUEST))
+    {
+      xgen_replay_ignore_field (replay, "xproto:QueryExtension",
+				"major_opcode");
+      xgen_replay_ignore_field (replay, "xproto:QueryExtension",
+				"first_event");
+      xgen_replay_ignore_field (replay, "xproto:QueryExtension",
+				"first_error");
+    }
+
+  return replay;
+}
+
+/**
+ * xgen_replay_set_speed:
+ * @replay: A replay
+ * @speed: 0 to send requests as fast as possible, 1 to keep to the
+ *	   captured timing, 2 for twice as fast and so on
+ * @units_per_second: How many units of the capture timestamps make up a
+ *		      second; the default is 1000000
+ *
+ * The estimates of the time the server spent on each request include any
+ * time it was kept waiting, so they are best made as fast as possible.
+ */
+void
+xgen_replay_set_speed (XGenReplay *replay,
+		       gdouble speed,
+		       guint64 units_per_second)
+{
+  replay->speed = MAX (speed, 0);
+  replay->units_per_second = MAX (units_per_second, 1);
+}
+
+/**
+ * xgen_replay_set_batch:
+ * @replay: A replay
+ * @batch: The number of requests written at a time
+ *
+ * A GetInputFocus is added after this many requests without replies to
+ * track the server's progress, and the replay runs at most a few batches
+ * ahead of the server.
+ */
+void
+xgen_replay_set_batch (XGenReplay *replay, guint batch)
+{
+  /* Sequence numbers are matched by their low 16 bits */
+  replay->batch = CLAMP (batch, 1, 0xffff / (MAX_OUTSTANDING_BATCHES + 1));
+}
+
+/**
+ * xgen_replay_set_resource_base:
+ * @replay: A replay
+ * @base: The resource-id-base the captured client was given
+ *
+ * By default the base is taken to be the most common one among the XIDs
+ * the captured requests use. The captured client's resource-id-mask is
+ * assumed to be the local one.
+ */
+void
+xgen_replay_set_resource_base (XGenReplay *replay, guint32 base)
+{
+  replay->captured_base = base;
+}
+
+/**
+ * xgen_replay_map_xid:
+ * @replay: A replay
+ * @captured: An XID used by the captured session
+ * @local: The XID to use on the local server instead
+ *
+ * Translates an XID that wasn't created by the captured client, e.g. the
+ * root window: xgen_replay_map_xid (replay, captured_root,
+ * xgen_replay_get_root (replay)). An XID that isn't translated and that
+ * no outstanding reply defines is assumed to be the same on both
+ * servers.
+ */
+void
+xgen_replay_map_xid (XGenReplay *replay, guint32 captured, guint32 local)
+{
+  g_hash_table_insert (replay->xids, GUINT_TO_POINTER (captured),
+		       GUINT_TO_POINTER (local));
+}
+
+static RequestInfo *
+get_request_info (XGenReplay *replay, const XGenRequest *request)
+{
+  RequestInfo *info = g_hash_table_lookup (replay->requests, request);
+  guint i;
+
+  if (info)
+    return info;
+
+  info = g_new0 (RequestInfo, 1);
+  info->stats.request = request;
+  info->layout = xgen_definition_get_layout (XGEN_DEF (request));
+  info->xid_fields = g_array_new (FALSE, FALSE, sizeof (guint));
+  info->extents = g_new (XGenFieldExtent, info->layout->n_fields);
+
+  for (i = 0; i < info->layout->n_fields; i++)
+    {
+      const XGenFieldLayout *field_layout = &info->layout->fields[i];
+
+      if ((field_layout->kind == XGEN_LAYOUT_SCALAR
+	   || field_layout->kind == XGEN_LAYOUT_LIST)
+	  && field_layout->type
+	  && (field_layout->type->type == XGEN_XID
+	      || field_layout->type->type == XGEN_XIDUNION)
+	  && field_layout->size == 4)
+	g_array_append_val (info->xid_fields, i);
+    }
+
+  g_hash_table_insert (replay->requests, (gpointer)request, info);
+  return info;
+}
+
+/**
+ * xgen_replay_ignore_field:
+ * @replay: A replay
+ * @request: The name of the request whose reply has the field, e.g.
+ *	     "xproto:QueryPointer" or "QueryPointer"
+ * @field: The name of a field of the reply
+ *
+ * Stops a reply field being compared with the capture, e.g. because it
+ * holds a timestamp. The opcodes and event and error bases in
+ * QueryExtension replies are always ignored.
+ *
+ * This function returns FALSE if there is no such reply field.
+ */
+gboolean
+xgen_replay_ignore_field (XGenReplay *replay,
+			  const char *request,
+			  const char *field)
+{
+  const XGenDefinition *def =
+    xgen_names_find_definition (replay->names, request, XGEN_REQUEST);
+  const XGenLayout *layout;
+  RequestInfo *info;
+  gint index;
+
+  if (!def || !XGEN_REQUEST_DEF (def)->reply)
+    {
+      g_warning ("There is no reply to %s", request);
+      return FALSE;
+    }
+
+  layout = xgen_definition_get_layout (XGEN_DEF (XGEN_REQUEST_DEF (def)
+						 ->reply));
+  index = xgen_layout_find_field (layout, field);
+  if (index < 0)
+    {
+      g_warning ("The %s reply has no field %s", request, field);
+      return FALSE;
+    }
+
+  info = get_request_info (replay, XGEN_REQUEST_DEF (def));
+  if (!info->ignored)
+    info->ignored = g_new0 (gboolean, layout->n_fields);
+  info->ignored[index] = TRUE;
+
+  return TRUE;
+}
+
+/**
+ * xgen_replay_set_difference_func:
+ * @replay: A replay
+ * @func: The function to call for each difference from the capture
+ * @user_data: Data to pass to @func
+ *
+ * Differences are only counted by default.
+ */
+void
+xgen_replay_set_difference_func (XGenReplay *replay,
+				 XGenReplayDifferenceFunc func,
+				 void *user_data)
+{
+  replay->func = func;
+  replay->user_data = user_data;
+}
+
+/* Reads whatever the server has sent. This waits for up to @timeout
+ * milliseconds for some data, or indefinitely if @timeout is negative. */
+static gboolean
+read_input (XGenReplay *replay, int timeout)
+{
+  gsize needed = MAX (replay->in_needed, 4096);
+  ssize_t n;
+
+  if (timeout >= 0)
+    {
+      struct pollfd pfd = { replay->fd, POLLIN, 0 };
+      int ret = poll (&pfd, 1, timeout);
+
+      if (ret == 0 || (ret < 0 && errno == EINTR))
+	return TRUE;
+      if (ret < 0)
+	{
+	  g_warning ("Failed to poll the X server connection: %s",
+		     strerror (errno));
+	  return FALSE;
+	}
+    }
+
+  /* Drop the messages already handled */
+  if (replay->in_pos)
+    {
+      memmove (replay->in, replay->in + replay->in_pos,
+	       replay->in_len - replay->in_pos);
+      replay->in_len -= replay->in_pos;
+      replay->in_pos = 0;
+    }
+  if (replay->in_allocated - replay->in_len < needed)
+    {
+      replay->in_allocated = MAX (replay->in_allocated * 2,
+				  replay->in_len + needed);
+      replay->in = g_realloc (replay->in, replay->in_allocated);
+    }
+
+  do
+    n = read (replay->fd, replay->in + replay->in_len,
+	      replay->in_allocated - replay->in_len);
+  while (n < 0 && errno == EINTR);
+
+  if (n <= 0)
+    {
+      g_warning ("The X server closed the connection");
+      return FALSE;
+    }
+  replay->in_len += n;
+  return TRUE;
+}
+
+/* Returns the next complete message from the server, or NULL */
+static const guint8 *
+peek_message (XGenReplay *replay, gsize *len)
+{
+  const guint8 *data = replay->in + replay->in_pos;
+  gsize available = replay->in_len - replay->in_pos;
+
+  if (available < 32)
+    return NULL;
+
+  /* Replies and generic events can be longer than 32 bytes */
+  *len = 32;
+  if (data[0] == X_REPLY || (data[0] & 0x7f) == X_GENERIC_EVENT)
+    *len += (gsize)_xgen_read_unsigned (data + 4, 4, replay->swap) * 4;
+  if (available < *len)
+    {
+      replay->in_needed = *len;
+      return NULL;
+    }
+
+  replay->in_needed = 0;
+  return data;
+}
+
+/* Extends the 16 bit sequence number of a reply or error. The replay
+ * never runs 65536 requests ahead of the server. */
+static guint64
+get_sequence (XGenReplay *replay, const guint8 *data)
+{
+  guint16 delta = _xgen_read_unsigned (data + 2, 2, replay->swap)
+    - (guint16)replay->last_sequence;
+
+  replay->last_sequence += delta;
+  return replay->last_sequence;
+}
+
+static gboolean
+flush (XGenReplay *replay)
+{
+  return xgen_output_buffer_flush (replay->buffer, replay->fd);
+}
+
+/* Reads until the reply or error to the last request sent arrives. The
+ * message is valid until more input is read. */
+static const guint8 *
+wait_for_reply (XGenReplay *replay)
+{
+  for (;;)
+    {
+      const guint8 *data;
+      gsize len;
+
+      while ((data = peek_message (replay, &len)))
+	{
+	  replay->in_pos += len;
+	  if (data[0] <= X_REPLY
+	      && get_sequence (replay, data) == replay->sequence)
+	    return data;
+	}
+
+      if (!read_input (replay, -1))
+	return NULL;
+    }
+}
+
+/* Reads a fixed position field of a message in the connection's byte
+ * order */
+static guint32
+get_field (XGenReplay *replay,
+	   const XGenDefinition *def,
+	   const guint8 *data,
+	   const char *name)
+{
+  const XGenLayout *layout = xgen_definition_get_layout (def);
+  gint index = xgen_layout_find_field (layout, name);
+
+  g_assert (index >= 0
+	    && layout->fields[index].offset != XGEN_LAYOUT_VARIABLE_OFFSET);
+  return _xgen_read_unsigned (data + layout->fields[index].offset,
+			      layout->fields[index].size, replay->swap);
+}
+
+/* Performs the connection setup and remembers the resource range and
+ * root window of the first screen */
+static gboolean
+setup_connection (XGenReplay *replay)
+{
+  XGenSetupInfo info;
+
+  if (!xgen_io_setup_connection (replay->state, replay->fd,
+				 replay->byte_order, &info))
+    return FALSE;
+
+  replay->resource_base = info.resource_id_base;
+  replay->resource_mask = info.resource_id_mask;
+  replay->root = info.root;
+  return TRUE;
+}
+
+/* Registers every extension the local server has with the values it
+ * gives for it */
+static gboolean
+query_extensions (XGenReplay *replay)
+{
+  const XGenDefinition *query =
+    xgen_names_find_definition (replay->names, "xproto:QueryExtension",
+				XGEN_REQUEST);
+  const XGenLayout *layout;
+  const XGenDefinition *reply_def;
+  XGenEncodeValue *values;
+  gint name_index;
+  GList *tmp;
+
+  if (!query)
+    {
+      g_warning ("The protocol files don't define QueryExtension");
+      return FALSE;
+    }
+  layout = xgen_definition_get_layout (query);
+  reply_def = XGEN_DEF (XGEN_REQUEST_DEF (query)->reply);
+  values = g_new0 (XGenEncodeValue, layout->n_fields);
+  name_index = xgen_layout_find_field (layout, "name");
+
+  for (tmp = replay->state->extensions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+      const guint8 *reply;
+
+      if (!extension->xname)
+	continue;
+
+      values[name_index].count = strlen (extension->xname);
+      values[name_index].data = extension->xname;
+      if (!xgen_encoder_append (replay->encoder, replay->buffer,
+				XGEN_REQUEST_DEF (query), values)
+	  || !flush (replay))
+	goto error;
+      replay->sequence++;
+
+      reply = wait_for_reply (replay);
+      if (!reply || reply[0] != X_REPLY)
+	goto error;
+
+      /* Requests of missing extensions are skipped */
+      if (get_field (replay, reply_def, reply, "present"))
+	xgen_dispatch_add_extension (replay->dispatch, extension->header,
+				     get_field (replay, reply_def, reply,
+						"major_opcode"),
+				     get_field (replay, reply_def, reply,
+						"first_event"),
+				     get_field (replay, reply_def, reply,
+						"first_error"));
+    }
+
+  g_free (values);
+  return TRUE;
+
+error:
+  g_warning ("Failed to query the X server's extensions");
+  g_free (values);
+  return FALSE;
+}
+
+/**
+ * xgen_replay_connect:
+ * @replay: A replay
+ * @display: The local display, e.g. ":9"
+ *
+ * Connects to a local server without authentication and finds out which
+ * extensions it has.
+ *
+ * This function returns FALSE if the connection failed.
+ */
+gboolean
+xgen_replay_connect (XGenReplay *replay, const char *display)
+{
+  const XGenDefinition *sync_def =
+    xgen_names_find_definition (replay->names, "xproto:GetInputFocus",
+				XGEN_REQUEST);
+
+  g_return_val_if_fail (replay->fd < 0, FALSE);
+
+  if (!sync_def)
+    {
+      g_warning ("The protocol files don't define GetInputFocus");
+      return FALSE;
+    }
+  replay->sync_request = XGEN_REQUEST_DEF (sync_def);
+  replay->sync_values =
+    g_new0 (XGenEncodeValue, xgen_definition_get_layout (sync_def)->n_fields);
+
+  replay->fd = xgen_io_connect_display (display);
+  if (replay->fd < 0)
+    return FALSE;
+
+  replay->dispatch = xgen_dispatch_new (replay->state);
+  replay->encoder = xgen_encoder_new (replay->dispatch, replay->byte_order);
+  replay->buffer = xgen_output_buffer_new ();
+
+  return setup_connection (replay) && query_extensions (replay);
+}
+
+/**
+ * xgen_replay_get_root:
+ * @replay: A connected replay
+ *
+ * Returns: The root window of the local server's first screen
+ */
+guint32
+xgen_replay_get_root (XGenReplay *replay)
+{
+  return replay->root;
+}
+
+/* Translates a captured XID, returning FALSE if it isn't known yet */
+static gboolean
+map_xid (XGenReplay *replay, guint32 xid, guint32 *local)
+{
+  gpointer value;
+
+  *local = xid;
+  if (!xid)
+    return TRUE;
+
+  if (replay->captured_base
+      && (xid & ~replay->resource_mask) == replay->captured_base)
+    {
+      *local = replay->resource_base | (xid & replay->resource_mask);
+      return TRUE;
+    }
+
+  if (g_hash_table_lookup_extended (replay->xids, GUINT_TO_POINTER (xid),
+				    NULL, &value))
+    {
+      *local = GPOINTER_TO_UINT (value);
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Compares a captured XID in a reply or error with the local one. An
+ * XID the replay doesn't know yet is learned from a reply. */
+static gboolean
+match_xid (XGenReplay *replay, guint32 captured, guint32 local, gboolean learn)
+{
+  guint32 mapped;
+
+  if (map_xid (replay, captured, &mapped))
+    return mapped == local;
+
+  if (learn && local)
+    {
+      xgen_replay_map_xid (replay, captured, local);
+      return TRUE;
+    }
+  return captured == local;
+}
+
+static void
+add_difference (XGenReplay *replay,
+		Pending *pending,
+		const char *format,
+		...) G_GNUC_PRINTF (3, 4);
+
+static void
+add_difference (XGenReplay *replay,
+		Pending *pending,
+		const char *format,
+		...)
+{
+  va_list args;
+  char *description;
+
+  if (!pending->differs)
+    {
+      pending->differs = TRUE;
+      pending->info->stats.n_differences++;
+      replay->totals.n_differences++;
+    }
+
+  if (!replay->func)
+    return;
+
+  va_start (args, format);
+  description = g_strdup_vprintf (format, args);
+  va_end (args);
+
+  replay->func (pending->info->stats.request, pending->captured, description,
+		replay->user_data);
+  g_free (description);
+}
+
+static const char *
+get_error_name (const XGenError *error)
+{
+  return error ? XGEN_DEF (error)->name : "unknown";
+}
+
+static gboolean
+is_ignored_field (const XGenFieldLayout *field_layout, gboolean is_error)
+{
+  const char *name = field_layout->field->name;
+
+  if (strcmp (name, "pad") == 0
+      || strcmp (name, "sequence") == 0
+      || strcmp (name, "length") == 0)
+    return TRUE;
+
+  /* The codes of extension errors and requests differ between servers */
+  return is_error
+    && (strcmp (name, "error_code") == 0
+	|| strcmp (name, "major_opcode") == 0);
+}
+
+static gboolean
+is_xid_field (const XGenFieldLayout *field_layout, gboolean is_error)
+{
+  if (is_error && strcmp (field_layout->field->name, "bad_value") == 0)
+    return TRUE;
+
+  return field_layout->type
+    && (field_layout->type->type == XGEN_XID
+	|| field_layout->type->type == XGEN_XIDUNION)
+    && field_layout->size == 4;
+}
+
+/* Compares a local reply or error with the captured one, field by
+ * field */
+static void
+compare_messages (XGenReplay *replay,
+		  Pending *pending,
+		  const XGenLayout *layout,
+		  const gboolean *ignored,
+		  const guint8 *data,
+		  gsize len)
+{
+  const XGenCaptureRecord *record = pending->expected->record;
+  const guint8 *captured = XGEN_CAPTURE_RECORD_DATA (record);
+  gboolean is_error = pending->expected->is_error;
+  XGenFieldExtent *extents = g_new (XGenFieldExtent, layout->n_fields * 2);
+  XGenFieldExtent *captured_extents = extents + layout->n_fields;
+  guint i, j;
+
+  if (!xgen_layout_get_extents (layout, data, len, replay->byte_order,
+				layout->n_fields, extents)
+      || !xgen_layout_get_extents (layout, captured, record->length,
+				   replay->byte_order, layout->n_fields,
+				   captured_extents))
+    {
+      add_difference (replay, pending, "%s doesn't match its layout",
+		      is_error ? "the error" : "the reply");
+      g_free (extents);
+      return;
+    }
+
+  for (i = 0; i < layout->n_fields; i++)
+    {
+      const XGenFieldLayout *field_layout = &layout->fields[i];
+      const XGenFieldExtent *extent = &extents[i];
+      const XGenFieldExtent *captured_extent = &captured_extents[i];
+      const char *name = field_layout->field->name;
+
+      if ((ignored && ignored[i]) || is_ignored_field (field_layout, is_error))
+	continue;
+
+      if (extent->count != captured_extent->count
+	  && field_layout->kind == XGEN_LAYOUT_LIST)
+	{
+	  add_difference (replay, pending, "%s: %u elements, captured %u",
+			  name, extent->count, captured_extent->count);
+	  continue;
+	}
+
+      if (is_xid_field (field_layout, is_error))
+	{
+	  for (j = 0; j < extent->count; j++)
+	    {
+	      guint32 value =
+		_xgen_read_unsigned (data + extent->offset + j * 4, 4,
+				     replay->swap);
+	      guint32 captured_value =
+		_xgen_read_unsigned (captured + captured_extent->offset
+				     + j * 4, 4, replay->swap);
+
+	      if (match_xid (replay, captured_value, value, !is_error))
+		continue;
+	      if (field_layout->kind == XGEN_LAYOUT_LIST)
+		add_difference (replay, pending,
+				"%s[%u]: 0x%x, captured 0x%x", name, j,
+				value, captured_value);
+	      else
+		add_difference (replay, pending, "%s: 0x%x, captured 0x%x",
+				name, value, captured_value);
+	      break;
+	    }
+	}
+      else if (field_layout->kind == XGEN_LAYOUT_SCALAR
+	       && (extent->size == 1 || extent->size == 2
+		   || extent->size == 4))
+	{
+	  guint32 value = _xgen_read_unsigned (data + extent->offset,
+					       extent->size, replay->swap);
+	  guint32 captured_value =
+	    _xgen_read_unsigned (captured + captured_extent->offset,
+				 extent->size, replay->swap);
+
+	  if (value != captured_value)
+	    add_difference (replay, pending, "%s: %u, captured %u", name,
+			    value, captured_value);
+	}
+      else if (extent->size != captured_extent->size
+	       || memcmp (data + extent->offset,
+			  captured + captured_extent->offset,
+			  extent->size) != 0)
+	add_difference (replay, pending, "%s differs", name);
+    }
+
+  g_free (extents);
+}
+
+static void
+handle_reply (XGenReplay *replay,
+	      Pending *pending,
+	      const guint8 *data,
+	      gsize len)
+{
+  const XGenRequest *request;
+  const Expected *expected = pending->expected;
+
+  replay->totals.n_replies++;
+  pending->info->stats.n_replies++;
+
+  /* Only the first of several replies is compared */
+  if (pending->answered)
+    return;
+  pending->answered = TRUE;
+
+  if (!expected)
+    return;
+  if (expected->is_error)
+    {
+      add_difference (replay, pending, "a reply instead of a %s error",
+		      get_error_name (expected->error));
+      return;
+    }
+
+  request = pending->info->stats.request;
+  compare_messages (replay, pending,
+		    xgen_definition_get_layout (XGEN_DEF (request->reply)),
+		    pending->info->ignored, data, len);
+}
+
+static void
+handle_error (XGenReplay *replay,
+	      Pending *pending,
+	      const guint8 *data,
+	      gsize len)
+{
+  const XGenError *error =
+    xgen_dispatch_lookup_error (replay->dispatch, data, len);
+  const Expected *expected = pending->expected;
+
+  replay->totals.n_errors++;
+  pending->info->stats.n_errors++;
+  pending->answered = TRUE;
+
+  if (!replay->has_responses)
+    return;
+
+  if (!expected)
+    add_difference (replay, pending, "a %s error", get_error_name (error));
+  else if (!expected->is_error)
+    add_difference (replay, pending, "a %s error instead of a reply",
+		    get_error_name (error));
+  else if (expected->error != error || !error)
+    add_difference (replay, pending, "a %s error instead of a %s error",
+		    get_error_name (error), get_error_name (expected->error));
+  else
+    compare_messages (replay, pending,
+		      xgen_definition_get_layout (XGEN_DEF (error)),
+		      NULL, data, len);
+}
+
+/* Called once the server has processed a request and sent anything it
+ * was going to send for it */
+static void
+finish_request (XGenReplay *replay, Pending *pending)
+{
+  const Expected *expected = pending->expected;
+
+  if (pending->info && !pending->answered && expected)
+    {
+      if (expected->is_error)
+	add_difference (replay, pending, "no %s error",
+			get_error_name (expected->error));
+      else
+	add_difference (replay, pending, "no reply");
+    }
+  g_free (pending);
+}
+
+/* Shares the time since the last completion point between the requests
+ * up to @sequence, and finishes those before it */
+static void
+complete_requests (XGenReplay *replay, guint64 sequence)
+{
+  gdouble now = g_timer_elapsed (replay->timer, NULL);
+  gdouble share = 0;
+  Pending *pending;
+  guint n = 0;
+  GList *l;
+
+  for (l = replay->pending->head;
+       l && ((Pending *)l->data)->sequence <= sequence;
+       l = l->next)
+    {
+      pending = l->data;
+      if (!pending->completed && pending->info)
+	n++;
+    }
+  if (n)
+    share = (now - replay->last_completion) / n;
+  replay->last_completion = now;
+
+  while ((pending = g_queue_peek_head (replay->pending))
+	 && pending->sequence <= sequence)
+    {
+      if (!pending->completed && pending->info)
+	pending->info->stats.time += share;
+      pending->completed = TRUE;
+
+      /* A request can have more than one reply */
+      if (pending->sequence == sequence)
+	break;
+      g_queue_pop_head (replay->pending);
+      finish_request (replay, pending);
+    }
+}
+
+static void
+handle_message (XGenReplay *replay, const guint8 *data, gsize len)
+{
+  Pending *pending;
+  guint64 sequence;
+
+  if (data[0] > X_REPLY)
+    {
+      replay->totals.n_events++;
+      return;
+    }
+
+  sequence = get_sequence (replay, data);
+  complete_requests (replay, sequence);
+
+  pending = g_queue_peek_head (replay->pending);
+  if (!pending || pending->sequence != sequence)
+    return;
+
+  if (pending->info && data[0] == X_REPLY)
+    handle_reply (replay, pending, data, len);
+  else
+    {
+      if (pending->info)
+	handle_error (replay, pending, data, len);
+      g_queue_pop_head (replay->pending);
+      finish_request (replay, pending);
+    }
+}
+
+static void
+process_input (XGenReplay *replay)
+{
+  const guint8 *data;
+  gsize len;
+
+  while ((data = peek_message (replay, &len)))
+    {
+      handle_message (replay, data, len);
+      replay->in_pos += len;
+    }
+}
+
+static void
+push_pending (XGenReplay *replay,
+	      guint64 captured,
+	      RequestInfo *info,
+	      const Expected *expected)
+{
+  Pending *pending = g_new0 (Pending, 1);
+
+  /* The server was idle, which mustn't count against the request */
+  if (g_queue_is_empty (replay->pending))
+    replay->last_completion = g_timer_elapsed (replay->timer, NULL);
+
+  pending->sequence = ++replay->sequence;
+  pending->captured = captured;
+  pending->info = info;
+  pending->expected = expected;
+  g_queue_push_tail (replay->pending, pending);
+}
+
+/* Adds a GetInputFocus whose reply shows the server has processed every
+ * request before it */
+static gboolean
+append_sync (XGenReplay *replay)
+{
+  if (!xgen_encoder_append (replay->encoder, replay->buffer,
+			    replay->sync_request, replay->sync_values))
+    return FALSE;
+
+  push_pending (replay, 0, NULL, NULL);
+  replay->totals.n_syncs++;
+  replay->n_since_reply = 0;
+  return TRUE;
+}
+
+/* Waits for the server to process every request sent */
+static gboolean
+drain (XGenReplay *replay)
+{
+  if (g_queue_is_empty (replay->pending))
+    return TRUE;
+
+  if (!append_sync (replay) || !flush (replay))
+    return FALSE;
+
+  while (!g_queue_is_empty (replay->pending))
+    {
+      if (!read_input (replay, -1))
+	return FALSE;
+      process_input (replay);
+    }
+  return TRUE;
+}
+
+/* Finds the captured reply or error to a request */
+static const Expected *
+find_expected (XGenReplay *replay, guint64 sequence)
+{
+  GArray *expected = replay->expected;
+
+  while (replay->next_expected < expected->len
+	 && g_array_index (expected, Expected,
+			   replay->next_expected).sequence < sequence)
+    replay->next_expected++;
+
+  if (replay->next_expected < expected->len
+      && g_array_index (expected, Expected,
+			replay->next_expected).sequence == sequence)
+    return &g_array_index (expected, Expected, replay->next_expected);
+  return NULL;
+}
+
+/* The fields of a request in the BIG-REQUESTS form follow its 32 bit
+ * length, so it is copied into the normal form to find them */
+static const guint8 *
+normal_form (XGenReplay *replay, const guint8 *data, gsize len)
+{
+  if (len - 4 > replay->scratch_allocated)
+    {
+      replay->scratch_allocated = len - 4;
+      replay->scratch = g_realloc (replay->scratch,
+				   replay->scratch_allocated);
+    }
+
+  memcpy (replay->scratch, data, 4);
+  memcpy (replay->scratch + 4, data + 8, len - 8);
+  return replay->scratch;
+}
+
+/* Translates the XIDs of a request in its normal form @data into @copy,
+ * which is in the BIG-REQUESTS form if @big is set. XIDs that aren't
+ * known are left as they are and are assumed to be the same on both
+ * servers from then on. If @copy is NULL this only checks whether every
+ * XID is known. */
+static gboolean
+translate_xids (XGenReplay *replay,
+		RequestInfo *info,
+		const guint8 *data,
+		guint8 *copy,
+		gboolean big)
+{
+  gboolean known = TRUE;
+  guint i, j;
+
+  for (i = 0; i < info->xid_fields->len; i++)
+    {
+      const XGenFieldExtent *extent =
+	&info->extents[g_array_index (info->xid_fields, guint, i)];
+
+      for (j = 0; j < extent->count; j++)
+	{
+	  guint32 offset = extent->offset + j * 4;
+	  guint32 xid = _xgen_read_unsigned (data + offset, 4, replay->swap);
+	  guint32 local;
+
+	  if (!map_xid (replay, xid, &local))
+	    {
+	      known = FALSE;
+	      if (copy)
+		xgen_replay_map_xid (replay, xid, xid);
+	    }
+
+	  if (copy)
+	    _xgen_write_unsigned (copy + offset + (big && offset >= 4 ? 4 : 0),
+				  4, local, replay->swap);
+	}
+    }
+
+  return known;
+}
+
+static gboolean
+send_request (XGenReplay *replay,
+	      const XGenCaptureRecord *record,
+	      const char *definition_name)
+{
+  const guint8 *data = XGEN_CAPTURE_RECORD_DATA (record);
+  gsize len = record->length;
+  const XGenDefinition *def = NULL;
+  RequestInfo *info;
+  const guint8 *normal;
+  gboolean big, valid;
+  guint8 *copy;
+
+  if (definition_name && len >= 4)
+    def = xgen_names_find_definition (replay->names, definition_name,
+				      XGEN_REQUEST);
+  if (!def)
+    {
+      replay->totals.n_skipped++;
+      return TRUE;
+    }
+
+  info = get_request_info (replay, XGEN_REQUEST_DEF (def));
+  if (!info->resolved)
+    {
+      gint minor_opcode;
+
+      info->supported =
+	xgen_dispatch_get_request_opcode (replay->dispatch,
+					  XGEN_REQUEST_DEF (def),
+					  &info->major_opcode, &minor_opcode);
+      info->resolved = TRUE;
+    }
+  if (!info->supported)
+    {
+      replay->totals.n_skipped++;
+      return TRUE;
+    }
+
+  big = len >= 8 && _xgen_read_unsigned (data + 2, 2, replay->swap) == 0;
+  normal = big ? normal_form (replay, data, len) : data;
+  valid = info->xid_fields->len
+    && xgen_layout_get_extents (info->layout, normal, big ? len - 4 : len,
+				replay->byte_order, info->layout->n_fields,
+				info->extents);
+
+  /* An XID that isn't known yet may be defined by an outstanding reply,
+   * e.g. an atom being interned */
+  if (valid && !translate_xids (replay, info, normal, NULL, big)
+      && !drain (replay))
+    return FALSE;
+
+  copy = xgen_output_buffer_append_raw (replay->buffer, data, len);
+  copy[0] = info->major_opcode;
+  if (valid)
+    translate_xids (replay, info, normal, copy, big);
+
+  push_pending (replay, record->sequence, info,
+		find_expected (replay, record->sequence));
+
+  info->stats.n_requests++;
+  info->stats.n_bytes += len;
+  replay->totals.n_requests++;
+  replay->totals.n_bytes += len;
+
+  if (XGEN_REQUEST_DEF (def)->reply)
+    replay->n_since_reply = 0;
+  else if (++replay->n_since_reply >= replay->batch)
+    return append_sync (replay);
+  return TRUE;
+}
+
+/* Keeps to the captured timing, handling input while waiting */
+static gboolean
+wait_for_timestamp (XGenReplay *replay, guint64 timestamp)
+{
+  gdouble due, now;
+
+  if (!replay->started)
+    {
+      replay->first_timestamp = timestamp;
+      replay->started = TRUE;
+    }
+  if (timestamp <= replay->first_timestamp)
+    return TRUE;
+
+  due = (gdouble)(timestamp - replay->first_timestamp)
+    / replay->units_per_second / replay->speed;
+
+  while ((now = g_timer_elapsed (replay->timer, NULL)) < due)
+    {
+      if (!flush (replay)
+	  || !read_input (replay, (due - now) * 1000 + 1))
+	return FALSE;
+      process_input (replay);
+    }
+  return TRUE;
+}
+
+static gboolean
+replay_record (const XGenCaptureRecord *record,
+	       const char *definition_name,
+	       void *user_data)
+{
+  XGenReplay *replay = user_data;
+  guint max_pending = replay->batch * MAX_OUTSTANDING_BATCHES;
+
+  if (record->direction != XGEN_CLIENT_TO_SERVER)
+    return TRUE;
+
+  if ((replay->speed > 0 && !wait_for_timestamp (replay, record->timestamp))
+      || !send_request (replay, record, definition_name))
+    goto error;
+
+  if (xgen_output_buffer_get_n_requests (replay->buffer) < replay->batch)
+    return TRUE;
+
+  if (!flush (replay) || !read_input (replay, 0))
+    goto error;
+  process_input (replay);
+
+  /* Don't run too far ahead of the server */
+  while (replay->pending->length >= max_pending)
+    {
+      if (!read_input (replay, -1))
+	goto error;
+      process_input (replay);
+    }
+  return TRUE;
+
+error:
+  replay->failed = TRUE;
+  return FALSE;
+}
+
+typedef struct _Scan
+{
+  XGenReplay *replay;
+  GHashTable *bases; /* Resource base -> number of uses */
+} Scan;
+
+/* Counts the resource bases of the XIDs in the fixed part of a request */
+static void
+count_bases (Scan *scan, const XGenCaptureRecord *record, const char *name)
+{
+  XGenReplay *replay = scan->replay;
+  const guint8 *data = XGEN_CAPTURE_RECORD_DATA (record);
+  const XGenDefinition *def =
+    xgen_names_find_definition (replay->names, name, XGEN_REQUEST);
+  RequestInfo *info;
+  guint i;
+
+  if (!def || record->length < 4
+      || _xgen_read_unsigned (data + 2, 2, replay->swap) == 0)
+    return;
+
+  info = get_request_info (replay, XGEN_REQUEST_DEF (def));
+  for (i = 0; i < info->xid_fields->len; i++)
+    {
+      const XGenFieldLayout *field_layout =
+	&info->layout->fields[g_array_index (info->xid_fields, guint, i)];
+      guint32 base;
+      gpointer count;
+
+      if (field_layout->kind != XGEN_LAYOUT_SCALAR
+	  || field_layout->offset == XGEN_LAYOUT_VARIABLE_OFFSET
+	  || field_layout->offset + 4 > record->length)
+	continue;
+
+      base = _xgen_read_unsigned (data + field_layout->offset, 4,
+				  replay->swap) & ~replay->resource_mask;
+      if (!base)
+	continue;
+
+      count = g_hash_table_lookup (scan->bases, GUINT_TO_POINTER (base));
+      g_hash_table_insert (scan->bases, GUINT_TO_POINTER (base),
+			   GUINT_TO_POINTER (GPOINTER_TO_UINT (count) + 1));
+    }
+}
+
+static gboolean
+scan_record (const XGenCaptureRecord *record,
+	     const char *definition_name,
+	     void *user_data)
+{
+  Scan *scan = user_data;
+  XGenReplay *replay = scan->replay;
+  const guint8 *data = XGEN_CAPTURE_RECORD_DATA (record);
+  GArray *expected = replay->expected;
+  Expected entry;
+
+  if (record->direction == XGEN_CLIENT_TO_SERVER)
+    {
+      if (scan->bases && definition_name)
+	count_bases (scan, record, definition_name);
+      return TRUE;
+    }
+
+  replay->has_responses = TRUE;
+  if (record->length < 32 || data[0] > X_REPLY)
+    return TRUE;
+
+  /* Only the first reply to a request is compared */
+  if (expected->len
+      && g_array_index (expected, Expected,
+			expected->len - 1).sequence == record->sequence)
+    return TRUE;
+
+  entry.sequence = record->sequence;
+  entry.record = record;
+  entry.is_error = data[0] == X_ERROR;
+  entry.error = NULL;
+  if (entry.is_error && definition_name)
+    {
+      const XGenDefinition *def =
+	xgen_names_find_definition (replay->names, definition_name,
+				    XGEN_ERROR);
+      entry.error = def ? XGEN_ERROR_DEF (def) : NULL;
+    }
+  g_array_append_val (expected, entry);
+
+  return TRUE;
+}
+
+static void
+find_most_used_base (gpointer key, gpointer value, gpointer user_data)
+{
+  guint32 *best = user_data;
+
+  if (GPOINTER_TO_UINT (value) > best[1])
+    {
+      best[0] = GPOINTER_TO_UINT (key);
+      best[1] = GPOINTER_TO_UINT (value);
+    }
+}
+
+/**
+ * xgen_replay_run:
+ * @replay: A connected replay
+ * @filename: A capture of one client session
+ *
+ * Sends every captured request to the server and waits for it to
+ * process them.
+ *
+ * This function returns FALSE if the capture couldn't be opened or the
+ * connection failed.
+ */
+gboolean
+xgen_replay_run (XGenReplay *replay, const char *filename)
+{
+  XGenCapture *capture;
+  Scan scan;
+
+  g_return_val_if_fail (replay->fd >= 0, FALSE);
+
+  capture = xgen_capture_open (filename);
+  if (!capture)
+    return FALSE;
+
+  /* Gather the captured replies and errors, and the captured client's
+   * resource base unless it was given */
+  scan.replay = replay;
+  scan.bases = replay->captured_base
+    ? NULL : g_hash_table_new (g_direct_hash, g_direct_equal);
+  g_array_set_size (replay->expected, 0);
+  replay->next_expected = 0;
+  replay->has_responses = FALSE;
+  xgen_capture_foreach_record (capture, scan_record, &scan);
+  if (scan.bases)
+    {
+      guint32 best[2] = { 0, 0 };
+
+      g_hash_table_foreach (scan.bases, find_most_used_base, best);
+      replay->captured_base = best[0];
+      g_hash_table_destroy (scan.bases);
+    }
+
+  replay->started = FALSE;
+  replay->failed = FALSE;
+  g_timer_start (replay->timer);
+  xgen_capture_foreach_record (capture, replay_record, replay);
+  if (!replay->failed && !drain (replay))
+    replay->failed = TRUE;
+  replay->totals.elapsed += g_timer_elapsed (replay->timer, NULL);
+
+  xgen_capture_close (capture);
+  g_array_set_size (replay->expected, 0);
+
+  return !replay->failed;
+}
+
+static gint
+compare_stats (gconstpointer a, gconstpointer b)
+{
+  const XGenReplayStats *stats_a = a;
+  const XGenReplayStats *stats_b = b;
+
+  if (stats_a->time != stats_b->time)
+    return stats_a->time > stats_b->time ? -1 : 1;
+  if (stats_a->n_requests != stats_b->n_requests)
+    return stats_a->n_requests > stats_b->n_requests ? -1 : 1;
+  return 0;
+}
+
+static void
+prepend_stats (gpointer key, gpointer value, gpointer user_data)
+{
+  RequestInfo *info = value;
+  GList **report = user_data;
+
+  if (info->stats.n_requests)
+    *report = g_list_prepend (*report, &info->stats);
+}
+
+/**
+ * xgen_replay_get_report:
+ * @replay: A replay
+ *
+ * The time the server spent on each type of request is estimated by
+ * sharing the time between consecutive replies and errors equally among
+ * the requests processed in between, so the throughput of a type of
+ * request is roughly stats->n_requests / stats->time.
+ *
+ * Returns: The XGenReplayStats of each type of request sent, the most
+ *	    time consuming first. The stats belong to the replay; free the
+ *	    list with g_list_free().
+ */
+GList *
+xgen_replay_get_report (XGenReplay *replay)
+{
+  GList *report = NULL;
+
+  g_hash_table_foreach (replay->requests, prepend_stats, &report);
+  return g_list_sort (report, compare_stats);
+}
+
+/**
+ * xgen_replay_get_totals:
+ * @replay: A replay
+ * @totals: Return location for the totals of every run
+ */
+void
+xgen_replay_get_totals (XGenReplay *replay, XGenReplayTotals *totals)
+{
+  *totals = replay->totals;
+}
+
+void
+xgen_replay_free (XGenReplay *replay)
+{
+  Pending *pending;
+
+  while ((pending = g_queue_pop_head (replay->pending)))
+    g_free (pending);
+  g_queue_free (replay->pending);
+
+  if (replay->fd >= 0)
+    {
+      close (replay->fd);
+      xgen_output_buffer_free (replay->buffer);
+      xgen_encoder_free (replay->encoder);
+      xgen_dispatch_free (replay->dispatch);
+    }
+
+  g_hash_table_destroy (replay->xids);
+  g_hash_table_destroy (replay->requests);
+  g_array_free (replay->expected, TRUE);
+  g_timer_destroy (replay->timer);
+  xgen_names_free (replay->names);
+  g_free (replay->sync_values);
+  g_free (replay->in);
+  g_free (replay->scratch);
+  g_free (replay);
+}
@@ -0,0 +1,90 @@
+#ifndef _XGEN_REPLAY_H_
+#define _XGEN_REPLAY_H_
+
+#include <xgen.h>
+#include <xgen-capture.h>
+
+#include <glib.h>
+
+/**
+ * Replays the requests of a captured client session against a local X
+ * server, such as Xvfb, to benchmark it with a real workload.
+ *
+ * Requests are sent as captured except that:
+ * - extension requests get the major opcodes the local server assigned;
+ * - XIDs in the captured client's resource range are moved into the
+ *   range the local server gave the replay;
+ * - other XIDs, such as atoms, are translated once a reply has shown
+ *   what they are on the local server, see xgen_replay_map_xid().
+ * Requests are pipelined. A request using an XID that isn't known yet
+ * first waits for the outstanding replies, since one of them may define
+ * it. Values within valueparams and structs aren't translated.
+ *
+ * The replies and errors of the local server are matched with the
+ * captured ones by sequence number, although the local sequence numbers
+ * differ, and compared field by field using their layouts. Padding,
+ * sequence numbers and lengths are ignored.
+ *
+ * Requests whose definition is unknown or whose extension the local
+ * server lacks are skipped.
+ */
+typedef struct _XGenReplay XGenReplay;
+
+typedef struct _XGenReplayStats
+{
+  const XGenRequest *request;
+  guint64 n_requests;
+  guint64 n_bytes;
+  guint64 n_replies;
+  guint64 n_errors;
+  guint64 n_differences; /* Requests answered differently than captured */
+  gdouble time;		 /* Estimated seconds the server spent on the
+			    requests; see xgen_replay_get_report() */
+} XGenReplayStats;
+
+typedef struct _XGenReplayTotals
+{
+  guint64 n_requests;
+  guint64 n_bytes;
+  guint64 n_skipped;
+  guint64 n_syncs;	 /* Requests added to track progress */
+  guint64 n_replies;
+  guint64 n_errors;
+  guint64 n_events;
+  guint64 n_differences;
+  gdouble elapsed;	 /* Seconds from the first request sent until the
+			    last was answered */
+} XGenReplayTotals;
+
+/**
+ * Called for each difference from the capture. @sequence is the captured
+ * sequence number of the request and @description says what differs,
+ * e.g. "width: 640, captured 800".
+ */
+typedef void (*XGenReplayDifferenceFunc) (const XGenRequest *request,
+					  guint64 sequence,
+					  const char *description,
+					  void *user_data);
+
+XGenReplay *xgen_replay_new (const XGenState *state,
+			     XGenByteOrder byte_order);
+void xgen_replay_set_speed (XGenReplay *replay,
+			    gdouble speed,
+			    guint64 units_per_second);
+void xgen_replay_set_batch (XGenReplay *replay, guint batch);
+void xgen_replay_set_resource_base (XGenReplay *replay, guint32 base);
+void xgen_replay_map_xid (XGenReplay *replay, guint32 captured, guint32 local);
+gboolean xgen_replay_ignore_field (XGenReplay *replay,
+				   const char *request,
+				   const char *field);
+void xgen_replay_set_difference_func (XGenReplay *replay,
+				      XGenReplayDifferenceFunc func,
+				      void *user_data);
+gboolean xgen_replay_connect (XGenReplay *replay, const char *display);
+guint32 xgen_replay_get_root (XGenReplay *replay);
+gboolean xgen_replay_run (XGenReplay *replay, const char *filename);
+GList *xgen_replay_get_report (XGenReplay *replay);
+void xgen_replay_get_totals (XGenReplay *replay, XGenReplayTotals *totals);
+void xgen_replay_free (XGenReplay *replay);
+
+#endif /* _XGEN_REPLAY_H_ */
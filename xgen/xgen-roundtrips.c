@@ -0,0 +1,685 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <xgen.h>
+#include <xgen-layout.h>
+#include <xgen-capture.h>
+#include <xgen-roundtrips.h>
+#include "xgen-private.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+#define X_ERROR 0
+#define X_REPLY 1
+
+/* The request fields that identify a call, with padding left out */
+typedef struct _CallKey
+{
+  const XGenDefinition *request;
+  guint			len;
+  guint8		data[1];
+} CallKey;
+
+/* The last reply to a call */
+typedef struct _CallReply
+{
+  CallKey *key;
+  guint64  index;     /* Of the reply record */
+  gsize	   len;
+  guint8  *data;
+} CallReply;
+
+/* A request waiting for its reply */
+typedef struct _Call
+{
+  guint64	       sequence;
+  guint64	       timestamp;
+  XGenRoundTripStats  *stats;
+  CallKey	      *key;
+  guint32	       window;	  /* The window the request is about, or 0 */
+} Call;
+
+/* The latest value of an event field for a window */
+typedef struct _EventValue
+{
+  guint32 value;
+  guint	  size;
+  guint64 index;  /* Of the event record */
+} EventValue;
+
+typedef enum _Comparison
+{
+  REPLY_IDENTICAL,
+  REPLY_PREDICTABLE,
+  REPLY_DIFFERENT
+} Comparison;
+
+struct _XGenRoundTripAnalyzer
+{
+  const XGenState *state;
+  XGenByteOrder	   byte_order;
+  gboolean	   swap;
+
+  /* Definitions by the names used in captures */
+  GHashTable	  *requests;
+  GHashTable	  *events;
+
+  GHashTable	  *stats;	 /* XGenRequest -> XGenRoundTripStats */
+  GHashTable	  *replies;	 /* CallKey -> CallReply */
+  GHashTable	  *windows;	 /* window -> field name -> EventValue */
+  GQueue	  *calls;	 /* Waiting for replies, in sequence order */
+
+  guint64	   n_records;
+  guint64	   last_request;	/* Sequence number */
+  gboolean	   last_call_blocked;
+  guint		   chain;
+  guint		   longest_chain;
+};
+
+static guint
+call_key_hash (gconstpointer key)
+{
+  const CallKey *call_key = key;
+  guint hash = GPOINTER_TO_UINT (call_key->request);
+  guint i;
+
+  for (i = 0; i < call_key->len; i++)
+    hash = hash * 31 + call_key->data[i];
+  return hash;
+}
+
+static gboolean
+call_key_equal (gconstpointer a, gconstpointer b)
+{
+  const CallKey *key_a = a;
+  const CallKey *key_b = b;
+
+  return key_a->request == key_b->request
+    && key_a->len == key_b->len
+    && memcmp (key_a->data, key_b->data, key_a->len) == 0;
+}
+
+static void
+call_reply_free (CallReply *reply)
+{
+  g_free (reply->key);
+  g_free (reply->data);
+  g_free (reply);
+}
+
+/**
+ * xgen_round_trip_analyzer_new:
+ * @state: The parsed protocol state, describing every extension in the
+ *	   captures to analyze
+ * @byte_order: The byte order of the captured connections
+ *
+ * Creates an analyzer without any records.
+ */
+XGenRoundTripAnalyzer *
+xgen_round_trip_analyzer_new (const XGenState *state,
+			      XGenByteOrder byte_order)
+{
+  XGenRoundTripAnalyzer *analyzer = g_new0 (XGenRoundTripAnalyzer, 1);
+
+  analyzer->state = state;
+  analyzer->byte_order = byte_order;
+  analyzer->swap = _XGEN_NEEDS_SWAP (byte_order);
+
+  analyzer->requests = g_hash_table_new_full (g_str_hash, g_str_equal,
+					      g_free, NULL);
+  analyzer->events = g_hash_table_new_full (g_str_hash, g_str_equal,
+					    g_free, NULL);
+  analyzer->stats = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					   NULL, g_free);
+  analyzer->replies =
+    g_hash_table_new_full (call_key_hash, call_key_equal, NULL,
+			   (GDestroyNotify)call_reply_free);
+  analyzer->windows =
+    g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+			   (GDestroyNotify)g_hash_table_destroy);
+  analyzer->calls = g_queue_new ();
+
+  return analyzer;
+}
+
+/* Finds a definition by its capture name, caching the lookups */
+static const XGenDefinition *
+find_definition (XGenRoundTripAnalyzer *analyzer,
+		 GHashTable *cache,
+		 const char *name,
+		 XGenType type)
+{
+  gpointer key, value;
+  const XGenDefinition *def;
+
+  if (g_hash_table_lookup_extended (cache, name, &key, &value))
+    return value;
+
+  def = xgen_state_find_definition (analyzer->state, name, type);
+  g_hash_table_insert (cache, g_strdup (name), (gpointer)def);
+  return def;
+}
+
+static gboolean
+is_ignored_field (const XGenFieldLayout *field_layout)
+{
+  const char *name = field_layout->field->name;
+
+  return strcmp (name, "pad") == 0 || strcmp (name, "sequence") == 0;
+}
+
+/* Returns the extents of every field of a message, or NULL if it doesn't
+ * fit the layout. Free with g_free(). */
+static XGenFieldExtent *
+get_extents (XGenRoundTripAnalyzer *analyzer,
+	     const XGenLayout *layout,
+	     const guint8 *data,
+	     gsize len)
+{
+  XGenFieldExtent *extents = g_new (XGenFieldExtent, layout->n_fields);
+
+  if (!xgen_layout_get_extents (layout, data, len, analyzer->byte_order,
+				layout->n_fields, extents))
+    {
+      g_free (extents);
+      return NULL;
+    }
+  return extents;
+}
+
+static CallKey *
+make_call_key (XGenRoundTripAnalyzer *analyzer,
+	       const XGenDefinition *request,
+	       const guint8 *data,
+	       gsize len)
+{
+  const XGenLayout *layout = xgen_definition_get_layout (request);
+  XGenFieldExtent *extents = get_extents (analyzer, layout, data, len);
+  GByteArray *bytes;
+  CallKey *key;
+  guint i;
+
+  if (!extents)
+    return NULL;
+
+  bytes = g_byte_array_new ();
+  for (i = 0; i < layout->n_fields; i++)
+    if (!is_ignored_field (&layout->fields[i]))
+      g_byte_array_append (bytes, data + extents[i].offset, extents[i].size);
+  g_free (extents);
+
+  key = g_malloc (sizeof (CallKey) + bytes->len);
+  key->request = request;
+  key->len = bytes->len;
+  memcpy (key->data, bytes->data, bytes->len);
+  g_byte_array_free (bytes, TRUE);
+
+  return key;
+}
+
+/* Reads a scalar field of up to 4 bytes, or returns FALSE */
+static gboolean
+read_scalar (XGenRoundTripAnalyzer *analyzer,
+	     const XGenFieldLayout *field_layout,
+	     const XGenFieldExtent *extent,
+	     const guint8 *data,
+	     guint32 *value)
+{
+  if (field_layout->kind != XGEN_LAYOUT_SCALAR
+      || (extent->size != 1 && extent->size != 2 && extent->size != 4))
+    return FALSE;
+
+  *value = _xgen_read_unsigned (data + extent->offset, extent->size,
+				analyzer->swap);
+  return TRUE;
+}
+
+/* Returns the window a request or event is about, or 0 */
+static guint32
+find_window (XGenRoundTripAnalyzer *analyzer,
+	     const XGenLayout *layout,
+	     const XGenFieldExtent *extents,
+	     const guint8 *data)
+{
+  static const char *names[] = { "window", "drawable" };
+  guint32 window;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (names); i++)
+    {
+      gint field = xgen_layout_find_field (layout, names[i]);
+
+      if (field >= 0
+	  && read_scalar (analyzer, &layout->fields[field], &extents[field],
+			  data, &window))
+	return window;
+    }
+
+  return 0;
+}
+
+static XGenRoundTripStats *
+get_stats (XGenRoundTripAnalyzer *analyzer, const XGenRequest *request)
+{
+  XGenRoundTripStats *stats = g_hash_table_lookup (analyzer->stats, request);
+
+  if (!stats)
+    {
+      stats = g_new0 (XGenRoundTripStats, 1);
+      stats->request = request;
+      g_hash_table_insert (analyzer->stats, (gpointer)request, stats);
+    }
+  return stats;
+}
+
+static void
+add_request (XGenRoundTripAnalyzer *analyzer,
+	     const XGenCaptureRecord *record,
+	     const char *definition_name)
+{
+  const XGenDefinition *def;
+  const XGenLayout *layout;
+  XGenFieldExtent *extents;
+  const guint8 *data = XGEN_CAPTURE_RECORD_DATA (record);
+  Call *call;
+
+  analyzer->last_request = record->sequence;
+
+  if (!definition_name)
+    return;
+  def = find_definition (analyzer, analyzer->requests, definition_name,
+			 XGEN_REQUEST);
+  if (!def || !XGEN_REQUEST_DEF (def)->reply)
+    return;
+
+  layout = xgen_definition_get_layout (def);
+  extents = get_extents (analyzer, layout, data, record->length);
+  if (!extents)
+    return;
+
+  call = g_new0 (Call, 1);
+  call->sequence = record->sequence;
+  call->timestamp = record->timestamp;
+  call->stats = get_stats (analyzer, XGEN_REQUEST_DEF (def));
+  call->key = make_call_key (analyzer, def, data, record->length);
+  call->window = find_window (analyzer, layout, extents, data);
+  g_queue_push_tail (analyzer->calls, call);
+
+  g_free (extents);
+}
+
+/* Remembers the latest value of each scalar field of an event for the
+ * window it's about */
+static void
+add_event (XGenRoundTripAnalyzer *analyzer,
+	   const XGenCaptureRecord *record,
+	   const char *definition_name)
+{
+  const guint8 *data = XGEN_CAPTURE_RECORD_DATA (record);
+  const XGenDefinition *def;
+  const XGenLayout *layout;
+  XGenFieldExtent *extents;
+  GHashTable *values;
+  guint32 window;
+  guint i;
+
+  if (!definition_name)
+    return;
+  def = find_definition (analyzer, analyzer->events, definition_name,
+			 XGEN_EVENT);
+  if (!def)
+    return;
+
+  layout = xgen_definition_get_layout (def);
+  extents = get_extents (analyzer, layout, data, record->length);
+  if (!extents)
+    return;
+
+  window = find_window (analyzer, layout, extents, data);
+  if (!window)
+    {
+      g_free (extents);
+      return;
+    }
+
+  values = g_hash_table_lookup (analyzer->windows, GUINT_TO_POINTER (window));
+  if (!values)
+    {
+      values = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+      g_hash_table_insert (analyzer->windows, GUINT_TO_POINTER (window),
+			   values);
+    }
+
+  for (i = 0; i < layout->n_fields; i++)
+    {
+      const XGenFieldLayout *field_layout = &layout->fields[i];
+      EventValue *value;
+      guint32 scalar;
+
+      if (is_ignored_field (field_layout)
+	  || !read_scalar (analyzer, field_layout, &extents[i], data, &scalar))
+	continue;
+
+      value = g_hash_table_lookup (values, field_layout->field->name);
+      if (!value)
+	{
+	  value = g_new (EventValue, 1);
+	  g_hash_table_insert (values, field_layout->field->name, value);
+	}
+      value->value = scalar;
+      value->size = extents[i].size;
+      value->index = analyzer->n_records;
+    }
+
+  g_free (extents);
+}
+
+/* Compares a reply with the previous reply to the same call. Differences
+ * are predictable if events about the call's window reported the new
+ * values since the previous reply. */
+static Comparison
+compare_replies (XGenRoundTripAnalyzer *analyzer,
+		 const XGenLayout *layout,
+		 const CallReply *previous,
+		 const guint8 *data,
+		 gsize len,
+		 guint32 window)
+{
+  XGenFieldExtent *extents;
+  XGenFieldExtent *previous_extents;
+  GHashTable *values = NULL;
+  Comparison comparison = REPLY_IDENTICAL;
+  guint i;
+
+  extents = get_extents (analyzer, layout, data, len);
+  previous_extents =
+    get_extents (analyzer, layout, previous->data, previous->len);
+  if (!extents || !previous_extents)
+    {
+      g_free (extents);
+      g_free (previous_extents);
+      return REPLY_DIFFERENT;
+    }
+
+  if (window)
+    values = g_hash_table_lookup (analyzer->windows,
+				  GUINT_TO_POINTER (window));
+
+  for (i = 0; i < layout->n_fields && comparison != REPLY_DIFFERENT; i++)
+    {
+      const XGenFieldLayout *field_layout = &layout->fields[i];
+      const EventValue *value;
+      guint32 scalar;
+
+      if (is_ignored_field (field_layout))
+	continue;
+
+      if (extents[i].size == previous_extents[i].size
+	  && memcmp (data + extents[i].offset,
+		     previous->data + previous_extents[i].offset,
+		     extents[i].size) == 0)
+	continue;
+
+      if (values
+	  && read_scalar (analyzer, field_layout, &extents[i], data, &scalar)
+	  && (value = g_hash_table_lookup (values, field_layout->field->name))
+	  && value->index > previous->index
+	  && value->size == extents[i].size
+	  && value->value == scalar)
+	comparison = REPLY_PREDICTABLE;
+      else
+	comparison = REPLY_DIFFERENT;
+    }
+
+  g_free (extents);
+  g_free (previous_extents);
+  return comparison;
+}
+
+/* Returns the call a reply or error is for, removing it and any calls
+ * before it that were never answered */
+static Call *
+pop_call (XGenRoundTripAnalyzer *analyzer, guint64 sequence)
+{
+  Call *call;
+
+  while ((call = g_queue_peek_head (analyzer->calls))
+	 && call->sequence <= sequence)
+    {
+      g_queue_pop_head (analyzer->calls);
+      if (call->sequence == sequence)
+	return call;
+      g_free (call->key);
+      g_free (call);
+    }
+
+  return NULL;
+}
+
+static void
+add_reply (XGenRoundTripAnalyzer *analyzer,
+	   const XGenCaptureRecord *record)
+{
+  const guint8 *data = XGEN_CAPTURE_RECORD_DATA (record);
+  Call *call = pop_call (analyzer, record->sequence);
+  XGenRoundTripStats *stats;
+  const XGenLayout *layout;
+  CallReply *previous = NULL;
+  Comparison comparison = REPLY_DIFFERENT;
+  guint64 latency;
+  gboolean blocking;
+
+  /* Further replies to the same request are ignored */
+  if (!call)
+    return;
+
+  stats = call->stats;
+  layout = xgen_definition_get_layout ((XGenDefinition *)
+				       stats->request->reply);
+  latency = record->timestamp > call->timestamp
+    ? record->timestamp - call->timestamp : 0;
+
+  /* The client sent nothing while it waited for the reply */
+  blocking = analyzer->last_request == call->sequence;
+
+  stats->n_calls++;
+  stats->total_latency += latency;
+  if (blocking)
+    {
+      stats->n_blocking++;
+      stats->blocking_latency += latency;
+
+      analyzer->chain = analyzer->last_call_blocked ? analyzer->chain + 1 : 1;
+      analyzer->longest_chain = MAX (analyzer->longest_chain,
+				     analyzer->chain);
+      stats->longest_chain = MAX (stats->longest_chain, analyzer->chain);
+    }
+  analyzer->last_call_blocked = blocking;
+
+  if (call->key)
+    previous = g_hash_table_lookup (analyzer->replies, call->key);
+  if (previous)
+    comparison = compare_replies (analyzer, layout, previous, data,
+				  record->length, call->window);
+
+  if (comparison == REPLY_IDENTICAL)
+    stats->n_repeated++;
+  else if (comparison == REPLY_PREDICTABLE)
+    stats->n_predictable++;
+  if (blocking && comparison != REPLY_DIFFERENT)
+    stats->saved_latency += latency;
+
+  if (call->key)
+    {
+      if (!previous)
+	{
+	  previous = g_new0 (CallReply, 1);
+	  previous->key = call->key;
+	  g_hash_table_insert (analyzer->replies, call->key, previous);
+	}
+      else
+	g_free (call->key);
+
+      g_free (previous->data);
+      previous->data = g_memdup (data, record->length);
+      previous->len = record->length;
+      previous->index = analyzer->n_records;
+    }
+  g_free (call);
+}
+
+/**
+ * xgen_round_trip_analyzer_add_record:
+ * @analyzer: A round trip analyzer
+ * @record: A captured message
+ * @definition_name: The "header:Name" of the message's definition, or
+ *		     NULL if unknown
+ *
+ * Adds the next message of a captured session. The records of one
+ * session must be added in capture order.
+ */
+void
+xgen_round_trip_analyzer_add_record (XGenRoundTripAnalyzer *analyzer,
+				     const XGenCaptureRecord *record,
+				     const char *definition_name)
+{
+  const guint8 *data = XGEN_CAPTURE_RECORD_DATA (record);
+
+  analyzer->n_records++;
+
+  if (record->direction == XGEN_CLIENT_TO_SERVER)
+    add_request (analyzer, record, definition_name);
+  else if (record->length < 32)
+    return;
+  else if (data[0] == X_REPLY)
+    add_reply (analyzer, record);
+  else if (data[0] == X_ERROR)
+    {
+      Call *call = pop_call (analyzer, record->sequence);
+
+      if (call)
+	{
+	  g_free (call->key);
+	  g_free (call);
+	}
+    }
+  else
+    add_event (analyzer, record, definition_name);
+}
+
+static gboolean
+add_capture_record (const XGenCaptureRecord *record,
+		    const char *definition_name,
+		    void *user_data)
+{
+  xgen_round_trip_analyzer_add_record (user_data, record, definition_name);
+  return TRUE;
+}
+
+/**
+ * xgen_round_trip_analyzer_add_capture:
+ * @analyzer: A round trip analyzer
+ * @filename: A capture of one session
+ *
+ * Adds every record of a capture.
+ *
+ * This function returns FALSE if the capture couldn't be opened.
+ */
+gboolean
+xgen_round_trip_analyzer_add_capture (XGenRoundTripAnalyzer *analyzer,
+				      const char *filename)
+{
+  XGenCapture *capture = xgen_capture_open (filename);
+
+  if (!capture)
+    return FALSE;
+
+  xgen_capture_foreach_record (capture, add_capture_record, analyzer);
+  xgen_capture_close (capture);
+
+  return TRUE;
+}
+
+static gint
+compare_stats (gconstpointer a, gconstpointer b)
+{
+  const XGenRoundTripStats *stats_a = a;
+  const XGenRoundTripStats *stats_b = b;
+
+  if (stats_a->saved_latency != stats_b->saved_latency)
+    return stats_a->saved_latency > stats_b->saved_latency ? -1 : 1;
+  if (stats_a->blocking_latency != stats_b->blocking_latency)
+    return stats_a->blocking_latency > stats_b->blocking_latency ? -1 : 1;
+  return 0;
+}
+
+static void
+prepend_stats (gpointer key, gpointer value, gpointer user_data)
+{
+  GList **report = user_data;
+
+  *report = g_list_prepend (*report, value);
+}
+
+/**
+ * xgen_round_trip_analyzer_get_report:
+ * @analyzer: A round trip analyzer
+ *
+ * Returns: The XGenRoundTripStats of each request with a reply seen, the
+ *	    largest estimated saving first. The stats belong to the
+ *	    analyzer; free the list with g_list_free().
+ */
+GList *
+xgen_round_trip_analyzer_get_report (XGenRoundTripAnalyzer *analyzer)
+{
+  GList *report = NULL;
+
+  g_hash_table_foreach (analyzer->stats, prepend_stats, &report);
+  return g_list_sort (report, compare_stats);
+}
+
+/**
+ * xgen_round_trip_analyzer_get_longest_chain:
+ * @analyzer: A round trip analyzer
+ *
+ * Returns: The most blocking calls seen in a row
+ */
+guint
+xgen_round_trip_analyzer_get_longest_chain (XGenRoundTripAnalyzer *analyzer)
+{
+  return analyzer->longest_chain;
+}
+
+void
+xgen_round_trip_analyzer_free (XGenRoundTripAnalyzer *analyzer)
+{
+  Call *call;
+
+  while ((call = g_queue_pop_head (analyzer->calls)))
+    {
+      g_free (call->key);
+      g_free (call);
+    }
+  g_queue_free (analyzer->calls);
+
+  g_hash_table_destroy (analyzer->requests);
+  g_hash_table_destroy (analyzer->events);
+  g_hash_table_destroy (analyzer->stats);
+  g_hash_table_destroy (analyzer->replies);
+  g_hash_table_destroy (analyzer->windows);
+  g_free (analyzer);
+}
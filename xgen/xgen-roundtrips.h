@@ -0,0 +1,55 @@
+#ifndef _XGEN_ROUNDTRIPS_H_
+#define _XGEN_ROUNDTRIPS_H_
+
+#include <xgen.h>
+#include <xgen-capture.h>
+
+#include <glib.h>
+
+/**
+ * Finds round trips a client could have avoided in a captured session.
+ *
+ * Each request with a reply is a call. A call is blocking if the client
+ * sent nothing else until the reply arrived, so that it waited a full
+ * round trip; consecutive blocking calls form a synchronous chain. A call
+ * is repeated if an earlier call had identical request fields and got a
+ * reply with identical fields. It is predictable if the reply only
+ * differs from the earlier one in fields that events about the same
+ * window reported in between, e.g. GetGeometry after ConfigureNotify.
+ *
+ * Fields are compared using the request and reply layouts, ignoring
+ * padding and sequence numbers.
+ *
+ * Latencies are in the units of the capture timestamps.
+ */
+typedef struct _XGenRoundTripStats
+{
+  const XGenRequest *request;
+  guint64 n_calls;
+  guint64 n_blocking;
+  guint64 n_repeated;
+  guint64 n_predictable;
+  guint64 total_latency;    /* Of all the calls */
+  guint64 blocking_latency; /* Time the client spent waiting on replies */
+  guint64 saved_latency;    /* Estimated time saved by answering blocking
+			       repeated and predictable calls from a
+			       client side cache */
+  guint	  longest_chain;    /* Of the synchronous chains including this
+			       request */
+} XGenRoundTripStats;
+
+typedef struct _XGenRoundTripAnalyzer XGenRoundTripAnalyzer;
+
+XGenRoundTripAnalyzer *xgen_round_trip_analyzer_new (const XGenState *state,
+						     XGenByteOrder byte_order);
+void xgen_round_trip_analyzer_add_record (XGenRoundTripAnalyzer *analyzer,
+					  const XGenCaptureRecord *record,
+					  const char *definition_name);
+gboolean xgen_round_trip_analyzer_add_capture (XGenRoundTripAnalyzer *analyzer,
+					       const char *filename);
+GList *xgen_round_trip_analyzer_get_report (XGenRoundTripAnalyzer *analyzer);
+guint
+xgen_round_trip_analyzer_get_longest_chain (XGenRoundTripAnalyzer *analyzer);
+void xgen_round_trip_analyzer_free (XGenRoundTripAnalyzer *analyzer);
+
+#endif /* _XGEN_ROUNDTRIPS_H_ */
@@ -0,0 +1,569 @@
+/* XGen - XCB protocol specs parser and toolkit
+ *
+ * Copyright (C) 2008 Robert Bragg
+ *
+ * This package is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This package is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <xgen.h>
+#include <xgen-watch.h>
+#include "xgen-private.h"
+
+#include <libxml/parser.h>
+
+#include <glib.h>
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#define READ_SIZE 4096
+
+typedef struct _WatchedFile
+{
+  char *path;
+  char *header;
+} WatchedFile;
+
+typedef struct _WatchSource
+{
+  GSource      source;
+  GPollFD      poll_fd;
+  XGenWatcher *watcher;
+} WatchSource;
+
+struct _XGenWatcher
+{
+  XGenState	*state;
+
+  /* The WatchedFiles in the order given, and indexed by path */
+  GList		*files;
+  GHashTable	*files_by_path;
+
+  /* The watched directories, by inotify watch descriptor. Directories
+   * are watched rather than the files since most editors save by
+   * renaming a new file over the old one. */
+  GHashTable	*directories;
+  int		 fd;
+
+  XGenWatchFunc	 func;
+  void		*user_data;
+
+  GSource	*source;
+};
+
+static char *
+resolve_path (const char *filename)
+{
+  /* As in xgen_open_xcb_proto_file */
+  if (filename[0] != '/')
+    return g_strdup_printf ("%s/%s", XCBPROTO_XCBINCLUDEDIR, filename);
+  return g_strdup (filename);
+}
+
+static char *
+read_header (const char *path)
+{
+  xmlDoc *doc = xmlParseFile (path);
+  xmlNode *root;
+  char *header = NULL;
+
+  if (!doc)
+    return NULL;
+
+  root = xmlDocGetRootElement (doc);
+  if (root)
+    {
+      xmlChar *prop = xmlGetProp (root, (const xmlChar *)"header");
+
+      if (prop)
+	{
+	  header = g_strdup ((char *)prop);
+	  xmlFree (prop);
+	}
+    }
+
+  xmlFreeDoc (doc);
+  return header;
+}
+
+/**
+ * xgen_watcher_new:
+ * @files: A list of xcb xml protocol descriptions
+ * @func: The function to call after each update, or NULL
+ * @user_data: The data to pass to @func
+ *
+ * Parses @files like xgen_parse_xcb_proto_files(), calling the current
+ * handlers as usual, and starts watching them for changes. Nothing is
+ * parsed again until the watcher is attached to a main context.
+ *
+ * Returns: A new watcher, or NULL if the files couldn't be parsed or
+ *	    watched
+ */
+XGenWatcher *
+xgen_watcher_new (GList *files, XGenWatchFunc func, void *user_data)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+  XGenWatcher *watcher;
+  XGenState *state;
+  GList *tmp;
+  int fd;
+
+  fd = inotify_init ();
+  if (fd < 0)
+    {
+      g_warning ("Failed to initialize inotify: %s", g_strerror (errno));
+      return NULL;
+    }
+  fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+  fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+  state = xgen_parse_xcb_proto_files (files);
+  if (!state)
+    {
+      close (fd);
+      return NULL;
+    }
+
+  watcher = g_new0 (XGenWatcher, 1);
+  watcher->state = state;
+  watcher->files_by_path = g_hash_table_new (g_str_hash, g_str_equal);
+  watcher->directories = g_hash_table_new_full (g_direct_hash,
+						g_direct_equal,
+						NULL,
+						g_free);
+  watcher->fd = fd;
+  watcher->func = func;
+  watcher->user_data = user_data;
+
+  for (tmp = files; tmp != NULL; tmp = tmp->next)
+    {
+      char *path = resolve_path (tmp->data);
+      char *directory = g_path_get_dirname (path);
+      char *basename = g_path_get_basename (path);
+      char *header = read_header (path);
+      WatchedFile *file;
+      int wd;
+
+      g_free (path);
+
+      if (!header)
+	{
+	  g_warning ("Failed to read the extension header of %s",
+		     (char *)tmp->data);
+	  g_free (directory);
+	  g_free (basename);
+	  xgen_watcher_free (watcher);
+	  return NULL;
+	}
+
+      file = g_new0 (WatchedFile, 1);
+      file->path = g_build_filename (directory, basename, NULL);
+      file->header = header;
+      g_free (basename);
+
+      watcher->files = g_list_prepend (watcher->files, file);
+      g_hash_table_insert (watcher->files_by_path, file->path, file);
+
+      /* Watching the same directory again gives the same descriptor */
+      wd = inotify_add_watch (fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+      if (wd < 0)
+	{
+	  g_warning ("Failed to watch %s: %s", directory, g_strerror (errno));
+	  g_free (directory);
+	  continue;
+	}
+      g_hash_table_replace (watcher->directories, GINT_TO_POINTER (wd),
+			    directory);
+    }
+  watcher->files = g_list_reverse (watcher->files);
+
+  return watcher;
+#else
+  g_warning ("Watching protocol files isn't supported on this platform");
+  return NULL;
+#endif
+}
+
+/**
+ * xgen_watcher_get_state:
+ * @watcher: A watcher
+ *
+ * The state is replaced whenever the files change, so the returned
+ * pointer is only valid until the next update.
+ *
+ * Returns: The current state
+ */
+const XGenState *
+xgen_watcher_get_state (XGenWatcher *watcher)
+{
+  return watcher->state;
+}
+
+/* Reads the pending inotify events and adds the headers of the changed
+ * files to @changed_headers */
+static void
+read_events (XGenWatcher *watcher, GHashTable *changed_headers)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+  /* NB: guint32 to keep the events aligned */
+  guint32 buffer[READ_SIZE / sizeof (guint32)];
+
+  for (;;)
+    {
+      ssize_t len = read (watcher->fd, buffer, sizeof (buffer));
+      ssize_t offset;
+
+      if (len < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  if (errno != EAGAIN)
+	    g_warning ("Failed to read inotify events: %s",
+		       g_strerror (errno));
+	  return;
+	}
+      if (len == 0)
+	return;
+
+      for (offset = 0; offset < len; )
+	{
+	  struct inotify_event *event =
+	    (struct inotify_event *)((guint8 *)buffer + offset);
+	  const char *directory;
+
+	  offset += sizeof (struct inotify_event) + event->len;
+
+	  if (event->mask & IN_Q_OVERFLOW)
+	    {
+	      GList *tmp;
+
+	      /* Events were lost so any file may have changed */
+	      for (tmp = watcher->files; tmp != NULL; tmp = tmp->next)
+		{
+		  WatchedFile *file = tmp->data;
+		  g_hash_table_insert (changed_headers, file->header,
+				       file->header);
+		}
+	      continue;
+	    }
+
+	  directory = g_hash_table_lookup (watcher->directories,
+					   GINT_TO_POINTER (event->wd));
+	  if (directory && event->len)
+	    {
+	      char *path = g_build_filename (directory, event->name, NULL);
+	      WatchedFile *file =
+		g_hash_table_lookup (watcher->files_by_path, path);
+
+	      if (file)
+		g_hash_table_insert (changed_headers, file->header,
+				     file->header);
+	      g_free (path);
+	    }
+	}
+    }
+#endif
+}
+
+static guint
+definition_hash (gconstpointer key)
+{
+  const XGenDefinition *def = key;
+
+  /* Requests and their replies share a name */
+  return g_str_hash (def->name) ^ def->type;
+}
+
+static gboolean
+definition_equal (gconstpointer a, gconstpointer b)
+{
+  const XGenDefinition *def_a = a;
+  const XGenDefinition *def_b = b;
+
+  return def_a->type == def_b->type && strcmp (def_a->name, def_b->name) == 0;
+}
+
+/* Appends the new and changed definitions of @extension to @changed,
+ * after those of the reparsed extensions it imports so that they are
+ * notified in the same order as by a full parse */
+static void
+find_changed_definitions (XGenExtension *extension,
+			  const XGenState *old_state,
+			  GHashTable *reparsed,
+			  GHashTable *done,
+			  GList **changed)
+{
+  XGenExtension *old_extension;
+  GHashTable *old_definitions;
+  GList *tmp;
+
+  if (g_hash_table_lookup (done, extension))
+    return;
+  g_hash_table_insert (done, extension, extension);
+
+  for (tmp = extension->imports; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *import = tmp->data;
+
+      if (g_hash_table_lookup (reparsed, import->header))
+	find_changed_definitions (import, old_state, reparsed, done, changed);
+    }
+
+  old_definitions = g_hash_table_new (definition_hash, definition_equal);
+  old_extension = xgen_state_find_extension (old_state, extension->header);
+  if (old_extension)
+    for (tmp = old_extension->all_definitions; tmp != NULL; tmp = tmp->next)
+      g_hash_table_insert (old_definitions, tmp->data, tmp->data);
+
+  for (tmp = extension->all_definitions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenDefinition *def = tmp->data;
+      XGenDefinition *old_def = g_hash_table_lookup (old_definitions, def);
+
+      if (!old_def
+	  || (xgen_definition_get_fingerprint (old_def)
+	      != xgen_definition_get_fingerprint (def)))
+	*changed = g_list_prepend (*changed, def);
+    }
+
+  g_hash_table_destroy (old_definitions);
+}
+
+static void
+reparse (XGenWatcher *watcher, GHashTable *reparsed)
+{
+  XGenState *old_state = watcher->state;
+  XGenState *state;
+  XGenState base;
+  XGenEventHandlers *handlers;
+  GHashTable *done;
+  GList *files = NULL;
+  GList *changed = NULL;
+  GList *tmp;
+  gboolean grew;
+
+  /* The extensions importing a changed one have to be parsed again too,
+   * so that they refer to its new definitions */
+  do
+    {
+      grew = FALSE;
+      for (tmp = old_state->extensions; tmp != NULL; tmp = tmp->next)
+	{
+	  XGenExtension *extension = tmp->data;
+	  GList *tmp2;
+
+	  if (g_hash_table_lookup (reparsed, extension->header))
+	    continue;
+
+	  for (tmp2 = extension->imports; tmp2 != NULL; tmp2 = tmp2->next)
+	    {
+	      XGenExtension *import = tmp2->data;
+
+	      if (g_hash_table_lookup (reparsed, import->header))
+		{
+		  g_hash_table_insert (reparsed, extension->header,
+				       extension->header);
+		  grew = TRUE;
+		  break;
+		}
+	    }
+	}
+    }
+  while (grew);
+
+  /* Everything else is shared from a base made of the old state */
+  memset (&base, 0, sizeof (base));
+  base.host_is_little_endian = old_state->host_is_little_endian;
+  for (tmp = old_state->extensions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+
+      if (!g_hash_table_lookup (reparsed, extension->header))
+	base.extensions = g_list_prepend (base.extensions, extension);
+    }
+  base.extensions = g_list_reverse (base.extensions);
+
+  for (tmp = watcher->files; tmp != NULL; tmp = tmp->next)
+    {
+      WatchedFile *file = tmp->data;
+
+      if (g_hash_table_lookup (reparsed, file->header))
+	files = g_list_prepend (files, file->path);
+    }
+  files = g_list_reverse (files);
+
+  /* The handlers are only called for the definitions that changed */
+  handlers = _xgen_get_handlers ();
+  xgen_set_handlers (NULL);
+  state = xgen_parse_xcb_proto_files_with_base (&base, files);
+  xgen_set_handlers (handlers);
+
+  g_list_free (base.extensions);
+  g_list_free (files);
+
+  if (!state)
+    return;
+
+  /* A file that failed to parse is simply missing from the new state */
+  for (tmp = old_state->extensions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+
+      if (!xgen_state_find_extension (state, extension->header))
+	{
+	  g_warning ("Failed to parse %s, keeping the previous definitions",
+		     extension->header);
+	  g_list_free (state->extensions);
+	  g_free (state);
+	  return;
+	}
+    }
+
+  done = g_hash_table_new (g_direct_hash, g_direct_equal);
+  for (tmp = state->extensions;
+       tmp != state->_shared_extensions;
+       tmp = tmp->next)
+    find_changed_definitions (tmp->data, old_state, reparsed, done,
+			      &changed);
+  g_hash_table_destroy (done);
+  changed = g_list_reverse (changed);
+
+  for (tmp = changed; tmp != NULL; tmp = tmp->next)
+    _xgen_notify_definition (tmp->data);
+
+  /* The watcher owns every extension of the new state, so it's handed
+   * out like the result of a full parse */
+  state->_shared_extensions = NULL;
+  watcher->state = state;
+
+  if (watcher->func)
+    watcher->func (watcher, state, changed, watcher->user_data);
+
+  g_list_free (changed);
+
+  /* NB: Parsed definitions can't be freed yet so only the old state
+   * itself is */
+  g_list_free (old_state->extensions);
+  g_free (old_state);
+}
+
+static gboolean
+watch_source_prepare (GSource *source, gint *timeout)
+{
+  *timeout = -1;
+  return FALSE;
+}
+
+static gboolean
+watch_source_check (GSource *source)
+{
+  WatchSource *watch_source = (WatchSource *)source;
+
+  return watch_source->poll_fd.revents != 0;
+}
+
+static gboolean
+watch_source_dispatch (GSource *source,
+		       GSourceFunc callback,
+		       gpointer user_data)
+{
+  XGenWatcher *watcher = ((WatchSource *)source)->watcher;
+  GHashTable *changed_headers = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* An editor saving several files, or one file in several steps, is
+   * dealt with by a single reparse */
+  read_events (watcher, changed_headers);
+  if (g_hash_table_size (changed_headers))
+    reparse (watcher, changed_headers);
+
+  g_hash_table_destroy (changed_headers);
+  return TRUE;
+}
+
+static GSourceFuncs watch_source_funcs = {
+  watch_source_prepare,
+  watch_source_check,
+  watch_source_dispatch,
+  NULL
+};
+
+/**
+ * xgen_watcher_attach:
+ * @watcher: A watcher
+ * @context: The main context to handle changes from, or NULL for the
+ *	     default context
+ *
+ * Starts updating the state whenever one of the files changes.
+ *
+ * Returns: The id of the source within @context
+ */
+guint
+xgen_watcher_attach (XGenWatcher *watcher, GMainContext *context)
+{
+  WatchSource *source;
+
+  g_return_val_if_fail (watcher->source == NULL, 0);
+
+  source = (WatchSource *)g_source_new (&watch_source_funcs,
+					sizeof (WatchSource));
+  source->watcher = watcher;
+  source->poll_fd.fd = watcher->fd;
+  source->poll_fd.events = G_IO_IN | G_IO_HUP | G_IO_ERR;
+  g_source_add_poll (&source->source, &source->poll_fd);
+
+  watcher->source = &source->source;
+  return g_source_attach (watcher->source, context);
+}
+
+/**
+ * xgen_watcher_free:
+ * @watcher: A watcher
+ *
+ * Stops watching the files and frees the watcher. This must not be
+ * called from the watch function.
+ */
+void
+xgen_watcher_free (XGenWatcher *watcher)
+{
+  GList *tmp;
+
+  if (watcher->source)
+    {
+      g_source_destroy (watcher->source);
+      g_source_unref (watcher->source);
+    }
+  close (watcher->fd);
+
+  for (tmp = watcher->files; tmp != NULL; tmp = tmp->next)
+    {
+      WatchedFile *file = tmp->data;
+
+      g_free (file->path);
+      g_free (file->header);
+      g_free (file);
+    }
+  g_list_free (watcher->files);
+  g_hash_table_destroy (watcher->files_by_path);
+  g_hash_table_destroy (watcher->directories);
+
+  g_list_free (watcher->state->extensions);
+  g_free (watcher->state);
+  g_free (watcher);
+}
@@ -0,0 +1,40 @@
+#ifndef _XGEN_WATCH_H_
+#define _XGEN_WATCH_H_
+
+#include <xgen.h>
+
+#include <glib.h>
+
+/**
+ * Keeps a parsed state up to date with its protocol files while they are
+ * being edited, so bindings can be regenerated on every save.
+ *
+ * When a file changes only its extension and the extensions importing
+ * it, directly or indirectly, are parsed again; the others are shared
+ * with the new state. The handlers set with xgen_set_handlers() are then
+ * called only for the definitions whose fingerprint changed or that are
+ * new, in the same order as during a full parse.
+ *
+ * The state is replaced on each change and the previous one is freed
+ * once the watch function returns, but the definitions of both stay
+ * valid for the lifetime of the watcher.
+ */
+typedef struct _XGenWatcher XGenWatcher;
+
+/**
+ * Called after the state has been updated with @changed, the list of
+ * new and changed XGenDefinitions, which is freed when this returns.
+ */
+typedef void (*XGenWatchFunc) (XGenWatcher *watcher,
+			       const XGenState *state,
+			       GList *changed,
+			       void *user_data);
+
+XGenWatcher *xgen_watcher_new (GList *files,
+			       XGenWatchFunc func,
+			       void *user_data);
+const XGenState *xgen_watcher_get_state (XGenWatcher *watcher);
+guint xgen_watcher_attach (XGenWatcher *watcher, GMainContext *context);
+void xgen_watcher_free (XGenWatcher *watcher);
+
+#endif /* _XGEN_WATCH_H_ */
@@ -15,6 +15,7 @@
  */
 
 #include <xgen.h>
+#include "xgen-private.h"
 
 #include <libxml/parser.h>
 
@@ -50,6 +51,9 @@ static const XGenBaseType core_type_definitions[] = {
 
 static XGenEventHandlers *event_handlers = NULL;
 
+static XGenExtension *find_extension (XGenState *state,
+				      gchar *extension_header);
+
 /* Helper function to avoid casting. */
 static char *
 xgen_xml_get_prop (xmlNodePtr node, const char *name)
@@ -223,12 +227,24 @@ xgen_parse_field_elements (XGenState * state,
       else if (strcmp (xgen_xml_get_node_name (cur), "field") == 0)
 	{
 	  char *name = xgen_xml_get_prop (cur, "name");
+	  char *enum_name;
 	  field->name = strdup (name);
 	  field->definition =
 	    xgen_find_type (state,
 			    extension,
 			    xgen_xml_get_prop (cur, "type"));
 	  xmlFree (name);
+
+	  /* Enums may be defined after they are referenced so they are
+	   * resolved once everything has been parsed */
+	  if ((enum_name = xgen_xml_get_prop (cur, "enum"))
+	      || (enum_name = xgen_xml_get_prop (cur, "altenum")))
+	    field->_enum_name = enum_name;
+	  else if ((enum_name = xgen_xml_get_prop (cur, "mask")))
+	    {
+	      field->_enum_name = enum_name;
+	      field->is_mask = TRUE;
+	    }
 	}
       else if (strcmp (xgen_xml_get_node_name (cur), "list") == 0)
 	{
@@ -259,12 +275,15 @@ xgen_parse_field_elements (XGenState * state,
 	      len_field->name = g_strdup_printf ("%s_len", field->name);
 	      len_field->definition =
 		xgen_find_type (state, extension, "CARD32");
+	      /* The list fills the remainder of the request so its length
+	       * isn't sent */
+	      len_field->implicit = TRUE;
 
 	      fields = g_list_prepend (fields, len_field);
 
 	      exp = g_new0 (XGenExpression, 1);
 	      exp->type = XGEN_FIELDREF;
-	      exp->field = g_strdup (field->name);
+	      exp->field = g_strdup (len_field->name);
 	      field->length = exp;
 	    }
 	}
@@ -398,6 +417,7 @@ xgen_open_xcb_proto_file (XGenState * state, const char *filename)
   xmlDoc *doc;
   xmlNode *root, *elem;
   char *extension_name;
+  char *extension_xname;
   char *extension_header;
   XGenExtension *extension = NULL;
 
@@ -429,18 +449,32 @@ xgen_open_xcb_proto_file (XGenState * state, const char *filename)
   extension_name = xgen_xml_get_prop (root, "extension-name");
   if (!extension_name)
     extension_name = g_strdup ("Core");
+  extension_xname = xgen_xml_get_prop (root, "extension-xname");
   extension_header = xgen_xml_get_prop (root, "header");
   g_assert (extension_header);
 
+  /* The extension may already be provided by a base state */
+  if (find_extension (state, extension_header))
+    {
+      xmlFree (extension_name);
+      xmlFree (extension_xname);
+      xmlFree (extension_header);
+      xmlFreeDoc (doc);
+      return;
+    }
+
   g_print ("Extension: %s\n", extension_name);
 
   extension = g_new0 (XGenExtension, 1);
   extension->_xml_doc = doc; /* FIXME: xmlFreeDoc */
   extension->name = g_strdup (extension_name);
   extension->header = g_strdup (extension_header);
+  extension->xname = g_strdup (extension_xname);
   state->extensions = g_list_prepend (state->extensions, extension);
 
   xmlFree (extension_name);
+  xmlFree (extension_xname);
+  xmlFree (extension_header);
 
   if (strcmp (extension->header, "xproto") == 0)
     {
@@ -489,6 +523,20 @@ xgen_open_xcb_proto_file (XGenState * state, const char *filename)
     }
 }
 
+static GList *
+prepend_header_field (XGenState *state,
+		      XGenExtension *extension,
+		      GList *fields,
+		      const char *name,
+		      const char *type_name)
+{
+  XGenFieldDefinition *field = g_new0 (XGenFieldDefinition, 1);
+
+  field->name = g_strdup (name);
+  field->definition = xgen_find_type (state, extension, type_name);
+  return g_list_prepend (fields, field);
+}
+
 /**
  * This function deals with parsing all the definitions within the xml protocol
  * specs, but assumes that the imports have been used to ensure that all
@@ -521,6 +569,7 @@ xgen_parse_xcb_proto_file (XGenState *state, XGenExtension *extension)
 	  XGenFieldDefinition *first_byte_field;
 	  GList *fields;
 	  int opcode = atoi (xgen_xml_get_prop (elem, "opcode"));
+	  gboolean core = strcmp (extension->header, "xproto") == 0;
 
 	  def = XGEN_DEF (request);
 	  def->extension = extension;
@@ -535,7 +584,9 @@ xgen_parse_xcb_proto_file (XGenState *state, XGenExtension *extension)
 
 	  fields = xgen_parse_field_elements (state, XGEN_REQUEST,
 					      extension, elem);
-	  if (!fields)
+	  /* The second byte of an extension request is its minor opcode,
+	   * otherwise it's the first 1 byte field or unused */
+	  if (!fields && core)
 	    {
 	      field = g_new0 (XGenFieldDefinition, 1);
 	      field->name = g_strdup ("pad");
@@ -550,6 +601,15 @@ xgen_parse_xcb_proto_file (XGenState *state, XGenExtension *extension)
 	    xgen_find_type (state, extension, "CARD16");
 	  fields = g_list_prepend (fields, field);
 
+	  if (!core)
+	    {
+	      field = g_new0 (XGenFieldDefinition, 1);
+	      field->name = g_strdup ("minor_opcode");
+	      field->definition =
+		xgen_find_type (state, extension, "CARD8");
+	      fields = g_list_prepend (fields, field);
+	    }
+
 	  field = g_new0 (XGenFieldDefinition, 1);
 	  field->name = g_strdup ("opcode");
 	  field->definition =
@@ -620,7 +680,7 @@ xgen_parse_xcb_proto_file (XGenState *state, XGenExtension *extension)
 	{
 	  XGenEvent *event = g_new0 (XGenEvent, 1);
 	  char *no_sequence_number;
-	  XGenFieldDefinition *field;
+	  char *xge;
 	  XGenFieldDefinition *first_byte_field;
 	  GList *fields;
 	  int number = atoi (xgen_xml_get_prop (elem, "number"));
@@ -632,27 +692,41 @@ xgen_parse_xcb_proto_file (XGenState *state, XGenExtension *extension)
 
 	  event->number = number;
 
+	  xge = xgen_xml_get_prop (elem, "xge");
+	  event->is_generic = xge && strcmp (xge, "true") == 0;
+	  xmlFree (xge);
+
 	  fields = xgen_parse_field_elements (state, XGEN_EVENT,
 					      extension, elem);
-	  first_byte_field = fields->data;
-	  fields = g_list_remove (fields, first_byte_field);
-
-	  no_sequence_number =
-	    xgen_xml_get_prop (elem, "no-sequence-number");
-	  if (!no_sequence_number)
+	  if (event->is_generic)
 	    {
-	      field = g_new0 (XGenFieldDefinition, 1);
-	      field->name = g_strdup ("sequence");
-	      field->definition = xgen_find_type (state, extension, "CARD16");
-	      fields = g_list_prepend (fields, field);
+	      /* All of the fields follow the GenericEvent header */
+	      fields = prepend_header_field (state, extension, fields,
+					     "event_type", "CARD16");
+	      fields = prepend_header_field (state, extension, fields,
+					     "length", "CARD32");
+	      fields = prepend_header_field (state, extension, fields,
+					     "sequence", "CARD16");
+	      fields = prepend_header_field (state, extension, fields,
+					     "extension", "CARD8");
+	      fields = prepend_header_field (state, extension, fields,
+					     "response_type", "BYTE");
 	    }
+	  else
+	    {
+	      first_byte_field = fields->data;
+	      fields = g_list_remove (fields, first_byte_field);
 
-	  fields = g_list_prepend (fields, first_byte_field);
+	      no_sequence_number =
+		xgen_xml_get_prop (elem, "no-sequence-number");
+	      if (!no_sequence_number)
+		fields = prepend_header_field (state, extension, fields,
+					       "sequence", "CARD16");
 
-	  field = g_new0 (XGenFieldDefinition, 1);
-	  field->name = g_strdup ("response_type");
-	  field->definition = xgen_find_type (state, extension, "BYTE");
-	  fields = g_list_prepend (fields, field);
+	      fields = g_list_prepend (fields, first_byte_field);
+	      fields = prepend_header_field (state, extension, fields,
+					     "response_type", "BYTE");
+	    }
 
 	  event->fields = fields;
 
@@ -680,6 +754,7 @@ xgen_parse_xcb_proto_file (XGenState *state, XGenExtension *extension)
 	  event->fields = copy_of->fields;
 	  /* So that we don't double free the fields: */
 	  event->is_copy = TRUE;
+	  event->is_generic = copy_of->is_generic;
 
 	  extension->events = g_list_prepend (extension->events, event);
           if (event_handlers && event_handlers->event_notify)
@@ -702,9 +777,10 @@ xgen_parse_xcb_proto_file (XGenState *state, XGenExtension *extension)
 	  fields = xgen_parse_field_elements (state, XGEN_ERROR,
 					      extension, elem);
 
+	  /* NB: we are prepending so these are in reverse wire order */
 	  field = g_new0 (XGenFieldDefinition, 1);
-	  field->name = g_strdup ("response");
-	  field->definition = xgen_find_type (state, extension, "BYTE");
+	  field->name = g_strdup ("sequence");
+	  field->definition = xgen_find_type (state, extension, "CARD16");
 	  fields = g_list_prepend (fields, field);
 
 	  field = g_new0 (XGenFieldDefinition, 1);
@@ -713,8 +789,8 @@ xgen_parse_xcb_proto_file (XGenState *state, XGenExtension *extension)
 	  fields = g_list_prepend (fields, field);
 
 	  field = g_new0 (XGenFieldDefinition, 1);
-	  field->name = g_strdup ("sequence");
-	  field->definition = xgen_find_type (state, extension, "CARD16");
+	  field->name = g_strdup ("response");
+	  field->definition = xgen_find_type (state, extension, "BYTE");
 	  fields = g_list_prepend (fields, field);
 
 	  error->fields = fields;
@@ -990,7 +1066,9 @@ resolve_imports (XGenState *state)
 {
   GList *tmp;
 
-  for (tmp = state->extensions; tmp != NULL; tmp=tmp->next)
+  for (tmp = state->extensions;
+       tmp != state->_shared_extensions;
+       tmp = tmp->next)
     {
       XGenExtension *extension = tmp->data;
       GList *tmp2;
@@ -1016,6 +1094,122 @@ resolve_imports (XGenState *state)
   return TRUE;
 }
 
+/* Frees an extension that was opened but whose definitions haven't been
+ * parsed, which only has its core types */
+static void
+free_unparsed_extension (XGenExtension *extension)
+{
+  GList *tmp;
+
+  for (tmp = extension->base_types; tmp != NULL; tmp = tmp->next)
+    {
+      XGenDefinition *def = tmp->data;
+
+      g_free (def->name);
+      g_free (def);
+    }
+  g_list_free (extension->base_types);
+  g_list_free (extension->all_definitions);
+
+  for (tmp = extension->_import_headers; tmp != NULL; tmp = tmp->next)
+    g_free (tmp->data);
+  g_list_free (extension->_import_headers);
+  g_list_free (extension->imports);
+
+  xmlFreeDoc (extension->_xml_doc);
+  g_free (extension->name);
+  g_free (extension->header);
+  g_free (extension->xname);
+  g_free (extension);
+}
+
+/**
+ * _xgen_definition_get_fields:
+ * @def: A definition
+ *
+ * This function returns the list of XGenFieldDefinitions for definitions
+ * that have fields, or NULL.
+ */
+GList *
+_xgen_definition_get_fields (const XGenDefinition *def)
+{
+  switch (def->type)
+    {
+    case XGEN_STRUCT:
+      return XGEN_STRUCT_DEF (def)->fields;
+    case XGEN_UNION:
+      return XGEN_UNION_DEF (def)->fields;
+    case XGEN_REQUEST:
+      return XGEN_REQUEST_DEF (def)->fields;
+    case XGEN_REPLY:
+      return XGEN_REPLYDEF (def)->fields;
+    case XGEN_EVENT:
+      return XGEN_EVENT_DEF (def)->fields;
+    case XGEN_ERROR:
+      return XGEN_ERROR_DEF (def)->fields;
+    default:
+      return NULL;
+    }
+}
+
+static XGenEnum *
+find_enum (XGenState *state, const XGenExtension *extension, char *name)
+{
+  XGenDefinition *def = NULL;
+
+  if (!strchr (name, ':'))
+    {
+      def = xgen_find_type_in_extension ((XGenExtension *)extension, name);
+      if (def && def->type != XGEN_ENUM)
+	def = NULL;
+    }
+  if (!def)
+    def = xgen_state_find_definition (state, name, XGEN_ENUM);
+
+  return XGEN_ENUM_DEF (def);
+}
+
+/**
+ * Links fields to the enums named by their enum, altenum or mask
+ * attributes. This is done after parsing everything since the enums may
+ * be defined after the fields that reference them.
+ */
+static void
+resolve_field_enums (XGenState *state)
+{
+  GList *tmp;
+
+  for (tmp = state->extensions;
+       tmp != state->_shared_extensions;
+       tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+      GList *tmp2;
+
+      for (tmp2 = extension->all_definitions; tmp2 != NULL; tmp2 = tmp2->next)
+	{
+	  XGenDefinition *def = tmp2->data;
+	  GList *tmp3;
+
+	  for (tmp3 = _xgen_definition_get_fields (def);
+	       tmp3 != NULL;
+	       tmp3 = tmp3->next)
+	    {
+	      XGenFieldDefinition *field = tmp3->data;
+
+	      if (!field->_enum_name || field->enum_def)
+		continue;
+
+	      field->enum_def = find_enum (state, extension,
+					   field->_enum_name);
+	      if (!field->enum_def)
+		g_warning ("Failed to find enum %s for field %s of %s",
+			   field->_enum_name, field->name, def->name);
+	    }
+	}
+    }
+}
+
 /**
  * xgen_parse_xcb_proto_files:
  * @files: A list of xcb xml protocol descriptions
@@ -1028,6 +1222,30 @@ resolve_imports (XGenState *state)
  */
 XGenState *
 xgen_parse_xcb_proto_files (GList *files)
+{
+  return xgen_parse_xcb_proto_files_with_base (NULL, files);
+}
+
+/**
+ * xgen_parse_xcb_proto_files_with_base:
+ * @base: A parsed state to build on, or NULL
+ * @files: A list of xcb xml protocol descriptions
+ *
+ * Parses @files like xgen_parse_xcb_proto_files() but first makes every
+ * extension of @base part of the new state by reference. The new files
+ * can import those extensions and name their types, and the new state
+ * only allocates what the files add. Files for extensions that @base
+ * already has are skipped, so e.g. xproto only needs parsing once for
+ * any number of states using different sets of extensions.
+ *
+ * @base is never modified, so it can be shared by states being created
+ * and used in any number of threads, but it must outlive them. An
+ * embedded state can be used as a base.
+ *
+ * This function returns NULL if there was a problem in parsing the files
+ */
+XGenState *
+xgen_parse_xcb_proto_files_with_base (const XGenState *base, GList *files)
 {
   XGenState  *state = g_new0 (XGenState, 1);
   unsigned long l = 1;
@@ -1035,11 +1253,30 @@ xgen_parse_xcb_proto_files (GList *files)
 
   state->host_is_little_endian = *(unsigned char *)&l ? TRUE : FALSE;
 
+  /* The extensions parsed into this state get prepended so the shared
+   * ones always stay at the tail of the list, and lookups fall through
+   * to them */
+  if (base)
+    {
+      state->extensions = g_list_copy (base->extensions);
+      state->_shared_extensions = state->extensions;
+    }
+
   for (tmp = files; tmp != NULL; tmp = tmp->next)
     xgen_open_xcb_proto_file (state, tmp->data);
 
   if (!resolve_imports (state))
-    return NULL;
+    {
+      /* Only the extensions opened for this state are freed; the list
+       * itself, including the shared tail, is a copy */
+      for (tmp = state->extensions;
+	   tmp != state->_shared_extensions;
+	   tmp = tmp->next)
+	free_unparsed_extension (tmp->data);
+      g_list_free (state->extensions);
+      g_free (state);
+      return NULL;
+    }
 
   for (tmp = state->extensions; tmp != NULL; tmp = tmp->next)
     {
@@ -1047,7 +1284,9 @@ xgen_parse_xcb_proto_files (GList *files)
       xgen_parse_xcb_proto_and_imports (state, extension);
     }
 
-  /* FIXME: Clean things up if there was an error resolving things! */
+  resolve_field_enums (state);
+  _xgen_compute_layouts (state);
+  _xgen_compute_fingerprints (state);
 
   return state;
 }
@@ -1058,6 +1297,154 @@ xgen_set_handlers (XGenEventHandlers *handlers)
     event_handlers = handlers;
 }
 
+XGenEventHandlers *
+_xgen_get_handlers (void)
+{
+  return event_handlers;
+}
+
+/**
+ * _xgen_notify_definition:
+ * @def: A parsed definition
+ *
+ * Calls the current handlers for @def as if it had just been parsed:
+ * first the notify for its type and then definition_notify. The
+ * valueparams of a request are notified before the request itself.
+ */
+void
+_xgen_notify_definition (XGenDefinition *def)
+{
+  if (!event_handlers)
+    return;
+
+  switch (def->type)
+    {
+    case XGEN_VOID:
+    case XGEN_BOOLEAN:
+    case XGEN_CHAR:
+    case XGEN_SIGNED:
+    case XGEN_UNSIGNED:
+    case XGEN_XID:
+    case XGEN_FLOAT:
+    case XGEN_DOUBLE:
+      if (event_handlers->base_notify)
+	event_handlers->base_notify (XGEN_BASE_TYPE_DEF (def));
+      break;
+    case XGEN_STRUCT:
+      if (event_handlers->struct_notify)
+	event_handlers->struct_notify (XGEN_STRUCT_DEF (def));
+      break;
+    case XGEN_UNION:
+      if (event_handlers->union_notify)
+	event_handlers->union_notify (XGEN_UNION_DEF (def));
+      break;
+    case XGEN_XIDUNION:
+      if (event_handlers->xid_union_notify)
+	event_handlers->xid_union_notify (XGEN_XID_UNION_DEF (def));
+      break;
+    case XGEN_ENUM:
+      if (event_handlers->enum_notify)
+	event_handlers->enum_notify (XGEN_ENUM_DEF (def));
+      break;
+    case XGEN_TYPEDEF:
+      if (event_handlers->typedef_notify)
+	event_handlers->typedef_notify (XGEN_TYPEDEF_DEF (def));
+      break;
+    case XGEN_REQUEST:
+      {
+	GList *tmp;
+
+	for (tmp = XGEN_REQUEST_DEF (def)->fields; tmp; tmp = tmp->next)
+	  {
+	    XGenFieldDefinition *field = tmp->data;
+
+	    if (field->definition->type == XGEN_VALUEPARAM)
+	      _xgen_notify_definition (field->definition);
+	  }
+
+	if (event_handlers->request_notify)
+	  event_handlers->request_notify (XGEN_REQUEST_DEF (def));
+	break;
+      }
+    case XGEN_VALUEPARAM:
+      if (event_handlers->valueparam_notify)
+	event_handlers->valueparam_notify (XGEN_VALUE_PARAM_DEF (def));
+      break;
+    case XGEN_REPLY:
+      if (event_handlers->reply_notify)
+	event_handlers->reply_notify (XGEN_REPLYDEF (def));
+      break;
+    case XGEN_EVENT:
+      if (event_handlers->event_notify)
+	event_handlers->event_notify (XGEN_EVENT_DEF (def));
+      break;
+    case XGEN_ERROR:
+      if (event_handlers->error_notify)
+	event_handlers->error_notify (XGEN_ERROR_DEF (def));
+      break;
+    }
+
+  if (event_handlers->definition_notify)
+    event_handlers->definition_notify (def);
+}
+
+/**
+ * xgen_state_find_extension:
+ * @state: The parsed protocol state
+ * @header: The extension header name, e.g. "xproto" or "shape"
+ *
+ * This function returns the extension with the given header name or NULL
+ * if there is no such extension.
+ */
+XGenExtension *
+xgen_state_find_extension (const XGenState *state, const char *header)
+{
+  return find_extension ((XGenState *)state, (gchar *)header);
+}
+
+/**
+ * xgen_state_find_definition:
+ * @state: The parsed protocol state
+ * @name: A definition name as "header:Name", or just "Name" to search every
+ *	  extension
+ * @type: The type of definition to find
+ *
+ * Since requests and their replies share a name, the type is used to
+ * choose between them.
+ *
+ * This function returns the definition or NULL if there is no match.
+ */
+XGenDefinition *
+xgen_state_find_definition (const XGenState *state,
+			    const char *name,
+			    XGenType type)
+{
+  const char *separator = strchr (name, ':');
+  const char *type_name = separator ? separator + 1 : name;
+  GList *tmp;
+
+  for (tmp = state->extensions; tmp != NULL; tmp = tmp->next)
+    {
+      XGenExtension *extension = tmp->data;
+      GList *tmp2;
+
+      if (separator
+	  && (strncmp (extension->header, name, separator - name) != 0
+	      || extension->header[separator - name] != '\0'))
+	continue;
+
+      for (tmp2 = extension->all_definitions; tmp2 != NULL; tmp2 = tmp2->next)
+	{
+	  XGenDefinition *def = tmp2->data;
+
+	  if (def->type == type && strcmp (def->name, type_name) == 0)
+	    return def;
+	}
+    }
+
+  return NULL;
+}
+
 
 void *
 xgen_definition_get_private (const XGenDefinition *def)
@@ -34,10 +34,14 @@ typedef enum _XGenType
   XGEN_ERROR
 } XGenType;
 
+typedef struct _XGenLayout XGenLayout;
+
 typedef struct _XGenExtension
 {
   char	*name;
   char  *header;
+  char  *xname;	/* The name to query the server with, or NULL for the
+		   core protocol */
 
   GList *imports;
 
@@ -59,6 +63,7 @@ typedef struct _XGenExtension
   xmlDoc *_xml_doc;
   GList *_import_headers;
   gboolean _parsed;
+  guint64 _fingerprint;
 
 } XGenExtension;
 
@@ -69,6 +74,10 @@ typedef struct _XGenDefinition
   char		      *name;
 
   void		      *_private; /* application private data */
+
+  /* Private */
+  const XGenLayout    *_layout;
+  guint64	       _fingerprint;
 } XGenDefinition;
 
 /**
@@ -214,10 +223,13 @@ typedef struct _XGenEvent
 {
   XGenDefinition   _parent;
 
-  unsigned char	   number;
+  unsigned char	   number;  /* The evtype for generic events */
   GList		  *fields;
   gboolean	   is_copy; /* If true then the fields are owned by another
 			       XGenEvent */
+  gboolean	   is_generic; /* If true the event is sent as an extension's
+				  GenericEvent and may be longer than 32
+				  bytes */
 } XGenEvent;
 /**
  * Casts a generic definition into an event definition
@@ -281,6 +293,16 @@ typedef struct _XGenFieldDefinition
   char *name;
   XGenDefinition *definition;
   XGenExpression *length;      /* List length. NULL for non-list */
+  gboolean implicit;	       /* If true then the field isn't part of the
+				  wire format, e.g. the length of a request
+				  list that's implied by the request length */
+  XGenEnum *enum_def;	       /* The enum that names the field's values,
+				  or NULL */
+  gboolean is_mask;	       /* If true then the enum names the bits of
+				  the field's value */
+
+  /* Private */
+  char *_enum_name;
 } XGenFieldDefinition;
 
 typedef struct _XGenFieldValue
@@ -310,10 +332,33 @@ typedef struct _XGenItemDefinition
   guint		 bit;
 } XGenItemDefinition;
 
+/**
+ * The direction a raw protocol message was travelling
+ */
+typedef enum _XGenDirection
+{
+  XGEN_CLIENT_TO_SERVER,
+  XGEN_SERVER_TO_CLIENT
+} XGenDirection;
+
+/**
+ * The byte order of raw protocol messages, as chosen by the client
+ * during connection setup.
+ */
+typedef enum _XGenByteOrder
+{
+  XGEN_LSB_FIRST,
+  XGEN_MSB_FIRST
+} XGenByteOrder;
+
 typedef struct _XGenState
 {
   gboolean   host_is_little_endian;
   GList	    *extensions;
+
+  /* Private */
+  GList	    *_shared_extensions; /* The tail of extensions that belongs to
+				    a base state */
 } XGenState;
 
 
@@ -336,8 +381,19 @@ typedef struct _XGenEventHandlers
 
 void xgen_set_handlers (XGenEventHandlers *handlers);
 XGenState *xgen_parse_xcb_proto_files (GList *files);
+XGenState *xgen_parse_xcb_proto_files_with_base (const XGenState *base,
+						 GList *files);
+
+XGenExtension *xgen_state_find_extension (const XGenState *state,
+					  const char *header);
+XGenDefinition *xgen_state_find_definition (const XGenState *state,
+					    const char *name,
+					    XGenType type);
 
 void *xgen_definition_get_private (const XGenDefinition *def);
 void xgen_definition_set_private (XGenDefinition *def, void *data);
 
+guint64 xgen_definition_get_fingerprint (const XGenDefinition *def);
+guint64 xgen_extension_get_fingerprint (const XGenExtension *extension);
+
 #endif /* _XGEN_H_ */